@@ -16,6 +16,9 @@
 
 #include <synapse_topic_list.h>
 
+#include <cerebri/core/log_utils.h>
+
+#include "gains.h"
 #include "input_mapping.h"
 #include "mixing.h"
 
@@ -34,7 +37,6 @@ struct context {
 	synapse_pb_Twist cmd_vel;
 	struct zros_sub sub_status, sub_cmd_vel, sub_input;
 	struct zros_pub pub_actuators;
-	const double wheel_radius;
 	const double max_turn_angle;
 	const double max_velocity;
 	struct k_sem running;
@@ -52,7 +54,6 @@ static struct context g_ctx = {
 	.sub_status = {},
 	.sub_cmd_vel = {},
 	.pub_actuators = {},
-	.wheel_radius = CONFIG_CEREBRI_B3RB_WHEEL_RADIUS_MM / 1000.0,
 	.max_turn_angle = CONFIG_CEREBRI_B3RB_MAX_TURN_ANGLE_MRAD / 1000.0,
 	.max_velocity = CONFIG_CEREBRI_B3RB_MAX_VELOCITY_MM_S / 1000.0,
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
@@ -145,17 +146,19 @@ static void b3rb_command_run(void *p0, void *p1, void *p2)
 		dt = (double)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
 		ticks_last = ticks_now;
 		if (dt < 0 || dt > 0.5) {
-			LOG_ERR("input update rate too low: %10.4f", dt);
+			CEREBRI_LOG_ERR_LIMIT("input update rate too low: %10.4f", dt);
 			continue;
 		}
 
 		if (ctx->status.mode == synapse_pb_Status_Mode_MODE_ACTUATORS) {
 
+			const struct b3rb_geometry_param *geometry =
+				PARAM_GET(b3rb_geometry, struct b3rb_geometry_param);
 			double turn_angle = -ctx->max_turn_angle *
 					    (double)ctx->input.channel[CH_RIGHT_STICK_RIGHT];
 			double omega_fwd = ctx->max_velocity *
 					   (double)ctx->input.channel[CH_LEFT_STICK_UP] /
-					   ctx->wheel_radius;
+					   geometry->wheel_radius;
 
 			bool armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
 
@@ -12,17 +12,21 @@
 #include <zephyr/shell/shell.h>
 
 #include <zros/private/zros_node_struct.h>
-#include <zros/private/zros_pub_struct.h>
 #include <zros/private/zros_sub_struct.h>
 #include <zros/zros_node.h>
-#include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <synapse_sync.h>
 #include <synapse_topic_list.h>
 
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/clock_sync.h>
+#include <cerebri/core/log_utils.h>
+#include <cerebri/core/perf_duration.h>
+#include <cerebri/core/state_history.h>
 
 #include "app/b3rb/casadi/b3rb.h"
+#include "gains.h"
 
 #define MY_STACK_SIZE 4096
 #define MY_PRIORITY   4
@@ -31,10 +35,29 @@
 #define M_PI 3.14159265358979323846
 #endif
 
+#define SLOP_US          CONFIG_CEREBRI_B3RB_ESTIMATE_WHEEL_ODOMETRY_SLOP_US
+#define PARKED_GYRO      (CONFIG_CEREBRI_B3RB_ESTIMATE_PARKED_GYRO_MRAD_S * 1e-3)
+#define PARKED_SPEED     (CONFIG_CEREBRI_B3RB_ESTIMATE_PARKED_SPEED_MM_S * 1e-3)
+#define PUBLISH_DIST     (CONFIG_CEREBRI_B3RB_ESTIMATE_PUBLISH_MM * 1e-3)
+#define PUBLISH_HEADING  (CONFIG_CEREBRI_B3RB_ESTIMATE_PUBLISH_MRAD * 1e-3)
+#define PUBLISH_MAX_MS   CONFIG_CEREBRI_B3RB_ESTIMATE_PUBLISH_MAX_MS
+#define UPDATE_BUDGET_US CONFIG_CEREBRI_B3RB_ESTIMATE_BUDGET_US
+
 LOG_MODULE_REGISTER(b3rb_estimate, CONFIG_CEREBRI_B3RB_LOG_LEVEL);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+// one prediction, the state it ended in and the inputs that took it there
+struct history_entry {
+	casadi_real x[3];
+	casadi_real delta_theta;
+	casadi_real u;
+};
+
+STATE_HISTORY_DEFINE(g_history, struct history_entry, CONFIG_CEREBRI_B3RB_ESTIMATE_HISTORY_LENGTH);
+#endif
+
 // private context
 struct context {
 	struct zros_node node;
@@ -42,9 +65,30 @@ struct context {
 	synapse_pb_Imu imu;
 	synapse_pb_Odometry odometry;
 	struct zros_sub sub_wheel_odometry, sub_imu;
-	struct zros_pub pub_odometry;
-	double x[3];
-	const double wheel_radius;
+	struct synapse_sync sync;
+	// cost of each prediction or measurement update against its budget
+	struct perf_duration perf_update;
+	double rotation_last;
+	int64_t predict_ns;
+	casadi_real omega;
+	casadi_real u;
+	// predictions skipped with the rover parked
+	uint32_t parked;
+	// pose last published and when
+	casadi_real x_published[3];
+	int64_t published_ticks;
+	uint32_t held;
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+	synapse_pb_Odometry odometry_ethernet;
+	struct zros_sub sub_odometry_ethernet;
+	struct perf_duration perf_replay;
+	// stamp of the last offboard odometry fused
+	int64_t fused_stamp_ns;
+	uint32_t fused;
+	uint32_t too_late;
+	uint32_t out_of_order;
+#endif
+	casadi_real x[3];
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -67,9 +111,12 @@ static struct context g_ctx = {
 		},
 	.sub_wheel_odometry = {},
 	.sub_imu = {},
-	.pub_odometry = {},
+	.sync = {},
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+	.odometry_ethernet = synapse_pb_Odometry_init_default,
+	.sub_odometry_ethernet = {},
+#endif
 	.x = {},
-	.wheel_radius = CONFIG_CEREBRI_B3RB_WHEEL_RADIUS_MM / 1000.0,
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
@@ -80,16 +127,37 @@ static void b3rb_estimate_init(struct context *ctx)
 {
 	zros_node_init(&ctx->node, "b3rb_estimate");
 	zros_sub_init(&ctx->sub_imu, &ctx->node, &topic_imu, &ctx->imu, 10);
+	// every wheel odometry message, so one within the slop of the imu is at hand
 	zros_sub_init(&ctx->sub_wheel_odometry, &ctx->node, &topic_wheel_odometry,
-		      &ctx->wheel_odometry, 10);
-	zros_pub_init(&ctx->pub_odometry, &ctx->node, &topic_odometry_estimator, &ctx->odometry);
+		      &ctx->wheel_odometry, 0);
+	synapse_sync_init(&ctx->sync, SYNAPSE_SYNC_APPROXIMATE, SLOP_US);
+	synapse_sync_add(&ctx->sync, &ctx->sub_imu, &ctx->imu.stamp);
+	synapse_sync_add(&ctx->sync, &ctx->sub_wheel_odometry, &ctx->wheel_odometry.stamp);
+	perf_duration_init(&ctx->perf_update, "b3rb estimator update", UPDATE_BUDGET_US * 1e-6);
+	ctx->parked = 0;
+	ctx->published_ticks = 0;
+	ctx->held = 0;
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+	zros_sub_init(&ctx->sub_odometry_ethernet, &ctx->node, &topic_odometry_ethernet,
+		      &ctx->odometry_ethernet, 0);
+	perf_duration_init(&ctx->perf_replay, "b3rb estimator replay", 1e-3);
+	state_history_reset(&g_history);
+	ctx->fused_stamp_ns = 0;
+	ctx->fused = 0;
+	ctx->too_late = 0;
+	ctx->out_of_order = 0;
+#endif
 	k_sem_take(&ctx->running, K_FOREVER);
 	LOG_INF("init");
 }
 
 static void b3rb_estimate_fini(struct context *ctx)
 {
-	zros_pub_fini(&ctx->pub_odometry);
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+	perf_duration_fini(&ctx->perf_replay);
+	zros_sub_fini(&ctx->sub_odometry_ethernet);
+#endif
+	perf_duration_fini(&ctx->perf_update);
 	zros_sub_fini(&ctx->sub_wheel_odometry);
 	zros_sub_fini(&ctx->sub_imu);
 	zros_node_fini(&ctx->node);
@@ -97,7 +165,7 @@ static void b3rb_estimate_fini(struct context *ctx)
 	LOG_INF("fini");
 }
 
-static bool all_finite(double *src, size_t n)
+static bool all_finite(casadi_real *src, size_t n)
 {
 	for (size_t i = 0; i < n; i++) {
 		if (!isfinite(src[i])) {
@@ -107,12 +175,12 @@ static bool all_finite(double *src, size_t n)
 	return true;
 }
 
-static void handle_update(struct context *ctx, double *x1)
+static void handle_update(struct context *ctx, casadi_real *x1)
 {
 	bool x1_finite = all_finite(x1, ARRAY_SIZE(ctx->x));
 
 	if (!x1_finite) {
-		LOG_WRN("x1 update not finite");
+		CEREBRI_LOG_WRN_LIMIT("x1 update not finite");
 	}
 
 	if (x1_finite) {
@@ -120,6 +188,165 @@ static void handle_update(struct context *ctx, double *x1)
 	}
 }
 
+static void b3rb_estimate_predict_state(casadi_real *x, casadi_real delta_theta, casadi_real u)
+{
+	/* predict:(x0[3],omega,u)->(x1[3]) */
+	casadi_real x1[3];
+
+	CASADI_FUNC_ARGS(predict);
+	args[0] = x;
+	args[1] = &delta_theta;
+	args[2] = &u;
+	res[0] = x1;
+	CASADI_FUNC_CALL(predict);
+
+	memcpy(x, x1, sizeof(x1));
+}
+
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+static void b3rb_estimate_record(struct context *ctx, casadi_real delta_theta, casadi_real u)
+{
+	struct history_entry *entry =
+		state_history_push(&g_history, clock_sync_ticks_to_ns(k_uptime_ticks()));
+	memcpy(entry->x, ctx->x, sizeof(entry->x));
+	entry->delta_theta = delta_theta;
+	entry->u = u;
+}
+
+/*
+ * Reset the planar pose to the offboard odometry at the prediction its
+ * stamp falls in, then replay the predictions since with their stored
+ * wheel and gyro inputs.
+ */
+static void b3rb_estimate_fuse_delayed(struct context *ctx)
+{
+	const synapse_pb_Timestamp *stamp = &ctx->odometry_ethernet.stamp;
+	int64_t stamp_ns = (int64_t)stamp->seconds * 1000000000LL + stamp->nanos;
+
+	if (stamp_ns <= ctx->fused_stamp_ns) {
+		ctx->out_of_order++;
+		return;
+	}
+
+	int age = state_history_find(&g_history, stamp_ns);
+	if (age < 0) {
+		ctx->too_late++;
+		return;
+	}
+
+	perf_duration_start(&ctx->perf_replay);
+
+	const synapse_pb_Quaternion *q = &ctx->odometry_ethernet.pose.orientation;
+	struct history_entry *entry = state_history_get(&g_history, age);
+	casadi_real x[3];
+	x[0] = ctx->odometry_ethernet.pose.position.x;
+	x[1] = ctx->odometry_ethernet.pose.position.y;
+	x[2] = atan2(2 * (q->w * q->z + q->x * q->y), 1 - 2 * (q->y * q->y + q->z * q->z));
+	memcpy(entry->x, x, sizeof(x));
+
+	for (int i = age - 1; i >= 0; i--) {
+		entry = state_history_get(&g_history, i);
+		b3rb_estimate_predict_state(x, entry->delta_theta, entry->u);
+		memcpy(entry->x, x, sizeof(x));
+	}
+
+	handle_update(ctx, x);
+	ctx->fused_stamp_ns = stamp_ns;
+	ctx->fused++;
+
+	perf_duration_stop(&ctx->perf_replay);
+}
+#endif
+
+/*
+ * Prediction on an imu sample and the wheel odometry aligned with it. A
+ * rover can not turn with its wheels standing still, so with the wheel
+ * speed and the yaw rate below their noise the state is left as it is.
+ */
+static void b3rb_estimate_predict(struct context *ctx)
+{
+	if (!synapse_sync_is_aligned(&ctx->sync, 1)) {
+		LOG_DBG("wheel odometry not aligned with imu");
+	}
+
+	// calculate dt
+	int64_t now_ns = synapse_uptime_ns();
+	casadi_real dt = (now_ns - ctx->predict_ns) * 1e-9;
+	ctx->predict_ns = now_ns;
+	if (dt < 0 || dt > 0.5) {
+		CEREBRI_LOG_WRN_LIMIT("imu update rate too low");
+		return;
+	}
+
+	// get data
+	double rotation = ctx->wheel_odometry.rotation;
+
+	// negative sign due to current gearing, should be in driver
+	const struct b3rb_geometry_param *geometry =
+		PARAM_GET(b3rb_geometry, struct b3rb_geometry_param);
+	ctx->u = (rotation - ctx->rotation_last) * geometry->wheel_radius;
+	ctx->rotation_last = rotation;
+
+	ctx->omega = ctx->imu.angular_velocity.z;
+	// LOG_DBG("imu omega z: %10.4f", omega);
+
+	// u is the travel since the last prediction
+	if (fabs(ctx->u) < PARKED_SPEED * dt && fabs(ctx->omega) < PARKED_GYRO) {
+		ctx->parked++;
+		return;
+	}
+
+	perf_duration_start(&ctx->perf_update);
+
+	casadi_real delta_theta = ctx->omega * dt;
+	casadi_real x1[3];
+
+	// LOG_DBG("predict");
+	memcpy(x1, ctx->x, sizeof(x1));
+	b3rb_estimate_predict_state(x1, delta_theta, ctx->u);
+
+	// update x, W
+	handle_update(ctx, x1);
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+	b3rb_estimate_record(ctx, delta_theta, ctx->u);
+#endif
+
+	perf_duration_stop(&ctx->perf_update);
+}
+
+// publish once the pose moved past the thresholds, a still pose at the max period
+static void b3rb_estimate_publish(struct context *ctx)
+{
+	int64_t now_ticks = k_uptime_ticks();
+	casadi_real dx = ctx->x[0] - ctx->x_published[0];
+	casadi_real dy = ctx->x[1] - ctx->x_published[1];
+	casadi_real dtheta = remainder(ctx->x[2] - ctx->x_published[2], 2 * M_PI);
+	bool moved = sqrt(dx * dx + dy * dy) >= PUBLISH_DIST || fabs(dtheta) >= PUBLISH_HEADING;
+
+	if (!moved && ctx->published_ticks != 0 &&
+	    now_ticks - ctx->published_ticks < k_ms_to_ticks_ceil64(PUBLISH_MAX_MS)) {
+		ctx->held++;
+		return;
+	}
+
+	stamp_msg_now(&ctx->odometry.stamp);
+
+	casadi_real theta = ctx->x[2];
+	ctx->odometry.pose.position.x = ctx->x[0];
+	ctx->odometry.pose.position.y = ctx->x[1];
+	ctx->odometry.pose.position.z = 0;
+	ctx->odometry.pose.orientation.x = 0;
+	ctx->odometry.pose.orientation.y = 0;
+	ctx->odometry.pose.orientation.z = sin(theta / 2);
+	ctx->odometry.pose.orientation.w = cos(theta / 2);
+	ctx->odometry.twist.angular.z = ctx->omega;
+	ctx->odometry.twist.linear.x = ctx->u;
+	synapse_loan_publish_copy(&loan_odometry_estimator, &ctx->odometry);
+
+	memcpy(ctx->x_published, ctx->x, sizeof(ctx->x_published));
+	ctx->published_ticks = now_ticks;
+}
+
 static void b3rb_estimate_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -131,110 +358,56 @@ static void b3rb_estimate_run(void *p0, void *p1, void *p2)
 	// LOG_DBG("started");
 	b3rb_estimate_init(ctx);
 
-	// variables
-	double rotation_last = 0;
-
-	struct k_poll_event events[1] = {};
-
-	// wait for imu
-	LOG_DBG("waiting for imu");
-	events[0] = *zros_sub_get_event(&ctx->sub_imu);
-	rc = k_poll(events, ARRAY_SIZE(events), K_FOREVER);
+	// wait for imu and wheel odometry
+	LOG_DBG("waiting for imu and wheel odometry");
+	rc = synapse_sync_wait(&ctx->sync, K_FOREVER);
 	if (rc != 0) {
 		LOG_DBG("did not receive imu");
 		return;
 	}
-	if (zros_sub_update_available(&ctx->sub_imu)) {
-		zros_sub_update(&ctx->sub_imu);
-	}
-
-	// wait for wheel odometry
-	LOG_DBG("waiting for wheel odometry");
-	events[0] = *zros_sub_get_event(&ctx->sub_wheel_odometry);
-	rc = k_poll(events, ARRAY_SIZE(events), K_FOREVER);
-	if (rc != 0) {
-		LOG_DBG("did not receive wheel odometry");
-		return;
-	}
-	if (zros_sub_update_available(&ctx->sub_wheel_odometry)) {
-		zros_sub_update(&ctx->sub_wheel_odometry);
-	}
-
-	double dt = 0;
-	int64_t ticks_last = k_uptime_ticks();
 
-	// poll on imu
-	events[0] = *zros_sub_get_event(&ctx->sub_imu);
+	ctx->rotation_last = 0;
+	ctx->predict_ns = synapse_uptime_ns();
 
 	// estimator state
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 
-		// poll for imu
+		// wake on whichever measurement arrives first
+		struct k_poll_event events[] = {
+			*zros_sub_get_event(&ctx->sub_imu),
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+			*zros_sub_get_event(&ctx->sub_odometry_ethernet),
+#endif
+		};
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
 		if (rc != 0) {
-			LOG_DBG("not receiving imu");
+			CEREBRI_LOG_DBG_LIMIT("not receiving imu");
 			continue;
 		}
 
-		if (zros_sub_update_available(&ctx->sub_imu)) {
-			zros_sub_update(&ctx->sub_imu);
-		}
-
-		if (zros_sub_update_available(&ctx->sub_wheel_odometry)) {
-			zros_sub_update(&ctx->sub_wheel_odometry);
-		}
+		bool updated = false;
 
-		// calculate dt
-		int64_t ticks_now = k_uptime_ticks();
-		dt = (double)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-		ticks_last = ticks_now;
-		if (dt < 0 || dt > 0.5) {
-			LOG_WRN("imu update rate too low");
-			continue;
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+		// measurement update the moment offboard odometry arrives
+		if (zros_sub_update_available(&ctx->sub_odometry_ethernet)) {
+			zros_sub_update(&ctx->sub_odometry_ethernet);
+			perf_duration_start(&ctx->perf_update);
+			b3rb_estimate_fuse_delayed(ctx);
+			perf_duration_stop(&ctx->perf_update);
+			updated = true;
 		}
+#endif
 
-		// get data
-		double rotation = ctx->wheel_odometry.rotation;
-
-		// negative sign due to current gearing, should be in driver
-		double u = (rotation - rotation_last) * ctx->wheel_radius;
-		rotation_last = rotation;
-
-		double omega = ctx->imu.angular_velocity.z;
-		// LOG_DBG("imu omega z: %10.4f", omega);
-
-		/* predict:(x0[3],omega,u)->(x1[3]) */
-		{
-			double delta_theta = omega * dt;
-			double x1[3];
-
-			// LOG_DBG("predict");
-			CASADI_FUNC_ARGS(predict);
-			args[0] = ctx->x;
-			args[1] = &delta_theta;
-			args[2] = &u;
-			res[0] = x1;
-			CASADI_FUNC_CALL(predict);
-
-			// update x, W
-			handle_update(ctx, x1);
+		// imu and the wheel odometry sample aligned with it, held back for at most the slop
+		if (zros_sub_update_available(&ctx->sub_imu) &&
+		    synapse_sync_wait(&ctx->sync, K_USEC(2 * SLOP_US)) == 0) {
+			b3rb_estimate_predict(ctx);
+			updated = true;
 		}
 
-		// publish odometry
-		{
-			stamp_msg(&ctx->odometry.stamp, k_uptime_ticks());
-
-			double theta = ctx->x[2];
-			ctx->odometry.pose.position.x = ctx->x[0];
-			ctx->odometry.pose.position.y = ctx->x[1];
-			ctx->odometry.pose.position.z = 0;
-			ctx->odometry.pose.orientation.x = 0;
-			ctx->odometry.pose.orientation.y = 0;
-			ctx->odometry.pose.orientation.z = sin(theta / 2);
-			ctx->odometry.pose.orientation.w = cos(theta / 2);
-			ctx->odometry.twist.angular.z = omega;
-			ctx->odometry.twist.linear.x = u;
-			zros_pub_update(&ctx->pub_odometry);
+		// a parked rover is still published at the max period
+		if (updated) {
+			b3rb_estimate_publish(ctx);
 		}
 	}
 
@@ -270,6 +443,13 @@ static int b3rb_estimate_cmd_handler(const struct shell *sh, size_t argc, char *
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		shell_print(sh, "updates: %llu, over budget: %llu, parked: %u, held: %u",
+			    ctx->perf_update.count, ctx->perf_update.misses, ctx->parked,
+			    ctx->held);
+#if defined(CONFIG_CEREBRI_B3RB_ESTIMATE_ODOMETRY_ETHERNET)
+		shell_print(sh, "fused: %u, too late: %u, out of order: %u", ctx->fused,
+			    ctx->too_late, ctx->out_of_order);
+#endif
 	}
 	return 0;
 }
@@ -3,8 +3,6 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include <stdio.h>
-
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
@@ -16,73 +14,178 @@
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/core/fsm.h>
+#include <cerebri/core/log_utils.h>
 #include <synapse_topic_list.h>
 
 #include "input_mapping.h"
 
 #define MY_STACK_SIZE 3072
 #define MY_PRIORITY   4
-#define STATE_ANY     -1
 
 LOG_MODULE_REGISTER(b3rb_fsm, CONFIG_CEREBRI_B3RB_LOG_LEVEL);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
-static void transition(void *state, bool request, const char *request_name, int pre, uint8_t post,
-		       char *buf, size_t n, int *request_seq, bool *request_rejected,
-		       size_t n_guards, ...)
-{
-	uint8_t *state_int = (uint8_t *)state;
-
-	// not requested
-	if (!request) {
-		return;
-	}
-
-	// null transition
-	if (*state_int == post) {
-		return;
-	}
+// inputs of the state machine, one bit each
+enum {
+	FSM_IN_ARM = BIT(0),
+	FSM_IN_DISARM = BIT(1),
+	FSM_IN_INPUT_SOURCE_RADIO_CONTROL = BIT(2),
+	FSM_IN_INPUT_SOURCE_ETHERNET = BIT(3),
+	FSM_IN_TOPIC_SOURCE_INPUT = BIT(4),
+	FSM_IN_TOPIC_SOURCE_ETHERNET = BIT(5),
+	FSM_IN_MODE_ACTUATORS = BIT(6),
+	FSM_IN_MODE_VELOCITY = BIT(7),
+	FSM_IN_MODE_BEZIER = BIT(8),
+	FSM_IN_MODE_CALIBRATION = BIT(9),
+	FSM_IN_SAFE = BIT(10),
+	FSM_IN_FUEL_LOW = BIT(11),
+	FSM_IN_FUEL_CRITICAL = BIT(12),
+	FSM_IN_INPUT_LOSS = BIT(13),
+	FSM_IN_TOPIC_LOSS = BIT(14),
+	FSM_IN_CMD_VEL_TIMEOUT = BIT(15),
+};
 
-	// LOG_INF("%s pre: %d, post: %d, state: %d", request_name, pre, post, *state_int);
-	// pre state required and not matched
-	if (pre >= 0 && *state_int != pre) {
-		return;
-	}
+// state variables of the status message the table changes
+enum {
+	FSM_ARMING = 0,
+	FSM_MODE = 1,
+	FSM_TOPIC_SOURCE = 2,
+	FSM_INPUT_SOURCE = 3,
+};
 
-	// new valid request
-	(*request_seq)++;
-
-	// check guards
-	va_list ap;
-	va_start(ap, n_guards);
-	for (size_t i = 0; i < n_guards; i++) {
-		int guard = va_arg(ap, int);
-		const char *guard_txt = va_arg(ap, const char *);
-		if (guard) {
-			snprintf(buf, n, "deny %s: %s", request_name, guard_txt);
-			LOG_WRN("%s", buf);
-			*request_rejected = true;
-			return;
-		}
-	}
-	va_end(ap);
-	snprintf(buf, n, "accept %s", request_name);
-	LOG_INF("%s", buf);
-	*state_int = post;
-	*request_rejected = false;
-	return;
-}
+static const struct fsm_transition g_fsm_table[] = {
+	{
+		.label = "request arm",
+		.request = FSM_IN_ARM,
+		.state = FSM_ARMING,
+		.pre = synapse_pb_Status_Arming_ARMING_DISARMED,
+		.post = synapse_pb_Status_Arming_ARMING_ARMED,
+		.guards =
+			{
+				FSM_GUARD_STATE(FSM_MODE, synapse_pb_Status_Mode_MODE_UNKNOWN,
+						"mode not set"),
+				FSM_GUARD_STATE(FSM_MODE, synapse_pb_Status_Mode_MODE_CALIBRATION,
+						"mode calibration"),
+				FSM_GUARD_INPUT(FSM_IN_SAFE, "safety on"),
+				FSM_GUARD_INPUT(FSM_IN_FUEL_CRITICAL, "fuel_critical"),
+				FSM_GUARD_INPUT(FSM_IN_FUEL_LOW, "fuel_low"),
+			},
+	},
+	{
+		.label = "request disarm",
+		.request = FSM_IN_DISARM,
+		.state = FSM_ARMING,
+		.pre = synapse_pb_Status_Arming_ARMING_ARMED,
+		.post = synapse_pb_Status_Arming_ARMING_DISARMED,
+	},
+	{
+		.label = "disarm fuel critical",
+		.request = FSM_IN_FUEL_CRITICAL,
+		.state = FSM_ARMING,
+		.pre = synapse_pb_Status_Arming_ARMING_ARMED,
+		.post = synapse_pb_Status_Arming_ARMING_DISARMED,
+	},
+	{
+		.label = "disarm safety engaged",
+		.request = FSM_IN_SAFE,
+		.state = FSM_ARMING,
+		.pre = synapse_pb_Status_Arming_ARMING_ARMED,
+		.post = synapse_pb_Status_Arming_ARMING_DISARMED,
+	},
+	{
+		.label = "request mode actuators",
+		.request = FSM_IN_MODE_ACTUATORS,
+		.state = FSM_MODE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_Mode_MODE_ACTUATORS,
+	},
+	{
+		.label = "request mode velocity",
+		.request = FSM_IN_MODE_VELOCITY,
+		.state = FSM_MODE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_Mode_MODE_VELOCITY,
+		.guards =
+			{
+				FSM_GUARD_INPUT(FSM_IN_CMD_VEL_TIMEOUT, "cmd_vel not received"),
+			},
+	},
+	{
+		.label = "actuator fallback, cmd_vel not received",
+		.request = FSM_IN_CMD_VEL_TIMEOUT,
+		.state = FSM_MODE,
+		.pre = synapse_pb_Status_Mode_MODE_VELOCITY,
+		.post = synapse_pb_Status_Mode_MODE_ACTUATORS,
+	},
+	{
+		.label = "request mode bezier",
+		.request = FSM_IN_MODE_BEZIER,
+		.state = FSM_MODE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_Mode_MODE_BEZIER,
+	},
+	{
+		.label = "request mode calibration",
+		.request = FSM_IN_MODE_CALIBRATION,
+		.state = FSM_MODE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_Mode_MODE_CALIBRATION,
+		.guards =
+			{
+				FSM_GUARD_STATE(FSM_ARMING, synapse_pb_Status_Arming_ARMING_ARMED,
+						"disarm required"),
+			},
+	},
+	{
+		.label = "request topic source input",
+		.request = FSM_IN_TOPIC_SOURCE_INPUT,
+		.state = FSM_TOPIC_SOURCE,
+		.pre = synapse_pb_Status_TopicSource_TOPIC_SOURCE_ETHERNET,
+		.post = synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT,
+		.guards =
+			{
+				FSM_GUARD_INPUT(FSM_IN_INPUT_LOSS, "no input data"),
+			},
+	},
+	{
+		.label = "request topic source ethernet",
+		.request = FSM_IN_TOPIC_SOURCE_ETHERNET,
+		.state = FSM_TOPIC_SOURCE,
+		.pre = synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT,
+		.post = synapse_pb_Status_TopicSource_TOPIC_SOURCE_ETHERNET,
+		.guards =
+			{
+				FSM_GUARD_INPUT(FSM_IN_INPUT_LOSS, "no topic data"),
+			},
+	},
+	{
+		.label = "request input source radio control",
+		.request = FSM_IN_INPUT_SOURCE_RADIO_CONTROL,
+		.state = FSM_INPUT_SOURCE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_InputSource_INPUT_SOURCE_RADIO_CONTROL,
+		.guards =
+			{
+				FSM_GUARD_INPUT(FSM_IN_INPUT_LOSS, "no RC input data"),
+			},
+	},
+	{
+		.label = "request input source ethernet",
+		.request = FSM_IN_INPUT_SOURCE_ETHERNET,
+		.state = FSM_INPUT_SOURCE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_InputSource_INPUT_SOURCE_ETHERNET,
+		.guards =
+			{
+				FSM_GUARD_INPUT(FSM_IN_INPUT_LOSS, "no enet input data"),
+			},
+	},
+};
 
 struct status_input {
 	struct input_request req;
-	bool armed;
-	bool safe;
-	bool mode_unknown;
-	bool mode_calibration;
-	bool fuel_low;
-	bool fuel_critical;
-
 	bool update_battery_state;
 	bool update_safety;
 	bool update_input_sbus;
@@ -120,7 +223,7 @@ struct context {
 	struct status_input status_input;
 	struct zros_sub sub_input_sbus, sub_input_ethernet, sub_battery_state, sub_safety,
 		sub_cmd_vel_ethernet;
-	struct zros_pub pub_status, pub_input, pub_cmd_vel;
+	struct zros_pub pub_input, pub_cmd_vel;
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -160,7 +263,6 @@ static struct context g_ctx = {
 	.sub_input_sbus = {},
 	.sub_input_ethernet = {},
 	.sub_cmd_vel_ethernet = {},
-	.pub_status = {},
 	.pub_input = {},
 	.pub_cmd_vel = {},
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
@@ -176,6 +278,9 @@ static struct context g_ctx = {
 	.topic_loss_ticks = 1.0 * CONFIG_SYS_CLOCK_TICKS_PER_SEC,
 };
 
+FSM_DEFINE(g_fsm, g_fsm_table, &g_ctx.status.arming, &g_ctx.status.mode,
+	   &g_ctx.status.topic_source, &g_ctx.status.input_source);
+
 static void b3rb_fsm_init(struct context *ctx)
 {
 	zros_node_init(&ctx->node, "b3rb_fsm");
@@ -187,7 +292,6 @@ static void b3rb_fsm_init(struct context *ctx)
 		      &ctx->input_ethernet, 10);
 	zros_sub_init(&ctx->sub_cmd_vel_ethernet, &ctx->node, &topic_cmd_vel_ethernet,
 		      &ctx->cmd_vel_ethernet, 10);
-	zros_pub_init(&ctx->pub_status, &ctx->node, &topic_status, &ctx->status);
 	zros_pub_init(&ctx->pub_input, &ctx->node, &topic_input, &ctx->input);
 	zros_pub_init(&ctx->pub_cmd_vel, &ctx->node, &topic_cmd_vel, &ctx->cmd_vel);
 	k_sem_take(&ctx->running, K_FOREVER);
@@ -201,7 +305,6 @@ static void b3rb_fsm_fini(struct context *ctx)
 	zros_sub_fini(&ctx->sub_input_sbus);
 	zros_sub_fini(&ctx->sub_input_ethernet);
 	zros_sub_fini(&ctx->sub_cmd_vel_ethernet);
-	zros_pub_fini(&ctx->pub_status);
 	zros_pub_fini(&ctx->pub_input);
 	zros_pub_fini(&ctx->pub_cmd_vel);
 	zros_node_fini(&ctx->node);
@@ -209,32 +312,8 @@ static void b3rb_fsm_fini(struct context *ctx)
 	LOG_INF("fini");
 }
 
-static void fsm_compute_input(struct status_input *input, struct context *ctx)
+static void fsm_compute_link(struct status_input *input, struct context *ctx)
 {
-	input_request_compute(&input->req, &ctx->input);
-
-	// precompute logical states
-	input->armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
-
-	input->mode_unknown = ctx->status.mode == synapse_pb_Status_Mode_MODE_UNKNOWN;
-	input->mode_calibration = ctx->status.mode == synapse_pb_Status_Mode_MODE_CALIBRATION;
-#ifdef CONFIG_CEREBRI_SENSE_SAFETY
-	input->safe = ctx->safety.status == synapse_pb_Safety_Status_SAFETY_SAFE ||
-		      ctx->safety.status == synapse_pb_Safety_Status_SAFETY_UNKNOWN;
-#else
-	input->safe = false;
-#endif
-
-#ifdef CONFIG_CEREBRI_SENSE_POWER
-	input->fuel_low =
-		ctx->battery_state.voltage < CONFIG_CEREBRI_B3RB_BATTERY_LOW_MILLIVOLT / 1000.0;
-	input->fuel_critical =
-		ctx->battery_state.voltage < CONFIG_CEREBRI_B3RB_BATTERY_MIN_MILLIVOLT / 1000.0;
-#else
-	input->fuel_low = false;
-	input->fuel_critical = false;
-#endif
-
 	// current ticks
 	ctx->now_ticks = k_uptime_ticks();
 
@@ -249,8 +328,6 @@ static void fsm_compute_input(struct status_input *input, struct context *ctx)
 	input->topic_source_input =
 		ctx->status.topic_source == synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT;
 	input->input_timeout = (ctx->now_ticks - ctx->input_last_ticks) > ctx->input_loss_ticks;
-	input->cmd_vel_timeout =
-		(ctx->now_ticks - ctx->cmd_vel_last_ticks) > ctx->cmd_vel_loss_ticks;
 	input->input_status_loss =
 		ctx->status.input_status == synapse_pb_Status_LinkStatus_STATUS_LOSS;
 	input->input_source_ethernet =
@@ -277,153 +354,62 @@ static void fsm_compute_input(struct status_input *input, struct context *ctx)
 	input->topic_lost_now = !input->topic_status_loss && input->topic_timeout;
 }
 
-static void fsm_update(synapse_pb_Status *status, const struct status_input *input)
+// after the updates, so a decision is made on the message that triggers it
+static uint32_t fsm_compute_input(struct status_input *input, const struct context *ctx)
 {
-	// arm transition
-	transition(&status->arming,                                        // state
-		   input->req.arm,                                         // request
-		   "request arm",                                          // label
-		   synapse_pb_Status_Arming_ARMING_DISARMED,               // pre
-		   synapse_pb_Status_Arming_ARMING_ARMED,                  // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   // guards
-		   5, input->mode_unknown, "mode not set", input->mode_calibration,
-		   "mode calibration", input->safe, "safety on", input->fuel_critical,
-		   "fuel_critical", input->fuel_low, "fuel_low");
-
-	// disarm transitions
-	transition(&status->arming,                                        // state
-		   input->req.disarm,                                      // request
-		   "request disarm",                                       // label
-		   synapse_pb_Status_Arming_ARMING_ARMED,                  // pre
-		   synapse_pb_Status_Arming_ARMING_DISARMED,               // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->arming,                                        // state
-		   input->fuel_critical,                                   // request
-		   "disarm fuel critical",                                 // label
-		   synapse_pb_Status_Arming_ARMING_ARMED,                  // pre
-		   synapse_pb_Status_Arming_ARMING_DISARMED,               // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->arming,                                        // state
-		   input->safe,                                            // request
-		   "disarm safety engaged",                                // label
-		   synapse_pb_Status_Arming_ARMING_ARMED,                  // pre
-		   synapse_pb_Status_Arming_ARMING_DISARMED,               // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	// mode transitions
-	transition(&status->mode,                                          // state
-		   input->req.mode_actuators,                              // request
-		   "request mode actuators",                               // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_Mode_MODE_ACTUATORS,                  // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->mode,                                          // state
-		   input->req.mode_velocity,                               // request
-		   "request mode velocity",                                // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_Mode_MODE_VELOCITY,                   // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   1, input->cmd_vel_timeout, "cmd_vel not received");     // guards
-
-	transition(&status->mode,                                          // state
-		   input->cmd_vel_timeout,                                 // request
-		   "actuator fallback, cmd_vel not received",              // label
-		   synapse_pb_Status_Mode_MODE_VELOCITY,                   // pre
-		   synapse_pb_Status_Mode_MODE_ACTUATORS,                  // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->mode,                                          // state
-		   input->req.mode_bezier,                                 // request
-		   "request mode bezier",                                  // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_Mode_MODE_BEZIER,                     // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->mode,                                          // state
-		   input->req.mode_calibration,                            // request
-		   "request mode calibration",                             // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_Mode_MODE_CALIBRATION,                // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   // guards
-		   1, input->armed, "disarm required");
-
-	// topic source transitions
-	transition(&status->topic_source,                                  // state
-		   input->req.topic_source_input,                          // request
-		   "request topic source input",                           // label
-		   synapse_pb_Status_TopicSource_TOPIC_SOURCE_ETHERNET,    // pre
-		   synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT,       // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   // guards
-		   1, input->input_status_loss, "no input data");
-
-	transition(&status->topic_source,                                  // state
-		   input->req.topic_source_ethernet,                       // request
-		   "request topic source ethernet",                        // label
-		   synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT,       // pre
-		   synapse_pb_Status_TopicSource_TOPIC_SOURCE_ETHERNET,    // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   // guards
-		   1, input->input_status_loss, "no topic data");
-
-	// input source transitions
-	transition(&status->input_source,                                    // state
-		   input->req.input_source_radio_control,                    // request
-		   "request input source radio control",                     // label
-		   STATE_ANY,                                                // pre
-		   synapse_pb_Status_InputSource_INPUT_SOURCE_RADIO_CONTROL, // post
-		   status->status_message, sizeof(status->status_message),   // status
-		   &status->request_seq, &status->request_rejected,          // request
-		   // guards
-		   1, input->input_status_loss, "no RC input data");
-
-	transition(&status->input_source,                                  // state
-		   input->req.input_source_ethernet,                       // request
-		   "request input source ethernet",                        // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_InputSource_INPUT_SOURCE_ETHERNET,    // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   // guards
-		   1, input->input_status_loss, "no enet input data");
-
-	// set timestamp
-	stamp_msg(&status->stamp, k_uptime_ticks());
+	input_request_compute(&input->req, &ctx->input);
+
+	uint32_t inputs = 0;
+	inputs |= input->req.arm ? FSM_IN_ARM : 0;
+	inputs |= input->req.disarm ? FSM_IN_DISARM : 0;
+	inputs |= input->req.input_source_radio_control ? FSM_IN_INPUT_SOURCE_RADIO_CONTROL : 0;
+	inputs |= input->req.input_source_ethernet ? FSM_IN_INPUT_SOURCE_ETHERNET : 0;
+	inputs |= input->req.topic_source_input ? FSM_IN_TOPIC_SOURCE_INPUT : 0;
+	inputs |= input->req.topic_source_ethernet ? FSM_IN_TOPIC_SOURCE_ETHERNET : 0;
+	inputs |= input->req.mode_actuators ? FSM_IN_MODE_ACTUATORS : 0;
+	inputs |= input->req.mode_velocity ? FSM_IN_MODE_VELOCITY : 0;
+	inputs |= input->req.mode_bezier ? FSM_IN_MODE_BEZIER : 0;
+	inputs |= input->req.mode_calibration ? FSM_IN_MODE_CALIBRATION : 0;
+
+#ifdef CONFIG_CEREBRI_SENSE_SAFETY
+	if (ctx->safety.status == synapse_pb_Safety_Status_SAFETY_SAFE ||
+	    ctx->safety.status == synapse_pb_Safety_Status_SAFETY_UNKNOWN) {
+		inputs |= FSM_IN_SAFE;
+	}
+#endif
+
+#ifdef CONFIG_CEREBRI_SENSE_POWER
+	if (ctx->battery_state.voltage < CONFIG_CEREBRI_B3RB_BATTERY_LOW_MILLIVOLT / 1000.0) {
+		inputs |= FSM_IN_FUEL_LOW;
+	}
+	if (ctx->battery_state.voltage < CONFIG_CEREBRI_B3RB_BATTERY_MIN_MILLIVOLT / 1000.0) {
+		inputs |= FSM_IN_FUEL_CRITICAL;
+	}
+#endif
+
+	if (ctx->status.input_status == synapse_pb_Status_LinkStatus_STATUS_LOSS) {
+		inputs |= FSM_IN_INPUT_LOSS;
+	}
+	if (ctx->status.topic_status == synapse_pb_Status_LinkStatus_STATUS_LOSS) {
+		inputs |= FSM_IN_TOPIC_LOSS;
+	}
+	if ((ctx->now_ticks - ctx->cmd_vel_last_ticks) > ctx->cmd_vel_loss_ticks) {
+		inputs |= FSM_IN_CMD_VEL_TIMEOUT;
+	}
+	return inputs;
 }
 
-static void status_add_extra_info(synapse_pb_Status *status, struct status_input *input,
-				  const struct context *ctx)
+static void status_add_extra_info(synapse_pb_Status *status, const struct status_input *input,
+				  uint32_t inputs, const struct context *ctx)
 {
 	if (input->req.lights_on) {
 		status->flag |= synapse_pb_Status_Flag_FLAG_LIGHTING;
 	} else {
 		status->flag &= ~synapse_pb_Status_Flag_FLAG_LIGHTING;
 	}
-	if (input->fuel_critical) {
+	if (inputs & FSM_IN_FUEL_CRITICAL) {
 		status->fuel = synapse_pb_Status_Fuel_FUEL_CRITICAL;
-	} else if (input->fuel_low) {
+	} else if (inputs & FSM_IN_FUEL_LOW) {
 		status->fuel = synapse_pb_Status_Fuel_FUEL_LOW;
 	} else {
 		status->fuel = synapse_pb_Status_Fuel_FUEL_NOMINAL;
@@ -458,24 +444,36 @@ static void b3rb_fsm_run(void *p0, void *p1, void *p2)
 		*zros_sub_get_event(&ctx->sub_input_sbus),
 		*zros_sub_get_event(&ctx->sub_input_ethernet),
 		*zros_sub_get_event(&ctx->sub_battery_state),
+		*zros_sub_get_event(&ctx->sub_safety),
+		*zros_sub_get_event(&ctx->sub_cmd_vel_ethernet),
 	};
 
+	int64_t publish_last_ticks = 0;
+	int64_t publish_ticks = CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+
+	fsm_reset(&g_fsm);
+
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 
-		// wait for input event, publish at 1 Hz regardless
-		int rc = 0;
-		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
+		// wait for an input, for the next link deadline, publish at 1 Hz regardless
+		int64_t now_ticks = k_uptime_ticks();
+		int64_t wait = publish_last_ticks + publish_ticks - now_ticks;
+		wait = fsm_wait_ticks(now_ticks, ctx->input_last_ticks + ctx->input_loss_ticks + 1,
+				      wait);
+		wait = fsm_wait_ticks(now_ticks, ctx->topic_last_ticks + ctx->topic_loss_ticks + 1,
+				      wait);
+		wait = fsm_wait_ticks(now_ticks,
+				      ctx->cmd_vel_last_ticks + ctx->cmd_vel_loss_ticks + 1, wait);
+		int rc = k_poll(events, ARRAY_SIZE(events), K_TICKS(MAX(wait, 1)));
 		if (rc != 0) {
-			LOG_DBG("fsm polling timeout");
+			CEREBRI_LOG_DBG_LIMIT("fsm polling timeout");
 		}
 
-		// perform finite state machine processing
-		fsm_compute_input(&ctx->status_input, ctx);
-		fsm_update(&ctx->status, &ctx->status_input);
-		status_add_extra_info(&ctx->status, &ctx->status_input, ctx);
-		zros_pub_update(&ctx->pub_status);
+		fsm_compute_link(&ctx->status_input, ctx);
 
 		struct status_input *in = &ctx->status_input;
+		bool link_changed = in->input_regained_now || in->input_lost_now ||
+				    in->topic_regained_now || in->topic_lost_now;
 
 		// handle update based on computed booleans
 		if (in->update_battery_state) {
@@ -559,6 +557,20 @@ static void b3rb_fsm_run(void *p0, void *p1, void *p2)
 			ctx->status.topic_status = synapse_pb_Status_LinkStatus_STATUS_LOSS;
 		}
 
+		// perform finite state machine processing, the table is only walked
+		// when an input changed
+		uint32_t inputs = fsm_compute_input(in, ctx);
+		bool walked = fsm_update(&g_fsm, inputs, ctx->status.status_message,
+					 sizeof(ctx->status.status_message),
+					 &ctx->status.request_seq, &ctx->status.request_rejected);
+		bool publish_due = ctx->now_ticks - publish_last_ticks >= publish_ticks;
+		if (walked || link_changed || publish_due) {
+			stamp_msg_now(&ctx->status.stamp);
+			status_add_extra_info(&ctx->status, in, inputs, ctx);
+			synapse_seqlock_publish(&seqlock_status, &ctx->status);
+			publish_last_ticks = ctx->now_ticks;
+		}
+
 		// publish control topics
 		if (in->update_topic && in->topic_source_ethernet) {
 			ctx->cmd_vel = ctx->cmd_vel_ethernet;
@@ -599,6 +611,8 @@ static int b3rb_fsm_cmd_handler(const struct shell *sh, size_t argc, char **argv
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		shell_print(sh, "table walks: %u, skipped: %u, longest: %u cyc", g_fsm.walks,
+			    g_fsm.skips, g_fsm.max_walk_cyc);
 	}
 	return 0;
 }
@@ -0,0 +1,24 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "gains.h"
+
+#define B3RB_GEOMETRY_DEFAULT                                                                      \
+	{                                                                                          \
+		.wheel_radius = CONFIG_CEREBRI_B3RB_WHEEL_RADIUS_MM / 1000.0,                      \
+		.wheel_base = CONFIG_CEREBRI_B3RB_WHEEL_BASE_MM / 1000.0,                          \
+	}
+
+PARAM_GROUP_DEFINE(b3rb_geometry, struct b3rb_geometry_param, B3RB_GEOMETRY_DEFAULT,
+		   PARAM(struct b3rb_geometry_param, wheel_radius),
+		   PARAM(struct b3rb_geometry_param, wheel_base));
+
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+PARAM_GROUP_DEFINE(b3rb_wheel, struct wheel_loop_gains, WHEEL_LOOP_GAINS_DEFAULT,
+		   PARAM(struct wheel_loop_gains, kp), PARAM(struct wheel_loop_gains, ki),
+		   PARAM(struct wheel_loop_gains, i_max));
+#endif
+
+// vi: ts=4 sw=4 et
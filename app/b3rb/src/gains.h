@@ -0,0 +1,30 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef B3RB_GAINS_H
+#define B3RB_GAINS_H
+
+#include <cerebri/core/param.h>
+
+#include "app/b3rb/casadi/b3rb.h"
+
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+#include <cerebri/sense/wheel_loop.h>
+#endif
+
+// vehicle geometry, runtime parameters defaulting to their Kconfig values
+struct b3rb_geometry_param {
+	casadi_real wheel_radius;
+	casadi_real wheel_base;
+};
+
+PARAM_GROUP_DECLARE(b3rb_geometry);
+
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+// wheel rate PI, a struct wheel_loop_gains
+PARAM_GROUP_DECLARE(b3rb_wheel);
+#endif
+
+#endif // B3RB_GAINS_H
+// vi: ts=4 sw=4 et
@@ -8,7 +8,7 @@
 void b3rb_set_actuators(synapse_pb_Actuators *msg, double turn_angle, double omega_fwd, bool armed)
 {
 	msg->has_stamp = true;
-	stamp_msg(&msg->stamp, k_uptime_ticks());
+	stamp_msg_now(&msg->stamp);
 
 	if (!armed) {
 		// stop if not armed
@@ -14,12 +14,15 @@
 
 #include <synapse_topic_list.h>
 
+#include <cerebri/core/clock_sync.h>
+
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
 
 #include "app/b3rb/casadi/b3rb.h"
 
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/log_utils.h>
 
 #define MY_STACK_SIZE 4096
 #define MY_PRIORITY   4
@@ -32,16 +35,14 @@ struct context {
 	struct zros_node node;
 	synapse_pb_Status status;
 	synapse_pb_BezierTrajectory bezier_trajectory_ethernet;
-	synapse_pb_ClockOffset clock_offset_ethernet;
 	synapse_pb_Odometry odometry_estimator;
 	synapse_pb_Twist cmd_vel;
-	struct zros_sub sub_status, sub_clock_offset_ethernet, sub_odometry_estimator,
-		sub_bezier_trajectory_ethernet;
+	struct zros_sub sub_status, sub_odometry_estimator, sub_bezier_trajectory_ethernet;
 	struct zros_pub pub_cmd_vel;
-	const double wheel_base;
-	const double gain_along_track;
-	const double gain_cross_track;
-	const double gain_heading;
+	const casadi_real wheel_base;
+	const casadi_real gain_along_track;
+	const casadi_real gain_cross_track;
+	const casadi_real gain_heading;
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -51,7 +52,6 @@ struct context {
 static struct context g_ctx = {
 	.status = synapse_pb_Status_init_default,
 	.bezier_trajectory_ethernet = synapse_pb_BezierTrajectory_init_default,
-	.clock_offset_ethernet = synapse_pb_ClockOffset_init_default,
 	.odometry_estimator = synapse_pb_Odometry_init_default,
 	.cmd_vel =
 		{
@@ -61,7 +61,6 @@ static struct context g_ctx = {
 			.angular = synapse_pb_Vector3_init_default,
 		},
 	.sub_status = {},
-	.sub_clock_offset_ethernet = {},
 	.sub_odometry_estimator = {},
 	.sub_bezier_trajectory_ethernet = {},
 	.pub_cmd_vel = {},
@@ -79,8 +78,6 @@ static void b3rb_position_init(struct context *ctx)
 {
 	zros_node_init(&ctx->node, "b3rb_position");
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
-	zros_sub_init(&ctx->sub_clock_offset_ethernet, &ctx->node, &topic_clock_offset_ethernet,
-		      &ctx->clock_offset_ethernet, 10);
 	zros_sub_init(&ctx->sub_odometry_estimator, &ctx->node, &topic_odometry_estimator,
 		      &ctx->odometry_estimator, 10);
 	zros_sub_init(&ctx->sub_bezier_trajectory_ethernet, &ctx->node,
@@ -93,7 +90,6 @@ static void b3rb_position_init(struct context *ctx)
 static void b3rb_position_fini(struct context *ctx)
 {
 	zros_sub_fini(&ctx->sub_status);
-	zros_sub_fini(&ctx->sub_clock_offset_ethernet);
 	zros_sub_fini(&ctx->sub_odometry_estimator);
 	zros_sub_fini(&ctx->sub_bezier_trajectory_ethernet);
 	zros_pub_fini(&ctx->pub_cmd_vel);
@@ -117,9 +113,7 @@ static void bezier_position_mode(struct context *ctx)
 	uint64_t time_stop_nsec = time_start_nsec;
 
 	// get current time
-	uint64_t time_nsec = k_uptime_get() * 1e6 +
-			     ctx->clock_offset_ethernet.offset.seconds * 1e9 +
-			     ctx->clock_offset_ethernet.offset.nanos;
+	uint64_t time_nsec = clock_sync_now_ns();
 
 	if (time_nsec < time_start_nsec) {
 		LOG_WRN("time current: %" PRIu64 " ns < time start: %" PRIu64
@@ -161,12 +155,12 @@ static void bezier_position_mode(struct context *ctx)
 		}
 	}
 
-	double T = (time_stop_nsec - time_start_nsec) * 1e-9;
-	double t = (time_nsec - time_start_nsec) * 1e-9;
-	double x, y, psi, V, omega = 0;
-	double e[3] = {}; // e_x, e_y, e_theta
+	casadi_real T = (time_stop_nsec - time_start_nsec) * 1e-9;
+	casadi_real t = (time_nsec - time_start_nsec) * 1e-9;
+	casadi_real x, y, psi, V, omega = 0;
+	casadi_real e[3] = {}; // e_x, e_y, e_theta
 
-	double PX[6], PY[6];
+	casadi_real PX[6], PY[6];
 	for (int i = 0; i < 6; i++) {
 		PX[i] = ctx->bezier_trajectory_ethernet.curves[curve_index].x[i];
 		PY[i] = ctx->bezier_trajectory_ethernet.curves[curve_index].y[i];
@@ -189,7 +183,7 @@ static void bezier_position_mode(struct context *ctx)
 
 	/* se2_error:(p[3],r[3])->(error[3]) */
 	{
-		double p[3], r[3];
+		casadi_real p[3], r[3];
 
 		// vehicle position
 		p[0] = ctx->odometry_estimator.pose.position.x;
@@ -233,7 +227,7 @@ static void b3rb_position_run(void *p0, void *p1, void *p2)
 		int rc = 0;
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
 		if (rc != 0) {
-			LOG_DBG("pos not receiving estimator odometry");
+			CEREBRI_LOG_DBG_LIMIT("pos not receiving estimator odometry");
 			continue;
 		}
 
@@ -249,10 +243,6 @@ static void b3rb_position_run(void *p0, void *p1, void *p2)
 			zros_sub_update(&ctx->sub_odometry_estimator);
 		}
 
-		if (zros_sub_update_available(&ctx->sub_clock_offset_ethernet)) {
-			zros_sub_update(&ctx->sub_clock_offset_ethernet);
-		}
-
 		if (ctx->status.mode == synapse_pb_Status_Mode_MODE_BEZIER) {
 			bezier_position_mode(ctx);
 			zros_pub_update(&ctx->pub_cmd_vel);
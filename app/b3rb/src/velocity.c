@@ -18,12 +18,22 @@
 #include <zros/zros_sub.h>
 
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/log_utils.h>
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+#include <cerebri/sense/wheel_loop.h>
+#endif
 
+#include "gains.h"
 #include "mixing.h"
 
 #define MY_STACK_SIZE 3072
 #define MY_PRIORITY   4
 
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+// cmd_vel older than this is not driven on, the timeout of the open loop poll
+#define CMD_VEL_TIMEOUT_NS (1000 * (int64_t)NSEC_PER_MSEC)
+#endif
+
 LOG_MODULE_REGISTER(b3rb_velocity, CONFIG_CEREBRI_B3RB_LOG_LEVEL);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
@@ -35,8 +45,10 @@ struct context {
 	synapse_pb_Actuators actuators;
 	struct zros_sub sub_status, sub_cmd_vel;
 	struct zros_pub pub_actuators;
-	const double wheel_radius;
-	const double wheel_base;
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+	struct wheel_loop wheel_loop;
+	int64_t cmd_vel_ns;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -51,8 +63,6 @@ static struct context g_ctx = {
 	.sub_status = {},
 	.sub_cmd_vel = {},
 	.pub_actuators = {},
-	.wheel_radius = CONFIG_CEREBRI_B3RB_WHEEL_RADIUS_MM / 1000.0,
-	.wheel_base = CONFIG_CEREBRI_B3RB_WHEEL_BASE_MM / 1000.0,
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
@@ -65,12 +75,19 @@ static void b3rb_velocity_init(struct context *ctx)
 	zros_sub_init(&ctx->sub_cmd_vel, &ctx->node, &topic_cmd_vel, &ctx->cmd_vel, 10);
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
 	zros_pub_init(&ctx->pub_actuators, &ctx->node, &topic_actuators, &ctx->actuators);
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+	wheel_loop_init(&ctx->wheel_loop, &ctx->node);
+	ctx->cmd_vel_ns = 0;
+#endif
 	k_sem_take(&ctx->running, K_FOREVER);
 	LOG_INF("init");
 }
 
 static void b3rb_velocity_fini(struct context *ctx)
 {
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+	wheel_loop_fini(&ctx->wheel_loop);
+#endif
 	zros_pub_fini(&ctx->pub_actuators);
 	zros_sub_fini(&ctx->sub_status);
 	zros_sub_fini(&ctx->sub_cmd_vel);
@@ -82,26 +99,34 @@ static void b3rb_velocity_fini(struct context *ctx)
 // computes actuators from cmd_vel
 static void b3rb_velocity_update(struct context *ctx)
 {
-	double turn_angle = 0;
-	double omega_fwd = 0;
-	double V = ctx->cmd_vel.linear.x;
-	double omega = ctx->cmd_vel.angular.z;
-	double delta = 0;
+	casadi_real turn_angle = 0;
+	casadi_real omega_fwd = 0;
+	casadi_real V = ctx->cmd_vel.linear.x;
+	casadi_real omega = ctx->cmd_vel.angular.z;
+	casadi_real delta = 0;
+
+	const struct b3rb_geometry_param *geometry =
+		PARAM_GET(b3rb_geometry, struct b3rb_geometry_param);
 
 	CASADI_FUNC_ARGS(ackermann_steering);
-	args[0] = &ctx->wheel_base;
+	args[0] = &geometry->wheel_base;
 	args[1] = &omega;
 	args[2] = &V;
 	res[0] = &delta;
 	CASADI_FUNC_CALL(ackermann_steering);
 
-	omega_fwd = V / ctx->wheel_radius;
+	bool armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
+
+	omega_fwd = V / geometry->wheel_radius;
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+	const struct wheel_loop_gains *gains = PARAM_GET(b3rb_wheel, struct wheel_loop_gains);
+	omega_fwd += wheel_loop_correction(&ctx->wheel_loop, gains, omega_fwd,
+					   armed && ctx->wheel_loop.closed);
+#endif
 	if (fabs(V) > 0.01) {
 		turn_angle = delta;
 	}
 
-	bool armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
-
 	b3rb_set_actuators(&ctx->actuators, turn_angle, omega_fwd, armed);
 
 	// publish
@@ -117,15 +142,20 @@ static void b3rb_velocity_run(void *p0, void *p1, void *p2)
 	b3rb_velocity_init(ctx);
 
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+		// paced by wheel odometry, open loop on the latest cmd_vel without it
+		wheel_loop_update(&ctx->wheel_loop);
+#else
 		struct k_poll_event events[] = {
 			*zros_sub_get_event(&ctx->sub_cmd_vel),
 		};
 		int rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
 
 		if (rc < 0) {
-			LOG_DBG("not receiving cmd_vel");
+			CEREBRI_LOG_DBG_LIMIT("not receiving cmd_vel");
 			continue;
 		}
+#endif
 
 		if (zros_sub_update_available(&ctx->sub_status)) {
 			zros_sub_update(&ctx->sub_status);
@@ -133,12 +163,29 @@ static void b3rb_velocity_run(void *p0, void *p1, void *p2)
 
 		if (zros_sub_update_available(&ctx->sub_cmd_vel)) {
 			zros_sub_update(&ctx->sub_cmd_vel);
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+			ctx->cmd_vel_ns = synapse_uptime_ns();
+#endif
 		}
 
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+		// the wheel paces the loop, a stale cmd_vel would be driven on indefinitely
+		if (synapse_uptime_ns() - ctx->cmd_vel_ns > CMD_VEL_TIMEOUT_NS) {
+			CEREBRI_LOG_DBG_LIMIT("not receiving cmd_vel");
+			wheel_loop_reset(&ctx->wheel_loop);
+			continue;
+		}
+#endif
+
 		// handle modes
 		if (ctx->status.mode != synapse_pb_Status_Mode_MODE_ACTUATORS) {
 			b3rb_velocity_update(ctx);
 		}
+#if defined(CONFIG_CEREBRI_B3RB_VELOCITY_WHEEL_LOOP)
+		else {
+			wheel_loop_reset(&ctx->wheel_loop);
+		}
+#endif
 	}
 
 	b3rb_velocity_fini(ctx);
@@ -16,6 +16,8 @@
 
 #include <synapse_topic_list.h>
 
+#include <cerebri/core/log_utils.h>
+
 #include "input_mapping.h"
 #include "mixing.h"
 
@@ -143,7 +145,7 @@ static void melm_command_run(void *p0, void *p1, void *p2)
 		dt = (double)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
 		ticks_last = ticks_now;
 		if (dt < 0 || dt > 0.5) {
-			LOG_ERR("input update rate too low: %10.4f", dt);
+			CEREBRI_LOG_ERR_LIMIT("input update rate too low: %10.4f", dt);
 			continue;
 		}
 
@@ -12,15 +12,14 @@
 #include <zephyr/shell/shell.h>
 
 #include <zros/private/zros_node_struct.h>
-#include <zros/private/zros_pub_struct.h>
 #include <zros/private/zros_sub_struct.h>
 #include <zros/zros_node.h>
-#include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
 #include <synapse_topic_list.h>
 
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/log_utils.h>
 
 #include "app/melm/casadi/melm.h"
 
@@ -42,9 +41,8 @@ struct context {
 	synapse_pb_Imu imu;
 	synapse_pb_Odometry odometry;
 	struct zros_sub sub_wheel_odometry, sub_imu;
-	struct zros_pub pub_odometry;
-	double x[3];
-	const double wheel_radius;
+	casadi_real x[3];
+	const casadi_real wheel_radius;
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -67,7 +65,6 @@ static struct context g_ctx = {
 		},
 	.sub_wheel_odometry = {},
 	.sub_imu = {},
-	.pub_odometry = {},
 	.x = {},
 	.wheel_radius = CONFIG_CEREBRI_MELM_WHEEL_RADIUS_MM / 1000.0,
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
@@ -82,14 +79,12 @@ static void melm_estimate_init(struct context *ctx)
 	zros_sub_init(&ctx->sub_imu, &ctx->node, &topic_imu, &ctx->imu, 10);
 	zros_sub_init(&ctx->sub_wheel_odometry, &ctx->node, &topic_wheel_odometry,
 		      &ctx->wheel_odometry, 10);
-	zros_pub_init(&ctx->pub_odometry, &ctx->node, &topic_odometry_estimator, &ctx->odometry);
 	k_sem_take(&ctx->running, K_FOREVER);
 	LOG_INF("init");
 }
 
 static void melm_estimate_fini(struct context *ctx)
 {
-	zros_pub_fini(&ctx->pub_odometry);
 	zros_sub_fini(&ctx->sub_wheel_odometry);
 	zros_sub_fini(&ctx->sub_imu);
 	zros_node_fini(&ctx->node);
@@ -97,7 +92,7 @@ static void melm_estimate_fini(struct context *ctx)
 	LOG_INF("fini");
 }
 
-static bool all_finite(double *src, size_t n)
+static bool all_finite(casadi_real *src, size_t n)
 {
 	for (size_t i = 0; i < n; i++) {
 		if (!isfinite(src[i])) {
@@ -107,12 +102,12 @@ static bool all_finite(double *src, size_t n)
 	return true;
 }
 
-static void handle_update(struct context *ctx, double *x1)
+static void handle_update(struct context *ctx, casadi_real *x1)
 {
 	bool x1_finite = all_finite(x1, ARRAY_SIZE(ctx->x));
 
 	if (!x1_finite) {
-		LOG_WRN("x1 update not finite");
+		CEREBRI_LOG_WRN_LIMIT("x1 update not finite");
 	}
 
 	if (x1_finite) {
@@ -160,8 +155,8 @@ static void melm_estimate_run(void *p0, void *p1, void *p2)
 		zros_sub_update(&ctx->sub_wheel_odometry);
 	}
 
-	double dt = 0;
-	int64_t ticks_last = k_uptime_ticks();
+	casadi_real dt = 0;
+	int64_t last_ns = synapse_uptime_ns();
 
 	// poll on imu
 	events[0] = *zros_sub_get_event(&ctx->sub_imu);
@@ -172,7 +167,7 @@ static void melm_estimate_run(void *p0, void *p1, void *p2)
 		// poll for imu
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
 		if (rc != 0) {
-			LOG_DBG("not receiving imu");
+			CEREBRI_LOG_DBG_LIMIT("not receiving imu");
 			continue;
 		}
 
@@ -185,11 +180,11 @@ static void melm_estimate_run(void *p0, void *p1, void *p2)
 		}
 
 		// calculate dt
-		int64_t ticks_now = k_uptime_ticks();
-		dt = (double)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-		ticks_last = ticks_now;
+		int64_t now_ns = synapse_uptime_ns();
+		dt = (now_ns - last_ns) * 1e-9;
+		last_ns = now_ns;
 		if (dt < 0 || dt > 0.5) {
-			LOG_WRN("imu update rate too low");
+			CEREBRI_LOG_WRN_LIMIT("imu update rate too low");
 			continue;
 		}
 
@@ -197,16 +192,16 @@ static void melm_estimate_run(void *p0, void *p1, void *p2)
 		double rotation = ctx->wheel_odometry.rotation;
 
 		// negative sign due to current gearing, should be in driver
-		double u = (rotation - rotation_last) * ctx->wheel_radius;
+		casadi_real u = (rotation - rotation_last) * ctx->wheel_radius;
 		rotation_last = rotation;
 
-		double omega = ctx->imu.angular_velocity.z;
+		casadi_real omega = ctx->imu.angular_velocity.z;
 		// LOG_DBG("imu omega z: %10.4f", omega);
 
 		/* predict:(x0[3],omega,u)->(x1[3]) */
 		{
-			double delta_theta = omega * dt;
-			double x1[3];
+			casadi_real delta_theta = omega * dt;
+			casadi_real x1[3];
 
 			// LOG_DBG("predict");
 			CASADI_FUNC_ARGS(predict);
@@ -222,9 +217,9 @@ static void melm_estimate_run(void *p0, void *p1, void *p2)
 
 		// publish odometry
 		{
-			stamp_msg(&ctx->odometry.stamp, k_uptime_ticks());
+			stamp_msg_now(&ctx->odometry.stamp);
 
-			double theta = ctx->x[2];
+			casadi_real theta = ctx->x[2];
 			ctx->odometry.pose.position.x = ctx->x[0];
 			ctx->odometry.pose.position.y = ctx->x[1];
 			ctx->odometry.pose.position.z = 0;
@@ -234,7 +229,7 @@ static void melm_estimate_run(void *p0, void *p1, void *p2)
 			ctx->odometry.pose.orientation.w = cos(theta / 2);
 			ctx->odometry.twist.angular.z = omega;
 			ctx->odometry.twist.linear.x = u;
-			zros_pub_update(&ctx->pub_odometry);
+			synapse_loan_publish_copy(&loan_odometry_estimator, &ctx->odometry);
 		}
 	}
 
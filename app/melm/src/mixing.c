@@ -9,7 +9,7 @@ void melm_set_actuators(synapse_pb_Actuators *msg, double omega_left, double ome
 			bool armed)
 {
 	msg->has_stamp = true;
-	stamp_msg(&msg->stamp, k_uptime_ticks());
+	stamp_msg_now(&msg->stamp);
 
 	if (!armed) {
 		// stop if not armed
@@ -18,12 +18,21 @@
 #include <zros/zros_sub.h>
 
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/log_utils.h>
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+#include <cerebri/sense/wheel_loop.h>
+#endif
 
 #include "mixing.h"
 
 #define MY_STACK_SIZE 3072
 #define MY_PRIORITY   4
 
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+// cmd_vel older than this is not driven on, the timeout of the open loop poll
+#define CMD_VEL_TIMEOUT_NS (1000 * (int64_t)NSEC_PER_MSEC)
+#endif
+
 LOG_MODULE_REGISTER(melm_velocity, CONFIG_CEREBRI_MELM_LOG_LEVEL);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
@@ -35,9 +44,16 @@ struct context {
 	synapse_pb_Actuators actuators;
 	struct zros_sub sub_status, sub_cmd_vel;
 	struct zros_pub pub_actuators;
-	const double wheel_radius;
-	const double wheel_base;
-	const double wheel_separation;
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+	struct wheel_loop wheel_loop;
+	int64_t cmd_vel_ns;
+#endif
+	const casadi_real wheel_radius;
+	const casadi_real wheel_base;
+	const casadi_real wheel_separation;
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+	const struct wheel_loop_gains wheel_gains;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -55,6 +71,9 @@ static struct context g_ctx = {
 	.wheel_radius = CONFIG_CEREBRI_MELM_WHEEL_RADIUS_MM / 1000.0,
 	.wheel_base = CONFIG_CEREBRI_MELM_WHEEL_BASE_MM / 1000.0,
 	.wheel_separation = CONFIG_CEREBRI_MELM_WHEEL_SEPARATION_MM / 1000.0,
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+	.wheel_gains = WHEEL_LOOP_GAINS_DEFAULT,
+#endif
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
@@ -67,12 +86,19 @@ static void melm_velocity_init(struct context *ctx)
 	zros_sub_init(&ctx->sub_cmd_vel, &ctx->node, &topic_cmd_vel, &ctx->cmd_vel, 10);
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
 	zros_pub_init(&ctx->pub_actuators, &ctx->node, &topic_actuators, &ctx->actuators);
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+	wheel_loop_init(&ctx->wheel_loop, &ctx->node);
+	ctx->cmd_vel_ns = 0;
+#endif
 	k_sem_take(&ctx->running, K_FOREVER);
 	LOG_INF("init");
 }
 
 static void melm_velocity_fini(struct context *ctx)
 {
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+	wheel_loop_fini(&ctx->wheel_loop);
+#endif
 	zros_pub_fini(&ctx->pub_actuators);
 	zros_sub_fini(&ctx->sub_status);
 	zros_sub_fini(&ctx->sub_cmd_vel);
@@ -84,9 +110,9 @@ static void melm_velocity_fini(struct context *ctx)
 // computes actuators from cmd_vel
 static void melm_velocity_update(struct context *ctx)
 {
-	double V = ctx->cmd_vel.linear.x;
-	double omega = ctx->cmd_vel.angular.z;
-	double Vw = 0; // differential wheel velocity
+	casadi_real V = ctx->cmd_vel.linear.x;
+	casadi_real omega = ctx->cmd_vel.angular.z;
+	casadi_real Vw = 0; // differential wheel velocity
 
 	CASADI_FUNC_ARGS(differential_steering);
 	args[0] = &ctx->wheel_base;
@@ -95,13 +121,22 @@ static void melm_velocity_update(struct context *ctx)
 	res[0] = &Vw;
 	CASADI_FUNC_CALL(differential_steering);
 
-	double omega_left = (V - Vw) / ctx->wheel_radius;
+	casadi_real omega_left = (V - Vw) / ctx->wheel_radius;
 	;
-	double omega_right = (V + Vw) / ctx->wheel_radius;
+	casadi_real omega_right = (V + Vw) / ctx->wheel_radius;
 	;
 
 	bool armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
 
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+	// one encoder, so the correction acts on the mean of both wheels
+	casadi_real correction = wheel_loop_correction(&ctx->wheel_loop, &ctx->wheel_gains,
+						       V / ctx->wheel_radius,
+						       armed && ctx->wheel_loop.closed);
+	omega_left += correction;
+	omega_right += correction;
+#endif
+
 	melm_set_actuators(&ctx->actuators, omega_left, omega_right, armed);
 
 	// publish
@@ -117,15 +152,20 @@ static void melm_velocity_run(void *p0, void *p1, void *p2)
 	melm_velocity_init(ctx);
 
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+		// paced by wheel odometry, open loop on the latest cmd_vel without it
+		wheel_loop_update(&ctx->wheel_loop);
+#else
 		struct k_poll_event events[] = {
 			*zros_sub_get_event(&ctx->sub_cmd_vel),
 		};
 		int rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
 
 		if (rc < 0) {
-			LOG_DBG("not receiving cmd_vel");
+			CEREBRI_LOG_DBG_LIMIT("not receiving cmd_vel");
 			continue;
 		}
+#endif
 
 		if (zros_sub_update_available(&ctx->sub_status)) {
 			zros_sub_update(&ctx->sub_status);
@@ -133,12 +173,29 @@ static void melm_velocity_run(void *p0, void *p1, void *p2)
 
 		if (zros_sub_update_available(&ctx->sub_cmd_vel)) {
 			zros_sub_update(&ctx->sub_cmd_vel);
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+			ctx->cmd_vel_ns = synapse_uptime_ns();
+#endif
+		}
+
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+		// the wheel paces the loop, a stale cmd_vel would be driven on indefinitely
+		if (synapse_uptime_ns() - ctx->cmd_vel_ns > CMD_VEL_TIMEOUT_NS) {
+			CEREBRI_LOG_DBG_LIMIT("not receiving cmd_vel");
+			wheel_loop_reset(&ctx->wheel_loop);
+			continue;
 		}
+#endif
 
 		// handle modes
 		if (ctx->status.mode != synapse_pb_Status_Mode_MODE_ACTUATORS) {
 			melm_velocity_update(ctx);
 		}
+#if defined(CONFIG_CEREBRI_MELM_VELOCITY_WHEEL_LOOP)
+		else {
+			wheel_loop_reset(&ctx->wheel_loop);
+		}
+#endif
 	}
 
 	melm_velocity_fini(ctx);
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2025 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <cerebri/core/log_utils.h>
+
+CEREBRI_NODE_LOG_INIT(offload_boot_banner, LOG_LEVEL_INF);
+
+static int offload_boot_banner_sys_init(void)
+{
+	LOG_INF("Cerebri Offload %d.%d.%d", CONFIG_CEREBRI_VERSION_MAJOR,
+		CONFIG_CEREBRI_VERSION_MINOR, CONFIG_CEREBRI_VERSION_PATCH);
+	return 0;
+};
+
+SYS_INIT(offload_boot_banner_sys_init, APPLICATION, 0);
+
+// vi: ts=4 sw=4 et
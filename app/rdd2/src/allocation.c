@@ -5,6 +5,7 @@
 
 #include "app/rdd2/casadi/rdd2.h"
 #include "math.h"
+#include "gains.h"
 
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
@@ -16,21 +17,42 @@
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <synapse_capture.h>
+#include <synapse_latency.h>
+#include <synapse_liveness.h>
 #include <synapse_topic_list.h>
 
+#include <cerebri/core/boot.h>
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/executor.h>
 #include <cerebri/core/log_utils.h>
+#include <cerebri/core/placement.h>
+#include <cerebri/core/trace.h>
 
-#define MY_STACK_SIZE 3072
-#define MY_PRIORITY   4
+#define MY_STACK_SIZE         3072
+#define MY_PRIORITY           4
+#define MY_DEADLINE_US        500
+// stop the motors once the moment setpoint is this late
+#define MOMENT_SP_DEADLINE_MS 20
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_MATRIX)
+#include "mixer.h"
+#define MOTORS RDD2_MOTOR_COUNT
+#else
+#define MOTORS 4
+#endif
+#define OMEGA_MAX RDD2_OMEGA_MAX
+
+BUILD_ASSERT(MOTORS <= ARRAY_SIZE(((synapse_pb_Actuators *)NULL)->velocity),
+	     "more motors than actuator velocities");
+
 CEREBRI_NODE_LOG_INIT(rdd2_allocation, LOG_LEVEL_WRN);
 
-static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+static CEREBRI_HOT_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
 struct context {
 	struct zros_node node;
@@ -39,20 +61,34 @@ struct context {
 	synapse_pb_Vector3 force_sp, moment_sp;
 	struct zros_sub sub_status, sub_force_sp, sub_moment_sp;
 	struct zros_pub pub_actuators;
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	struct synapse_battery_headroom headroom;
+	struct zros_sub sub_battery_headroom;
+#endif
+	struct synapse_latency_trace latency;
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_MATRIX)
+	struct rdd2_mixer mixer;
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	struct synapse_liveness liveness;
+#endif
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	struct executor_task task;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
 	struct k_thread thread_data;
 };
 
-static struct context g_ctx = {
+static struct context g_ctx CEREBRI_HOT_CONTEXT = {
 	.node = {},
 	.status = synapse_pb_Status_init_default,
 	.actuators =
 		{
 			.has_stamp = true,
 			.stamp = synapse_pb_Timestamp_init_default,
-			.velocity_count = 4,
+			.velocity_count = MOTORS,
 			.normalized_count = 0,
 			.position_count = 0,
 			.position = {},
@@ -63,6 +99,14 @@ static struct context g_ctx = {
 	.sub_force_sp = {},
 	.sub_moment_sp = {},
 	.pub_actuators = {},
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	.headroom = {.thrust_scale = 1.0f},
+	.sub_battery_headroom = {},
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	.liveness = SYNAPSE_LIVENESS_INITIALIZER(g_ctx.liveness, &topic_moment_sp,
+						 "rdd2_allocation", MOMENT_SP_DEADLINE_MS),
+#endif
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
@@ -76,15 +120,29 @@ static void rdd2_allocation_init(struct context *ctx)
 	zros_sub_init(&ctx->sub_force_sp, &ctx->node, &topic_force_sp, &ctx->force_sp, 1000);
 	zros_sub_init(&ctx->sub_moment_sp, &ctx->node, &topic_moment_sp, &ctx->moment_sp, 1000);
 	zros_pub_init(&ctx->pub_actuators, &ctx->node, &topic_actuators, &ctx->actuators);
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	zros_sub_init(&ctx->sub_battery_headroom, &ctx->node, &topic_battery_headroom,
+		      &ctx->headroom, 10);
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	synapse_liveness_start(&ctx->liveness);
+#endif
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("rdd2_allocation init");
 	LOG_INF("init");
 }
 
 static void rdd2_allocation_fini(struct context *ctx)
 {
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	synapse_liveness_stop(&ctx->liveness);
+#endif
 	zros_sub_fini(&ctx->sub_status);
 	zros_sub_fini(&ctx->sub_force_sp);
 	zros_sub_fini(&ctx->sub_moment_sp);
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	zros_sub_fini(&ctx->sub_battery_headroom);
+#endif
 	zros_pub_fini(&ctx->pub_actuators);
 	zros_node_fini(&ctx->node);
 	k_sem_give(&ctx->running);
@@ -93,11 +151,120 @@ static void rdd2_allocation_fini(struct context *ctx)
 
 static void stop(struct context *ctx)
 {
-	for (int i = 0; i < 4; i++) {
+	for (int i = 0; i < MOTORS; i++) {
 		ctx->actuators.velocity[i] = 0;
 	}
 }
 
+static void rdd2_allocation_update(struct context *ctx, int rc)
+{
+	// update subscriptions
+	zros_sub_update(&ctx->sub_status);
+	zros_sub_update(&ctx->sub_force_sp);
+	zros_sub_update(&ctx->sub_moment_sp);
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	zros_sub_update(&ctx->sub_battery_headroom);
+#endif
+	synapse_latency_get(SYNAPSE_LATENCY_ANGULAR_VELOCITY, &ctx->latency);
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	if (synapse_liveness_stale(&ctx->liveness)) {
+		rc = -EAGAIN;
+	}
+#endif
+
+	if (rc < 0) {
+		stop(ctx);
+		LOG_DBG("no data, stopped");
+	} else if (ctx->status.arming != synapse_pb_Status_Arming_ARMING_ARMED) {
+		// not armed, stop
+		stop(ctx);
+	} else {
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+		// thrust the pack can still give at full throttle, so saturation keeps moment
+		casadi_real const thrust_scale = ctx->headroom.thrust_scale;
+#else
+		static casadi_real const thrust_scale = 1.0;
+#endif
+		const struct rdd2_motor_param *motor =
+			PARAM_GET(rdd2_motor, struct rdd2_motor_param);
+		casadi_real omega[MOTORS];
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_MATRIX)
+		float omega_mix[MOTORS];
+		float moment[3] = {ctx->moment_sp.x, ctx->moment_sp.y, ctx->moment_sp.z};
+		float f_max = motor->Ct * OMEGA_MAX * OMEGA_MAX * thrust_scale;
+
+		int sat = rdd2_mixer_run(&ctx->mixer, motor->Cm, motor->Ct, f_max, ctx->force_sp.z,
+					 moment, omega_mix);
+		if (sat & (RDD2_MIXER_SAT_MOMENT | RDD2_MIXER_SAT_THRUST)) {
+			synapse_capture_trigger("motor saturation");
+		}
+		for (int i = 0; i < MOTORS; i++) {
+			omega[i] = omega_mix[i];
+		}
+#else
+		casadi_real const F_max = RDD2_F_MAX * thrust_scale;
+		casadi_real Fp_sum[4], F_moment[4], F_thrust[4], M_sat[3];
+		casadi_real moment[3] = {ctx->moment_sp.x, ctx->moment_sp.y, ctx->moment_sp.z};
+		// the message field is a double, casadi_real may be a float
+		casadi_real const thrust = ctx->force_sp.z;
+
+		// control_allocation:(F_max,l,Cm,Ct,T,M[3])->(omega[4],Fp_sum[4],F_moment[4],F_thrust[4],M_sat[3])
+		CASADI_FUNC_ARGS(control_allocation)
+
+		args[0] = &F_max;
+		args[1] = &motor->l;
+		args[2] = &motor->Cm;
+		args[3] = &motor->Ct;
+		args[4] = &thrust;
+		args[5] = moment;
+
+		res[0] = omega;
+		res[1] = Fp_sum;
+		res[2] = F_moment;
+		res[3] = F_thrust;
+		res[4] = M_sat;
+		CASADI_FUNC_CALL(control_allocation)
+#endif
+
+		for (int i = 0; i < MOTORS; i++) {
+			if (!isfinite(omega[i])) {
+				CEREBRI_LOG_WRN_LIMIT("omega is not finite: %10.4f", omega[i]);
+				synapse_capture_trigger("allocation not finite");
+				omega[i] = 0;
+			} else if (omega[i] > OMEGA_MAX) {
+				CEREBRI_LOG_WRN_LIMIT("omega too large: %10.4f", omega[i]);
+				synapse_capture_trigger("motor saturation");
+				omega[i] = OMEGA_MAX;
+			} else if (omega[i] < 0) {
+				CEREBRI_LOG_WRN_LIMIT("omega negative: %10.4f", omega[i]);
+				omega[i] = 0;
+			}
+			ctx->actuators.velocity[i] = omega[i];
+		}
+	}
+
+	// publish
+	stamp_msg_now(&ctx->actuators.stamp);
+	ctx->actuators.has_stamp = true;
+	synapse_latency_mark(SYNAPSE_LATENCY_ALLOCATION, &ctx->latency);
+	CEREBRI_TRACE_NAMED(TRACE_EVENT_PUBLISH, "actuators", 0);
+	zros_pub_update(&ctx->pub_actuators);
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+static void rdd2_allocation_execute(struct executor_task *task)
+{
+	struct context *ctx = CONTAINER_OF(task, struct context, task);
+
+	bool available = zros_sub_update_available(&ctx->sub_moment_sp);
+	int rc = executor_wait(task, available, 100);
+	if (rc != -EBUSY) {
+		rdd2_allocation_update(ctx, rc);
+	}
+}
+#endif
+
 static void rdd2_allocation_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -108,71 +275,37 @@ static void rdd2_allocation_run(void *p0, void *p1, void *p2)
 
 	struct k_poll_event events[] = {
 		*zros_sub_get_event(&ctx->sub_moment_sp),
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+		SYNAPSE_LIVENESS_POLL_EVENT(&ctx->liveness),
+#endif
 	};
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	if (executor_register(&ctx->task, "rdd2_allocation", rdd2_allocation_execute,
+			      EXECUTOR_STAGE_ALLOCATION, EXECUTOR_FRAME_US, 0,
+			      MY_DEADLINE_US) == 0) {
+		// updates run in the executor frame, park until stopped
+		k_sem_take(&ctx->running, K_FOREVER);
+		executor_unregister(&ctx->task);
+		rdd2_allocation_fini(ctx);
+		return;
+	}
+#endif
+
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 		int rc = 0;
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(100));
+		CEREBRI_TRACE_NAMED(TRACE_EVENT_POLL_RETURN, "rdd2_allocation", rc);
 		if (rc != 0) {
-			LOG_DBG("not receiving moment_sp");
+			CEREBRI_LOG_DBG_LIMIT("not receiving moment_sp");
 		}
-
-		// update subscriptions
-		zros_sub_update(&ctx->sub_status);
-		zros_sub_update(&ctx->sub_force_sp);
-		zros_sub_update(&ctx->sub_moment_sp);
-
-		if (rc < 0) {
-			stop(ctx);
-			LOG_DBG("no data, stopped");
-		} else if (ctx->status.arming != synapse_pb_Status_Arming_ARMING_ARMED) {
-			// not armed, stop
-			stop(ctx);
-		} else {
-			static double const F_max = 20.0;
-			static double const l = CONFIG_CEREBRI_RDD2_MOTOR_L_MM * 1e-3;
-			static double const Cm = CONFIG_CEREBRI_RDD2_MOTOR_CM * 1e-6;
-			static double const Ct = CONFIG_CEREBRI_RDD2_MOTOR_CT * 1e-9;
-			double omega[4];
-			double Fp_sum[4], F_moment[4], F_thrust[4], M_sat[3];
-			double moment[3] = {ctx->moment_sp.x, ctx->moment_sp.y, ctx->moment_sp.z};
-
-			// control_allocation:(F_max,l,Cm,Ct,T,M[3])->(omega[4],Fp_sum[4],F_moment[4],F_thrust[4],M_sat[3])
-			CASADI_FUNC_ARGS(control_allocation)
-
-			args[0] = &F_max;
-			args[1] = &l;
-			args[2] = &Cm;
-			args[3] = &Ct;
-			args[4] = &ctx->force_sp.z;
-			args[5] = moment;
-
-			res[0] = omega;
-			res[1] = Fp_sum;
-			res[2] = F_moment;
-			res[3] = F_thrust;
-			res[4] = M_sat;
-			CASADI_FUNC_CALL(control_allocation)
-
-			for (int i = 0; i < 4; i++) {
-				if (!isfinite(omega[i])) {
-					LOG_WRN("omega is not finite: %10.4f", omega[i]);
-					omega[i] = 0;
-				} else if (omega[i] > 3000) {
-					LOG_WRN("omega too large: %10.4f", omega[i]);
-					omega[i] = 3000;
-				} else if (omega[i] < 0) {
-					LOG_WRN("omega negative: %10.4f", omega[i]);
-					omega[i] = 0;
-				}
-				ctx->actuators.velocity[i] = omega[i];
-			}
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+		if (events[1].state == K_POLL_STATE_SIGNALED) {
+			synapse_liveness_ack(&ctx->liveness, &events[1]);
 		}
+#endif
 
-		// publish
-		stamp_msg(&ctx->actuators.stamp, k_uptime_ticks());
-		ctx->actuators.has_stamp = true;
-		zros_pub_update(&ctx->pub_actuators);
+		rdd2_allocation_update(ctx, rc);
 	}
 
 	rdd2_allocation_fini(ctx);
@@ -207,6 +340,11 @@ static int rdd2_allocation_cmd_handler(const struct shell *sh, size_t argc, char
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_MATRIX)
+		shell_print(sh, "motors: %d", MOTORS);
+		shell_print(sh, "saturated moment: %u yaw: %u thrust: %u", ctx->mixer.sat_moment,
+			    ctx->mixer.sat_yaw, ctx->mixer.sat_thrust);
+#endif
 	}
 	return 0;
 }
@@ -5,6 +5,7 @@
 
 #include <math.h>
 
+#include <synapse_latency.h>
 #include <synapse_topic_list.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
@@ -16,17 +17,23 @@
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/core/boot.h>
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/executor.h>
 #include <cerebri/core/log_utils.h>
+#include <cerebri/core/placement.h>
+#include <cerebri/core/trace.h>
 
 #include "app/rdd2/casadi/rdd2.h"
+#include "gains.h"
 
-#define MY_STACK_SIZE 3072
-#define MY_PRIORITY   4
+#define MY_STACK_SIZE  3072
+#define MY_PRIORITY    4
+#define MY_DEADLINE_US 500
 
 CEREBRI_NODE_LOG_INIT(rdd2_angular_velocity, LOG_LEVEL_WRN);
 
-static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+static CEREBRI_HOT_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
 struct context {
 	struct zros_node node;
@@ -35,20 +42,25 @@ struct context {
 	synapse_pb_Odometry odometry_estimator;
 	struct zros_sub sub_status, sub_angular_velocity_sp, sub_odometry_estimator, sub_moment_ff;
 	struct zros_pub pub_moment_sp;
+	struct synapse_latency_trace latency;
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	struct executor_task task;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
 	struct k_thread thread_data;
-	double dt;
-	double omega[3];
-	double omega_r[3];
-	double omega_i[3];
-	double omega_e[3];
-	double domega_e[3];
-	double alpha;
+	int64_t ticks_last;
+	casadi_real dt;
+	casadi_real omega[3];
+	casadi_real omega_r[3];
+	casadi_real omega_i[3];
+	casadi_real omega_e[3];
+	casadi_real domega_e[3];
+	casadi_real alpha;
 };
 
-static struct context g_ctx = {
+static struct context g_ctx CEREBRI_HOT_CONTEXT = {
 	.node = {},
 	.status = synapse_pb_Status_init_default,
 	.moment_sp = synapse_pb_Vector3_init_default,
@@ -79,6 +91,7 @@ static void rdd2_angular_velocity_init(struct context *ctx)
 	zros_sub_init(&ctx->sub_moment_ff, &ctx->node, &topic_moment_ff, &ctx->moment_ff, 1000);
 	zros_pub_init(&ctx->pub_moment_sp, &ctx->node, &topic_moment_sp, &ctx->moment_sp);
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("rdd2_angular_velocity init");
 	LOG_INF("init");
 }
 
@@ -94,6 +107,102 @@ static void rdd2_angular_velocity_fini(struct context *ctx)
 	LOG_INF("fini");
 }
 
+static void rdd2_angular_velocity_update(struct context *ctx)
+{
+	// update subscriptions
+	zros_sub_update(&ctx->sub_status);
+	zros_sub_update(&ctx->sub_odometry_estimator);
+	zros_sub_update(&ctx->sub_angular_velocity_sp);
+	zros_sub_update(&ctx->sub_moment_ff);
+	// woken by estimator odometry, attitude runs in parallel on the same trace
+	synapse_latency_get(SYNAPSE_LATENCY_ESTIMATE, &ctx->latency);
+
+	// calculate dt
+	int64_t ticks_now = k_uptime_ticks();
+	ctx->dt = (double)(ticks_now - ctx->ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+	ctx->ticks_last = ticks_now;
+	if (ctx->dt < 0 || ctx->dt > 0.1) {
+		CEREBRI_LOG_DBG_LIMIT("odometry rate too low");
+		return;
+	}
+
+	casadi_real M[3];
+	{
+		// attitude_rate_control:(
+		// kp[3],ki[3],kd[3],f_cut,i_max[3],
+		// omega[3],omega_r[3],i0[3],e0[3],de0[3],dt)->(M[3],i1[3],e1[3],de1[3])
+		CASADI_FUNC_ARGS(attitude_rate_control);
+
+		ctx->omega[0] = ctx->odometry_estimator.twist.angular.x;
+		ctx->omega[1] = ctx->odometry_estimator.twist.angular.y;
+		ctx->omega[2] = ctx->odometry_estimator.twist.angular.z;
+		ctx->omega_r[0] = ctx->angular_velocity_sp.x;
+		ctx->omega_r[1] = ctx->angular_velocity_sp.y;
+		ctx->omega_r[2] = ctx->angular_velocity_sp.z;
+
+		const struct rdd2_rate_param *param = PARAM_GET(rdd2_rate, struct rdd2_rate_param);
+
+		args[0] = param->kp;
+		args[1] = param->ki;
+		args[2] = param->kd;
+		args[3] = &param->f_cut;
+		args[4] = param->i_max;
+		args[5] = ctx->omega;
+		args[6] = ctx->omega_r;
+		args[7] = ctx->omega_i;
+		args[8] = ctx->omega_e;
+		args[9] = ctx->domega_e;
+		args[10] = &ctx->dt;
+
+		res[0] = M;
+		res[1] = ctx->omega_i;
+		res[2] = ctx->omega_e;
+		res[3] = ctx->domega_e;
+		res[4] = &ctx->alpha;
+
+		CASADI_FUNC_CALL(attitude_rate_control);
+	}
+
+	bool data_ok = true;
+	for (int i = 0; i < 3; i++) {
+		if (!isfinite(ctx->omega_i[i])) {
+			CEREBRI_LOG_ERR_LIMIT("omega_i[%d] not finite: %10.4f", i, ctx->omega_i[i]);
+			data_ok = false;
+			break;
+		}
+		if (!isfinite(M[i])) {
+			CEREBRI_LOG_ERR_LIMIT("M[%d] not finite: %10.4f", i, M[i]);
+			data_ok = false;
+			break;
+		}
+	}
+
+	// publish moment setpoint
+	if (data_ok) {
+		stamp_msg_now(&ctx->moment_sp.stamp);
+		ctx->moment_sp.has_stamp = true;
+		ctx->moment_sp.x = M[0] + ctx->moment_ff.x;
+		ctx->moment_sp.y = M[1] + ctx->moment_ff.y;
+		ctx->moment_sp.z = M[2] + ctx->moment_ff.z;
+		synapse_latency_mark(SYNAPSE_LATENCY_ANGULAR_VELOCITY, &ctx->latency);
+		CEREBRI_TRACE_NAMED(TRACE_EVENT_PUBLISH, "moment_sp", 0);
+		zros_pub_update(&ctx->pub_moment_sp);
+	}
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+static void rdd2_angular_velocity_execute(struct executor_task *task)
+{
+	struct context *ctx = CONTAINER_OF(task, struct context, task);
+
+	bool available = zros_sub_update_available(&ctx->sub_odometry_estimator);
+	int rc = executor_wait(task, available, 100);
+	if (rc != -EBUSY) {
+		rdd2_angular_velocity_update(ctx);
+	}
+}
+#endif
+
 static void rdd2_angular_velocity_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -106,116 +215,30 @@ static void rdd2_angular_velocity_run(void *p0, void *p1, void *p2)
 		*zros_sub_get_event(&ctx->sub_odometry_estimator),
 	};
 
-	int64_t ticks_last = k_uptime_ticks();
-
-	// PID controller constants
-	static const double kp[3] = {
-		CONFIG_CEREBRI_RDD2_ROLLRATE_KP * 1e-6,
-		CONFIG_CEREBRI_RDD2_PITCHRATE_KP * 1e-6,
-		CONFIG_CEREBRI_RDD2_YAWRATE_KP * 1e-6,
-	};
-
-	static const double ki[3] = {
-		CONFIG_CEREBRI_RDD2_ROLLRATE_KI * 1e-6,
-		CONFIG_CEREBRI_RDD2_PITCHRATE_KI * 1e-6,
-		CONFIG_CEREBRI_RDD2_YAWRATE_KI * 1e-6,
-	};
-
-	static const double kd[3] = {
-		CONFIG_CEREBRI_RDD2_ROLLRATE_KD * 1e-6,
-		CONFIG_CEREBRI_RDD2_PITCHRATE_KD * 1e-6,
-		CONFIG_CEREBRI_RDD2_YAWRATE_KD * 1e-6,
-	};
-
-	static const double i_max[3] = {
-		CONFIG_CEREBRI_RDD2_ROLLRATE_IMAX * 1e-6,
-		CONFIG_CEREBRI_RDD2_PITCHRATE_IMAX * 1e-6,
-		CONFIG_CEREBRI_RDD2_YAWRATE_IMAX * 1e-6,
-	};
-
-	static const double f_cut = CONFIG_CEREBRI_RDD2_ATTITUDE_RATE_FCUT * 1e-3;
+	ctx->ticks_last = k_uptime_ticks();
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	if (executor_register(&ctx->task, "rdd2_angular_velocity", rdd2_angular_velocity_execute,
+			      EXECUTOR_STAGE_ANGULAR_VELOCITY, EXECUTOR_FRAME_US, 0,
+			      MY_DEADLINE_US) == 0) {
+		// updates run in the executor frame, park until stopped
+		k_sem_take(&ctx->running, K_FOREVER);
+		executor_unregister(&ctx->task);
+		rdd2_angular_velocity_fini(ctx);
+		return;
+	}
+#endif
 
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 		// wait for estimator odometry, publish at 10 Hz regardless
 		int rc = 0;
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(100));
+		CEREBRI_TRACE_NAMED(TRACE_EVENT_POLL_RETURN, "rdd2_angular_velocity", rc);
 		if (rc != 0) {
-			LOG_DBG("not receiving estimator odometry");
-		}
-
-		// update subscriptions
-		zros_sub_update(&ctx->sub_status);
-		zros_sub_update(&ctx->sub_odometry_estimator);
-		zros_sub_update(&ctx->sub_angular_velocity_sp);
-		zros_sub_update(&ctx->sub_moment_ff);
-
-		// calculate dt
-		int64_t ticks_now = k_uptime_ticks();
-		ctx->dt = (double)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-		ticks_last = ticks_now;
-		if (ctx->dt < 0 || ctx->dt > 0.1) {
-			LOG_DBG("odometry rate too low");
-			continue;
-		}
-
-		double M[3];
-		{
-			// attitude_rate_control:(
-			// kp[3],ki[3],kd[3],f_cut,i_max[3],
-			// omega[3],omega_r[3],i0[3],e0[3],de0[3],dt)->(M[3],i1[3],e1[3],de1[3])
-			CASADI_FUNC_ARGS(attitude_rate_control);
-
-			ctx->omega[0] = ctx->odometry_estimator.twist.angular.x;
-			ctx->omega[1] = ctx->odometry_estimator.twist.angular.y;
-			ctx->omega[2] = ctx->odometry_estimator.twist.angular.z;
-			ctx->omega_r[0] = ctx->angular_velocity_sp.x;
-			ctx->omega_r[1] = ctx->angular_velocity_sp.y;
-			ctx->omega_r[2] = ctx->angular_velocity_sp.z;
-
-			args[0] = kp;
-			args[1] = ki;
-			args[2] = kd;
-			args[3] = &f_cut;
-			args[4] = i_max;
-			args[5] = ctx->omega;
-			args[6] = ctx->omega_r;
-			args[7] = ctx->omega_i;
-			args[8] = ctx->omega_e;
-			args[9] = ctx->domega_e;
-			args[10] = &ctx->dt;
-
-			res[0] = M;
-			res[1] = ctx->omega_i;
-			res[2] = ctx->omega_e;
-			res[3] = ctx->domega_e;
-			res[4] = &ctx->alpha;
-
-			CASADI_FUNC_CALL(attitude_rate_control);
-		}
-
-		bool data_ok = true;
-		for (int i = 0; i < 3; i++) {
-			if (!isfinite(ctx->omega_i[i])) {
-				LOG_ERR("omega_i[%d] not finite: %10.4f", i, ctx->omega_i[i]);
-				data_ok = false;
-				break;
-			}
-			if (!isfinite(M[i])) {
-				LOG_ERR("M[%d] not finite: %10.4f", i, M[i]);
-				data_ok = false;
-				break;
-			}
+			CEREBRI_LOG_DBG_LIMIT("not receiving estimator odometry");
 		}
 
-		// publish moment setpoint
-		if (data_ok) {
-			stamp_msg(&ctx->moment_sp.stamp, k_uptime_ticks());
-			ctx->moment_sp.has_stamp = true;
-			ctx->moment_sp.x = M[0] + ctx->moment_ff.x;
-			ctx->moment_sp.y = M[1] + ctx->moment_ff.y;
-			ctx->moment_sp.z = M[2] + ctx->moment_ff.z;
-			zros_pub_update(&ctx->pub_moment_sp);
-		}
+		rdd2_angular_velocity_update(ctx);
 	}
 
 	rdd2_angular_velocity_fini(ctx);
@@ -15,19 +15,28 @@
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/core/boot.h>
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/executor.h>
 #include <cerebri/core/log_utils.h>
+#include <cerebri/core/placement.h>
+#include <cerebri/core/trace.h>
 
+#include <synapse_latency.h>
 #include <synapse_topic_list.h>
 
 #include "app/rdd2/casadi/rdd2.h"
+#include "app/rdd2/casadi/rdd2_loglinear.h"
+#include "gains.h"
+#include "variant.h"
 
-#define MY_STACK_SIZE 3072
-#define MY_PRIORITY   4
+#define MY_STACK_SIZE  3072
+#define MY_PRIORITY    4
+#define MY_DEADLINE_US 500
 
 CEREBRI_NODE_LOG_INIT(rdd2_attitude, LOG_LEVEL_WRN);
 
-static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+static CEREBRI_HOT_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
 struct context {
 	struct zros_node node;
@@ -38,13 +47,18 @@ struct context {
 	struct zros_sub sub_status, sub_attitude_sp, sub_odometry_estimator,
 		sub_angular_velocity_ff;
 	struct zros_pub pub_angular_velocity_sp;
+	struct synapse_latency_trace latency;
+	struct rdd2_variant variant;
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	struct executor_task task;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
 	struct k_thread thread_data;
 };
 
-static struct context g_ctx = {
+static struct context g_ctx CEREBRI_HOT_CONTEXT = {
 	.node = {},
 	.status = synapse_pb_Status_init_default,
 	.attitude_sp = synapse_pb_Quaternion_init_default,
@@ -61,6 +75,11 @@ static struct context g_ctx = {
 	.thread_data = {},
 };
 
+static const char *const g_variant_perf_names[RDD2_VARIANT_COUNT] = {
+	[RDD2_VARIANT_STANDARD] = "rdd2_attitude standard",
+	[RDD2_VARIANT_LOG_LINEAR] = "rdd2_attitude log_linear",
+};
+
 static void rdd2_attitude_init(struct context *ctx)
 {
 	zros_node_init(&ctx->node, "rdd2_attitude");
@@ -72,7 +91,11 @@ static void rdd2_attitude_init(struct context *ctx)
 		      &ctx->angular_velocity_ff, 50);
 	zros_pub_init(&ctx->pub_angular_velocity_sp, &ctx->node, &topic_angular_velocity_sp,
 		      &ctx->angular_velocity_sp);
+	rdd2_variant_init(&ctx->variant, g_variant_perf_names,
+			  PARAM_GET(rdd2_control, struct rdd2_control_param)->attitude,
+			  MY_DEADLINE_US * 1e-6);
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("rdd2_attitude init");
 	LOG_INF("init");
 }
 
@@ -83,11 +106,117 @@ static void rdd2_attitude_fini(struct context *ctx)
 	zros_sub_fini(&ctx->sub_odometry_estimator);
 	zros_sub_fini(&ctx->sub_angular_velocity_ff);
 	zros_pub_fini(&ctx->pub_angular_velocity_sp);
+	rdd2_variant_fini(&ctx->variant);
 	zros_node_fini(&ctx->node);
 	k_sem_give(&ctx->running);
 	LOG_INF("fini");
 }
 
+static void rdd2_attitude_update(struct context *ctx)
+{
+	// update subscriptions
+	zros_sub_update(&ctx->sub_status);
+	zros_sub_update(&ctx->sub_odometry_estimator);
+	zros_sub_update(&ctx->sub_attitude_sp);
+	zros_sub_update(&ctx->sub_angular_velocity_ff);
+	synapse_latency_get(SYNAPSE_LATENCY_ESTIMATE, &ctx->latency);
+
+	if (ctx->status.mode != synapse_pb_Status_Mode_MODE_ATTITUDE_RATE) {
+		casadi_real q_wb[4] = {ctx->odometry_estimator.pose.orientation.w,
+				       ctx->odometry_estimator.pose.orientation.x,
+				       ctx->odometry_estimator.pose.orientation.y,
+				       ctx->odometry_estimator.pose.orientation.z};
+
+		casadi_real q_r[4] = {ctx->attitude_sp.w, ctx->attitude_sp.x, ctx->attitude_sp.y,
+				      ctx->attitude_sp.z};
+		casadi_real omega[RDD2_VARIANT_COUNT][3];
+		const struct rdd2_attitude_param *param =
+			PARAM_GET(rdd2_attitude, struct rdd2_attitude_param);
+		struct rdd2_variant *variant = &ctx->variant;
+		double weight = rdd2_variant_update(
+			variant, PARAM_GET(rdd2_control, struct rdd2_control_param)->attitude,
+			ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED);
+
+		if (rdd2_variant_runs(variant, RDD2_VARIANT_STANDARD)) {
+			// attitude_control:(kp[3],q[4],q_r[4])->(omega[3])
+			CASADI_FUNC_ARGS(attitude_control);
+			perf_duration_start(&variant->perf[RDD2_VARIANT_STANDARD]);
+
+			args[0] = param->kp;
+			args[1] = q_wb;
+			args[2] = q_r;
+
+			res[0] = omega[RDD2_VARIANT_STANDARD];
+
+			CASADI_FUNC_CALL(attitude_control);
+			perf_duration_stop(&variant->perf[RDD2_VARIANT_STANDARD]);
+		}
+
+		if (rdd2_variant_runs(variant, RDD2_VARIANT_LOG_LINEAR)) {
+			// so3_attitude_control:(kp[3],q[4],q_r[4])->(omega[3])
+			CASADI_FUNC_ARGS(so3_attitude_control);
+			perf_duration_start(&variant->perf[RDD2_VARIANT_LOG_LINEAR]);
+
+			args[0] = param->kp;
+			args[1] = q_wb;
+			args[2] = q_r;
+
+			res[0] = omega[RDD2_VARIANT_LOG_LINEAR];
+
+			CASADI_FUNC_CALL(so3_attitude_control);
+			perf_duration_stop(&variant->perf[RDD2_VARIANT_LOG_LINEAR]);
+		}
+
+		// attitude error angle, the quaternions may be on opposite hemispheres
+		double dot = q_wb[0] * q_r[0] + q_wb[1] * q_r[1] + q_wb[2] * q_r[2] +
+			     q_wb[3] * q_r[3];
+		rdd2_variant_track(variant, 2 * acos(MIN(fabs(dot), 1.0)));
+
+		// the rate setpoint moves from the previous variant to the new one
+		casadi_real omega_sp[3];
+		for (int i = 0; i < 3; i++) {
+			omega_sp[i] = omega[variant->active][i];
+			if (weight < 1) {
+				omega_sp[i] = weight * omega_sp[i] +
+					      (1 - weight) * omega[variant->previous][i];
+			}
+		}
+
+		// publish
+		bool data_ok = true;
+		for (int i = 0; i < 3; i++) {
+			if (!isfinite(omega_sp[i])) {
+				CEREBRI_LOG_WRN_LIMIT("omega[0] not finite: %10.4f", omega_sp[i]);
+				data_ok = false;
+			}
+		}
+
+		if (data_ok) {
+			stamp_msg_now(&ctx->angular_velocity_sp.stamp);
+			ctx->angular_velocity_sp.has_stamp = true;
+			ctx->angular_velocity_sp.x = omega_sp[0] + ctx->angular_velocity_ff.x;
+			ctx->angular_velocity_sp.y = omega_sp[1] + ctx->angular_velocity_ff.y;
+			ctx->angular_velocity_sp.z = omega_sp[2] + ctx->angular_velocity_ff.z;
+			synapse_latency_mark(SYNAPSE_LATENCY_ATTITUDE, &ctx->latency);
+			CEREBRI_TRACE_NAMED(TRACE_EVENT_PUBLISH, "angular_velocity_sp", 0);
+			zros_pub_update(&ctx->pub_angular_velocity_sp);
+		}
+	}
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+static void rdd2_attitude_execute(struct executor_task *task)
+{
+	struct context *ctx = CONTAINER_OF(task, struct context, task);
+
+	bool available = zros_sub_update_available(&ctx->sub_odometry_estimator);
+	int rc = executor_wait(task, available, 1000);
+	if (rc == 0) {
+		rdd2_attitude_update(ctx);
+	}
+}
+#endif
+
 static void rdd2_attitude_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -96,13 +225,6 @@ static void rdd2_attitude_run(void *p0, void *p1, void *p2)
 
 	rdd2_attitude_init(ctx);
 
-	// constants
-	static const double kp[3] = {
-		CONFIG_CEREBRI_RDD2_ROLL_KP * 1e-6,
-		CONFIG_CEREBRI_RDD2_PITCH_KP * 1e-6,
-		CONFIG_CEREBRI_RDD2_YAW_KP * 1e-6,
-	};
-
 	// wait for attitude setpoint
 	struct k_poll_event events[1];
 	events[0] = *zros_sub_get_event(&ctx->sub_attitude_sp);
@@ -110,7 +232,7 @@ static void rdd2_attitude_run(void *p0, void *p1, void *p2)
 		int rc = 0;
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
 		if (rc != 0) {
-			LOG_DBG("not receiving attitude_setpoint");
+			CEREBRI_LOG_DBG_LIMIT("not receiving attitude_setpoint");
 		} else {
 			break;
 		}
@@ -118,61 +240,28 @@ static void rdd2_attitude_run(void *p0, void *p1, void *p2)
 
 	// poll on odometry from estimator
 	events[0] = *zros_sub_get_event(&ctx->sub_odometry_estimator);
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	if (executor_register(&ctx->task, "rdd2_attitude", rdd2_attitude_execute,
+			      EXECUTOR_STAGE_ATTITUDE, EXECUTOR_FRAME_US, 0, MY_DEADLINE_US) == 0) {
+		// updates run in the executor frame, park until stopped
+		k_sem_take(&ctx->running, K_FOREVER);
+		executor_unregister(&ctx->task);
+		rdd2_attitude_fini(ctx);
+		return;
+	}
+#endif
+
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 		int rc = 0;
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
+		CEREBRI_TRACE_NAMED(TRACE_EVENT_POLL_RETURN, "rdd2_attitude", rc);
 		if (rc != 0) {
-			LOG_DBG("not receiving odometry_estimator");
+			CEREBRI_LOG_DBG_LIMIT("not receiving odometry_estimator");
 			continue;
 		}
 
-		// update subscriptions
-		zros_sub_update(&ctx->sub_status);
-		zros_sub_update(&ctx->sub_odometry_estimator);
-		zros_sub_update(&ctx->sub_attitude_sp);
-		zros_sub_update(&ctx->sub_angular_velocity_ff);
-
-		if (ctx->status.mode != synapse_pb_Status_Mode_MODE_ATTITUDE_RATE) {
-			double q_wb[4] = {ctx->odometry_estimator.pose.orientation.w,
-					  ctx->odometry_estimator.pose.orientation.x,
-					  ctx->odometry_estimator.pose.orientation.y,
-					  ctx->odometry_estimator.pose.orientation.z};
-
-			double q_r[4] = {ctx->attitude_sp.w, ctx->attitude_sp.x, ctx->attitude_sp.y,
-					 ctx->attitude_sp.z};
-			double omega[3];
-
-			{
-				// attitude_control:(kp[3],q[4],q_r[4])->(omega[3])
-				CASADI_FUNC_ARGS(attitude_control);
-
-				args[0] = kp;
-				args[1] = q_wb;
-				args[2] = q_r;
-
-				res[0] = omega;
-
-				CASADI_FUNC_CALL(attitude_control);
-			}
-
-			// publish
-			bool data_ok = true;
-			for (int i = 0; i < 3; i++) {
-				if (!isfinite(omega[i])) {
-					LOG_WRN("omega[0] not finite: %10.4f", omega[i]);
-					data_ok = false;
-				}
-			}
-
-			if (data_ok) {
-				stamp_msg(&ctx->angular_velocity_sp.stamp, k_uptime_ticks());
-				ctx->angular_velocity_sp.has_stamp = true;
-				ctx->angular_velocity_sp.x = omega[0] + ctx->angular_velocity_ff.x;
-				ctx->angular_velocity_sp.y = omega[1] + ctx->angular_velocity_ff.y;
-				ctx->angular_velocity_sp.z = omega[2] + ctx->angular_velocity_ff.z;
-				zros_pub_update(&ctx->pub_angular_velocity_sp);
-			}
-		}
+		rdd2_attitude_update(ctx);
 	}
 
 	rdd2_attitude_fini(ctx);
@@ -207,6 +296,7 @@ static int rdd2_attitude_cmd_handler(const struct shell *sh, size_t argc, char *
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		rdd2_variant_status(&ctx->variant, sh);
 	}
 	return 0;
 }
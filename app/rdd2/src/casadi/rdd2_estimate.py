@@ -0,0 +1,198 @@
+"""
+Fused estimator kernels over packed covariances.
+
+The estimator functions generated by cyecca/models/rdd2.py take full 6x6
+covariances, and are called one after the other every imu step. The
+kernels here compose them symbolically, so the generated code computes
+each step in one call, and keep covariances as the 21 values of their
+upper triangle, row by row, so only the unique entries are loaded,
+computed and stored.
+"""
+
+import argparse
+import importlib.util
+import inspect
+import os
+import sys
+from pathlib import Path
+
+import casadi as ca
+
+print("python: ", sys.executable)
+
+
+def load_functions(model_path: str) -> dict:
+    """
+    Every casadi function the derive_ functions of the cyecca model
+    return, by name, without depending on how they are grouped.
+    """
+    spec = importlib.util.spec_from_file_location("rdd2_model", model_path)
+    model = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(model)
+    funcs = {}
+    for name, derive in inspect.getmembers(model, inspect.isfunction):
+        if not name.startswith("derive_"):
+            continue
+        params = inspect.signature(derive).parameters.values()
+        if any(p.default is inspect.Parameter.empty for p in params):
+            continue
+        eqs = derive()
+        if isinstance(eqs, dict):
+            funcs.update({k: v for k, v in eqs.items() if isinstance(v, ca.Function)})
+    return funcs
+
+
+def sx_function(f: ca.Function) -> ca.Function:
+    return f.expand() if f.is_a("MXFunction") else f
+
+
+def packed_size(n: int) -> int:
+    return n * (n + 1) // 2
+
+
+def unpack(p: ca.SX, n: int) -> ca.SX:
+    """symmetric n x n matrix from its upper triangle, row by row"""
+    P = ca.SX(n, n)
+    k = 0
+    for i in range(n):
+        for j in range(i, n):
+            P[i, j] = p[k]
+            P[j, i] = p[k]
+            k += 1
+    return P
+
+
+def pack(P: ca.SX, n: int) -> ca.SX:
+    return ca.vertcat(*[P[i, j] for i in range(n) for j in range(i, n)])
+
+
+def call_packed(f: ca.Function, i_P: int, args: list, p: ca.SX, n: int) -> list:
+    """call f with the covariance argument i_P given packed, and its last result packed"""
+    shape = f.size_in(i_P)
+    args = list(args)
+    args.insert(i_P, ca.reshape(unpack(p, n), shape[0], shape[1]))
+    res = list(f(*args))
+    res[-1] = pack(ca.reshape(res[-1], n, n), n)
+    return res
+
+
+def derive_kernels(funcs: dict) -> dict:
+    propagate = sx_function(funcs["strapdown_ins_propagate"])
+    correct = sx_function(funcs["position_correction"])
+    attitude = sx_function(funcs["attitude_estimator"])
+
+    n_pos = int(round(correct.numel_in(3) ** 0.5))
+    n_att = int(round(attitude.numel_in(8) ** 0.5))
+
+    x0 = ca.SX.sym("x0", 10)
+    a_b = ca.SX.sym("a_b", 3)
+    omega_b = ca.SX.sym("omega_b", 3)
+    g = ca.SX.sym("g")
+    dt = ca.SX.sym("dt")
+    gps = ca.SX.sym("gps", 3)
+    mag = ca.SX.sym("mag", 3)
+    mag_decl = ca.SX.sym("mag_decl")
+    accel_gain = ca.SX.sym("accel_gain")
+    mag_gain = ca.SX.sym("mag_gain")
+    P_pos = ca.SX.sym("P_pos", packed_size(n_pos))
+    P_att = ca.SX.sym("P_att", packed_size(n_att))
+
+    def attitude_step(x, q):
+        # the attitude estimator starts from the propagated attitude
+        q1, P_att1 = call_packed(
+            attitude, 8, [q, mag, mag_decl, omega_b, a_b, accel_gain, mag_gain, dt], P_att, n_att
+        )
+        return ca.vertcat(x[0:6], q1), P_att1
+
+    x_prop = propagate(x0, a_b, omega_b, g, dt)
+    x_corr, P_pos1 = call_packed(correct, 3, [x_prop, gps, dt], P_pos, n_pos)
+    x_step, P_att_step = attitude_step(x_corr, x_prop[6:10])
+    f_step = ca.Function(
+        "estimate_step",
+        [x0, a_b, omega_b, g, dt, gps, P_pos, mag, mag_decl, accel_gain, mag_gain, P_att],
+        [x_step, P_pos1, P_att_step],
+        [
+            "x0",
+            "a_b",
+            "omega_b",
+            "g",
+            "dt",
+            "gps",
+            "P_pos",
+            "mag",
+            "mag_decl",
+            "accel_gain",
+            "mag_gain",
+            "P_att",
+        ],
+        ["x1", "P_pos1", "P_att1"],
+    )
+
+    # without the position correction, for measurements fused at their own time
+    x_prop_only, P_att_prop = attitude_step(x_prop, x_prop[6:10])
+    f_propagate = ca.Function(
+        "estimate_propagate",
+        [x0, a_b, omega_b, g, dt, mag, mag_decl, accel_gain, mag_gain, P_att],
+        [x_prop_only, P_att_prop],
+        ["x0", "a_b", "omega_b", "g", "dt", "mag", "mag_decl", "accel_gain", "mag_gain", "P_att"],
+        ["x1", "P_att1"],
+    )
+
+    x_fix, P_pos_fix = call_packed(correct, 3, [x0, gps, dt], P_pos, n_pos)
+    f_correct = ca.Function(
+        "estimate_position_correction",
+        [x0, gps, dt, P_pos],
+        [x_fix, P_pos_fix],
+        ["x0", "gps", "dt", "P_pos"],
+        ["x1", "P_pos1"],
+    )
+
+    return {
+        "estimate_step": f_step,
+        "estimate_propagate": f_propagate,
+        "estimate_position_correction": f_correct,
+    }
+
+
+def generate_code(eqs: dict, filename, dest_dir: str, **kwargs):
+    """
+    Generate C Code from python CasADi functions.
+    """
+    dest_dir = Path(dest_dir)
+    dest_dir.mkdir(exist_ok=True)
+    p = {
+        "verbose": True,
+        "mex": False,
+        "cpp": False,
+        "main": False,
+        "with_header": True,
+        "with_mem": False,
+        "with_export": False,
+        "with_import": False,
+        "include_math": True,
+        "avoid_stack": True,
+    }
+    for k, v in kwargs.items():
+        assert k in p.keys()
+        p[k] = v
+
+    gen = ca.CodeGenerator(filename, p)
+    for name, eq in eqs.items():
+        gen.add(eq)
+    gen.generate(str(dest_dir) + os.sep)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("model")
+    parser.add_argument("dest_dir")
+    args = parser.parse_args()
+
+    print("generating casadi equations in {:s}".format(args.dest_dir))
+    eqs = derive_kernels(load_functions(args.model))
+
+    for name, eq in eqs.items():
+        print("eq: ", name)
+
+    generate_code(eqs, filename="rdd2_estimate.c", dest_dir=args.dest_dir)
+    print("complete")
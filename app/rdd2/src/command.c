@@ -4,6 +4,7 @@
  */
 
 #include "command.h"
+#include <cerebri/core/boot.h>
 #include <cerebri/core/log_utils.h>
 
 #define MY_STACK_SIZE 16384
@@ -24,6 +25,12 @@ static struct context g_ctx = {
 	.angular_velocity_ff = synapse_pb_Vector3_init_default,
 	.force_sp = synapse_pb_Vector3_init_default,
 	.bezier_trajectory = synapse_pb_BezierTrajectory_init_default,
+	.bezier = {},
+	.bezier_front = &g_ctx.bezier[0],
+	.bezier_back = &g_ctx.bezier[1],
+	.bezier_chunks = 0,
+	.bezier_swaps = 0,
+	.bezier_dropped = 0,
 	.status = synapse_pb_Status_init_default,
 	.last_status = synapse_pb_Status_init_default,
 	.velocity_sp = synapse_pb_Vector3_init_default,
@@ -42,7 +49,6 @@ static struct context g_ctx = {
 	.sub_input_sbus = {},
 	.sub_status = {},
 	.sub_bezier_trajectory_ethernet = {},
-	.sub_clock_offset_ethernet = {},
 	.sub_odometry_estimator = {},
 	.sub_cmd_vel_ethernet = {},
 	.pub_attitude_sp = {},
@@ -75,8 +81,6 @@ static void rdd2_command_init(struct context *ctx)
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
 	zros_sub_init(&ctx->sub_bezier_trajectory_ethernet, &ctx->node,
 		      &topic_bezier_trajectory_ethernet, &ctx->bezier_trajectory, 10);
-	zros_sub_init(&ctx->sub_clock_offset_ethernet, &ctx->node, &topic_clock_offset_ethernet,
-		      &ctx->clock_offset, 10);
 	zros_sub_init(&ctx->sub_odometry_estimator, &ctx->node, &topic_odometry_estimator,
 		      &ctx->odometry_estimator, 10);
 	zros_sub_init(&ctx->sub_cmd_vel_ethernet, &ctx->node, &topic_cmd_vel_ethernet,
@@ -93,6 +97,7 @@ static void rdd2_command_init(struct context *ctx)
 	zros_pub_init(&ctx->pub_position_sp, &ctx->node, &topic_position_sp, &ctx->position_sp);
 	zros_pub_init(&ctx->pub_input, &ctx->node, &topic_input, &ctx->input);
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("rdd2_command init");
 	LOG_INF("init");
 }
 
@@ -159,10 +164,6 @@ static void rdd2_command_run(void *p0, void *p1, void *p2)
 			zros_sub_update(&ctx->sub_status);
 		}
 
-		if (zros_sub_update_available(&ctx->sub_clock_offset_ethernet)) {
-			zros_sub_update(&ctx->sub_clock_offset_ethernet);
-		}
-
 		// prioritize onboard sbus input
 		if (zros_sub_update_available(&ctx->sub_input_sbus)) {
 			zros_sub_update(&ctx->sub_input_sbus);
@@ -176,7 +177,10 @@ static void rdd2_command_run(void *p0, void *p1, void *p2)
 				synapse_pb_Status_InputSource_INPUT_SOURCE_ETHERNET;
 		}
 
-		zros_sub_update(&ctx->sub_bezier_trajectory_ethernet);
+		if (zros_sub_update_available(&ctx->sub_bezier_trajectory_ethernet)) {
+			zros_sub_update(&ctx->sub_bezier_trajectory_ethernet);
+			rdd2_bezier_receive(ctx);
+		}
 		zros_sub_update(&ctx->sub_odometry_estimator);
 		zros_sub_update(&ctx->sub_cmd_vel_ethernet);
 
@@ -185,7 +189,7 @@ static void rdd2_command_run(void *p0, void *p1, void *p2)
 		ctx->dt = (double)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
 		ticks_last = ticks_now;
 		if (ctx->dt < 0 || ctx->dt > 0.5) {
-			LOG_DBG("input update rate too low");
+			CEREBRI_LOG_DBG_LIMIT("input update rate too low");
 			continue;
 		}
 
@@ -245,6 +249,10 @@ static int rdd2_command_cmd_handler(const struct shell *sh, size_t argc, char **
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		shell_print(sh, "bezier front: %d segments, back: %d segments",
+			    ctx->bezier_front->count, ctx->bezier_back->count);
+		shell_print(sh, "bezier chunks: %u, swaps: %u, dropped curves: %u",
+			    ctx->bezier_chunks, ctx->bezier_swaps, ctx->bezier_dropped);
 	}
 	return 0;
 }
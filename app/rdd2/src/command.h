@@ -18,6 +18,7 @@
 #include <synapse_topic_list.h>
 
 #include <cerebri/core/casadi.h>
+#include <cerebri/core/clock_sync.h>
 #include <cerebri/core/log_utils.h>
 
 #include "app/rdd2/casadi/bezier.h"
@@ -26,6 +27,28 @@
 
 #include "input_mapping.h"
 
+// a bezier segment, coefficients converted and timing resolved as it arrives
+struct bezier_segment {
+	uint64_t start_ns;
+	uint64_t stop_ns;
+	casadi_real T;
+#if defined(CONFIG_CEREBRI_RDD2_BEZIER_POWER_BASIS)
+	// coefficients in seconds since start_ns, lowest order first
+	casadi_real cx[8], cy[8], cz[8], cpsi[4];
+#else
+	casadi_real PX[8], PY[8], PZ[8], Ppsi[4];
+#endif
+};
+
+// segments of one trajectory, assembled from chunks sharing time_start
+struct bezier_buffer {
+	struct bezier_segment segments[CONFIG_CEREBRI_RDD2_BEZIER_SEGMENTS];
+	uint64_t time_start_ns;
+	int count;
+	// segment of the last lookup, time only moves it forward
+	int cursor;
+};
+
 struct context {
 	struct zros_node node;
 	synapse_pb_Input input;
@@ -33,26 +56,28 @@ struct context {
 		position_sp;
 	synapse_pb_Quaternion attitude_sp, orientation_sp;
 	synapse_pb_BezierTrajectory bezier_trajectory;
-	synapse_pb_ClockOffset clock_offset;
+	// front is flown while chunks of the next trajectory fill back
+	struct bezier_buffer bezier[2];
+	struct bezier_buffer *bezier_front, *bezier_back;
+	uint32_t bezier_chunks, bezier_swaps, bezier_dropped;
 	synapse_pb_Status status;
 	synapse_pb_Status last_status;
 	synapse_pb_Odometry odometry_estimator;
 	synapse_pb_Twist cmd_vel;
 	struct zros_sub sub_bezier_trajectory_ethernet, sub_status, sub_input_ethernet,
-		sub_input_sbus, sub_odometry_estimator, sub_cmd_vel_ethernet,
-		sub_clock_offset_ethernet;
+		sub_input_sbus, sub_odometry_estimator, sub_cmd_vel_ethernet;
 	struct zros_pub pub_attitude_sp, pub_angular_velocity_ff, pub_force_sp, pub_accel_sp,
 		pub_moment_ff, pub_velocity_sp, pub_orientation_sp, pub_position_sp, pub_input;
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
 	struct k_thread thread_data;
-	double psi_sp;        // yaw setpoint for input_velocity function
-	double input_aetr[4]; // input: aileron, elevator, throttle, rudder
-	double q[4];          // estimated attitude quaternion
-	double dt;            // time delta between input updates
-	double thrust_trim;   // trim throttle
-	double thrust_delta;  // throttle scaling
+	casadi_real psi_sp;        // yaw setpoint for input_velocity function
+	casadi_real input_aetr[4]; // input: aileron, elevator, throttle, rudder
+	casadi_real q[4];          // estimated attitude quaternion
+	casadi_real dt;            // time delta between input updates
+	casadi_real thrust_trim;   // trim throttle
+	casadi_real thrust_delta;  // throttle scaling
 };
 
 // mode handlers
@@ -60,5 +85,6 @@ void rdd2_mode_attitude_rate(struct context *ctx);
 void rdd2_mode_attitude(struct context *ctx);
 void rdd2_mode_velocity(struct context *ctx);
 void rdd2_mode_bezier(struct context *ctx);
+void rdd2_bezier_receive(struct context *ctx);
 
 // vi: ts=4 sw=4 et
@@ -5,6 +5,7 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include <zephyr/kernel.h>
@@ -12,23 +13,50 @@
 #include <zephyr/shell/shell.h>
 
 #include <zros/private/zros_node_struct.h>
-#include <zros/private/zros_pub_struct.h>
 #include <zros/private/zros_sub_struct.h>
 #include <zros/zros_node.h>
-#include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/core/boot.h>
+#include <cerebri/core/clock_sync.h>
+#include <cerebri/core/executor.h>
 #include <cerebri/core/perf_counter.h>
+#include <cerebri/core/perf_duration.h>
+#include <cerebri/core/placement.h>
 #include <cerebri/core/log_utils.h>
+#include <cerebri/core/state_history.h>
+#include <cerebri/core/trace.h>
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+#include <cerebri/sense/imu.h>
+#endif
 
+#include <synapse_latency.h>
+#include <synapse_liveness.h>
+#include <synapse_sync.h>
 #include <synapse_topic_list.h>
 
 #include <cerebri/core/casadi.h>
 
 #include "app/rdd2/casadi/rdd2.h"
-
-#define MY_STACK_SIZE 4096
-#define MY_PRIORITY   4
+#include "app/rdd2/casadi/rdd2_estimate.h"
+#include "gains.h"
+
+#define MY_STACK_SIZE   4096
+#define MY_PRIORITY     4
+#define MY_DEADLINE_US  1000
+// imu is late after this, several samples at any configured rate
+#define IMU_DEADLINE_MS 50
+
+// inputs of the imu and magnetometer set
+#define SYNC_IMU 0
+#define SYNC_MAG 1
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+// every mocap sample is forwarded, not just the one the next imu step sees
+#define ODOMETRY_ETHERNET_RATE_HZ CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_RATE_HZ
+#else
+#define ODOMETRY_ETHERNET_RATE_HZ 10
+#endif
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -36,7 +64,19 @@
 
 CEREBRI_NODE_LOG_INIT(rdd2_estimate, LOG_LEVEL_WRN);
 
-static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+static CEREBRI_HOT_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+// one estimator step, the state it ended in and the inputs that took it there
+struct history_entry {
+	casadi_real x[10];
+	casadi_real a_b[3];
+	casadi_real omega_b[3];
+	casadi_real dt;
+};
+
+STATE_HISTORY_DEFINE(g_history, struct history_entry, CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED_LENGTH);
+#endif
 
 // private context
 struct context {
@@ -45,18 +85,58 @@ struct context {
 	synapse_pb_Imu imu;
 	synapse_pb_Odometry odometry;
 	struct zros_sub sub_odometry_ethernet, sub_imu, sub_mag;
-	struct zros_pub pub_odometry;
-	double x[3];
+	struct synapse_sync sync;
+	casadi_real x[10];
+	// upper triangles, row by row
+	casadi_real P_pos[21];
+	casadi_real P_att[21];
+	int64_t last_ns;
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
 	struct k_thread thread_data;
 	struct perf_counter perf;
 	synapse_pb_MagneticField mag;
+	struct synapse_latency_trace latency;
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	struct synapse_liveness liveness;
+	// reported once per outage
+	bool imu_stale;
+#endif
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	struct executor_task task;
+#endif
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_IMU_DELTA)
+	struct synapse_imu_delta imu_delta;
+	struct zros_sub sub_imu_delta;
+	// sensor time propagated up to
+	uint64_t delta_stamp_ns;
+	uint32_t delta_gaps;
+#endif
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+	struct perf_duration perf_replay;
+	// stamp of the last offboard odometry fused
+	int64_t fused_stamp_ns;
+	uint32_t fused;
+	uint32_t too_late;
+	uint32_t out_of_order;
+	uint32_t replayed_max;
+#endif
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+	synapse_pb_Status status;
+	struct zros_sub sub_status;
+	// status.topic_source selects ethernet
+	bool passthrough;
+	struct perf_duration perf_passthrough;
+	uint32_t forwarded;
+	// mocap stamp to publish, last and worst
+	int64_t mocap_age_ns;
+	int64_t mocap_age_max_ns;
+#endif
 };
 
 // private initialization
-static struct context g_ctx = {
+static struct context g_ctx CEREBRI_HOT_CONTEXT = {
 	.node = {},
 	.odometry_ethernet = synapse_pb_Odometry_init_default,
 	.imu = synapse_pb_Imu_init_default,
@@ -76,7 +156,7 @@ static struct context g_ctx = {
 	.sub_odometry_ethernet = {},
 	.sub_imu = {},
 	.sub_mag = {},
-	.pub_odometry = {},
+	.sync = {},
 	.x = {},
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
 	.stack_size = MY_STACK_SIZE,
@@ -84,6 +164,11 @@ static struct context g_ctx = {
 	.thread_data = {},
 	.perf = {},
 	.mag = {},
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	.liveness = SYNAPSE_LIVENESS_INITIALIZER(g_ctx.liveness, &topic_imu, "rdd2_estimate",
+						 IMU_DEADLINE_MS),
+	.imu_stale = false,
+#endif
 };
 
 static void rdd2_estimate_init(struct context *ctx)
@@ -92,24 +177,532 @@ static void rdd2_estimate_init(struct context *ctx)
 	zros_sub_init(&ctx->sub_imu, &ctx->node, &topic_imu, &ctx->imu, 300);
 	zros_sub_init(&ctx->sub_mag, &ctx->node, &topic_magnetic_field, &ctx->mag, 300);
 	zros_sub_init(&ctx->sub_odometry_ethernet, &ctx->node, &topic_odometry_ethernet,
-		      &ctx->odometry_ethernet, 10);
-	zros_pub_init(&ctx->pub_odometry, &ctx->node, &topic_odometry_estimator, &ctx->odometry);
+		      &ctx->odometry_ethernet, ODOMETRY_ETHERNET_RATE_HZ);
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
+	perf_duration_init(&ctx->perf_passthrough, "estimator mocap",
+			   1.0 / CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_RATE_HZ);
+	ctx->passthrough = false;
+	ctx->forwarded = 0;
+	ctx->mocap_age_ns = 0;
+	ctx->mocap_age_max_ns = 0;
+#endif
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_IMU_DELTA)
+	zros_sub_init(&ctx->sub_imu_delta, &ctx->node, &topic_imu_delta, &ctx->imu_delta, 300);
+	ctx->delta_stamp_ns = 0;
+	ctx->delta_gaps = 0;
+#endif
+	synapse_sync_init(&ctx->sync, SYNAPSE_SYNC_APPROXIMATE,
+			  CONFIG_CEREBRI_RDD2_ESTIMATE_MAG_SLOP_US);
+	synapse_sync_add(&ctx->sync, &ctx->sub_imu, &ctx->imu.stamp);
+	synapse_sync_add(&ctx->sync, &ctx->sub_mag, &ctx->mag.stamp);
 	perf_counter_init(&ctx->perf, "estimator imu", 1.0 / 100);
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+	perf_duration_init(&ctx->perf_replay, "estimator replay", MY_DEADLINE_US * 1e-6 / 2);
+	state_history_reset(&g_history);
+	ctx->fused_stamp_ns = 0;
+	ctx->fused = 0;
+	ctx->too_late = 0;
+	ctx->out_of_order = 0;
+	ctx->replayed_max = 0;
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	ctx->imu_stale = false;
+	synapse_liveness_start(&ctx->liveness);
+#endif
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("rdd2_estimate init");
 	LOG_INF("init");
 }
 
 static void rdd2_estimate_fini(struct context *ctx)
 {
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	synapse_liveness_stop(&ctx->liveness);
+#endif
 	zros_sub_fini(&ctx->sub_imu);
 	zros_sub_fini(&ctx->sub_mag);
 	zros_sub_fini(&ctx->sub_odometry_ethernet);
-	zros_pub_fini(&ctx->pub_odometry);
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_IMU_DELTA)
+	zros_sub_fini(&ctx->sub_imu_delta);
+#endif
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+	perf_duration_fini(&ctx->perf_replay);
+#endif
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+	zros_sub_fini(&ctx->sub_status);
+	perf_duration_fini(&ctx->perf_passthrough);
+#endif
 	zros_node_fini(&ctx->node);
 	k_sem_give(&ctx->running);
 	LOG_INF("fini");
 }
 
+// Constants
+static const casadi_real decl_WL = -4.494167 / 180 * M_PI; // magnetic declination for WL, IN
+static const casadi_real g = 9.8;                          // gravity
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_IMU_DELTA)
+/*
+ * The delta of the batch behind this imu sample, as the mean rate and
+ * specific force over the sensor interval of the batch. Batches missed in
+ * between are bridged with the means of this one, so propagation always
+ * covers sensor time without holes, however the estimator is woken.
+ */
+static bool rdd2_estimate_imu_delta(struct context *ctx, casadi_real omega_b[3],
+				    casadi_real a_b[3], casadi_real *dt)
+{
+	if (!zros_sub_update_available(&ctx->sub_imu_delta)) {
+		return false;
+	}
+	zros_sub_update(&ctx->sub_imu_delta);
+
+	const struct synapse_imu_delta *delta = &ctx->imu_delta;
+	if (delta->dt_ns == 0) {
+		return false;
+	}
+	uint64_t span_ns = delta->dt_ns;
+	uint64_t start_ns = delta->stamp_ns - delta->dt_ns;
+	if (ctx->delta_stamp_ns != 0 && start_ns > ctx->delta_stamp_ns) {
+		span_ns = delta->stamp_ns - ctx->delta_stamp_ns;
+		ctx->delta_gaps++;
+	}
+	ctx->delta_stamp_ns = delta->stamp_ns;
+
+	casadi_real per_sec = 1e9 / (casadi_real)delta->dt_ns;
+	for (int i = 0; i < 3; i++) {
+		omega_b[i] = delta->delta_angle[i] * per_sec;
+		a_b[i] = delta->delta_velocity[i] * per_sec;
+	}
+	*dt = span_ns * 1e-9;
+	return true;
+}
+#endif
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_ODOMETRY_ETHERNET) ||                                     \
+	defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+static void rdd2_estimate_reset_odometry(struct context *ctx, casadi_real *x)
+{
+	__ASSERT(fabs((ctx->odometry_ethernet.pose.orientation.w *
+			       ctx->odometry_ethernet.pose.orientation.w +
+		       ctx->odometry_ethernet.pose.orientation.x *
+			       ctx->odometry_ethernet.pose.orientation.x +
+		       ctx->odometry_ethernet.pose.orientation.y *
+			       ctx->odometry_ethernet.pose.orientation.y +
+		       ctx->odometry_ethernet.pose.orientation.z *
+			       ctx->odometry_ethernet.pose.orientation.z) -
+		      1) < 1e-2,
+		 "quaternion normal error");
+
+	// use offboard odometry to reset position
+	x[0] = ctx->odometry_ethernet.pose.position.x;
+	x[1] = ctx->odometry_ethernet.pose.position.y;
+	x[2] = ctx->odometry_ethernet.pose.position.z;
+
+	// use offboard odometry to reset velocity
+	x[3] = ctx->odometry_ethernet.twist.linear.x;
+	x[4] = ctx->odometry_ethernet.twist.linear.y;
+	x[5] = ctx->odometry_ethernet.twist.linear.z;
+
+	// use offboard odometry to reset orientation
+	x[6] = ctx->odometry_ethernet.pose.orientation.w;
+	x[7] = ctx->odometry_ethernet.pose.orientation.x;
+	x[8] = ctx->odometry_ethernet.pose.orientation.y;
+	x[9] = ctx->odometry_ethernet.pose.orientation.z;
+}
+#endif
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+static void rdd2_estimate_record(struct context *ctx, const casadi_real a_b[3],
+				 const casadi_real omega_b[3], casadi_real dt)
+{
+	struct history_entry *entry =
+		state_history_push(&g_history, clock_sync_ticks_to_ns(k_uptime_ticks()));
+	memcpy(entry->x, ctx->x, sizeof(entry->x));
+	memcpy(entry->a_b, a_b, sizeof(entry->a_b));
+	memcpy(entry->omega_b, omega_b, sizeof(entry->omega_b));
+	entry->dt = dt;
+}
+
+/*
+ * Fuse the offboard odometry at the step it was measured in, then replay
+ * the steps since with their stored imu inputs. A position fix leaves the
+ * attitude of the replayed steps as it was estimated, a reset replaces it
+ * and the strapdown carries it forward. P_pos only changes when odometry
+ * is fused, and odometry older than the last fused is dropped, so the
+ * current P_pos is the one at the fused step.
+ */
+static void rdd2_estimate_fuse_delayed(struct context *ctx)
+{
+	const synapse_pb_Timestamp *stamp = &ctx->odometry_ethernet.stamp;
+	int64_t stamp_ns = (int64_t)stamp->seconds * 1000000000LL + stamp->nanos;
+
+	if (stamp_ns <= ctx->fused_stamp_ns) {
+		ctx->out_of_order++;
+		return;
+	}
+
+	int age = state_history_find(&g_history, stamp_ns);
+	if (age < 0) {
+		ctx->too_late++;
+		return;
+	}
+
+	perf_duration_start(&ctx->perf_replay);
+
+	struct history_entry *entry = state_history_get(&g_history, age);
+	casadi_real x[10];
+	memcpy(x, entry->x, sizeof(x));
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_ODOMETRY_ETHERNET)
+	rdd2_estimate_reset_odometry(ctx, x);
+#else
+	{
+		CASADI_FUNC_ARGS(estimate_position_correction)
+
+		casadi_real gps[3] = {ctx->odometry_ethernet.pose.position.x,
+				      ctx->odometry_ethernet.pose.position.y,
+				      ctx->odometry_ethernet.pose.position.z};
+		// P_pos grows over the time since the last fix
+		casadi_real dt = ctx->fused_stamp_ns != 0 ? (stamp_ns - ctx->fused_stamp_ns) * 1e-9
+							  : entry->dt;
+
+		args[0] = x;
+		args[1] = gps;
+		args[2] = &dt;
+		args[3] = ctx->P_pos;
+
+		res[0] = x;
+		res[1] = ctx->P_pos;
+
+		CASADI_FUNC_CALL(estimate_position_correction)
+	}
+#endif
+	memcpy(entry->x, x, sizeof(x));
+
+	for (int i = age - 1; i >= 0; i--) {
+		entry = state_history_get(&g_history, i);
+
+		CASADI_FUNC_ARGS(strapdown_ins_propagate)
+
+		args[0] = x;
+		args[1] = entry->a_b;
+		args[2] = entry->omega_b;
+		args[3] = &g;
+		args[4] = &entry->dt;
+
+		res[0] = x;
+
+		CASADI_FUNC_CALL(strapdown_ins_propagate)
+
+#if !defined(CONFIG_CEREBRI_RDD2_ESTIMATE_ODOMETRY_ETHERNET)
+		// attitude is the attitude estimator's, not the strapdown's
+		memcpy(&x[6], &entry->x[6], 4 * sizeof(casadi_real));
+#endif
+		memcpy(entry->x, x, sizeof(x));
+	}
+
+	memcpy(ctx->x, x, sizeof(x));
+	ctx->fused_stamp_ns = stamp_ns;
+	ctx->fused++;
+	if ((uint32_t)age > ctx->replayed_max) {
+		ctx->replayed_max = age;
+	}
+
+	perf_duration_stop(&ctx->perf_replay);
+}
+#endif
+
+static void rdd2_estimate_publish(struct context *ctx)
+{
+	casadi_real *x = ctx->x;
+	casadi_real q[4] = {x[6], x[7], x[8], x[9]};
+
+	casadi_real v_b[3]; // velocity in body frame
+	casadi_real v_w[3]; // velocity in world frame
+
+	// Update velocity in world frame
+	v_w[0] = x[3];
+	v_w[1] = x[4];
+	v_w[2] = x[5];
+
+	// Rotate velocity from world frame to body frame
+	{
+		// rotate_vector_w_to_b:(q[4],v_w[3])->(v_b[3])
+		CASADI_FUNC_ARGS(rotate_vector_w_to_b)
+
+		args[0] = q;
+		args[1] = v_w;
+
+		res[0] = v_b;
+
+		CASADI_FUNC_CALL(rotate_vector_w_to_b)
+	}
+
+	bool data_ok = true;
+	for (int i = 0; i < 10; i++) {
+		if (!isfinite(x[i])) {
+			CEREBRI_LOG_ERR_LIMIT("x[%d] is not finite", i);
+			// TODO reinitialize
+			x[i] = 0;
+			data_ok = false;
+			break;
+		}
+	}
+
+	// publish odometry
+	if (data_ok) {
+		stamp_msg_now(&ctx->odometry.stamp);
+		ctx->odometry.pose.position.x = x[0];
+		ctx->odometry.pose.position.y = x[1];
+		ctx->odometry.pose.position.z = x[2];
+		ctx->odometry.twist.linear.x = v_b[0];
+		ctx->odometry.twist.linear.y = v_b[1];
+		ctx->odometry.twist.linear.z = v_b[2];
+		ctx->odometry.pose.orientation.w = x[6];
+		ctx->odometry.pose.orientation.x = x[7];
+		ctx->odometry.pose.orientation.y = x[8];
+		ctx->odometry.pose.orientation.z = x[9];
+		ctx->odometry.twist.angular.x = ctx->imu.angular_velocity.x;
+		ctx->odometry.twist.angular.y = ctx->imu.angular_velocity.y;
+		ctx->odometry.twist.angular.z = ctx->imu.angular_velocity.z;
+
+		// check quaternion normal
+		__ASSERT(fabs((ctx->odometry.pose.orientation.w *
+				       ctx->odometry.pose.orientation.w +
+			       ctx->odometry.pose.orientation.x *
+				       ctx->odometry.pose.orientation.x +
+			       ctx->odometry.pose.orientation.y *
+				       ctx->odometry.pose.orientation.y +
+			       ctx->odometry.pose.orientation.z *
+				       ctx->odometry.pose.orientation.z) -
+			      1) < 1e-2,
+			 "quaternion normal error");
+		synapse_latency_mark(SYNAPSE_LATENCY_ESTIMATE, &ctx->latency);
+		CEREBRI_TRACE_NAMED(TRACE_EVENT_PUBLISH, "odometry_estimator", 0);
+		synapse_loan_publish_copy(&loan_odometry_estimator, &ctx->odometry);
+	}
+}
+
+static void rdd2_estimate_update(struct context *ctx)
+{
+	casadi_real *x = ctx->x;
+#if !defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+	casadi_real *P_pos = ctx->P_pos;
+#endif
+	casadi_real *P_att = ctx->P_att;
+	casadi_real dt = 0;
+	casadi_real a_b[3];
+	casadi_real omega_b[3];
+
+	// imu and magnetometer were taken together by synapse_sync_wait
+	synapse_latency_get(SYNAPSE_LATENCY_IMU, &ctx->latency);
+	perf_counter_update(&ctx->perf);
+	if (!synapse_sync_is_aligned(&ctx->sync, SYNC_MAG)) {
+		LOG_DBG("magnetometer not aligned with imu");
+	}
+
+	/*
+	if (j % 100 == 0) {
+	    int offset = 0;
+	    static char buf[1024];
+	    int n = 1024;
+	    offset += snprintf(buf + offset, n - offset, "x: ");
+	    for (int i=0; i<10;i++) {
+		offset += snprintf(buf + offset, n - offset, " %6.2f", x[i]);
+	    }
+	    LOG_INF("%s", buf);
+	}
+	*/
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+	// fused at its own stamp once this step is in the history
+	bool odometry_fresh = false;
+#endif
+	bool odometry_available = zros_sub_update_available(&ctx->sub_odometry_ethernet);
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+	// left for rdd2_estimate_passthrough to forward
+	odometry_available = odometry_available && !ctx->passthrough;
+#endif
+	if (odometry_available) {
+		// LOG_INF("correct offboard odometry");
+		zros_sub_update(&ctx->sub_odometry_ethernet);
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_ODOMETRY_ETHERNET) &&                                     \
+	!defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+		rdd2_estimate_reset_odometry(ctx, x);
+#endif
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+		odometry_fresh = true;
+#endif
+	}
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_IMU_DELTA)
+	// dt is the sensor interval of the batch
+	if (!rdd2_estimate_imu_delta(ctx, omega_b, a_b, &dt)) {
+		LOG_DBG("no imu delta for this imu sample");
+		return;
+	}
+#else
+	// calculate dt
+	int64_t now_ns = synapse_uptime_ns();
+	dt = (now_ns - ctx->last_ns) * 1e-9;
+	ctx->last_ns = now_ns;
+
+	a_b[0] = ctx->imu.linear_acceleration.x;
+	a_b[1] = ctx->imu.linear_acceleration.y;
+	a_b[2] = ctx->imu.linear_acceleration.z;
+	omega_b[0] = ctx->imu.angular_velocity.x;
+	omega_b[1] = ctx->imu.angular_velocity.y;
+	omega_b[2] = ctx->imu.angular_velocity.z;
+#endif
+	if (dt <= 0 || dt > 0.5) {
+		CEREBRI_LOG_WRN_LIMIT("imu update rate too low");
+		return;
+	}
+
+	casadi_real mag[3] = {ctx->mag.magnetic_field.x, ctx->mag.magnetic_field.y,
+			      ctx->mag.magnetic_field.z};
+	const struct rdd2_estimate_param *param =
+		PARAM_GET(rdd2_estimate, struct rdd2_estimate_param);
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+	{
+		/* estimate_propagate:(x0[10],a_b[3],omega_b[3],g,dt,mag[3],mag_decl,accel_gain,
+		 * mag_gain,P_att[21])->(x1[10],P_att1[21]) */
+		CASADI_FUNC_ARGS(estimate_propagate)
+
+		args[0] = x;
+		args[1] = a_b;
+		args[2] = omega_b;
+		args[3] = &g;
+		args[4] = &dt;
+		args[5] = mag;
+		args[6] = &decl_WL;
+		args[7] = &param->accel_gain;
+		args[8] = &param->mag_gain;
+		args[9] = P_att;
+
+		res[0] = x;
+		res[1] = P_att;
+
+		CASADI_FUNC_CALL(estimate_propagate)
+	}
+#else
+	{
+		/* estimate_step:(x0[10],a_b[3],omega_b[3],g,dt,gps[3],P_pos[21],mag[3],mag_decl,
+		 * accel_gain,mag_gain,P_att[21])->(x1[10],P_pos1[21],P_att1[21]) */
+		CASADI_FUNC_ARGS(estimate_step)
+
+		// strapdown propagation, position correction and attitude estimator in one pass
+		casadi_real gps[3] = {ctx->odometry_ethernet.pose.position.x,
+				      ctx->odometry_ethernet.pose.position.y,
+				      ctx->odometry_ethernet.pose.position.z};
+
+		args[0] = x;
+		args[1] = a_b;
+		args[2] = omega_b;
+		args[3] = &g;
+		args[4] = &dt;
+		args[5] = gps;
+		args[6] = P_pos;
+		args[7] = mag;
+		args[8] = &decl_WL;
+		args[9] = &param->accel_gain;
+		args[10] = &param->mag_gain;
+		args[11] = P_att;
+
+		res[0] = x;
+		res[1] = P_pos;
+		res[2] = P_att;
+
+		CASADI_FUNC_CALL(estimate_step)
+	}
+#endif
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+	rdd2_estimate_record(ctx, a_b, omega_b, dt);
+	if (odometry_fresh) {
+		rdd2_estimate_fuse_delayed(ctx);
+	}
+#endif
+
+	rdd2_estimate_publish(ctx);
+}
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+static bool rdd2_estimate_passthrough_check(struct context *ctx)
+{
+	if (zros_sub_update_available(&ctx->sub_status)) {
+		zros_sub_update(&ctx->sub_status);
+	}
+	ctx->passthrough =
+		ctx->status.topic_source == synapse_pb_Status_TopicSource_TOPIC_SOURCE_ETHERNET;
+	return ctx->passthrough;
+}
+
+/*
+ * Forward a mocap sample the moment it arrives, position, velocity and
+ * attitude as measured, with the latest imu rates. The imu steps between
+ * samples carry the attitude and rates on at the imu rate from there.
+ */
+static bool rdd2_estimate_passthrough(struct context *ctx)
+{
+	if (!ctx->passthrough || !zros_sub_update_available(&ctx->sub_odometry_ethernet)) {
+		return false;
+	}
+	perf_duration_start(&ctx->perf_passthrough);
+	zros_sub_update(&ctx->sub_odometry_ethernet);
+	rdd2_estimate_reset_odometry(ctx, ctx->x);
+	rdd2_estimate_publish(ctx);
+	perf_duration_stop(&ctx->perf_passthrough);
+
+	const synapse_pb_Timestamp *stamp = &ctx->odometry_ethernet.stamp;
+	int64_t stamp_ns = (int64_t)stamp->seconds * NSEC_PER_SEC + stamp->nanos;
+	ctx->mocap_age_ns = clock_sync_ticks_to_ns(k_uptime_ticks()) - stamp_ns;
+	if (ctx->mocap_age_ns > ctx->mocap_age_max_ns) {
+		ctx->mocap_age_max_ns = ctx->mocap_age_ns;
+	}
+	ctx->forwarded++;
+	return true;
+}
+#endif
+
+// the fsm refuses to arm on a stale imu, this only reports the outage
+static void rdd2_estimate_check_imu(struct context *ctx)
+{
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	bool stale = synapse_liveness_stale(&ctx->liveness);
+	if (stale && !ctx->imu_stale) {
+		LOG_WRN("imu stale for %u ms", ctx->liveness.deadline_ms);
+	} else if (!stale && ctx->imu_stale) {
+		LOG_INF("imu recovered");
+	}
+	ctx->imu_stale = stale;
+#else
+	ARG_UNUSED(ctx);
+#endif
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+static void rdd2_estimate_execute(struct executor_task *task)
+{
+	struct context *ctx = CONTAINER_OF(task, struct context, task);
+
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+	// the frame only waits on the imu, mocap goes out at the next frame
+	rdd2_estimate_passthrough_check(ctx);
+	rdd2_estimate_passthrough(ctx);
+#endif
+	bool available = synapse_sync_wait(&ctx->sync, K_NO_WAIT) == 0;
+	int rc = executor_wait(task, available, 1000);
+	rdd2_estimate_check_imu(ctx);
+	if (rc == 0) {
+		rdd2_estimate_update(ctx);
+	}
+}
+#endif
+
 static void rdd2_estimate_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -121,88 +714,67 @@ static void rdd2_estimate_run(void *p0, void *p1, void *p2)
 	// LOG_DBG("started");
 	rdd2_estimate_init(ctx);
 
-	// variables
-	struct k_poll_event events[1] = {};
-
-	// wait for imu
-	LOG_DBG("waiting for imu");
-	events[0] = *zros_sub_get_event(&ctx->sub_imu);
-	rc = k_poll(events, ARRAY_SIZE(events), K_FOREVER);
-	if (rc != 0) {
-		LOG_DBG("did not receive imu");
-		return;
-	}
-	zros_sub_update(&ctx->sub_imu);
-
-	double dt = 0;
-	int64_t ticks_last = k_uptime_ticks();
+	// wait for imu and magnetometer
+	LOG_DBG("waiting for imu and magnetometer");
+	do {
+		rc = synapse_sync_wait(&ctx->sync, K_MSEC(1000));
+		if (rc != 0 || !synapse_sync_is_aligned(&ctx->sync, SYNC_MAG)) {
+			LOG_INF("waiting for imu and magnetometer");
+		}
+	} while (rc != 0 || !synapse_sync_is_aligned(&ctx->sync, SYNC_MAG));
 
-	// Constants
-	static const double decl_WL = -4.494167 / 180 * M_PI; // magnetic declination for WL, IN
-	static const double g = 9.8;                          // gravity
-	static const double accel_gain = CONFIG_CEREBRI_RDD2_ATTITUDE_EST_ACCEL_GAIN * 1e-3;
-	static const double mag_gain = CONFIG_CEREBRI_RDD2_ATTITUDE_EST_MAG_GAIN * 1e-3;
+	ctx->last_ns = synapse_uptime_ns();
 
 	// ------ Initialize attitude from accelerometer and magnetometer ------
 
-	double q[4] = {1, 0, 0, 0};
-	// Wait for both IMU and magnetometer data
+	casadi_real q[4] = {1, 0, 0, 0};
 
-	// Magnetometer waiting
-	while (!zros_sub_update_available(&ctx->sub_mag)) {
-		LOG_INF("waiting for magnetometer");
-		k_sleep(K_MSEC(50));
-	}
-	zros_sub_update(&ctx->sub_mag);
-	double mag_norm = ctx->mag.magnetic_field.x * ctx->mag.magnetic_field.x +
-			  ctx->mag.magnetic_field.y * ctx->mag.magnetic_field.y +
-			  ctx->mag.magnetic_field.z * ctx->mag.magnetic_field.z;
 	// wait for magnetometer to be valid
+	casadi_real mag_norm = ctx->mag.magnetic_field.x * ctx->mag.magnetic_field.x +
+			       ctx->mag.magnetic_field.y * ctx->mag.magnetic_field.y +
+			       ctx->mag.magnetic_field.z * ctx->mag.magnetic_field.z;
 	while (mag_norm < 1e-4) {
+		LOG_INF("magnetometer is not valid, waiting for valid data: %f", mag_norm);
+		synapse_sync_wait(&ctx->sync, K_MSEC(50));
 		mag_norm = ctx->mag.magnetic_field.x * ctx->mag.magnetic_field.x +
 			   ctx->mag.magnetic_field.y * ctx->mag.magnetic_field.y +
 			   ctx->mag.magnetic_field.z * ctx->mag.magnetic_field.z;
-		LOG_INF("magnetometer is not valid, waiting for valid data: %f", mag_norm);
-		k_sleep(K_MSEC(50));
 	}
 
-	// TODO: If the IMU calibration parameters are saved on the SD card,
+	// If the IMU calibration parameters were loaded from settings,
 	// perform full attitude initialization from accelerometer and magnetometer.
-	// Otherwise, perform only yaw initialization from magnetometer.
+	// Otherwise, perform only yaw initialization from magnetometer, the
+	// calibration at boot levels the accelerometer.
 
 	bool imu_calibrated = false;
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+	imu_calibrated = sense_imu_calibration_stored();
+#endif
 
 	if (imu_calibrated) {
-		// IMU waiting
-		while (!zros_sub_update_available(&ctx->sub_imu)) {
-			LOG_INF("waiting for IMU");
-			k_sleep(K_MSEC(50));
-		}
-		zros_sub_update(&ctx->sub_imu);
-		double accel_norm =
+		casadi_real accel_norm =
 			ctx->imu.linear_acceleration.x * ctx->imu.linear_acceleration.x +
 			ctx->imu.linear_acceleration.y * ctx->imu.linear_acceleration.y +
 			ctx->imu.linear_acceleration.z * ctx->imu.linear_acceleration.z;
 		// wait for IMU to be valid
 		while (accel_norm < 0.8 * 9.8 * 9.8 || accel_norm > 1.2 * 9.8 * 9.8) {
-			zros_sub_update(&ctx->sub_imu);
+			synapse_sync_wait(&ctx->sync, K_MSEC(50));
 			accel_norm =
 				ctx->imu.linear_acceleration.x * ctx->imu.linear_acceleration.x +
 				ctx->imu.linear_acceleration.y * ctx->imu.linear_acceleration.y +
 				ctx->imu.linear_acceleration.z * ctx->imu.linear_acceleration.z;
 			LOG_INF("IMU is not valid, waiting for valid data: %f", accel_norm);
-			k_sleep(K_MSEC(50));
 		}
 
 		{
 			// attitude_init_from_mag:(mag_b[3],accel_b[3],mag_decl)->(q_init[4]w)
 			CASADI_FUNC_ARGS(attitude_init)
 
-			double mag[3] = {ctx->mag.magnetic_field.x, ctx->mag.magnetic_field.y,
-					 ctx->mag.magnetic_field.z};
-			double accel[3] = {ctx->imu.linear_acceleration.x,
-					   ctx->imu.linear_acceleration.y,
-					   ctx->imu.linear_acceleration.z};
+			casadi_real mag[3] = {ctx->mag.magnetic_field.x, ctx->mag.magnetic_field.y,
+					      ctx->mag.magnetic_field.z};
+			casadi_real accel[3] = {ctx->imu.linear_acceleration.x,
+						ctx->imu.linear_acceleration.y,
+						ctx->imu.linear_acceleration.z};
 
 			args[0] = mag;
 			args[1] = accel;
@@ -215,8 +787,8 @@ static void rdd2_estimate_run(void *p0, void *p1, void *p2)
 	} else {
 		CASADI_FUNC_ARGS(yaw_init)
 
-		double mag[3] = {ctx->mag.magnetic_field.x, ctx->mag.magnetic_field.y,
-				 ctx->mag.magnetic_field.z};
+		casadi_real mag[3] = {ctx->mag.magnetic_field.x, ctx->mag.magnetic_field.y,
+				      ctx->mag.magnetic_field.z};
 		args[0] = mag;
 		args[1] = &decl_WL;
 
@@ -226,245 +798,68 @@ static void rdd2_estimate_run(void *p0, void *p1, void *p2)
 	}
 
 	// estimator states
-	double x[10] = {0, 0, 0, 0, 0, 0, q[0], q[1], q[2], q[3]};
+	casadi_real x[10] = {0, 0, 0, 0, 0, 0, q[0], q[1], q[2], q[3]};
+
+	// Position estimator covariance, upper triangle
+	casadi_real P_pos[21] = {1e-2, 0,    0,    0,    0,    0,    1e-2, 0,    0, 0, 0,
+				 1e-2, 0,    0,    0,    1e-2, 0,    0,    1e-2, 0, 1e-2};
 
-	// Position estimator covariance
-	double P_pos[36] = {1e-2, 0, 0, 0,    0, 0, 0, 1e-2, 0, 0, 0,    0, 0, 0, 1e-2, 0, 0, 0,
-			    0,    0, 0, 1e-2, 0, 0, 0, 0,    0, 0, 1e-2, 0, 0, 0, 0,    0, 0, 1e-2};
+	// Attitude estimator covariance, upper triangle
+	casadi_real P_att[21] = {1e-2, 0,    0,    0,    0,    0,    1e-2, 0,    0, 0, 0,
+				 1e-2, 0,    0,    0,    1e-2, 0,    0,    1e-2, 0, 1e-2};
 
-	// Attitude estimator covariance
-	double P_att[36] = {1e-2, 0, 0, 0,    0, 0, 0, 1e-2, 0, 0, 0,    0, 0, 0, 1e-2, 0, 0, 0,
-			    0,    0, 0, 1e-2, 0, 0, 0, 0,    0, 0, 1e-2, 0, 0, 0, 0,    0, 0, 1e-2};
+	memcpy(ctx->x, x, sizeof(ctx->x));
+	memcpy(ctx->P_pos, P_pos, sizeof(ctx->P_pos));
+	memcpy(ctx->P_att, P_att, sizeof(ctx->P_att));
+	boot_ready_set(BOOT_READY_ESTIMATE);
 
-	// poll on imu
-	events[0] = *zros_sub_get_event(&ctx->sub_imu);
 	// int j = 0;
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	if (executor_register(&ctx->task, "rdd2_estimate", rdd2_estimate_execute,
+			      EXECUTOR_STAGE_ESTIMATE, EXECUTOR_FRAME_US, 0, MY_DEADLINE_US) == 0) {
+		// updates run in the executor frame, park until stopped
+		k_sem_take(&ctx->running, K_FOREVER);
+		executor_unregister(&ctx->task);
+		rdd2_estimate_fini(ctx);
+		return;
+	}
+#endif
+
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 
 		// j += 1;
 
-		// poll for imu
-		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
-		if (rc != 0) {
-			LOG_DBG("not receiving imu");
-			continue;
-		}
-
-		if (zros_sub_update_available(&ctx->sub_imu)) {
-			zros_sub_update(&ctx->sub_imu);
-			perf_counter_update(&ctx->perf);
-		}
-
-		if (zros_sub_update_available(&ctx->sub_mag)) {
-			zros_sub_update(&ctx->sub_mag);
-		}
-
-		/*
-		if (j % 100 == 0) {
-		    int offset = 0;
-		    static char buf[1024];
-		    int n = 1024;
-		    offset += snprintf(buf + offset, n - offset, "x: ");
-		    for (int i=0; i<10;i++) {
-			offset += snprintf(buf + offset, n - offset, " %6.2f", x[i]);
-		    }
-		    LOG_INF("%s", buf);
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+		// wake on mocap too while it is passed through
+		if (rdd2_estimate_passthrough_check(ctx)) {
+			struct k_poll_event events[] = {
+				*zros_sub_get_event(&ctx->sub_imu),
+				*zros_sub_get_event(&ctx->sub_odometry_ethernet),
+			};
+			rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
+			if (rc != 0) {
+				rdd2_estimate_check_imu(ctx);
+				CEREBRI_LOG_DBG_LIMIT("not receiving imu or mocap");
+				continue;
+			}
+			if (rdd2_estimate_passthrough(ctx) &&
+			    !zros_sub_update_available(&ctx->sub_imu)) {
+				continue;
+			}
 		}
-		*/
-
-		if (zros_sub_update_available(&ctx->sub_odometry_ethernet)) {
-			// LOG_INF("correct offboard odometry");
-			zros_sub_update(&ctx->sub_odometry_ethernet);
-
-#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_ODOMETRY_ETHERNET)
-			__ASSERT(fabs((ctx->odometry_ethernet.pose.orientation.w *
-					       ctx->odometry_ethernet.pose.orientation.w +
-				       ctx->odometry_ethernet.pose.orientation.x *
-					       ctx->odometry_ethernet.pose.orientation.x +
-				       ctx->odometry_ethernet.pose.orientation.y *
-					       ctx->odometry_ethernet.pose.orientation.y +
-				       ctx->odometry_ethernet.pose.orientation.z *
-					       ctx->odometry_ethernet.pose.orientation.z) -
-				      1) < 1e-2,
-				 "quaternion normal error");
-
-			// use offboard odometry to reset position
-			x[0] = ctx->odometry_ethernet.pose.position.x;
-			x[1] = ctx->odometry_ethernet.pose.position.y;
-			x[2] = ctx->odometry_ethernet.pose.position.z;
-
-			// use offboard odometry to reset velocity
-			x[3] = ctx->odometry_ethernet.twist.linear.x;
-			x[4] = ctx->odometry_ethernet.twist.linear.y;
-			x[5] = ctx->odometry_ethernet.twist.linear.z;
-
-			// use offboard odometry to reset orientation
-			x[6] = ctx->odometry_ethernet.pose.orientation.w;
-			x[7] = ctx->odometry_ethernet.pose.orientation.x;
-			x[8] = ctx->odometry_ethernet.pose.orientation.y;
-			x[9] = ctx->odometry_ethernet.pose.orientation.z;
-
 #endif
-		}
 
-		// calculate dt
-		int64_t ticks_now = k_uptime_ticks();
-		dt = (double)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-		ticks_last = ticks_now;
-		if (dt <= 0 || dt > 0.5) {
-			LOG_WRN("imu update rate too low");
+		// imu and the magnetometer sample aligned with it
+		rc = synapse_sync_wait(&ctx->sync, K_MSEC(1000));
+		CEREBRI_TRACE_NAMED(TRACE_EVENT_POLL_RETURN, "rdd2_estimate", rc);
+		rdd2_estimate_check_imu(ctx);
+		if (rc != 0) {
+			CEREBRI_LOG_DBG_LIMIT("not receiving imu");
 			continue;
 		}
 
-		{
-			CASADI_FUNC_ARGS(strapdown_ins_propagate)
-			/* strapdown_ins_propagate:(x0[10],a_b[3],omega_b[3],g,dt)->(x1[10]) */
-
-			double a_b[3] = {ctx->imu.linear_acceleration.x,
-					 ctx->imu.linear_acceleration.y,
-					 ctx->imu.linear_acceleration.z};
-			double omega_b[3] = {ctx->imu.angular_velocity.x,
-					     ctx->imu.angular_velocity.y,
-					     ctx->imu.angular_velocity.z};
-			args[0] = x;
-			args[1] = a_b;
-			args[2] = omega_b;
-			args[3] = &g;
-			args[4] = &dt;
-
-			res[0] = x;
-
-			CASADI_FUNC_CALL(strapdown_ins_propagate)
-		}
-
-		// Update quaternion
-		q[0] = x[6];
-		q[1] = x[7];
-		q[2] = x[8];
-		q[3] = x[9];
-
-		{
-			CASADI_FUNC_ARGS(position_correction)
-
-			double gps[3] = {ctx->odometry_ethernet.pose.position.x,
-					 ctx->odometry_ethernet.pose.position.y,
-					 ctx->odometry_ethernet.pose.position.z};
-
-			args[0] = x;
-			args[1] = gps;
-			args[2] = &dt;
-			args[3] = P_pos;
-
-			res[0] = x;
-			res[1] = P_pos;
-
-			CASADI_FUNC_CALL(position_correction)
-		}
-
-		/*
-		f_att_estimator = ca.Function(
-		"attitude_estimator",
-		[q0, mag, mag_decl, gyro, accel, dt, P_att],
-		[q1.param, P_att],
-		["q", "mag", "mag_decl", "gyro", "accel", "dt", "P_att"],
-		["q1", "P_att"],
-		)*/
-
-		{
-			CASADI_FUNC_ARGS(attitude_estimator)
-
-			double a_b[3] = {ctx->imu.linear_acceleration.x,
-					 ctx->imu.linear_acceleration.y,
-					 ctx->imu.linear_acceleration.z};
-			double omega_b[3] = {ctx->imu.angular_velocity.x,
-					     ctx->imu.angular_velocity.y,
-					     ctx->imu.angular_velocity.z};
-			double mag[3] = {ctx->mag.magnetic_field.x, ctx->mag.magnetic_field.y,
-					 ctx->mag.magnetic_field.z};
-
-			args[0] = q;
-			args[1] = mag;
-			args[2] = &decl_WL;
-			args[3] = omega_b;
-			args[4] = a_b;
-			args[5] = &accel_gain;
-			args[6] = &mag_gain;
-			args[7] = &dt;
-			args[8] = P_att;
-
-			res[0] = q;
-			res[1] = P_att;
-			CASADI_FUNC_CALL(attitude_estimator)
-		}
-
-		x[6] = q[0];
-		x[7] = q[1];
-		x[8] = q[2];
-		x[9] = q[3];
-
-		double v_b[3]; // velocity in body frame
-		double v_w[3]; // velocity in world frame
-
-		// Update velocity in world frame
-		v_w[0] = x[3];
-		v_w[1] = x[4];
-		v_w[2] = x[5];
-
-		// Rotate velocity from world frame to body frame
-		{
-			// rotate_vector_w_to_b:(q[4],v_w[3])->(v_b[3])
-			CASADI_FUNC_ARGS(rotate_vector_w_to_b)
-
-			args[0] = q;
-			args[1] = v_w;
-
-			res[0] = v_b;
-
-			CASADI_FUNC_CALL(rotate_vector_w_to_b)
-		}
-
-		bool data_ok = true;
-		for (int i = 0; i < 10; i++) {
-			if (!isfinite(x[i])) {
-				LOG_ERR("x[%d] is not finite", i);
-				// TODO reinitialize
-				x[i] = 0;
-				data_ok = false;
-				break;
-			}
-		}
-
-		// publish odometry
-		if (data_ok) {
-			stamp_msg(&ctx->odometry.stamp, k_uptime_ticks());
-			ctx->odometry.pose.position.x = x[0];
-			ctx->odometry.pose.position.y = x[1];
-			ctx->odometry.pose.position.z = x[2];
-			ctx->odometry.twist.linear.x = v_b[0];
-			ctx->odometry.twist.linear.y = v_b[1];
-			ctx->odometry.twist.linear.z = v_b[2];
-			ctx->odometry.pose.orientation.w = x[6];
-			ctx->odometry.pose.orientation.x = x[7];
-			ctx->odometry.pose.orientation.y = x[8];
-			ctx->odometry.pose.orientation.z = x[9];
-			ctx->odometry.twist.angular.x = ctx->imu.angular_velocity.x;
-			ctx->odometry.twist.angular.y = ctx->imu.angular_velocity.y;
-			ctx->odometry.twist.angular.z = ctx->imu.angular_velocity.z;
-
-			// check quaternion normal
-			__ASSERT(fabs((ctx->odometry.pose.orientation.w *
-					       ctx->odometry.pose.orientation.w +
-				       ctx->odometry.pose.orientation.x *
-					       ctx->odometry.pose.orientation.x +
-				       ctx->odometry.pose.orientation.y *
-					       ctx->odometry.pose.orientation.y +
-				       ctx->odometry.pose.orientation.z *
-					       ctx->odometry.pose.orientation.z) -
-				      1) < 1e-2,
-				 "quaternion normal error");
-			zros_pub_update(&ctx->pub_odometry);
-		}
+		rdd2_estimate_update(ctx);
 	}
 
 	rdd2_estimate_fini(ctx);
@@ -499,6 +894,19 @@ static int rdd2_estimate_cmd_handler(const struct shell *sh, size_t argc, char *
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_IMU_DELTA)
+		shell_print(sh, "imu delta: %llu ns, gaps bridged: %u",
+			    (unsigned long long)ctx->delta_stamp_ns, ctx->delta_gaps);
+#endif
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_DELAYED)
+		shell_print(sh, "fused: %u, too late: %u, out of order: %u, replayed max: %u",
+			    ctx->fused, ctx->too_late, ctx->out_of_order, ctx->replayed_max);
+#endif
+#if defined(CONFIG_CEREBRI_RDD2_ESTIMATE_MOCAP_PASSTHROUGH)
+		shell_print(sh, "mocap passthrough: %d, forwarded: %u, age: %lld us, max: %lld us",
+			    ctx->passthrough, ctx->forwarded, (long long)(ctx->mocap_age_ns / 1000),
+			    (long long)(ctx->mocap_age_max_ns / 1000));
+#endif
 	}
 	return 0;
 }
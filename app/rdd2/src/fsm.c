@@ -3,84 +3,158 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include <stdio.h>
-
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
 
 #include <zros/private/zros_node_struct.h>
-#include <zros/private/zros_pub_struct.h>
 #include <zros/private/zros_sub_struct.h>
 #include <zros/zros_node.h>
-#include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/core/boot.h>
+#include <cerebri/core/fsm.h>
 #include <cerebri/core/log_utils.h>
+#include <synapse_capture.h>
+#include <synapse_liveness.h>
 #include <synapse_topic_list.h>
 
 #include "input_mapping.h"
 
-#define MY_STACK_SIZE 3072
-#define MY_PRIORITY   4
-#define STATE_ANY     -1
+#define MY_STACK_SIZE   3072
+#define MY_PRIORITY     4
+// arming waits for an imu no older than this
+#define IMU_DEADLINE_MS 100
 
 LOG_MODULE_REGISTER(rdd2_fsm, CONFIG_CEREBRI_RDD2_LOG_LEVEL);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
-static void transition(void *state, bool request, const char *request_name, int pre, uint8_t post,
-		       char *buf, size_t n, int *request_seq, bool *request_rejected,
-		       size_t n_guards, ...)
-{
-	uint8_t *state_int = (uint8_t *)state;
-
-	// not requested
-	if (!request) {
-		return;
-	}
-
-	// null transition
-	if (*state_int == post) {
-		return;
-	}
+// inputs of the state machine, one bit each
+enum {
+	FSM_IN_ARM = BIT(0),
+	FSM_IN_DISARM = BIT(1),
+	FSM_IN_MODE_ATTITUDE_RATE = BIT(2),
+	FSM_IN_MODE_ATTITUDE = BIT(3),
+	FSM_IN_MODE_VELOCITY = BIT(4),
+	FSM_IN_MODE_BEZIER = BIT(5),
+	FSM_IN_MODE_CALIBRATION = BIT(6),
+	FSM_IN_TOPIC_SOURCE_INPUT = BIT(7),
+	FSM_IN_TOPIC_SOURCE_ETHERNET = BIT(8),
+	FSM_IN_SAFE = BIT(9),
+	FSM_IN_FUEL_LOW = BIT(10),
+	FSM_IN_FUEL_CRITICAL = BIT(11),
+	FSM_IN_IMU_STALE = BIT(12),
+	FSM_IN_NOT_READY = BIT(13),
+};
 
-	// LOG_INF("%s pre: %d, post: %d, state: %d", request_name, pre, post, *state_int);
-	// pre state required and not matched
-	if (pre >= 0 && *state_int != pre) {
-		return;
-	}
+// nodes that signal readiness, arming waits for all of them
+#define BOOT_READY_ARM_MASK                                                                        \
+	((IS_ENABLED(CONFIG_CEREBRI_SENSE_IMU) ? BOOT_READY(IMU) : 0) |                            \
+	 (IS_ENABLED(CONFIG_CEREBRI_RDD2_ESTIMATE) ? BOOT_READY(ESTIMATE) : 0))
 
-	// new valid request
-	(*request_seq)++;
-
-	// check guards
-	va_list ap;
-	va_start(ap, n_guards);
-	for (size_t i = 0; i < n_guards; i++) {
-		int guard = va_arg(ap, int);
-		const char *guard_txt = va_arg(ap, const char *);
-		if (guard) {
-			snprintf(buf, n, "deny %s: %s", request_name, guard_txt);
-			LOG_WRN("%s", buf);
-			*request_rejected = true;
-			return;
-		}
-	}
-	va_end(ap);
-	snprintf(buf, n, "accept %s", request_name);
-	LOG_INF("%s", buf);
-	*state_int = post;
-	*request_rejected = false;
-	return;
-}
+// state variables of the status message the table changes
+enum {
+	FSM_ARMING = 0,
+	FSM_MODE = 1,
+	FSM_TOPIC_SOURCE = 2,
+};
 
-struct status_input {
-	struct input_request req;
-	bool safe;
-	bool mode_set;
-	bool fuel_low;
-	bool fuel_critical;
+static const struct fsm_transition g_fsm_table[] = {
+	{
+		.label = "request arm",
+		.request = FSM_IN_ARM,
+		.state = FSM_ARMING,
+		.pre = synapse_pb_Status_Arming_ARMING_DISARMED,
+		.post = synapse_pb_Status_Arming_ARMING_ARMED,
+		.guards =
+			{
+				FSM_GUARD_STATE(FSM_MODE, synapse_pb_Status_Mode_MODE_UNKNOWN,
+						"mode not set"),
+				FSM_GUARD_STATE(FSM_MODE, synapse_pb_Status_Mode_MODE_CALIBRATION,
+						"mode calibration"),
+				FSM_GUARD_INPUT(FSM_IN_SAFE, "safety on"),
+				FSM_GUARD_INPUT(FSM_IN_FUEL_CRITICAL, "fuel_critical"),
+				FSM_GUARD_INPUT(FSM_IN_FUEL_LOW, "fuel_low"),
+				FSM_GUARD_INPUT(FSM_IN_IMU_STALE, "imu not received"),
+				FSM_GUARD_INPUT(FSM_IN_NOT_READY, "not ready"),
+			},
+	},
+	{
+		.label = "request disarm",
+		.request = FSM_IN_DISARM,
+		.state = FSM_ARMING,
+		.pre = synapse_pb_Status_Arming_ARMING_ARMED,
+		.post = synapse_pb_Status_Arming_ARMING_DISARMED,
+	},
+	{
+		.label = "disarm fuel critical",
+		.request = FSM_IN_FUEL_CRITICAL,
+		.state = FSM_ARMING,
+		.pre = synapse_pb_Status_Arming_ARMING_ARMED,
+		.post = synapse_pb_Status_Arming_ARMING_DISARMED,
+	},
+	{
+		.label = "disarm safety engaged",
+		.request = FSM_IN_SAFE,
+		.state = FSM_ARMING,
+		.pre = synapse_pb_Status_Arming_ARMING_ARMED,
+		.post = synapse_pb_Status_Arming_ARMING_DISARMED,
+	},
+	{
+		.label = "request mode attitude rate",
+		.request = FSM_IN_MODE_ATTITUDE_RATE,
+		.state = FSM_MODE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_Mode_MODE_ATTITUDE_RATE,
+	},
+	{
+		.label = "request mode attitude",
+		.request = FSM_IN_MODE_ATTITUDE,
+		.state = FSM_MODE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_Mode_MODE_ATTITUDE,
+	},
+	{
+		.label = "request mode velocity",
+		.request = FSM_IN_MODE_VELOCITY,
+		.state = FSM_MODE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_Mode_MODE_VELOCITY,
+	},
+	{
+		.label = "request mode bezier",
+		.request = FSM_IN_MODE_BEZIER,
+		.state = FSM_MODE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_Mode_MODE_BEZIER,
+	},
+	{
+		.label = "request mode calibration",
+		.request = FSM_IN_MODE_CALIBRATION,
+		.state = FSM_MODE,
+		.pre = FSM_STATE_ANY,
+		.post = synapse_pb_Status_Mode_MODE_CALIBRATION,
+		.guards =
+			{
+				FSM_GUARD_STATE(FSM_ARMING, synapse_pb_Status_Arming_ARMING_ARMED,
+						"disarm required"),
+			},
+	},
+	{
+		.label = "request topic source input",
+		.request = FSM_IN_TOPIC_SOURCE_INPUT,
+		.state = FSM_TOPIC_SOURCE,
+		.pre = synapse_pb_Status_TopicSource_TOPIC_SOURCE_ETHERNET,
+		.post = synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT,
+	},
+	{
+		.label = "request topic source ethernet",
+		.request = FSM_IN_TOPIC_SOURCE_ETHERNET,
+		.state = FSM_TOPIC_SOURCE,
+		.pre = synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT,
+		.post = synapse_pb_Status_TopicSource_TOPIC_SOURCE_ETHERNET,
+	},
 };
 
 struct context {
@@ -89,9 +163,10 @@ struct context {
 	synapse_pb_BatteryState battery_state;
 	synapse_pb_Safety safety;
 	synapse_pb_Status status;
-	struct status_input status_input;
 	struct zros_sub sub_input, sub_battery_state, sub_safety;
-	struct zros_pub pub_status;
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	struct synapse_liveness liveness_imu;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -121,13 +196,19 @@ static struct context g_ctx = {
 	.sub_input = {},
 	.sub_battery_state = {},
 	.sub_safety = {},
-	.pub_status = {},
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	.liveness_imu = SYNAPSE_LIVENESS_INITIALIZER(g_ctx.liveness_imu, &topic_imu, "rdd2_fsm",
+						     IMU_DEADLINE_MS),
+#endif
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
 	.thread_data = {},
 };
 
+FSM_DEFINE(g_fsm, g_fsm_table, &g_ctx.status.arming, &g_ctx.status.mode,
+	   &g_ctx.status.topic_source);
+
 static void rdd2_fsm_init(struct context *ctx)
 {
 	zros_node_init(&ctx->node, "rdd2_fsm");
@@ -135,171 +216,80 @@ static void rdd2_fsm_init(struct context *ctx)
 	zros_sub_init(&ctx->sub_battery_state, &ctx->node, &topic_battery_state,
 		      &ctx->battery_state, 1);
 	zros_sub_init(&ctx->sub_safety, &ctx->node, &topic_safety, &ctx->safety, 5);
-	zros_pub_init(&ctx->pub_status, &ctx->node, &topic_status, &ctx->status);
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	synapse_liveness_start(&ctx->liveness_imu);
+#endif
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("rdd2_fsm init");
 	LOG_INF("init");
 }
 
 static void rdd2_fsm_fini(struct context *ctx)
 {
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	synapse_liveness_stop(&ctx->liveness_imu);
+#endif
 	zros_sub_fini(&ctx->sub_input);
 	zros_sub_fini(&ctx->sub_battery_state);
 	zros_sub_fini(&ctx->sub_safety);
-	zros_pub_fini(&ctx->pub_status);
 	zros_node_fini(&ctx->node);
 	k_sem_give(&ctx->running);
 	LOG_INF("fini");
 }
 
-static void fsm_compute_input(struct status_input *input, const struct context *ctx)
+static uint32_t fsm_compute_input(const struct context *ctx)
 {
-	input_request_compute(&input->req, &ctx->input);
+	struct input_request req;
+	input_request_compute(&req, &ctx->input);
+
+	uint32_t inputs = 0;
+	inputs |= req.arm ? FSM_IN_ARM : 0;
+	inputs |= req.disarm ? FSM_IN_DISARM : 0;
+	inputs |= req.mode_attitude_rate ? FSM_IN_MODE_ATTITUDE_RATE : 0;
+	inputs |= req.mode_attitude ? FSM_IN_MODE_ATTITUDE : 0;
+	inputs |= req.mode_velocity ? FSM_IN_MODE_VELOCITY : 0;
+	inputs |= req.mode_bezier ? FSM_IN_MODE_BEZIER : 0;
+	inputs |= req.mode_calibration ? FSM_IN_MODE_CALIBRATION : 0;
+	inputs |= req.topic_source_input ? FSM_IN_TOPIC_SOURCE_INPUT : 0;
+	inputs |= req.topic_source_ethernet ? FSM_IN_TOPIC_SOURCE_ETHERNET : 0;
 
-	// precompute logical states
-	input->mode_set = ctx->status.mode != synapse_pb_Status_Mode_MODE_UNKNOWN;
 #ifdef CONFIG_CEREBRI_SENSE_SAFETY
-	input->safe = ctx->safety.status == synapse_pb_Safety_Status_SAFETY_SAFE ||
-		      ctx->safety.status == synapse_pb_Safety_Status_SAFETY_UNKNOWN;
-#else
-	input->safe = false;
+	if (ctx->safety.status == synapse_pb_Safety_Status_SAFETY_SAFE ||
+	    ctx->safety.status == synapse_pb_Safety_Status_SAFETY_UNKNOWN) {
+		inputs |= FSM_IN_SAFE;
+	}
 #endif
 
 #ifdef CONFIG_CEREBRI_SENSE_POWER
-	input->fuel_low = ctx->battery_state.voltage <
-			  CONFIG_CEREBRI_RDD2_BATTERY_NCELLS *
-				  CONFIG_CEREBRI_RDD2_BATTERY_CELL_LOW_MILLIVOLT / 1000.0;
-	input->fuel_critical = ctx->battery_state.voltage <
-			       CONFIG_CEREBRI_RDD2_BATTERY_NCELLS *
-				       CONFIG_CEREBRI_RDD2_BATTERY_CELL_MIN_MILLIVOLT / 1000.0;
-#else
-	input->fuel_low = false;
-	input->fuel_critical = false;
+	if (ctx->battery_state.voltage < CONFIG_CEREBRI_RDD2_BATTERY_NCELLS *
+						 CONFIG_CEREBRI_RDD2_BATTERY_CELL_LOW_MILLIVOLT /
+						 1000.0) {
+		inputs |= FSM_IN_FUEL_LOW;
+	}
+	if (ctx->battery_state.voltage < CONFIG_CEREBRI_RDD2_BATTERY_NCELLS *
+						 CONFIG_CEREBRI_RDD2_BATTERY_CELL_MIN_MILLIVOLT /
+						 1000.0) {
+		inputs |= FSM_IN_FUEL_CRITICAL;
+	}
 #endif
-}
 
-static void fsm_update(synapse_pb_Status *status, const struct status_input *input)
-{
-	// arm transition
-	transition(&status->arming,                                        // state
-		   input->req.arm,                                         // request
-		   "request arm",                                          // label
-		   synapse_pb_Status_Arming_ARMING_DISARMED,               // pre
-		   synapse_pb_Status_Arming_ARMING_ARMED,                  // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   // guards
-		   5, status->mode == synapse_pb_Status_Mode_MODE_UNKNOWN, "mode not set",
-		   status->mode == synapse_pb_Status_Mode_MODE_CALIBRATION, "mode calibration",
-		   input->safe, "safety on", input->fuel_critical, "fuel_critical", input->fuel_low,
-		   "fuel_low");
-
-	// disarm transitions
-	transition(&status->arming,                                        // state
-		   input->req.disarm,                                      // request
-		   "request disarm",                                       // label
-		   synapse_pb_Status_Arming_ARMING_ARMED,                  // pre
-		   synapse_pb_Status_Arming_ARMING_DISARMED,               // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	// disarm transitions
-	transition(&status->arming,                                        // state
-		   input->fuel_critical,                                   // request
-		   "disarm fuel critical",                                 // label
-		   synapse_pb_Status_Arming_ARMING_ARMED,                  // pre
-		   synapse_pb_Status_Arming_ARMING_DISARMED,               // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->arming,                                        // state
-		   input->safe,                                            // request
-		   "disarm safety engaged",                                // label
-		   synapse_pb_Status_Arming_ARMING_ARMED,                  // pre
-		   synapse_pb_Status_Arming_ARMING_DISARMED,               // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	// mode transitions
-	transition(&status->mode,                                          // state
-		   input->req.mode_attitude_rate,                          // request
-		   "request mode attitude rate",                           // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_Mode_MODE_ATTITUDE_RATE,              // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->mode,                                          // state
-		   input->req.mode_attitude,                               // request
-		   "request mode attitude",                                // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_Mode_MODE_ATTITUDE,                   // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->mode,                                          // state
-		   input->req.mode_velocity,                               // request
-		   "request mode velocity",                                // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_Mode_MODE_VELOCITY,                   // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->mode,                                          // state
-		   input->req.mode_bezier,                                 // request
-		   "request mode bezier",                                  // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_Mode_MODE_BEZIER,                     // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   0);                                                     // guards
-
-	transition(&status->mode,                                          // state
-		   input->req.mode_calibration,                            // request
-		   "request mode calibration",                             // label
-		   STATE_ANY,                                              // pre
-		   synapse_pb_Status_Mode_MODE_CALIBRATION,                // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   // guards
-		   1, status->arming == synapse_pb_Status_Arming_ARMING_ARMED, "disarm required");
-
-	// topic source transitions
-	transition(&status->topic_source,                                  // state
-		   input->req.topic_source_input,                          // request
-		   "request topic source input",                           // label
-		   synapse_pb_Status_TopicSource_TOPIC_SOURCE_ETHERNET,    // pre
-		   synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT,       // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   // guards
-		   0);
-
-	transition(&status->topic_source,                                  // state
-		   input->req.topic_source_ethernet,                       // request
-		   "request topic source ethernet",                        // label
-		   synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT,       // pre
-		   synapse_pb_Status_TopicSource_TOPIC_SOURCE_ETHERNET,    // post
-		   status->status_message, sizeof(status->status_message), // status
-		   &status->request_seq, &status->request_rejected,        // request
-		   // guards
-		   0);
-
-	// set timestamp
-	stamp_msg(&status->stamp, k_uptime_ticks());
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	if (synapse_liveness_stale(&ctx->liveness_imu)) {
+		inputs |= FSM_IN_IMU_STALE;
+	}
+#endif
+	if (!boot_ready_all(BOOT_READY_ARM_MASK)) {
+		inputs |= FSM_IN_NOT_READY;
+	}
+	return inputs;
 }
 
-static void status_add_extra_info(synapse_pb_Status *status, struct status_input *input,
+static void status_add_extra_info(synapse_pb_Status *status, uint32_t inputs,
 				  const struct context *ctx)
 {
-	if (input->fuel_critical) {
+	if (inputs & FSM_IN_FUEL_CRITICAL) {
 		status->fuel = synapse_pb_Status_Fuel_FUEL_CRITICAL;
-	} else if (input->fuel_low) {
+	} else if (inputs & FSM_IN_FUEL_LOW) {
 		status->fuel = synapse_pb_Status_Fuel_FUEL_LOW;
 	} else {
 		status->fuel = synapse_pb_Status_Fuel_FUEL_NOMINAL;
@@ -308,8 +298,13 @@ static void status_add_extra_info(synapse_pb_Status *status, struct status_input
 			 CONFIG_CEREBRI_RDD2_BATTERY_CELL_MAX_MILLIVOLT / 1000.0;
 	double bat_min = CONFIG_CEREBRI_RDD2_BATTERY_NCELLS *
 			 CONFIG_CEREBRI_RDD2_BATTERY_CELL_MIN_MILLIVOLT / 1000.0;
-	status->fuel_percentage =
-		100 * (ctx->battery_state.voltage - bat_min) / (bat_max - bat_min);
+	if (ctx->battery_state.design_capacity > 0) {
+		// coulomb counted by sense_power, does not jump with the sag under load
+		status->fuel_percentage = 100 * ctx->battery_state.percentage;
+	} else {
+		status->fuel_percentage =
+			100 * (ctx->battery_state.voltage - bat_min) / (bat_max - bat_min);
+	}
 	status->power = ctx->battery_state.voltage * ctx->battery_state.current;
 #ifdef CONFIG_CEREBRI_SENSE_SAFETY
 	if (ctx->safety.status == synapse_pb_Safety_Status_SAFETY_SAFE) {
@@ -335,22 +330,41 @@ static void rdd2_fsm_run(void *p0, void *p1, void *p2)
 	struct k_poll_event events[] = {
 		*zros_sub_get_event(&ctx->sub_input),
 		*zros_sub_get_event(&ctx->sub_battery_state),
+		*zros_sub_get_event(&ctx->sub_safety),
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+		// the imu going quiet or coming back changes an input
+		SYNAPSE_LIVENESS_POLL_EVENT(&ctx->liveness_imu),
+#endif
 	};
 
 	int64_t input_last_ticks = k_uptime_ticks();
 	int64_t input_loss_ticks = 1.0 * CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+	int64_t publish_last_ticks = 0;
+	int64_t publish_ticks = CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+
+	fsm_reset(&g_fsm);
 
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 
-		// current ticks
+		// wait for an input, on input loss, publish at 1 Hz regardless
 		int64_t now_ticks = k_uptime_ticks();
-
-		// wait for input event, publish at 1 Hz regardless
-		int rc = 0;
-		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
+		int64_t wait = publish_last_ticks + publish_ticks - now_ticks;
+		if (ctx->status.input_status != synapse_pb_Status_LinkStatus_STATUS_LOSS) {
+			wait = fsm_wait_ticks(now_ticks, input_last_ticks + input_loss_ticks + 1,
+					      wait);
+		}
+		int rc = k_poll(events, ARRAY_SIZE(events), K_TICKS(MAX(wait, 1)));
 		if (rc != 0) {
-			LOG_DBG("fsm input/battery polling timeout");
+			CEREBRI_LOG_DBG_LIMIT("fsm input/battery polling timeout");
 		}
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+		if (events[3].state == K_POLL_STATE_SIGNALED) {
+			synapse_liveness_ack(&ctx->liveness_imu, &events[3]);
+		}
+#endif
+
+		now_ticks = k_uptime_ticks();
+		bool link_changed = false;
 
 		zros_sub_update(&ctx->sub_battery_state);
 		zros_sub_update(&ctx->sub_safety);
@@ -361,6 +375,8 @@ static void rdd2_fsm_run(void *p0, void *p1, void *p2)
 			if (ctx->status.input_status == synapse_pb_Status_LinkStatus_STATUS_LOSS) {
 				LOG_DBG("input regained");
 			}
+			link_changed |=
+				ctx->status.input_status != synapse_pb_Status_LinkStatus_STATUS_NOMINAL;
 			input_last_ticks = now_ticks;
 			ctx->status.input_status = synapse_pb_Status_LinkStatus_STATUS_NOMINAL;
 		}
@@ -370,13 +386,30 @@ static void rdd2_fsm_run(void *p0, void *p1, void *p2)
 		    (now_ticks - input_last_ticks) > input_loss_ticks) {
 			LOG_DBG("input loss");
 			ctx->status.input_status = synapse_pb_Status_LinkStatus_STATUS_LOSS;
+			link_changed = true;
 		}
 
-		// perform processing
-		fsm_compute_input(&ctx->status_input, ctx);
-		fsm_update(&ctx->status, &ctx->status_input);
-		status_add_extra_info(&ctx->status, &ctx->status_input, ctx);
-		zros_pub_update(&ctx->pub_status);
+		// perform processing, the table is only walked when an input changed
+		uint32_t inputs = fsm_compute_input(ctx);
+		if (!(inputs & FSM_IN_NOT_READY)) {
+			boot_ready_set(BOOT_READY_ARM);
+		}
+		synapse_pb_Status_Arming arming = ctx->status.arming;
+		bool walked = fsm_update(&g_fsm, inputs, ctx->status.status_message,
+					 sizeof(ctx->status.status_message),
+					 &ctx->status.request_seq, &ctx->status.request_rejected);
+		if (arming == synapse_pb_Status_Arming_ARMING_ARMED &&
+		    ctx->status.arming == synapse_pb_Status_Arming_ARMING_DISARMED &&
+		    !(inputs & FSM_IN_DISARM)) {
+			synapse_capture_trigger("fsm failsafe disarm");
+		}
+
+		if (walked || link_changed || now_ticks - publish_last_ticks >= publish_ticks) {
+			stamp_msg_now(&ctx->status.stamp);
+			status_add_extra_info(&ctx->status, inputs, ctx);
+			synapse_seqlock_publish(&seqlock_status, &ctx->status);
+			publish_last_ticks = now_ticks;
+		}
 	}
 
 	rdd2_fsm_fini(ctx);
@@ -410,6 +443,8 @@ static int rdd2_fsm_cmd_handler(const struct shell *sh, size_t argc, char **argv
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		shell_print(sh, "table walks: %u, skipped: %u, longest: %u cyc", g_fsm.walks,
+			    g_fsm.skips, g_fsm.max_walk_cyc);
 	}
 	return 0;
 }
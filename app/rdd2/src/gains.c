@@ -0,0 +1,71 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "gains.h"
+
+#define RDD2_ATTITUDE_DEFAULT                                                                      \
+	{                                                                                          \
+		.kp = {CONFIG_CEREBRI_RDD2_ROLL_KP * 1e-6, CONFIG_CEREBRI_RDD2_PITCH_KP * 1e-6,    \
+		       CONFIG_CEREBRI_RDD2_YAW_KP * 1e-6},                                         \
+	}
+
+PARAM_GROUP_DEFINE(rdd2_attitude, struct rdd2_attitude_param, RDD2_ATTITUDE_DEFAULT,
+		   PARAM_ARRAY(struct rdd2_attitude_param, kp));
+
+#define RDD2_RATE_DEFAULT                                                                          \
+	{                                                                                          \
+		.kp = {CONFIG_CEREBRI_RDD2_ROLLRATE_KP * 1e-6,                                     \
+		       CONFIG_CEREBRI_RDD2_PITCHRATE_KP * 1e-6,                                    \
+		       CONFIG_CEREBRI_RDD2_YAWRATE_KP * 1e-6},                                     \
+		.ki = {CONFIG_CEREBRI_RDD2_ROLLRATE_KI * 1e-6,                                     \
+		       CONFIG_CEREBRI_RDD2_PITCHRATE_KI * 1e-6,                                    \
+		       CONFIG_CEREBRI_RDD2_YAWRATE_KI * 1e-6},                                     \
+		.kd = {CONFIG_CEREBRI_RDD2_ROLLRATE_KD * 1e-6,                                     \
+		       CONFIG_CEREBRI_RDD2_PITCHRATE_KD * 1e-6,                                    \
+		       CONFIG_CEREBRI_RDD2_YAWRATE_KD * 1e-6},                                     \
+		.i_max = {CONFIG_CEREBRI_RDD2_ROLLRATE_IMAX * 1e-6,                                \
+			  CONFIG_CEREBRI_RDD2_PITCHRATE_IMAX * 1e-6,                               \
+			  CONFIG_CEREBRI_RDD2_YAWRATE_IMAX * 1e-6},                                \
+		.f_cut = CONFIG_CEREBRI_RDD2_ATTITUDE_RATE_FCUT * 1e-3,                            \
+	}
+
+PARAM_GROUP_DEFINE(rdd2_rate, struct rdd2_rate_param, RDD2_RATE_DEFAULT,
+		   PARAM_ARRAY(struct rdd2_rate_param, kp), PARAM_ARRAY(struct rdd2_rate_param, ki),
+		   PARAM_ARRAY(struct rdd2_rate_param, kd),
+		   PARAM_ARRAY(struct rdd2_rate_param, i_max),
+		   PARAM(struct rdd2_rate_param, f_cut));
+
+#define RDD2_ESTIMATE_DEFAULT                                                                      \
+	{                                                                                          \
+		.accel_gain = CONFIG_CEREBRI_RDD2_ATTITUDE_EST_ACCEL_GAIN * 1e-3,                  \
+		.mag_gain = CONFIG_CEREBRI_RDD2_ATTITUDE_EST_MAG_GAIN * 1e-3,                      \
+	}
+
+PARAM_GROUP_DEFINE(rdd2_estimate, struct rdd2_estimate_param, RDD2_ESTIMATE_DEFAULT,
+		   PARAM(struct rdd2_estimate_param, accel_gain),
+		   PARAM(struct rdd2_estimate_param, mag_gain));
+
+#define RDD2_MOTOR_DEFAULT                                                                         \
+	{                                                                                          \
+		.l = CONFIG_CEREBRI_RDD2_MOTOR_L_MM * 1e-3,                                        \
+		.Cm = CONFIG_CEREBRI_RDD2_MOTOR_CM * 1e-6,                                         \
+		.Ct = CONFIG_CEREBRI_RDD2_MOTOR_CT * 1e-9,                                         \
+	}
+
+PARAM_GROUP_DEFINE(rdd2_motor, struct rdd2_motor_param, RDD2_MOTOR_DEFAULT,
+		   PARAM(struct rdd2_motor_param, l), PARAM(struct rdd2_motor_param, Cm),
+		   PARAM(struct rdd2_motor_param, Ct));
+
+#define RDD2_CONTROL_DEFAULT                                                                       \
+	{                                                                                          \
+		.position = IS_ENABLED(CONFIG_CEREBRI_RDD2_LOG_LINEAR_POSITION),                   \
+		.attitude = IS_ENABLED(CONFIG_CEREBRI_RDD2_LOG_LINEAR_ATTITUDE),                   \
+	}
+
+PARAM_GROUP_DEFINE(rdd2_control, struct rdd2_control_param, RDD2_CONTROL_DEFAULT,
+		   PARAM(struct rdd2_control_param, position),
+		   PARAM(struct rdd2_control_param, attitude));
+
+// vi: ts=4 sw=4 et
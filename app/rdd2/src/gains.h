@@ -0,0 +1,59 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef RDD2_GAINS_H
+#define RDD2_GAINS_H
+
+#include <cerebri/core/param.h>
+
+#include "app/rdd2/casadi/rdd2.h"
+
+/*
+ * Gains and vehicle constants, runtime parameters defaulting to their
+ * Kconfig values. Shared by the separate nodes and the inner loop node.
+ */
+
+struct rdd2_attitude_param {
+	casadi_real kp[3];
+};
+
+struct rdd2_rate_param {
+	casadi_real kp[3];
+	casadi_real ki[3];
+	casadi_real kd[3];
+	casadi_real i_max[3];
+	casadi_real f_cut;
+};
+
+struct rdd2_estimate_param {
+	casadi_real accel_gain;
+	casadi_real mag_gain;
+};
+
+struct rdd2_motor_param {
+	casadi_real l;
+	casadi_real Cm;
+	casadi_real Ct;
+};
+
+// controller variant of each loop, an rdd2_variant_id, see variant.h
+struct rdd2_control_param {
+	int32_t position;
+	int32_t attitude;
+};
+
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_OMEGA_MAX)
+// allocation limits, the same for the allocation node and the inner loop node
+#define RDD2_OMEGA_MAX CONFIG_CEREBRI_RDD2_ALLOCATION_OMEGA_MAX
+#define RDD2_F_MAX     (CONFIG_CEREBRI_RDD2_ALLOCATION_THRUST_MAX_MN * 1e-3)
+#endif
+
+PARAM_GROUP_DECLARE(rdd2_attitude);
+PARAM_GROUP_DECLARE(rdd2_rate);
+PARAM_GROUP_DECLARE(rdd2_estimate);
+PARAM_GROUP_DECLARE(rdd2_motor);
+PARAM_GROUP_DECLARE(rdd2_control);
+
+#endif // RDD2_GAINS_H
+// vi: ts=4 sw=4 et
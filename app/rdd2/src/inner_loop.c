@@ -0,0 +1,499 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/private/zros_sub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+#include <zros/zros_sub.h>
+
+#include <synapse_capture.h>
+#include <synapse_latency.h>
+#include <synapse_topic_list.h>
+
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_DIRECT)
+#include <cerebri/actuate/dshot.h>
+#endif
+#include <cerebri/core/boot.h>
+#include <cerebri/core/casadi.h>
+#include <cerebri/core/executor.h>
+#include <cerebri/core/log_utils.h>
+#include <cerebri/core/perf_duration.h>
+#include <cerebri/core/placement.h>
+#include <cerebri/core/trace.h>
+
+#include "app/rdd2/casadi/rdd2.h"
+#include "gains.h"
+
+#define MY_STACK_SIZE  4096
+#define MY_PRIORITY    4
+#define MY_DEADLINE_US 500
+
+CEREBRI_NODE_LOG_INIT(rdd2_inner_loop, LOG_LEVEL_WRN);
+
+static CEREBRI_HOT_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+
+/*
+ * Attitude, angular velocity and allocation in one pass on each estimator
+ * odometry, in place of the rdd2_attitude, rdd2_angular_velocity and
+ * rdd2_allocation nodes. The motors are written before the intermediate
+ * setpoints are published, these are only for logging and the modes that
+ * set the angular velocity themselves.
+ */
+struct context {
+	struct zros_node node;
+	synapse_pb_Status status;
+	synapse_pb_Odometry odometry_estimator;
+	synapse_pb_Quaternion attitude_sp;
+	synapse_pb_Vector3 angular_velocity_cmd, angular_velocity_ff;
+	synapse_pb_Vector3 angular_velocity_sp, moment_sp, moment_ff, force_sp;
+	synapse_pb_Actuators actuators;
+	struct zros_sub sub_status, sub_odometry_estimator, sub_attitude_sp,
+		sub_angular_velocity_cmd, sub_angular_velocity_ff, sub_moment_ff, sub_force_sp;
+	struct zros_pub pub_angular_velocity_sp, pub_moment_sp, pub_actuators;
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	struct synapse_battery_headroom headroom;
+	struct zros_sub sub_battery_headroom;
+#endif
+	struct synapse_latency_trace latency;
+	struct perf_duration perf;
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	struct executor_task task;
+#endif
+	struct k_sem running;
+	size_t stack_size;
+	k_thread_stack_t *stack_area;
+	struct k_thread thread_data;
+	int64_t ticks_last;
+	casadi_real dt;
+	casadi_real omega_i[3];
+	casadi_real omega_e[3];
+	casadi_real domega_e[3];
+	casadi_real alpha;
+};
+
+static struct context g_ctx CEREBRI_HOT_CONTEXT = {
+	.node = {},
+	.status = synapse_pb_Status_init_default,
+	.odometry_estimator = synapse_pb_Odometry_init_default,
+	.attitude_sp = synapse_pb_Quaternion_init_default,
+	.angular_velocity_cmd = synapse_pb_Vector3_init_default,
+	.angular_velocity_ff = synapse_pb_Vector3_init_default,
+	.angular_velocity_sp = synapse_pb_Vector3_init_default,
+	.moment_sp = synapse_pb_Vector3_init_default,
+	.moment_ff = synapse_pb_Vector3_init_default,
+	.force_sp = synapse_pb_Vector3_init_default,
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	.headroom = {.thrust_scale = 1.0f},
+	.sub_battery_headroom = {},
+#endif
+	.actuators =
+		{
+			.has_stamp = true,
+			.stamp = synapse_pb_Timestamp_init_default,
+			.velocity_count = 4,
+			.normalized_count = 0,
+			.position_count = 0,
+			.position = {},
+			.normalized = {},
+			.velocity = {},
+		},
+	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
+	.stack_size = MY_STACK_SIZE,
+	.stack_area = g_my_stack_area,
+	.thread_data = {},
+	.omega_i = {},
+	.omega_e = {},
+	.domega_e = {},
+};
+
+static void rdd2_inner_loop_init(struct context *ctx)
+{
+	zros_node_init(&ctx->node, "rdd2_inner_loop");
+	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
+	zros_sub_init(&ctx->sub_odometry_estimator, &ctx->node, &topic_odometry_estimator,
+		      &ctx->odometry_estimator, 1000);
+	zros_sub_init(&ctx->sub_attitude_sp, &ctx->node, &topic_attitude_sp, &ctx->attitude_sp, 50);
+	zros_sub_init(&ctx->sub_angular_velocity_cmd, &ctx->node, &topic_angular_velocity_sp,
+		      &ctx->angular_velocity_cmd, 1000);
+	zros_sub_init(&ctx->sub_angular_velocity_ff, &ctx->node, &topic_angular_velocity_ff,
+		      &ctx->angular_velocity_ff, 50);
+	zros_sub_init(&ctx->sub_moment_ff, &ctx->node, &topic_moment_ff, &ctx->moment_ff, 1000);
+	zros_sub_init(&ctx->sub_force_sp, &ctx->node, &topic_force_sp, &ctx->force_sp, 1000);
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	zros_sub_init(&ctx->sub_battery_headroom, &ctx->node, &topic_battery_headroom,
+		      &ctx->headroom, 10);
+#endif
+	zros_pub_init(&ctx->pub_angular_velocity_sp, &ctx->node, &topic_angular_velocity_sp,
+		      &ctx->angular_velocity_sp);
+	zros_pub_init(&ctx->pub_moment_sp, &ctx->node, &topic_moment_sp, &ctx->moment_sp);
+	zros_pub_init(&ctx->pub_actuators, &ctx->node, &topic_actuators, &ctx->actuators);
+	perf_duration_init(&ctx->perf, "rdd2 inner loop", MY_DEADLINE_US * 1e-6);
+	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("rdd2_inner_loop init");
+	LOG_INF("init");
+}
+
+static void rdd2_inner_loop_fini(struct context *ctx)
+{
+	perf_duration_fini(&ctx->perf);
+	zros_sub_fini(&ctx->sub_status);
+	zros_sub_fini(&ctx->sub_odometry_estimator);
+	zros_sub_fini(&ctx->sub_attitude_sp);
+	zros_sub_fini(&ctx->sub_angular_velocity_cmd);
+	zros_sub_fini(&ctx->sub_angular_velocity_ff);
+	zros_sub_fini(&ctx->sub_moment_ff);
+	zros_sub_fini(&ctx->sub_force_sp);
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	zros_sub_fini(&ctx->sub_battery_headroom);
+#endif
+	zros_pub_fini(&ctx->pub_angular_velocity_sp);
+	zros_pub_fini(&ctx->pub_moment_sp);
+	zros_pub_fini(&ctx->pub_actuators);
+	zros_node_fini(&ctx->node);
+	k_sem_give(&ctx->running);
+	LOG_INF("fini");
+}
+
+// angular velocity setpoint from the attitude setpoint, false if not computed
+static bool rdd2_inner_loop_attitude(struct context *ctx)
+{
+	casadi_real q_wb[4] = {ctx->odometry_estimator.pose.orientation.w,
+			       ctx->odometry_estimator.pose.orientation.x,
+			       ctx->odometry_estimator.pose.orientation.y,
+			       ctx->odometry_estimator.pose.orientation.z};
+	casadi_real q_r[4] = {ctx->attitude_sp.w, ctx->attitude_sp.x, ctx->attitude_sp.y,
+			      ctx->attitude_sp.z};
+	casadi_real omega[3];
+
+	{
+		// attitude_control:(kp[3],q[4],q_r[4])->(omega[3])
+		CASADI_FUNC_ARGS(attitude_control);
+		const struct rdd2_attitude_param *param =
+			PARAM_GET(rdd2_attitude, struct rdd2_attitude_param);
+
+		args[0] = param->kp;
+		args[1] = q_wb;
+		args[2] = q_r;
+
+		res[0] = omega;
+
+		CASADI_FUNC_CALL(attitude_control);
+	}
+
+	for (int i = 0; i < 3; i++) {
+		if (!isfinite(omega[i])) {
+			CEREBRI_LOG_WRN_LIMIT("omega[%d] not finite: %10.4f", i, omega[i]);
+			return false;
+		}
+	}
+
+	ctx->angular_velocity_sp.x = omega[0] + ctx->angular_velocity_ff.x;
+	ctx->angular_velocity_sp.y = omega[1] + ctx->angular_velocity_ff.y;
+	ctx->angular_velocity_sp.z = omega[2] + ctx->angular_velocity_ff.z;
+	return true;
+}
+
+// moment setpoint from the angular velocity setpoint, false if not computed
+static bool rdd2_inner_loop_angular_velocity(struct context *ctx)
+{
+	casadi_real omega[3] = {ctx->odometry_estimator.twist.angular.x,
+				ctx->odometry_estimator.twist.angular.y,
+				ctx->odometry_estimator.twist.angular.z};
+	casadi_real omega_r[3] = {ctx->angular_velocity_sp.x, ctx->angular_velocity_sp.y,
+				  ctx->angular_velocity_sp.z};
+	casadi_real M[3];
+
+	{
+		// attitude_rate_control:(
+		// kp[3],ki[3],kd[3],f_cut,i_max[3],
+		// omega[3],omega_r[3],i0[3],e0[3],de0[3],dt)->(M[3],i1[3],e1[3],de1[3])
+		CASADI_FUNC_ARGS(attitude_rate_control);
+
+		const struct rdd2_rate_param *param = PARAM_GET(rdd2_rate, struct rdd2_rate_param);
+
+		args[0] = param->kp;
+		args[1] = param->ki;
+		args[2] = param->kd;
+		args[3] = &param->f_cut;
+		args[4] = param->i_max;
+		args[5] = omega;
+		args[6] = omega_r;
+		args[7] = ctx->omega_i;
+		args[8] = ctx->omega_e;
+		args[9] = ctx->domega_e;
+		args[10] = &ctx->dt;
+
+		res[0] = M;
+		res[1] = ctx->omega_i;
+		res[2] = ctx->omega_e;
+		res[3] = ctx->domega_e;
+		res[4] = &ctx->alpha;
+
+		CASADI_FUNC_CALL(attitude_rate_control);
+	}
+
+	for (int i = 0; i < 3; i++) {
+		if (!isfinite(ctx->omega_i[i])) {
+			CEREBRI_LOG_ERR_LIMIT("omega_i[%d] not finite: %10.4f", i, ctx->omega_i[i]);
+			return false;
+		}
+		if (!isfinite(M[i])) {
+			CEREBRI_LOG_ERR_LIMIT("M[%d] not finite: %10.4f", i, M[i]);
+			return false;
+		}
+	}
+
+	ctx->moment_sp.x = M[0] + ctx->moment_ff.x;
+	ctx->moment_sp.y = M[1] + ctx->moment_ff.y;
+	ctx->moment_sp.z = M[2] + ctx->moment_ff.z;
+	return true;
+}
+
+static void stop(struct context *ctx)
+{
+	for (int i = 0; i < 4; i++) {
+		ctx->actuators.velocity[i] = 0;
+	}
+}
+
+static void rdd2_inner_loop_allocation(struct context *ctx)
+{
+	casadi_real omega[4];
+	casadi_real Fp_sum[4], F_moment[4], F_thrust[4], M_sat[3];
+	casadi_real moment[3] = {ctx->moment_sp.x, ctx->moment_sp.y, ctx->moment_sp.z};
+	// the message field is a double, casadi_real may be a float
+	casadi_real const thrust = ctx->force_sp.z;
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	// thrust the pack can still give at full throttle, so saturation keeps moment
+	casadi_real const F_max = RDD2_F_MAX * ctx->headroom.thrust_scale;
+#else
+	static casadi_real const F_max = RDD2_F_MAX;
+#endif
+
+	// control_allocation:(F_max,l,Cm,Ct,T,M[3])
+	// ->(omega[4],Fp_sum[4],F_moment[4],F_thrust[4],M_sat[3])
+	CASADI_FUNC_ARGS(control_allocation)
+	const struct rdd2_motor_param *motor = PARAM_GET(rdd2_motor, struct rdd2_motor_param);
+
+	args[0] = &F_max;
+	args[1] = &motor->l;
+	args[2] = &motor->Cm;
+	args[3] = &motor->Ct;
+	args[4] = &thrust;
+	args[5] = moment;
+
+	res[0] = omega;
+	res[1] = Fp_sum;
+	res[2] = F_moment;
+	res[3] = F_thrust;
+	res[4] = M_sat;
+	CASADI_FUNC_CALL(control_allocation)
+
+	for (int i = 0; i < 4; i++) {
+		if (!isfinite(omega[i])) {
+			CEREBRI_LOG_WRN_LIMIT("omega is not finite: %10.4f", omega[i]);
+			synapse_capture_trigger("allocation not finite");
+			omega[i] = 0;
+		} else if (omega[i] > RDD2_OMEGA_MAX) {
+			CEREBRI_LOG_WRN_LIMIT("omega too large: %10.4f", omega[i]);
+			synapse_capture_trigger("motor saturation");
+			omega[i] = RDD2_OMEGA_MAX;
+		} else if (omega[i] < 0) {
+			CEREBRI_LOG_WRN_LIMIT("omega negative: %10.4f", omega[i]);
+			omega[i] = 0;
+		}
+		ctx->actuators.velocity[i] = omega[i];
+	}
+}
+
+static void rdd2_inner_loop_update(struct context *ctx, int rc)
+{
+	perf_duration_start(&ctx->perf);
+
+	// update subscriptions
+	zros_sub_update(&ctx->sub_status);
+	zros_sub_update(&ctx->sub_odometry_estimator);
+	zros_sub_update(&ctx->sub_attitude_sp);
+	zros_sub_update(&ctx->sub_angular_velocity_cmd);
+	zros_sub_update(&ctx->sub_angular_velocity_ff);
+	zros_sub_update(&ctx->sub_moment_ff);
+	zros_sub_update(&ctx->sub_force_sp);
+#if defined(CONFIG_CEREBRI_RDD2_ALLOCATION_BATTERY_HEADROOM)
+	zros_sub_update(&ctx->sub_battery_headroom);
+#endif
+	synapse_latency_get(SYNAPSE_LATENCY_ESTIMATE, &ctx->latency);
+
+	// calculate dt
+	int64_t ticks_now = k_uptime_ticks();
+	ctx->dt = (double)(ticks_now - ctx->ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+	ctx->ticks_last = ticks_now;
+
+	bool attitude_ok = false;
+	bool moment_ok = false;
+
+	if (ctx->status.mode == synapse_pb_Status_Mode_MODE_ATTITUDE_RATE) {
+		// the command sets the angular velocity itself
+		ctx->angular_velocity_sp.x = ctx->angular_velocity_cmd.x;
+		ctx->angular_velocity_sp.y = ctx->angular_velocity_cmd.y;
+		ctx->angular_velocity_sp.z = ctx->angular_velocity_cmd.z;
+	} else {
+		attitude_ok = rdd2_inner_loop_attitude(ctx);
+	}
+	synapse_latency_mark(SYNAPSE_LATENCY_ATTITUDE, &ctx->latency);
+
+	if (rc == 0 && ctx->dt >= 0 && ctx->dt <= 0.1) {
+		moment_ok = rdd2_inner_loop_angular_velocity(ctx);
+	} else {
+		CEREBRI_LOG_DBG_LIMIT("odometry rate too low");
+	}
+	synapse_latency_mark(SYNAPSE_LATENCY_ANGULAR_VELOCITY, &ctx->latency);
+
+	if (rc < 0) {
+		stop(ctx);
+		LOG_DBG("no data, stopped");
+	} else if (ctx->status.arming != synapse_pb_Status_Arming_ARMING_ARMED) {
+		// not armed, stop
+		stop(ctx);
+	} else {
+		rdd2_inner_loop_allocation(ctx);
+	}
+
+	stamp_msg_now(&ctx->actuators.stamp);
+	ctx->actuators.has_stamp = true;
+	synapse_latency_mark(SYNAPSE_LATENCY_ALLOCATION, &ctx->latency);
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_DIRECT)
+	bool direct = actuate_dshot_write(&ctx->actuators, &ctx->latency) == 0;
+#else
+	bool direct = false;
+#endif
+	if (!direct) {
+		CEREBRI_TRACE_NAMED(TRACE_EVENT_PUBLISH, "actuators", 0);
+		zros_pub_update(&ctx->pub_actuators);
+	}
+	perf_duration_stop(&ctx->perf);
+
+	// off the critical path, the motors are written
+	if (attitude_ok) {
+		stamp_msg_now(&ctx->angular_velocity_sp.stamp);
+		ctx->angular_velocity_sp.has_stamp = true;
+		zros_pub_update(&ctx->pub_angular_velocity_sp);
+	}
+	if (moment_ok) {
+		stamp_msg_now(&ctx->moment_sp.stamp);
+		ctx->moment_sp.has_stamp = true;
+		zros_pub_update(&ctx->pub_moment_sp);
+	}
+	if (direct) {
+		zros_pub_update(&ctx->pub_actuators);
+	}
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+static void rdd2_inner_loop_execute(struct executor_task *task)
+{
+	struct context *ctx = CONTAINER_OF(task, struct context, task);
+
+	bool available = zros_sub_update_available(&ctx->sub_odometry_estimator);
+	int rc = executor_wait(task, available, 100);
+	if (rc != -EBUSY) {
+		rdd2_inner_loop_update(ctx, rc);
+	}
+}
+#endif
+
+static void rdd2_inner_loop_run(void *p0, void *p1, void *p2)
+{
+	struct context *ctx = p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	rdd2_inner_loop_init(ctx);
+
+	struct k_poll_event events[] = {
+		*zros_sub_get_event(&ctx->sub_odometry_estimator),
+	};
+
+	ctx->ticks_last = k_uptime_ticks();
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	if (executor_register(&ctx->task, "rdd2_inner_loop", rdd2_inner_loop_execute,
+			      EXECUTOR_STAGE_ATTITUDE, EXECUTOR_FRAME_US, 0, MY_DEADLINE_US) == 0) {
+		// updates run in the executor frame, park until stopped
+		k_sem_take(&ctx->running, K_FOREVER);
+		executor_unregister(&ctx->task);
+		rdd2_inner_loop_fini(ctx);
+		return;
+	}
+#endif
+
+	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
+		// wait for estimator odometry, stop the motors at 10 Hz without it
+		int rc = 0;
+		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(100));
+		CEREBRI_TRACE_NAMED(TRACE_EVENT_POLL_RETURN, "rdd2_inner_loop", rc);
+		if (rc != 0) {
+			CEREBRI_LOG_DBG_LIMIT("not receiving estimator odometry");
+		}
+
+		rdd2_inner_loop_update(ctx, rc);
+	}
+
+	rdd2_inner_loop_fini(ctx);
+}
+
+static int start(struct context *ctx)
+{
+	k_tid_t tid =
+		k_thread_create(&ctx->thread_data, ctx->stack_area, ctx->stack_size,
+				rdd2_inner_loop_run, ctx, NULL, NULL, MY_PRIORITY, 0, K_FOREVER);
+	k_thread_name_set(tid, "rdd2_inner_loop");
+	k_thread_start(tid);
+	return 0;
+}
+
+static int rdd2_inner_loop_cmd_handler(const struct shell *sh, size_t argc, char **argv, void *data)
+{
+	ARG_UNUSED(argc);
+	struct context *ctx = data;
+
+	if (strcmp(argv[0], "start") == 0) {
+		if (k_sem_count_get(&g_ctx.running) == 0) {
+			shell_print(sh, "already running");
+		} else {
+			start(ctx);
+		}
+	} else if (strcmp(argv[0], "stop") == 0) {
+		if (k_sem_count_get(&g_ctx.running) == 0) {
+			k_sem_give(&g_ctx.running);
+		} else {
+			shell_print(sh, "not running");
+		}
+	} else if (strcmp(argv[0], "status") == 0) {
+		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_DICT_SET_CREATE(sub_rdd2_inner_loop, rdd2_inner_loop_cmd_handler,
+			     (start, &g_ctx, "start"), (stop, &g_ctx, "stop"),
+			     (status, &g_ctx, "status"));
+
+SHELL_CMD_REGISTER(rdd2_inner_loop, &sub_rdd2_inner_loop, "rdd2 inner loop commands", NULL);
+
+static int rdd2_inner_loop_sys_init(void)
+{
+	return start(&g_ctx);
+};
+
+SYS_INIT(rdd2_inner_loop_sys_init, APPLICATION, 1);
+
+// vi: ts=4 sw=4 et
@@ -3,8 +3,6 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include <math.h>
-
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
@@ -16,15 +14,33 @@
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/core/boot.h>
+#include <cerebri/core/lighting.h>
 #include <cerebri/core/log_utils.h>
+#include <synapse_cache.h>
 #include <synapse_topic_list.h>
 
 #define MY_STACK_SIZE 2048
 #define MY_PRIORITY   4
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+// the work item has no subscription events to wake on, so state is polled this often
+#define MAX_WAIT_MS 100
+#else
+#define MAX_WAIT_MS 1000
+#endif
+
+#define LED_INDEX_MAX ARRAY_SIZE(((synapse_pb_LEDArray *)NULL)->led)
+
 CEREBRI_NODE_LOG_INIT(rdd2_lighting, LOG_LEVEL_WRN);
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+extern struct k_work_q g_shared_work_q;
+
+static void rdd2_lighting_work_handler(struct k_work *work);
+#else
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+#endif
 
 struct context {
 	// node
@@ -39,9 +55,18 @@ struct context {
 	// publications
 	struct zros_pub pub_led_array;
 	struct k_sem running;
+	// last color published per led index, only changes are published
+	struct lighting_led led_last[LED_INDEX_MAX];
+	// until the pulse brightness next changes
+	int64_t wait_ms;
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+	struct k_work_delayable work_item;
+	bool active;
+#else
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
 	struct k_thread thread_data;
+#endif
 };
 
 static struct context g_ctx = {
@@ -54,20 +79,31 @@ static struct context g_ctx = {
 	.sub_status = {},
 	.pub_led_array = {},
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
+	.led_last = {},
+	.wait_ms = 0,
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+	.work_item = Z_WORK_DELAYABLE_INITIALIZER(rdd2_lighting_work_handler),
+	.active = false,
+#else
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
 	.thread_data = {},
+#endif
 };
 
 static void rdd2_lighting_init(struct context *ctx)
 {
 	zros_node_init(&ctx->node, "rdd2_lighting");
-	zros_sub_init(&ctx->sub_battery_state, &ctx->node, &topic_battery_state,
-		      &ctx->battery_state, 10);
-	zros_sub_init(&ctx->sub_safety, &ctx->node, &topic_safety, &ctx->safety, 10);
-	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
+	// a restarted node shows the current state before the next publish
+	synapse_sub_init_cached(&ctx->sub_battery_state, &ctx->node, &topic_battery_state,
+				&ctx->battery_state, 10);
+	synapse_sub_init_cached(&ctx->sub_safety, &ctx->node, &topic_safety, &ctx->safety, 10);
+	synapse_sub_init_cached(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
 	zros_pub_init(&ctx->pub_led_array, &ctx->node, &topic_led_array, &ctx->led_array);
+	// publish every led again after a restart
+	lighting_led_reset(ctx->led_last, LED_INDEX_MAX);
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("rdd2_lighting init");
 	LOG_INF("init");
 }
 
@@ -91,129 +127,176 @@ static void set_led(const int index, const double *color, const double brightnes
 	led->b = brightness * color[2];
 }
 
-static void rdd2_lighting_run(void *p0, void *p1, void *p2)
+static void rdd2_lighting_update(struct context *ctx)
 {
-	struct context *ctx = p0;
-	ARG_UNUSED(p1);
-	ARG_UNUSED(p2);
-
-	rdd2_lighting_init(ctx);
-
-	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
-
-		// wait 33 ms
-		k_msleep(33);
-
-		// update subscriptions
+	// update subscriptions
+	if (zros_sub_update_available(&ctx->sub_status)) {
 		zros_sub_update(&ctx->sub_status);
+	}
+
+	if (zros_sub_update_available(&ctx->sub_safety)) {
 		zros_sub_update(&ctx->sub_safety);
+	}
+
+	if (zros_sub_update_available(&ctx->sub_battery_state)) {
 		zros_sub_update(&ctx->sub_battery_state);
+	}
 
-		// timing
-		double t = k_uptime_ticks() / ((double)CONFIG_SYS_CLOCK_TICKS_PER_SEC);
-		const double led_pulse_freq = 0.25;
-		const double brightness_min = 4;
-		const double brightness_max = 30;
-		const double brightness_amplitude = (brightness_max - brightness_min) / 2;
-		const double brightness_mean = (brightness_max + brightness_min) / 2;
-
-		int brightness = brightness_mean +
-				 brightness_amplitude * sin(2 * 3.14159 * led_pulse_freq * t);
-		int led_msg_index = 0;
-
-		const int mode_leds[] = {2, 5, 8, 11, 14, 17, 20, 23, 26, 29, 32, 35};
-		const double color_auto[] = {1, 0, 0};
-		const double color_manual[] = {0, 1, 0};
-		const double color_cmd_vel[] = {0, 0, 1};
-		const double color_unknown[] = {0.33, 0.33, 0.33};
-
-		const int arm_leds[] = {1, 4, 7, 10, 13, 16, 19, 22, 25, 28, 31, 34};
-		const double color_armed[] = {1, 0, 0};
-		const double color_disarmed[] = {0, 1, 0};
-
-		const int safety_leds[] = {0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33};
-		const double color_unsafe[] = {1, 0, 0};
-		const double color_safe[] = {0, 1, 0};
-		const double color_battery_critical[] = {1, 0.65, 0};
-		const double color_calibration[] = {1, 1, 0};
-
-		bool battery_critical = ctx->battery_state.voltage <
-					CONFIG_CEREBRI_RDD2_BATTERY_NCELLS *
-						CONFIG_CEREBRI_RDD2_BATTERY_CELL_MIN_MILLIVOLT /
-						1000.0;
-
-		// mode leds
-		for (size_t i = 0; i < ARRAY_SIZE(mode_leds); i++) {
-			const double *color = NULL;
-			if (ctx->status.mode == synapse_pb_Status_Mode_MODE_ATTITUDE) {
-				color = color_manual;
-			} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_VELOCITY) {
-				color = color_cmd_vel;
-			} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_BEZIER) {
-				color = color_auto;
-			} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_CALIBRATION) {
-				color = color_calibration;
+	// timing
+	double t = k_uptime_ticks() / ((double)CONFIG_SYS_CLOCK_TICKS_PER_SEC);
+	int brightness = lighting_pulse_brightness(t, &ctx->wait_ms);
+	int led_msg_index = 0;
+
+	const int mode_leds[] = {2, 5, 8, 11, 14, 17, 20, 23, 26, 29, 32, 35};
+	const double color_auto[] = {1, 0, 0};
+	const double color_manual[] = {0, 1, 0};
+	const double color_cmd_vel[] = {0, 0, 1};
+	const double color_unknown[] = {0.33, 0.33, 0.33};
+
+	const int arm_leds[] = {1, 4, 7, 10, 13, 16, 19, 22, 25, 28, 31, 34};
+	const double color_armed[] = {1, 0, 0};
+	const double color_disarmed[] = {0, 1, 0};
+
+	const int safety_leds[] = {0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33};
+	const double color_unsafe[] = {1, 0, 0};
+	const double color_safe[] = {0, 1, 0};
+	const double color_battery_critical[] = {1, 0.65, 0};
+	const double color_calibration[] = {1, 1, 0};
+
+	bool battery_critical = ctx->battery_state.voltage <
+				CONFIG_CEREBRI_RDD2_BATTERY_NCELLS *
+					CONFIG_CEREBRI_RDD2_BATTERY_CELL_MIN_MILLIVOLT / 1000.0;
+
+	// mode leds
+	for (size_t i = 0; i < ARRAY_SIZE(mode_leds); i++) {
+		const double *color = NULL;
+		if (ctx->status.mode == synapse_pb_Status_Mode_MODE_ATTITUDE) {
+			color = color_manual;
+		} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_VELOCITY) {
+			color = color_cmd_vel;
+		} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_BEZIER) {
+			color = color_auto;
+		} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_CALIBRATION) {
+			color = color_calibration;
+		} else {
+			color = color_unknown;
+		}
+		set_led(mode_leds[i], color, brightness, &ctx->led_array.led[led_msg_index]);
+		led_msg_index++;
+	}
+
+	// arm leds
+	for (size_t i = 0; i < ARRAY_SIZE(arm_leds); i++) {
+		const double *color = NULL;
+		if (battery_critical) {
+			color = color_battery_critical;
+		} else {
+			if (ctx->status.arming == synapse_pb_Status_Arming_ARMING_DISARMED) {
+				color = color_disarmed;
+			} else if (ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED) {
+				color = color_armed;
 			} else {
 				color = color_unknown;
 			}
-			set_led(mode_leds[i], color, brightness,
-				&ctx->led_array.led[led_msg_index]);
-			led_msg_index++;
 		}
+		set_led(arm_leds[i], color, brightness, &ctx->led_array.led[led_msg_index]);
+		led_msg_index++;
+	}
 
-		// arm leds
-		for (size_t i = 0; i < ARRAY_SIZE(arm_leds); i++) {
-			const double *color = NULL;
-			if (battery_critical) {
-				color = color_battery_critical;
-			} else {
-				if (ctx->status.arming ==
-				    synapse_pb_Status_Arming_ARMING_DISARMED) {
-					color = color_disarmed;
-				} else if (ctx->status.arming ==
-					   synapse_pb_Status_Arming_ARMING_ARMED) {
-					color = color_armed;
-				} else {
-					color = color_unknown;
-				}
-			}
-			set_led(arm_leds[i], color, brightness, &ctx->led_array.led[led_msg_index]);
-			led_msg_index++;
+	// safety leds
+	for (size_t i = 0; i < ARRAY_SIZE(safety_leds); i++) {
+		const double *color = NULL;
+		if (ctx->safety.status == synapse_pb_Safety_Status_SAFETY_SAFE) {
+			color = color_safe;
+		} else if (ctx->safety.status == synapse_pb_Safety_Status_SAFETY_UNSAFE) {
+			color = color_unsafe;
+		} else {
+			color = color_unknown;
 		}
+		set_led(safety_leds[i], color, brightness, &ctx->led_array.led[led_msg_index]);
+		led_msg_index++;
+	}
 
-		// safety leds
-		for (size_t i = 0; i < ARRAY_SIZE(safety_leds); i++) {
-			const double *color = NULL;
-			if (ctx->safety.status == synapse_pb_Safety_Status_SAFETY_SAFE) {
-				color = color_safe;
-			} else if (ctx->safety.status == synapse_pb_Safety_Status_SAFETY_UNSAFE) {
-				color = color_unsafe;
-			} else {
-				color = color_unknown;
-			}
-			set_led(safety_leds[i], color, brightness,
-				&ctx->led_array.led[led_msg_index]);
-			led_msg_index++;
+	// keep only the leds that changed
+	int led_changed_count = 0;
+	for (int i = 0; i < led_msg_index; i++) {
+		const synapse_pb_LEDArray_LED *led = &ctx->led_array.led[i];
+		if (lighting_led_changed(ctx->led_last, LED_INDEX_MAX, led->index, led->r, led->g,
+					 led->b)) {
+			ctx->led_array.led[led_changed_count++] = *led;
 		}
+	}
+
+	if (led_changed_count == 0) {
+		return;
+	}
+
+	// set timestamp
+	stamp_msg_now(&ctx->led_array.stamp);
+	ctx->led_array.has_stamp = true;
+	ctx->led_array.led_count = led_changed_count;
+
+	zros_pub_update(&ctx->pub_led_array);
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+static void rdd2_lighting_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct context *ctx = CONTAINER_OF(dwork, struct context, work_item);
+
+	// first run after start, topics are registered by now
+	if (!ctx->active) {
+		rdd2_lighting_init(ctx);
+		ctx->active = true;
+	} else if (k_sem_take(&ctx->running, K_NO_WAIT) == 0) {
+		ctx->active = false;
+		rdd2_lighting_fini(ctx);
+		return;
+	} else {
+		rdd2_lighting_update(ctx);
+	}
 
-		// set timestamp
-		stamp_msg(&ctx->led_array.stamp, k_uptime_ticks());
-		ctx->led_array.has_stamp = true;
-		ctx->led_array.led_count = led_msg_index;
+	k_work_schedule_for_queue(&g_shared_work_q, &ctx->work_item,
+				  K_MSEC(CLAMP(ctx->wait_ms, 1, MAX_WAIT_MS)));
+}
+#else
+static void rdd2_lighting_run(void *p0, void *p1, void *p2)
+{
+	struct context *ctx = p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	rdd2_lighting_init(ctx);
+
+	struct k_poll_event events[] = {
+		*zros_sub_get_event(&ctx->sub_status),
+		*zros_sub_get_event(&ctx->sub_safety),
+		*zros_sub_get_event(&ctx->sub_battery_state),
+	};
+
+	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
+		// wait for a state change or the next pulse step
+		k_poll(events, ARRAY_SIZE(events), K_MSEC(CLAMP(ctx->wait_ms, 1, MAX_WAIT_MS)));
 
-		zros_pub_update(&ctx->pub_led_array);
+		rdd2_lighting_update(ctx);
 	}
 
 	rdd2_lighting_fini(ctx);
 }
+#endif
 
 static int start(struct context *ctx)
 {
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+	k_work_schedule_for_queue(&g_shared_work_q, &ctx->work_item, K_NO_WAIT);
+#else
 	k_tid_t tid =
 		k_thread_create(&ctx->thread_data, ctx->stack_area, ctx->stack_size,
 				rdd2_lighting_run, ctx, NULL, NULL, MY_PRIORITY, 0, K_FOREVER);
 	k_thread_name_set(tid, "rdd2_lighting");
 	k_thread_start(tid);
+#endif
 	return 0;
 }
 
@@ -0,0 +1,150 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdbool.h>
+
+#include <zephyr/logging/log.h>
+
+#include <arm_math.h>
+
+#include <cerebri/core/log_utils.h>
+
+#include "mixer.h"
+
+CEREBRI_NODE_LOG_INIT(rdd2_mixer, LOG_LEVEL_WRN);
+
+#define N RDD2_MOTOR_COUNT
+
+BUILD_ASSERT(DT_HAS_COMPAT_STATUS_OKAY(cerebri_motor_geometry),
+	     "the matrix allocator needs a cerebri,motor-geometry node");
+BUILD_ASSERT(N >= 4, "the matrix allocator needs four rotors or more");
+
+struct rdd2_motor_geometry {
+	float x;
+	float y;
+	// +1 for a counter clockwise propeller, it turns the body clockwise
+	float spin;
+};
+
+#define MOTOR_GEOMETRY(node)                                                                       \
+	{.x = DT_PROP_BY_IDX(node, position_mm, 0) * 1e-3f,                                        \
+	 .y = DT_PROP_BY_IDX(node, position_mm, 1) * 1e-3f,                                        \
+	 .spin = DT_ENUM_IDX(node, spin) == 0 ? 1.0f : -1.0f},
+
+static const struct rdd2_motor_geometry g_motors[] = {
+	DT_FOREACH_CHILD_STATUS_OKAY(RDD2_MIXER_NODE, MOTOR_GEOMETRY)};
+
+// P = (B B^T)^-1 B, rows by axis so rdd2_mixer_run takes each as a vector
+static int rdd2_mixer_build(struct rdd2_mixer *mixer, float km)
+{
+	static float B[RDD2_MIXER_AXES][N], Bt[N][RDD2_MIXER_AXES];
+	static float BBt[RDD2_MIXER_AXES][RDD2_MIXER_AXES], inv[RDD2_MIXER_AXES][RDD2_MIXER_AXES];
+
+	for (int i = 0; i < N; i++) {
+		B[RDD2_MIXER_THRUST][i] = 1.0f;
+		B[RDD2_MIXER_ROLL][i] = g_motors[i].y;
+		B[RDD2_MIXER_PITCH][i] = -g_motors[i].x;
+		B[RDD2_MIXER_YAW][i] = -g_motors[i].spin * km;
+	}
+
+	arm_matrix_instance_f32 mB = {RDD2_MIXER_AXES, N, &B[0][0]};
+	arm_matrix_instance_f32 mBt = {N, RDD2_MIXER_AXES, &Bt[0][0]};
+	arm_matrix_instance_f32 mBBt = {RDD2_MIXER_AXES, RDD2_MIXER_AXES, &BBt[0][0]};
+	arm_matrix_instance_f32 mInv = {RDD2_MIXER_AXES, RDD2_MIXER_AXES, &inv[0][0]};
+	arm_matrix_instance_f32 mP = {RDD2_MIXER_AXES, N, &mixer->P[0][0]};
+
+	if (arm_mat_trans_f32(&mB, &mBt) != ARM_MATH_SUCCESS ||
+	    arm_mat_mult_f32(&mB, &mBt, &mBBt) != ARM_MATH_SUCCESS ||
+	    arm_mat_inverse_f32(&mBBt, &mInv) != ARM_MATH_SUCCESS ||
+	    arm_mat_mult_f32(&mInv, &mB, &mP) != ARM_MATH_SUCCESS) {
+		// a frame that cannot make every axis, e.g. all rotors spinning the same way
+		CEREBRI_LOG_ERR_LIMIT("motor geometry is singular");
+		mixer->km = 0;
+		return -EINVAL;
+	}
+	mixer->km = km;
+	LOG_INF("allocation for %d motors, km %g", N, (double)km);
+	return 0;
+}
+
+static float rdd2_mixer_range(const float *f)
+{
+	float max, min;
+	uint32_t idx;
+	arm_max_f32(f, N, &max, &idx);
+	arm_min_f32(f, N, &min, &idx);
+	return max - min;
+}
+
+int rdd2_mixer_run(struct rdd2_mixer *mixer, float Cm, float Ct, float f_max, float T,
+		   const float M[3], float omega[N])
+{
+	static float f[N], yaw[N];
+	int sat = 0;
+
+	float km = Ct > 0 ? Cm / Ct : 0;
+	// rebuilt when the motor parameters change
+	bool stale = fabsf(mixer->km - km) > 1e-6f * km;
+	if (!(km > 0) || (stale && rdd2_mixer_build(mixer, km) < 0)) {
+		arm_fill_f32(0, omega, N);
+		return RDD2_MIXER_SAT_MOMENT | RDD2_MIXER_SAT_YAW | RDD2_MIXER_SAT_THRUST;
+	}
+
+	// roll and pitch first, scaled as a whole to the motor range so the axis is kept
+	arm_scale_f32(mixer->P[RDD2_MIXER_ROLL], M[0], f, N);
+	arm_scale_f32(mixer->P[RDD2_MIXER_PITCH], M[1], yaw, N);
+	arm_add_f32(f, yaw, f, N);
+	float r0 = rdd2_mixer_range(f);
+	if (r0 > f_max) {
+		arm_scale_f32(f, f_max / r0, f, N);
+		r0 = f_max;
+		sat |= RDD2_MIXER_SAT_MOMENT;
+	}
+
+	/*
+	 * yaw takes what is left, the range is convex in the yaw scale, so the
+	 * scale that brings the chord down to f_max keeps it within
+	 */
+	arm_scale_f32(mixer->P[RDD2_MIXER_YAW], M[2], yaw, N);
+	arm_add_f32(f, yaw, yaw, N);
+	float r1 = rdd2_mixer_range(yaw);
+	if (r1 > f_max) {
+		float a = (f_max - r0) / (r1 - r0);
+		arm_scale_f32(yaw, a, yaw, N);
+		arm_scale_f32(f, 1.0f - a, f, N);
+		arm_add_f32(f, yaw, f, N);
+		sat |= RDD2_MIXER_SAT_YAW;
+	} else {
+		arm_copy_f32(yaw, f, N);
+	}
+
+	// collective thrust is moved last, into the band where no rotor leaves the range
+	const float *u = mixer->P[RDD2_MIXER_THRUST];
+	float lo = -INFINITY;
+	float hi = INFINITY;
+	for (int i = 0; i < N; i++) {
+		if (u[i] > 1e-6f) {
+			lo = MAX(lo, -f[i] / u[i]);
+			hi = MIN(hi, (f_max - f[i]) / u[i]);
+		}
+	}
+	float t = CLAMP(T, lo, MAX(lo, hi));
+	if (T < lo || T > hi) {
+		sat |= RDD2_MIXER_SAT_THRUST;
+	}
+
+	for (int i = 0; i < N; i++) {
+		float fi = CLAMP(f[i] + t * u[i], 0.0f, f_max);
+		omega[i] = sqrtf(fi / Ct);
+	}
+
+	mixer->sat_moment += (sat & RDD2_MIXER_SAT_MOMENT) != 0;
+	mixer->sat_yaw += (sat & RDD2_MIXER_SAT_YAW) != 0;
+	mixer->sat_thrust += (sat & RDD2_MIXER_SAT_THRUST) != 0;
+	return sat;
+}
+
+// vi: ts=4 sw=4 et
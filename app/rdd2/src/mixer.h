@@ -0,0 +1,57 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef RDD2_MIXER_H
+#define RDD2_MIXER_H
+
+#include <stdint.h>
+
+#include <zephyr/devicetree.h>
+#include <zephyr/sys/util.h>
+
+/*
+ * Matrix allocator for any number of rotors, geometry from the
+ * cerebri,motor-geometry node. Rotor thrust f maps to the wrench by
+ * B = [1; y; -x; -spin km] with km = Cm / Ct, the allocator applies its
+ * pseudo inverse, built once per km, axis by axis. Roll and pitch always
+ * fit in the motor range, yaw is scaled down first and collective thrust
+ * is moved second to keep them there.
+ */
+
+#define RDD2_MIXER_NODE DT_INST(0, cerebri_motor_geometry)
+
+#define RDD2_MOTOR_COUNT DT_CHILD_NUM_STATUS_OKAY(RDD2_MIXER_NODE)
+
+// rdd2_mixer_run result bits
+#define RDD2_MIXER_SAT_MOMENT BIT(0)
+#define RDD2_MIXER_SAT_YAW    BIT(1)
+#define RDD2_MIXER_SAT_THRUST BIT(2)
+
+enum rdd2_mixer_axis {
+	RDD2_MIXER_THRUST,
+	RDD2_MIXER_ROLL,
+	RDD2_MIXER_PITCH,
+	RDD2_MIXER_YAW,
+	RDD2_MIXER_AXES,
+};
+
+struct rdd2_mixer {
+	// km the pseudo inverse was built for, 0 before the first run
+	float km;
+	// pseudo inverse by axis, rotor thrust per unit of the wrench
+	float P[RDD2_MIXER_AXES][RDD2_MOTOR_COUNT];
+	uint32_t sat_moment;
+	uint32_t sat_yaw;
+	uint32_t sat_thrust;
+};
+
+/*
+ * rotor speeds for thrust T and moment M, f_max is the thrust of one
+ * rotor at full speed, returns the RDD2_MIXER_SAT_ bits of what was cut
+ */
+int rdd2_mixer_run(struct rdd2_mixer *mixer, float Cm, float Ct, float f_max, float T,
+		   const float M[3], float omega[RDD2_MOTOR_COUNT]);
+
+#endif // RDD2_MIXER_H
+// vi: ts=4 sw=4 et
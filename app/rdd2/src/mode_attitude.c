@@ -4,8 +4,8 @@ LOG_MODULE_DECLARE(rdd2_command, CONFIG_CEREBRI_RDD2_LOG_LEVEL);
 
 void rdd2_mode_attitude(struct context *ctx)
 {
-	double qr[4];
-	double thrust;
+	casadi_real qr[4];
+	casadi_real thrust;
 	{
 		/* input_auto_level:(thrust_trim,thrust_delta,input_aetr[4],q[4])->(q_r[4],thrust)
 		 */
@@ -25,20 +25,20 @@ void rdd2_mode_attitude(struct context *ctx)
 	bool data_ok = true;
 	for (int i = 0; i < 3; i++) {
 		if (!isfinite(qr[i])) {
-			LOG_ERR("qr[%d] not finite: %10.4f", i, qr[i]);
+			CEREBRI_LOG_ERR_LIMIT("qr[%d] not finite: %10.4f", i, qr[i]);
 			data_ok = false;
 			break;
 		}
 	}
 
 	if (!isfinite(thrust)) {
-		LOG_ERR("thrust not finite: %10.4f", thrust);
+		CEREBRI_LOG_ERR_LIMIT("thrust not finite: %10.4f", thrust);
 		data_ok = false;
 	}
 
 	// attitude set point
 	if (data_ok) {
-		stamp_msg(&ctx->attitude_sp.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->attitude_sp.stamp);
 		ctx->attitude_sp.has_stamp = true;
 		ctx->attitude_sp.w = qr[0];
 		ctx->attitude_sp.x = qr[1];
@@ -47,7 +47,7 @@ void rdd2_mode_attitude(struct context *ctx)
 		zros_pub_update(&ctx->pub_attitude_sp);
 
 		// thrust pass through
-		stamp_msg(&ctx->force_sp.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->force_sp.stamp);
 		ctx->force_sp.has_stamp = true;
 		ctx->force_sp.z = thrust;
 		zros_pub_update(&ctx->pub_force_sp);
@@ -4,8 +4,8 @@ LOG_MODULE_DECLARE(rdd2_command, CONFIG_CEREBRI_RDD2_LOG_LEVEL);
 
 void rdd2_mode_attitude_rate(struct context *ctx)
 {
-	double omega[3];
-	double thrust;
+	casadi_real omega[3];
+	casadi_real thrust;
 	{
 		// input_acro:(thrust_trim,thrust_delta,input_aetr[4])->(omega[3],thrust)
 		CASADI_FUNC_ARGS(input_acro);
@@ -23,26 +23,26 @@ void rdd2_mode_attitude_rate(struct context *ctx)
 	bool data_ok = true;
 	for (int i = 0; i < 3; i++) {
 		if (!isfinite(omega[i])) {
-			LOG_ERR("omega[%d] not finite: %10.4f", i, omega[i]);
+			CEREBRI_LOG_ERR_LIMIT("omega[%d] not finite: %10.4f", i, omega[i]);
 			data_ok = false;
 			break;
 		}
 	}
 	if (!isfinite(thrust)) {
-		LOG_ERR("thrust not finite: %10.4f", thrust);
+		CEREBRI_LOG_ERR_LIMIT("thrust not finite: %10.4f", thrust);
 		data_ok = false;
 	}
 
 	if (data_ok) {
 		// angular velocity set point
-		stamp_msg(&ctx->angular_velocity_ff.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->angular_velocity_ff.stamp);
 		ctx->angular_velocity_ff.x = omega[0];
 		ctx->angular_velocity_ff.y = omega[1];
 		ctx->angular_velocity_ff.z = omega[2];
 		zros_pub_update(&ctx->pub_angular_velocity_ff);
 
 		// thrust pass through
-		stamp_msg(&ctx->force_sp.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->force_sp.stamp);
 		ctx->force_sp.z = thrust;
 		zros_pub_update(&ctx->pub_force_sp);
 	}
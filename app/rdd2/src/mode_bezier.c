@@ -2,73 +2,203 @@
 
 LOG_MODULE_DECLARE(rdd2_command, CONFIG_CEREBRI_RDD2_LOG_LEVEL);
 
-void rdd2_mode_bezier(struct context *ctx)
+static uint64_t stamp_to_ns(const synapse_pb_Timestamp *stamp)
 {
-	// goal -> given position goal, find cmd_vel
-	uint64_t time_start_nsec = (ctx->bezier_trajectory.time_start.seconds * 1e9 +
-				    ctx->bezier_trajectory.time_start.nanos);
-	uint64_t time_stop_nsec = time_start_nsec;
+	return (uint64_t)stamp->seconds * 1000000000ULL + stamp->nanos;
+}
 
-	// get current time
-	uint64_t time_nsec = (k_uptime_get() * 1e6 + ctx->clock_offset.offset.seconds * 1e9 +
-			      ctx->clock_offset.offset.nanos);
+#if defined(CONFIG_CEREBRI_RDD2_BEZIER_POWER_BASIS)
+static const uint8_t binomial[8][8] = {
+	{1},
+	{1, 1},
+	{1, 2, 1},
+	{1, 3, 3, 1},
+	{1, 4, 6, 4, 1},
+	{1, 5, 10, 10, 5, 1},
+	{1, 6, 15, 20, 15, 6, 1},
+	{1, 7, 21, 35, 35, 21, 7, 1},
+};
 
-	if (time_nsec < time_start_nsec) {
-		LOG_WRN("time current: %" PRIu64 " ns < time start: %" PRIu64
-			"  ns, time out of range of trajectory\n",
-			time_nsec, time_start_nsec);
-		return;
+// k! / (k - m)!, the factor of t^(k - m) in the m-th derivative of t^k
+static const uint16_t falling[5][8] = {
+	{1, 1, 1, 1, 1, 1, 1, 1},
+	{0, 1, 2, 3, 4, 5, 6, 7},
+	{0, 0, 2, 6, 12, 20, 30, 42},
+	{0, 0, 0, 6, 24, 60, 120, 210},
+	{0, 0, 0, 0, 24, 120, 360, 840},
+};
+
+// power basis in t on [0, T] of the bezier curve with n control points
+static void bezier_to_power(const casadi_real *P, int n, casadi_real T, casadi_real *c)
+{
+	casadi_real T_inv = T > 0 ? 1 / T : 0;
+	casadi_real scale = 1;
+
+	for (int k = 0; k < n; k++) {
+		casadi_real sum = 0;
+		for (int i = 0; i <= k; i++) {
+			casadi_real term = binomial[k][i] * P[i];
+			sum += ((k - i) & 1) ? -term : term;
+		}
+		c[k] = binomial[n - 1][k] * sum * scale;
+		scale *= T_inv;
 	}
+}
 
-	// find current trajectory index, time_start, and time_stop
-	int curve_index = 0;
+// m-th derivative at t of the polynomial with n coefficients
+static casadi_real poly_eval(const casadi_real *c, int n, int m, casadi_real t)
+{
+	casadi_real y = 0;
 
-	while (true) {
+	for (int k = n - 1; k >= m; k--) {
+		y = y * t + c[k] * falling[m][k];
+	}
+	return y;
+}
+#endif
 
-		synapse_pb_BezierTrajectory_Curve *curve =
-			&ctx->bezier_trajectory.curves[curve_index];
-		synapse_pb_BezierTrajectory_Curve *curve_prev =
-			&ctx->bezier_trajectory.curves[curve_index - 1];
+static void bezier_buffer_reset(struct bezier_buffer *buf, uint64_t time_start_ns)
+{
+	buf->time_start_ns = time_start_ns;
+	buf->count = 0;
+	buf->cursor = 0;
+}
 
-		uint64_t curve_stop_nsec = curve->time_stop.seconds * 1e9 + curve->time_stop.nanos;
-		uint64_t curve_stop_prev_nsec =
-			curve_prev->time_stop.seconds * 1e9 + curve_prev->time_stop.nanos;
+// append the curves of a chunk, each segment starts where the previous one stopped
+static void bezier_buffer_append(struct context *ctx, struct bezier_buffer *buf,
+				 const synapse_pb_BezierTrajectory *chunk)
+{
+	uint64_t start_ns =
+		buf->count > 0 ? buf->segments[buf->count - 1].stop_ns : buf->time_start_ns;
 
-		// check if time handled by current trajectory
-		if (time_nsec < curve_stop_nsec) {
-			time_stop_nsec = curve_stop_nsec;
-			if (curve_index > 0) {
-				time_start_nsec = curve_stop_prev_nsec;
-			}
-			break;
+	for (int i = 0; i < chunk->curves_count; i++) {
+		if (buf->count >= CONFIG_CEREBRI_RDD2_BEZIER_SEGMENTS) {
+			ctx->bezier_dropped += chunk->curves_count - i;
+			LOG_WRN("bezier buffer full, dropped %d curves",
+				(int)chunk->curves_count - i);
+			return;
 		}
+		const synapse_pb_BezierTrajectory_Curve *curve = &chunk->curves[i];
+		struct bezier_segment *seg = &buf->segments[buf->count];
+		uint64_t stop_ns = stamp_to_ns(&curve->time_stop);
+		if (stop_ns <= start_ns) {
+			// a resent or out of order chunk, its curves are already buffered or lost
+			ctx->bezier_dropped += chunk->curves_count - i;
+			LOG_WRN("bezier curve ends by %" PRIu64 " ns, dropped %d curves",
+				start_ns, (int)chunk->curves_count - i);
+			return;
+		}
+		seg->start_ns = start_ns;
+		seg->stop_ns = stop_ns;
+		seg->T = (stop_ns - start_ns) * 1e-9;
+#if defined(CONFIG_CEREBRI_RDD2_BEZIER_POWER_BASIS)
+		casadi_real PX[8], PY[8], PZ[8], Ppsi[4];
+#else
+		casadi_real *PX = seg->PX, *PY = seg->PY, *PZ = seg->PZ, *Ppsi = seg->Ppsi;
+#endif
+		for (int j = 0; j < 8; j++) {
+			PX[j] = curve->x[j];
+			PY[j] = curve->y[j];
+			PZ[j] = curve->z[j];
+		}
+		for (int j = 0; j < 4; j++) {
+			Ppsi[j] = curve->yaw[j];
+		}
+#if defined(CONFIG_CEREBRI_RDD2_BEZIER_POWER_BASIS)
+		bezier_to_power(PX, 8, seg->T, seg->cx);
+		bezier_to_power(PY, 8, seg->T, seg->cy);
+		bezier_to_power(PZ, 8, seg->T, seg->cz);
+		bezier_to_power(Ppsi, 4, seg->T, seg->cpsi);
+#endif
+		start_ns = stop_ns;
+		buf->count++;
+	}
+}
 
-		// next index
-		curve_index++;
+void rdd2_bezier_receive(struct context *ctx)
+{
+	const synapse_pb_BezierTrajectory *chunk = &ctx->bezier_trajectory;
+	uint64_t time_start_ns = stamp_to_ns(&chunk->time_start);
+	struct bezier_buffer *buf;
 
-		// check if index exceeds bounds
-		if (curve_index >= ctx->bezier_trajectory.curves_count) {
-			// LOG_DBG("curve index exceeds bounds");
-			// stop(ctx);
-			break;
+	ctx->bezier_chunks++;
+	if (ctx->bezier_front->count > 0 && ctx->bezier_front->time_start_ns == time_start_ns) {
+		// rest of the trajectory being flown, segments past the cursor are not read yet
+		buf = ctx->bezier_front;
+	} else {
+		buf = ctx->bezier_back;
+		if (buf->count == 0 || buf->time_start_ns != time_start_ns) {
+			// first chunk of a new trajectory, replaces any partial one
+			bezier_buffer_reset(buf, time_start_ns);
 		}
 	}
+	bezier_buffer_append(ctx, buf, chunk);
+}
 
-	if (curve_index < ctx->bezier_trajectory.curves_count) {
-		double T = (time_stop_nsec - time_start_nsec) * 1e-9;
-		double t = (time_nsec - time_start_nsec) * 1e-9;
-		double x, y, z, psi, dpsi, ddpsi = 0;
-		double v[3], a[3], j[3], s[3];
-		double PX[8], PY[8], PZ[8], Ppsi[4];
-		for (int i = 0; i < 8; i++) {
-			PX[i] = ctx->bezier_trajectory.curves[curve_index].x[i];
-			PY[i] = ctx->bezier_trajectory.curves[curve_index].y[i];
-			PZ[i] = ctx->bezier_trajectory.curves[curve_index].z[i];
-		}
+// segment covering time_nsec, -1 past the end of the trajectory
+static int bezier_buffer_lookup(struct bezier_buffer *buf, uint64_t time_nsec)
+{
+	if (buf->cursor >= buf->count || time_nsec < buf->segments[buf->cursor].start_ns) {
+		// time stepped back or the end was extended, rescan from the start
+		buf->cursor = 0;
+	}
+	while (buf->cursor < buf->count && time_nsec >= buf->segments[buf->cursor].stop_ns) {
+		buf->cursor++;
+	}
+	return buf->cursor < buf->count ? buf->cursor : -1;
+}
+
+void rdd2_mode_bezier(struct context *ctx)
+{
+	// get current time
+	uint64_t time_nsec = clock_sync_now_ns();
+
+	// the next trajectory takes over once its time_start arrives
+	struct bezier_buffer *back = ctx->bezier_back;
+	if (back->count > 0 && time_nsec >= back->time_start_ns) {
+		ctx->bezier_back = ctx->bezier_front;
+		ctx->bezier_front = back;
+		bezier_buffer_reset(ctx->bezier_back, 0);
+		ctx->bezier_swaps++;
+	}
+
+	struct bezier_buffer *buf = ctx->bezier_front;
+
+	if (buf->count == 0) {
+		return;
+	}
+
+	if (time_nsec < buf->time_start_ns) {
+		LOG_WRN("time current: %" PRIu64 " ns < time start: %" PRIu64
+			"  ns, time out of range of trajectory\n",
+			time_nsec, buf->time_start_ns);
+		return;
+	}
+
+	// goal -> given position goal, find cmd_vel
+	int curve_index = bezier_buffer_lookup(buf, time_nsec);
+
+	if (curve_index >= 0) {
+		struct bezier_segment *seg = &buf->segments[curve_index];
+		casadi_real t = (time_nsec - seg->start_ns) * 1e-9;
+		casadi_real x, y, z, psi, dpsi, ddpsi = 0;
+		casadi_real v[3], a[3], j[3], s[3];
 
-		for (int i = 0; i < 4; i++) {
-			Ppsi[i] = ctx->bezier_trajectory.curves[curve_index].yaw[i];
+#if defined(CONFIG_CEREBRI_RDD2_BEZIER_POWER_BASIS)
+		x = poly_eval(seg->cx, 8, 0, t);
+		y = poly_eval(seg->cy, 8, 0, t);
+		z = poly_eval(seg->cz, 8, 0, t);
+		casadi_real *derivs[] = {v, a, j, s};
+		for (int m = 1; m <= 4; m++) {
+			derivs[m - 1][0] = poly_eval(seg->cx, 8, m, t);
+			derivs[m - 1][1] = poly_eval(seg->cy, 8, m, t);
+			derivs[m - 1][2] = poly_eval(seg->cz, 8, m, t);
 		}
+		psi = poly_eval(seg->cpsi, 4, 0, t);
+		dpsi = poly_eval(seg->cpsi, 4, 1, t);
+		ddpsi = poly_eval(seg->cpsi, 4, 2, t);
+#else
+		casadi_real T = seg->T;
 
 		// bezier_multirotor:(t,T,PX[1x8],PY[1x8],PX[1x8],Ppsi[1x4])
 		// ->(x,y,z,psi,dpsi,ddpsi,V,a,j,s)
@@ -77,10 +207,10 @@ void rdd2_mode_bezier(struct context *ctx)
 
 			args[0] = &t;
 			args[1] = &T;
-			args[2] = PX;
-			args[3] = PY;
-			args[4] = PZ;
-			args[5] = Ppsi;
+			args[2] = seg->PX;
+			args[3] = seg->PY;
+			args[4] = seg->PZ;
+			args[5] = seg->Ppsi;
 
 			res[0] = &x;
 			res[1] = &y;
@@ -95,8 +225,9 @@ void rdd2_mode_bezier(struct context *ctx)
 
 			CASADI_FUNC_CALL(bezier_multirotor);
 		}
+#endif
 
-		double v_b[3], q_att[4], omega[3], omega_dot[3], M[3], Thrust;
+		casadi_real v_b[3], q_att[4], omega[3], omega_dot[3], M[3], Thrust;
 		// world to body
 		// f_ref:(psi,psi_dot,psi_ddot,v_e[3],a_e[3],j_e[3],s_e[3])
 		// ->(v_b[3],quat[4],omega_eb_b[3],omega_dot_eb_b[3],M_b[3],T)
@@ -122,11 +253,18 @@ void rdd2_mode_bezier(struct context *ctx)
 		}
 
 		/* euler to quat */
-		double q_orientation[4];
+		casadi_real q_orientation[4];
+#if defined(CONFIG_CEREBRI_RDD2_BEZIER_POWER_BASIS)
+		// yaw only, so the 321 rotation reduces to one about z
+		q_orientation[0] = cos(psi / 2);
+		q_orientation[1] = 0;
+		q_orientation[2] = 0;
+		q_orientation[3] = sin(psi / 2);
+#else
 		{
 			CASADI_FUNC_ARGS(eulerB321_to_quat);
-			double phi = 0;
-			double theta = 0;
+			casadi_real phi = 0;
+			casadi_real theta = 0;
 			args[0] = &psi;
 			args[1] = &theta;
 			args[2] = &phi;
@@ -134,9 +272,10 @@ void rdd2_mode_bezier(struct context *ctx)
 			res[0] = q_orientation;
 			CASADI_FUNC_CALL(eulerB321_to_quat);
 		}
+#endif
 
 		// position sp
-		stamp_msg(&ctx->position_sp.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->position_sp.stamp);
 		ctx->position_sp.has_stamp = true;
 		ctx->position_sp.x = x;
 		ctx->position_sp.y = y;
@@ -144,7 +283,7 @@ void rdd2_mode_bezier(struct context *ctx)
 		zros_pub_update(&ctx->pub_position_sp);
 
 		// velocity sp
-		stamp_msg(&ctx->velocity_sp.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->velocity_sp.stamp);
 		ctx->velocity_sp.has_stamp = true;
 		ctx->velocity_sp.x = v[0];
 		ctx->velocity_sp.y = v[1];
@@ -152,7 +291,7 @@ void rdd2_mode_bezier(struct context *ctx)
 		zros_pub_update(&ctx->pub_velocity_sp);
 
 		// acceleration sp
-		stamp_msg(&ctx->accel_sp.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->accel_sp.stamp);
 		ctx->accel_sp.has_stamp = true;
 		ctx->accel_sp.x = a[0];
 		ctx->accel_sp.y = a[1];
@@ -166,7 +305,7 @@ void rdd2_mode_bezier(struct context *ctx)
 		// ctx->attitude_sp.z = q_att[3];
 
 		// angular velocity ff
-		stamp_msg(&ctx->angular_velocity_ff.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->angular_velocity_ff.stamp);
 		ctx->angular_velocity_ff.has_stamp = true;
 		ctx->angular_velocity_ff.x = omega[0];
 		ctx->angular_velocity_ff.y = omega[1];
@@ -174,7 +313,7 @@ void rdd2_mode_bezier(struct context *ctx)
 		zros_pub_update(&ctx->pub_angular_velocity_ff);
 
 		// moment ff
-		stamp_msg(&ctx->moment_ff.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->moment_ff.stamp);
 		ctx->moment_ff.has_stamp = true;
 		ctx->moment_ff.x = M[0];
 		ctx->moment_ff.y = M[1];
@@ -182,7 +321,7 @@ void rdd2_mode_bezier(struct context *ctx)
 		zros_pub_update(&ctx->pub_moment_ff);
 
 		// orientation sp
-		stamp_msg(&ctx->orientation_sp.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->orientation_sp.stamp);
 		ctx->orientation_sp.has_stamp = true;
 		ctx->orientation_sp.w = q_orientation[0];
 		ctx->orientation_sp.x = q_orientation[1];
@@ -16,7 +16,7 @@ void rdd2_mode_velocity(struct context *ctx)
 		ctx->position_sp.z = ctx->odometry_estimator.pose.position.z;
 
 		// Get current yaw from quaternion for reset
-		double yaw, pitch, roll;
+		casadi_real yaw, pitch, roll;
 		{
 			CASADI_FUNC_ARGS(quat_to_eulerB321);
 			args[0] = ctx->q;
@@ -28,8 +28,8 @@ void rdd2_mode_velocity(struct context *ctx)
 		ctx->psi_sp = yaw;
 	}
 
-	double yaw_rate = 0;
-	double vt_b[3];
+	casadi_real yaw_rate = 0;
+	casadi_real vt_b[3];
 
 	if (ctx->status.topic_source == synapse_pb_Status_TopicSource_TOPIC_SOURCE_INPUT) {
 
@@ -55,17 +55,17 @@ void rdd2_mode_velocity(struct context *ctx)
 		// vt_b[1], vt_b[2]);
 	}
 
-	double pw[3] = {ctx->odometry_estimator.pose.position.x,
-			ctx->odometry_estimator.pose.position.y,
-			ctx->odometry_estimator.pose.position.z};
-	double pw_sp[3] = {
+	casadi_real pw[3] = {ctx->odometry_estimator.pose.position.x,
+			     ctx->odometry_estimator.pose.position.y,
+			     ctx->odometry_estimator.pose.position.z};
+	casadi_real pw_sp[3] = {
 		ctx->position_sp.x,
 		ctx->position_sp.y,
 		ctx->position_sp.z,
 	};
-	double vw_sp[3], aw_sp[3];
-	double reset_position = 0;
-	double q_sp[4];
+	casadi_real vw_sp[3], aw_sp[3];
+	casadi_real reset_position = 0;
+	casadi_real q_sp[4];
 	{
 		// velocity_control:(dt,psi_sp,pw_sp[3],
 		//   pw[3],vb[3],psi_vel_sp,reset_position)
@@ -92,7 +92,7 @@ void rdd2_mode_velocity(struct context *ctx)
 	// LOG_INF("psi_sp1: %10.4f", psi_sp1);
 
 	// position setpoint
-	stamp_msg(&ctx->position_sp.stamp, k_uptime_ticks());
+	stamp_msg_now(&ctx->position_sp.stamp);
 	ctx->position_sp.has_stamp = true;
 	ctx->position_sp.x = pw_sp[0];
 	ctx->position_sp.y = pw_sp[1];
@@ -100,7 +100,7 @@ void rdd2_mode_velocity(struct context *ctx)
 	zros_pub_update(&ctx->pub_position_sp);
 
 	// velocity setpoint
-	stamp_msg(&ctx->velocity_sp.stamp, k_uptime_ticks());
+	stamp_msg_now(&ctx->velocity_sp.stamp);
 	ctx->velocity_sp.has_stamp = true;
 	ctx->velocity_sp.x = vw_sp[0];
 	ctx->velocity_sp.y = vw_sp[1];
@@ -108,7 +108,7 @@ void rdd2_mode_velocity(struct context *ctx)
 	zros_pub_update(&ctx->pub_velocity_sp);
 
 	// orientation setpoint (from input_velocity function)
-	stamp_msg(&ctx->orientation_sp.stamp, k_uptime_ticks());
+	stamp_msg_now(&ctx->orientation_sp.stamp);
 	ctx->orientation_sp.has_stamp = true;
 	ctx->orientation_sp.w = q_sp[0];
 	ctx->orientation_sp.x = q_sp[1];
@@ -117,7 +117,7 @@ void rdd2_mode_velocity(struct context *ctx)
 	zros_pub_update(&ctx->pub_orientation_sp);
 
 	// acceleration setpoint
-	stamp_msg(&ctx->accel_sp.stamp, k_uptime_ticks());
+	stamp_msg_now(&ctx->accel_sp.stamp);
 	ctx->accel_sp.has_stamp = true;
 	ctx->accel_sp.x = aw_sp[0];
 	ctx->accel_sp.y = aw_sp[1];
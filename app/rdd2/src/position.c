@@ -17,18 +17,27 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
 #include "app/rdd2/casadi/rdd2.h"
+#include "app/rdd2/casadi/rdd2_loglinear.h"
 
+#include <cerebri/core/boot.h>
 #include <cerebri/core/casadi.h>
 #include <cerebri/core/log_utils.h>
 
-#define MY_STACK_SIZE 3072
-#define MY_PRIORITY   4
+#include "gains.h"
+#include "variant.h"
+
+#define MY_STACK_SIZE  3072
+#define MY_PRIORITY    4
+#define RATE_HZ        CONFIG_CEREBRI_RDD2_POSITION_RATE_HZ
+#define EXTRAPOLATE_MS CONFIG_CEREBRI_RDD2_POSITION_EXTRAPOLATE_MS
+// a longer gap is integrated as this long, so a stall does not wind up the altitude integral
+#define DT_MAX         (4.0 / RATE_HZ)
 
 CEREBRI_NODE_LOG_INIT(rdd2_position, LOG_LEVEL_WRN);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
-static const double thrust_trim = CONFIG_CEREBRI_RDD2_THRUST_TRIM * 1e-3;
+static const casadi_real thrust_trim = CONFIG_CEREBRI_RDD2_THRUST_TRIM * 1e-3;
 
 struct context {
 	struct zros_node node;
@@ -39,6 +48,11 @@ struct context {
 	struct zros_sub sub_status, sub_position_sp, sub_velocity_sp, sub_accel_sp,
 		sub_odometry_estimator, sub_orientation_sp;
 	struct zros_pub pub_force_sp, pub_attitude_sp;
+	int64_t odometry_stamp_ns;
+	// loop timing and the oldest setpoint extrapolated, for the status command
+	uint32_t runs;
+	double dt, dt_max, sp_age_max;
+	struct rdd2_variant variant;
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -68,20 +82,36 @@ static struct context g_ctx = {
 	.thread_data = {},
 };
 
+static const char *const g_variant_perf_names[RDD2_VARIANT_COUNT] = {
+	[RDD2_VARIANT_STANDARD] = "rdd2_position standard",
+	[RDD2_VARIANT_LOG_LINEAR] = "rdd2_position log_linear",
+};
+
 static void rdd2_position_init(struct context *ctx)
 {
 	zros_node_init(&ctx->node, "rdd2_position");
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
-	zros_sub_init(&ctx->sub_position_sp, &ctx->node, &topic_position_sp, &ctx->position_sp, 10);
-	zros_sub_init(&ctx->sub_velocity_sp, &ctx->node, &topic_velocity_sp, &ctx->velocity_sp, 10);
-	zros_sub_init(&ctx->sub_accel_sp, &ctx->node, &topic_accel_sp, &ctx->accel_sp, 10);
+	// every setpoint the command node sends, the odometry paces the loop at its rate
+	zros_sub_init(&ctx->sub_position_sp, &ctx->node, &topic_position_sp, &ctx->position_sp,
+		      RATE_HZ);
+	zros_sub_init(&ctx->sub_velocity_sp, &ctx->node, &topic_velocity_sp, &ctx->velocity_sp,
+		      RATE_HZ);
+	zros_sub_init(&ctx->sub_accel_sp, &ctx->node, &topic_accel_sp, &ctx->accel_sp, RATE_HZ);
 	zros_sub_init(&ctx->sub_odometry_estimator, &ctx->node, &topic_odometry_estimator,
-		      &ctx->odometry_estimator, 10);
+		      &ctx->odometry_estimator, RATE_HZ);
 	zros_sub_init(&ctx->sub_orientation_sp, &ctx->node, &topic_orientation_sp,
-		      &ctx->orientation_sp, 10);
+		      &ctx->orientation_sp, RATE_HZ);
 	zros_pub_init(&ctx->pub_force_sp, &ctx->node, &topic_force_sp, &ctx->force_sp);
 	zros_pub_init(&ctx->pub_attitude_sp, &ctx->node, &topic_attitude_sp, &ctx->attitude_sp);
+	ctx->odometry_stamp_ns = 0;
+	ctx->runs = 0;
+	ctx->dt_max = 0;
+	ctx->sp_age_max = 0;
+	rdd2_variant_init(&ctx->variant, g_variant_perf_names,
+			  PARAM_GET(rdd2_control, struct rdd2_control_param)->position,
+			  1.0 / RATE_HZ);
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("rdd2_position init");
 	LOG_INF("init");
 }
 
@@ -95,11 +125,72 @@ static void rdd2_position_fini(struct context *ctx)
 	zros_sub_fini(&ctx->sub_orientation_sp);
 	zros_pub_fini(&ctx->pub_force_sp);
 	zros_pub_fini(&ctx->pub_attitude_sp);
+	rdd2_variant_fini(&ctx->variant);
 	zros_node_fini(&ctx->node);
 	k_sem_give(&ctx->running);
 	LOG_INF("fini");
 }
 
+static int64_t stamp_ns(const synapse_pb_Timestamp *stamp)
+{
+	return stamp->seconds * NSEC_PER_SEC + stamp->nanos;
+}
+
+/*
+ * time since a setpoint was sent, the command node repeats them at its own
+ * rate and in between they are carried along their derivative, capped so a
+ * sender that stopped is held rather than flown away from
+ */
+static casadi_real setpoint_age(struct context *ctx, bool has_stamp,
+				const synapse_pb_Timestamp *stamp, int64_t now_ns)
+{
+	if (!has_stamp || EXTRAPOLATE_MS == 0) {
+		return 0;
+	}
+	casadi_real age = (now_ns - stamp_ns(stamp)) * 1e-9;
+	if (age < 0) {
+		return 0;
+	}
+	ctx->sp_age_max = MAX(ctx->sp_age_max, age);
+	return MIN(age, EXTRAPOLATE_MS * 1e-3);
+}
+
+// the odometry stamps, the wakeup time when the estimator does not stamp
+static casadi_real rdd2_position_dt(struct context *ctx, int64_t *ticks_last)
+{
+	int64_t ticks_now = k_uptime_ticks();
+	casadi_real dt = (double)(ticks_now - *ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+	*ticks_last = ticks_now;
+
+	if (ctx->odometry_estimator.has_stamp) {
+		int64_t now_ns = stamp_ns(&ctx->odometry_estimator.stamp);
+		if (ctx->odometry_stamp_ns != 0 && now_ns > ctx->odometry_stamp_ns) {
+			dt = (now_ns - ctx->odometry_stamp_ns) * 1e-9;
+		}
+		ctx->odometry_stamp_ns = now_ns;
+	}
+	return dt;
+}
+
+// moves q from the setpoint of the variant blended out, nlerp on the near hemisphere
+static void rdd2_position_blend(casadi_real q[4], const casadi_real q_prev[4], double weight)
+{
+	double dot = 0;
+	for (int i = 0; i < 4; i++) {
+		dot += q[i] * q_prev[i];
+	}
+	double sign = dot < 0 ? -1 : 1;
+	double norm = 0;
+	for (int i = 0; i < 4; i++) {
+		q[i] = weight * q[i] + (1 - weight) * sign * q_prev[i];
+		norm += q[i] * q[i];
+	}
+	norm = sqrt(norm);
+	for (int i = 0; norm > 1e-6 && i < 4; i++) {
+		q[i] /= norm;
+	}
+}
+
 static void rdd2_position_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -112,15 +203,15 @@ static void rdd2_position_run(void *p0, void *p1, void *p2)
 		*zros_sub_get_event(&ctx->sub_odometry_estimator),
 	};
 
-	double dt = 0;
+	casadi_real dt = 0;
 	int64_t ticks_last = k_uptime_ticks();
-	double z_i = 0; // altitude error integral
+	casadi_real z_i = 0; // altitude error integral
 
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 		int rc = 0;
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
 		if (rc != 0) {
-			LOG_DBG("pos not receiving  pose");
+			CEREBRI_LOG_DBG_LIMIT("pos not receiving  pose");
 			continue;
 		}
 
@@ -133,12 +224,14 @@ static void rdd2_position_run(void *p0, void *p1, void *p2)
 		zros_sub_update(&ctx->sub_odometry_estimator);
 
 		// calculate dt
-		int64_t ticks_now = k_uptime_ticks();
-		dt = (double)(ticks_now - ticks_last) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-		ticks_last = ticks_now;
+		dt = rdd2_position_dt(ctx, &ticks_last);
 		if (dt < 0 || dt > 0.5) {
-			LOG_WRN("position update rate too low: %10.4f", dt);
+			CEREBRI_LOG_WRN_LIMIT("position update rate too low: %10.4f", dt);
 		}
+		ctx->runs++;
+		ctx->dt = dt;
+		ctx->dt_max = MAX(ctx->dt_max, dt);
+		dt = CLAMP(dt, 0, DT_MAX);
 
 		if (ctx->status.mode == synapse_pb_Status_Mode_MODE_POSITION ||
 		    ctx->status.mode == synapse_pb_Status_Mode_MODE_VELOCITY ||
@@ -146,33 +239,42 @@ static void rdd2_position_run(void *p0, void *p1, void *p2)
 		    ctx->status.mode == synapse_pb_Status_Mode_MODE_BEZIER) {
 
 			// vehicle state
-			double p_w[3] = {ctx->odometry_estimator.pose.position.x,
-					 ctx->odometry_estimator.pose.position.y,
-					 ctx->odometry_estimator.pose.position.z};
+			casadi_real p_w[3] = {ctx->odometry_estimator.pose.position.x,
+					      ctx->odometry_estimator.pose.position.y,
+					      ctx->odometry_estimator.pose.position.z};
+
+			casadi_real v_b[3] = {ctx->odometry_estimator.twist.linear.x,
+					      ctx->odometry_estimator.twist.linear.y,
+					      ctx->odometry_estimator.twist.linear.z};
 
-			double v_b[3] = {ctx->odometry_estimator.twist.linear.x,
-					 ctx->odometry_estimator.twist.linear.y,
-					 ctx->odometry_estimator.twist.linear.z};
+			casadi_real q_wb[4] = {ctx->odometry_estimator.pose.orientation.w,
+					       ctx->odometry_estimator.pose.orientation.x,
+					       ctx->odometry_estimator.pose.orientation.y,
+					       ctx->odometry_estimator.pose.orientation.z};
 
-			double q_wb[4] = {ctx->odometry_estimator.pose.orientation.w,
-					  ctx->odometry_estimator.pose.orientation.x,
-					  ctx->odometry_estimator.pose.orientation.y,
-					  ctx->odometry_estimator.pose.orientation.z};
+			// vehicle setpoint, at the control time, position along the velocity
+			// setpoint and velocity along the acceleration
+			int64_t now_ns = synapse_now_ns();
+			casadi_real age_p = setpoint_age(ctx, ctx->position_sp.has_stamp,
+							 &ctx->position_sp.stamp, now_ns);
+			casadi_real age_v = setpoint_age(ctx, ctx->velocity_sp.has_stamp,
+							 &ctx->velocity_sp.stamp, now_ns);
 
-			// vehicle setpoint
-			double pt_w[3] = {ctx->position_sp.x, ctx->position_sp.y,
-					  ctx->position_sp.z};
+			casadi_real at_w[3] = {ctx->accel_sp.x, ctx->accel_sp.y, ctx->accel_sp.z};
 
-			double vt_w[3] = {ctx->velocity_sp.x, ctx->velocity_sp.y,
-					  ctx->velocity_sp.z};
+			casadi_real vt_w[3] = {ctx->velocity_sp.x + at_w[0] * age_v,
+					       ctx->velocity_sp.y + at_w[1] * age_v,
+					       ctx->velocity_sp.z + at_w[2] * age_v};
 
-			double at_w[3] = {ctx->accel_sp.x, ctx->accel_sp.y, ctx->accel_sp.z};
+			casadi_real pt_w[3] = {ctx->position_sp.x + ctx->velocity_sp.x * age_p,
+					       ctx->position_sp.y + ctx->velocity_sp.y * age_p,
+					       ctx->position_sp.z + ctx->velocity_sp.z * age_p};
 
 			// vehicle camera setpoint
-			double qc_wb[4] = {ctx->orientation_sp.w, ctx->orientation_sp.x,
-					   ctx->orientation_sp.y, ctx->orientation_sp.z};
+			casadi_real qc_wb[4] = {ctx->orientation_sp.w, ctx->orientation_sp.x,
+						ctx->orientation_sp.y, ctx->orientation_sp.z};
 
-			double v_w[3];
+			casadi_real v_w[3];
 			{
 				// rotate_vector_b_to_w:(q[4],v_b[3])->(v_w[3])
 				CASADI_FUNC_ARGS(rotate_vector_b_to_w)
@@ -185,14 +287,21 @@ static void rdd2_position_run(void *p0, void *p1, void *p2)
 				CASADI_FUNC_CALL(rotate_vector_b_to_w)
 			}
 
-			// output
-			double nT; // thrust
-			double qr_wb[4];
-
-			{
+			// output of each variant, they share the altitude integral
+			casadi_real nT_v[RDD2_VARIANT_COUNT]; // thrust
+			casadi_real qr_v[RDD2_VARIANT_COUNT][4];
+			casadi_real z_i_v[RDD2_VARIANT_COUNT];
+			struct rdd2_variant *variant = &ctx->variant;
+			const struct rdd2_control_param *control =
+				PARAM_GET(rdd2_control, struct rdd2_control_param);
+			bool armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
+			double weight = rdd2_variant_update(variant, control->position, armed);
+
+			if (rdd2_variant_runs(variant, RDD2_VARIANT_STANDARD)) {
 				// position_control:(thrust_trim,pt_w[3],vt_w[3],at_w[3],
 				// qc_wb[4],p_w[3],v_w[3],z_i,dt)->(nT,qr_wb[4],z_i_2)
 				CASADI_FUNC_ARGS(position_control)
+				perf_duration_start(&variant->perf[RDD2_VARIANT_STANDARD]);
 
 				args[0] = &thrust_trim;
 				args[1] = pt_w;
@@ -204,24 +313,89 @@ static void rdd2_position_run(void *p0, void *p1, void *p2)
 				args[7] = &z_i;
 				args[8] = &dt;
 
-				res[0] = &nT;
-				res[1] = qr_wb;
-				res[2] = &z_i;
+				res[0] = &nT_v[RDD2_VARIANT_STANDARD];
+				res[1] = qr_v[RDD2_VARIANT_STANDARD];
+				res[2] = &z_i_v[RDD2_VARIANT_STANDARD];
 
 				CASADI_FUNC_CALL(position_control)
+				perf_duration_stop(&variant->perf[RDD2_VARIANT_STANDARD]);
+			}
+
+			if (rdd2_variant_runs(variant, RDD2_VARIANT_LOG_LINEAR)) {
+				perf_duration_start(&variant->perf[RDD2_VARIANT_LOG_LINEAR]);
+				const struct rdd2_attitude_param *param =
+					PARAM_GET(rdd2_attitude, struct rdd2_attitude_param);
+				casadi_real zeta[9]; // se23 error
+
+				{
+					// se23_error:(p_w[3],v_w[3],q_wb[4],p_rw[3],v_rw[3],
+					// q_r[4])->(zeta[9]), the attitude is left to its own loop
+					CASADI_FUNC_ARGS(se23_error)
+
+					args[0] = p_w;
+					args[1] = v_w;
+					args[2] = q_wb;
+					args[3] = pt_w;
+					args[4] = vt_w;
+					args[5] = q_wb;
+
+					res[0] = zeta;
+
+					CASADI_FUNC_CALL(se23_error)
+				}
+
+				{
+					// se23_position_control:(thrust_trim,kp[3],zeta[9],at_w[3],
+					// qc_wb[4],z_i,dt)->(nT,qr_wb[4],z_i_2)
+					CASADI_FUNC_ARGS(se23_position_control)
+
+					args[0] = &thrust_trim;
+					args[1] = param->kp;
+					args[2] = zeta;
+					args[3] = at_w;
+					args[4] = qc_wb;
+					args[5] = &z_i;
+					args[6] = &dt;
+
+					res[0] = &nT_v[RDD2_VARIANT_LOG_LINEAR];
+					res[1] = qr_v[RDD2_VARIANT_LOG_LINEAR];
+					res[2] = &z_i_v[RDD2_VARIANT_LOG_LINEAR];
+
+					CASADI_FUNC_CALL(se23_position_control)
+				}
+				perf_duration_stop(&variant->perf[RDD2_VARIANT_LOG_LINEAR]);
+			}
+
+			// the variant in control carries the integral on
+			z_i = z_i_v[variant->active];
+			double ep_sq = 0;
+			for (int i = 0; i < 3; i++) {
+				ep_sq += (p_w[i] - pt_w[i]) * (p_w[i] - pt_w[i]);
+			}
+			rdd2_variant_track(variant, sqrt(ep_sq));
+
+			casadi_real nT = nT_v[variant->active];
+			casadi_real qr_wb[4];
+			for (int i = 0; i < 4; i++) {
+				qr_wb[i] = qr_v[variant->active][i];
+			}
+			if (weight < 1) {
+				rdd2_position_blend(qr_wb, qr_v[variant->previous], weight);
+				nT = weight * nT + (1 - weight) * nT_v[variant->previous];
 			}
 
 			bool data_ok = true;
 			for (int i = 0; i < 4; i++) {
 				if (!isfinite(qr_wb[i])) {
-					LOG_ERR("qr_wb[%d] not finite: %10.4f", i, qr_wb[i]);
+					CEREBRI_LOG_ERR_LIMIT("qr_wb[%d] not finite: %10.4f", i,
+							      qr_wb[i]);
 					data_ok = false;
 					break;
 				}
 			}
 
 			if (!isfinite(nT)) {
-				LOG_ERR("nT not finite: %10.4f", nT);
+				CEREBRI_LOG_ERR_LIMIT("nT not finite: %10.4f", nT);
 				data_ok = false;
 			}
 
@@ -232,7 +406,7 @@ static void rdd2_position_run(void *p0, void *p1, void *p2)
 				LOG_DBG("ep_w: %10.4f %10.4f %10.4f", p_w[0] - pt_w[0],
 					p_w[1] - pt_w[1], p_w[2] - pt_w[2]);
 
-				stamp_msg(&ctx->attitude_sp.stamp, k_uptime_ticks());
+				stamp_msg_now(&ctx->attitude_sp.stamp);
 				ctx->attitude_sp.has_stamp = true;
 				ctx->attitude_sp.w = qr_wb[0];
 				ctx->attitude_sp.x = qr_wb[1];
@@ -240,7 +414,7 @@ static void rdd2_position_run(void *p0, void *p1, void *p2)
 				ctx->attitude_sp.z = qr_wb[3];
 				zros_pub_update(&ctx->pub_attitude_sp);
 
-				stamp_msg(&ctx->force_sp.stamp, k_uptime_ticks());
+				stamp_msg_now(&ctx->force_sp.stamp);
 				ctx->force_sp.has_stamp = true;
 				ctx->force_sp.z = nT;
 				zros_pub_update(&ctx->pub_force_sp);
@@ -279,6 +453,11 @@ static int rdd2_position_cmd_handler(const struct shell *sh, size_t argc, char *
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		shell_print(sh, "runs: %u rate: %d Hz dt: %.4f max: %.4f s", ctx->runs, RATE_HZ,
+			    ctx->dt, ctx->dt_max);
+		shell_print(sh, "setpoint age max: %.1f ms, extrapolated up to %d ms",
+			    ctx->sp_age_max * 1e3, EXTRAPOLATE_MS);
+		rdd2_variant_status(&ctx->variant, sh);
 	}
 	return 0;
 }
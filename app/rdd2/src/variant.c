@@ -0,0 +1,100 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "variant.h"
+
+#define BLEND_TICKS k_ms_to_ticks_ceil64(CONFIG_CEREBRI_RDD2_VARIANT_BLEND_MS)
+
+static const char *const g_variant_names[RDD2_VARIANT_COUNT] = {
+	[RDD2_VARIANT_STANDARD] = "standard",
+	[RDD2_VARIANT_LOG_LINEAR] = "log_linear",
+};
+
+const char *rdd2_variant_name(enum rdd2_variant_id id)
+{
+	return id < RDD2_VARIANT_COUNT ? g_variant_names[id] : "unknown";
+}
+
+static enum rdd2_variant_id rdd2_variant_valid(int32_t selected, enum rdd2_variant_id current)
+{
+	if (selected < 0 || selected >= RDD2_VARIANT_COUNT) {
+		return current;
+	}
+	return (enum rdd2_variant_id)selected;
+}
+
+void rdd2_variant_init(struct rdd2_variant *variant, const char *const names[RDD2_VARIANT_COUNT],
+		       int32_t selected, double deadline_sec)
+{
+	variant->active = rdd2_variant_valid(selected, RDD2_VARIANT_STANDARD);
+	variant->previous = variant->active;
+	variant->switch_ticks = 0;
+	variant->weight = 1;
+	variant->switches = 0;
+	for (int i = 0; i < RDD2_VARIANT_COUNT; i++) {
+		perf_duration_init(&variant->perf[i], names[i], deadline_sec);
+		variant->error_sq_sum[i] = 0;
+		variant->error_count[i] = 0;
+	}
+}
+
+void rdd2_variant_fini(struct rdd2_variant *variant)
+{
+	for (int i = 0; i < RDD2_VARIANT_COUNT; i++) {
+		perf_duration_fini(&variant->perf[i]);
+	}
+}
+
+double rdd2_variant_update(struct rdd2_variant *variant, int32_t selected, bool armed)
+{
+	enum rdd2_variant_id next = rdd2_variant_valid(selected, variant->active);
+	int64_t now = k_uptime_ticks();
+
+	if (next != variant->active) {
+		// a switch back during a blend picks the ramp up where the output is now
+		double weight = next == variant->previous ? 1 - variant->weight : 0;
+		variant->previous = variant->active;
+		variant->active = next;
+		variant->switch_ticks = now - (int64_t)(weight * BLEND_TICKS);
+		variant->switches++;
+		variant->weight = armed && BLEND_TICKS > 0 ? weight : 1;
+	}
+	if (variant->weight < 1) {
+		double blend = (double)(now - variant->switch_ticks) / MAX(BLEND_TICKS, 1);
+		variant->weight = armed ? MIN(blend, 1) : 1;
+	}
+	return variant->weight;
+}
+
+void rdd2_variant_track(struct rdd2_variant *variant, double error)
+{
+	if (!isfinite(error)) {
+		return;
+	}
+	variant->error_sq_sum[variant->active] += error * error;
+	variant->error_count[variant->active]++;
+}
+
+void rdd2_variant_status(const struct rdd2_variant *variant, const struct shell *sh)
+{
+	shell_print(sh, "variant: %s weight: %.2f switches: %u", rdd2_variant_name(variant->active),
+		    variant->weight, variant->switches);
+	for (int i = 0; i < RDD2_VARIANT_COUNT; i++) {
+		const struct perf_duration *perf = &variant->perf[i];
+		uint64_t avg_cyc = perf->count > 0 ? perf->delta_cyc_sum / perf->count : 0;
+		uint32_t n = variant->error_count[i];
+		double rms = n > 0 ? sqrt(variant->error_sq_sum[i] / n) : 0;
+		shell_print(sh, "  %-10s runs: %llu avg: %llu max: %u cyc, error rms: %.4f over %u",
+			    g_variant_names[i], (unsigned long long)perf->count,
+			    (unsigned long long)avg_cyc, perf->max_duration_cyc, rms, n);
+	}
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,68 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef RDD2_VARIANT_H
+#define RDD2_VARIANT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cerebri/core/perf_duration.h>
+
+/*
+ * Controller variants linked into one node, picked at runtime with the
+ * rdd2_control parameters. Disarmed a new variant takes over at once,
+ * armed both run for CONFIG_CEREBRI_RDD2_VARIANT_BLEND_MS and the node
+ * blends their outputs with the weight rdd2_variant_update returns.
+ * Each variant times its own iterations with a perf_duration and sums
+ * the tracking error of the iterations it was in control of, so the
+ * cost and quality of both can be compared on the same airframe.
+ */
+
+struct shell;
+
+enum rdd2_variant_id {
+	RDD2_VARIANT_STANDARD,
+	RDD2_VARIANT_LOG_LINEAR,
+	RDD2_VARIANT_COUNT,
+};
+
+struct rdd2_variant {
+	// variant in control, and the one blended out while weight < 1
+	enum rdd2_variant_id active;
+	enum rdd2_variant_id previous;
+	int64_t switch_ticks;
+	double weight;
+	uint32_t switches;
+	struct perf_duration perf[RDD2_VARIANT_COUNT];
+	double error_sq_sum[RDD2_VARIANT_COUNT];
+	uint32_t error_count[RDD2_VARIANT_COUNT];
+};
+
+const char *rdd2_variant_name(enum rdd2_variant_id id);
+
+// names[] are the perf_duration names, static strings one per variant
+void rdd2_variant_init(struct rdd2_variant *variant, const char *const names[RDD2_VARIANT_COUNT],
+		       int32_t selected, double deadline_sec);
+
+void rdd2_variant_fini(struct rdd2_variant *variant);
+
+/*
+ * take the selection once per iteration, returns the weight of the
+ * active variant, below 1 while the previous one must still run
+ */
+double rdd2_variant_update(struct rdd2_variant *variant, int32_t selected, bool armed);
+
+static inline bool rdd2_variant_runs(const struct rdd2_variant *variant, enum rdd2_variant_id id)
+{
+	return id == variant->active || (variant->weight < 1 && id == variant->previous);
+}
+
+// the tracking error of this iteration, counted for the variant in control
+void rdd2_variant_track(struct rdd2_variant *variant, double error);
+
+void rdd2_variant_status(const struct rdd2_variant *variant, const struct shell *sh);
+
+#endif // RDD2_VARIANT_H
+// vi: ts=4 sw=4 et
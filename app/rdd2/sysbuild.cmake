@@ -0,0 +1,24 @@
+# Copyright (c) 2025 CogniPilot Foundation
+# SPDX-License-Identifier: Apache-2.0
+
+if(SB_CONFIG_CEREBRI_RDD2_OFFLOAD)
+  ExternalZephyrProject_Add(
+    APPLICATION offload
+    SOURCE_DIR ${APP_DIR}/../offload
+    BOARD ${SB_CONFIG_CEREBRI_RDD2_OFFLOAD_BOARD}
+    )
+
+  set_config_bool(${DEFAULT_IMAGE} CONFIG_SECOND_CORE_MCUX y)
+  set_config_bool(${DEFAULT_IMAGE} CONFIG_INCLUDE_REMOTE_DIR y)
+
+  set(${DEFAULT_IMAGE}_EXTRA_DTC_OVERLAY_FILE
+    ${APP_DIR}/boards/ipc.overlay CACHE INTERNAL "")
+  set(${DEFAULT_IMAGE}_EXTRA_CONF_FILE
+    ${APP_DIR}/prj_ipc.conf CACHE INTERNAL "")
+
+  # the cm7 image carries the cm4 image
+  add_dependencies(${DEFAULT_IMAGE} offload)
+  sysbuild_add_dependencies(CONFIGURE ${DEFAULT_IMAGE} offload)
+endif()
+
+# vi: ts=2 sw=2 et
@@ -19,14 +19,28 @@
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/actuate/dshot.h>
+#include <cerebri/core/executor.h>
+#include <cerebri/core/log_utils.h>
 #include <cerebri/core/perf_duration.h>
+#include <cerebri/core/trace.h>
+#include <synapse_capture.h>
+#include <synapse_latency.h>
+#include <synapse_liveness.h>
 #include <synapse_topic_list.h>
 
 LOG_MODULE_REGISTER(actuate_dshot, CONFIG_CEREBRI_ACTUATE_DSHOT_LOG_LEVEL);
 
 #define CONFIG_DSHOT_ACTUATORS_INIT_PRIORITY 50
 #define MY_STACK_SIZE                        4096
+#define MY_DEADLINE_US                       250
 #define MY_PRIORITY                          4
+// direct writes older than this hand the motors back to the actuators topic
+#define DIRECT_HOLD_MS                       100
+// disarm when the allocation stops for this long
+#define ACTUATORS_DEADLINE_MS                100
+// frames packed per update, one per flexio shifter
+#define DSHOT_CHANNELS_MAX                   8
 
 extern struct perf_duration control_latency;
 
@@ -49,6 +63,20 @@ struct context {
 	synapse_pb_Status status;
 	struct zros_node node;
 	struct zros_sub sub_actuators, sub_status;
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_TELEMETRY)
+	struct synapse_motor_state motor_state;
+	struct zros_pub pub_motor_state;
+	// uptime of the last frame, its replies are collected before the next
+	int64_t trigger_ticks;
+	uint32_t replies, missed;
+#endif
+	struct synapse_latency_trace latency;
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	struct synapse_liveness liveness;
+#endif
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	struct executor_task task;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -56,8 +84,19 @@ struct context {
 	const struct device *const dev;
 	uint8_t num_actuators;
 	const actuator_dshot_t *dshot_actuators;
+	// serializes frames between the thread and direct writes
+	struct k_spinlock lock;
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_DIRECT)
+	int64_t direct_ticks;
+	uint32_t direct_writes;
+#endif
 };
 
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_DIRECT)
+// the first instance, the one actuate_dshot_write drives
+static struct context *g_direct;
+#endif
+
 static int actuate_dshot_init(struct context *ctx)
 {
 	LOG_INF("init");
@@ -68,6 +107,13 @@ static int actuate_dshot_init(struct context *ctx)
 	zros_node_init(&ctx->node, "actuate_dshot");
 	zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators, &ctx->actuators, 1000);
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_TELEMETRY)
+	zros_pub_init(&ctx->pub_motor_state, &ctx->node, &topic_motor_state, &ctx->motor_state);
+	ctx->trigger_ticks = 0;
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	synapse_liveness_start(&ctx->liveness);
+#endif
 	k_sem_take(&ctx->running, K_FOREVER);
 	return 0;
 }
@@ -75,40 +121,106 @@ static int actuate_dshot_init(struct context *ctx)
 static void actuate_dshot_fini(struct context *ctx)
 {
 	LOG_INF("fini");
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	synapse_liveness_stop(&ctx->liveness);
+#endif
 	zros_sub_fini(&ctx->sub_actuators);
 	zros_sub_fini(&ctx->sub_status);
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_TELEMETRY)
+	zros_pub_fini(&ctx->pub_motor_state);
+#endif
 	zros_node_fini(&ctx->node);
 	k_sem_give(&ctx->running);
 }
 
-static void dshot_update(struct context *ctx)
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_TELEMETRY)
+// replies to the last frame, whatever has not arrived by now is counted missing
+static bool dshot_collect(struct context *ctx)
 {
-	bool armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
-
-	for (int i = 0; i < ctx->num_actuators; i++) {
-		actuator_dshot_t dshot = ctx->dshot_actuators[i];
-
-		double input = 0;
-		uint32_t throttle = 0;
+	struct synapse_motor_state *m = &ctx->motor_state;
 
-		if (armed) {
-			input = ctx->actuators.velocity[i];
-			throttle = (uint32_t)((dshot.scale * input) + dshot.center);
+	if (ctx->trigger_ticks == 0) {
+		return false;
+	}
+	up_bdshot_decode_erpm(ctx->dev);
+	m->stamp_ns = k_ticks_to_ns_floor64(ctx->trigger_ticks);
+	m->count = MIN(ctx->num_actuators, SYNAPSE_MOTOR_STATE_MAX);
+	m->valid = 0;
+	for (int i = 0; i < m->count; i++) {
+		int erpm = 0;
+		if (up_bdshot_get_erpm(ctx->dev, i, &erpm) == 0) {
+			// the reply carries erpm / 100
+			m->erpm[i] = erpm * 100;
+			m->valid |= BIT(i);
+			ctx->replies++;
+		} else {
+			m->erpm[i] = 0;
+			ctx->missed++;
+		}
+	}
+	return true;
+}
+#endif
 
-			if (throttle > DSHOT_MAX) {
-				throttle = DSHOT_MAX;
-			} else if (throttle < DSHOT_MIN) {
-				throttle = DSHOT_MIN;
-			}
+static void dshot_update(struct context *ctx, const synapse_pb_Actuators *actuators)
+{
+	bool armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
+	k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_TELEMETRY)
+	bool collected = dshot_collect(ctx);
+#endif
+
+	uint16_t throttle[DSHOT_CHANNELS_MAX] = {};
+	int count = MIN(ctx->num_actuators, DSHOT_CHANNELS_MAX);
+
+	// all frames are packed first and handed to the driver in one call
+	if (armed) {
+		for (int i = 0; i < count; i++) {
+			const actuator_dshot_t *dshot = &ctx->dshot_actuators[i];
+			int32_t value = (int32_t)((dshot->scale * actuators->velocity[i]) +
+						  dshot->center);
+			throttle[i] = CLAMP(value, DSHOT_MIN, DSHOT_MAX);
 		}
+	}
 
-		nxp_flexio_dshot_data_set(ctx->dev, i, (uint16_t)throttle, false);
+	nxp_flexio_dshot_frames_set(ctx->dev, throttle, count);
+	perf_duration_stop(&control_latency);
+	nxp_flexio_dshot_trigger(ctx->dev);
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_TELEMETRY)
+	ctx->trigger_ticks = k_uptime_ticks();
+#endif
+	k_spin_unlock(&ctx->lock, key);
+	CEREBRI_TRACE_NAMED(TRACE_EVENT_ACTUATOR_WRITE, "actuate_dshot", ctx->num_actuators);
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_TELEMETRY)
+	// published outside the lock, the frame is on its way already
+	if (collected) {
+		zros_pub_update(&ctx->pub_motor_state);
+	}
+#endif
+}
 
-		perf_duration_stop(&control_latency);
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_DIRECT)
+int actuate_dshot_write(const synapse_pb_Actuators *actuators,
+			struct synapse_latency_trace *latency)
+{
+	struct context *ctx = g_direct;
+
+	if (ctx == NULL || k_sem_count_get(&ctx->running) != 0) {
+		return -ENODEV;
 	}
+	ctx->direct_ticks = k_uptime_ticks();
+	ctx->direct_writes++;
+	dshot_update(ctx, actuators);
+	synapse_latency_mark(SYNAPSE_LATENCY_ACTUATE, latency);
+	return 0;
+}
 
-	nxp_flexio_dshot_trigger(ctx->dev);
+static bool direct_active(struct context *ctx)
+{
+	return ctx->direct_ticks != 0 &&
+	       k_uptime_ticks() - ctx->direct_ticks < k_ms_to_ticks_ceil64(DIRECT_HOLD_MS);
 }
+#endif
 
 static void dshot_beep(const struct shell *sh, struct context *ctx, int motor)
 {
@@ -154,6 +266,58 @@ static void dshot_spin_dir(const struct shell *sh, struct context *ctx, int moto
 	}
 }
 
+static void actuate_dshot_update(struct context *ctx, int rc)
+{
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+	// the watchdog sees a quiet allocation within a period of its deadline
+	if (rc == 0 && synapse_liveness_stale(&ctx->liveness)) {
+		rc = -EAGAIN;
+	}
+#endif
+	if (rc != 0) {
+		CEREBRI_LOG_DBG_LIMIT("no actuator message received");
+		// put motors in disarmed state
+		if (ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED) {
+			ctx->status.arming = synapse_pb_Status_Arming_ARMING_DISARMED;
+			LOG_ERR("disarming motors due to actuator msg timeout!");
+			synapse_capture_trigger("actuator timeout");
+		}
+	}
+
+	if (zros_sub_update_available(&ctx->sub_status)) {
+		zros_sub_update(&ctx->sub_status);
+	}
+
+	if (zros_sub_update_available(&ctx->sub_actuators)) {
+		zros_sub_update(&ctx->sub_actuators);
+		synapse_latency_get(SYNAPSE_LATENCY_ALLOCATION, &ctx->latency);
+	}
+
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_DIRECT)
+	// the control loop wrote these already, the topic is its copy for logging
+	if (rc == 0 && direct_active(ctx)) {
+		return;
+	}
+#endif
+
+	// update dshot
+	dshot_update(ctx, &ctx->actuators);
+	synapse_latency_mark(SYNAPSE_LATENCY_ACTUATE, &ctx->latency);
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+static void actuate_dshot_execute(struct executor_task *task)
+{
+	struct context *ctx = CONTAINER_OF(task, struct context, task);
+
+	bool available = zros_sub_update_available(&ctx->sub_actuators);
+	int rc = executor_wait(task, available, 1000);
+	if (rc != -EBUSY) {
+		actuate_dshot_update(ctx, rc);
+	}
+}
+#endif
+
 static void actuate_dshot_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -168,30 +332,32 @@ static void actuate_dshot_run(void *p0, void *p1, void *p2)
 
 	struct k_poll_event events[] = {
 		*zros_sub_get_event(&ctx->sub_actuators),
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+		SYNAPSE_LIVENESS_POLL_EVENT(&ctx->liveness),
+#endif
 	};
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	if (executor_register(&ctx->task, "actuate_dshot", actuate_dshot_execute,
+			      EXECUTOR_STAGE_ACTUATE, EXECUTOR_FRAME_US, 0, MY_DEADLINE_US) == 0) {
+		// updates run in the executor frame, park until stopped
+		k_sem_take(&ctx->running, K_FOREVER);
+		executor_unregister(&ctx->task);
+		actuate_dshot_fini(ctx);
+		return;
+	}
+#endif
+
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 		int rc = 0;
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
-		if (rc != 0) {
-			LOG_DBG("no actuator message received");
-			// put motors in disarmed state
-			if (ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED) {
-				ctx->status.arming = synapse_pb_Status_Arming_ARMING_DISARMED;
-				LOG_ERR("disarming motors due to actuator msg timeout!");
-			}
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+		if (events[1].state == K_POLL_STATE_SIGNALED) {
+			synapse_liveness_ack(&ctx->liveness, &events[1]);
 		}
+#endif
 
-		if (zros_sub_update_available(&ctx->sub_status)) {
-			zros_sub_update(&ctx->sub_status);
-		}
-
-		if (zros_sub_update_available(&ctx->sub_actuators)) {
-			zros_sub_update(&ctx->sub_actuators);
-		}
-
-		// update dshot
-		dshot_update(ctx);
+		actuate_dshot_update(ctx, rc);
 	}
 
 	actuate_dshot_fini(ctx);
@@ -228,6 +394,15 @@ static int actuate_dshot_cmd_handler(const struct shell *sh, size_t argc, char *
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&ctx->running) == 0);
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_DIRECT)
+		if (ctx == g_direct) {
+			shell_print(sh, "direct writes: %u, active: %d", ctx->direct_writes,
+				    direct_active(ctx));
+		}
+#endif
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_TELEMETRY)
+		shell_print(sh, "erpm replies: %u, missed: %u", ctx->replies, ctx->missed);
+#endif
 	} else if (strcmp(argv[0], "beep") == 0) {
 		if (k_sem_count_get(&ctx->running) == 0) {
 			shell_print(sh, "must stop before using set");
@@ -255,6 +430,11 @@ static int actuate_dshot_cmd_handler(const struct shell *sh, size_t argc, char *
 static int actuate_dshot_device_init(const struct device *dev)
 {
 	struct context *data = dev->data;
+#if defined(CONFIG_CEREBRI_ACTUATE_DSHOT_DIRECT)
+	if (g_direct == NULL) {
+		g_direct = data;
+	}
+#endif
 	start(data);
 	return 0;
 }
@@ -290,6 +470,14 @@ static int actuate_dshot_device_init(const struct device *dev)
 		.type = DT_ENUM_IDX(node_id, input_type),                                          \
 	},
 
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+#define DSHOT_LIVENESS_INIT(inst)                                                                  \
+	.liveness = SYNAPSE_LIVENESS_INITIALIZER(data_##inst.liveness, &topic_actuators,          \
+						 "actuate_dshot", ACTUATORS_DEADLINE_MS),
+#else
+#define DSHOT_LIVENESS_INIT(inst)
+#endif
+
 #define DSHOT_ACTUATORS_DEFINE(inst)                                                               \
 	static const actuator_dshot_t g_actuator_dshots_##inst[] = {                               \
 		DT_FOREACH_CHILD(DT_INST(inst, cerebri_dshot_actuators), DSHOT_ACTUATOR_DEFINE)};  \
@@ -301,6 +489,7 @@ static int actuate_dshot_device_init(const struct device *dev)
 		.node = {},                                                                        \
 		.sub_status = {},                                                                  \
 		.sub_actuators = {},                                                               \
+		DSHOT_LIVENESS_INIT(inst)                                                          \
 		.running = Z_SEM_INITIALIZER(data_##inst.running, 1, 1),                           \
 		.stack_size = MY_STACK_SIZE,                                                       \
 		.stack_area = g_my_stack_area_##inst,                                              \
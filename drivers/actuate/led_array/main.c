@@ -22,7 +22,13 @@
 
 LOG_MODULE_REGISTER(actuate_led_array, CONFIG_CEREBRI_ACTUATE_LED_ARRAY_LOG_LEVEL);
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+extern struct k_work_q g_shared_work_q;
+
+static void actuate_led_array_work_handler(struct k_work *work);
+#else
 extern struct k_work_q g_low_priority_work_q;
+#endif
 
 #define MY_STACK_SIZE 4096
 #define MY_PRIORITY   4
@@ -33,6 +39,12 @@ typedef struct _context {
 	synapse_pb_LEDArray data;
 	const struct device *strip;
 	struct led_rgb strip_colors[CONFIG_CEREBRI_ACTUATE_LED_ARRAY_COUNT];
+	uint32_t written, skipped;
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+	struct k_work_delayable work_item;
+	bool initialized;
+	int64_t last_update_ms;
+#endif
 } context;
 
 static context g_ctx = {
@@ -41,6 +53,13 @@ static context g_ctx = {
 	.sub = {},
 	.strip = NULL,
 	.strip_colors = {},
+	.written = 0,
+	.skipped = 0,
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+	.work_item = Z_WORK_DELAYABLE_INITIALIZER(actuate_led_array_work_handler),
+	.initialized = false,
+	.last_update_ms = 0,
+#endif
 };
 
 static void actuate_led_array_init(context *ctx)
@@ -57,6 +76,69 @@ static void actuate_led_array_init(context *ctx)
 	}
 }
 
+// messages may carry only the leds that changed, the strip is written only if a color did
+static void actuate_led_array_update(context *ctx, bool force)
+{
+	bool changed = force;
+
+	for (int i = 0; i < ctx->data.led_count; i++) {
+		synapse_pb_LEDArray_LED led = ctx->data.led[i];
+		if (led.index >= CONFIG_CEREBRI_ACTUATE_LED_ARRAY_COUNT) {
+			LOG_ERR("Setting LED index out of range");
+			continue;
+		}
+		struct led_rgb *color = &ctx->strip_colors[led.index];
+		if (color->r != led.r || color->g != led.g || color->b != led.b) {
+			color->r = led.r;
+			color->g = led.g;
+			color->b = led.b;
+			changed = true;
+		}
+	}
+
+	if (!changed) {
+		ctx->skipped++;
+		return;
+	}
+	led_strip_update_rgb(ctx->strip, ctx->strip_colors, CONFIG_CEREBRI_ACTUATE_LED_ARRAY_COUNT);
+	ctx->written++;
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+static void actuate_led_array_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	context *ctx = CONTAINER_OF(dwork, context, work_item);
+
+	// first run after boot, topics are registered by now
+	if (!ctx->initialized) {
+		LOG_INF("init");
+		actuate_led_array_init(ctx);
+		ctx->initialized = true;
+	}
+
+	// polled instead of k_poll, refresh at least once a second as the thread did
+	int64_t now = k_uptime_get();
+	if (zros_sub_update_available(&ctx->sub)) {
+		zros_sub_update(&ctx->sub);
+		actuate_led_array_update(ctx, false);
+		ctx->last_update_ms = now;
+	} else if (now - ctx->last_update_ms >= 1000) {
+		actuate_led_array_update(ctx, true);
+		ctx->last_update_ms = now;
+	}
+
+	k_work_schedule_for_queue(&g_shared_work_q, &ctx->work_item, DELAY_TIME);
+}
+
+static int actuate_led_array_sys_init(void)
+{
+	k_work_schedule_for_queue(&g_shared_work_q, &g_ctx.work_item, K_NO_WAIT);
+	return 0;
+};
+
+SYS_INIT(actuate_led_array_sys_init, APPLICATION, 2);
+#else
 void actuate_led_array_entry_point(context *ctx)
 {
 	LOG_INF("init");
@@ -73,27 +155,33 @@ void actuate_led_array_entry_point(context *ctx)
 			LOG_DBG("sub polling error! %d", rc);
 		}
 
+		// perform processing, rewrite the strip once a second without messages
 		if (zros_sub_update_available(&ctx->sub)) {
 			zros_sub_update(&ctx->sub);
+			actuate_led_array_update(ctx, false);
+		} else {
+			actuate_led_array_update(ctx, true);
 		}
-
-		// perform processing
-		for (int i = 0; i < ctx->data.led_count; i++) {
-			synapse_pb_LEDArray_LED led = ctx->data.led[i];
-			if (led.index > CONFIG_CEREBRI_ACTUATE_LED_ARRAY_COUNT) {
-				LOG_ERR("Setting LED index out of range");
-				continue;
-			}
-			ctx->strip_colors[led.index].r = led.r;
-			ctx->strip_colors[led.index].g = led.g;
-			ctx->strip_colors[led.index].b = led.b;
-		}
-		led_strip_update_rgb(ctx->strip, ctx->strip_colors,
-				     CONFIG_CEREBRI_ACTUATE_LED_ARRAY_COUNT);
 	}
 }
 
 K_THREAD_DEFINE(actuate_led_array, MY_STACK_SIZE, actuate_led_array_entry_point, &g_ctx, NULL, NULL,
 		MY_PRIORITY, 0, 100);
+#endif
+
+static int actuate_led_array_cmd_status(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	shell_print(sh, "frames written: %u, identical skipped: %u", g_ctx.written, g_ctx.skipped);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_actuate_led_array,
+			       SHELL_CMD(status, NULL, "Strip write counters.",
+					 actuate_led_array_cmd_status),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(actuate_led_array, &sub_actuate_led_array, "led array commands", NULL);
 
 /* vi: ts=4 sw=4 et */
@@ -19,14 +19,20 @@
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/core/executor.h>
+#include <cerebri/core/log_utils.h>
 #include <cerebri/core/perf_duration.h>
+#include <cerebri/core/trace.h>
+#include <synapse_latency.h>
 #include <synapse_topic_list.h>
 
 LOG_MODULE_REGISTER(actuate_pwm, CONFIG_CEREBRI_ACTUATE_PWM_LOG_LEVEL);
 
 #define CONFIG_PWM_ACTUATORS_INIT_PRIORITY 50
 #define MY_STACK_SIZE                      4096
+#define MY_DEADLINE_US                     250
 #define MY_PRIORITY                        4
+#define PWM_ACTUATORS_MAX                  16
 
 extern struct perf_duration control_latency;
 
@@ -36,6 +42,15 @@ typedef enum pwm_type_t {
 	PWM_TYPE_velocity = 2,
 } pwm_type_t;
 
+// pulse width divisor of each protocol, the configured widths are in standard pwm terms
+typedef enum pwm_protocol_t {
+	PWM_PROTOCOL_pwm = 0,
+	PWM_PROTOCOL_oneshot125 = 1,
+	PWM_PROTOCOL_oneshot42 = 2,
+} pwm_protocol_t;
+
+static const uint32_t pwm_protocol_div[] = {1, 8, 24};
+
 typedef struct actuator_pwm_t {
 	const char *label;
 	struct pwm_dt_spec device;
@@ -56,6 +71,10 @@ struct context {
 	struct zros_node node;
 	struct zros_sub sub_actuators, sub_status;
 	struct zros_pub pub_pwm;
+	struct synapse_latency_trace latency;
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	struct executor_task task;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -63,6 +82,12 @@ struct context {
 	uint32_t test_pulse;
 	uint8_t num_actuators;
 	const actuator_pwm_t *actuator_pwms;
+	pwm_protocol_t protocol;
+	// timer clock of each channel, 0 falls back to pwm_set_pulse_dt
+	uint64_t cycles_per_sec[PWM_ACTUATORS_MAX];
+	uint32_t period_cycles[PWM_ACTUATORS_MAX];
+	uint32_t commits;
+	uint32_t max_commit_cyc;
 };
 
 static int actuate_pwm_init(struct context *ctx)
@@ -77,6 +102,22 @@ static int actuate_pwm_init(struct context *ctx)
 		}
 	}
 
+	if (ctx->num_actuators > PWM_ACTUATORS_MAX) {
+		LOG_ERR("%d pwm actuators, at most %d", ctx->num_actuators, PWM_ACTUATORS_MAX);
+		return -1;
+	}
+
+	// the generic api looks the timer clock up on every call, do it once here
+	for (int i = 0; i < ctx->num_actuators; i++) {
+		const struct pwm_dt_spec *spec = &ctx->actuator_pwms[i].device;
+		uint64_t cycles_per_sec = 0;
+		if (pwm_get_cycles_per_sec(spec->dev, spec->channel, &cycles_per_sec) != 0) {
+			cycles_per_sec = 0;
+		}
+		ctx->cycles_per_sec[i] = cycles_per_sec;
+		ctx->period_cycles[i] = (uint32_t)(spec->period * cycles_per_sec / NSEC_PER_SEC);
+	}
+
 	zros_node_init(&ctx->node, "actuate_pwm");
 	zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators, &ctx->actuators, 1000);
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
@@ -95,11 +136,54 @@ static void actuate_pwm_fini(struct context *ctx)
 	k_sem_give(&ctx->running);
 }
 
+/*
+ * Write staged pulses, in the configured us or ns, to every channel back to
+ * back. Timers with shadow registers latch them at the same period
+ * boundary as long as the writes are not preempted in between.
+ */
+static void pwm_commit(struct context *ctx, const uint32_t *pulse)
+{
+	uint32_t div = pwm_protocol_div[ctx->protocol];
+	uint32_t cycles[PWM_ACTUATORS_MAX];
+
+	for (int i = 0; i < ctx->num_actuators; i++) {
+		uint64_t pulse_ns = ctx->actuator_pwms[i].use_nano_seconds ? PWM_NSEC(pulse[i])
+									   : PWM_USEC(pulse[i]);
+		pulse_ns /= div;
+		cycles[i] = (uint32_t)(pulse_ns * ctx->cycles_per_sec[i] / NSEC_PER_SEC);
+	}
+
+	uint32_t start = k_cycle_get_32();
+	k_sched_lock();
+	for (int i = 0; i < ctx->num_actuators; i++) {
+		const actuator_pwm_t *pwm = &ctx->actuator_pwms[i];
+		const struct pwm_dt_spec *spec = &pwm->device;
+		int err = 0;
+		if (ctx->cycles_per_sec[i] != 0) {
+			err = pwm_set_cycles(spec->dev, spec->channel, ctx->period_cycles[i],
+					     cycles[i], spec->flags);
+		} else {
+			err = pwm_set_pulse_dt(spec, pwm->use_nano_seconds
+							     ? PWM_NSEC(pulse[i]) / div
+							     : PWM_USEC(pulse[i]) / div);
+		}
+		if (err) {
+			LOG_ERR("Failed to set pulse %d on %d (err %d)", pulse[i], pwm->index, err);
+		}
+	}
+	k_sched_unlock();
+
+	uint32_t duration = k_cycle_get_32() - start;
+	ctx->max_commit_cyc = MAX(ctx->max_commit_cyc, duration);
+	ctx->commits++;
+}
+
 static void pwm_update(struct context *ctx)
 {
 	bool armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
-	int err = 0;
+	uint32_t pulses[PWM_ACTUATORS_MAX];
 
+	// stage every channel, then commit them together
 	for (int i = 0; i < ctx->num_actuators; i++) {
 		actuator_pwm_t pwm = ctx->actuator_pwms[i];
 
@@ -118,33 +202,66 @@ static void pwm_update(struct context *ctx)
 			pulse = (uint32_t)((pwm.scale * input) + pwm.center);
 			if (pulse > pwm.max) {
 				pulse = pwm.max;
-				LOG_DBG("%d  pwm saturated, requested %d > %d", pwm.index, pulse,
-					pwm.max);
+				CEREBRI_LOG_DBG_LIMIT("%d  pwm saturated, requested %d > %d",
+						      pwm.index, pulse, pwm.max);
 			} else if (pulse < pwm.min) {
 				pulse = pwm.min;
-				LOG_DBG("%d  pwm saturated, requested %d < %d", pwm.index, pulse,
-					pwm.min);
+				CEREBRI_LOG_DBG_LIMIT("%d  pwm saturated, requested %d < %d",
+						      pwm.index, pulse, pwm.min);
 			}
 		}
 
 		ctx->pwm.channel[i] = pulse;
+		pulses[i] = pulse;
+	}
 
-		if (pwm.use_nano_seconds) {
-			err = pwm_set_pulse_dt(&pwm.device, PWM_NSEC(pulse));
-		} else {
-			err = pwm_set_pulse_dt(&pwm.device, PWM_USEC(pulse));
-		}
-		perf_duration_stop(&control_latency);
+	pwm_commit(ctx, pulses);
+	perf_duration_stop(&control_latency);
 
-		if (err) {
-			LOG_ERR("Failed to set pulse %d on %d (err %d)", pulse, pwm.index, err);
+	CEREBRI_TRACE_NAMED(TRACE_EVENT_ACTUATOR_WRITE, "actuate_pwm", ctx->num_actuators);
+	synapse_latency_mark(SYNAPSE_LATENCY_ACTUATE, &ctx->latency);
+
+	stamp_msg_now(&ctx->pwm.timestamp);
+	zros_pub_update(&ctx->pub_pwm);
+}
+
+static void actuate_pwm_update(struct context *ctx, int rc)
+{
+	if (rc != 0) {
+		CEREBRI_LOG_DBG_LIMIT("no actuator message received");
+		// put motors in disarmed state
+		if (ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED) {
+			ctx->status.arming = synapse_pb_Status_Arming_ARMING_DISARMED;
+			LOG_ERR("disarming motors due to actuator msg timeout!");
 		}
 	}
 
-	stamp_msg(&ctx->pwm.timestamp, k_uptime_ticks());
-	zros_pub_update(&ctx->pub_pwm);
+	if (zros_sub_update_available(&ctx->sub_status)) {
+		zros_sub_update(&ctx->sub_status);
+	}
+
+	if (zros_sub_update_available(&ctx->sub_actuators)) {
+		zros_sub_update(&ctx->sub_actuators);
+		synapse_latency_get(SYNAPSE_LATENCY_ALLOCATION, &ctx->latency);
+	}
+
+	// update pwm
+	pwm_update(ctx);
 }
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+static void actuate_pwm_execute(struct executor_task *task)
+{
+	struct context *ctx = CONTAINER_OF(task, struct context, task);
+
+	bool available = zros_sub_update_available(&ctx->sub_actuators);
+	int rc = executor_wait(task, available, 1000);
+	if (rc != -EBUSY) {
+		actuate_pwm_update(ctx, rc);
+	}
+}
+#endif
+
 static void actuate_pwm_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -161,28 +278,22 @@ static void actuate_pwm_run(void *p0, void *p1, void *p2)
 		*zros_sub_get_event(&ctx->sub_actuators),
 	};
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR)
+	if (executor_register(&ctx->task, "actuate_pwm", actuate_pwm_execute,
+			      EXECUTOR_STAGE_ACTUATE, EXECUTOR_FRAME_US, 0, MY_DEADLINE_US) == 0) {
+		// updates run in the executor frame, park until stopped
+		k_sem_take(&ctx->running, K_FOREVER);
+		executor_unregister(&ctx->task);
+		actuate_pwm_fini(ctx);
+		return;
+	}
+#endif
+
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 		int rc = 0;
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
-		if (rc != 0) {
-			LOG_DBG("no actuator message received");
-			// put motors in disarmed state
-			if (ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED) {
-				ctx->status.arming = synapse_pb_Status_Arming_ARMING_DISARMED;
-				LOG_ERR("disarming motors due to actuator msg timeout!");
-			}
-		}
-
-		if (zros_sub_update_available(&ctx->sub_status)) {
-			zros_sub_update(&ctx->sub_status);
-		}
-
-		if (zros_sub_update_available(&ctx->sub_actuators)) {
-			zros_sub_update(&ctx->sub_actuators);
-		}
 
-		// update pwm
-		pwm_update(ctx);
+		actuate_pwm_update(ctx, rc);
 	}
 
 	actuate_pwm_fini(ctx);
@@ -200,18 +311,12 @@ static int start(struct context *ctx)
 
 static int set_pulse_all(struct context *ctx, uint32_t pulse)
 {
+	uint32_t pulses[PWM_ACTUATORS_MAX];
+
 	for (int i = 0; i < ctx->num_actuators; i++) {
-		actuator_pwm_t pwm = ctx->actuator_pwms[i];
-		int err = 0;
-		if (pwm.use_nano_seconds) {
-			err = pwm_set_pulse_dt(&pwm.device, PWM_NSEC(pulse));
-		} else {
-			err = pwm_set_pulse_dt(&pwm.device, PWM_USEC(pulse));
-		}
-		if (err) {
-			LOG_ERR("failed to set pulse %d on %d (err %d)", pwm.max, pwm.index, err);
-		}
+		pulses[i] = pulse;
 	}
+	pwm_commit(ctx, pulses);
 	return 0;
 }
 
@@ -253,6 +358,7 @@ static int actuate_pwm_cmd_handler(const struct shell *sh, size_t argc, char **a
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&ctx->running) == 0);
+		shell_print(sh, "commits: %u, longest: %u cyc", ctx->commits, ctx->max_commit_cyc);
 	} else {
 		shell_print(sh, "unknown command");
 	}
@@ -316,6 +422,11 @@ static int actuate_pwm_device_init(const struct device *dev)
 		.test_pulse = 0,                                                                   \
 		.actuator_pwms = g_actuator_pwms_##inst,                                           \
 		.num_actuators = DT_CHILD_NUM(DT_INST(inst, cerebri_pwm_actuators)),               \
+		.protocol = DT_INST_ENUM_IDX_OR(inst, protocol, PWM_PROTOCOL_pwm),                 \
+		.cycles_per_sec = {},                                                              \
+		.period_cycles = {},                                                               \
+		.commits = 0,                                                                      \
+		.max_commit_cyc = 0,                                                               \
 	};                                                                                         \
 	PWM_ACTUATOR_SHELL(inst);                                                                  \
 	DEVICE_DT_INST_DEFINE(inst, actuate_pwm_device_init, NULL, &data_##inst, NULL,             \
@@ -15,11 +15,31 @@
 
 #include <synapse_topic_list.h>
 
-#define MY_STACK_SIZE 4096
+#define MY_STACK_SIZE 1024
 #define MY_PRIORITY   4
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+// the work item has no subscription events to wake on, so status is polled this often
+#define MAX_WAIT_MS 100
+#else
+#define MAX_WAIT_MS 1000
+#endif
+
+// a tune is only cut short by one of the same or higher priority
+#define TUNE_PRIORITY_MODE  0
+#define TUNE_PRIORITY_STATE 1
+#define TUNE_PRIORITY_ALERT 2
+
 LOG_MODULE_REGISTER(cerebri_actuate_sound, CONFIG_CEREBRI_ACTUATE_SOUND_LOG_LEVEL);
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+extern struct k_work_q g_shared_work_q;
+
+static void actuate_sound_work_handler(struct k_work *work);
+#endif
+
+static void tune_timer_handler(struct k_timer *timer);
+
 typedef struct _context {
 	struct zros_node node;
 	synapse_pb_Status status;
@@ -27,11 +47,22 @@ typedef struct _context {
 	synapse_pb_Status_Arming status_last_arming;
 	synapse_pb_Status_Safety status_last_safety;
 	uint32_t status_last_request_seq;
+	int64_t input_loss_last_alarm_ticks;
+	int64_t fuel_low_last_alarm_ticks;
 	struct zros_sub sub_status;
-	struct tones_t *sound;
-	int sound_size;
+	// tune playing, notes are advanced by the timer
+	struct k_timer tune_timer;
+	struct k_spinlock tune_lock;
+	const struct tones_t *tune;
+	size_t tune_size;
+	size_t tune_index;
+	int tune_priority;
 	const struct pwm_dt_spec buzzer;
 	bool started;
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+	struct k_work_delayable work_item;
+	bool active;
+#endif
 } context;
 
 static context g_ctx = {
@@ -41,11 +72,19 @@ static context g_ctx = {
 	.status_last_arming = synapse_pb_Status_Arming_ARMING_UNKNOWN,
 	.status_last_safety = synapse_pb_Status_Safety_SAFETY_UNKNOWN,
 	.status_last_request_seq = 0,
+	.input_loss_last_alarm_ticks = 0,
+	.fuel_low_last_alarm_ticks = 0,
 	.sub_status = {},
-	.sound = NULL,
-	.sound_size = 0,
+	.tune = NULL,
+	.tune_size = 0,
+	.tune_index = 0,
+	.tune_priority = 0,
 	.buzzer = PWM_DT_SPEC_GET(DT_ALIAS(buzzer)),
 	.started = false,
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+	.work_item = Z_WORK_DELAYABLE_INITIALIZER(actuate_sound_work_handler),
+	.active = false,
+#endif
 };
 
 static void init_actuate_sound(context *ctx)
@@ -53,139 +92,201 @@ static void init_actuate_sound(context *ctx)
 	LOG_DBG("init actuate sound");
 	zros_node_init(&ctx->node, "actuate_sound");
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 1);
+	k_timer_init(&ctx->tune_timer, tune_timer_handler, NULL);
 	if (!pwm_is_ready_dt(&ctx->buzzer)) {
 		LOG_ERR("Sound device %s is not ready!", ctx->buzzer.dev->name);
 	}
 }
 
-static int play_sound(context *ctx, struct tones_t *sound, size_t sound_size)
+// called with tune_lock held, from the timer or the status handler
+static void tune_note(context *ctx)
 {
 	int err;
-	for (size_t i = 0; i < sound_size; i++) {
-		if (sound[i].note == REST) {
+	if (ctx->tune_index >= ctx->tune_size) {
+		ctx->tune = NULL;
+		err = pwm_set_pulse_dt(&ctx->buzzer, 0);
+	} else {
+		const struct tones_t *tone = &ctx->tune[ctx->tune_index];
+		if (tone->note == REST) {
 			err = pwm_set_pulse_dt(&ctx->buzzer, 0);
 		} else {
-			err = pwm_set_dt(&ctx->buzzer, PWM_HZ(sound[i].note),
-					 PWM_HZ((sound[i].note)) / 2);
+			err = pwm_set_dt(&ctx->buzzer, PWM_HZ(tone->note), PWM_HZ(tone->note) / 2);
 		}
-		if (err) {
-			return err;
-		}
-		k_msleep(sound[i].duration);
+		k_timer_start(&ctx->tune_timer, K_MSEC(tone->duration), K_NO_WAIT);
+	}
+	if (err) {
+		LOG_ERR("Sound device write failed (err %d)", err);
 	}
-	err = pwm_set_pulse_dt(&ctx->buzzer, 0);
-	return err;
 }
 
-static void actuate_sound_entry_point(void *p0, void *p1, void *p2)
+static void tune_timer_handler(struct k_timer *timer)
 {
-	LOG_INF("init");
-	context *ctx = p0;
-	ARG_UNUSED(p1);
-	ARG_UNUSED(p2);
+	context *ctx = CONTAINER_OF(timer, context, tune_timer);
 
-	init_actuate_sound(ctx);
+	k_spinlock_key_t key = k_spin_lock(&ctx->tune_lock);
+	if (ctx->tune != NULL) {
+		ctx->tune_index++;
+		tune_note(ctx);
+	}
+	k_spin_unlock(&ctx->tune_lock, key);
+}
 
-	struct k_poll_event events[] = {
-		*zros_sub_get_event(&ctx->sub_status),
-	};
+// start a tune and return at once, a tune of lower priority is cut short
+static void play_sound(context *ctx, const struct tones_t *sound, size_t sound_size,
+		       int priority)
+{
+	k_spinlock_key_t key = k_spin_lock(&ctx->tune_lock);
+	if (ctx->tune == NULL || (ctx->tune != sound && priority >= ctx->tune_priority)) {
+		k_timer_stop(&ctx->tune_timer);
+		ctx->tune = sound;
+		ctx->tune_size = sound_size;
+		ctx->tune_index = 0;
+		ctx->tune_priority = priority;
+		tune_note(ctx);
+	}
+	k_spin_unlock(&ctx->tune_lock, key);
+}
 
-	int64_t input_loss_last_alarm_ticks = 0;
-	int64_t fuel_low_last_alarm_ticks = 0;
+static void actuate_sound_update(context *ctx)
+{
 	float input_loss_period_sec = 3.0;
 	float fuel_low_period_sec = 10.0;
 
-	while (true) {
+	if (zros_sub_update_available(&ctx->sub_status)) {
+		zros_sub_update(&ctx->sub_status);
+	}
 
-		int rc = 0;
-		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
-		if (rc != 0) {
-			LOG_DBG("Sound poll failed");
-			continue;
+	if (ctx->status.mode != ctx->status_last_mode) {
+		ctx->status_last_mode = ctx->status.mode;
+		if (ctx->status.mode == synapse_pb_Status_Mode_MODE_ACTUATORS) {
+			play_sound(ctx, manual_mode_tone, ARRAY_SIZE(manual_mode_tone),
+				   TUNE_PRIORITY_MODE);
+		} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_BEZIER) {
+			play_sound(ctx, auto_mode_tone, ARRAY_SIZE(auto_mode_tone),
+				   TUNE_PRIORITY_MODE);
+		} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_VELOCITY) {
+			play_sound(ctx, cmd_vel_mode_tone, ARRAY_SIZE(cmd_vel_mode_tone),
+				   TUNE_PRIORITY_MODE);
+		} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_CALIBRATION) {
+			play_sound(ctx, cal_mode_tone, ARRAY_SIZE(cal_mode_tone),
+				   TUNE_PRIORITY_MODE);
 		}
+	}
 
-		if (zros_sub_update_available(&ctx->sub_status)) {
-			zros_sub_update(&ctx->sub_status);
-		}
+	if (ctx->status_last_arming == synapse_pb_Status_Arming_ARMING_UNKNOWN) {
+		ctx->status_last_arming = ctx->status.arming;
+	}
+
+	else if (ctx->status_last_arming == synapse_pb_Status_Arming_ARMING_DISARMED &&
+		 ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED) {
+		ctx->status_last_arming = ctx->status.arming;
+		play_sound(ctx, armed_tone, ARRAY_SIZE(armed_tone), TUNE_PRIORITY_STATE);
+	}
 
-		if (ctx->status.mode != ctx->status_last_mode) {
-			ctx->status_last_mode = ctx->status.mode;
-			if (ctx->status.mode == synapse_pb_Status_Mode_MODE_ACTUATORS) {
-				play_sound(ctx, manual_mode_tone, ARRAY_SIZE(manual_mode_tone));
-			} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_BEZIER) {
-				play_sound(ctx, auto_mode_tone, ARRAY_SIZE(auto_mode_tone));
-			} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_VELOCITY) {
-				play_sound(ctx, cmd_vel_mode_tone, ARRAY_SIZE(cmd_vel_mode_tone));
-			} else if (ctx->status.mode == synapse_pb_Status_Mode_MODE_CALIBRATION) {
-				play_sound(ctx, cal_mode_tone, ARRAY_SIZE(cal_mode_tone));
+	else if (ctx->status_last_arming == synapse_pb_Status_Arming_ARMING_ARMED &&
+		 ctx->status.arming == synapse_pb_Status_Arming_ARMING_DISARMED) {
+		ctx->status_last_arming = ctx->status.arming;
+		play_sound(ctx, disarmed_tone, ARRAY_SIZE(disarmed_tone), TUNE_PRIORITY_STATE);
+	}
+
+	if (ctx->status.safety != ctx->status_last_safety) {
+		ctx->status_last_safety = ctx->status.safety;
+		if (ctx->status.safety == synapse_pb_Status_Safety_SAFETY_SAFE) {
+			if (!ctx->started) {
+				play_sound(ctx, airy_start_tone, ARRAY_SIZE(airy_start_tone),
+					   TUNE_PRIORITY_STATE);
+				ctx->started = true;
+			} else {
+				play_sound(ctx, safety_on_tone, ARRAY_SIZE(safety_on_tone),
+					   TUNE_PRIORITY_STATE);
 			}
 		}
 
-		if (ctx->status_last_arming == synapse_pb_Status_Arming_ARMING_UNKNOWN) {
-			ctx->status_last_arming = ctx->status.arming;
+		else if (ctx->status.safety == synapse_pb_Status_Safety_SAFETY_UNSAFE) {
+			play_sound(ctx, safety_off_tone, ARRAY_SIZE(safety_off_tone),
+				   TUNE_PRIORITY_STATE);
 		}
+	}
 
-		else if (ctx->status_last_arming == synapse_pb_Status_Arming_ARMING_DISARMED &&
-			 ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED) {
-			ctx->status_last_arming = ctx->status.arming;
-			play_sound(ctx, armed_tone, ARRAY_SIZE(armed_tone));
+	if (ctx->status.fuel == synapse_pb_Status_Fuel_FUEL_LOW) {
+		int64_t now_ticks = k_uptime_ticks();
+		if ((now_ticks - ctx->fuel_low_last_alarm_ticks) >
+		    fuel_low_period_sec * CONFIG_SYS_CLOCK_TICKS_PER_SEC) {
+			ctx->fuel_low_last_alarm_ticks = now_ticks;
+			play_sound(ctx, fuel_tone, ARRAY_SIZE(fuel_tone), TUNE_PRIORITY_ALERT);
 		}
+	}
 
-		else if (ctx->status_last_arming == synapse_pb_Status_Arming_ARMING_ARMED &&
-			 ctx->status.arming == synapse_pb_Status_Arming_ARMING_DISARMED) {
-			ctx->status_last_arming = ctx->status.arming;
-			play_sound(ctx, disarmed_tone, ARRAY_SIZE(disarmed_tone));
+	// repeats back to back, a tune already playing is not restarted
+	if (ctx->status.fuel == synapse_pb_Status_Fuel_FUEL_CRITICAL) {
+		play_sound(ctx, fuel_tone, ARRAY_SIZE(fuel_tone), TUNE_PRIORITY_ALERT);
+	}
+
+	if (ctx->status.input_status == synapse_pb_Status_LinkStatus_STATUS_LOSS &&
+	    ctx->status.safety == synapse_pb_Status_Safety_SAFETY_UNSAFE) {
+		int64_t now_ticks = k_uptime_ticks();
+		if ((now_ticks - ctx->input_loss_last_alarm_ticks) >
+		    input_loss_period_sec * CONFIG_SYS_CLOCK_TICKS_PER_SEC) {
+			ctx->input_loss_last_alarm_ticks = now_ticks;
+			play_sound(ctx, input_loss_tone, ARRAY_SIZE(input_loss_tone),
+				   TUNE_PRIORITY_ALERT);
 		}
+	}
 
-		if (ctx->status.safety != ctx->status_last_safety) {
-			ctx->status_last_safety = ctx->status.safety;
-			if (ctx->status.safety == synapse_pb_Status_Safety_SAFETY_SAFE) {
-				if (!ctx->started) {
-					play_sound(ctx, airy_start_tone,
-						   ARRAY_SIZE(airy_start_tone));
-					ctx->started = true;
-				} else {
-					play_sound(ctx, safety_on_tone, ARRAY_SIZE(safety_on_tone));
-				}
-			}
+	if (ctx->status.request_rejected &&
+	    ctx->status_last_request_seq != ctx->status.request_seq) {
+		ctx->status_last_request_seq = ctx->status.request_seq;
+		play_sound(ctx, reject_tone, ARRAY_SIZE(reject_tone), TUNE_PRIORITY_STATE);
+	}
+}
 
-			else if (ctx->status.safety == synapse_pb_Status_Safety_SAFETY_UNSAFE) {
-				play_sound(ctx, safety_off_tone, ARRAY_SIZE(safety_off_tone));
-			}
-		}
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+static void actuate_sound_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	context *ctx = CONTAINER_OF(dwork, context, work_item);
 
-		if (ctx->status.fuel == synapse_pb_Status_Fuel_FUEL_LOW) {
-			int64_t now_ticks = k_uptime_ticks();
-			if ((now_ticks - fuel_low_last_alarm_ticks) >
-			    fuel_low_period_sec * CONFIG_SYS_CLOCK_TICKS_PER_SEC) {
-				fuel_low_last_alarm_ticks = now_ticks;
-				play_sound(ctx, fuel_tone, ARRAY_SIZE(fuel_tone));
-			}
-		}
+	// first run after boot, topics are registered by now
+	if (!ctx->active) {
+		init_actuate_sound(ctx);
+		ctx->active = true;
+	} else {
+		actuate_sound_update(ctx);
+	}
 
-		if (ctx->status.fuel == synapse_pb_Status_Fuel_FUEL_CRITICAL) {
-			play_sound(ctx, fuel_tone, ARRAY_SIZE(fuel_tone));
-		}
+	k_work_schedule_for_queue(&g_shared_work_q, &ctx->work_item, K_MSEC(MAX_WAIT_MS));
+}
 
-		if (ctx->status.input_status == synapse_pb_Status_LinkStatus_STATUS_LOSS &&
-		    ctx->status.safety == synapse_pb_Status_Safety_SAFETY_UNSAFE) {
-			int64_t now_ticks = k_uptime_ticks();
-			if ((now_ticks - input_loss_last_alarm_ticks) >
-			    input_loss_period_sec * CONFIG_SYS_CLOCK_TICKS_PER_SEC) {
-				input_loss_last_alarm_ticks = now_ticks;
-				play_sound(ctx, input_loss_tone, ARRAY_SIZE(input_loss_tone));
-			}
-		}
+static int actuate_sound_sys_init(void)
+{
+	k_work_schedule_for_queue(&g_shared_work_q, &g_ctx.work_item, K_NO_WAIT);
+	return 0;
+}
 
-		if (ctx->status.request_rejected &&
-		    ctx->status_last_request_seq != ctx->status.request_seq) {
-			ctx->status_last_request_seq = ctx->status.request_seq;
-			play_sound(ctx, reject_tone, ARRAY_SIZE(reject_tone));
-		}
+SYS_INIT(actuate_sound_sys_init, APPLICATION, 10);
+#else
+static void actuate_sound_entry_point(void *p0, void *p1, void *p2)
+{
+	LOG_INF("init");
+	context *ctx = p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	init_actuate_sound(ctx);
+
+	struct k_poll_event events[] = {
+		*zros_sub_get_event(&ctx->sub_status),
+	};
+
+	while (true) {
+		// tunes play from the timer, so status is handled while they do
+		k_poll(events, ARRAY_SIZE(events), K_MSEC(MAX_WAIT_MS));
+		actuate_sound_update(ctx);
 	}
 }
 
 K_THREAD_DEFINE(actuate_sound, MY_STACK_SIZE, actuate_sound_entry_point, &g_ctx, NULL, NULL,
 		MY_PRIORITY, 0, 100);
+#endif
 
 /* vi: ts=4 sw=4 et */
@@ -10,6 +10,7 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
 
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_pub_struct.h>
@@ -22,7 +23,10 @@
 #include <zephyr/net/socketcan.h>
 #include <zephyr/net/socketcan_utils.h>
 
+#include <cerebri/core/log_utils.h>
 #include <cerebri/core/perf_duration.h>
+#include <cerebri/core/trace.h>
+#include <synapse_latency.h>
 #include <synapse_topic_list.h>
 
 LOG_MODULE_REGISTER(actuate_vesc_can, CONFIG_CEREBRI_ACTUATE_VESC_CAN_LOG_LEVEL);
@@ -30,8 +34,16 @@ LOG_MODULE_REGISTER(actuate_vesc_can, CONFIG_CEREBRI_ACTUATE_VESC_CAN_LOG_LEVEL)
 #define CONFIG_VESC_CAN_ACTUATORS_INIT_PRIORITY 90
 #define MY_STACK_SIZE                           4096
 #define MY_PRIORITY                             4
+#define VESC_CAN_ACTUATORS_MAX                  8
 
-#define CAN_STATUS_ID_BASE 0x00000900
+// extended id is packet << 8 | vesc id
+#define VESC_PACKET_SET_RPM  3
+#define VESC_PACKET_STATUS   9
+#define VESC_PACKET_STATUS_4 16
+#define VESC_PACKET_STATUS_5 27
+
+// unstuffed bits of an extended frame with n data bytes, for the bus load estimate
+#define CAN_EXT_FRAME_BITS(n) (67 + 8 * (n))
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -43,6 +55,7 @@ extern struct perf_duration control_latency;
 
 static void actuate_vesc_can_rx_callback(const struct device *dev, struct can_frame *frame,
 					 void *user_data);
+static void actuate_vesc_can_tx_callback(const struct device *dev, int error, void *user_data);
 
 typedef enum vesc_can_type_t {
 	VESC_CAN_TYPE_NORMALIZED = 0,
@@ -60,15 +73,29 @@ struct actuator_vesc_can {
 	struct can_filter rx_filter;
 	struct context *ctx;
 	double rotation;
+	// decoded from the status frames in the rx callback, under the context lock
+	int64_t status_ticks;
+	int32_t erpm;
+	float current;
+	float current_in;
+	float temperature;
+	float v_in;
+	bool fresh;
 };
 
 struct context {
 	synapse_pb_Actuators actuators;
 	synapse_pb_WheelOdometry wheel_odometry;
 	synapse_pb_Status status;
+	struct synapse_motor_state motor_state;
+#if defined(CONFIG_CEREBRI_ACTUATE_VESC_CAN_BATTERY)
+	synapse_pb_BatteryState battery_state;
+	struct zros_pub pub_battery_state;
+#endif
 	struct zros_node node;
 	struct zros_sub sub_actuators, sub_status;
-	struct zros_pub pub_wheel_odometry;
+	struct zros_pub pub_wheel_odometry, pub_motor_state;
+	struct synapse_latency_trace latency;
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -81,6 +108,13 @@ struct context {
 	const char *label;
 	uint16_t status_rate;
 	bool enable_pub_wheel_odom;
+	uint32_t bitrate;
+	// status frames arrive in isr context
+	struct k_spinlock lock;
+	// bus statistics, the callbacks update them in isr context
+	atomic_t tx_queued, tx_done, tx_error, tx_full, rx_frames, bus_bits;
+	int64_t stats_ticks;
+	uint32_t stats_bits;
 };
 
 static int actuate_vesc_can_stop(struct context *ctx)
@@ -116,6 +150,11 @@ static int actuate_vesc_can_init(struct context *ctx)
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 10);
 	zros_pub_init(&ctx->pub_wheel_odometry, &ctx->node, &topic_wheel_odometry,
 		      &ctx->wheel_odometry);
+	zros_pub_init(&ctx->pub_motor_state, &ctx->node, &topic_motor_state, &ctx->motor_state);
+#if defined(CONFIG_CEREBRI_ACTUATE_VESC_CAN_BATTERY)
+	zros_pub_init(&ctx->pub_battery_state, &ctx->node, &topic_battery_state,
+		      &ctx->battery_state);
+#endif
 
 	if (ctx->ready) {
 		LOG_ERR("%s - already initialized", ctx->label);
@@ -151,9 +190,10 @@ static int actuate_vesc_can_init(struct context *ctx)
 	for (int i = 0; i < ctx->num_actuators; i++) {
 		struct actuator_vesc_can *act = &ctx->actuator_vesc_cans[i];
 		act->ctx = ctx;
+		// every packet from this vesc, the callback picks the status frames
 		act->rx_filter.flags = CAN_FILTER_IDE;
-		act->rx_filter.id = CAN_STATUS_ID_BASE + act->vesc_id;
-		act->rx_filter.mask = CAN_EXT_ID_MASK;
+		act->rx_filter.id = act->vesc_id;
+		act->rx_filter.mask = 0xFF;
 		err = can_add_rx_filter(ctx->device, actuate_vesc_can_rx_callback, act,
 					&act->rx_filter);
 		if (err < 0) {
@@ -175,6 +215,10 @@ static int actuate_vesc_can_fini(struct context *ctx)
 	zros_sub_fini(&ctx->sub_actuators);
 	zros_sub_fini(&ctx->sub_status);
 	zros_pub_fini(&ctx->pub_wheel_odometry);
+	zros_pub_fini(&ctx->pub_motor_state);
+#if defined(CONFIG_CEREBRI_ACTUATE_VESC_CAN_BATTERY)
+	zros_pub_fini(&ctx->pub_battery_state);
+#endif
 	zros_node_fini(&ctx->node);
 	k_sem_give(&ctx->running);
 	LOG_INF("fini");
@@ -186,35 +230,124 @@ static void actuate_vesc_can_rx_callback(const struct device *dev, struct can_fr
 {
 	struct actuator_vesc_can *act = (struct actuator_vesc_can *)user_data;
 	struct context *ctx = act->ctx;
-	int64_t data = (frame->data[0] << 24) + (frame->data[1] << 16) + (frame->data[2] << 8) +
-		       frame->data[3];
-	act->rotation += 2 * M_PI * data / (act->pole_pair * ctx->status_rate * 60);
-	// LOG_INF("Data: %ld", data);
-	// LOG_INF("Angular: %f", act->rotation);
-	if (act->id == ctx->actuator_vesc_cans[0].id) {
-		double mean_rotation = 0;
-		for (int i = 0; i < ctx->num_actuators; i++) {
-			mean_rotation += ctx->actuator_vesc_cans[i].rotation;
+	ARG_UNUSED(dev);
+
+	atomic_inc(&ctx->rx_frames);
+	atomic_add(&ctx->bus_bits, CAN_EXT_FRAME_BITS(can_dlc_to_bytes(frame->dlc)));
+	if (can_dlc_to_bytes(frame->dlc) < 8) {
+		return;
+	}
+
+	int64_t now = k_uptime_ticks();
+	k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+
+	switch (frame->id >> 8) {
+	case VESC_PACKET_STATUS: {
+		// erpm, phase current * 10, duty * 1000
+		int32_t erpm = (int32_t)sys_get_be32(&frame->data[0]);
+		double dt = act->status_ticks != 0 ? (double)(now - act->status_ticks) /
+							     CONFIG_SYS_CLOCK_TICKS_PER_SEC
+						   : 1.0 / MAX(ctx->status_rate, 1);
+		act->rotation += 2 * M_PI * erpm * dt / (act->pole_pair * 60);
+		act->erpm = erpm;
+		act->current = (int16_t)sys_get_be16(&frame->data[4]) / 10.0f;
+		act->status_ticks = now;
+		act->fresh = true;
+		break;
+	}
+	case VESC_PACKET_STATUS_4:
+		// fet and motor temperature * 10, input current * 10, pid position * 50
+		act->temperature = (int16_t)sys_get_be16(&frame->data[2]) / 10.0f;
+		act->current_in = (int16_t)sys_get_be16(&frame->data[4]) / 10.0f;
+		break;
+	case VESC_PACKET_STATUS_5:
+		// tachometer, input voltage * 10
+		act->v_in = (int16_t)sys_get_be16(&frame->data[4]) / 10.0f;
+		break;
+	default:
+		break;
+	}
+
+	k_spin_unlock(&ctx->lock, key);
+}
+
+static void actuate_vesc_can_tx_callback(const struct device *dev, int error, void *user_data)
+{
+	struct context *ctx = user_data;
+	ARG_UNUSED(dev);
+
+	if (error == 0) {
+		atomic_inc(&ctx->tx_done);
+		atomic_add(&ctx->bus_bits, CAN_EXT_FRAME_BITS(4));
+	} else {
+		atomic_inc(&ctx->tx_error);
+	}
+}
+
+// feedback of every vesc as of the last status frames
+static void actuate_vesc_can_publish(struct context *ctx)
+{
+	struct synapse_motor_state *m = &ctx->motor_state;
+	double mean_rotation = 0;
+	float v_in = 0;
+	float current_in = 0;
+	int v_in_count = 0;
+
+	k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+	m->stamp_ns = k_ticks_to_ns_floor64(k_uptime_ticks());
+	m->count = MIN(ctx->num_actuators, SYNAPSE_MOTOR_STATE_MAX);
+	m->valid = 0;
+	for (int i = 0; i < ctx->num_actuators; i++) {
+		struct actuator_vesc_can *act = &ctx->actuator_vesc_cans[i];
+		mean_rotation += act->rotation;
+		current_in += act->current_in;
+		if (act->v_in > 0) {
+			v_in += act->v_in;
+			v_in_count++;
 		}
-		mean_rotation /= ctx->num_actuators;
+		if (i < m->count) {
+			m->erpm[i] = act->erpm;
+			m->current[i] = act->current;
+			m->temperature[i] = act->temperature;
+			m->valid |= act->fresh ? BIT(i) : 0;
+		}
+		act->fresh = false;
+	}
+	k_spin_unlock(&ctx->lock, key);
+
+	zros_pub_update(&ctx->pub_motor_state);
+
+	if (ctx->enable_pub_wheel_odom && ctx->num_actuators > 0) {
 		ctx->wheel_odometry.has_stamp = true;
-		stamp_msg(&ctx->wheel_odometry.stamp, k_uptime_ticks());
-		ctx->wheel_odometry.rotation = mean_rotation;
+		stamp_msg_now(&ctx->wheel_odometry.stamp);
+		ctx->wheel_odometry.rotation = mean_rotation / ctx->num_actuators;
+		zros_pub_update(&ctx->pub_wheel_odometry);
+	}
+
+#if defined(CONFIG_CEREBRI_ACTUATE_VESC_CAN_BATTERY)
+	if (v_in_count > 0) {
+		ctx->battery_state.has_stamp = true;
+		stamp_msg_now(&ctx->battery_state.stamp);
+		ctx->battery_state.voltage = v_in / v_in_count;
+		ctx->battery_state.current = current_in;
+		zros_pub_update(&ctx->pub_battery_state);
 	}
+#else
+	ARG_UNUSED(v_in);
+	ARG_UNUSED(v_in_count);
+	ARG_UNUSED(current_in);
+#endif
 }
 
 static void actuate_vesc_can_update(struct context *ctx)
 {
 	bool armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
-	int err = 0;
+	struct can_frame frames[VESC_CAN_ACTUATORS_MAX];
+	int count = MIN(ctx->num_actuators, VESC_CAN_ACTUATORS_MAX);
 
-	for (int i = 0; i < ctx->num_actuators; i++) {
+	// build every frame first so they are queued back to back
+	for (int i = 0; i < count; i++) {
 		struct actuator_vesc_can *act = &ctx->actuator_vesc_cans[i];
-
-		struct can_frame frame = {
-			.dlc = can_bytes_to_dlc(4),
-			.flags = CAN_FRAME_IDE,
-		};
 		double input = 0;
 
 		if (act->type == VESC_CAN_TYPE_VELOCITY && armed) {
@@ -222,23 +355,38 @@ static void actuate_vesc_can_update(struct context *ctx)
 		}
 
 		int32_t erpm = act->pole_pair * input * 60 / (2 * M_PI);
-		frame.id = 768 + act->vesc_id;
-		frame.data[0] = erpm >> 24 & 255;
-		frame.data[1] = erpm >> 16 & 255;
-		frame.data[2] = erpm >> 8 & 255;
-		frame.data[3] = erpm & 255;
+		frames[i] = (struct can_frame){
+			.id = (VESC_PACKET_SET_RPM << 8) + act->vesc_id,
+			.dlc = can_bytes_to_dlc(4),
+			.flags = CAN_FRAME_IDE,
+		};
+		sys_put_be32(erpm, frames[i].data);
+	}
 
-		// send can data
+	// with a callback can_send only queues the frame, completion is counted in the callback
+	for (int i = 0; i < count; i++) {
 		g_send_count += 1;
-		err = can_send(ctx->device, &frame, K_NO_WAIT, NULL, NULL);
-		if (err != 0) {
-			ctx->ready = false;
-			LOG_ERR("%s - send failed to VESC ID: %d (%d)\n", act->label, act->vesc_id,
+		int err = can_send(ctx->device, &frames[i], K_NO_WAIT, actuate_vesc_can_tx_callback,
+				   ctx);
+		if (err == -EAGAIN) {
+			// tx queue full, the next update supersedes this frame
+			atomic_inc(&ctx->tx_full);
+			continue;
+		} else if (err != 0) {
+			atomic_inc(&ctx->tx_error);
+			if (err == -ENETDOWN || err == -ENETUNREACH) {
+				ctx->ready = false;
+			}
+			struct actuator_vesc_can *act = &ctx->actuator_vesc_cans[i];
+			LOG_DBG("%s - send failed to VESC ID: %d (%d)", act->label, act->vesc_id,
 				err);
 			continue;
 		}
+		atomic_inc(&ctx->tx_queued);
 		perf_duration_stop(&control_latency);
 	}
+	CEREBRI_TRACE_NAMED(TRACE_EVENT_ACTUATOR_WRITE, "actuate_vesc_can", ctx->num_actuators);
+	synapse_latency_mark(SYNAPSE_LATENCY_ACTUATE, &ctx->latency);
 }
 
 static void actuate_vesc_can_run(void *p0, void *p1, void *p2)
@@ -262,7 +410,7 @@ static void actuate_vesc_can_run(void *p0, void *p1, void *p2)
 		int rc = 0;
 		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
 		if (rc != 0) {
-			LOG_DBG("no actuator message received");
+			CEREBRI_LOG_DBG_LIMIT("no actuator message received");
 			// put motors in disarmed state
 			if (ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED) {
 				ctx->status.arming = synapse_pb_Status_Arming_ARMING_DISARMED;
@@ -276,12 +424,13 @@ static void actuate_vesc_can_run(void *p0, void *p1, void *p2)
 
 		if (zros_sub_update_available(&ctx->sub_actuators)) {
 			zros_sub_update(&ctx->sub_actuators);
+			synapse_latency_get(SYNAPSE_LATENCY_ALLOCATION, &ctx->latency);
 		}
 
-		zros_pub_update(&ctx->pub_wheel_odometry);
-
 		// update vesc_can
 		actuate_vesc_can_update(ctx);
+
+		actuate_vesc_can_publish(ctx);
 	}
 
 	actuate_vesc_can_fini(ctx);
@@ -318,7 +467,38 @@ static int actuate_vesc_can_cmd_handler(const struct shell *sh, size_t argc, cha
 			shell_print(sh, "not running");
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
-		shell_print(sh, "running: %d", (int)k_sem_count_get(&ctx->running) == 0);
+		shell_print(sh, "running: %d, ready: %d", (int)k_sem_count_get(&ctx->running) == 0,
+			    ctx->ready);
+		shell_print(sh, "tx queued: %ld, done: %ld, error: %ld, queue full: %ld, rx: %ld",
+			    atomic_get(&ctx->tx_queued), atomic_get(&ctx->tx_done),
+			    atomic_get(&ctx->tx_error), atomic_get(&ctx->tx_full),
+			    atomic_get(&ctx->rx_frames));
+
+		// load since the last status, from the unstuffed length of frames seen
+		int64_t now = k_uptime_ticks();
+		uint32_t bits = (uint32_t)atomic_get(&ctx->bus_bits);
+		double elapsed = (double)(now - ctx->stats_ticks) / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+		if (ctx->bitrate > 0 && ctx->stats_ticks != 0 && elapsed > 0) {
+			shell_print(sh, "bus load: %.1f %% over %.1f s",
+				    100.0 * (bits - ctx->stats_bits) / (elapsed * ctx->bitrate),
+				    elapsed);
+		}
+		ctx->stats_ticks = now;
+		ctx->stats_bits = bits;
+
+		struct can_bus_err_cnt err_cnt;
+		enum can_state state;
+		if (can_get_state(ctx->device, &state, &err_cnt) == 0) {
+			shell_print(sh, "state: %d, tx errors: %u, rx errors: %u", state,
+				    err_cnt.tx_err_cnt, err_cnt.rx_err_cnt);
+		}
+
+		for (int i = 0; i < ctx->num_actuators; i++) {
+			struct actuator_vesc_can *act = &ctx->actuator_vesc_cans[i];
+			shell_print(sh, "%s: %d erpm, %.1f A, %.1f V, %.1f C", act->label,
+				    act->erpm, (double)act->current, (double)act->v_in,
+				    (double)act->temperature);
+		}
 	} else {
 		shell_print(sh, "unknown command");
 	}
@@ -349,6 +529,8 @@ static int actuate_vesc_can_device_init(const struct device *dev)
 		.rx_filter = {},                                                                   \
 		.ctx = NULL,                                                                       \
 		.rotation = 0,                                                                     \
+		.status_ticks = 0,                                                                 \
+		.fresh = false,                                                                    \
 	},
 
 #define VESC_CAN_ACTUATORS_DEFINE(inst)                                                            \
@@ -372,6 +554,7 @@ static int actuate_vesc_can_device_init(const struct device *dev)
 		.fd = DT_INST_PROP(inst, fd),                                                      \
 		.status_rate = DT_INST_PROP(inst, status_rate),                                    \
 		.enable_pub_wheel_odom = DT_INST_PROP(inst, pub_wheel_odometry),                   \
+		.bitrate = DT_PROP_OR(DT_INST_PROP(inst, device), bitrate, 0),                     \
 		.label = DT_NODE_FULL_NAME(DT_DRV_INST(inst)),                                     \
 	};                                                                                         \
 	VESC_CAN_ACTUATOR_SHELL(inst);                                                             \
@@ -2,21 +2,315 @@
  * Copyright CogniPilot Foundation 2023
  * SPDX-License-Identifier: Apache-2.0 */
 
-#define MY_STACK_SIZE 4096
-#define MY_PRIORITY   4
-
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/shell/shell.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_sub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_sub.h>
+
+#include <pb_decode.h>
+#include <pb_encode.h>
+
+#include <synapse_topic_list.h>
+#include <cerebri/core/perf_duration.h>
+
+#define MY_STACK_SIZE 8192
+#define MY_PRIORITY   1
+#define BUF_SIZE      2048
 
 LOG_MODULE_REGISTER(dream_hil, CONFIG_CEREBRI_DREAM_HIL_LOG_LEVEL);
 
-static void zephyr_hil_entry_point(void)
+static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+
+/*
+ * The simulator sends one datagram per step: a sim_clock frame followed
+ * by the delimited sensor frames of the step. All sensors are published
+ * stamped with the sim time of the step, then the first actuators the
+ * control loop produces go back with the sim_clock of the step in a
+ * single reply datagram. The time from receiving a step to replying is
+ * the on board part of the round trip, the simulator has the rest.
+ */
+struct context {
+	struct zros_node node;
+	struct zros_sub sub_actuators;
+	synapse_pb_Actuators actuators;
+	synapse_pb_Frame frame;
+	synapse_pb_SimClock sim_clock;
+	int sock;
+	struct sockaddr_in peer;
+	socklen_t peer_len;
+	uint8_t rx_buf[BUF_SIZE];
+	uint8_t tx_buf[BUF_SIZE];
+	struct perf_duration round_trip;
+	uint32_t steps;
+	uint32_t sensors;
+	uint32_t decode_errors;
+	uint32_t reply_timeouts;
+	uint32_t send_errors;
+	struct k_sem running;
+	size_t stack_size;
+	k_thread_stack_t *stack_area;
+	struct k_thread thread_data;
+};
+
+static struct context g_ctx = {
+	.node = {},
+	.sub_actuators = {},
+	.actuators = synapse_pb_Actuators_init_default,
+	.frame = synapse_pb_Frame_init_default,
+	.sim_clock = synapse_pb_SimClock_init_default,
+	.sock = -1,
+	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
+	.stack_size = MY_STACK_SIZE,
+	.stack_area = g_my_stack_area,
+	.thread_data = {},
+};
+
+static int dream_hil_init(struct context *ctx)
+{
+	struct sockaddr_in addr = {
+		.sin_addr.s_addr = INADDR_ANY,
+		.sin_family = AF_INET,
+		.sin_port = htons(CONFIG_CEREBRI_DREAM_HIL_PORT),
+	};
+
+	ctx->sock = zsock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (ctx->sock < 0) {
+		LOG_ERR("failed to create UDP socket: %d", errno);
+		return -errno;
+	}
+	if (zsock_bind(ctx->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		LOG_ERR("failed to bind UDP socket: %d", errno);
+		int ret = -errno;
+		zsock_close(ctx->sock);
+		ctx->sock = -1;
+		return ret;
+	}
+
+	zros_node_init(&ctx->node, "dream_hil");
+	zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators, &ctx->actuators, 1000);
+	perf_duration_init(&ctx->round_trip, "hil round trip",
+			   CONFIG_CEREBRI_DREAM_HIL_REPLY_TIMEOUT_US * 1e-6);
+	k_sem_take(&ctx->running, K_FOREVER);
+	LOG_INF("init");
+	return 0;
+}
+
+static void dream_hil_fini(struct context *ctx)
+{
+	perf_duration_fini(&ctx->round_trip);
+	zros_sub_fini(&ctx->sub_actuators);
+	zros_node_fini(&ctx->node);
+	zsock_close(ctx->sock);
+	ctx->sock = -1;
+	k_sem_give(&ctx->running);
+	LOG_INF("fini");
+}
+
+#define HIL_STAMP(msg, time)                                                                       \
+	do {                                                                                       \
+		(msg)->has_stamp = true;                                                           \
+		(msg)->stamp = (time);                                                             \
+	} while (0)
+
+// publish one sensor frame of the step, false for a frame the stream does not carry
+static bool publish_sensor(struct context *ctx, synapse_pb_Frame *frame)
+{
+	switch (frame->which_msg) {
+	case synapse_pb_Frame_imu_tag:
+		HIL_STAMP(&frame->msg.imu, ctx->sim_clock.sim);
+		synapse_topic_republish(&topic_imu, &frame->msg.imu);
+		break;
+	case synapse_pb_Frame_magnetic_field_tag:
+		HIL_STAMP(&frame->msg.magnetic_field, ctx->sim_clock.sim);
+		synapse_topic_republish(&topic_magnetic_field, &frame->msg.magnetic_field);
+		break;
+	case synapse_pb_Frame_nav_sat_fix_tag:
+		HIL_STAMP(&frame->msg.nav_sat_fix, ctx->sim_clock.sim);
+		synapse_topic_republish(&topic_nav_sat_fix, &frame->msg.nav_sat_fix);
+		break;
+	case synapse_pb_Frame_battery_state_tag:
+		HIL_STAMP(&frame->msg.battery_state, ctx->sim_clock.sim);
+		synapse_topic_republish(&topic_battery_state, &frame->msg.battery_state);
+		break;
+	case synapse_pb_Frame_wheel_odometry_tag:
+		HIL_STAMP(&frame->msg.wheel_odometry, ctx->sim_clock.sim);
+		synapse_topic_republish(&topic_wheel_odometry, &frame->msg.wheel_odometry);
+		break;
+	default:
+		return false;
+	}
+	ctx->sensors++;
+	return true;
+}
+
+/*
+ * Decode and publish the whole step with the scheduler locked, so the
+ * consumers wake once with every sensor of the step already published.
+ */
+static bool handle_step(struct context *ctx, size_t size)
+{
+	pb_istream_t stream = pb_istream_from_buffer(ctx->rx_buf, size);
+	bool clock = false;
+
+	k_sched_lock();
+	while (stream.bytes_left > 0) {
+		if (!pb_decode_ex(&stream, synapse_pb_Frame_fields, &ctx->frame,
+				  PB_DECODE_DELIMITED)) {
+			LOG_ERR("failed to decode frame: %s", PB_GET_ERROR(&stream));
+			ctx->decode_errors++;
+			break;
+		}
+		if (ctx->frame.which_msg == synapse_pb_Frame_sim_clock_tag) {
+			ctx->sim_clock = ctx->frame.msg.sim_clock;
+			clock = true;
+		} else if (!publish_sensor(ctx, &ctx->frame)) {
+			LOG_DBG("unhandled frame: %d", ctx->frame.which_msg);
+		}
+	}
+	k_sched_unlock();
+	return clock;
+}
+
+static void send_reply(struct context *ctx)
 {
-	LOG_WRN("running HIL");
+	pb_ostream_t stream = pb_ostream_from_buffer(ctx->tx_buf, sizeof(ctx->tx_buf));
+
+	ctx->frame.which_msg = synapse_pb_Frame_actuators_tag;
+	ctx->frame.msg.actuators = ctx->actuators;
+	bool encoded = pb_encode_ex(&stream, synapse_pb_Frame_fields, &ctx->frame,
+				    PB_ENCODE_DELIMITED);
+	ctx->frame.which_msg = synapse_pb_Frame_sim_clock_tag;
+	ctx->frame.msg.sim_clock = ctx->sim_clock;
+	encoded = encoded && pb_encode_ex(&stream, synapse_pb_Frame_fields, &ctx->frame,
+					  PB_ENCODE_DELIMITED);
+	if (!encoded) {
+		LOG_ERR("encoding failed: %s", PB_GET_ERROR(&stream));
+		ctx->send_errors++;
+		return;
+	}
+
+	if (zsock_sendto(ctx->sock, ctx->tx_buf, stream.bytes_written, 0,
+			 (struct sockaddr *)&ctx->peer, ctx->peer_len) < 0) {
+		ctx->send_errors++;
+	}
 }
 
-// zephyr threads
-K_THREAD_DEFINE(zephyr_hil, MY_STACK_SIZE, zephyr_hil_entry_point, NULL, NULL, NULL, MY_PRIORITY, 0,
-		0);
+static void dream_hil_run(void *p0, void *p1, void *p2)
+{
+	struct context *ctx = p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	if (dream_hil_init(ctx) < 0) {
+		return;
+	}
+
+	struct k_poll_event events[] = {
+		*zros_sub_get_event(&ctx->sub_actuators),
+	};
+	struct zsock_pollfd fds[] = {
+		{ctx->sock, ZSOCK_POLLIN, 0},
+	};
+
+	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
+		int rc = zsock_poll(fds, ARRAY_SIZE(fds), 1000);
+		if (rc <= 0) {
+			if (rc < 0) {
+				LOG_ERR("poll failed: %d", errno);
+			}
+			continue;
+		}
+
+		ctx->peer_len = sizeof(ctx->peer);
+		int received = zsock_recvfrom(ctx->sock, ctx->rx_buf, sizeof(ctx->rx_buf),
+					      ZSOCK_MSG_DONTWAIT, (struct sockaddr *)&ctx->peer,
+					      &ctx->peer_len);
+		if (received <= 0) {
+			continue;
+		}
+		perf_duration_start(&ctx->round_trip);
+
+		// actuators of an earlier step must not answer this one
+		if (zros_sub_update_available(&ctx->sub_actuators)) {
+			zros_sub_update(&ctx->sub_actuators);
+		}
+
+		if (!handle_step(ctx, received)) {
+			// sensors without a step, nothing to answer
+			continue;
+		}
+		ctx->steps++;
+
+		rc = k_poll(events, ARRAY_SIZE(events),
+			    K_USEC(CONFIG_CEREBRI_DREAM_HIL_REPLY_TIMEOUT_US));
+		if (rc != 0) {
+			ctx->reply_timeouts++;
+			continue;
+		}
+		zros_sub_update(&ctx->sub_actuators);
+		send_reply(ctx);
+		perf_duration_stop(&ctx->round_trip);
+	}
+
+	dream_hil_fini(ctx);
+}
+
+static int start(struct context *ctx)
+{
+	k_tid_t tid = k_thread_create(&ctx->thread_data, ctx->stack_area, ctx->stack_size,
+				      dream_hil_run, ctx, NULL, NULL, MY_PRIORITY, 0, K_FOREVER);
+	k_thread_name_set(tid, "dream_hil");
+	k_thread_start(tid);
+	return 0;
+}
+
+static int dream_hil_cmd_handler(const struct shell *sh, size_t argc, char **argv, void *data)
+{
+	ARG_UNUSED(argc);
+	struct context *ctx = data;
+
+	if (strcmp(argv[0], "start") == 0) {
+		if (k_sem_count_get(&ctx->running) == 0) {
+			shell_print(sh, "already running");
+		} else {
+			start(ctx);
+		}
+	} else if (strcmp(argv[0], "stop") == 0) {
+		if (k_sem_count_get(&ctx->running) == 0) {
+			k_sem_give(&ctx->running);
+		} else {
+			shell_print(sh, "not running");
+		}
+	} else if (strcmp(argv[0], "status") == 0) {
+		shell_print(sh, "running: %d", (int)k_sem_count_get(&ctx->running) == 0);
+		shell_print(sh, "steps: %u sensors: %u decode errors: %u", ctx->steps,
+			    ctx->sensors, ctx->decode_errors);
+		shell_print(sh, "reply timeouts: %u send errors: %u", ctx->reply_timeouts,
+			    ctx->send_errors);
+		uint64_t count = ctx->round_trip.count;
+		shell_print(sh, "round trip us mean: %u max: %u",
+			    count > 0 ? k_cyc_to_us_floor32(ctx->round_trip.delta_cyc_sum / count)
+				      : 0,
+			    k_cyc_to_us_floor32(ctx->round_trip.max_duration_cyc));
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_DICT_SET_CREATE(sub_dream_hil, dream_hil_cmd_handler, (start, &g_ctx, "start"),
+			     (stop, &g_ctx, "stop"), (status, &g_ctx, "status"));
+
+SHELL_CMD_REGISTER(dream_hil, &sub_dream_hil, "dream_hil commands", NULL);
+
+static int dream_hil_sys_init(void)
+{
+	return start(&g_ctx);
+};
+
+SYS_INIT(dream_hil_sys_init, APPLICATION, 0);
 
 // vi: ts=4 sw=4 et
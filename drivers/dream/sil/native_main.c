@@ -13,8 +13,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include <zephyr/sys/ring_buffer.h>
 
+#include "sil_shm.h"
+
 // mutex locking is not necessary, as this is single threaded
 // and all consumers can only run while this process is sleeping
 
@@ -30,20 +33,44 @@ extern pthread_mutex_t g_lock_rx;
 
 volatile sig_atomic_t g_shutdown;
 
+#if !defined(CONFIG_CEREBRI_DREAM_SIL_SHM)
+// the udp pump, with shared memory the firmware moves the frames itself
 struct context {
 	const char *module_name;
 	int sock;
 	pthread_t thread;
 	struct sockaddr_in client_addr;
 	socklen_t client_addr_len;
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+	// written by the firmware once a step is queued, wakes the pump to send it
+	int tx_wake[2];
+#endif
 };
 
 static struct context g_ctx = {
 	.module_name = "dream_sil_native",
 	.sock = -1,
 	.thread = 0,
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+	.tx_wake = {-1, -1},
+#endif
 };
+#endif
+
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+void sil_tx_notify(void)
+{
+#if !defined(CONFIG_CEREBRI_DREAM_SIL_SHM)
+	// with shared memory sil_shm_write wakes the bridge itself
+	uint8_t c = 0;
+	if (g_ctx.tx_wake[1] >= 0) {
+		(void)write(g_ctx.tx_wake[1], &c, 1);
+	}
+#endif
+}
+#endif
 
+#if !defined(CONFIG_CEREBRI_DREAM_SIL_SHM)
 static void udp_init(struct context *ctx)
 {
 	printf("%s: sim core running\n", ctx->module_name);
@@ -77,6 +104,13 @@ static void udp_init(struct context *ctx)
 	ctx->client_addr.sin_family = AF_INET;
 	ctx->client_addr.sin_port = htons(GZ_PORT);
 	ctx->client_addr_len = sizeof(ctx->client_addr);
+
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+	if (pipe(ctx->tx_wake) < 0) {
+		printf("%s failed to create tx wake pipe: %d\n", ctx->module_name, errno);
+		exit(1);
+	}
+#endif
 }
 
 static void udp_tx(struct context *ctx)
@@ -97,6 +131,9 @@ static void udp_rx(struct context *ctx)
 {
 	struct pollfd pollfds[] = {
 		{ctx->sock, POLLIN | POLLHUP, 0},
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+		{ctx->tx_wake[0], POLLIN, 0},
+#endif
 	};
 
 	int ret = poll(pollfds, ARRAY_SIZE(pollfds), 1000);
@@ -109,15 +146,17 @@ static void udp_rx(struct context *ctx)
 		return;
 	};
 
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+	// the step is sent by udp_tx, only drain the wakeups here
+	if (pollfds[1].revents & POLLIN) {
+		uint8_t drain[64];
+		(void)read(ctx->tx_wake[0], drain, sizeof(drain));
+	}
+#endif
+
 	bool data_ready = false;
-	for (size_t i = 0; i < ARRAY_SIZE(pollfds); i++) {
-		if (pollfds[i].revents & POLLIN) {
-			data_ready = true;
-		}
-		if (pollfds[i].revents & POLLHUP) {
-			// disconnect
-			continue;
-		}
+	if (pollfds[0].revents & POLLIN) {
+		data_ready = true;
 	}
 
 	if (!data_ready) {
@@ -162,7 +201,22 @@ static void *native_sim_entry_point(void *p0)
 	exit(0);
 	return 0;
 }
+#endif
 
+#if defined(CONFIG_CEREBRI_DREAM_SIL_SHM)
+// the firmware reads and writes the shared rings itself, no pump thread
+static void native_sim_start_task(void)
+{
+	if (sil_shm_init() < 0) {
+		exit(1);
+	}
+}
+
+static void native_sim_stop_task(void)
+{
+	g_shutdown = 1;
+}
+#else
 static void native_sim_start_task(void)
 {
 	pthread_create(&g_ctx.thread, NULL, native_sim_entry_point, &g_ctx);
@@ -173,6 +227,7 @@ static void native_sim_stop_task(void)
 	g_shutdown = 1;
 	pthread_join(g_ctx.thread, NULL);
 }
+#endif
 
 // native tasks
 NATIVE_TASK(native_sim_start_task, PRE_BOOT_1, 0);
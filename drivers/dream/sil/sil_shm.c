@@ -0,0 +1,113 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <zephyr/sys/util.h>
+
+#include "sil_shm.h"
+
+// runs on the host, frames are copied straight between the rings and the
+// pb buffers of zephyr_main.c, without the ring_buf and socket hops
+
+static struct sil_shm *g_shm;
+
+static long futex(uint32_t *addr, int op, uint32_t val, const struct timespec *ts)
+{
+	return syscall(SYS_futex, addr, op, val, ts, NULL, 0);
+}
+
+int sil_shm_init(void)
+{
+	int fd = shm_open(CONFIG_CEREBRI_DREAM_SIL_SHM_NAME, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		printf("sil_shm: failed to open %s: %d\n", CONFIG_CEREBRI_DREAM_SIL_SHM_NAME,
+		       errno);
+		return -errno;
+	}
+	if (ftruncate(fd, sizeof(struct sil_shm)) < 0) {
+		printf("sil_shm: failed to size segment: %d\n", errno);
+		close(fd);
+		return -errno;
+	}
+	void *addr = mmap(NULL, sizeof(struct sil_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		printf("sil_shm: failed to map segment: %d\n", errno);
+		return -errno;
+	}
+	g_shm = addr;
+
+	// a segment the bridge already set up keeps its rings
+	if (__atomic_load_n(&g_shm->magic, __ATOMIC_ACQUIRE) != SIL_SHM_MAGIC) {
+		memset(g_shm, 0, sizeof(*g_shm));
+		g_shm->ring_size = SIL_SHM_RING_SIZE;
+		__atomic_store_n(&g_shm->magic, SIL_SHM_MAGIC, __ATOMIC_RELEASE);
+	}
+	printf("sil_shm: mapped %s\n", CONFIG_CEREBRI_DREAM_SIL_SHM_NAME);
+	return 0;
+}
+
+bool sil_shm_write(const uint8_t *buf, uint32_t len)
+{
+	struct sil_shm_ring *ring = &g_shm->to_sim;
+	uint32_t head = ring->head;
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (SIL_SHM_RING_SIZE - (head - tail) < len) {
+		ring->dropped++;
+		return false;
+	}
+
+	uint32_t start = head % SIL_SHM_RING_SIZE;
+	uint32_t first = MIN(len, SIL_SHM_RING_SIZE - start);
+	memcpy(&ring->data[start], buf, first);
+	memcpy(&ring->data[0], buf + first, len - first);
+	__atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+
+	__atomic_add_fetch(&ring->seq, 1, __ATOMIC_RELEASE);
+	futex(&ring->seq, FUTEX_WAKE, 1, NULL);
+	return true;
+}
+
+int sil_shm_read(uint8_t *buf, uint32_t len)
+{
+	struct sil_shm_ring *ring = &g_shm->to_board;
+	uint32_t tail = ring->tail;
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint32_t count = MIN(head - tail, len);
+
+	uint32_t start = tail % SIL_SHM_RING_SIZE;
+	uint32_t first = MIN(count, SIL_SHM_RING_SIZE - start);
+	memcpy(buf, &ring->data[start], first);
+	memcpy(buf + first, &ring->data[0], count - first);
+	__atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+	return count;
+}
+
+void sil_shm_wait(int timeout_ms)
+{
+	struct sil_shm_ring *ring = &g_shm->to_board;
+	uint32_t seq = __atomic_load_n(&ring->seq, __ATOMIC_ACQUIRE);
+
+	// the sim may have written since the last read, seq alone would miss it
+	if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail) {
+		return;
+	}
+	struct timespec ts = {
+		.tv_sec = timeout_ms / 1000,
+		.tv_nsec = (timeout_ms % 1000) * 1000000L,
+	};
+	futex(&ring->seq, FUTEX_WAIT, seq, &ts);
+}
+
+// vi: ts=4 sw=4 et
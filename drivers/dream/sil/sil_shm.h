@@ -0,0 +1,54 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_DREAM_SIL_SHM_H
+#define CEREBRI_DREAM_SIL_SHM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Layout of the shared memory segment between native_sim and the sim
+ * bridge, both sides map it and it must match theirs. Each direction is
+ * a single producer, single consumer byte ring carrying the same
+ * delimited synapse_pb frames as the UDP transport. head and tail count
+ * bytes and only ever grow, the producer copies a whole frame in before
+ * it publishes the new head, then bumps seq and wakes a waiting consumer
+ * through a futex on it.
+ */
+#define SIL_SHM_MAGIC     0x53494c31 // "SIL1"
+// a power of two, so positions stay valid as the counters wrap
+#define SIL_SHM_RING_SIZE (64 * 1024)
+
+struct sil_shm_ring {
+	uint32_t head;
+	uint32_t tail;
+	uint32_t seq;
+	uint32_t dropped;
+	uint8_t data[SIL_SHM_RING_SIZE];
+};
+
+struct sil_shm {
+	uint32_t magic;
+	uint32_t ring_size;
+	// firmware to sim, actuators and led_array
+	struct sil_shm_ring to_sim;
+	// sim to firmware, sim_clock and sensors
+	struct sil_shm_ring to_board;
+};
+
+// map the segment, creating it if the bridge has not yet
+int sil_shm_init(void);
+
+// queue a frame for the sim, all of it or nothing, false if it did not fit
+bool sil_shm_write(const uint8_t *buf, uint32_t len);
+
+// frames from the sim, at most len bytes
+int sil_shm_read(uint8_t *buf, uint32_t len);
+
+// block the host until the sim wrote or timeout_ms passed
+void sil_shm_wait(int timeout_ms);
+
+#endif // CEREBRI_DREAM_SIL_SHM_H
+// vi: ts=4 sw=4 et
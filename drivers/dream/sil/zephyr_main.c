@@ -21,8 +21,11 @@
 #include <zros/zros_sub.h>
 
 #include <synapse_topic_list.h>
+#include <cerebri/core/clock_sync.h>
 #include <cerebri/core/log_utils.h>
 
+#include "sil_shm.h"
+
 #define RX_BUF_SIZE   8192
 #define TX_BUF_SIZE   8192
 #define MY_STACK_SIZE 8192
@@ -40,34 +43,60 @@ static uint8_t g_pb_tx_buf[TX_BUF_SIZE];
 struct context {
 	int sock;
 	pthread_t thread;
+	struct zros_node node;
+	struct zros_sub sub_actuators, sub_led_array;
 	synapse_pb_Frame tx_frame, rx_frame;
 	synapse_pb_ClockOffset clock_offset;
 	bool clock_initialized;
 	uint64_t uptime_last;
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+	int64_t offset_ns;
+	uint32_t steps;
+	// steps that arrived with the board clock already past them
+	uint32_t steps_late;
+#endif
 };
 
 extern volatile sig_atomic_t g_shutdown;
 
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+// wakes the native pump to send what is queued, defined in native_main.c
+extern void sil_tx_notify(void);
+#endif
+
 void write_sim(const uint8_t *buf, uint32_t len)
 {
+#if defined(CONFIG_CEREBRI_DREAM_SIL_SHM)
+	if (!sil_shm_write(buf, len)) {
+		LOG_ERR("failed to send: %d bytes", len);
+	}
+#else
 	pthread_mutex_lock(&g_lock_tx);
 	int sent = ring_buf_put(&g_tx_buf, buf, len);
 	if (sent != len) {
 		LOG_ERR("failed to send: %d/%d", sent, len);
 	}
 	pthread_mutex_unlock(&g_lock_tx);
+#endif
 }
 
 int read_sim(uint8_t *buf, uint32_t len)
 {
+#if defined(CONFIG_CEREBRI_DREAM_SIL_SHM)
+	return sil_shm_read(buf, len);
+#else
 	pthread_mutex_lock(&g_lock_rx);
 	int recv = ring_buf_get(&g_rx_buf, buf, len);
 	pthread_mutex_unlock(&g_lock_rx);
 	return recv;
+#endif
 }
 
 struct context g_ctx = {.sock = -1,
 			.thread = 0,
+			.node = {},
+			.sub_actuators = {},
+			.sub_led_array = {},
 			.tx_frame = synapse_pb_Frame_init_default,
 			.rx_frame = synapse_pb_Frame_init_default,
 			.clock_offset = synapse_pb_ClockOffset_init_default,
@@ -87,6 +116,51 @@ static void send_frame(synapse_pb_Frame *frame)
 	}
 }
 
+static void send_outputs(struct context *ctx)
+{
+	// send actuators if subscription updated
+	if (zros_sub_update_available(&ctx->sub_actuators)) {
+		zros_sub_update(&ctx->sub_actuators);
+		ctx->tx_frame.which_msg = synapse_pb_Frame_actuators_tag;
+		send_frame(&ctx->tx_frame);
+	}
+
+	// send led_array if subscription updated
+	if (zros_sub_update_available(&ctx->sub_led_array)) {
+		zros_sub_update(&ctx->sub_led_array);
+		ctx->tx_frame.which_msg = synapse_pb_Frame_led_array_tag;
+		send_frame(&ctx->tx_frame);
+	}
+}
+
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+/*
+ * Advance the kernel clock to the sim time of the step. Every thread
+ * released before then runs to completion while this one sleeps, the
+ * clock does not move while any of them is running, so the outputs sent
+ * afterwards are exactly those of the step. The sim_clock frame goes back
+ * last to report the step done.
+ */
+static void lockstep(struct context *ctx, const synapse_pb_SimClock *sim_clock)
+{
+	int64_t sim_ns = sim_clock->sim.seconds * 1000000000LL + sim_clock->sim.nanos;
+	k_ticks_t target = k_ns_to_ticks_ceil64(MAX(sim_ns - ctx->offset_ns, 0));
+	if (target > k_uptime_ticks()) {
+		k_sleep(K_TIMEOUT_ABS_TICKS(target));
+	} else if (ctx->steps > 0) {
+		ctx->steps_late++;
+		LOG_DBG("step behind board clock by %lld ticks", k_uptime_ticks() - target);
+	}
+	ctx->steps++;
+
+	send_outputs(ctx);
+	ctx->tx_frame.which_msg = synapse_pb_Frame_sim_clock_tag;
+	ctx->tx_frame.msg.sim_clock = *sim_clock;
+	send_frame(&ctx->tx_frame);
+	sil_tx_notify();
+}
+#endif
+
 static void handle_frame(struct context *ctx)
 {
 	synapse_pb_Frame *frame = &ctx->rx_frame;
@@ -98,12 +172,25 @@ static void handle_frame(struct context *ctx)
 			LOG_INF("sim clock received sec: %lld nsec: %d", sim_clock->sim.seconds,
 				sim_clock->sim.nanos);
 			clock_offset->has_stamp = true;
-			stamp_msg(&clock_offset->stamp, k_uptime_ticks());
+			stamp_msg_now(&clock_offset->stamp);
 			clock_offset->offset.seconds = sim_clock->sim.seconds;
 			clock_offset->offset.nanos = sim_clock->sim.nanos;
 			zros_topic_publish(&topic_clock_offset_ethernet, clock_offset);
+			clock_sync_set_offset_ns(clock_offset->offset.seconds * 1000000000LL +
+						 clock_offset->offset.nanos);
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+			ctx->offset_ns = clock_offset->offset.seconds * 1000000000LL +
+					 clock_offset->offset.nanos;
+			ctx->steps = 0;
+			ctx->steps_late = 0;
+#endif
 		}
 
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+		lockstep(ctx, sim_clock);
+		return;
+#endif
+
 		// compute board time
 		uint64_t uptime = k_uptime_get();
 		int uptime_delta = uptime - ctx->uptime_last;
@@ -134,7 +221,7 @@ static void handle_frame(struct context *ctx)
 	} else if (frame->which_msg == synapse_pb_Frame_nav_sat_fix_tag) {
 		zros_topic_publish(&topic_nav_sat_fix, &frame->msg.nav_sat_fix);
 	} else if (frame->which_msg == synapse_pb_Frame_imu_tag) {
-		zros_topic_publish(&topic_imu, &frame->msg.imu);
+		synapse_seqlock_publish(&seqlock_imu, &frame->msg.imu);
 	} else if (frame->which_msg == synapse_pb_Frame_magnetic_field_tag) {
 		zros_topic_publish(&topic_magnetic_field, &frame->msg.magnetic_field);
 	} else if (frame->which_msg == synapse_pb_Frame_battery_state_tag) {
@@ -142,7 +229,7 @@ static void handle_frame(struct context *ctx)
 	} else if (frame->which_msg == synapse_pb_Frame_wheel_odometry_tag) {
 		zros_topic_publish(&topic_wheel_odometry, &frame->msg.wheel_odometry);
 	} else if (frame->which_msg == synapse_pb_Frame_odometry_tag) {
-		zros_topic_publish(&topic_odometry_ethernet, &frame->msg.odometry);
+		synapse_loan_publish_copy(&loan_odometry_ethernet, &frame->msg.odometry);
 	}
 }
 
@@ -154,12 +241,11 @@ static void zephyr_sim_entry_point(void *p0, void *p1, void *p2)
 	ARG_UNUSED(p1);
 	ARG_UNUSED(p2);
 
-	struct zros_node node;
-	struct zros_sub sub_actuators, sub_led_array;
-
-	zros_node_init(&node, "dream_sil");
-	zros_sub_init(&sub_actuators, &node, &topic_actuators, &ctx->tx_frame.msg.actuators, 10);
-	zros_sub_init(&sub_led_array, &node, &topic_led_array, &ctx->tx_frame.msg.led_array, 10);
+	zros_node_init(&ctx->node, "dream_sil");
+	zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators,
+		      &ctx->tx_frame.msg.actuators, 10);
+	zros_sub_init(&ctx->sub_led_array, &ctx->node, &topic_led_array,
+		      &ctx->tx_frame.msg.led_array, 10);
 
 	static uint8_t buf[RX_BUF_SIZE];
 	pb_istream_t stream;
@@ -177,20 +263,7 @@ static void zephyr_sim_entry_point(void *p0, void *p1, void *p2)
 			nanosleep(&request, &remaining);
 
 		} else {
-
-			// send actuators if subscription updated
-			if (zros_sub_update_available(&sub_actuators)) {
-				zros_sub_update(&sub_actuators);
-				ctx->tx_frame.which_msg = synapse_pb_Frame_actuators_tag;
-				send_frame(&ctx->tx_frame);
-			}
-
-			// send led_array if subscription updated
-			if (zros_sub_update_available(&sub_led_array)) {
-				zros_sub_update(&sub_led_array);
-				ctx->tx_frame.which_msg = synapse_pb_Frame_led_array_tag;
-				send_frame(&ctx->tx_frame);
-			}
+			send_outputs(ctx);
 		}
 
 		//  receive new messages
@@ -208,18 +281,26 @@ static void zephyr_sim_entry_point(void *p0, void *p1, void *p2)
 				}
 			}
 		} else {
+#if defined(CONFIG_CEREBRI_DREAM_SIL_SHM)
+			// woken as soon as the bridge writes
+			sil_shm_wait(1);
+#else
 			// wait for new meessage
 			struct timespec request, remaining;
 			request.tv_sec = 0;
 			request.tv_nsec = 1000000;
 			nanosleep(&request, &remaining);
+#endif
 		}
 	}
 	LOG_INF("finished\n");
+#if defined(CONFIG_CEREBRI_DREAM_SIL_LOCKSTEP)
+	LOG_INF("lockstep steps: %u late: %u", ctx->steps, ctx->steps_late);
+#endif
 
-	zros_sub_fini(&sub_actuators);
-	zros_sub_fini(&sub_led_array);
-	zros_node_fini(&node);
+	zros_sub_fini(&ctx->sub_actuators);
+	zros_sub_fini(&ctx->sub_led_array);
+	zros_node_fini(&ctx->node);
 }
 
 static int start()
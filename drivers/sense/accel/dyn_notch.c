@@ -0,0 +1,252 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <dsp/basic_math_functions.h>
+#include <dsp/complex_math_functions.h>
+
+#include "dyn_notch.h"
+
+LOG_MODULE_DECLARE(sense_accel);
+
+#define N           DYN_NOTCH_FFT_SIZE
+#define MIN_HZ      CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH_MIN_HZ
+#define MAX_HZ      CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH_MAX_HZ
+#define UPDATE_MS   CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH_UPDATE_MS
+#define Q           (CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH_Q / 10.0f)
+#define NOTCH_SHIFT 1
+// a peak has to stand this far above the mean of the searched band
+#define PEAK_RATIO  3.0f
+// weight of a new peak against the notch already at that slot
+#define FREQ_ALPHA  0.5f
+
+BUILD_ASSERT((N & (N - 1)) == 0, "fft size must be a power of two");
+
+extern struct k_work_q g_low_priority_work_q;
+
+static void dyn_notch_work_handler(struct k_work *work);
+
+static q31_t coeff_to_q31(float value)
+{
+	// coefficients are Q30 so the postshift of 1 gives a range of [-2, 2)
+	float scaled = value * (float)(1 << (31 - NOTCH_SHIFT));
+	if (scaled >= 2147483647.0f) {
+		return INT32_MAX;
+	} else if (scaled <= -2147483648.0f) {
+		return INT32_MIN;
+	}
+	return (q31_t)scaled;
+}
+
+/*
+ * RBJ notch, b = (1, -2 cos w0, 1), a = (1 + alpha, -2 cos w0, 1 - alpha),
+ * in the CMSIS order b0 b1 b2 -a1 -a2 normalized by a0. A centre of 0 is
+ * a pass through stage.
+ */
+static void notch_coeffs(q31_t coeffs[5], float freq_hz, float sample_hz)
+{
+	if (freq_hz <= 0) {
+		coeffs[0] = coeff_to_q31(1.0f);
+		coeffs[1] = coeffs[2] = coeffs[3] = coeffs[4] = 0;
+		return;
+	}
+	float w0 = 2.0f * PI * freq_hz / sample_hz;
+	float cos_w0 = cosf(w0);
+	float alpha = sinf(w0) / (2.0f * Q);
+	float a0 = 1.0f + alpha;
+	coeffs[0] = coeff_to_q31(1.0f / a0);
+	coeffs[1] = coeff_to_q31(-2.0f * cos_w0 / a0);
+	coeffs[2] = coeff_to_q31(1.0f / a0);
+	coeffs[3] = coeff_to_q31(2.0f * cos_w0 / a0);
+	coeffs[4] = coeff_to_q31(-(1.0f - alpha) / a0);
+}
+
+int dyn_notch_init(struct dyn_notch *notch)
+{
+	if (arm_rfft_fast_init_f32(&notch->rfft, N) != ARM_MATH_SUCCESS) {
+		LOG_ERR("no fft of size %d", N);
+		return -EINVAL;
+	}
+	for (int i = 0; i < N; i++) {
+		notch->hann[i] = 0.5f * (1.0f - cosf(2.0f * PI * i / (N - 1)));
+	}
+	for (int j = 0; j < 3; j++) {
+		struct dyn_notch_axis *axis = &notch->axis[j];
+		for (int k = 0; k < DYN_NOTCH_COUNT; k++) {
+			axis->freq_hz[k] = 0;
+			notch_coeffs(&axis->coeffs[0][5 * k], 0, 1);
+		}
+		axis->active = 0;
+		atomic_set(&axis->ready, 0);
+		arm_biquad_cascade_df1_init_q31(&axis->filter, DYN_NOTCH_COUNT, axis->coeffs[0],
+						axis->state, NOTCH_SHIFT);
+	}
+	notch->work_item = (struct workq_item)WORKQ_ITEM_INITIALIZER(
+		dyn_notch_work_handler, "sense_accel_notch", UPDATE_MS * 1000);
+	notch->head = 0;
+	notch->filled = 0;
+	notch->sample_hz = 0;
+	notch->next_axis = 0;
+	notch->next_ticks = 0;
+	notch->updates = 0;
+	notch->busy = 0;
+	perf_duration_init(&notch->duration, "sense_accel_notch", UPDATE_MS * 1e-3);
+	return 0;
+}
+
+void dyn_notch_update(struct dyn_notch *notch, q31_t *const in[3], uint32_t count, int8_t shift,
+		      uint32_t span_ns)
+{
+	for (int j = 0; j < 3; j++) {
+		struct dyn_notch_axis *axis = &notch->axis[j];
+		if (atomic_cas(&axis->ready, 1, 0)) {
+			axis->active ^= 1;
+			axis->filter.pCoeffs = axis->coeffs[axis->active];
+		}
+	}
+
+	if (count == 0) {
+		return;
+	}
+
+	float scale = ldexpf(1.0f, shift - 31);
+	k_spinlock_key_t key = k_spin_lock(&notch->lock);
+	if (count > 1 && span_ns > 0) {
+		float sample_hz = (count - 1) * 1e9f / span_ns;
+		notch->sample_hz = notch->sample_hz == 0
+					   ? sample_hz
+					   : 0.9f * notch->sample_hz + 0.1f * sample_hz;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		for (int j = 0; j < 3; j++) {
+			notch->window[j][notch->head] = in[j][i] * scale;
+		}
+		notch->head = (notch->head + 1) % N;
+	}
+	notch->filled = MIN(notch->filled + count, N);
+	bool full = notch->filled == N && notch->sample_hz > 0;
+	k_spin_unlock(&notch->lock, key);
+
+	int64_t now = k_uptime_ticks();
+	if (!full || now < notch->next_ticks) {
+		return;
+	}
+	notch->next_ticks = now + k_ms_to_ticks_ceil64(UPDATE_MS);
+	if (k_work_busy_get(&notch->work_item.work) != 0) {
+		// the low priority queue is behind, skip rather than pile up
+		notch->busy++;
+		return;
+	}
+	workq_submit(&g_low_priority_work_q, &notch->work_item);
+}
+
+void dyn_notch_filter(struct dyn_notch *notch, q31_t *const in[3], q31_t *const out[3],
+		      uint32_t count)
+{
+	for (int j = 0; j < 3; j++) {
+		arm_biquad_cascade_df1_fast_q31(&notch->axis[j].filter, in[j], out[j], count);
+	}
+}
+
+/*
+ * Up to DYN_NOTCH_COUNT local maxima of the magnitude between the band
+ * bins, strongest first, refined by a parabola through the neighbours.
+ */
+static int find_peaks(const float *mag, int lo, int hi, float bin_hz, float peaks[])
+{
+	float strength[DYN_NOTCH_COUNT];
+	float mean;
+	int found = 0;
+
+	arm_mean_f32(&mag[lo], hi - lo + 1, &mean);
+	for (int k = lo; k <= hi; k++) {
+		float m = mag[k];
+		if (m < PEAK_RATIO * mean || m <= mag[k - 1] || m < mag[k + 1]) {
+			continue;
+		}
+		// insertion into the strongest found so far
+		int pos = found;
+		while (pos > 0 && strength[pos - 1] < m) {
+			pos--;
+		}
+		if (pos >= DYN_NOTCH_COUNT) {
+			continue;
+		}
+		for (int i = MIN(found, DYN_NOTCH_COUNT - 1); i > pos; i--) {
+			strength[i] = strength[i - 1];
+			peaks[i] = peaks[i - 1];
+		}
+		float den = mag[k - 1] - 2.0f * m + mag[k + 1];
+		float offset = den != 0 ? 0.5f * (mag[k - 1] - mag[k + 1]) / den : 0;
+		strength[pos] = m;
+		peaks[pos] = (k + offset) * bin_hz;
+		found = MIN(found + 1, DYN_NOTCH_COUNT);
+	}
+	return found;
+}
+
+// one axis per run, so the cost of a run is one fft whatever the notch count
+static void dyn_notch_work_handler(struct k_work *work)
+{
+	struct dyn_notch *notch = CONTAINER_OF(work, struct dyn_notch, work_item.work);
+	int j = notch->next_axis;
+	struct dyn_notch_axis *axis = &notch->axis[j];
+
+	if (atomic_get(&axis->ready)) {
+		// the filter thread has not taken the last set yet
+		return;
+	}
+	notch->next_axis = (j + 1) % 3;
+	perf_duration_start(&notch->duration);
+
+	k_spinlock_key_t key = k_spin_lock(&notch->lock);
+	uint32_t head = notch->head;
+	float sample_hz = notch->sample_hz;
+	// oldest sample first
+	for (int i = 0; i < N; i++) {
+		notch->fft_in[i] = notch->window[j][(head + i) % N];
+	}
+	k_spin_unlock(&notch->lock, key);
+
+	arm_mult_f32(notch->fft_in, notch->hann, notch->fft_in, N);
+	arm_rfft_fast_f32(&notch->rfft, notch->fft_in, notch->fft_out, 0);
+	// bin 0 packs dc and nyquist, the band never reaches either
+	arm_cmplx_mag_f32(notch->fft_out, notch->mag, N / 2);
+
+	float bin_hz = sample_hz / N;
+	int lo = MAX((int)ceilf(MIN_HZ / bin_hz), 2);
+	int hi = MIN((int)(MIN(MAX_HZ, 0.45f * sample_hz) / bin_hz), N / 2 - 2);
+	float peaks[DYN_NOTCH_COUNT];
+	int found = lo < hi ? find_peaks(notch->mag, lo, hi, bin_hz, peaks) : 0;
+
+	// slots in frequency order, so a slot tracks the same peak across updates
+	for (int a = 1; a < found; a++) {
+		for (int b = a; b > 0 && peaks[b - 1] > peaks[b]; b--) {
+			float t = peaks[b];
+			peaks[b] = peaks[b - 1];
+			peaks[b - 1] = t;
+		}
+	}
+
+	q31_t *coeffs = axis->coeffs[axis->active ^ 1];
+	for (int k = 0; k < DYN_NOTCH_COUNT; k++) {
+		float freq = axis->freq_hz[k];
+		if (k < found) {
+			freq = freq > 0 ? freq + FREQ_ALPHA * (peaks[k] - freq) : peaks[k];
+		}
+		axis->freq_hz[k] = freq;
+		notch_coeffs(&coeffs[5 * k], freq, sample_hz);
+	}
+	atomic_set(&axis->ready, 1);
+
+	notch->updates++;
+	perf_duration_stop(&notch->duration);
+}
+
+// vi: ts=4 sw=4 et
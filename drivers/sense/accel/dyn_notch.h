@@ -0,0 +1,74 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CEREBRI_SENSE_ACCEL_DYN_NOTCH_H
+#define CEREBRI_SENSE_ACCEL_DYN_NOTCH_H
+
+#include <zephyr/kernel.h>
+
+#include <cerebri/core/perf_duration.h>
+#include <cerebri/core/workq.h>
+
+#include <dsp/filtering_functions.h>
+#include <dsp/transform_functions.h>
+
+#define DYN_NOTCH_FFT_SIZE CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH_FFT_SIZE
+#define DYN_NOTCH_COUNT    CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH_COUNT
+
+/*
+ * Notch bank of one gyro axis. The filter thread runs coeffs[active], the
+ * analysis writes the other set and raises ready, the filter thread swaps
+ * at the start of its next batch, so neither ever waits on the other.
+ */
+struct dyn_notch_axis {
+	arm_biquad_casd_df1_inst_q31 filter;
+	q31_t state[4 * DYN_NOTCH_COUNT];
+	q31_t coeffs[2][5 * DYN_NOTCH_COUNT];
+	int active;
+	atomic_t ready;
+	// centre of each notch, 0 while it passes through
+	float freq_hz[DYN_NOTCH_COUNT];
+};
+
+struct dyn_notch {
+	struct dyn_notch_axis axis[3];
+	struct workq_item work_item;
+	struct k_spinlock lock;
+	// ring of the latest raw samples, lock held by the writer and the copy
+	float window[3][DYN_NOTCH_FFT_SIZE];
+	uint32_t head;
+	uint32_t filled;
+	float sample_hz;
+	// analysis side, only touched by the work item
+	arm_rfft_fast_instance_f32 rfft;
+	float hann[DYN_NOTCH_FFT_SIZE];
+	float fft_in[DYN_NOTCH_FFT_SIZE];
+	float fft_out[DYN_NOTCH_FFT_SIZE];
+	float mag[DYN_NOTCH_FFT_SIZE / 2];
+	int next_axis;
+	int64_t next_ticks;
+	struct perf_duration duration;
+	uint32_t updates;
+	uint32_t busy;
+};
+
+int dyn_notch_init(struct dyn_notch *notch);
+
+/*
+ * Called by the filter thread once per batch with the raw gyro axes,
+ * count samples of the given q31 shift over span_ns between the first
+ * and last. Swaps in coefficients that are ready, keeps the window and
+ * queues the analysis of the next axis when it is due.
+ */
+void dyn_notch_update(struct dyn_notch *notch, q31_t *const in[3], uint32_t count, int8_t shift,
+		      uint32_t span_ns);
+
+// notch in to out for every axis, in is left as decoded
+void dyn_notch_filter(struct dyn_notch *notch, q31_t *const in[3], q31_t *const out[3],
+		      uint32_t count);
+
+#endif // CEREBRI_SENSE_ACCEL_DYN_NOTCH_H
+
+// vi: ts=4 sw=4 et
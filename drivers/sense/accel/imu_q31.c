@@ -0,0 +1,64 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "imu_q31.h"
+
+LOG_MODULE_DECLARE(sense_accel, CONFIG_CEREBRI_SENSE_ACCEL_LOG_LEVEL);
+
+#define BIAS_FRAMES CONFIG_CEREBRI_SENSE_ACCEL_Q31_BIAS_FRAMES
+#define ROTATION    CONFIG_CEREBRI_SENSE_ACCEL_Q31_YAW_DEG
+
+BUILD_ASSERT(ROTATION % 90 == 0, "only rotations by multiples of 90 degrees are exact in Q31");
+
+void imu_q31_bias_correct(struct imu_q31_bias *bias, q31_t *const axes[3], uint32_t count)
+{
+	if (!bias->ready) {
+		for (int j = 0; j < 3; j++) {
+			for (uint32_t i = 0; i < count; i++) {
+				bias->sum[j] += axes[j][i];
+			}
+		}
+		bias->frames += count;
+		if (bias->frames < BIAS_FRAMES) {
+			return;
+		}
+		for (int j = 0; j < 3; j++) {
+			bias->bias[j] = (q31_t)(bias->sum[j] / (int64_t)bias->frames);
+		}
+		bias->ready = true;
+		LOG_INF("gyro bias from %u frames: %d %d %d", bias->frames, bias->bias[0],
+			bias->bias[1], bias->bias[2]);
+	}
+	for (int j = 0; j < 3; j++) {
+		arm_offset_q31(axes[j], -bias->bias[j], axes[j], count);
+	}
+}
+
+void imu_q31_rotate(q31_t *const axes[3], q31_t *tmp, uint32_t count)
+{
+	ARG_UNUSED(tmp);
+#if ROTATION == 90
+	// x = -y, y = x
+	arm_copy_q31(axes[0], tmp, count);
+	arm_negate_q31(axes[1], axes[0], count);
+	arm_copy_q31(tmp, axes[1], count);
+#elif ROTATION == 180
+	arm_negate_q31(axes[0], axes[0], count);
+	arm_negate_q31(axes[1], axes[1], count);
+#elif ROTATION == 270
+	// x = y, y = -x
+	arm_copy_q31(axes[0], tmp, count);
+	arm_copy_q31(axes[1], axes[0], count);
+	arm_negate_q31(tmp, axes[1], count);
+#else
+	ARG_UNUSED(axes);
+	ARG_UNUSED(count);
+#endif
+}
+
+// vi: ts=4 sw=4 et
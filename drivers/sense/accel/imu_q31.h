@@ -0,0 +1,65 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CEREBRI_SENSE_ACCEL_IMU_Q31_H
+#define CEREBRI_SENSE_ACCEL_IMU_Q31_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <dsp/basic_math_functions.h>
+#include <dsp/support_functions.h>
+
+/*
+ * Fixed point side of the accel pipeline. Samples stay in the Q31 of the
+ * decoder with its shift, deltas are Q31 with the fixed shifts below, so
+ * the whole batch is integer math until the delta is handed to the
+ * estimator as float.
+ */
+
+// delta angle range +-4 rad, more than a batch turns at the gyro full scale
+#define IMU_Q31_ANGLE_SHIFT 2
+// delta velocity range +-16 m/s, 16 g over 100 ms
+#define IMU_Q31_VEL_SHIFT   4
+
+// gyro bias from the frames of the first seconds, the vehicle is still at boot
+struct imu_q31_bias {
+	int64_t sum[3];
+	uint32_t frames;
+	q31_t bias[3];
+	bool ready;
+};
+
+// add the frames of a batch until enough are in, then apply the bias in place
+void imu_q31_bias_correct(struct imu_q31_bias *bias, q31_t *const axes[3], uint32_t count);
+
+// rotate x and y of the sensor frame to the body frame in place, tmp holds count samples
+void imu_q31_rotate(q31_t *const axes[3], q31_t *tmp, uint32_t count);
+
+// seconds of dt_ns in Q31, dt_ns below 1 s, 2^62 / 1e9 avoids the division
+static inline q31_t imu_q31_dt(uint32_t dt_ns)
+{
+	return (q31_t)(((uint64_t)dt_ns * 4611686018ULL) >> 31);
+}
+
+// sample with its decoder shift times a Q31 dt, as a delta with out_shift
+static inline q31_t imu_q31_delta(q31_t sample, int8_t shift, q31_t dt, int out_shift)
+{
+	int64_t p = (int64_t)sample * dt;
+	int s = 31 + out_shift - shift;
+	return (q31_t)(s >= 0 ? p >> s : p << -s);
+}
+
+// a x b with a a delta angle, b keeps its own shift
+static inline void imu_q31_cross(const q31_t a[3], const q31_t b[3], q31_t out[3])
+{
+	const int s = 31 - IMU_Q31_ANGLE_SHIFT;
+	out[0] = (q31_t)((((int64_t)a[1] * b[2]) >> s) - (((int64_t)a[2] * b[1]) >> s));
+	out[1] = (q31_t)((((int64_t)a[2] * b[0]) >> s) - (((int64_t)a[0] * b[2]) >> s));
+	out[2] = (q31_t)((((int64_t)a[0] * b[1]) >> s) - (((int64_t)a[1] * b[0]) >> s));
+}
+
+#endif // CEREBRI_SENSE_ACCEL_IMU_Q31_H
+// vi: ts=4 sw=4 et
@@ -3,6 +3,8 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <math.h>
+
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/kernel.h>
@@ -18,27 +20,47 @@
 #include <zros/zros_sub.h>
 
 #include <cerebri/core/perf_counter.h>
+#include <cerebri/core/placement.h>
 #include <dsp/filtering_functions.h>
 
 #include <synapse_topic_list.h>
 
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH)
+#include "dyn_notch.h"
+#endif
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_Q31)
+#include "imu_q31.h"
+#endif
+
 #define MY_STACK_SIZE     8192
 #define MY_PRIORITY       1
 #define BATCH_DURATION    50
 #define FILTER_NUM_STAGES 2
-#define FILTER_BLOCK_SIZE 1
 #define FILTER_SHIFT      1
+#define FRAME_MAX         ARRAY_SIZE(((synapse_pb_ImuQ31Array *)NULL)->frame)
+// a longer gap between frames restarts the integration instead of spanning it
+#define FRAME_GAP_MAX_NS  10000000ULL
 
 LOG_MODULE_REGISTER(sense_accel, CONFIG_CEREBRI_SENSE_ACCEL_LOG_LEVEL);
 
-static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+static CEREBRI_HOT_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+
+// one fifo batch of a sensor, an array per axis so each axis filters in one block call
+struct axis_batch {
+	q31_t in[3][FRAME_MAX];
+	q31_t out[3][FRAME_MAX];
+	// from the first frame of the batch
+	uint32_t delta_nanos[FRAME_MAX];
+	uint32_t count;
+	int8_t shift;
+	uint64_t base_timestamp_ns;
+};
 
 // private context
 struct context {
 	struct zros_node node;
 	synapse_pb_ImuQ31Array imu_q31_array;
 	synapse_pb_Imu imu;
-	struct zros_pub pub_imu;
 	struct zros_pub pub_imu_q31_array;
 	struct k_sem running;
 	size_t stack_size;
@@ -53,12 +75,25 @@ struct context {
 	arm_biquad_casd_df1_inst_q31 accel_filter[3];
 	q31_t gyro_filter_state[3][4 * FILTER_NUM_STAGES];
 	arm_biquad_casd_df1_inst_q31 gyro_filter[3];
+	struct axis_batch accel_batch;
+	struct axis_batch gyro_batch;
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH)
+	struct dyn_notch gyro_notch;
+#endif
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_Q31)
+	struct imu_q31_bias gyro_bias;
+#endif
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DELTA)
+	struct synapse_imu_delta imu_delta;
+	struct zros_pub pub_imu_delta;
+	// sensor time of the last frame integrated, 0 before the first
+	uint64_t last_frame_ns;
+#endif
 };
 
 // private initialization
-static struct context g_ctx = {
+static struct context g_ctx CEREBRI_HOT_CONTEXT = {
 	.node = {},
-	.pub_imu = {},
 	.pub_imu_q31_array = {},
 	.imu = {.has_stamp = true, .has_angular_velocity = true, .has_linear_acceleration = true},
 	.imu_q31_array =
@@ -91,6 +126,9 @@ static struct context g_ctx = {
 	.accel_filter = {},
 	.gyro_filter_state = {},
 	.gyro_filter = {},
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_Q31)
+	.gyro_bias = {},
+#endif
 };
 
 static RTIO_IODEV_DEFINE(iodev_accel_stream, &__sensor_iodev_api, &g_ctx.stream_config);
@@ -100,10 +138,13 @@ RTIO_DEFINE_WITH_MEMPOOL(accel_rtio, 4, 4, 32, 64, 4);
 static int sense_accel_init(struct context *ctx)
 {
 	zros_node_init(&ctx->node, "sense_accel");
-	zros_pub_init(&ctx->pub_imu, &ctx->node, &topic_imu, &ctx->imu);
 	zros_pub_init(&ctx->pub_imu_q31_array, &ctx->node, &topic_imu_q31_array,
 		      &ctx->imu_q31_array);
 	perf_counter_init(&ctx->perf, "sense_accel", 1.0 / 100);
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DELTA)
+	zros_pub_init(&ctx->pub_imu_delta, &ctx->node, &topic_imu_delta, &ctx->imu_delta);
+	ctx->last_frame_ns = 0;
+#endif
 
 	for (int i = 0; i < 3; i++) {
 		LOG_INF("initializing channel: %d", i);
@@ -114,6 +155,9 @@ static int sense_accel_init(struct context *ctx)
 						ctx->filter_coeffs, ctx->gyro_filter_state[i],
 						FILTER_SHIFT);
 	}
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH)
+	dyn_notch_init(&ctx->gyro_notch);
+#endif
 
 	ctx->stream_config.count = 1;
 
@@ -152,8 +196,10 @@ double q31_to_double(int32_t q31_value, int8_t shift)
 static void sense_accel_fini(struct context *ctx)
 {
 	perf_counter_fini(&ctx->perf);
-	zros_pub_fini(&ctx->pub_imu);
 	zros_pub_fini(&ctx->pub_imu_q31_array);
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DELTA)
+	zros_pub_fini(&ctx->pub_imu_delta);
+#endif
 	zros_node_fini(&ctx->node);
 
 	if (ctx->streaming_handle != NULL) {
@@ -165,17 +211,212 @@ static void sense_accel_fini(struct context *ctx)
 	LOG_INF("fini");
 }
 
-static void accel_processing_callback(int result, uint8_t *buf, uint32_t buf_len, void *userdata)
+/*
+ * Decode as many fifo frames per call as the decoder gives, straight into
+ * the per axis arrays of the batch.
+ */
+static void decode_batch(const struct sensor_decoder_api *decoder, const uint8_t *buf,
+			 struct sensor_chan_spec ch, struct axis_batch *batch)
+{
+	static union {
+		struct sensor_three_axis_data data;
+		uint8_t buf[sizeof(struct sensor_three_axis_data) +
+			    (FRAME_MAX - 1) * sizeof(struct sensor_three_axis_sample_data)];
+	} decoded;
+	uint32_t fit = 0;
+	int n;
+
+	batch->count = 0;
+	while (batch->count < FRAME_MAX &&
+	       (n = decoder->decode(buf, ch, &fit, FRAME_MAX - batch->count, &decoded.data)) > 0) {
+		const struct sensor_three_axis_data *data = &decoded.data;
+		if (batch->count == 0) {
+			batch->base_timestamp_ns = data->header.base_timestamp_ns;
+			batch->shift = data->shift;
+		}
+		// deltas are kept relative to the first frame of the batch
+		uint64_t offset = data->header.base_timestamp_ns - batch->base_timestamp_ns;
+		for (int k = 0; k < n; k++) {
+			uint32_t idx = batch->count + k;
+			batch->in[0][idx] = data->readings[k].values[0];
+			batch->in[1][idx] = data->readings[k].values[1];
+			batch->in[2][idx] = data->readings[k].values[2];
+			batch->delta_nanos[idx] = offset + data->readings[k].timestamp_delta;
+		}
+		batch->count += n;
+	}
+	if (batch->count == FRAME_MAX && decoder->decode(buf, ch, &fit, 1, &decoded.data) > 0) {
+		LOG_ERR("frame overflow");
+	}
+}
+
+// src is in, or out when an earlier stage already wrote it
+static void filter_batch(arm_biquad_casd_df1_inst_q31 filter[3], q31_t src[3][FRAME_MAX],
+			 struct axis_batch *batch)
+{
+	for (int j = 0; j < 3; j++) {
+		arm_biquad_cascade_df1_fast_q31(&filter[j], src[j], batch->out[j], batch->count);
+	}
+}
+
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DELTA) && defined(CONFIG_CEREBRI_SENSE_ACCEL_Q31)
+/*
+ * integrate_batch in Q31, the same coning and sculling terms with every
+ * sum a delta of fixed shift and the cross products in 64 bit, only the
+ * published delta is converted to float.
+ */
+static void integrate_batch(struct context *ctx)
+{
+	const struct axis_batch *gyro = &ctx->gyro_batch;
+	const struct axis_batch *accel = &ctx->accel_batch;
+	uint32_t count = MIN(gyro->count, accel->count);
+	q31_t alpha[3] = {}, beta[3] = {}, v[3] = {}, scul[3] = {};
+	q31_t dalpha_prev[3] = {};
+	uint64_t start_ns = ctx->last_frame_ns;
+	uint16_t frames = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t t_ns = gyro->base_timestamp_ns + gyro->delta_nanos[i];
+		if (ctx->last_frame_ns == 0 || t_ns <= ctx->last_frame_ns ||
+		    t_ns - ctx->last_frame_ns > FRAME_GAP_MAX_NS) {
+			if (frames == 0) {
+				start_ns = t_ns;
+			}
+			ctx->last_frame_ns = t_ns;
+			continue;
+		}
+		q31_t dt = imu_q31_dt(t_ns - ctx->last_frame_ns);
+		ctx->last_frame_ns = t_ns;
+
+		q31_t dalpha[3], dv[3];
+		for (int j = 0; j < 3; j++) {
+			dalpha[j] = imu_q31_delta(gyro->in[j][i], gyro->shift, dt,
+						  IMU_Q31_ANGLE_SHIFT);
+			dv[j] = imu_q31_delta(accel->in[j][i], accel->shift, dt, IMU_Q31_VEL_SHIFT);
+		}
+
+		q31_t a6[3], coning[3], scul_a[3], scul_v[3];
+		for (int j = 0; j < 3; j++) {
+			a6[j] = alpha[j] + dalpha_prev[j] / 6;
+		}
+		imu_q31_cross(a6, dalpha, coning);
+		imu_q31_cross(alpha, dv, scul_a);
+		// v x dalpha = -(dalpha x v), keeps the delta angle first
+		imu_q31_cross(dalpha, v, scul_v);
+		for (int j = 0; j < 3; j++) {
+			beta[j] += coning[j] / 2;
+			scul[j] += (scul_a[j] - scul_v[j]) / 2;
+			alpha[j] += dalpha[j];
+			v[j] += dv[j];
+			dalpha_prev[j] = dalpha[j];
+		}
+		frames++;
+	}
+
+	if (frames == 0) {
+		return;
+	}
+
+	q31_t rot[3];
+	imu_q31_cross(alpha, v, rot);
+	struct synapse_imu_delta *delta = &ctx->imu_delta;
+	for (int j = 0; j < 3; j++) {
+		delta->delta_angle[j] = ldexpf(alpha[j] + beta[j], IMU_Q31_ANGLE_SHIFT - 31);
+		delta->delta_velocity[j] =
+			ldexpf(v[j] + rot[j] / 2 + scul[j], IMU_Q31_VEL_SHIFT - 31);
+	}
+	delta->stamp_ns = ctx->last_frame_ns;
+	delta->dt_ns = ctx->last_frame_ns - start_ns;
+	delta->frame_count = frames;
+	zros_pub_update(&ctx->pub_imu_delta);
+}
+#elif defined(CONFIG_CEREBRI_SENSE_ACCEL_DELTA)
+static void cross(const float a[3], const float b[3], float out[3])
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/*
+ * Integrate every frame of the batch since the last one integrated, with
+ * the coning and sculling terms of Savage's algorithm at the fifo rate,
+ * alpha and v being the plain sums before frame k:
+ *
+ *   beta  += 1/2 (alpha + 1/6 dalpha[k-1]) x dalpha[k]
+ *   scul  += 1/2 (alpha x dv[k] + v x dalpha[k])
+ *   dtheta = alpha + beta
+ *   dvel   = v + 1/2 alpha x v + scul
+ *
+ * Raw samples are used, the integral is its own anti-alias filter.
+ */
+static void integrate_batch(struct context *ctx)
 {
-	static uint8_t decoded_buffer[127];
-	static struct {
-		uint64_t base_timestamp_ns;
-		int count;
-		uint64_t timestamp_delta;
-		int64_t values[3];
-		int8_t shift;
-	} accumulator_buffer;
+	const struct axis_batch *gyro = &ctx->gyro_batch;
+	const struct axis_batch *accel = &ctx->accel_batch;
+	uint32_t count = MIN(gyro->count, accel->count);
+	float alpha[3] = {}, beta[3] = {}, v[3] = {}, scul[3] = {};
+	float dalpha_prev[3] = {};
+	uint64_t start_ns = ctx->last_frame_ns;
+	uint16_t frames = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t t_ns = gyro->base_timestamp_ns + gyro->delta_nanos[i];
+		if (ctx->last_frame_ns == 0 || t_ns <= ctx->last_frame_ns ||
+		    t_ns - ctx->last_frame_ns > FRAME_GAP_MAX_NS) {
+			// no interval to integrate over yet, start from this frame
+			if (frames == 0) {
+				start_ns = t_ns;
+			}
+			ctx->last_frame_ns = t_ns;
+			continue;
+		}
+		float dt = (t_ns - ctx->last_frame_ns) * 1e-9f;
+		ctx->last_frame_ns = t_ns;
+
+		float dalpha[3], dv[3];
+		for (int j = 0; j < 3; j++) {
+			dalpha[j] = (float)q31_to_double(gyro->in[j][i], gyro->shift) * dt;
+			dv[j] = (float)q31_to_double(accel->in[j][i], accel->shift) * dt;
+		}
+
+		float a6[3], coning[3], scul_a[3], scul_v[3];
+		for (int j = 0; j < 3; j++) {
+			a6[j] = alpha[j] + dalpha_prev[j] / 6.0f;
+		}
+		cross(a6, dalpha, coning);
+		cross(alpha, dv, scul_a);
+		cross(v, dalpha, scul_v);
+		for (int j = 0; j < 3; j++) {
+			beta[j] += 0.5f * coning[j];
+			scul[j] += 0.5f * (scul_a[j] + scul_v[j]);
+			alpha[j] += dalpha[j];
+			v[j] += dv[j];
+			dalpha_prev[j] = dalpha[j];
+		}
+		frames++;
+	}
+
+	if (frames == 0) {
+		return;
+	}
 
+	float rot[3];
+	cross(alpha, v, rot);
+	struct synapse_imu_delta *delta = &ctx->imu_delta;
+	for (int j = 0; j < 3; j++) {
+		delta->delta_angle[j] = alpha[j] + beta[j];
+		delta->delta_velocity[j] = v[j] + 0.5f * rot[j] + scul[j];
+	}
+	delta->stamp_ns = ctx->last_frame_ns;
+	delta->dt_ns = ctx->last_frame_ns - start_ns;
+	delta->frame_count = frames;
+	zros_pub_update(&ctx->pub_imu_delta);
+}
+#endif
+
+static void accel_processing_callback(int result, uint8_t *buf, uint32_t buf_len, void *userdata)
+{
 	if (result < 0) {
 		LOG_ERR("read failed");
 		return;
@@ -195,144 +436,85 @@ static void accel_processing_callback(int result, uint8_t *buf, uint32_t buf_len
 		return;
 	}
 
-	int channels[] = {
-		SENSOR_CHAN_GYRO_XYZ,
-		SENSOR_CHAN_ACCEL_XYZ,
-	};
-	bool gyro_updated = false;
-	bool accel_updated = false;
-
-	ctx->imu_q31_array.frame_count = 0;
-
-	for (int i = 0; i < ARRAY_SIZE(channels); i++) {
-		int chan = channels[i];
-		struct sensor_chan_spec ch = {
-			.chan_idx = 0,
-			.chan_type = chan,
-		};
-
-		uint32_t fit = 0;
-		uint32_t frame_idx = 0;
-		memset(&accumulator_buffer, 0, sizeof(accumulator_buffer));
-		while (decoder->decode(buf, ch, &fit, 1, decoded_buffer) > 0) {
-			if (accumulator_buffer.count >= 127) {
-				LOG_ERR("fifo overflow: %d", accumulator_buffer.count);
-				break;
-			}
-
-			if (ch.chan_type == SENSOR_CHAN_GYRO_XYZ ||
-			    ch.chan_type == SENSOR_CHAN_ACCEL_XYZ) {
-				struct sensor_three_axis_data *data =
-					(struct sensor_three_axis_data *)decoded_buffer;
-				if (accumulator_buffer.count == 0) {
-					accumulator_buffer.base_timestamp_ns =
-						data->header.base_timestamp_ns;
-					accumulator_buffer.timestamp_delta =
-						data->readings[0].timestamp_delta;
-					accumulator_buffer.shift = data->shift;
-					if (ch.chan_type == SENSOR_CHAN_GYRO_XYZ) {
-						ctx->imu_q31_array.gyro_shift = data->shift;
-					} else if (ch.chan_type == SENSOR_CHAN_ACCEL_XYZ) {
-						ctx->imu_q31_array.accel_shift = data->shift;
-					}
-				}
-				accumulator_buffer.values[0] += data->readings[0].values[0];
-				accumulator_buffer.values[1] += data->readings[0].values[1];
-				accumulator_buffer.values[2] += data->readings[0].values[2];
-				accumulator_buffer.count++;
-
-				if (ch.chan_type == SENSOR_CHAN_GYRO_XYZ) {
-					ctx->imu_q31_array.frame[frame_idx].gyro_x =
-						data->readings[0].values[0];
-					ctx->imu_q31_array.frame[frame_idx].gyro_y =
-						data->readings[0].values[1];
-					ctx->imu_q31_array.frame[frame_idx].gyro_z =
-						data->readings[0].values[2];
-					ctx->imu_q31_array.frame[frame_idx].delta_nanos =
-						data->readings[0].timestamp_delta;
-				} else if (ch.chan_type == SENSOR_CHAN_ACCEL_XYZ) {
-					ctx->imu_q31_array.frame[frame_idx].accel_x =
-						data->readings[0].values[0];
-					ctx->imu_q31_array.frame[frame_idx].accel_y =
-						data->readings[0].values[1];
-					ctx->imu_q31_array.frame[frame_idx].accel_z =
-						data->readings[0].values[2];
-					ctx->imu_q31_array.frame[frame_idx].delta_nanos =
-						data->readings[0].timestamp_delta;
-				}
-			}
-
-			if (frame_idx > ctx->imu_q31_array.frame_count) {
-				ctx->imu_q31_array.frame_count = frame_idx;
-			}
-			if (frame_idx++ >= ARRAY_SIZE(ctx->imu_q31_array.frame)) {
-				LOG_ERR("frame overflow");
-				break;
-			}
-		}
-
-		// double x = q31_to_double(accumulator_buffer.values[0] / accumulator_buffer.count,
-		// accumulator_buffer.shift); double y = q31_to_double(accumulator_buffer.values[1]
-		// / accumulator_buffer.count, accumulator_buffer.shift); double z =
-		// q31_to_double(accumulator_buffer.values[2] / accumulator_buffer.count,
-		// accumulator_buffer.shift);
-		synapse_pb_Timestamp stamp;
-		synapse_pb_Duration delta;
-		stamp.seconds = accumulator_buffer.base_timestamp_ns / 1e9;
-		stamp.nanos = accumulator_buffer.base_timestamp_ns - stamp.seconds * 1e9;
-		delta.seconds = accumulator_buffer.timestamp_delta / 1e9;
-		delta.nanos = accumulator_buffer.timestamp_delta - delta.seconds * 1e9;
-
-		if (ch.chan_type == SENSOR_CHAN_GYRO_XYZ) {
-			// LOG_INF("gyro %10.4f %10.4f %10.4f", x, y, z);
-			ctx->imu_q31_array.stamp = stamp;
-			// ctx->imu.angular_velocity.x = x;
-			// ctx->imu.angular_velocity.y = y;
-			// ctx->imu.angular_velocity.z = z;
-			ctx->imu.stamp = stamp;
-			gyro_updated = true;
-		} else if (ch.chan_type == SENSOR_CHAN_ACCEL_XYZ) {
-			ctx->imu_q31_array.stamp = stamp;
-			// ctx->imu.linear_acceleration.x = x;
-			// ctx->imu.linear_acceleration.y = y;
-			// ctx->imu.linear_acceleration.z = z;
-			ctx->imu.stamp = stamp;
-			accel_updated = true;
-		}
+	struct axis_batch *gyro = &ctx->gyro_batch;
+	struct axis_batch *accel = &ctx->accel_batch;
+	struct sensor_chan_spec gyro_ch = {.chan_idx = 0, .chan_type = SENSOR_CHAN_GYRO_XYZ};
+	struct sensor_chan_spec accel_ch = {.chan_idx = 0, .chan_type = SENSOR_CHAN_ACCEL_XYZ};
+
+	decode_batch(decoder, buf, gyro_ch, gyro);
+	decode_batch(decoder, buf, accel_ch, accel);
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_Q31)
+	// body frame and bias corrected from here on, out is scratch until filtering
+	q31_t *const gyro_axes[3] = {gyro->in[0], gyro->in[1], gyro->in[2]};
+	q31_t *const accel_axes[3] = {accel->in[0], accel->in[1], accel->in[2]};
+	imu_q31_rotate(gyro_axes, gyro->out[0], gyro->count);
+	imu_q31_rotate(accel_axes, accel->out[0], accel->count);
+	imu_q31_bias_correct(&ctx->gyro_bias, gyro_axes, gyro->count);
+#endif
+	if (gyro->count > 0) {
+		ctx->imu_q31_array.gyro_shift = gyro->shift;
+	}
+	if (accel->count > 0) {
+		ctx->imu_q31_array.accel_shift = accel->shift;
 	}
 
-	q31_t accel_out[3] = {};
-	q31_t gyro_out[3] = {};
-	q31_t accel_in[3] = {};
-	q31_t gyro_in[3] = {};
-
-	for (int i = 0; i < ctx->imu_q31_array.frame_count; i++) {
-		accel_in[0] = ctx->imu_q31_array.frame[i].accel_x;
-		accel_in[1] = ctx->imu_q31_array.frame[i].accel_y;
-		accel_in[2] = ctx->imu_q31_array.frame[i].accel_z;
-		gyro_in[0] = ctx->imu_q31_array.frame[i].gyro_x;
-		gyro_in[1] = ctx->imu_q31_array.frame[i].gyro_y;
-		gyro_in[2] = ctx->imu_q31_array.frame[i].gyro_z;
-		for (int j = 0; j < 3; j++) {
-			arm_biquad_cascade_df1_fast_q31(&ctx->accel_filter[j], &accel_in[j],
-							&accel_out[j], FILTER_BLOCK_SIZE);
-			arm_biquad_cascade_df1_fast_q31(&ctx->gyro_filter[j], &gyro_in[j],
-							&gyro_out[j], FILTER_BLOCK_SIZE);
-		}
+	// the raw batch goes out as frames, built from the axis arrays
+	uint32_t frame_count = MAX(gyro->count, accel->count);
+	for (uint32_t i = 0; i < frame_count; i++) {
+		synapse_pb_ImuQ31Array_Frame *frame = &ctx->imu_q31_array.frame[i];
+		frame->gyro_x = i < gyro->count ? gyro->in[0][i] : 0;
+		frame->gyro_y = i < gyro->count ? gyro->in[1][i] : 0;
+		frame->gyro_z = i < gyro->count ? gyro->in[2][i] : 0;
+		frame->accel_x = i < accel->count ? accel->in[0][i] : 0;
+		frame->accel_y = i < accel->count ? accel->in[1][i] : 0;
+		frame->accel_z = i < accel->count ? accel->in[2][i] : 0;
+		frame->delta_nanos =
+			i < accel->count ? accel->delta_nanos[i] : gyro->delta_nanos[i];
+	}
+	ctx->imu_q31_array.frame_count = frame_count;
+
+	// the accel batch is decoded last, its stamp is the one published as before
+	struct axis_batch *stamped = accel->count > 0 ? accel : gyro;
+	synapse_pb_Timestamp stamp;
+	stamp_msg_ns(&stamp, stamped->base_timestamp_ns);
+	ctx->imu_q31_array.stamp = stamp;
+	ctx->imu.stamp = stamp;
+
+	// a whole batch per axis in one call lets CMSIS-DSP use its block and SIMD paths
+	if (gyro->count > 0) {
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH)
+		// notches in to out, then the low pass in place, in stays raw for the deltas
+		q31_t *const gyro_in[3] = {gyro->in[0], gyro->in[1], gyro->in[2]};
+		q31_t *const gyro_out[3] = {gyro->out[0], gyro->out[1], gyro->out[2]};
+		uint32_t span_ns = gyro->delta_nanos[gyro->count - 1] - gyro->delta_nanos[0];
+		dyn_notch_update(&ctx->gyro_notch, gyro_in, gyro->count, gyro->shift, span_ns);
+		dyn_notch_filter(&ctx->gyro_notch, gyro_in, gyro_out, gyro->count);
+		filter_batch(ctx->gyro_filter, gyro->out, gyro);
+#else
+		filter_batch(ctx->gyro_filter, gyro->in, gyro);
+#endif
+		uint32_t last = gyro->count - 1;
+		int8_t shift = gyro->shift;
+		ctx->imu.angular_velocity.x = q31_to_double(gyro->out[0][last], shift);
+		ctx->imu.angular_velocity.y = q31_to_double(gyro->out[1][last], shift);
+		ctx->imu.angular_velocity.z = q31_to_double(gyro->out[2][last], shift);
+	}
+	if (accel->count > 0) {
+		filter_batch(ctx->accel_filter, accel->in, accel);
+		uint32_t last = accel->count - 1;
+		int8_t shift = accel->shift;
+		ctx->imu.linear_acceleration.x = q31_to_double(accel->out[0][last], shift);
+		ctx->imu.linear_acceleration.y = q31_to_double(accel->out[1][last], shift);
+		ctx->imu.linear_acceleration.z = q31_to_double(accel->out[2][last], shift);
 	}
-	ctx->imu.angular_velocity.x = q31_to_double(gyro_out[0], ctx->imu_q31_array.gyro_shift);
-	ctx->imu.angular_velocity.y = q31_to_double(gyro_out[1], ctx->imu_q31_array.gyro_shift);
-	ctx->imu.angular_velocity.z = q31_to_double(gyro_out[2], ctx->imu_q31_array.gyro_shift);
-
-	ctx->imu.linear_acceleration.x =
-		q31_to_double(accel_out[0], ctx->imu_q31_array.accel_shift);
-	ctx->imu.linear_acceleration.y =
-		q31_to_double(accel_out[1], ctx->imu_q31_array.accel_shift);
-	ctx->imu.linear_acceleration.z =
-		q31_to_double(accel_out[2], ctx->imu_q31_array.accel_shift);
-
-	if (gyro_updated || accel_updated) {
-		zros_pub_update(&ctx->pub_imu);
+
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DELTA)
+	// ahead of the imu, so a consumer woken by the imu finds the delta of its batch
+	integrate_batch(ctx);
+#endif
+
+	if (frame_count > 0) {
+		synapse_seqlock_publish(&seqlock_imu, &ctx->imu);
 		zros_pub_update(&ctx->pub_imu_q31_array);
 	}
 }
@@ -356,7 +538,7 @@ static void sense_accel_run(void *p0, void *p1, void *p2)
 		LOG_INF("publishing");
 
 		ctx->accel_array.has_stamp = true;
-		stamp_msg(&ctx->accel_array.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->accel_array.stamp);
 		ctx->accel_array.value_count = 2;
 		ctx->accel_array.value[0].x = 1;
 		ctx->accel_array.value[0].y = 2;
@@ -404,6 +586,17 @@ static int sense_accel_cmd_handler(const struct shell *sh, size_t argc, char **a
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+#if defined(CONFIG_CEREBRI_SENSE_ACCEL_DYN_NOTCH)
+		struct dyn_notch *notch = &ctx->gyro_notch;
+		shell_print(sh, "notch sample rate: %.1f Hz, updates: %u, busy: %u",
+			    (double)notch->sample_hz, notch->updates, notch->busy);
+		for (int j = 0; j < 3; j++) {
+			for (int k = 0; k < DYN_NOTCH_COUNT; k++) {
+				shell_print(sh, "notch axis %d, %d: %.1f Hz", j, k,
+					    (double)notch->axis[j].freq_hz[k]);
+			}
+		}
+#endif
 	}
 	return 0;
 }
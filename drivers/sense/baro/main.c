@@ -12,24 +12,73 @@
 
 #include <synapse_topic_list.h>
 
+#include <cerebri/core/workq.h>
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+#include <cerebri/core/sensor_sched.h>
+#endif
+
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/logging/log.h>
 
 #include <math.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(sense_baro, CONFIG_CEREBRI_SENSE_BARO_LOG_LEVEL);
 
 #define MY_STACK_SIZE 4096
 #define MY_PRIORITY   6
+#define PERIOD_MS     CONFIG_CEREBRI_SENSE_BARO_PERIOD_MS
+// a baro whose last sample is older than this sits out the vote
+#define STALE_MS      (3 * PERIOD_MS)
+#define BARO_COUNT    CONFIG_CEREBRI_SENSE_BARO_COUNT
+
+// pressure disagreement with the median of the others that votes a baro out, kPa
+static const double g_vote_press_tolerance = 0.3;
+// consecutive disagreeing votes before a baro is dropped, agreeing before it is back
+static const int g_vote_faults = 3;
+static const int g_vote_recoveries = 100;
+
+/*
+ * The altitude of a pressure ratio p / p0 is T / L * ((p0 / p)^(R L / g M) - 1).
+ * The power is tabulated once over the ratios anywhere from well below sea
+ * level to about 10 km and interpolated linearly, the error is about a
+ * meter at 10 km and a few cm near sea level.
+ */
+#define ALT_TABLE_SIZE  129
+#define ALT_RATIO_MIN   0.25f
+#define ALT_RATIO_MAX   1.15f
+#define ALT_RATIO_STEP  ((ALT_RATIO_MAX - ALT_RATIO_MIN) / (ALT_TABLE_SIZE - 1))
+#define ALT_EXPONENT    (1 / 5.257f)
+#define ALT_LAPSE_RATE  0.0065f  // K/m
+#define ALT_SEA_PRESS   101.325f // kPa
+#define ALT_ZERO_C      273.15f
 
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
 void baro_timer_handler(struct k_timer *dummy);
 void baro_work_handler(struct k_work *work);
+#endif
+
+struct baro_instance {
+	const struct device *dev;
+	// last sample, kPa and C
+	double press;
+	double temp;
+	int64_t ticks;
+	// voting
+	bool healthy;
+	int faults;
+	int recoveries;
+	uint32_t disagreements;
+};
 
 typedef struct context_t {
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
 	// work
-	struct k_work work_item;
+	struct workq_item work_item;
 	struct k_timer timer;
+	struct sensor_trigger trigger;
+#endif
 	// node
 	struct zros_node node;
 	// data
@@ -37,14 +86,19 @@ typedef struct context_t {
 	// publications
 	struct zros_pub pub;
 	// devices
-	const struct device *baro_dev[CONFIG_CEREBRI_SENSE_BARO_COUNT];
-	// raw readings
-	double baro_raw[CONFIG_CEREBRI_SENSE_BARO_COUNT];
+	struct baro_instance inst[BARO_COUNT];
+	// (p0 / p)^exponent at ALT_RATIO_MIN + i * ALT_RATIO_STEP of p / p0
+	float alt_table[ALT_TABLE_SIZE];
+	// baros in the last published blend
+	int fused;
 } context_t;
 
 static context_t g_ctx = {
-	.work_item = Z_WORK_INITIALIZER(baro_work_handler),
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	.work_item = WORKQ_ITEM_INITIALIZER(baro_work_handler, "sense_baro", 20000),
 	.timer = Z_TIMER_INITIALIZER(g_ctx.timer, baro_timer_handler, NULL),
+	.trigger = {.type = SENSOR_TRIG_DATA_READY, .chan = SENSOR_CHAN_ALL},
+#endif
 	.node = {},
 	.altimeter =
 		{
@@ -54,11 +108,14 @@ static context_t g_ctx = {
 			.vertical_reference = 0,
 			.vertical_velocity = 0,
 		},
-	.baro_dev = {},
-	.baro_raw = {},
+	.inst = {},
+	.alt_table = {},
+	.fused = 0,
 };
 
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
 extern struct k_work_q g_low_priority_work_q;
+#endif
 
 static const struct device *sensor_check(const struct device *const dev)
 {
@@ -78,54 +135,238 @@ static const struct device *sensor_check(const struct device *const dev)
 	return dev;
 }
 
-void baro_work_handler(struct k_work *work_item)
+static void alt_table_init(context_t *ctx)
 {
-	context_t *ctx = CONTAINER_OF(work_item, context_t, work_item);
-	double baro_data_array[CONFIG_CEREBRI_SENSE_BARO_COUNT][2] = {};
-	for (int i = 0; i < CONFIG_CEREBRI_SENSE_BARO_COUNT; i++) {
-		// default all data to zero
-		struct sensor_value baro_press = {};
-		struct sensor_value baro_temp = {};
+	for (int i = 0; i < ALT_TABLE_SIZE; i++) {
+		float ratio = ALT_RATIO_MIN + i * ALT_RATIO_STEP;
+		ctx->alt_table[i] = powf(1.0f / ratio, ALT_EXPONENT);
+	}
+}
+
+// altitude above the standard sea level pressure, at the measured temperature
+static float baro_altitude(const context_t *ctx, float press, float temp)
+{
+	float x = (press / ALT_SEA_PRESS - ALT_RATIO_MIN) / ALT_RATIO_STEP;
+	x = CLAMP(x, 0.0f, ALT_TABLE_SIZE - 1.001f);
+	int i = (int)x;
+	float frac = x - i;
+	float power = ctx->alt_table[i] + frac * (ctx->alt_table[i + 1] - ctx->alt_table[i]);
+	return (power - 1.0f) * (temp + ALT_ZERO_C) / ALT_LAPSE_RATE;
+}
+
+static bool baro_stale(const struct baro_instance *inst, int64_t now)
+{
+	return inst->ticks == 0 || now - inst->ticks > k_ms_to_ticks_ceil64(STALE_MS);
+}
 
-		// get accel if device present
-		if (ctx->baro_dev[i] != NULL) {
-			sensor_sample_fetch(ctx->baro_dev[i]);
-			sensor_channel_get(ctx->baro_dev[i], SENSOR_CHAN_PRESS, &baro_press);
-			sensor_channel_get(ctx->baro_dev[i], SENSOR_CHAN_AMBIENT_TEMP, &baro_temp);
-			LOG_DBG("baro %d: %d.%06d %d.%06d", i, baro_press.val1, baro_press.val2,
-				baro_temp.val1, baro_temp.val2);
+static double median(const double *values, int n)
+{
+	double v[BARO_COUNT];
+	memcpy(v, values, n * sizeof(double));
+	// insertion sort, n is at most 4
+	for (int i = 1; i < n; i++) {
+		double x = v[i];
+		int j = i - 1;
+		for (; j >= 0 && v[j] > x; j--) {
+			v[j + 1] = v[j];
 		}
+		v[j + 1] = x;
+	}
+	return n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
 
-		baro_data_array[i][0] = baro_press.val1 + baro_press.val2 * 1e-6;
-		baro_data_array[i][1] = baro_temp.val1 + baro_temp.val2 * 1e-6;
+/*
+ * Vote the fresh baros and blend the healthy ones, as sense_imu votes its
+ * instances. One that disagrees with the median pressure by more than the
+ * tolerance is dropped after g_vote_faults votes and back after
+ * g_vote_recoveries, with two left a disagreement can not be attributed
+ * so both stay in. Returns the number of baros blended, 0 if none.
+ */
+static int baro_vote(context_t *ctx, double *press_out, double *temp_out)
+{
+	int64_t now = k_uptime_ticks();
+	double press[BARO_COUNT];
+	int usable[BARO_COUNT];
+	int n = 0;
+
+	for (int i = 0; i < BARO_COUNT; i++) {
+		const struct baro_instance *inst = &ctx->inst[i];
+		if (baro_stale(inst, now) || inst->press <= 0) {
+			continue;
+		}
+		press[n] = inst->press;
+		usable[n++] = i;
 	}
 
-	// select first baro for data for now: TODO implement voting
-	// TODO add barmetric formula equation
-	double press = baro_data_array[0][0];
-	double temp = 15.0; // standard atmosphere temp in C
-	const double sea_press = 101.325;
-	double alt = ((pow((sea_press / press), 1 / 5.257) - 1.0) * (temp + 273.15)) / 0.0065;
-	// LOG_DBG("press %10.4f, temp: %10.4f, alt: %10.4f", press, temp, alt);
+	if (n >= 3) {
+		double ref = median(press, n);
+		for (int k = 0; k < n; k++) {
+			struct baro_instance *inst = &ctx->inst[usable[k]];
+			if (fabs(press[k] - ref) <= g_vote_press_tolerance) {
+				inst->faults = 0;
+				if (!inst->healthy && ++inst->recoveries >= g_vote_recoveries) {
+					LOG_INF("baro %d healthy", usable[k]);
+					inst->healthy = true;
+				}
+			} else {
+				inst->disagreements++;
+				inst->recoveries = 0;
+				if (inst->healthy && ++inst->faults >= g_vote_faults) {
+					LOG_WRN("baro %d disagrees, dropped", usable[k]);
+					inst->healthy = false;
+				}
+			}
+		}
+	} else if (n == 2 && fabs(press[0] - press[1]) > g_vote_press_tolerance) {
+		ctx->inst[usable[0]].disagreements++;
+		ctx->inst[usable[1]].disagreements++;
+	}
+
+	double press_sum = 0;
+	double temp_sum = 0;
+	int blended = 0;
+	for (int k = 0; k < n; k++) {
+		const struct baro_instance *inst = &ctx->inst[usable[k]];
+		// with every baro voted out, the median one is the best guess
+		if (!inst->healthy && n >= 3) {
+			continue;
+		}
+		press_sum += inst->press;
+		temp_sum += inst->temp;
+		blended++;
+	}
+	if (blended == 0 && n > 0) {
+		*press_out = median(press, n);
+		*temp_out = ctx->inst[usable[0]].temp;
+		return 1;
+	}
+	if (blended > 0) {
+		*press_out = press_sum / blended;
+		*temp_out = temp_sum / blended;
+	}
+	return blended;
+}
+
+static void baro_publish(context_t *ctx)
+{
+	double press = 0;
+	double temp = 0;
+	int fused = baro_vote(ctx, &press, &temp);
+	if (fused == 0) {
+		return;
+	}
+	ctx->fused = fused;
+	float alt = baro_altitude(ctx, press, temp);
+	LOG_DBG("press %10.4f, temp: %10.4f, alt: %10.4f", press, temp, (double)alt);
 
 	// publish altimeter
-	ctx->altimeter.vertical_reference = alt;
 	stamp_header(&ctx->altimeter.header, k_uptime_ticks());
 	ctx->altimeter.header.seq++;
 	ctx->altimeter.vertical_position = alt;
 	ctx->altimeter.vertical_velocity = 0;
-	ctx->altimeter.vertical_reference = 0;
+	ctx->altimeter.vertical_reference = alt;
 	zros_pub_update(&ctx->pub);
 }
 
-K_WORK_DEFINE(baro_work, baro_work_handler);
+static void baro_sample(context_t *ctx, int i, double press, double temp)
+{
+	struct baro_instance *inst = &ctx->inst[i];
+	inst->press = press;
+	inst->temp = temp;
+	inst->ticks = k_uptime_ticks();
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+// the first fresh healthy baro, or the first fresh one with none healthy
+static int baro_pacer(const context_t *ctx)
+{
+	int64_t now = k_uptime_ticks();
+	int fresh = -1;
+	for (int i = 0; i < BARO_COUNT; i++) {
+		const struct baro_instance *inst = &ctx->inst[i];
+		if (baro_stale(inst, now)) {
+			continue;
+		}
+		if (inst->healthy) {
+			return i;
+		}
+		if (fresh < 0) {
+			fresh = i;
+		}
+	}
+	return fresh;
+}
+
+// runs on the sensor scheduler thread once the async read of a baro completes
+static void baro_read_done(struct sensor_sched_client *client, int result, const uint8_t *buf,
+			   uint32_t len)
+{
+	context_t *ctx = &g_ctx;
+	int i = POINTER_TO_UINT(client->user_data);
+	double press, temp;
+	ARG_UNUSED(len);
+
+	if (result < 0 || sensor_sched_decode(client, buf, SENSOR_CHAN_PRESS, &press, 1) < 0 ||
+	    sensor_sched_decode(client, buf, SENSOR_CHAN_AMBIENT_TEMP, &temp, 1) < 0) {
+		LOG_DBG("baro %d read failed: %d", i, result);
+		return;
+	}
+	LOG_DBG("baro %d: %10.6f %10.6f", i, press, temp);
+	baro_sample(ctx, i, press, temp);
+
+	// one baro paces publishing, the others are at most a period old
+	if (baro_pacer(ctx) == i) {
+		baro_publish(ctx);
+	}
+}
+
+#define BARO_CLIENT(i, _)                                                                          \
+	SENSOR_SCHED_CLIENT_DEFINE(baro_client##i, DT_ALIAS(baro##i), PERIOD_MS, baro_read_done,   \
+				   UINT_TO_POINTER(i), {SENSOR_CHAN_PRESS, 0},                     \
+				   {SENSOR_CHAN_AMBIENT_TEMP, 0});
+#define BARO_CLIENT_REF(i, _) &baro_client##i
+
+LISTIFY(CONFIG_CEREBRI_SENSE_BARO_COUNT, BARO_CLIENT, ())
+
+static struct sensor_sched_client *const g_baro_clients[] = {
+	LISTIFY(CONFIG_CEREBRI_SENSE_BARO_COUNT, BARO_CLIENT_REF, (,))};
+#else
+void baro_work_handler(struct k_work *work_item)
+{
+	context_t *ctx = CONTAINER_OF(work_item, context_t, work_item.work);
+	for (int i = 0; i < BARO_COUNT; i++) {
+		struct sensor_value baro_press = {};
+		struct sensor_value baro_temp = {};
+
+		// a failed fetch leaves the last sample to go stale
+		if (ctx->inst[i].dev == NULL || sensor_sample_fetch(ctx->inst[i].dev) < 0) {
+			continue;
+		}
+		sensor_channel_get(ctx->inst[i].dev, SENSOR_CHAN_PRESS, &baro_press);
+		sensor_channel_get(ctx->inst[i].dev, SENSOR_CHAN_AMBIENT_TEMP, &baro_temp);
+		LOG_DBG("baro %d: %d.%06d %d.%06d", i, baro_press.val1, baro_press.val2,
+			baro_temp.val1, baro_temp.val2);
+		baro_sample(ctx, i, sensor_value_to_double(&baro_press),
+			    sensor_value_to_double(&baro_temp));
+	}
+	baro_publish(ctx);
+}
 
 void baro_timer_handler(struct k_timer *dummy)
 {
-	k_work_submit_to_queue(&g_low_priority_work_q, &baro_work);
+	workq_submit(&g_low_priority_work_q, &g_ctx.work_item);
+}
+
+// data ready of the first baro present paces publishing at its output rate
+static void baro_trigger_handler(const struct device *dev, const struct sensor_trigger *trigger)
+{
+	ARG_UNUSED(dev);
+	ARG_UNUSED(trigger);
+	workq_submit(&g_low_priority_work_q, &g_ctx.work_item);
 }
+#endif
 
-K_TIMER_DEFINE(baro_timer, baro_timer_handler, NULL);
+#define BARO_DEVICE(i, _) sensor_check(DEVICE_DT_GET(DT_ALIAS(baro##i)))
 
 int sense_baro_entry_point(void *p0, void *p1, void *p2)
 {
@@ -133,16 +374,31 @@ int sense_baro_entry_point(void *p0, void *p1, void *p2)
 	context_t *ctx = p0;
 	ARG_UNUSED(p1);
 	ARG_UNUSED(p2);
-	ctx->baro_dev[0] = sensor_check(DEVICE_DT_GET(DT_ALIAS(baro0)));
-#if CONFIG_CEREBRI_SENSE_BARO_COUNT >= 2
-	ctx->baro_dev[1] = sensor_check(DEVICE_DT_GET(DT_ALIAS(baro1)));
-#elif CONFIG_CEREBRI_SENSE_BARO_COUNT >= 3
-	ctx->baro_dev[2] = sensor_check(DEVICE_DT_GET(DT_ALIAS(baro2)));
-#elif CONFIG_CEREBRI_SENSE_BARO_COUNT == 4
-	ctrx->baro_dev[3] = sensor_check(DEVICE_DT_GET(DT_ALIAS(baro3)));
-#endif
 
-	k_timer_start(&baro_timer, K_MSEC(100), K_MSEC(100));
+	const struct device *devs[] = {LISTIFY(CONFIG_CEREBRI_SENSE_BARO_COUNT, BARO_DEVICE, (,))};
+	for (int i = 0; i < BARO_COUNT; i++) {
+		ctx->inst[i].dev = devs[i];
+		ctx->inst[i].healthy = true;
+	}
+	alt_table_init(ctx);
+
+	zros_node_init(&ctx->node, "sense_baro");
+	zros_pub_init(&ctx->pub, &ctx->node, &topic_altimeter, &ctx->altimeter);
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	for (int i = 0; i < ARRAY_SIZE(g_baro_clients); i++) {
+		sensor_sched_add(g_baro_clients[i]);
+	}
+#else
+	const struct device *pacer = NULL;
+	for (int i = 0; i < BARO_COUNT && pacer == NULL; i++) {
+		pacer = ctx->inst[i].dev;
+	}
+	if (pacer == NULL || sensor_trigger_set(pacer, &ctx->trigger, baro_trigger_handler) < 0) {
+		LOG_INF("no data ready trigger, polling every %d ms", PERIOD_MS);
+		k_timer_start(&ctx->timer, K_MSEC(PERIOD_MS), K_MSEC(PERIOD_MS));
+	}
+#endif
 	return 0;
 }
 
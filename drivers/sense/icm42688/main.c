@@ -3,9 +3,13 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <math.h>
+
 #include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/rtio/rtio.h>
 #include <zephyr/shell/shell.h>
 
 #include <zros/private/zros_node_struct.h>
@@ -15,33 +19,58 @@
 #include <zros/zros_pub.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/core/perf_counter.h>
+
 #include <synapse_topic_list.h>
 
 #define MY_STACK_SIZE  8192
 #define MY_PRIORITY    1
-#define BATCH_DURATION 50
+#define ODR            CONFIG_CEREBRI_SENSE_ICM42688_ODR
+#define BATCH_DURATION CONFIG_CEREBRI_SENSE_ICM42688_BATCH_DURATION
+#define FRAME_MAX      ARRAY_SIZE(((synapse_pb_ImuQ31Array *)NULL)->frame)
+// the 2 kB fifo read in one go, twice for a batch in flight while one decodes
+#define BLOCK_SIZE     64
+#define BLOCK_COUNT    (2 * 2048 / BLOCK_SIZE)
+
+#define ICM42688_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(invensense_icm42688)
 
 LOG_MODULE_REGISTER(sense_icm42688, CONFIG_CEREBRI_SENSE_ICM42688_LOG_LEVEL);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
+// frames decoded from a batch, up to one imu_q31_array worth at a time
+union frames {
+	struct sensor_three_axis_data data;
+	uint8_t buf[sizeof(struct sensor_three_axis_data) +
+		    (FRAME_MAX - 1) * sizeof(struct sensor_three_axis_sample_data)];
+};
+
 // private context
 struct context {
 	struct zros_node node;
 	synapse_pb_ImuQ31Array imu_q31_array;
 	synapse_pb_Imu imu;
-	struct zros_pub pub_imu;
 	struct zros_pub pub_imu_q31_array;
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
 	struct k_thread thread_data;
+	struct rtio_sqe *streaming_handle;
+	struct sensor_stream_trigger stream_trigger;
+	struct sensor_read_config stream_config;
+	struct perf_counter perf;
+	union frames gyro;
+	union frames accel;
+	// die temperature of the last batch, deg C
+	double temperature;
+	uint32_t batches;
+	uint32_t frames;
+	uint32_t errors;
 };
 
 // private initialization
 static struct context g_ctx = {
 	.node = {},
-	.pub_imu = {},
 	.pub_imu_q31_array = {},
 	.imu = {.has_stamp = true, .has_angular_velocity = true, .has_linear_acceleration = true},
 	.imu_q31_array =
@@ -52,16 +81,74 @@ static struct context g_ctx = {
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
 	.thread_data = {},
+	.streaming_handle = NULL,
+	.stream_trigger =
+		{
+			.opt = SENSOR_STREAM_DATA_INCLUDE,
+			.trigger = SENSOR_TRIG_FIFO_WATERMARK,
+		},
+	.stream_config =
+		{
+			.sensor = DEVICE_DT_GET(ICM42688_NODE),
+			.is_streaming = true,
+			.triggers = &g_ctx.stream_trigger,
+			.count = 0,
+			.max = 1,
+		},
+	.temperature = 0,
+	.batches = 0,
+	.frames = 0,
+	.errors = 0,
 };
 
+static RTIO_IODEV_DEFINE(iodev_icm42688_stream, &__sensor_iodev_api, &g_ctx.stream_config);
+
+RTIO_DEFINE_WITH_MEMPOOL(icm42688_rtio, 4, 4, BLOCK_COUNT, BLOCK_SIZE, 4);
+
+static double q31_to_double(int32_t q31_value, int8_t shift)
+{
+	return ldexp(q31_value, shift - 31);
+}
+
 static int sense_icm42688_init(struct context *ctx)
 {
+	const struct device *dev = ctx->stream_config.sensor;
+
 	zros_node_init(&ctx->node, "sense_icm42688");
-	zros_pub_init(&ctx->pub_imu, &ctx->node, &topic_imu, &ctx->imu);
 	zros_pub_init(&ctx->pub_imu_q31_array, &ctx->node, &topic_imu_q31_array,
 		      &ctx->imu_q31_array);
+	perf_counter_init(&ctx->perf, "sense_icm42688", 1.0 / 100);
 	int rc = 0;
 
+	if (!device_is_ready(dev)) {
+		LOG_ERR("%s not ready", dev->name);
+		return -ENODEV;
+	}
+
+	struct sensor_value odr = {ODR, 0};
+	rc = sensor_attr_set(dev, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SAMPLING_FREQUENCY, &odr);
+	if (rc == 0) {
+		rc = sensor_attr_set(dev, SENSOR_CHAN_GYRO_XYZ, SENSOR_ATTR_SAMPLING_FREQUENCY,
+				     &odr);
+	}
+	if (rc != 0) {
+		LOG_ERR("failed to set odr %d Hz: %d", ODR, rc);
+		return rc;
+	}
+
+	ctx->stream_config.count = 1;
+
+	struct sensor_value val = {BATCH_DURATION, 0};
+	sensor_attr_set(dev, SENSOR_CHAN_ALL, SENSOR_ATTR_BATCH_DURATION, &val);
+	sensor_attr_get(dev, SENSOR_CHAN_ALL, SENSOR_ATTR_BATCH_DURATION, &val);
+	LOG_INF("odr %d Hz batch duration %d", ODR, val.val1);
+
+	rc = sensor_stream(&iodev_icm42688_stream, &icm42688_rtio, ctx, &ctx->streaming_handle);
+	if (rc != 0) {
+		LOG_ERR("Failed to start stream");
+		return rc;
+	}
+
 	rc = k_sem_take(&ctx->running, K_FOREVER);
 	if (rc != 0) {
 		LOG_ERR("Failed to take running");
@@ -74,13 +161,133 @@ static int sense_icm42688_init(struct context *ctx)
 
 static void sense_icm42688_fini(struct context *ctx)
 {
-	zros_pub_fini(&ctx->pub_imu);
+	perf_counter_fini(&ctx->perf);
 	zros_pub_fini(&ctx->pub_imu_q31_array);
 	zros_node_fini(&ctx->node);
+
+	if (ctx->streaming_handle != NULL) {
+		rtio_sqe_cancel(ctx->streaming_handle);
+		ctx->streaming_handle = NULL;
+	}
+
 	k_sem_give(&ctx->running);
 	LOG_INF("fini");
 }
 
+/*
+ * Publish the frames of one decode call as an imu_q31_array. The stamp is
+ * the first frame, taken from the watermark interrupt time of the batch
+ * and the frame's place in the fifo, and the frame deltas are from it.
+ */
+static void publish_frames(struct context *ctx, int count)
+{
+	const struct sensor_three_axis_data *gyro = &ctx->gyro.data;
+	const struct sensor_three_axis_data *accel = &ctx->accel.data;
+	synapse_pb_ImuQ31Array *msg = &ctx->imu_q31_array;
+	uint64_t first_ns = accel->header.base_timestamp_ns + accel->readings[0].timestamp_delta;
+
+	msg->gyro_shift = gyro->shift;
+	msg->accel_shift = accel->shift;
+	for (int i = 0; i < count; i++) {
+		synapse_pb_ImuQ31Array_Frame *frame = &msg->frame[i];
+		frame->gyro_x = gyro->readings[i].values[0];
+		frame->gyro_y = gyro->readings[i].values[1];
+		frame->gyro_z = gyro->readings[i].values[2];
+		frame->accel_x = accel->readings[i].values[0];
+		frame->accel_y = accel->readings[i].values[1];
+		frame->accel_z = accel->readings[i].values[2];
+		frame->delta_nanos = accel->header.base_timestamp_ns +
+				     accel->readings[i].timestamp_delta - first_ns;
+	}
+	msg->frame_count = count;
+	msg->stamp.seconds = first_ns / 1000000000ULL;
+	msg->stamp.nanos = first_ns % 1000000000ULL;
+	zros_pub_update(&ctx->pub_imu_q31_array);
+}
+
+static void icm42688_processing_callback(int result, uint8_t *buf, uint32_t buf_len, void *userdata)
+{
+	struct context *ctx = userdata;
+	ARG_UNUSED(buf_len);
+
+	if (result < 0) {
+		ctx->errors++;
+		LOG_ERR("read failed: %d", result);
+		return;
+	}
+
+	const struct sensor_decoder_api *decoder;
+	int rc = sensor_get_decoder(ctx->stream_config.sensor, &decoder);
+	if (rc != 0) {
+		LOG_ERR("failed to get decoder");
+		return;
+	}
+
+	struct sensor_chan_spec gyro_ch = {.chan_idx = 0, .chan_type = SENSOR_CHAN_GYRO_XYZ};
+	struct sensor_chan_spec accel_ch = {.chan_idx = 0, .chan_type = SENSOR_CHAN_ACCEL_XYZ};
+	struct sensor_chan_spec temp_ch = {.chan_idx = 0, .chan_type = SENSOR_CHAN_DIE_TEMP};
+	uint32_t gyro_fit = 0;
+	uint32_t accel_fit = 0;
+	uint32_t temp_fit = 0;
+	double gyro_sum[3] = {};
+	double accel_sum[3] = {};
+	uint64_t last_ns = 0;
+	int total = 0;
+
+	// a fast fifo batch can hold more frames than one array, send it in pieces
+	while (true) {
+		int n_gyro = decoder->decode(buf, gyro_ch, &gyro_fit, FRAME_MAX, &ctx->gyro.data);
+		int n_accel =
+			decoder->decode(buf, accel_ch, &accel_fit, FRAME_MAX, &ctx->accel.data);
+		int n = MIN(n_gyro, n_accel);
+		if (n <= 0) {
+			break;
+		}
+
+		publish_frames(ctx, n);
+
+		const struct sensor_three_axis_data *gyro = &ctx->gyro.data;
+		const struct sensor_three_axis_data *accel = &ctx->accel.data;
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < 3; j++) {
+				gyro_sum[j] +=
+					q31_to_double(gyro->readings[i].values[j], gyro->shift);
+				accel_sum[j] +=
+					q31_to_double(accel->readings[i].values[j], accel->shift);
+			}
+		}
+		last_ns = accel->header.base_timestamp_ns + accel->readings[n - 1].timestamp_delta;
+		total += n;
+	}
+
+	if (total == 0) {
+		return;
+	}
+	ctx->batches++;
+	ctx->frames += total;
+
+	struct sensor_q31_data temp;
+	if (decoder->decode(buf, temp_ch, &temp_fit, 1, &temp) > 0) {
+		ctx->temperature = q31_to_double(temp.readings[0].temperature, temp.shift);
+	}
+	LOG_DBG("batch %d frames, %10.3f C", total, ctx->temperature);
+
+#if defined(CONFIG_CEREBRI_SENSE_ICM42688_IMU)
+	// the batch mean is a box filter ahead of the decimation to the batch rate
+	ctx->imu.stamp.seconds = last_ns / 1000000000ULL;
+	ctx->imu.stamp.nanos = last_ns % 1000000000ULL;
+	ctx->imu.angular_velocity.x = gyro_sum[0] / total;
+	ctx->imu.angular_velocity.y = gyro_sum[1] / total;
+	ctx->imu.angular_velocity.z = gyro_sum[2] / total;
+	ctx->imu.linear_acceleration.x = accel_sum[0] / total;
+	ctx->imu.linear_acceleration.y = accel_sum[1] / total;
+	ctx->imu.linear_acceleration.z = accel_sum[2] / total;
+	synapse_seqlock_publish(&seqlock_imu, &ctx->imu);
+#else
+	ARG_UNUSED(last_ns);
+#endif
+}
+
 static void sense_icm42688_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -88,10 +295,15 @@ static void sense_icm42688_run(void *p0, void *p1, void *p2)
 	ARG_UNUSED(p2);
 
 	LOG_INF("starting");
-	sense_icm42688_init(ctx);
+	if (sense_icm42688_init(ctx) != 0) {
+		sense_icm42688_fini(ctx);
+		return;
+	}
 
+	// watermark interrupts drive the fifo reads, this thread only decodes
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
-		k_msleep(1000);
+		sensor_processing_with_callback(&icm42688_rtio, icm42688_processing_callback);
+		perf_counter_update(&ctx->perf);
 	}
 
 	LOG_INF("finished");
@@ -128,6 +340,9 @@ static int sense_icm42688_cmd_handler(const struct shell *sh, size_t argc, char
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		shell_print(sh, "odr: %d Hz batches: %u frames: %u errors: %u", ODR, ctx->batches,
+			    ctx->frames, ctx->errors);
+		shell_print(sh, "temperature: %10.3f C", ctx->temperature);
 	}
 	return 0;
 }
@@ -7,11 +7,25 @@
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+#include <zephyr/rtio/rtio.h>
+#endif
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+#include <zephyr/settings/settings.h>
+#endif
 
 // #include <cerebri/core/casadi.h>
+#include <cerebri/core/boot.h>
 #include <cerebri/core/common.h>
+#include <cerebri/core/log_utils.h>
 #include <cerebri/core/perf_duration.h>
+#include <cerebri/core/placement.h>
+#include <cerebri/core/trace.h>
+#include <cerebri/core/workq.h>
+#include <cerebri/sense/imu.h>
 
+#include <synapse_latency.h>
 #include <synapse_topic_list.h>
 
 #include <zros/private/zros_node_struct.h>
@@ -25,19 +39,104 @@ LOG_MODULE_REGISTER(sense_imu, CONFIG_CEREBRI_SENSE_IMU_LOG_LEVEL);
 
 #define THREAD_STACK_SIZE 1024
 #define THREAD_PRIORITY   6
+// sensor settling time after power on, before the initial calibration
+#define IMU_SETTLE_MS     1000
+// frames decoded per call in streaming mode
+#define DECODE_FRAMES     16
+// accelN and gyroN make up imu instance N
+#define IMU_COUNT         CONFIG_CEREBRI_SENSE_IMU_ACCEL_COUNT
+#if defined(CONFIG_CEREBRI_SENSE_IMU_Q31_ARRAY)
+#define FRAME_MAX ARRAY_SIZE(((synapse_pb_ImuQ31Array *)NULL)->frame)
+#endif
+
+BUILD_ASSERT(CONFIG_CEREBRI_SENSE_IMU_GYRO_COUNT == IMU_COUNT,
+	     "every imu instance needs both an accel and a gyro");
 
 static const double g_accel = 9.8;
 static const int g_calibration_count = 100;
+// largest difference from the other instances that still counts as agreeing
+static const double g_vote_gyro_tolerance = 0.3;  // rad/s
+static const double g_vote_accel_tolerance = 3.0; // m/s^2
+// consecutive disagreeing votes before an instance is dropped, agreeing before it is back
+static const int g_vote_faults = 2;
+static const int g_vote_recoveries = 200;
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+// gyro bias time constant in samples while disarmed and still, and the limits of still
+static const double g_refine_samples = 2000;
+static const double g_refine_gyro_max = 0.05; // rad/s
+static const double g_refine_accel_max = 0.5; // m/s^2
+#endif
 
 extern struct perf_duration control_latency;
 extern struct k_work_q g_high_priority_work_q;
 static void imu_work_handler(struct k_work *work);
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+static void imu_save_work_handler(struct k_work *work);
+#endif
+#if !defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
 static void imu_timer_handler(struct k_timer *dummy);
+#endif
+
+struct imu_instance {
+	int index;
+	// gyro
+	const struct device *gyro_dev;
+	double gyro_raw[3];
+	double gyro_bias[3];
+
+	// accel
+	const struct device *accel_dev;
+	double accel_raw[3];
+	double accel_bias[3];
+	double accel_scale;
+
+	// running sums of the calibration in progress
+	int calibration_samples;
+	double accel_sum[3];
+	double accel_sum_sq[3];
+	double gyro_sum[3];
+	double gyro_sum_sq[3];
+	bool calibrated;
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+	// gyro bias moved by the online refinement since the last save
+	bool refined;
+#endif
+
+	// voting, valid means the latest sample was read
+	bool valid;
+	bool healthy;
+	int faults;
+	int recoveries;
+	uint32_t disagreements;
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+	// fifo batches arrive on the rtio thread, the work item publishes them
+	struct rtio_sqe *streaming_handle;
+	struct sensor_stream_trigger stream_trigger;
+	struct sensor_read_config stream_config;
+	double accel_batch[3];
+	double gyro_batch[3];
+	struct synapse_latency_trace batch_latency;
+	int64_t batch_ticks;
+	int64_t interval_ticks;
+	uint32_t batches;
+	uint32_t empty_batches;
+#endif
+#if defined(CONFIG_CEREBRI_SENSE_IMU_Q31_ARRAY)
+	struct zros_pub pub_q31_array;
+	synapse_pb_ImuQ31Array q31_array;
+#endif
+};
 
 typedef struct context_t {
 	// work
-	struct k_work work_item;
+	struct workq_item work_item;
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+	// guards the batch fields of the instances
+	struct k_spinlock lock;
+#else
 	struct k_timer timer;
+#endif
 	// node
 	struct zros_node node;
 	// data
@@ -45,27 +144,57 @@ typedef struct context_t {
 	synapse_pb_Status status;
 	synapse_pb_Status_Mode last_mode;
 	bool calibrated;
-	// publications
-	struct zros_pub pub_imu;
+	int calibration_rounds;
+	int64_t calibration_retry_ticks;
+	// the calibration in use came from settings, not from leveling at boot
+	bool calibration_stored;
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+	// flash writes run on the system work queue, never on the imu one
+	struct k_work save_work;
+	synapse_pb_Status_Arming last_arming;
+#endif
 	// subscriptions
 	struct zros_sub sub_status;
-	// gyro
-	const struct device *gyro_dev;
-	double gyro_raw[3];
-	double gyro_bias[3];
 
-	// accel
-	const struct device *accel_dev;
-	double accel_raw[3];
-	double accel_bias[3];
-	double accel_scale;
+	struct imu_instance inst[IMU_COUNT];
+	// instance published, or the first of the blend
+	atomic_t selected;
+	uint32_t failovers;
+
+	// latency trace of the sample being published
+	struct synapse_latency_trace latency;
 
 	// 2nd order butterworth filter states
 } context_t;
 
-static context_t g_ctx = {
-	.work_item = Z_WORK_INITIALIZER(imu_work_handler),
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+#define IMU_INSTANCE_INIT(i, _)                                                                    \
+	{                                                                                          \
+		.index = i,                                                                        \
+		.streaming_handle = NULL,                                                          \
+		.stream_trigger =                                                                  \
+			{                                                                          \
+				.opt = SENSOR_STREAM_DATA_INCLUDE,                                 \
+				.trigger = SENSOR_TRIG_FIFO_WATERMARK,                             \
+			},                                                                         \
+		.stream_config =                                                                   \
+			{                                                                          \
+				.sensor = DEVICE_DT_GET(DT_ALIAS(accel##i)),                       \
+				.is_streaming = true,                                              \
+				.triggers = &g_ctx.inst[i].stream_trigger,                         \
+				.count = 1,                                                        \
+				.max = 1,                                                          \
+			},                                                                         \
+	}
+#else
+#define IMU_INSTANCE_INIT(i, _) {.index = i}
+#endif
+
+static context_t g_ctx CEREBRI_HOT_CONTEXT = {
+	.work_item = WORKQ_ITEM_INITIALIZER(imu_work_handler, "sense_imu", 1000),
+#if !defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
 	.timer = Z_TIMER_INITIALIZER(g_ctx.timer, imu_timer_handler, NULL),
+#endif
 	.node = {},
 	.imu =
 		{
@@ -80,75 +209,424 @@ static context_t g_ctx = {
 	.status = synapse_pb_Status_init_default,
 	.last_mode = synapse_pb_Status_Mode_MODE_UNKNOWN,
 	.calibrated = false,
-	.pub_imu = {},
+	.calibration_rounds = 0,
+	.calibration_retry_ticks = 0,
+	.calibration_stored = false,
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+	.save_work = Z_WORK_INITIALIZER(imu_save_work_handler),
+	.last_arming = synapse_pb_Status_Arming_ARMING_UNKNOWN,
+#endif
 	.sub_status = {},
-	.gyro_dev = NULL,
-	.gyro_raw = {},
-	.gyro_bias = {},
-	.accel_dev = NULL,
-	.accel_raw = {},
-	.accel_bias = {},
+	.inst = {LISTIFY(IMU_COUNT, IMU_INSTANCE_INIT, (,))},
+	.selected = ATOMIC_INIT(0),
+	.failovers = 0,
+};
+
+#define IMU_ACCEL_DEV(i, _) DEVICE_DT_GET(DT_ALIAS(accel##i))
+#define IMU_GYRO_DEV(i, _)  DEVICE_DT_GET(DT_ALIAS(gyro##i))
+
+static const struct device *const g_accel_devs[] = {LISTIFY(IMU_COUNT, IMU_ACCEL_DEV, (,))};
+static const struct device *const g_gyro_devs[] = {LISTIFY(IMU_COUNT, IMU_GYRO_DEV, (,))};
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+#define IMU_IODEV_DEFINE(i, _)                                                                     \
+	static RTIO_IODEV_DEFINE(iodev_imu_stream_##i, &__sensor_iodev_api,                        \
+				 &g_ctx.inst[i].stream_config);
+#define IMU_IODEV_REF(i, _) &iodev_imu_stream_##i
+
+LISTIFY(IMU_COUNT, IMU_IODEV_DEFINE, ())
+
+static struct rtio_iodev *const g_imu_iodevs[] = {LISTIFY(IMU_COUNT, IMU_IODEV_REF, (,))};
+
+RTIO_DEFINE_WITH_MEMPOOL(imu_rtio, 4 * IMU_COUNT, 4 * IMU_COUNT, 32 * IMU_COUNT, 64, 4);
+#endif
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_Q31_ARRAY)
+// instance 0 keeps the topic sense_accel publishes when it runs instead
+static struct zros_topic *const g_q31_array_topics[] = {
+	&topic_imu_q31_array, &topic_imu_q31_array_1, &topic_imu_q31_array_2,
+	&topic_imu_q31_array_3};
+#endif
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+static void imu_corrected(const struct imu_instance *inst, double gyro[3], double accel[3]);
+
+// persisted per instance as sense_imu/<n>
+struct imu_calibration {
+	double accel_bias[3];
+	double gyro_bias[3];
+	double accel_scale;
 };
 
+static int imu_settings_set(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	context_t *ctx = &g_ctx;
+	struct imu_calibration cal;
+	const char *next;
+
+	if (settings_name_next(key, &next) != 1 || next != NULL || key[0] < '0' ||
+	    key[0] >= '0' + IMU_COUNT) {
+		return -ENOENT;
+	}
+	if (len != sizeof(cal) || read_cb(cb_arg, &cal, len) != (ssize_t)len) {
+		return -EINVAL;
+	}
+
+	struct imu_instance *inst = &ctx->inst[key[0] - '0'];
+	memcpy(inst->accel_bias, cal.accel_bias, sizeof(inst->accel_bias));
+	memcpy(inst->gyro_bias, cal.gyro_bias, sizeof(inst->gyro_bias));
+	inst->accel_scale = cal.accel_scale;
+	inst->calibrated = true;
+	inst->healthy = true;
+	if (!ctx->calibrated) {
+		atomic_set(&ctx->selected, inst->index);
+	}
+	ctx->calibrated = true;
+	ctx->calibration_stored = true;
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(sense_imu, "sense_imu", NULL, imu_settings_set, NULL, NULL);
+
+static void imu_save_work_handler(struct k_work *work)
+{
+	context_t *ctx = CONTAINER_OF(work, context_t, save_work);
+
+	for (int i = 0; i < IMU_COUNT; i++) {
+		struct imu_instance *inst = &ctx->inst[i];
+		if (!inst->calibrated) {
+			continue;
+		}
+		struct imu_calibration cal = {.accel_scale = inst->accel_scale};
+		memcpy(cal.accel_bias, inst->accel_bias, sizeof(cal.accel_bias));
+		memcpy(cal.gyro_bias, inst->gyro_bias, sizeof(cal.gyro_bias));
+		char key[] = "sense_imu/0";
+		key[sizeof(key) - 2] = '0' + i;
+		if (settings_save_one(key, &cal, sizeof(cal)) < 0) {
+			LOG_ERR("imu %d: saving calibration failed", i);
+		}
+		inst->refined = false;
+	}
+	LOG_INF("calibration saved");
+}
+
+/*
+ * Track the gyro bias while disarmed and still, so temperature drift of a
+ * stored calibration is taken out before arming. The refined bias is saved
+ * once disarmed again.
+ */
+static void imu_refine(context_t *ctx)
+{
+	synapse_pb_Status_Arming arming = ctx->status.arming;
+	bool disarmed = arming == synapse_pb_Status_Arming_ARMING_DISARMED;
+
+	if (disarmed && ctx->last_arming == synapse_pb_Status_Arming_ARMING_ARMED) {
+		for (int i = 0; i < IMU_COUNT; i++) {
+			if (ctx->inst[i].refined) {
+				k_work_submit(&ctx->save_work);
+				break;
+			}
+		}
+	}
+	ctx->last_arming = arming;
+	if (!disarmed) {
+		return;
+	}
+
+	for (int i = 0; i < IMU_COUNT; i++) {
+		struct imu_instance *inst = &ctx->inst[i];
+		if (!inst->calibrated || !inst->valid) {
+			continue;
+		}
+		double gyro[3], accel[3];
+		imu_corrected(inst, gyro, accel);
+		double accel_norm = sqrt(accel[0] * accel[0] + accel[1] * accel[1] +
+					 accel[2] * accel[2]);
+		if (fabs(gyro[0]) > g_refine_gyro_max || fabs(gyro[1]) > g_refine_gyro_max ||
+		    fabs(gyro[2]) > g_refine_gyro_max ||
+		    fabs(accel_norm - g_accel) > g_refine_accel_max) {
+			continue;
+		}
+		for (int j = 0; j < 3; j++) {
+			inst->gyro_bias[j] += gyro[j] / g_refine_samples;
+		}
+		inst->refined = true;
+	}
+}
+#endif
+
+bool sense_imu_calibration_stored(void)
+{
+	return g_ctx.calibration_stored;
+}
+
 static void imu_init(context_t *ctx)
 {
 	LOG_INF("init");
 
 	// initialize node
 	zros_node_init(&ctx->node, "sense_imu");
-	zros_pub_init(&ctx->pub_imu, &ctx->node, &topic_imu, &ctx->imu);
 	zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 1);
 
-	// setup accel devices
-	ctx->accel_dev = get_device(DEVICE_DT_GET(DT_ALIAS(accel0)));
+	for (int i = 0; i < IMU_COUNT; i++) {
+		struct imu_instance *inst = &ctx->inst[i];
+		// setup accel and gyro devices
+		inst->accel_dev = get_device(g_accel_devs[i]);
+		inst->gyro_dev = get_device(g_gyro_devs[i]);
+#if defined(CONFIG_CEREBRI_SENSE_IMU_Q31_ARRAY)
+		inst->q31_array.has_stamp = true;
+		zros_pub_init(&inst->pub_q31_array, &ctx->node, g_q31_array_topics[i],
+			      &inst->q31_array);
+#endif
+	}
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+	settings_subsys_init();
+	settings_load_subtree("sense_imu");
+	if (ctx->calibrated) {
+		LOG_INF("stored calibration loaded, imu %d selected",
+			(int)atomic_get(&ctx->selected));
+	}
+#endif
+}
+
+static void imu_check_saturation(struct imu_instance *inst)
+{
+	for (int j = 0; j < 3; j++) {
+		if (inst->accel_raw[j] > 15 * g_accel || inst->accel_raw[j] < -15 * g_accel) {
+			LOG_ERR("imu %d accel saturating: %d: %10.4f", inst->index, j,
+				inst->accel_raw[j]);
+		}
+		if (inst->gyro_raw[j] > 34 || inst->gyro_raw[j] < -34) {
+			LOG_ERR("imu %d gyro saturating: %d: %10.4f", inst->index, j,
+				inst->gyro_raw[j]);
+		}
+	}
+}
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+static double q31_to_double(int32_t value, int8_t shift)
+{
+	return ldexp((double)value, shift - 31);
+}
+
+/*
+ * Average all frames of one channel in the fifo batch, decoding
+ * DECODE_FRAMES per call. Returns the number of frames.
+ */
+static int imu_decode_mean(const struct sensor_decoder_api *decoder, const uint8_t *buf,
+			   enum sensor_channel chan, double mean[3])
+{
+	static union {
+		struct sensor_three_axis_data data;
+		uint8_t buf[sizeof(struct sensor_three_axis_data) +
+			    (DECODE_FRAMES - 1) * sizeof(struct sensor_three_axis_sample_data)];
+	} decoded;
+	struct sensor_chan_spec ch = {.chan_idx = 0, .chan_type = chan};
+	uint32_t fit = 0;
+	int64_t sum[3] = {};
+	int8_t shift = 0;
+	int count = 0;
+	int n;
+
+	while ((n = decoder->decode(buf, ch, &fit, DECODE_FRAMES, &decoded.data)) > 0) {
+		shift = decoded.data.shift;
+		for (int k = 0; k < n; k++) {
+			for (int j = 0; j < 3; j++) {
+				sum[j] += decoded.data.readings[k].values[j];
+			}
+		}
+		count += n;
+	}
+	for (int j = 0; j < 3 && count > 0; j++) {
+		mean[j] = q31_to_double(sum[j] / count, shift);
+	}
+	return count;
+}
 
-	// setup gyro devices
-	ctx->gyro_dev = get_device(DEVICE_DT_GET(DT_ALIAS(gyro0)));
+#if defined(CONFIG_CEREBRI_SENSE_IMU_Q31_ARRAY)
+// the first frames of the batch as the instance's imu_q31_array
+static void imu_publish_frames(struct imu_instance *inst, const struct sensor_decoder_api *decoder,
+			       const uint8_t *buf)
+{
+	static union {
+		struct sensor_three_axis_data data;
+		uint8_t buf[sizeof(struct sensor_three_axis_data) +
+			    (FRAME_MAX - 1) * sizeof(struct sensor_three_axis_sample_data)];
+	} gyro, accel;
+	struct sensor_chan_spec gyro_ch = {.chan_idx = 0, .chan_type = SENSOR_CHAN_GYRO_XYZ};
+	struct sensor_chan_spec accel_ch = {.chan_idx = 0, .chan_type = SENSOR_CHAN_ACCEL_XYZ};
+	uint32_t gyro_fit = 0;
+	uint32_t accel_fit = 0;
+
+	int n = MIN(decoder->decode(buf, gyro_ch, &gyro_fit, FRAME_MAX, &gyro.data),
+		    decoder->decode(buf, accel_ch, &accel_fit, FRAME_MAX, &accel.data));
+	if (n <= 0) {
+		return;
+	}
+
+	synapse_pb_ImuQ31Array *msg = &inst->q31_array;
+	uint64_t first_ns =
+		accel.data.header.base_timestamp_ns + accel.data.readings[0].timestamp_delta;
+	msg->gyro_shift = gyro.data.shift;
+	msg->accel_shift = accel.data.shift;
+	for (int i = 0; i < n; i++) {
+		synapse_pb_ImuQ31Array_Frame *frame = &msg->frame[i];
+		frame->gyro_x = gyro.data.readings[i].values[0];
+		frame->gyro_y = gyro.data.readings[i].values[1];
+		frame->gyro_z = gyro.data.readings[i].values[2];
+		frame->accel_x = accel.data.readings[i].values[0];
+		frame->accel_y = accel.data.readings[i].values[1];
+		frame->accel_z = accel.data.readings[i].values[2];
+		frame->delta_nanos = accel.data.header.base_timestamp_ns +
+				     accel.data.readings[i].timestamp_delta - first_ns;
+	}
+	msg->frame_count = n;
+	msg->stamp.seconds = first_ns / 1000000000ULL;
+	msg->stamp.nanos = first_ns % 1000000000ULL;
+	zros_pub_update(&inst->pub_q31_array);
+}
+#endif
+
+// a batch is late once half an interval past due, the selected instance is then failed over
+static bool imu_batch_late(const struct imu_instance *inst, int64_t now)
+{
+	return inst->batches == 0 ||
+	       (inst->interval_ticks > 0 &&
+		now - inst->batch_ticks > inst->interval_ticks + inst->interval_ticks / 2);
 }
 
+// rtio completion, bus transfers are done, only decode here
+static void imu_stream_callback(int result, uint8_t *buf, uint32_t buf_len, void *userdata)
+{
+	struct imu_instance *inst = userdata;
+	context_t *ctx = &g_ctx;
+	ARG_UNUSED(buf_len);
+
+	if (result < 0) {
+		LOG_ERR("imu %d stream read failed: %d", inst->index, result);
+		return;
+	}
+
+	const struct sensor_decoder_api *decoder;
+	if (sensor_get_decoder(inst->stream_config.sensor, &decoder) != 0) {
+		LOG_ERR("failed to get decoder");
+		return;
+	}
+
+	struct synapse_latency_trace latency;
+	synapse_latency_begin(&latency);
+
+	double accel[3], gyro[3];
+	if (imu_decode_mean(decoder, buf, SENSOR_CHAN_ACCEL_XYZ, accel) == 0 ||
+	    imu_decode_mean(decoder, buf, SENSOR_CHAN_GYRO_XYZ, gyro) == 0) {
+		inst->empty_batches++;
+		return;
+	}
+#if defined(CONFIG_CEREBRI_SENSE_IMU_Q31_ARRAY)
+	imu_publish_frames(inst, decoder, buf);
+#endif
+
+	int64_t now = k_uptime_ticks();
+	k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+	memcpy(inst->accel_batch, accel, sizeof(accel));
+	memcpy(inst->gyro_batch, gyro, sizeof(gyro));
+	inst->batch_latency = latency;
+	if (inst->batches > 0) {
+		inst->interval_ticks = now - inst->batch_ticks;
+	}
+	inst->batch_ticks = now;
+	inst->batches++;
+	int selected = atomic_get(&ctx->selected);
+	bool selected_late = imu_batch_late(&ctx->inst[selected], now);
+	k_spin_unlock(&ctx->lock, key);
+
+	// the selected instance paces publishing, any other one takes over if it goes quiet
+	if (inst->index == selected || selected_late) {
+		workq_submit(&g_high_priority_work_q, &ctx->work_item);
+	}
+}
+
+// latest batch means, the work item never touches the bus
 void imu_read(context_t *ctx)
+{
+	int64_t now = k_uptime_ticks();
+	int selected = atomic_get(&ctx->selected);
+	k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+	for (int i = 0; i < IMU_COUNT; i++) {
+		struct imu_instance *inst = &ctx->inst[i];
+		memcpy(inst->accel_raw, inst->accel_batch, sizeof(inst->accel_raw));
+		memcpy(inst->gyro_raw, inst->gyro_batch, sizeof(inst->gyro_raw));
+		inst->valid = !imu_batch_late(inst, now);
+	}
+	ctx->latency = ctx->inst[selected].batch_latency;
+	k_spin_unlock(&ctx->lock, key);
+}
+#else
+// fetch every instance, valid is only set for the ones read without error
+static void imu_read_instance(struct imu_instance *inst)
 {
 	// default all data to zero
 	struct sensor_value accel_value[3] = {};
 	struct sensor_value gyro_value[3] = {};
 
-	// get accel if device present
-	if (ctx->accel_dev != NULL) {
-		sensor_sample_fetch(ctx->accel_dev);
-		sensor_channel_get(ctx->accel_dev, SENSOR_CHAN_ACCEL_XYZ, accel_value);
-		for (int j = 0; j < 3; j++) {
-			ctx->accel_raw[j] = accel_value[j].val1 + accel_value[j].val2 * 1e-6;
+	inst->valid = false;
+	if (inst->accel_dev == NULL || inst->gyro_dev == NULL) {
+		return;
+	}
 
-			if (ctx->accel_raw[j] > 15 * g_accel || ctx->accel_raw[j] < -15 * g_accel) {
-				LOG_ERR("accel saturating: %d: %10.4f", j, ctx->accel_raw[j]);
-				continue;
-			}
-		}
+	// get accel
+	if (sensor_sample_fetch(inst->accel_dev) != 0 ||
+	    sensor_channel_get(inst->accel_dev, SENSOR_CHAN_ACCEL_XYZ, accel_value) != 0) {
+		return;
+	}
+	for (int j = 0; j < 3; j++) {
+		inst->accel_raw[j] = accel_value[j].val1 + accel_value[j].val2 * 1e-6;
 	}
 
-	// get gyro if device present
-	if (ctx->gyro_dev != NULL) {
-		// don't resample if it is the same device as accel, want same timestamp
-		if (ctx->gyro_dev != ctx->accel_dev) {
-			sensor_sample_fetch(ctx->gyro_dev);
-		}
-		sensor_channel_get(ctx->gyro_dev, SENSOR_CHAN_GYRO_XYZ, gyro_value);
-		for (int j = 0; j < 3; j++) {
-			ctx->gyro_raw[j] = gyro_value[j].val1 + gyro_value[j].val2 * 1e-6;
+	// get gyro, don't resample if it is the same device as accel, want same timestamp
+	if (inst->gyro_dev != inst->accel_dev && sensor_sample_fetch(inst->gyro_dev) != 0) {
+		return;
+	}
+	if (sensor_channel_get(inst->gyro_dev, SENSOR_CHAN_GYRO_XYZ, gyro_value) != 0) {
+		return;
+	}
+	for (int j = 0; j < 3; j++) {
+		inst->gyro_raw[j] = gyro_value[j].val1 + gyro_value[j].val2 * 1e-6;
+	}
+	inst->valid = true;
+}
 
-			if (ctx->gyro_raw[j] > 34 || ctx->gyro_raw[j] < -34) {
-				LOG_ERR("gyro saturating: %d: %10.4f", j, ctx->gyro_raw[j]);
-				continue;
-			}
-		}
+void imu_read(context_t *ctx)
+{
+	for (int i = 0; i < IMU_COUNT; i++) {
+		imu_read_instance(&ctx->inst[i]);
 	}
 }
+#endif
 
-void imu_calibrate(context_t *ctx)
+static void imu_calibrate_add(struct imu_instance *inst)
 {
-	// data
-	double accel_samples[g_calibration_count][3];
-	double gyro_samples[g_calibration_count][3];
+	if (!inst->valid) {
+		return;
+	}
+	for (int k = 0; k < 3; k++) {
+		inst->accel_sum[k] += inst->accel_raw[k];
+		inst->accel_sum_sq[k] += inst->accel_raw[k] * inst->accel_raw[k];
+		inst->gyro_sum[k] += inst->gyro_raw[k];
+		inst->gyro_sum_sq[k] += inst->gyro_raw[k] * inst->gyro_raw[k];
+	}
+	inst->calibration_samples++;
+}
+
+// bias and scale of one instance from its sums, false if unacceptable
+static bool imu_calibrate_finish(struct imu_instance *inst)
+{
+	int count = inst->calibration_samples;
+	if (count < g_calibration_count / 2) {
+		LOG_WRN("imu %d: only %d samples", inst->index, count);
+		return false;
+	}
 
 	// mean and std
 	double accel_mean[3];
@@ -156,142 +634,296 @@ void imu_calibrate(context_t *ctx)
 	double accel_std[3];
 	double gyro_std[3];
 
-	// repeat until calibrated
-	while (true) {
+	for (int k = 0; k < 3; k++) {
+		accel_mean[k] = inst->accel_sum[k] / count;
+		gyro_mean[k] = inst->gyro_sum[k] / count;
+		double accel_var = inst->accel_sum_sq[k] / count - accel_mean[k] * accel_mean[k];
+		double gyro_var = inst->gyro_sum_sq[k] / count - gyro_mean[k] * gyro_mean[k];
+		accel_std[k] = sqrt(fmax(accel_var, 0));
+		gyro_std[k] = sqrt(fmax(gyro_var, 0));
+	}
 
-		LOG_INF("calibration started, keep device stationary");
+	// check if calibration acceptable
+	bool calibration_ok = true;
 
-		// reset sum to zero
-		memset(gyro_samples, 0, sizeof(gyro_samples));
-		memset(accel_samples, 0, sizeof(accel_samples));
-		memset(accel_mean, 0, sizeof(accel_mean));
-		memset(accel_std, 0, sizeof(accel_std));
-		memset(gyro_mean, 0, sizeof(gyro_mean));
-		memset(gyro_std, 0, sizeof(gyro_std));
-
-		// attempt to get samples
-		for (int i = 0; i < g_calibration_count; i++) {
-			k_msleep(5);
-			imu_read(ctx);
-
-			// get accel data
-			for (int k = 0; k < 3; k++) {
-				accel_samples[i][k] = ctx->accel_raw[k];
-				accel_mean[k] += accel_samples[i][k];
-			}
+	// Check if acceleration magnitude is reasonable (should be close to 9.8 m/s²)
+	double accel_magnitude =
+		sqrt(accel_mean[0] * accel_mean[0] + accel_mean[1] * accel_mean[1] +
+		     accel_mean[2] * accel_mean[2]);
 
-			// get gyro data
-			for (int k = 0; k < 3; k++) {
-				gyro_samples[i][k] = ctx->gyro_raw[k];
-				gyro_mean[k] += gyro_samples[i][k];
-			}
-		}
+	if (accel_magnitude < 8.0 || accel_magnitude > 11.0) {
+		LOG_WRN("imu %d accel magnitude out of range: %10.4f (expected ~9.8)", inst->index,
+			accel_magnitude);
+		calibration_ok = false;
+	}
 
-		// find accel mean
-		for (int k = 0; k < 3; k++) {
-			accel_mean[k] /= g_calibration_count;
+	// Check if gyro readings are stable (low std deviation)
+	for (int k = 0; k < 3; k++) {
+		if (gyro_std[k] > 0.1) { // 0.1 rad/s threshold
+			CEREBRI_LOG_WRN_LIMIT("imu %d gyro axis %d too noisy: std=%10.4f",
+					      inst->index, k, gyro_std[k]);
+			calibration_ok = false;
 		}
+	}
 
-		// find gyro mean
-		for (int k = 0; k < 3; k++) {
-			gyro_mean[k] /= g_calibration_count;
-		}
+	if (!calibration_ok) {
+		return false;
+	}
 
-		// find std deviation
-		for (int i = 0; i < g_calibration_count; i++) {
-			for (int k = 0; k < 3; k++) {
-				double e = accel_samples[i][k] - accel_mean[k];
-				accel_std[k] += e * e;
-			}
+	inst->accel_bias[0] = accel_mean[0];
+	inst->accel_bias[1] = accel_mean[1];
+	inst->accel_bias[2] = 0;
+	inst->accel_scale = accel_magnitude / g_accel;
+	LOG_INF("imu %d accel", inst->index);
+	LOG_INF("mean: %10.4f %10.4f %10.4f", accel_mean[0], accel_mean[1], accel_mean[2]);
+	LOG_INF("std: %10.4f %10.4f %10.4f", accel_std[0], accel_std[1], accel_std[2]);
+	LOG_INF("scale %10.4f", inst->accel_scale);
 
-			// get gyro data
-			for (int k = 0; k < 3; k++) {
-				double e = gyro_samples[i][k] - gyro_mean[k];
-				gyro_std[k] += e * e;
-			}
+	LOG_INF("imu %d gyro", inst->index);
+	LOG_INF("mean: %10.4f %10.4f %10.4f", gyro_mean[0], gyro_mean[1], gyro_mean[2]);
+	LOG_INF("std: %10.4f %10.4f %10.4f", gyro_std[0], gyro_std[1], gyro_std[2]);
+	for (int k = 0; k < 3; k++) {
+		inst->gyro_bias[k] = gyro_mean[k];
+	}
+	return true;
+}
+
+/*
+ * Add the latest samples to the calibration, called once per work item so
+ * the work queue is never held for the whole calibration. Instances that
+ * fail are left out until the next calibration, it is retried only if all
+ * of them fail. Returns true once calibrated.
+ */
+static bool imu_calibrate(context_t *ctx)
+{
+	if (k_uptime_ticks() < ctx->calibration_retry_ticks) {
+		return false;
+	}
+
+	if (ctx->calibration_rounds == 0) {
+		LOG_INF("calibration started, keep device stationary");
+		for (int i = 0; i < IMU_COUNT; i++) {
+			struct imu_instance *inst = &ctx->inst[i];
+			inst->calibration_samples = 0;
+			memset(inst->accel_sum, 0, sizeof(inst->accel_sum));
+			memset(inst->accel_sum_sq, 0, sizeof(inst->accel_sum_sq));
+			memset(inst->gyro_sum, 0, sizeof(inst->gyro_sum));
+			memset(inst->gyro_sum_sq, 0, sizeof(inst->gyro_sum_sq));
 		}
+	}
+
+	for (int i = 0; i < IMU_COUNT; i++) {
+		imu_calibrate_add(&ctx->inst[i]);
+	}
+	if (++ctx->calibration_rounds < g_calibration_count) {
+		return false;
+	}
+	ctx->calibration_rounds = 0;
 
-		for (int k = 0; k < 3; k++) {
-			accel_std[k] = sqrt(accel_std[k] / g_calibration_count);
+	int first = -1;
+	for (int i = 0; i < IMU_COUNT; i++) {
+		struct imu_instance *inst = &ctx->inst[i];
+		inst->calibrated = imu_calibrate_finish(inst);
+		inst->healthy = inst->calibrated;
+		inst->faults = 0;
+		inst->recoveries = 0;
+		if (inst->calibrated && first < 0) {
+			first = i;
 		}
+	}
+
+	if (first < 0) {
+		LOG_INF("calibration failed, retrying...");
+		// Wait before retry
+		ctx->calibration_retry_ticks = k_uptime_ticks() + k_ms_to_ticks_ceil64(1000);
+		return false;
+	}
 
-		for (int k = 0; k < 3; k++) {
-			gyro_std[k] = sqrt(gyro_std[k] / g_calibration_count);
+	LOG_INF("calibration completed, imu %d selected", first);
+	atomic_set(&ctx->selected, first);
+	ctx->calibrated = true;
+	boot_ready_set(BOOT_READY_IMU);
+	ctx->calibration_stored = false;
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+	k_work_submit(&ctx->save_work);
+#endif
+	return true;
+}
+
+static void imu_corrected(const struct imu_instance *inst, double gyro[3], double accel[3])
+{
+	for (int j = 0; j < 3; j++) {
+		gyro[j] = inst->gyro_raw[j] - inst->gyro_bias[j];
+		accel[j] = (inst->accel_raw[j] - inst->accel_bias[j]) / inst->accel_scale;
+	}
+}
+
+static double median(const double *values, int n)
+{
+	double v[IMU_COUNT];
+	memcpy(v, values, n * sizeof(double));
+	// insertion sort, n is at most 4
+	for (int i = 1; i < n; i++) {
+		double x = v[i];
+		int j = i - 1;
+		for (; j >= 0 && v[j] > x; j--) {
+			v[j + 1] = v[j];
 		}
+		v[j + 1] = x;
+	}
+	return n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
 
-		// check if calibration acceptable
-		bool calibration_ok = true;
+/*
+ * Check the instances against each other and pick the output. An instance
+ * that was not read or is not calibrated sits out the vote, one that
+ * disagrees with the median of the others by more than the tolerances is
+ * dropped after g_vote_faults votes and back after g_vote_recoveries. With
+ * two instances left a disagreement can not be attributed, so both stay in
+ * and only the count of disagreements is kept. Failover happens in the
+ * vote of the sample that failed, the published sample never comes from
+ * an instance sitting out. Returns false if there is nothing to publish.
+ */
+static bool imu_vote(context_t *ctx, double gyro_out[3], double accel_out[3])
+{
+	double gyro[IMU_COUNT][3], accel[IMU_COUNT][3];
+	double ref_gyro[3], ref_accel[3];
+	int usable[IMU_COUNT];
+	int n = 0;
 
-		// Check if acceleration magnitude is reasonable (should be close to 9.8 m/s²)
-		double accel_magnitude =
-			sqrt(accel_mean[0] * accel_mean[0] + accel_mean[1] * accel_mean[1] +
-			     accel_mean[2] * accel_mean[2]);
+	for (int i = 0; i < IMU_COUNT; i++) {
+		struct imu_instance *inst = &ctx->inst[i];
+		if (!inst->calibrated || !inst->valid) {
+			continue;
+		}
+		imu_check_saturation(inst);
+		imu_corrected(inst, gyro[i], accel[i]);
+		usable[n++] = i;
+	}
 
-		if (accel_magnitude < 8.0 || accel_magnitude > 11.0) {
-			LOG_WRN("accel magnitude out of range: %10.4f (expected ~9.8)",
-				accel_magnitude);
-			calibration_ok = false;
+	if (n >= 3) {
+		for (int j = 0; j < 3; j++) {
+			double g[IMU_COUNT], a[IMU_COUNT];
+			for (int k = 0; k < n; k++) {
+				g[k] = gyro[usable[k]][j];
+				a[k] = accel[usable[k]][j];
+			}
+			ref_gyro[j] = median(g, n);
+			ref_accel[j] = median(a, n);
 		}
+	}
 
-		// Check if gyro readings are stable (low std deviation)
-		for (int k = 0; k < 3; k++) {
-			if (gyro_std[k] > 0.1) { // 0.1 rad/s threshold
-				LOG_WRN("gyro axis %d too noisy: std=%10.4f", k, gyro_std[k]);
-				calibration_ok = false;
+	for (int k = 0; k < n; k++) {
+		struct imu_instance *inst = &ctx->inst[usable[k]];
+		bool agree = true;
+		if (n == 2) {
+			const int other = usable[1 - k];
+			for (int j = 0; j < 3; j++) {
+				agree &= fabs(gyro[usable[k]][j] - gyro[other][j]) <=
+					 g_vote_gyro_tolerance;
+				agree &= fabs(accel[usable[k]][j] - accel[other][j]) <=
+					 g_vote_accel_tolerance;
+			}
+			if (!agree) {
+				inst->disagreements++;
+				agree = true;
+			}
+		} else if (n >= 3) {
+			for (int j = 0; j < 3; j++) {
+				agree &= fabs(gyro[usable[k]][j] - ref_gyro[j]) <=
+					 g_vote_gyro_tolerance;
+				agree &= fabs(accel[usable[k]][j] - ref_accel[j]) <=
+					 g_vote_accel_tolerance;
 			}
 		}
 
-		if (calibration_ok) {
-			break;
+		if (agree) {
+			inst->faults = 0;
+			if (!inst->healthy && ++inst->recoveries >= g_vote_recoveries) {
+				LOG_INF("imu %d healthy", inst->index);
+				inst->healthy = true;
+			}
 		} else {
-			LOG_INF("calibration failed, retrying...");
-			k_msleep(1000); // Wait before retry
+			inst->disagreements++;
+			inst->recoveries = 0;
+			if (inst->healthy && ++inst->faults >= g_vote_faults) {
+				LOG_WRN("imu %d disagrees, dropped", inst->index);
+				inst->healthy = false;
+			}
 		}
 	}
 
-	LOG_INF("calibration completed");
-	ctx->accel_bias[0] = accel_mean[0];
-	ctx->accel_bias[1] = accel_mean[1];
-	ctx->accel_bias[2] = 0;
-	ctx->accel_scale = sqrt(accel_mean[0] * accel_mean[0] + accel_mean[1] * accel_mean[1] +
-				accel_mean[2] * accel_mean[2]) /
-			   g_accel;
-	LOG_INF("accel");
-	LOG_INF("mean: %10.4f %10.4f %10.4f", accel_mean[0], accel_mean[1], accel_mean[2]);
-	LOG_INF("std: %10.4f %10.4f %10.4f", accel_std[0], accel_std[1], accel_std[2]);
-	LOG_INF("scale %10.4f", ctx->accel_scale);
+	if (n == 0) {
+		return false;
+	}
 
-	LOG_INF("gyro");
-	LOG_INF("mean: %10.4f %10.4f %10.4f", gyro_mean[0], gyro_mean[1], gyro_mean[2]);
-	LOG_INF("std: %10.4f %10.4f %10.4f", gyro_std[0], gyro_std[1], gyro_std[2]);
-	for (int k = 0; k < 3; k++) {
-		ctx->gyro_bias[k] = gyro_mean[k];
+	int selected = atomic_get(&ctx->selected);
+	const struct imu_instance *current = &ctx->inst[selected];
+	if (!current->valid || !current->calibrated || !current->healthy) {
+		// the first healthy one, or any one read if all of them disagree
+		int next = usable[0];
+		for (int k = 0; k < n; k++) {
+			if (ctx->inst[usable[k]].healthy) {
+				next = usable[k];
+				break;
+			}
+		}
+		if (next != selected) {
+			LOG_WRN("imu %d failed, switching to imu %d", selected, next);
+			selected = next;
+			atomic_set(&ctx->selected, selected);
+			ctx->failovers++;
+		}
 	}
-	ctx->calibrated = true;
+
+#if defined(CONFIG_CEREBRI_SENSE_IMU_BLEND)
+	int healthy = 0;
+	memset(gyro_out, 0, 3 * sizeof(double));
+	memset(accel_out, 0, 3 * sizeof(double));
+	for (int k = 0; k < n; k++) {
+		// the selected one is always in, even when no instance is healthy
+		if (!ctx->inst[usable[k]].healthy && usable[k] != selected) {
+			continue;
+		}
+		for (int j = 0; j < 3; j++) {
+			gyro_out[j] += gyro[usable[k]][j];
+			accel_out[j] += accel[usable[k]][j];
+		}
+		healthy++;
+	}
+	for (int j = 0; j < 3; j++) {
+		gyro_out[j] /= healthy;
+		accel_out[j] /= healthy;
+	}
+#else
+	memcpy(gyro_out, gyro[selected], 3 * sizeof(double));
+	memcpy(accel_out, accel[selected], 3 * sizeof(double));
+#endif
+	return true;
 }
 
-void imu_publish(context_t *ctx)
+void imu_publish(context_t *ctx, const double gyro[3], const double accel[3])
 {
 	// update message
-	stamp_msg(&ctx->imu.stamp, k_uptime_ticks());
-	ctx->imu.angular_velocity.x = ctx->gyro_raw[0] - ctx->gyro_bias[0];
-	ctx->imu.angular_velocity.y = ctx->gyro_raw[1] - ctx->gyro_bias[1];
-	ctx->imu.angular_velocity.z = ctx->gyro_raw[2] - ctx->gyro_bias[2];
-	ctx->imu.linear_acceleration.x =
-		(ctx->accel_raw[0] - ctx->accel_bias[0]) / ctx->accel_scale;
-	ctx->imu.linear_acceleration.y =
-		(ctx->accel_raw[1] - ctx->accel_bias[1]) / ctx->accel_scale;
-	ctx->imu.linear_acceleration.z =
-		(ctx->accel_raw[2] - ctx->accel_bias[2]) / ctx->accel_scale;
+	stamp_msg_now(&ctx->imu.stamp);
+	ctx->imu.angular_velocity.x = gyro[0];
+	ctx->imu.angular_velocity.y = gyro[1];
+	ctx->imu.angular_velocity.z = gyro[2];
+	ctx->imu.linear_acceleration.x = accel[0];
+	ctx->imu.linear_acceleration.y = accel[1];
+	ctx->imu.linear_acceleration.z = accel[2];
 
 	// publish message
-	zros_pub_update(&ctx->pub_imu);
+	synapse_latency_mark(SYNAPSE_LATENCY_IMU, &ctx->latency);
+	CEREBRI_TRACE_NAMED(TRACE_EVENT_PUBLISH, "imu", 0);
+	synapse_seqlock_publish(&seqlock_imu, &ctx->imu);
 	// LOG_INF("publish imu");
 }
 
 void imu_work_handler(struct k_work *work)
 {
-	context_t *ctx = CONTAINER_OF(work, context_t, work_item);
+	context_t *ctx = CONTAINER_OF(work, context_t, work_item.work);
+	CEREBRI_TRACE_NAMED(TRACE_EVENT_NODE_WAKE, "sense_imu", 0);
 
 	// update status
 	if (zros_sub_update_available(&ctx->sub_status)) {
@@ -302,36 +934,112 @@ void imu_work_handler(struct k_work *work)
 	if (ctx->status.mode == synapse_pb_Status_Mode_MODE_CALIBRATION &&
 	    ctx->last_mode != synapse_pb_Status_Mode_MODE_CALIBRATION) {
 		ctx->calibrated = false;
+		ctx->calibration_rounds = 0;
 	}
 	ctx->last_mode = ctx->status.mode;
 
 	if (!ctx->calibrated) {
-		LOG_INF("calibrating");
+		imu_read(ctx);
 		imu_calibrate(ctx);
 		return;
 	}
 
 	perf_duration_start(&control_latency);
+#if !defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+	// streamed batches are stamped when their fifo read completes
+	synapse_latency_begin(&ctx->latency);
+#endif
 	imu_read(ctx);
-	imu_publish(ctx);
+
+	double gyro[3], accel[3];
+	if (imu_vote(ctx, gyro, accel)) {
+		imu_publish(ctx, gyro, accel);
+	}
+#if defined(CONFIG_CEREBRI_SENSE_IMU_CALIBRATION_STORE)
+	imu_refine(ctx);
+#endif
 }
 
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+int sense_imu_entry_point(context_t *ctx)
+{
+	imu_init(ctx);
+	boot_mark("imu init");
+	// let the sensors settle for 1 s after power on before the initial
+	// calibration, the rest of the boot already counts towards it
+	if (!ctx->calibrated) {
+		k_sleep(K_TIMEOUT_ABS_MS(IMU_SETTLE_MS));
+	}
+
+	for (int i = 0; i < IMU_COUNT; i++) {
+		struct imu_instance *inst = &ctx->inst[i];
+		struct sensor_value val = {CONFIG_CEREBRI_SENSE_IMU_BATCH_DURATION, 0};
+		sensor_attr_set(inst->stream_config.sensor, SENSOR_CHAN_ALL,
+				SENSOR_ATTR_BATCH_DURATION, &val);
+
+		int rc = sensor_stream(g_imu_iodevs[i], &imu_rtio, inst, &inst->streaming_handle);
+		if (rc != 0) {
+			// the instance never becomes valid, the others carry on
+			LOG_ERR("imu %d: failed to start stream: %d", i, rc);
+		}
+	}
+	if (ctx->calibrated) {
+		boot_ready_set(BOOT_READY_IMU);
+	}
+
+	// fifo watermark interrupts drive the rtio reads, this thread only decodes
+	while (true) {
+		sensor_processing_with_callback(&imu_rtio, imu_stream_callback);
+	}
+	return 0;
+}
+#else
 void imu_timer_handler(struct k_timer *timer)
 {
 	context_t *ctx = CONTAINER_OF(timer, context_t, timer);
-	k_work_submit_to_queue(&g_high_priority_work_q, &ctx->work_item);
+	workq_submit(&g_high_priority_work_q, &ctx->work_item);
 }
 
 int sense_imu_entry_point(context_t *ctx)
 {
 	imu_init(ctx);
-	// delay initiali calibration 1 s
-	k_msleep(1000);
+	boot_mark("imu init");
+	// let the sensors settle for 1 s after power on before the initial
+	// calibration, the rest of the boot already counts towards it
+	if (!ctx->calibrated) {
+		k_sleep(K_TIMEOUT_ABS_MS(IMU_SETTLE_MS));
+	}
 	k_timer_start(&ctx->timer, K_MSEC(5), K_MSEC(5));
+	if (ctx->calibrated) {
+		boot_ready_set(BOOT_READY_IMU);
+	}
 	return 0;
 }
+#endif
 
 K_THREAD_DEFINE(sense_imu, THREAD_STACK_SIZE, sense_imu_entry_point, &g_ctx, NULL, NULL,
 		THREAD_PRIORITY, 0, 100);
 
+static int cmd_sense_imu(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	context_t *ctx = &g_ctx;
+
+	shell_print(sh, "selected: %d failovers: %u calibrated: %d",
+		    (int)atomic_get(&ctx->selected), ctx->failovers, ctx->calibrated);
+	for (int i = 0; i < IMU_COUNT; i++) {
+		const struct imu_instance *inst = &ctx->inst[i];
+		shell_print(sh, "imu %d: calibrated: %d valid: %d healthy: %d disagreements: %u", i,
+			    inst->calibrated, inst->valid, inst->healthy, inst->disagreements);
+#if defined(CONFIG_CEREBRI_SENSE_IMU_STREAM)
+		shell_print(sh, "       batches: %u empty: %u interval: %lld us", inst->batches,
+			    inst->empty_batches, k_ticks_to_us_floor64(inst->interval_ticks));
+#endif
+	}
+	return 0;
+}
+
+SHELL_CMD_REGISTER(sense_imu, NULL, "Imu instances and voting", cmd_sense_imu);
+
 // vi: ts=4 sw=4 et
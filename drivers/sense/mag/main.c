@@ -2,132 +2,431 @@
  * Copyright CogniPilot Foundation 2023
  * SPDX-License-Identifier: Apache-2.0
  */
+#include <stdlib.h>
+#include <string.h>
+
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+#if defined(CONFIG_CEREBRI_SENSE_MAG_CALIBRATION_STORE)
+#include <zephyr/settings/settings.h>
+#endif
 
 #include <cerebri/core/common.h>
+#include <cerebri/core/workq.h>
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+#include <cerebri/core/sensor_sched.h>
+#endif
 
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_pub_struct.h>
 #include <zros/zros_node.h>
 #include <zros/zros_pub.h>
 
+#include <dsp/basic_math_functions.h>
+#include <dsp/matrix_functions.h>
+
 #include <synapse_topic_list.h>
 
 LOG_MODULE_REGISTER(sense_mag, CONFIG_CEREBRI_SENSE_MAG_LOG_LEVEL);
 
 #define MY_STACK_SIZE 2048
 #define MY_PRIORITY   6
+#define PERIOD_MS     20
+#define MAG_COUNT     CONFIG_CEREBRI_SENSE_MAG_COUNT
+// a sample older than this is left out of the fusion
+#define STALE_MS      (3 * PERIOD_MS)
 
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
 extern struct k_work_q g_high_priority_work_q;
 void mag_work_handler(struct k_work *work);
+#endif
+
+// hard iron bias b and soft iron matrix A in the body frame, calibrated = A (R raw - b)
+struct mag_calibration {
+	double A[3][3];
+	double b[3];
+};
+
+// body from sensor rotation of a device, from a cerebri,sensor-mount node
+struct mag_mount {
+	const struct device *dev;
+	// cells, (-1) reads back as 0xffffffff
+	uint32_t rotation[9];
+};
+
+#define MAG_MOUNT(node)                                                                            \
+	{.dev = DEVICE_DT_GET(DT_PHANDLE(node, sensor)), .rotation = DT_PROP(node, rotation)},
+
+static const struct mag_mount g_mag_mounts[] = {
+	DT_FOREACH_STATUS_OKAY(cerebri_sensor_mount, MAG_MOUNT)};
+
+// mounting of the mags without a mount node
+static const float g_mag_rotation_default[9] = {0, 1, 0, -1, 0, 0, 0, 0, -1};
 
 typedef struct context {
-	struct k_work work_item;
-	const struct device *device[CONFIG_CEREBRI_SENSE_MAG_COUNT];
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	struct workq_item work_item;
+#endif
+	const struct device *device[MAG_COUNT];
 	struct zros_node node;
 	struct zros_pub pub;
 	synapse_pb_MagneticField data;
+	double raw[MAG_COUNT][3];
+	struct mag_calibration cal[MAG_COUNT];
+	// only calibrated mags are fused
+	bool calibrated[MAG_COUNT];
+	float rotation[MAG_COUNT][9];
+	// A R and A b, so a sample is one matrix vector product and a subtraction
+	float M[MAG_COUNT][9];
+	float offset[MAG_COUNT][3];
+	// calibrated body frame field of each mag and the ticks it was read at
+	float field[MAG_COUNT][3];
+	int64_t ticks[MAG_COUNT];
+	uint32_t fused;
 } context_t;
 
-static context_t g_ctx = {.work_item = Z_WORK_INITIALIZER(mag_work_handler),
-			  .device = {},
-			  .node = {},
-			  .pub = {},
-			  .data = {
-				  .has_stamp = true,
-				  .frame_id = "base_link",
-				  .stamp = synapse_pb_Timestamp_init_default,
-				  .magnetic_field = synapse_pb_Vector3_init_default,
-				  .has_magnetic_field = true,
-				  .magnetic_field_covariance = {},
-				  .magnetic_field_covariance_count = 0,
-			  }};
+#define MAG_CAL_IDENTITY(i, _)                                                                     \
+	{.A = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}, .b = {0, 0, 0}}
 
-void mag_work_handler(struct k_work *work)
+static context_t g_ctx = {
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	.work_item = WORKQ_ITEM_INITIALIZER(mag_work_handler, "sense_mag", 5000),
+#endif
+	.device = {},
+	.node = {},
+	.pub = {},
+	.data =
+		{
+			.has_stamp = true,
+			.frame_id = "base_link",
+			.stamp = synapse_pb_Timestamp_init_default,
+			.magnetic_field = synapse_pb_Vector3_init_default,
+			.has_magnetic_field = true,
+			.magnetic_field_covariance = {},
+			.magnetic_field_covariance_count = 0,
+		},
+	.raw = {},
+	// Define calibration parameters, the first mag is the one calibrated in tree
+	.cal =
+		{
+			{
+				.A = {{2.0199, -0.0516, 0.1352},
+				      {0.0000, 1.9783, -0.0096},
+				      {0.0000, 0.0000, 2.0242}},
+				.b = {0.0017, 0.0235, -0.0057},
+			},
+#if MAG_COUNT > 1
+			LISTIFY(UTIL_DEC(MAG_COUNT), MAG_CAL_IDENTITY, (,)),
+#endif
+		},
+	.calibrated = {true},
+	.ticks = {},
+	.fused = 0,
+};
+
+static void mag_precompute(context_t *ctx, int i)
 {
-	context_t *ctx = CONTAINER_OF(work, context_t, work_item);
-	double mag_data_array[CONFIG_CEREBRI_SENSE_MAG_COUNT][3] = {};
-	for (int i = 0; i < CONFIG_CEREBRI_SENSE_MAG_COUNT; i++) {
-		// default all data to zero
-		struct sensor_value mag_value[3] = {};
+	const struct mag_calibration *cal = &ctx->cal[i];
+	const float *R = ctx->rotation[i];
 
-		// get accel if device present
-		if (ctx->device[i] != NULL) {
-			sensor_sample_fetch(ctx->device[i]);
-			sensor_channel_get(ctx->device[i], SENSOR_CHAN_MAGN_XYZ, mag_value);
-			LOG_DBG("mag %d: %d.%06d %d.%06d %d.%06d", i, mag_value[0].val1,
-				mag_value[0].val2, mag_value[1].val1, mag_value[1].val2,
-				mag_value[2].val1, mag_value[2].val2);
+	for (int r = 0; r < 3; r++) {
+		double offset = 0;
+		for (int c = 0; c < 3; c++) {
+			double m = 0;
+			for (int k = 0; k < 3; k++) {
+				m += cal->A[r][k] * R[3 * k + c];
+			}
+			ctx->M[i][3 * r + c] = m;
+			offset += cal->A[r][c] * cal->b[c];
 		}
+		ctx->offset[i][r] = offset;
+	}
+}
 
-		for (int j = 0; j < 3; j++) {
-			mag_data_array[i][j] = mag_value[j].val1 + mag_value[j].val2 * 1e-6;
+static void mag_mount_init(context_t *ctx)
+{
+	for (int i = 0; i < MAG_COUNT; i++) {
+		memcpy(ctx->rotation[i], g_mag_rotation_default, sizeof(ctx->rotation[i]));
+		for (int j = 0; j < ARRAY_SIZE(g_mag_mounts); j++) {
+			if (ctx->device[i] == NULL || g_mag_mounts[j].dev != ctx->device[i]) {
+				continue;
+			}
+			for (int k = 0; k < 9; k++) {
+				ctx->rotation[i][k] = (int32_t)g_mag_mounts[j].rotation[k];
+			}
+			LOG_INF("mag %d: mount from devicetree", i);
 		}
+		mag_precompute(ctx, i);
 	}
+}
 
-	// select first mag for data for now: TODO implement voting
-	double mag[3] = {mag_data_array[0][1], -mag_data_array[0][0], -mag_data_array[0][2]};
-
-	// Define calibration parameters
-	double A[3][3] = {
-		{2.0199, -0.0516, 0.1352}, {0.0000, 1.9783, -0.0096}, {0.0000, 0.0000, 2.0242}};
-	double b[3] = {0.0017, 0.0235, -0.0057};
+#if defined(CONFIG_CEREBRI_SENSE_MAG_CALIBRATION_STORE)
+static int mag_settings_set(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	struct mag_calibration cal;
 
-	double temp[3];
+	const char *next;
 
-	// Subtract bias
-	for (int i = 0; i < 3; i++) {
-		mag[i] -= b[i];
+	if (settings_name_next(key, &next) != 1 || next != NULL || key[0] < '0' ||
+	    key[0] >= '0' + MAG_COUNT) {
+		return -ENOENT;
+	}
+	if (len != sizeof(cal) || read_cb(cb_arg, &cal, len) != (ssize_t)len) {
+		return -EINVAL;
 	}
+	// loaded before the publisher starts, precomputed with the mounts at init
+	g_ctx.cal[key[0] - '0'] = cal;
+	g_ctx.calibrated[key[0] - '0'] = true;
+	return 0;
+}
 
-	// Apply calibration matrix
-	for (int i = 0; i < 3; i++) {
-		temp[i] = 0;
-		for (int j = 0; j < 3; j++) {
-			temp[i] += A[i][j] * mag[j];
+SETTINGS_STATIC_HANDLER_DEFINE(sense_mag, "sense_mag", NULL, mag_settings_set, NULL, NULL);
+#endif
+
+// rotate and calibrate the sample of mag i where it was read
+static void mag_correct(context_t *ctx, int i)
+{
+	float raw[3] = {ctx->raw[i][0], ctx->raw[i][1], ctx->raw[i][2]};
+	arm_matrix_instance_f32 M = {.numRows = 3, .numCols = 3, .pData = ctx->M[i]};
+
+	arm_mat_vec_mult_f32(&M, raw, ctx->field[i]);
+	arm_sub_f32(ctx->field[i], ctx->offset[i], ctx->field[i], 3);
+	ctx->ticks[i] = k_uptime_ticks();
+}
+
+// a fresh calibrated sample, an all zero one is a device that is not there
+static bool mag_usable(const context_t *ctx, int i, int64_t now)
+{
+	const float *field = ctx->field[i];
+	bool stale = ctx->ticks[i] == 0 || now - ctx->ticks[i] > k_ms_to_ticks_ceil64(STALE_MS);
+	return ctx->calibrated[i] && !stale && !(field[0] == 0 && field[1] == 0 && field[2] == 0);
+}
+
+/*
+ * Fuse the fresh calibrated mags into one body frame vector, their mean,
+ * or with CEREBRI_SENSE_MAG_SELECT the first one in alias order.
+ */
+static void mag_publish(context_t *ctx)
+{
+	int64_t now = k_uptime_ticks();
+	float mag[3] = {};
+	int n = 0;
+
+	for (int i = 0; i < MAG_COUNT; i++) {
+		if (!mag_usable(ctx, i, now)) {
+			continue;
+		}
+		arm_add_f32(mag, ctx->field[i], mag, 3);
+		n++;
+		if (IS_ENABLED(CONFIG_CEREBRI_SENSE_MAG_SELECT)) {
+			break;
 		}
 	}
-
-	// Copy calibrated data back
-	for (int i = 0; i < 3; i++) {
-		mag[i] = temp[i];
+	if (n == 0) {
+		return;
 	}
+	arm_scale_f32(mag, 1.0f / n, mag, 3);
+	ctx->fused = n;
 
 	// publish
-	stamp_msg(&ctx->data.stamp, k_uptime_ticks());
+	stamp_msg(&ctx->data.stamp, now);
 	ctx->data.magnetic_field.x = mag[0];
 	ctx->data.magnetic_field.y = mag[1];
 	ctx->data.magnetic_field.z = mag[2];
 	zros_pub_update(&ctx->pub);
 }
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+// the first usable mag paces publishing, so a missing or failed mag 0 does not stop it
+static int mag_pacer(const context_t *ctx)
+{
+	int64_t now = k_uptime_ticks();
+	for (int i = 0; i < MAG_COUNT; i++) {
+		if (mag_usable(ctx, i, now)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// runs on the sensor scheduler thread once the async read of a mag completes
+static void mag_read_done(struct sensor_sched_client *client, int result, const uint8_t *buf,
+			  uint32_t len)
+{
+	context_t *ctx = &g_ctx;
+	int i = POINTER_TO_UINT(client->user_data);
+	ARG_UNUSED(len);
+
+	if (result < 0 || sensor_sched_decode(client, buf, SENSOR_CHAN_MAGN_XYZ, ctx->raw[i], 3)) {
+		LOG_DBG("mag %d read failed: %d", i, result);
+		return;
+	}
+	LOG_DBG("mag %d: %10.6f %10.6f %10.6f", i, ctx->raw[i][0], ctx->raw[i][1], ctx->raw[i][2]);
+	mag_correct(ctx, i);
+
+	// the others are at most a period old
+	if (mag_pacer(ctx) == i) {
+		mag_publish(ctx);
+	}
+}
+
+#define MAG_CLIENT(i, _)                                                                           \
+	SENSOR_SCHED_CLIENT_DEFINE(mag_client##i, DT_ALIAS(mag##i), PERIOD_MS, mag_read_done,      \
+				   UINT_TO_POINTER(i), {SENSOR_CHAN_MAGN_XYZ, 0});
+#define MAG_CLIENT_REF(i, _) &mag_client##i
+
+LISTIFY(CONFIG_CEREBRI_SENSE_MAG_COUNT, MAG_CLIENT, ())
+
+static struct sensor_sched_client *const g_mag_clients[] = {
+	LISTIFY(CONFIG_CEREBRI_SENSE_MAG_COUNT, MAG_CLIENT_REF, (,))};
+#else
+void mag_work_handler(struct k_work *work)
+{
+	context_t *ctx = CONTAINER_OF(work, context_t, work_item.work);
+	for (int i = 0; i < MAG_COUNT; i++) {
+		struct sensor_value mag_value[3] = {};
+
+		// get mag if device present, a failed fetch leaves its last sample to go stale
+		if (ctx->device[i] == NULL || sensor_sample_fetch(ctx->device[i]) < 0) {
+			continue;
+		}
+		sensor_channel_get(ctx->device[i], SENSOR_CHAN_MAGN_XYZ, mag_value);
+		LOG_DBG("mag %d: %d.%06d %d.%06d %d.%06d", i, mag_value[0].val1, mag_value[0].val2,
+			mag_value[1].val1, mag_value[1].val2, mag_value[2].val1, mag_value[2].val2);
+
+		for (int j = 0; j < 3; j++) {
+			ctx->raw[i][j] = mag_value[j].val1 + mag_value[j].val2 * 1e-6;
+		}
+		mag_correct(ctx, i);
+	}
+	mag_publish(ctx);
+}
+
 void mag_timer_handler(struct k_timer *dummy)
 {
-	k_work_submit_to_queue(&g_high_priority_work_q, &g_ctx.work_item);
+	workq_submit(&g_high_priority_work_q, &g_ctx.work_item);
 }
 
 K_TIMER_DEFINE(mag_timer, mag_timer_handler, NULL);
+#endif
+
+#define MAG_DEVICE(i, _) ctx->device[i] = get_device(DEVICE_DT_GET(DT_ALIAS(mag##i)));
 
 int sense_mag_entry_point(context_t *ctx)
 {
 	LOG_INF("init");
-	ctx->device[0] = get_device(DEVICE_DT_GET(DT_ALIAS(mag0)));
-#if CONFIG_CEREBRI_SENSE_MAG_COUNT >= 2
-	ctx->device[1] = get_device(DEVICE_DT_GET(DT_ALIAS(mag1)));
-#elif CONFIG_CEREBRI_SENSE_MAG_COUNT >= 3
-	ctx->device[2] = get_device(DEVICE_DT_GET(DT_ALIAS(mag2)));
-#elif CONFIG_CEREBRI_SENSE_MAG_COUNT >= 4
-	ctx->device[3] = get_device(DEVICE_DT_GET(DT_ALIAS(mag3)));
+	LISTIFY(MAG_COUNT, MAG_DEVICE, ())
+
+#if defined(CONFIG_CEREBRI_SENSE_MAG_CALIBRATION_STORE)
+	settings_subsys_init();
+	settings_load_subtree("sense_mag");
 #endif
+	mag_mount_init(ctx);
 
 	zros_node_init(&ctx->node, "sense_mag");
 	zros_pub_init(&ctx->pub, &ctx->node, &topic_magnetic_field, &ctx->data);
-	k_timer_start(&mag_timer, K_MSEC(20), K_MSEC(20));
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	for (int i = 0; i < ARRAY_SIZE(g_mag_clients); i++) {
+		sensor_sched_add(g_mag_clients[i]);
+	}
+#else
+	k_timer_start(&mag_timer, K_MSEC(PERIOD_MS), K_MSEC(PERIOD_MS));
+#endif
 	return 0;
 }
 
+static void mag_print_calibration(const struct shell *sh, const struct mag_calibration *cal)
+{
+	shell_print(sh, "b: %10.4f %10.4f %10.4f", cal->b[0], cal->b[1], cal->b[2]);
+	for (int i = 0; i < 3; i++) {
+		shell_print(sh, "A: %10.4f %10.4f %10.4f", cal->A[i][0], cal->A[i][1],
+			    cal->A[i][2]);
+	}
+}
+
+static int cmd_sense_mag_cal(const struct shell *sh, size_t argc, char **argv)
+{
+	context_t *ctx = &g_ctx;
+	char *end;
+
+	int n = strtol(argv[1], &end, 10);
+	if (*end != '\0' || n < 0 || n >= MAG_COUNT) {
+		shell_error(sh, "no mag %s", argv[1]);
+		return -EINVAL;
+	}
+	if (argc == 2) {
+		mag_print_calibration(sh, &ctx->cal[n]);
+		return 0;
+	} else if (argc != 14) {
+		shell_error(sh, "expected 12 values");
+		return -EINVAL;
+	}
+
+	// b0 b1 b2 then A row by row
+	struct mag_calibration cal;
+	for (int i = 0; i < 12; i++) {
+		double v = strtod(argv[i + 2], &end);
+		if (*end != '\0') {
+			shell_error(sh, "not a number: %s", argv[i + 2]);
+			return -EINVAL;
+		}
+		if (i < 3) {
+			cal.b[i] = v;
+		} else {
+			cal.A[(i - 3) / 3][(i - 3) % 3] = v;
+		}
+	}
+	ctx->cal[n] = cal;
+	mag_precompute(ctx, n);
+	ctx->calibrated[n] = true;
+	mag_print_calibration(sh, &ctx->cal[n]);
+#if defined(CONFIG_CEREBRI_SENSE_MAG_CALIBRATION_STORE)
+	char key[] = "sense_mag/0";
+	key[sizeof(key) - 2] = '0' + n;
+	if (settings_save_one(key, &cal, sizeof(cal)) < 0) {
+		shell_error(sh, "saving failed");
+		return -EIO;
+	}
+#else
+	shell_print(sh, "not saved, CONFIG_CEREBRI_SENSE_MAG_CALIBRATION_STORE is off");
+#endif
+	return 0;
+}
+
+static int cmd_sense_mag_status(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	context_t *ctx = &g_ctx;
+	int64_t now = k_uptime_ticks();
+
+	for (int i = 0; i < MAG_COUNT; i++) {
+		shell_print(sh, "mag %d: %10.4f %10.4f %10.4f age: %lld ms", i,
+			    (double)ctx->field[i][0], (double)ctx->field[i][1],
+			    (double)ctx->field[i][2],
+			    ctx->ticks[i] == 0 ? -1LL : k_ticks_to_ms_floor64(now - ctx->ticks[i]));
+	}
+	shell_print(sh, "fused: %u", ctx->fused);
+	for (int i = 0; i < MAG_COUNT; i++) {
+		if (!ctx->calibrated[i]) {
+			shell_print(sh, "mag %d: not calibrated, not fused", i);
+		}
+	}
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_sense_mag,
+			       SHELL_CMD_ARG(cal, NULL, "Show or set <n> [b0 b1 b2 A00 ... A22].",
+					     cmd_sense_mag_cal, 2, 12),
+			       SHELL_CMD(status, NULL, "Calibrated field of each mag.",
+					 cmd_sense_mag_status),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(sense_mag, &sub_sense_mag, "sense_mag commands", NULL);
+
 K_THREAD_DEFINE(sense_mag, MY_STACK_SIZE, sense_mag_entry_point, &g_ctx, NULL, NULL, MY_PRIORITY, 0,
 		100);
 
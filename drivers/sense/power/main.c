@@ -2,6 +2,7 @@
  * Copyright CogniPilot Foundation 2023
  * SPDX-License-Identifier: Apache-2.0
  */
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <zephyr/device.h>
@@ -10,6 +11,12 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
 
+#include <cerebri/core/log_utils.h>
+#include <cerebri/core/workq.h>
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+#include <cerebri/core/sensor_sched.h>
+#endif
+
 #include <synapse_topic_list.h>
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_pub_struct.h>
@@ -20,26 +27,97 @@ LOG_MODULE_REGISTER(sense_power, CONFIG_CEREBRI_SENSE_POWER_LOG_LEVEL);
 
 #define MY_STACK_SIZE 2048
 #define MY_PRIORITY   6
+#define PERIOD_MS     CONFIG_CEREBRI_SENSE_POWER_SAMPLE_PERIOD_MS
+// samples integrated per published battery state
+#define PUBLISH_EVERY MAX(CONFIG_CEREBRI_SENSE_POWER_PUBLISH_PERIOD_MS / PERIOD_MS, 1)
+
+// full charge of a lipo cell, the top of g_cell_ocv
+#define CELL_FULL_MV 4200
+// the pack is declared with the battery options of the vehicle
+#if defined(CONFIG_CEREBRI_RDD2_BATTERY_NCELLS)
+#define CELLS CONFIG_CEREBRI_RDD2_BATTERY_NCELLS
+#elif defined(CONFIG_CEREBRI_B3RB_BATTERY_MAX_MILLIVOLT)
+#define CELLS DIV_ROUND_CLOSEST(CONFIG_CEREBRI_B3RB_BATTERY_MAX_MILLIVOLT, CELL_FULL_MV)
+#elif defined(CONFIG_CEREBRI_MELM_BATTERY_MAX_MILLIVOLT)
+#define CELLS DIV_ROUND_CLOSEST(CONFIG_CEREBRI_MELM_BATTERY_MAX_MILLIVOLT, CELL_FULL_MV)
+#else
+#define CELLS 4
+#endif
+#define CAPACITY_AH    (CONFIG_CEREBRI_SENSE_POWER_CAPACITY_MAH * 1e-3f)
+#define RESISTANCE     (CONFIG_CEREBRI_SENSE_POWER_RESISTANCE_MOHM * 1e-3f)
+#define RATED_CURRENT  ((float)CONFIG_CEREBRI_SENSE_POWER_RATED_CURRENT_A)
+// voltage under the rated current of a full pack at the initial resistance, thrust_scale 1
+#define FULL_LOADED_V  (CELLS * CELL_FULL_MV * 1e-3f - RATED_CURRENT * RESISTANCE)
+// a pack reading below this per cell is a sensor fault or no pack, not a charge state
+#define CELL_VALID_V   2.5f
+// current step that is large enough to read the resistance from its sag, A
+#define R_STEP_CURRENT 2.0f
+// below this the pack is at rest and its voltage pulls the charge estimate, A
+#define REST_CURRENT   1.0f
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+// reads are queued by the sensor scheduler
+#elif defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+extern struct k_work_q g_shared_work_q;
+#define POWER_WORK_Q g_shared_work_q
+#else
 extern struct k_work_q g_low_priority_work_q;
+#define POWER_WORK_Q g_low_priority_work_q
+#endif
 
 #define N_SENSORS 1
 
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
 void power_work_handler(struct k_work *work);
+#endif
+
+BUILD_ASSERT(CELLS > 0, "sense_power needs the cell count of the pack");
+
+// lipo open circuit cell voltage at 0, 10, .. 100 % charge
+static const float g_cell_ocv[] = {3.30f, 3.60f, 3.69f, 3.73f, 3.77f, 3.81f,
+				   3.85f, 3.91f, 3.98f, 4.07f, 4.20f};
+
+/*
+ * Battery model, updated every sample. The open circuit voltage is the
+ * measured one plus the sag of the current over the pack resistance, the
+ * resistance is learned from the sag of each large current step. Charge
+ * is integrated from the current, starts from the open circuit voltage of
+ * the first sample and is pulled slowly towards it while the pack rests,
+ * which bounds the drift of the current offset.
+ */
+struct battery_model {
+	int64_t ticks;
+	float voltage;
+	float current;
+	float current_mean;
+	float voltage_oc;
+	float resistance;
+	float charge;
+	bool started;
+};
 
 typedef struct context {
-	struct k_work work_item;
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	struct workq_item work_item;
+#endif
 	const struct device *device[N_SENSORS];
 	struct zros_node node;
-	struct zros_pub pub;
+	struct zros_pub pub, pub_headroom;
 	synapse_pb_BatteryState data;
+	struct synapse_battery_headroom headroom;
+	struct battery_model model;
+	uint32_t samples;
+	bool initialized;
 } context_t;
 
 static context_t g_ctx = {
-	.work_item = Z_WORK_INITIALIZER(power_work_handler),
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	.work_item = WORKQ_ITEM_INITIALIZER(power_work_handler, "sense_power", 20000),
+#endif
 	.device = {},
 	.node = {},
 	.pub = {},
+	.pub_headroom = {},
 	.data = {
 		.has_stamp = true,
 		.stamp = synapse_pb_Timestamp_init_default,
@@ -61,11 +139,162 @@ static context_t g_ctx = {
 		.serial_number = "0",
 		.temperature = 0,
 		.voltage = 0,
-	}};
+	},
+	.headroom = {},
+	.model = {.resistance = RESISTANCE},
+	.samples = 0,
+	.initialized = false,
+};
+
+static void sense_power_init(context_t *ctx)
+{
+	LOG_INF("init");
+	ctx->device[0] = DEVICE_DT_GET(DT_ALIAS(power0));
+	if (!device_is_ready(ctx->device[0])) {
+		LOG_ERR("Device %s is not ready", ctx->device[0]->name);
+	}
+	zros_node_init(&ctx->node, "sense_power");
+	zros_pub_init(&ctx->pub, &ctx->node, &topic_battery_state, &ctx->data);
+	zros_pub_init(&ctx->pub_headroom, &ctx->node, &topic_battery_headroom, &ctx->headroom);
+	ctx->initialized = true;
+}
 
+// state of charge of an open circuit pack voltage, from the cell curve
+static float battery_soc_from_ocv(float voltage_oc)
+{
+	float cell = voltage_oc / CELLS;
+	const int n = ARRAY_SIZE(g_cell_ocv);
+	if (cell <= g_cell_ocv[0]) {
+		return 0;
+	}
+	for (int i = 1; i < n; i++) {
+		if (cell < g_cell_ocv[i]) {
+			float lo = g_cell_ocv[i - 1];
+			return (i - 1 + (cell - lo) / (g_cell_ocv[i] - lo)) / (n - 1);
+		}
+	}
+	return 1;
+}
+
+static void battery_model_update(struct battery_model *m, float voltage, float current,
+				 int64_t ticks)
+{
+	if (!m->started) {
+		m->started = true;
+		m->voltage_oc = voltage + current * m->resistance;
+		m->charge = CAPACITY_AH * battery_soc_from_ocv(m->voltage_oc);
+		m->current_mean = current;
+	} else {
+		float dt = k_ticks_to_us_floor64(ticks - m->ticks) * 1e-6f;
+		float di = current - m->current;
+		if (fabsf(di) > R_STEP_CURRENT) {
+			float r = -(voltage - m->voltage) / di;
+			// a step that the voltage did not follow, or followed backwards, is noise
+			if (r > 0.1f * RESISTANCE && r < 10 * RESISTANCE) {
+				m->resistance += 0.05f * (r - m->resistance);
+			}
+		}
+		m->charge -= current * dt / 3600.0f;
+		m->current_mean += 0.01f * (current - m->current_mean);
+		m->voltage_oc += 0.1f * (voltage + current * m->resistance - m->voltage_oc);
+		if (fabsf(current) < REST_CURRENT) {
+			float rest = CAPACITY_AH * battery_soc_from_ocv(m->voltage_oc);
+			m->charge += 1e-3f * (rest - m->charge);
+		}
+		m->charge = CLAMP(m->charge, 0.0f, CAPACITY_AH);
+	}
+	m->ticks = ticks;
+	m->voltage = voltage;
+	m->current = current;
+}
+
+static void power_publish(context_t *ctx)
+{
+	const struct battery_model *m = &ctx->model;
+	int64_t now_ns = synapse_now_ns();
+	float remaining = m->charge / CAPACITY_AH;
+
+	stamp_msg_ns(&ctx->data.stamp, now_ns);
+	ctx->data.voltage = m->voltage;
+	ctx->data.current = m->current;
+	ctx->data.charge = m->charge;
+	ctx->data.capacity = CAPACITY_AH;
+	ctx->data.design_capacity = CAPACITY_AH;
+	ctx->data.percentage = remaining;
+	ctx->data.power_supply_status =
+		m->current > REST_CURRENT
+			? synapse_pb_BatteryState_PowerSupplyStatus_DISCHARGING
+			: synapse_pb_BatteryState_PowerSupplyStatus_NOT_CHARGING;
+	zros_pub_update(&ctx->pub);
+
+	float loaded = m->voltage_oc - RATED_CURRENT * m->resistance;
+	float scale = CLAMP(loaded / FULL_LOADED_V, 0.0f, 1.0f);
+	ctx->headroom.stamp_ns = now_ns;
+	ctx->headroom.voltage_oc = m->voltage_oc;
+	ctx->headroom.resistance = m->resistance;
+	ctx->headroom.remaining = remaining;
+	ctx->headroom.charge = m->charge;
+	ctx->headroom.thrust_scale = scale * scale;
+	ctx->headroom.time_remaining_s =
+		m->current_mean > REST_CURRENT ? 3600.0f * m->charge / m->current_mean : 0;
+	zros_pub_update(&ctx->pub_headroom);
+}
+
+static void power_sample(context_t *ctx, double voltage, double current)
+{
+	// left out of the model, the last published headroom stands
+	if (!isfinite(voltage) || !isfinite(current) || voltage < CELLS * CELL_VALID_V) {
+		CEREBRI_LOG_WRN_LIMIT("invalid reading %g V %g A", voltage, current);
+		return;
+	}
+	battery_model_update(&ctx->model, voltage, current, k_uptime_ticks());
+	if (++ctx->samples % PUBLISH_EVERY == 0) {
+		power_publish(ctx);
+	}
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+// runs on the sensor scheduler thread once the async read completes
+static void power_read_done(struct sensor_sched_client *client, int result, const uint8_t *buf,
+			    uint32_t len)
+{
+	context_t *ctx = &g_ctx;
+	double voltage, current;
+	ARG_UNUSED(len);
+
+	// without the init thread, topics are registered by the first sample
+	if (!ctx->initialized) {
+		sense_power_init(ctx);
+	}
+
+	if (result < 0 || sensor_sched_decode(client, buf, SENSOR_CHAN_VOLTAGE, &voltage, 1) < 0 ||
+	    sensor_sched_decode(client, buf, SENSOR_CHAN_CURRENT, &current, 1) < 0) {
+		LOG_DBG("read failed: %d", result);
+		return;
+	}
+	power_sample(ctx, voltage, current);
+}
+
+SENSOR_SCHED_CLIENT_DEFINE(power_client, DT_ALIAS(power0), PERIOD_MS, power_read_done, NULL,
+			   {SENSOR_CHAN_VOLTAGE, 0}, {SENSOR_CHAN_CURRENT, 0});
+
+static void power_start(context_t *ctx)
+{
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+	sense_power_init(ctx);
+#endif
+	sensor_sched_add(&power_client);
+}
+#else
 void power_work_handler(struct k_work *work)
 {
-	context_t *ctx = CONTAINER_OF(work, context_t, work_item);
+	context_t *ctx = CONTAINER_OF(work, context_t, work_item.work);
+
+	// without the init thread, topics are registered by the first sample
+	if (!ctx->initialized) {
+		sense_power_init(ctx);
+	}
+
 	int ret = sensor_sample_fetch(ctx->device[0]);
 	if (ret) {
 		LOG_ERR("Could not fetch sensor data");
@@ -76,34 +305,42 @@ void power_work_handler(struct k_work *work)
 	sensor_channel_get(ctx->device[0], SENSOR_CHAN_VOLTAGE, &voltage);
 	sensor_channel_get(ctx->device[0], SENSOR_CHAN_CURRENT, &current);
 
-	stamp_msg(&ctx->data.stamp, k_uptime_ticks());
-	ctx->data.voltage = sensor_value_to_double(&voltage);
-	ctx->data.current = sensor_value_to_double(&current);
-
-	zros_pub_update(&ctx->pub);
+	power_sample(ctx, sensor_value_to_double(&voltage), sensor_value_to_double(&current));
 }
 
 void power_timer_handler(struct k_timer *dummy)
 {
-	k_work_submit_to_queue(&g_low_priority_work_q, &g_ctx.work_item);
+	workq_submit(&POWER_WORK_Q, &g_ctx.work_item);
 }
 
 K_TIMER_DEFINE(power_timer, power_timer_handler, NULL);
 
+static void power_start(context_t *ctx)
+{
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+	sense_power_init(ctx);
+#endif
+	k_timer_start(&power_timer, K_MSEC(PERIOD_MS), K_MSEC(PERIOD_MS));
+}
+#endif
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+static int sense_power_sys_init(void)
+{
+	power_start(&g_ctx);
+	return 0;
+};
+
+SYS_INIT(sense_power_sys_init, APPLICATION, 2);
+#else
 int sense_power_entry_point(context_t *ctx)
 {
-	LOG_INF("init");
-	ctx->device[0] = DEVICE_DT_GET(DT_ALIAS(power0));
-	if (!device_is_ready(ctx->device[0])) {
-		LOG_ERR("Device %s is not ready", ctx->device[0]->name);
-	}
-	zros_node_init(&ctx->node, "sense_power");
-	zros_pub_init(&ctx->pub, &ctx->node, &topic_battery_state, &ctx->data);
-	k_timer_start(&power_timer, K_MSEC(100), K_MSEC(100));
+	power_start(ctx);
 	return 0;
 }
 
 K_THREAD_DEFINE(sense_power, MY_STACK_SIZE, sense_power_entry_point, &g_ctx, NULL, NULL,
 		MY_PRIORITY, 0, 100);
+#endif
 
 /* vi: ts=4 sw=4 et */
@@ -8,119 +8,121 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
-
-#include <zros/private/zros_node_struct.h>
-#include <zros/private/zros_pub_struct.h>
-#include <zros/zros_node.h>
-#include <zros/zros_pub.h>
+#include <zephyr/sys/atomic.h>
 
 #include <synapse_pb/safety.pb.h>
 #include <synapse_topic_list.h>
 
-#define MY_STACK_SIZE 1024
-#define MY_PRIORITY   4
+#define HEARTBEAT_MS CONFIG_CEREBRI_SENSE_SAFETY_HEARTBEAT_MS
+
+// the low byte of the state is the status, the rest counts changes
+#define STATE_STATUS(state) ((synapse_pb_Safety_Status)((state) & 0xff))
+#define STATE_SEQ(state)    ((uint32_t)(state) >> 8)
 
 LOG_MODULE_REGISTER(sense_safety, CONFIG_CEREBRI_SENSE_SAFETY_LOG_LEVEL);
 
-static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+extern struct k_work_q g_shared_work_q;
+#define SAFETY_WORK_Q g_shared_work_q
+#else
+extern struct k_work_q g_low_priority_work_q;
+#define SAFETY_WORK_Q g_low_priority_work_q
+#endif
 
+static void sense_safety_work_handler(struct k_work *work);
+
+/*
+ * The switch state is one atomic word written only by the input callback,
+ * which publishes the change itself. The heartbeat work item republishes
+ * the state for late subscribers, building its own message so no lock is
+ * shared with the callback.
+ */
 typedef struct context {
-	struct zros_node node;
-	struct zros_pub pub;
-	synapse_pb_Safety data;
+	atomic_t state;
 	struct k_sem running;
-	struct k_sem data_sem;
-	size_t stack_size;
-	k_thread_stack_t *stack_area;
-	struct k_thread thread_data;
+	struct k_work_delayable work_item;
 } context_t;
 
 static context_t g_ctx = {
-	.node = {},
-	.pub = {},
-	.data =
-		{
-			.has_stamp = true,
-			.stamp = synapse_pb_Timestamp_init_default,
-			.status = synapse_pb_Safety_Status_SAFETY_SAFE,
-		},
+	.state = ATOMIC_INIT(synapse_pb_Safety_Status_SAFETY_SAFE),
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
-	.stack_size = MY_STACK_SIZE,
-	.stack_area = g_my_stack_area,
-	.thread_data = {},
-	.data_sem = Z_SEM_INITIALIZER(g_ctx.data_sem, 1, 1),
+	.work_item = Z_WORK_DELAYABLE_INITIALIZER(sense_safety_work_handler),
 };
 
-static void sense_safety_init(context_t *ctx)
+static bool sense_safety_running(const context_t *ctx)
 {
-	zros_node_init(&ctx->node, "sense_safety");
-	zros_pub_init(&ctx->pub, &ctx->node, &topic_safety, &ctx->data);
-	k_sem_take(&ctx->running, K_FOREVER);
-	LOG_INF("init");
+	return k_sem_count_get((struct k_sem *)&ctx->running) == 0;
 }
 
-static void sense_safety_fini(struct context *ctx)
+// publish a state, returns the state that was published
+static atomic_val_t sense_safety_publish(context_t *ctx)
 {
-	zros_pub_fini(&ctx->pub);
-	zros_node_fini(&ctx->node);
-	k_sem_give(&ctx->running);
-	LOG_INF("fini");
+	atomic_val_t state = atomic_get(&ctx->state);
+	synapse_pb_Safety msg = {
+		.has_stamp = true,
+		.stamp = synapse_pb_Timestamp_init_default,
+		.status = STATE_STATUS(state),
+	};
+	stamp_msg_now(&msg.stamp);
+	zros_topic_publish(&topic_safety, &msg);
+	return state;
 }
 
-static void sense_safety_run(void *p0, void *p1, void *p2)
+static void sense_safety_work_handler(struct k_work *work)
 {
-	struct context *ctx = p0;
-	ARG_UNUSED(p1);
-	ARG_UNUSED(p2);
-
-	sense_safety_init(ctx);
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct context *ctx = CONTAINER_OF(dwork, struct context, work_item);
 
-	// publish every one seconds while not stopped
-	while (k_sem_take(&ctx->running, K_MSEC(1000)) < 0) {
-		int ret = k_sem_take(&ctx->data_sem, K_NO_WAIT);
-		if (ret < 0) {
-			continue;
-		}
-		zros_pub_update(&ctx->pub);
-		k_sem_give(&ctx->data_sem);
+	if (!sense_safety_running(ctx)) {
+		LOG_INF("fini");
+		return;
 	}
 
-	sense_safety_fini(ctx);
+	// a change published while this one was in flight may have been overtaken, repeat it
+	atomic_val_t published;
+	do {
+		published = sense_safety_publish(ctx);
+	} while (published != atomic_get(&ctx->state));
+
+	int ret = k_work_schedule_for_queue(&SAFETY_WORK_Q, &ctx->work_item, K_MSEC(HEARTBEAT_MS));
+	if (ret < 0) {
+		LOG_ERR("heartbeat not scheduled: %d", ret);
+	}
 }
 
-static int start(struct context *ctx)
+static int start(struct context *ctx, k_timeout_t delay)
 {
-	k_tid_t tid = k_thread_create(&ctx->thread_data, ctx->stack_area, ctx->stack_size,
-				      sense_safety_run, ctx, NULL, NULL, MY_PRIORITY, 0, K_FOREVER);
-	k_thread_name_set(tid, "sense_safety");
-	k_thread_start(tid);
+	k_sem_take(&ctx->running, K_FOREVER);
+	int ret = k_work_schedule_for_queue(&SAFETY_WORK_Q, &ctx->work_item, delay);
+	if (ret < 0) {
+		LOG_ERR("heartbeat not scheduled: %d", ret);
+		k_sem_give(&ctx->running);
+		return ret;
+	}
+	LOG_INF("init");
 	return 0;
 }
 
 static void input_cb(struct input_event *evt, void *userdata)
 {
 	struct context *ctx = &g_ctx;
+	ARG_UNUSED(userdata);
 
-	// check if still running
-	if (k_sem_count_get(&ctx->running) != 0) {
+	if (!sense_safety_running(ctx)) {
 		return;
 	}
 
 	if (evt->type == INPUT_EV_KEY && evt->code == INPUT_KEY_0 && evt->value == 1) {
-		int ret = k_sem_take(&ctx->data_sem, K_FOREVER);
-		if (ret < 0) {
-			LOG_ERR("failed to take data sem");
-		} else if (ret == 0) {
-			synapse_pb_Safety_Status status = ctx->data.status;
-			if (status == synapse_pb_Safety_Status_SAFETY_SAFE) {
-				ctx->data.status = synapse_pb_Safety_Status_SAFETY_UNSAFE;
-			} else {
-				ctx->data.status = synapse_pb_Safety_Status_SAFETY_SAFE;
-			}
-			stamp_msg(&ctx->data.stamp, k_uptime_ticks());
-			zros_pub_update(&ctx->pub);
-			k_sem_give(&ctx->data_sem);
-		}
+		atomic_val_t state, next;
+		do {
+			state = atomic_get(&ctx->state);
+			synapse_pb_Safety_Status status =
+				STATE_STATUS(state) == synapse_pb_Safety_Status_SAFETY_SAFE
+					? synapse_pb_Safety_Status_SAFETY_UNSAFE
+					: synapse_pb_Safety_Status_SAFETY_SAFE;
+			next = ((STATE_SEQ(state) + 1) << 8) | status;
+		} while (!atomic_cas(&ctx->state, state, next));
+		sense_safety_publish(ctx);
 	}
 }
 
@@ -132,19 +134,25 @@ static int sense_safety_cmd_handler(const struct shell *sh, size_t argc, char **
 	struct context *ctx = data;
 
 	if (strcmp(argv[0], "start") == 0) {
-		if (k_sem_count_get(&g_ctx.running) == 0) {
+		if (sense_safety_running(ctx)) {
 			shell_print(sh, "already running");
 		} else {
-			start(ctx);
+			start(ctx, K_NO_WAIT);
 		}
 	} else if (strcmp(argv[0], "stop") == 0) {
-		if (k_sem_count_get(&g_ctx.running) == 0) {
-			k_sem_give(&g_ctx.running);
+		if (sense_safety_running(ctx)) {
+			k_sem_give(&ctx->running);
+			// stop now rather than at the next heartbeat
+			k_work_reschedule_for_queue(&SAFETY_WORK_Q, &ctx->work_item, K_NO_WAIT);
 		} else {
 			shell_print(sh, "not running");
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
-		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		atomic_val_t state = atomic_get(&ctx->state);
+		shell_print(sh, "running: %d", (int)sense_safety_running(ctx));
+		shell_print(sh, "safe: %d changes: %u",
+			    STATE_STATUS(state) == synapse_pb_Safety_Status_SAFETY_SAFE,
+			    (unsigned int)STATE_SEQ(state));
 	}
 	return 0;
 }
@@ -156,7 +164,9 @@ SHELL_CMD_REGISTER(sense_safety, &sub_sense_safety, "sense safety args", NULL);
 
 static int sense_safety_sys_init(void)
 {
-	return start(&g_ctx);
+	// the low priority queue starts with the static threads after this level,
+	// the first heartbeat is submitted once the timeout expires and it runs
+	return start(&g_ctx, K_MSEC(HEARTBEAT_MS));
 };
 
 SYS_INIT(sense_safety_sys_init, APPLICATION, 2);
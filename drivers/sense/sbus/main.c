@@ -4,7 +4,11 @@
  */
 
 #include <zephyr/device.h>
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+#include <zephyr/drivers/uart.h>
+#else
 #include <zephyr/input/input.h>
+#endif
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
@@ -19,6 +23,17 @@
 #define MY_STACK_SIZE 2048
 #define MY_PRIORITY   2
 
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+#define SBUS_FRAME_LEN   25
+#define SBUS_HEADER      0x0f
+#define SBUS_FLAGS_BYTE  23
+#define SBUS_CHANNELS    16
+#define SBUS_CENTER      1024
+// an idle line of about three bytes at 100 kbaud 8E2 ends a burst
+#define SBUS_IDLE_US     360
+#define SBUS_RX_BUF_SIZE 64
+#endif
+
 LOG_MODULE_REGISTER(sense_sbus, CONFIG_CEREBRI_SENSE_SBUS_LOG_LEVEL);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
@@ -32,8 +47,30 @@ struct context {
 	k_thread_stack_t *stack_area;
 	struct k_thread thread_data;
 	int last_event;
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+	const struct device *uart;
+	struct zros_pub pub_status;
+	struct synapse_sbus_status status;
+	// bytes of the frame being received, only touched by the uart callback
+	uint8_t frame[SBUS_FRAME_LEN];
+	uint32_t frame_len;
+	uint8_t rx_buf[2][SBUS_RX_BUF_SIZE];
+	int rx_buf_next;
+	bool rx_restart;
+	atomic_t errors;
+#endif
+};
+
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+// a complete frame and the ticks of the line going idle after it
+struct sbus_frame {
+	uint8_t data[SBUS_FRAME_LEN];
+	int64_t ticks;
 };
 
+K_MSGQ_DEFINE(g_sbus_frames, sizeof(struct sbus_frame), 4, 4);
+#endif
+
 static struct context g_ctx = {
 	.node = {},
 	.pub_input = {},
@@ -43,19 +80,180 @@ static struct context g_ctx = {
 	.stack_area = g_my_stack_area,
 	.thread_data = {},
 	.last_event = 0,
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+	.uart = DEVICE_DT_GET(DT_BUS(DT_ALIAS(sbus))),
+	.pub_status = {},
+	.status = {},
+	.frame_len = 0,
+	.rx_buf_next = 0,
+	.rx_restart = false,
+	.errors = ATOMIC_INIT(0),
+#endif
 };
 
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+/*
+ * Runs in the uart isr. Bytes are gathered into the frame until the line
+ * goes idle, a burst that is a whole frame is handed to the thread with
+ * the idle ticks as its reception stamp. Anything else is dropped, the
+ * next idle gap resynchronizes on the gap between frames.
+ */
+static void sbus_rx_bytes(struct context *ctx, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (ctx->frame_len == 0 && data[i] != SBUS_HEADER) {
+			continue;
+		}
+		if (ctx->frame_len < SBUS_FRAME_LEN) {
+			ctx->frame[ctx->frame_len] = data[i];
+		}
+		ctx->frame_len++;
+	}
+
+	if (ctx->frame_len < SBUS_FRAME_LEN) {
+		// a burst cut short by a full buffer, the rest follows
+		return;
+	}
+	if (ctx->frame_len == SBUS_FRAME_LEN) {
+		struct sbus_frame frame;
+		memcpy(frame.data, ctx->frame, SBUS_FRAME_LEN);
+		frame.ticks = k_uptime_ticks();
+		if (k_msgq_put(&g_sbus_frames, &frame, K_NO_WAIT) < 0) {
+			atomic_inc(&ctx->errors);
+		}
+	} else {
+		atomic_inc(&ctx->errors);
+	}
+	ctx->frame_len = 0;
+}
+
+static void sbus_uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	struct context *ctx = user_data;
+
+	switch (evt->type) {
+	case UART_RX_RDY:
+		sbus_rx_bytes(ctx, evt->data.rx.buf + evt->data.rx.offset, evt->data.rx.len);
+		break;
+	case UART_RX_BUF_REQUEST:
+		uart_rx_buf_rsp(dev, ctx->rx_buf[ctx->rx_buf_next], SBUS_RX_BUF_SIZE);
+		ctx->rx_buf_next ^= 1;
+		break;
+	case UART_RX_STOPPED:
+		atomic_inc(&ctx->errors);
+		ctx->frame_len = 0;
+		break;
+	case UART_RX_DISABLED:
+		// restarted after a stop for an error, unless the node is stopping
+		if (ctx->rx_restart) {
+			ctx->rx_buf_next = 1;
+			uart_rx_enable(dev, ctx->rx_buf[0], SBUS_RX_BUF_SIZE, SBUS_IDLE_US);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static int sbus_uart_start(struct context *ctx)
+{
+	const struct uart_config config = {
+		.baudrate = 100000,
+		.parity = UART_CFG_PARITY_EVEN,
+		.stop_bits = UART_CFG_STOP_BITS_2,
+		.data_bits = UART_CFG_DATA_BITS_8,
+		.flow_ctrl = UART_CFG_FLOW_CTRL_NONE,
+	};
+
+	if (!device_is_ready(ctx->uart)) {
+		LOG_ERR("uart %s not ready", ctx->uart->name);
+		return -ENODEV;
+	}
+	int rc = uart_configure(ctx->uart, &config);
+	if (rc < 0) {
+		LOG_ERR("uart configure failed: %d", rc);
+		return rc;
+	}
+	rc = uart_callback_set(ctx->uart, sbus_uart_cb, ctx);
+	if (rc < 0) {
+		LOG_ERR("uart callback failed: %d", rc);
+		return rc;
+	}
+	ctx->frame_len = 0;
+	ctx->rx_buf_next = 1;
+	ctx->rx_restart = true;
+	return uart_rx_enable(ctx->uart, ctx->rx_buf[0], SBUS_RX_BUF_SIZE, SBUS_IDLE_US);
+}
+
+/*
+ * 16 channels of 11 bits, lsb first, then the flags byte. Channels are
+ * unpacked and centred in integers, one multiply scales each to the
+ * float of the message.
+ */
+static void sbus_decode(struct context *ctx, const struct sbus_frame *frame)
+{
+	const uint8_t *payload = &frame->data[1];
+	const float scale = 1.0f / 784;
+	uint32_t bits = 0;
+	int nbits = 0;
+	int byte = 0;
+
+	for (int i = 0; i < SBUS_CHANNELS; i++) {
+		while (nbits < 11) {
+			bits |= (uint32_t)payload[byte++] << nbits;
+			nbits += 8;
+		}
+		int32_t value = (int32_t)(bits & 0x7ff) - SBUS_CENTER;
+		bits >>= 11;
+		nbits -= 11;
+		ctx->input.channel[i] = value * scale;
+	}
+
+	struct synapse_sbus_status *status = &ctx->status;
+	uint8_t flags = frame->data[SBUS_FLAGS_BYTE];
+	status->flags = flags & 0x0f;
+	status->frames++;
+	if (flags & SYNAPSE_SBUS_FLAG_FRAME_LOST) {
+		status->frames_lost++;
+	}
+	status->stamp_ns = k_ticks_to_ns_floor64(frame->ticks);
+	status->errors = atomic_get(&ctx->errors);
+
+	if (flags & SYNAPSE_SBUS_FLAG_FAILSAFE) {
+		// channels hold the receiver failsafe values, let the fsm see the loss
+		status->failsafes++;
+	} else {
+		stamp_msg(&ctx->input.timestamp, frame->ticks);
+		zros_pub_update(&ctx->pub_input);
+	}
+	status->latency_us = k_ticks_to_us_floor32(k_uptime_ticks() - frame->ticks);
+	zros_pub_update(&ctx->pub_status);
+}
+#endif
+
 static void sense_sbus_init(struct context *ctx)
 {
 	zros_node_init(&ctx->node, "sense_sbus");
 	zros_pub_init(&ctx->pub_input, &ctx->node, &topic_input_sbus, &ctx->input);
 	ctx->last_event = 0;
 	k_sem_take(&ctx->running, K_FOREVER);
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+	zros_pub_init(&ctx->pub_status, &ctx->node, &topic_sbus_status, &ctx->status);
+	k_msgq_purge(&g_sbus_frames);
+	if (sbus_uart_start(ctx) < 0) {
+		LOG_ERR("failed to start sbus uart");
+	}
+#endif
 	LOG_INF("init");
 }
 
 static void sense_sbus_fini(struct context *ctx)
 {
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+	ctx->rx_restart = false;
+	uart_rx_disable(ctx->uart);
+	zros_pub_fini(&ctx->pub_status);
+#endif
 	zros_pub_fini(&ctx->pub_input);
 	zros_node_fini(&ctx->node);
 	k_sem_give(&ctx->running);
@@ -70,9 +268,19 @@ static void sense_sbus_run(void *p0, void *p1, void *p2)
 
 	sense_sbus_init(ctx);
 
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+	// decode each frame as it arrives, until stop request
+	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
+		struct sbus_frame frame;
+		if (k_msgq_get(&g_sbus_frames, &frame, K_MSEC(100)) == 0) {
+			sbus_decode(ctx, &frame);
+		}
+	}
+#else
 	// wait for stop request
 	while (k_sem_take(&ctx->running, K_MSEC(1000)) < 0)
 		;
+#endif
 
 	sense_sbus_fini(ctx);
 }
@@ -86,6 +294,7 @@ static int start(struct context *ctx)
 	return 0;
 }
 
+#if !defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
 static void input_cb(struct input_event *evt, void *userdata)
 {
 	struct context *ctx = userdata;
@@ -106,13 +315,14 @@ static void input_cb(struct input_event *evt, void *userdata)
 	}
 
 	if (evt->sync == true) {
-		stamp_msg(&ctx->input.timestamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->input.timestamp);
 		zros_pub_update(&ctx->pub_input);
 	}
 	ctx->last_event = evt->code;
 }
 
 INPUT_CALLBACK_DEFINE(DEVICE_DT_GET(DT_ALIAS(sbus)), input_cb, &g_ctx);
+#endif
 
 static int sense_sbus_cmd_handler(const struct shell *sh, size_t argc, char **argv, void *data)
 {
@@ -133,6 +343,12 @@ static int sense_sbus_cmd_handler(const struct shell *sh, size_t argc, char **ar
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+#if defined(CONFIG_CEREBRI_SENSE_SBUS_UART)
+		const struct synapse_sbus_status *status = &ctx->status;
+		shell_print(sh, "frames: %u lost: %u failsafes: %u errors: %u latency: %u us",
+			    status->frames, status->frames_lost, status->failsafes,
+			    (unsigned)atomic_get(&ctx->errors), status->latency_us);
+#endif
 	}
 	return 0;
 }
@@ -64,7 +64,7 @@ void publish_gnss_data(uDeviceHandle_t devHandle, int32_t errorCode, const uLoca
 		ctx->data.latitude = pLocation->latitudeX1e7 / 1e7;
 		ctx->data.longitude = pLocation->longitudeX1e7 / 1e7;
 		ctx->data.altitude = pLocation->altitudeMillimetres / 1e3;
-		stamp_msg(&ctx->data.stamp, k_uptime_ticks());
+		stamp_msg_now(&ctx->data.stamp);
 
 		// TODO Covariance
 		zros_pub_update(&ctx->pub);
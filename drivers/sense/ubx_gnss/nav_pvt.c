@@ -0,0 +1,488 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+
+#include <synapse_topic_list.h>
+
+LOG_MODULE_REGISTER(ubx_gnss, CONFIG_CEREBRI_SENSE_UBX_GNSS_LOG_LEVEL);
+
+#define MY_STACK_SIZE 2048
+#define MY_PRIORITY   6
+
+#define RATE_HZ           CONFIG_CEREBRI_SENSE_UBX_GNSS_RATE_HZ
+#define RX_BUF_SIZE       128
+#define RX_RING_SIZE      1024
+#define RX_IDLE_US        1000
+#define UBX_SYNC1         0xb5
+#define UBX_SYNC2         0x62
+#define UBX_PAYLOAD_MAX   100
+#define UBX_CLASS_NAV     0x01
+#define UBX_ID_NAV_PVT    0x07
+#define UBX_CLASS_CFG     0x06
+#define UBX_ID_CFG_MSG    0x01
+#define UBX_ID_CFG_RATE   0x08
+#define UBX_ID_CFG_VALSET 0x8a
+#define NAV_PVT_LEN       92
+// fixType 3d, flags gnssFixOK
+#define NAV_PVT_FIX_3D    3
+#define NAV_PVT_FIX_OK    BIT(0)
+// a pulse older than this no longer dates an epoch
+#define PPS_STALE_MS      1500
+
+#define GNSS_UART DT_ALIAS(gnss0)
+#define GNSS_PPS  DT_ALIAS(gnss_pps)
+
+enum ubx_state {
+	UBX_STATE_SYNC1,
+	UBX_STATE_SYNC2,
+	UBX_STATE_CLASS,
+	UBX_STATE_ID,
+	UBX_STATE_LEN1,
+	UBX_STATE_LEN2,
+	UBX_STATE_PAYLOAD,
+	UBX_STATE_CK_A,
+	UBX_STATE_CK_B,
+};
+
+struct ubx_parser {
+	enum ubx_state state;
+	uint8_t msg_class;
+	uint8_t msg_id;
+	uint16_t len;
+	uint16_t count;
+	uint8_t ck_a;
+	uint8_t ck_b;
+	uint8_t payload[UBX_PAYLOAD_MAX];
+};
+
+typedef struct context {
+	struct zros_node node;
+	struct zros_pub pub;
+	synapse_pb_NavSatFix data;
+	const struct device *uart;
+	uint8_t rx_buf[2][RX_BUF_SIZE];
+	int rx_buf_next;
+	struct ring_buf *rx_ring;
+	struct k_sem rx_sem;
+	struct k_sem tx_done;
+	struct ubx_parser parser;
+#if DT_NODE_EXISTS(GNSS_PPS)
+	struct gpio_dt_spec pps;
+	struct gpio_callback pps_cb;
+#endif
+	// ticks of the last time pulse, written by the gpio isr
+	atomic_t pps_ticks_lo;
+	atomic_t pps_ticks_hi;
+	atomic_t pps_seq;
+	uint32_t pps_count;
+	uint32_t messages;
+	uint32_t checksum_errors;
+	uint32_t overruns;
+	uint32_t pps_stamped;
+	uint32_t latency_us;
+} context_t;
+
+RING_BUF_DECLARE(g_gnss_rx_ring, RX_RING_SIZE);
+
+static context_t g_ctx = {
+	.node = {},
+	.pub = {},
+	.data = {.has_stamp = true,
+		 .stamp = synapse_pb_Timestamp_init_default,
+		 .altitude = 0,
+		 .latitude = 0,
+		 .longitude = 0,
+		 .position_covariance = synapse_pb_Covariance3_init_default,
+		 .position_covariance_type = synapse_pb_NavSatFix_CovarianceType_UNKNOWN,
+		 .status = {.service = 0, .status = 0}},
+	.uart = DEVICE_DT_GET(GNSS_UART),
+	.rx_buf_next = 0,
+	.rx_ring = &g_gnss_rx_ring,
+	.rx_sem = Z_SEM_INITIALIZER(g_ctx.rx_sem, 0, 1),
+	.tx_done = Z_SEM_INITIALIZER(g_ctx.tx_done, 0, 1),
+	.parser = {.state = UBX_STATE_SYNC1},
+#if DT_NODE_EXISTS(GNSS_PPS)
+	.pps = GPIO_DT_SPEC_GET(GNSS_PPS, gpios),
+#endif
+	.pps_ticks_lo = ATOMIC_INIT(0),
+	.pps_ticks_hi = ATOMIC_INIT(0),
+	.pps_seq = ATOMIC_INIT(0),
+};
+
+/*
+ * The 64 bit pulse ticks are written as two words under a sequence
+ * count, odd while the isr is writing, so the thread never sees a torn
+ * value without a lock on the isr.
+ */
+static int64_t pps_ticks_get(context_t *ctx)
+{
+	atomic_val_t seq;
+	int64_t ticks;
+
+	do {
+		seq = atomic_get(&ctx->pps_seq);
+		ticks = ((int64_t)(uint32_t)atomic_get(&ctx->pps_ticks_hi) << 32) |
+			(uint32_t)atomic_get(&ctx->pps_ticks_lo);
+	} while ((seq & 1) || seq != atomic_get(&ctx->pps_seq));
+	return ticks;
+}
+
+#if DT_NODE_EXISTS(GNSS_PPS)
+static void pps_isr(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+	context_t *ctx = CONTAINER_OF(cb, context_t, pps_cb);
+	int64_t now = k_uptime_ticks();
+
+	atomic_inc(&ctx->pps_seq);
+	atomic_set(&ctx->pps_ticks_lo, (uint32_t)now);
+	atomic_set(&ctx->pps_ticks_hi, (uint32_t)(now >> 32));
+	atomic_inc(&ctx->pps_seq);
+	ctx->pps_count++;
+}
+
+static int pps_init(context_t *ctx)
+{
+	if (!gpio_is_ready_dt(&ctx->pps)) {
+		LOG_ERR("pps gpio not ready");
+		return -ENODEV;
+	}
+	int rc = gpio_pin_configure_dt(&ctx->pps, GPIO_INPUT);
+	if (rc < 0) {
+		return rc;
+	}
+	gpio_init_callback(&ctx->pps_cb, pps_isr, BIT(ctx->pps.pin));
+	rc = gpio_add_callback(ctx->pps.port, &ctx->pps_cb);
+	if (rc < 0) {
+		return rc;
+	}
+	return gpio_pin_interrupt_configure_dt(&ctx->pps, GPIO_INT_EDGE_TO_ACTIVE);
+}
+#endif
+
+// runs in the uart isr, bytes are parsed by the thread
+static void gnss_uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	context_t *ctx = user_data;
+
+	switch (evt->type) {
+	case UART_RX_RDY:
+		if (ring_buf_put(ctx->rx_ring, evt->data.rx.buf + evt->data.rx.offset,
+				 evt->data.rx.len) != evt->data.rx.len) {
+			ctx->overruns++;
+		}
+		k_sem_give(&ctx->rx_sem);
+		break;
+	case UART_RX_BUF_REQUEST:
+		uart_rx_buf_rsp(dev, ctx->rx_buf[ctx->rx_buf_next], RX_BUF_SIZE);
+		ctx->rx_buf_next ^= 1;
+		break;
+	case UART_RX_DISABLED:
+		// stopped by a line error, start again
+		ctx->rx_buf_next = 1;
+		uart_rx_enable(dev, ctx->rx_buf[0], RX_BUF_SIZE, RX_IDLE_US);
+		break;
+	case UART_TX_DONE:
+	case UART_TX_ABORTED:
+		k_sem_give(&ctx->tx_done);
+		break;
+	default:
+		break;
+	}
+}
+
+static void ubx_checksum(const uint8_t *buf, size_t len, uint8_t *ck_a, uint8_t *ck_b)
+{
+	for (size_t i = 0; i < len; i++) {
+		*ck_a += buf[i];
+		*ck_b += *ck_a;
+	}
+}
+
+static int ubx_send(context_t *ctx, uint8_t msg_class, uint8_t msg_id, const uint8_t *payload,
+		    uint16_t len)
+{
+	static uint8_t buf[8 + 64];
+	uint8_t ck_a = 0, ck_b = 0;
+
+	if (len > sizeof(buf) - 8) {
+		return -EINVAL;
+	}
+	buf[0] = UBX_SYNC1;
+	buf[1] = UBX_SYNC2;
+	buf[2] = msg_class;
+	buf[3] = msg_id;
+	sys_put_le16(len, &buf[4]);
+	memcpy(&buf[6], payload, len);
+	ubx_checksum(&buf[2], 4 + len, &ck_a, &ck_b);
+	buf[6 + len] = ck_a;
+	buf[7 + len] = ck_b;
+
+	k_sem_reset(&ctx->tx_done);
+	int rc = uart_tx(ctx->uart, buf, 8 + len, SYS_FOREVER_US);
+	if (rc < 0) {
+		return rc;
+	}
+	return k_sem_take(&ctx->tx_done, K_MSEC(100));
+}
+
+/*
+ * NAV-PVT on the uart at RATE_HZ and nmea off. The receiver time pulse
+ * is left at its default of 1 Hz on the top of the second.
+ */
+static void gnss_configure(context_t *ctx)
+{
+	uint16_t meas_ms = 1000 / RATE_HZ;
+	int rc;
+
+#if defined(CONFIG_CEREBRI_SENSE_UBX_GNSS_MODULE_TYPE_M8)
+	// measRate, navRate 1, timeRef gps
+	uint8_t rate[6] = {meas_ms & 0xff, meas_ms >> 8, 1, 0, 1, 0};
+	uint8_t msg[3] = {UBX_CLASS_NAV, UBX_ID_NAV_PVT, 1};
+
+	rc = ubx_send(ctx, UBX_CLASS_CFG, UBX_ID_CFG_RATE, rate, sizeof(rate));
+	if (rc == 0) {
+		rc = ubx_send(ctx, UBX_CLASS_CFG, UBX_ID_CFG_MSG, msg, sizeof(msg));
+	}
+#else
+	// version 0, ram layer, then key ids and values
+	uint8_t valset[] = {
+		0x00, 0x01, 0x00, 0x00,
+		// CFG-RATE-MEAS
+		0x01, 0x00, 0x21, 0x30, meas_ms & 0xff, meas_ms >> 8,
+		// CFG-MSGOUT-UBX_NAV_PVT_UART1
+		0x07, 0x00, 0x91, 0x20, 0x01,
+		// CFG-UART1OUTPROT-NMEA
+		0x02, 0x00, 0x74, 0x10, 0x00,
+	};
+
+	rc = ubx_send(ctx, UBX_CLASS_CFG, UBX_ID_CFG_VALSET, valset, sizeof(valset));
+#endif
+	if (rc < 0) {
+		LOG_ERR("configure failed: %d", rc);
+	}
+}
+
+/*
+ * Measurement time of an epoch in local ticks. The time pulse marks the
+ * top of the second, so the epoch is the last pulse plus the millisecond
+ * of the second in iTOW. A pulse later than that epoch belongs to the
+ * next second. Without a recent pulse the reception time is used.
+ */
+static int64_t epoch_ticks(context_t *ctx, uint32_t itow_ms, int64_t rx_ticks)
+{
+	int64_t pps = pps_ticks_get(ctx);
+
+	if (pps == 0 || rx_ticks - pps > k_ms_to_ticks_ceil64(PPS_STALE_MS)) {
+		return rx_ticks;
+	}
+	int64_t epoch = pps + k_ms_to_ticks_near64(itow_ms % 1000);
+	if (epoch > rx_ticks) {
+		epoch -= k_ms_to_ticks_near64(1000);
+	}
+	ctx->pps_stamped++;
+	return epoch;
+}
+
+static void handle_nav_pvt(context_t *ctx, const uint8_t *p, int64_t rx_ticks)
+{
+	uint32_t itow = sys_get_le32(&p[0]);
+	uint8_t fix_type = p[20];
+	uint8_t flags = p[21];
+	int32_t lon = sys_get_le32(&p[24]);
+	int32_t lat = sys_get_le32(&p[28]);
+	int32_t h_msl = sys_get_le32(&p[36]);
+
+	if (fix_type < NAV_PVT_FIX_3D || !(flags & NAV_PVT_FIX_OK)) {
+		LOG_DBG("no fix: %d %d", fix_type, flags);
+		return;
+	}
+
+	int64_t epoch = epoch_ticks(ctx, itow, rx_ticks);
+	ctx->data.latitude = lat / 1e7;
+	ctx->data.longitude = lon / 1e7;
+	ctx->data.altitude = h_msl / 1e3;
+	stamp_msg(&ctx->data.stamp, epoch);
+	zros_pub_update(&ctx->pub);
+	ctx->latency_us = k_ticks_to_us_floor32(k_uptime_ticks() - epoch);
+	LOG_DBG("lat %f long %f", ctx->data.latitude, ctx->data.longitude);
+}
+
+static void ubx_parse(context_t *ctx, uint8_t byte, int64_t rx_ticks)
+{
+	struct ubx_parser *p = &ctx->parser;
+
+	switch (p->state) {
+	case UBX_STATE_SYNC1:
+		if (byte == UBX_SYNC1) {
+			p->state = UBX_STATE_SYNC2;
+		}
+		return;
+	case UBX_STATE_SYNC2:
+		p->state = byte == UBX_SYNC2 ? UBX_STATE_CLASS : UBX_STATE_SYNC1;
+		p->ck_a = 0;
+		p->ck_b = 0;
+		return;
+	default:
+		break;
+	}
+
+	if (p->state < UBX_STATE_CK_A) {
+		ubx_checksum(&byte, 1, &p->ck_a, &p->ck_b);
+	}
+
+	switch (p->state) {
+	case UBX_STATE_CLASS:
+		p->msg_class = byte;
+		p->state = UBX_STATE_ID;
+		break;
+	case UBX_STATE_ID:
+		p->msg_id = byte;
+		p->state = UBX_STATE_LEN1;
+		break;
+	case UBX_STATE_LEN1:
+		p->len = byte;
+		p->state = UBX_STATE_LEN2;
+		break;
+	case UBX_STATE_LEN2:
+		p->len |= byte << 8;
+		p->count = 0;
+		p->state = p->len == 0 ? UBX_STATE_CK_A : UBX_STATE_PAYLOAD;
+		break;
+	case UBX_STATE_PAYLOAD:
+		// longer messages are checksummed and skipped
+		if (p->count < UBX_PAYLOAD_MAX) {
+			p->payload[p->count] = byte;
+		}
+		if (++p->count == p->len) {
+			p->state = UBX_STATE_CK_A;
+		}
+		break;
+	case UBX_STATE_CK_A:
+		p->state = byte == p->ck_a ? UBX_STATE_CK_B : UBX_STATE_SYNC1;
+		if (p->state == UBX_STATE_SYNC1) {
+			ctx->checksum_errors++;
+		}
+		break;
+	case UBX_STATE_CK_B:
+		p->state = UBX_STATE_SYNC1;
+		if (byte != p->ck_b) {
+			ctx->checksum_errors++;
+			break;
+		}
+		ctx->messages++;
+		if (p->msg_class == UBX_CLASS_NAV && p->msg_id == UBX_ID_NAV_PVT &&
+		    p->len == NAV_PVT_LEN) {
+			handle_nav_pvt(ctx, p->payload, rx_ticks);
+		}
+		break;
+	default:
+		p->state = UBX_STATE_SYNC1;
+		break;
+	}
+}
+
+static int gnss_start(context_t *ctx)
+{
+	const struct uart_config config = {
+		.baudrate = CONFIG_CEREBRI_SENSE_UBX_GNSS_BAUD,
+		.parity = UART_CFG_PARITY_NONE,
+		.stop_bits = UART_CFG_STOP_BITS_1,
+		.data_bits = UART_CFG_DATA_BITS_8,
+		.flow_ctrl = UART_CFG_FLOW_CTRL_NONE,
+	};
+
+	if (!device_is_ready(ctx->uart)) {
+		LOG_ERR("uart %s not ready", ctx->uart->name);
+		return -ENODEV;
+	}
+	int rc = uart_configure(ctx->uart, &config);
+	if (rc < 0) {
+		LOG_ERR("uart configure failed: %d", rc);
+		return rc;
+	}
+	rc = uart_callback_set(ctx->uart, gnss_uart_cb, ctx);
+	if (rc < 0) {
+		LOG_ERR("uart callback failed: %d", rc);
+		return rc;
+	}
+	ctx->rx_buf_next = 1;
+	rc = uart_rx_enable(ctx->uart, ctx->rx_buf[0], RX_BUF_SIZE, RX_IDLE_US);
+	if (rc < 0) {
+		LOG_ERR("uart rx failed: %d", rc);
+		return rc;
+	}
+#if DT_NODE_EXISTS(GNSS_PPS)
+	rc = pps_init(ctx);
+	if (rc < 0) {
+		LOG_ERR("pps init failed: %d, stamping at reception", rc);
+	}
+#endif
+	gnss_configure(ctx);
+	return 0;
+}
+
+void sense_ubx_gnss_entry_point(context_t *ctx)
+{
+	LOG_INF("init");
+	zros_node_init(&ctx->node, "sense_ubx_gnss");
+	zros_pub_init(&ctx->pub, &ctx->node, &topic_nav_sat_fix, &ctx->data);
+
+	if (gnss_start(ctx) < 0) {
+		return;
+	}
+
+	while (true) {
+		uint8_t buf[64];
+		uint32_t len;
+
+		k_sem_take(&ctx->rx_sem, K_FOREVER);
+		// bytes of a burst arrive together, the wakeup dates the burst
+		int64_t rx_ticks = k_uptime_ticks();
+		while ((len = ring_buf_get(ctx->rx_ring, buf, sizeof(buf))) > 0) {
+			for (uint32_t i = 0; i < len; i++) {
+				ubx_parse(ctx, buf[i], rx_ticks);
+			}
+		}
+	}
+}
+
+K_THREAD_DEFINE(ubx_gnss, MY_STACK_SIZE, sense_ubx_gnss_entry_point, &g_ctx, NULL, NULL,
+		MY_PRIORITY, 0, 100);
+
+static int cmd_ubx_gnss_status(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	context_t *ctx = &g_ctx;
+
+	shell_print(sh, "messages: %u checksum errors: %u overruns: %u", ctx->messages,
+		    ctx->checksum_errors, ctx->overruns);
+	shell_print(sh, "pps: %u pps stamped: %u latency: %u us", ctx->pps_count,
+		    ctx->pps_stamped, ctx->latency_us);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_ubx_gnss,
+			       SHELL_CMD(status, NULL, "Parser and time pulse counters.",
+					 cmd_ubx_gnss_status),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(ubx_gnss, &sub_ubx_gnss, "ubx gnss commands", NULL);
+
+// vi: ts=4 sw=4 et
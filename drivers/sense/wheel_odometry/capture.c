@@ -0,0 +1,260 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <math.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <cerebri/core/common.h>
+#include <cerebri/core/workq.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+
+#include <synapse_pb/wheel_odometry.pb.h>
+#include <synapse_topic_list.h>
+
+LOG_MODULE_REGISTER(sense_wheel_odometry, CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_LOG_LEVEL);
+
+#define MY_STACK_SIZE 1024
+#define MY_PRIORITY   6
+#define RATE_HZ       CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_CAPTURE_RATE_HZ
+// with no edge for this long the wheel is taken as stopped
+#define STOPPED_MS    500
+
+#define ENCODER DT_COMPAT_GET_ANY_STATUS_OKAY(cerebri_quadrature_encoder)
+
+// both edges of channel a are counted
+#define COUNTS_PER_REV (2 * DT_PROP(ENCODER, counts_per_revolution))
+
+extern struct k_work_q g_high_priority_work_q;
+
+void wheel_capture_work_handler(struct k_work *work);
+void wheel_capture_timer_handler(struct k_timer *timer);
+
+typedef struct context {
+	struct workq_item work_item;
+	struct k_timer timer;
+	struct gpio_dt_spec a;
+	struct gpio_dt_spec b;
+	struct gpio_callback a_cb;
+	struct k_spinlock lock;
+	// written by the edge isr under lock
+	int32_t count;
+	uint32_t edge_cyc;
+	uint16_t edges;
+	uint32_t submit_cyc;
+	// publisher side, the edge the last rate was measured up to
+	int32_t count_prev;
+	uint32_t edge_cyc_prev;
+	int64_t edge_ticks_prev;
+	float velocity;
+	uint32_t period_cyc;
+	struct zros_node node;
+	struct zros_pub pub;
+	struct zros_pub pub_velocity;
+	synapse_pb_WheelOdometry data;
+	struct synapse_wheel_velocity wheel_velocity;
+} context_t;
+
+static context_t g_ctx = {
+	.work_item = WORKQ_ITEM_INITIALIZER(wheel_capture_work_handler, "sense_wheel_odometry",
+					    2000),
+	.a = GPIO_DT_SPEC_GET(ENCODER, a_gpios),
+	.b = GPIO_DT_SPEC_GET(ENCODER, b_gpios),
+	.count = 0,
+	.edges = 0,
+	.count_prev = 0,
+	.velocity = 0,
+	.node = {},
+	.pub = {},
+	.pub_velocity = {},
+	.data =
+		{
+			.has_stamp = true,
+			.stamp = synapse_pb_Timestamp_init_default,
+			.rotation = 0,
+		},
+	.wheel_velocity = {},
+};
+
+/*
+ * Channel a edge. The count and the cycle of the edge are all the isr
+ * keeps, publishing runs on the high priority work queue, submitted from
+ * here once a period has passed so a moving wheel is published from its
+ * edges. The timer covers a wheel that has stopped.
+ */
+static void wheel_capture_isr(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+	context_t *ctx = CONTAINER_OF(cb, context_t, a_cb);
+	uint32_t cyc = k_cycle_get_32();
+	int a = gpio_pin_get_dt(&ctx->a);
+	int b = gpio_pin_get_dt(&ctx->b);
+
+	k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+	ctx->count += a == b ? -1 : 1;
+	ctx->edge_cyc = cyc;
+	ctx->edges++;
+	bool due = cyc - ctx->submit_cyc >= ctx->period_cyc;
+	if (due) {
+		ctx->submit_cyc = cyc;
+	}
+	k_spin_unlock(&ctx->lock, key);
+
+	if (due) {
+		workq_submit(&g_high_priority_work_q, &ctx->work_item);
+	}
+}
+
+void wheel_capture_timer_handler(struct k_timer *timer)
+{
+	context_t *ctx = CONTAINER_OF(timer, context_t, timer);
+	uint32_t cyc = k_cycle_get_32();
+	bool due;
+
+	k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+	due = cyc - ctx->submit_cyc >= ctx->period_cyc;
+	if (due) {
+		ctx->submit_cyc = cyc;
+	}
+	k_spin_unlock(&ctx->lock, key);
+
+	if (due) {
+		workq_submit(&g_high_priority_work_q, &ctx->work_item);
+	}
+}
+
+/*
+ * Rate from edge times, the counts between the edge the last rate was
+ * measured up to and the latest edge over the time between them. With
+ * no new edge the wheel turned less than a count since the last one, so
+ * the rate is bounded by one count over the time since, falling to 0.
+ */
+void wheel_capture_work_handler(struct k_work *work)
+{
+	context_t *ctx = CONTAINER_OF(work, context_t, work_item.work);
+	const float rad_per_count = 2 * M_PI / COUNTS_PER_REV;
+	uint32_t now_cyc = k_cycle_get_32();
+	int64_t now_ticks = k_uptime_ticks();
+
+	k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+	int32_t count = ctx->count;
+	uint32_t edge_cyc = ctx->edge_cyc;
+	uint16_t edges = ctx->edges;
+	ctx->edges = 0;
+	k_spin_unlock(&ctx->lock, key);
+
+	// the edge in uptime ticks, cycles only serve the short intervals
+	uint32_t edge_age_cyc = now_cyc - edge_cyc;
+	int64_t edge_ticks = now_ticks - k_cyc_to_ticks_near64(edge_age_cyc);
+
+	if (count != ctx->count_prev) {
+		uint32_t dcyc = edge_cyc - ctx->edge_cyc_prev;
+		if (ctx->edge_ticks_prev != 0 && dcyc > 0 &&
+		    edge_ticks - ctx->edge_ticks_prev < k_ms_to_ticks_ceil64(STOPPED_MS)) {
+			ctx->velocity = (count - ctx->count_prev) * rad_per_count *
+					sys_clock_hw_cycles_per_sec() / (float)dcyc;
+		} else {
+			// first edge after standing still, no interval to measure yet
+			ctx->velocity = 0;
+		}
+		ctx->count_prev = count;
+		ctx->edge_cyc_prev = edge_cyc;
+		ctx->edge_ticks_prev = edge_ticks;
+	} else if (ctx->edge_ticks_prev == 0 ||
+		   now_ticks - ctx->edge_ticks_prev >= k_ms_to_ticks_ceil64(STOPPED_MS)) {
+		ctx->velocity = 0;
+	} else {
+		float bound = rad_per_count * sys_clock_hw_cycles_per_sec() / (float)edge_age_cyc;
+		if (fabsf(ctx->velocity) > bound) {
+			ctx->velocity = copysignf(bound, ctx->velocity);
+		}
+	}
+
+	// account for negative rotation of encoder
+	double rotation = -count * (double)rad_per_count;
+	int64_t stamp_ticks = ctx->edge_ticks_prev != 0 ? ctx->edge_ticks_prev : now_ticks;
+
+	stamp_msg(&ctx->data.stamp, stamp_ticks);
+	ctx->data.rotation = rotation;
+	zros_pub_update(&ctx->pub);
+
+	ctx->wheel_velocity.stamp_ns = k_ticks_to_ns_floor64(stamp_ticks);
+	ctx->wheel_velocity.rotation = rotation;
+	ctx->wheel_velocity.velocity = -ctx->velocity;
+	ctx->wheel_velocity.edges = edges;
+	zros_pub_update(&ctx->pub_velocity);
+}
+
+static int wheel_capture_init(context_t *ctx)
+{
+	if (!gpio_is_ready_dt(&ctx->a) || !gpio_is_ready_dt(&ctx->b)) {
+		LOG_ERR("encoder gpios not ready");
+		return -ENODEV;
+	}
+	int rc = gpio_pin_configure_dt(&ctx->a, GPIO_INPUT);
+	if (rc == 0) {
+		rc = gpio_pin_configure_dt(&ctx->b, GPIO_INPUT);
+	}
+	if (rc < 0) {
+		LOG_ERR("encoder gpio configure failed: %d", rc);
+		return rc;
+	}
+	gpio_init_callback(&ctx->a_cb, wheel_capture_isr, BIT(ctx->a.pin));
+	rc = gpio_add_callback(ctx->a.port, &ctx->a_cb);
+	if (rc < 0) {
+		return rc;
+	}
+	return gpio_pin_interrupt_configure_dt(&ctx->a, GPIO_INT_EDGE_BOTH);
+}
+
+int sense_wheel_odometry_entry_point(context_t *ctx)
+{
+	LOG_INF("init");
+	ctx->period_cyc = sys_clock_hw_cycles_per_sec() / RATE_HZ;
+	ctx->submit_cyc = k_cycle_get_32();
+	ctx->edge_cyc = ctx->submit_cyc;
+	ctx->edge_cyc_prev = ctx->submit_cyc;
+	ctx->edge_ticks_prev = 0;
+	zros_node_init(&ctx->node, "sense_wheel_odometry");
+	zros_pub_init(&ctx->pub, &ctx->node, &topic_wheel_odometry, &ctx->data);
+	zros_pub_init(&ctx->pub_velocity, &ctx->node, &topic_wheel_velocity, &ctx->wheel_velocity);
+	if (wheel_capture_init(ctx) < 0) {
+		return -ENODEV;
+	}
+	// a moving wheel is published by its edges, the timer publishes it standing still
+	k_timer_init(&ctx->timer, wheel_capture_timer_handler, NULL);
+	k_timer_start(&ctx->timer, K_MSEC(1000 / RATE_HZ), K_MSEC(1000 / RATE_HZ));
+	return 0;
+}
+
+K_THREAD_DEFINE(sense_wheel_odometry, MY_STACK_SIZE, sense_wheel_odometry_entry_point, &g_ctx, NULL,
+		NULL, MY_PRIORITY, 0, 100);
+
+static int cmd_wheel_odometry_status(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	context_t *ctx = &g_ctx;
+
+	shell_print(sh, "count: %d velocity: %10.4f rad/s", ctx->count_prev,
+		    (double)ctx->wheel_velocity.velocity);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_sense_wheel_odometry,
+			       SHELL_CMD(status, NULL, "Encoder count and rate.",
+					 cmd_wheel_odometry_status),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(sense_wheel_odometry, &sub_sense_wheel_odometry,
+		   "sense_wheel_odometry commands", NULL);
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,101 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include <zros/zros_sub.h>
+
+#include <cerebri/core/log_utils.h>
+#include <cerebri/sense/wheel_loop.h>
+
+LOG_MODULE_DECLARE(sense_wheel_odometry, CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_LOG_LEVEL);
+
+#if defined(CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_CAPTURE)
+#define WHEEL_TOPIC topic_wheel_velocity
+#else
+#define WHEEL_TOPIC topic_wheel_odometry
+#endif
+
+void wheel_loop_init(struct wheel_loop *loop, struct zros_node *node)
+{
+	zros_sub_init(&loop->sub, node, &WHEEL_TOPIC, &loop->wheel, 0);
+	loop->closed = false;
+	loop->last_ns = 0;
+	loop->integral = 0;
+#if !defined(CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_CAPTURE)
+	loop->stamp_ns = 0;
+#endif
+}
+
+void wheel_loop_fini(struct wheel_loop *loop)
+{
+	zros_sub_fini(&loop->sub);
+}
+
+static bool wheel_loop_take(struct wheel_loop *loop)
+{
+	zros_sub_update(&loop->sub);
+
+	int64_t now_ns = synapse_uptime_ns();
+	double dt = (now_ns - loop->last_ns) * 1e-9;
+	bool first = loop->last_ns == 0;
+	loop->last_ns = now_ns;
+
+#if defined(CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_CAPTURE)
+	// rate from encoder edge times
+	loop->omega = loop->wheel.velocity;
+#else
+	// rate from rotation differenced over the message stamps
+	int64_t stamp_ns = loop->wheel.stamp.seconds * NSEC_PER_SEC + loop->wheel.stamp.nanos;
+	double stamp_dt = (stamp_ns - loop->stamp_ns) * 1e-9;
+	bool rate = loop->stamp_ns != 0 && stamp_dt > 0;
+	if (rate) {
+		loop->omega = (loop->wheel.rotation - loop->rotation) / stamp_dt;
+	}
+	loop->stamp_ns = stamp_ns;
+	loop->rotation = loop->wheel.rotation;
+	if (!rate) {
+		return false;
+	}
+#endif
+
+	if (first || dt <= 0 || dt > WHEEL_LOOP_TIMEOUT_MS * 1e-3) {
+		return false;
+	}
+	loop->dt = dt;
+	return true;
+}
+
+bool wheel_loop_update(struct wheel_loop *loop)
+{
+	struct k_poll_event events[] = {
+		*zros_sub_get_event(&loop->sub),
+	};
+	int rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(WHEEL_LOOP_TIMEOUT_MS));
+
+	if (rc < 0) {
+		CEREBRI_LOG_DBG_LIMIT("not receiving wheel odometry, open loop");
+	}
+	loop->closed = rc == 0 && wheel_loop_take(loop);
+	return loop->closed;
+}
+
+double wheel_loop_correction(struct wheel_loop *loop, const struct wheel_loop_gains *gains,
+			     double omega_sp, bool closed)
+{
+	if (!closed) {
+		loop->integral = 0;
+		return 0;
+	}
+
+	double error = omega_sp - loop->omega;
+	loop->integral = CLAMP(loop->integral + gains->ki * error * loop->dt, -gains->i_max,
+			       gains->i_max);
+	return gains->kp * error + loop->integral;
+}
+
+// vi: ts=4 sw=4 et
@@ -7,6 +7,10 @@
 #include <zephyr/logging/log.h>
 
 #include <cerebri/core/common.h>
+#include <cerebri/core/workq.h>
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+#include <cerebri/core/sensor_sched.h>
+#endif
 
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_pub_struct.h>
@@ -20,34 +24,72 @@ LOG_MODULE_REGISTER(sense_wheel_odometry, CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_LO
 
 #define MY_STACK_SIZE 1024
 #define MY_PRIORITY   6
-
-extern struct k_work_q g_high_priority_work_q;
+#define PERIOD_MS     10
 
 #define N_SENSORS 1
 
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+extern struct k_work_q g_high_priority_work_q;
 void wheel_odometry_work_handler(struct k_work *work);
+#endif
 
 typedef struct context {
-	struct k_work work_item;
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	struct workq_item work_item;
+#endif
 	const struct device *device[N_SENSORS];
 	struct zros_node node;
 	struct zros_pub pub;
 	synapse_pb_WheelOdometry data;
 } context_t;
 
-static context_t g_ctx = {.work_item = Z_WORK_INITIALIZER(wheel_odometry_work_handler),
-			  .device = {},
-			  .node = {},
-			  .pub = {},
-			  .data = {
-				  .has_stamp = true,
-				  .stamp = synapse_pb_Timestamp_init_default,
-				  .rotation = 0,
-			  }};
+static context_t g_ctx = {
+#if !defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	.work_item =
+		WORKQ_ITEM_INITIALIZER(wheel_odometry_work_handler, "sense_wheel_odometry", 2000),
+#endif
+	.device = {},
+	.node = {},
+	.pub = {},
+	.data =
+		{
+			.has_stamp = true,
+			.stamp = synapse_pb_Timestamp_init_default,
+			.rotation = 0,
+		},
+};
+
+static void wheel_odometry_publish(context_t *ctx, double rotation)
+{
+	stamp_msg_now(&ctx->data.stamp);
+	ctx->data.rotation = rotation;
+	zros_pub_update(&ctx->pub);
+}
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+// runs on the sensor scheduler thread once the async read completes
+static void wheel_odometry_read_done(struct sensor_sched_client *client, int result,
+				     const uint8_t *buf, uint32_t len)
+{
+	double rotation;
+	ARG_UNUSED(len);
 
+	if (result < 0 ||
+	    sensor_sched_decode(client, buf, SENSOR_CHAN_ROTATION, &rotation, 1) < 0) {
+		LOG_DBG("read failed: %d", result);
+		return;
+	}
+	LOG_DBG("rotation: %10.6f", rotation);
+	// account for negative rotation of encoder
+	wheel_odometry_publish(&g_ctx, -rotation);
+}
+
+SENSOR_SCHED_CLIENT_DEFINE(wheel_odometry_client, DT_ALIAS(wheel_odometry0), PERIOD_MS,
+			   wheel_odometry_read_done, NULL, {SENSOR_CHAN_ROTATION, 0});
+#else
 void wheel_odometry_work_handler(struct k_work *work)
 {
-	context_t *ctx = CONTAINER_OF(work, context_t, work_item);
+	context_t *ctx = CONTAINER_OF(work, context_t, work_item.work);
 	double data_array[N_SENSORS];
 	for (int i = 0; i < N_SENSORS; i++) {
 		// default all data to zero
@@ -69,17 +111,16 @@ void wheel_odometry_work_handler(struct k_work *work)
 	double rotation = -data_array[0]; // account for negative rotation of encoder
 
 	// publish msg
-	stamp_msg(&ctx->data.stamp, k_uptime_ticks());
-	ctx->data.rotation = rotation;
-	zros_pub_update(&ctx->pub);
+	wheel_odometry_publish(ctx, rotation);
 }
 
 void wheel_odometry_timer_handler(struct k_timer *dummy)
 {
-	k_work_submit_to_queue(&g_high_priority_work_q, &g_ctx.work_item);
+	workq_submit(&g_high_priority_work_q, &g_ctx.work_item);
 }
 
 K_TIMER_DEFINE(wheel_odometry_timer, wheel_odometry_timer_handler, NULL);
+#endif
 
 int sense_wheel_odometry_entry_point(context_t *ctx)
 {
@@ -87,7 +128,11 @@ int sense_wheel_odometry_entry_point(context_t *ctx)
 	ctx->device[0] = get_device(DEVICE_DT_GET(DT_ALIAS(wheel_odometry0)));
 	zros_node_init(&ctx->node, "sense_wheel_odometry");
 	zros_pub_init(&ctx->pub, &ctx->node, &topic_wheel_odometry, &ctx->data);
-	k_timer_start(&wheel_odometry_timer, K_MSEC(10), K_MSEC(10));
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED)
+	sensor_sched_add(&wheel_odometry_client);
+#else
+	k_timer_start(&wheel_odometry_timer, K_MSEC(PERIOD_MS), K_MSEC(PERIOD_MS));
+#endif
 	return 0;
 }
 
@@ -13,21 +13,135 @@
 
 #include "proto/udp_rx.h"
 #include <synapse_topic_list.h>
+#include <cerebri/core/arena.h>
+#include <cerebri/core/boot.h>
+#include <cerebri/core/clock_sync.h>
 #include <cerebri/core/log_utils.h>
+#include <cerebri/core/param.h>
 
 #include <pb_decode.h>
 
-#define MY_STACK_SIZE 8192
-#define MY_PRIORITY   1
+#define MY_STACK_SIZE   8192
+#define MY_PRIORITY     1
+#define BULK_STACK_SIZE 8192
+#define BULK_PRIORITY   CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK_PRIORITY
+#define BULK_BUDGET     CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK_BUDGET
 
 CEREBRI_NODE_LOG_INIT(eth_rx, LOG_LEVEL_WRN);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK)
+static K_THREAD_STACK_DEFINE(g_bulk_stack_area, BULK_STACK_SIZE);
+#endif
+
+/*
+ * Received messages, X(frame field, message type, topic, storage). Topics
+ * with a loan are decoded straight into a loaned buffer and published
+ * without a copy, the others are decoded into a scratch message sized for
+ * them alone and republished.
+ */
+#define RX_TYPES_COMMON(X)                                                                         \
+	X(bezier_trajectory, BezierTrajectory, bezier_trajectory_ethernet, LOAN)                   \
+	X(clock_offset, ClockOffset, clock_offset_ethernet, COPY)                                  \
+	X(input, Input, input_ethernet, COPY)                                                      \
+	X(twist, Twist, cmd_vel_ethernet, COPY)                                                    \
+	X(odometry, Odometry, odometry_ethernet, LOAN)
+
+#if defined(CONFIG_CEREBRI_DREAM_HIL_ETH_RX)
+#define RX_TYPES_HIL(X)                                                                            \
+	X(battery_state, BatteryState, battery_state, COPY)                                        \
+	X(imu, Imu, imu, COPY)                                                                     \
+	X(magnetic_field, MagneticField, magnetic_field, COPY)                                     \
+	X(nav_sat_fix, NavSatFix, nav_sat_fix, COPY)                                               \
+	X(wheel_odometry, WheelOdometry, wheel_odometry, COPY)
+#else
+#define RX_TYPES_HIL(X)
+#endif
+
+#define RX_TYPES(X) RX_TYPES_COMMON(X) RX_TYPES_HIL(X)
+
+#define RX_LOAN_LOAN(topic) &loan_##topic
+#define RX_LOAN_COPY(topic) NULL
+
+#define RX_SCRATCH_LOAN(field, type)
+#define RX_SCRATCH_COPY(field, type) synapse_pb_##type field;
+
+#define RX_TYPE_ENTRY(field, type, topic_name, storage)                                            \
+	{.tag = synapse_pb_Frame_##field##_tag,                                                    \
+	 .fields = synapse_pb_##type##_fields,                                                     \
+	 .topic = &topic_##topic_name,                                                             \
+	 .loan = RX_LOAN_##storage(topic_name),                                                    \
+	 .name = #field},
+#define RX_TYPE_SCRATCH(field, type, topic_name, storage) RX_SCRATCH_##storage(field, type)
+
+struct rx_type {
+	pb_size_t tag;
+	const pb_msgdesc_t *fields;
+	struct zros_topic *topic;
+	struct synapse_loan *loan;
+	const char *name;
+};
+
+static const struct rx_type g_rx_types[] = {RX_TYPES(RX_TYPE_ENTRY)};
+
+#define RX_TYPE_INDEX(field, type, topic_name, storage) RX_INDEX_##field,
+enum rx_index {
+	RX_TYPES(RX_TYPE_INDEX) RX_INDEX_COUNT
+};
+
+BUILD_ASSERT(RX_INDEX_COUNT < UINT8_MAX, "rx type index is 8 bit");
+
+// frame tag to rx type index plus one, zero for a tag that is not received
+#define RX_TAG_BOUND(field, type, topic_name, storage)                                             \
+	char field[synapse_pb_Frame_##field##_tag + 1];
+#define RX_TAG_ENTRY(field, type, topic_name, storage)                                             \
+	[synapse_pb_Frame_##field##_tag] = RX_INDEX_##field + 1,
+
+union rx_tag_bound {
+	RX_TYPES(RX_TAG_BOUND)
+};
+
+static const uint8_t g_rx_index[sizeof(union rx_tag_bound)] = {RX_TYPES(RX_TAG_ENTRY)};
+
+union rx_scratch {
+	RX_TYPES(RX_TYPE_SCRATCH)
+};
+
+/*
+ * Frames arrive on two channels, each decoded by a thread of its own into
+ * its own scratch message. The command channel on the udp_rx data port is
+ * drained completely at high priority. With CEREBRI_SYNAPSE_ETH_RX_BULK,
+ * trajectory uploads and mocap sent to the bulk port are decoded at low
+ * priority, a budget of datagrams per wakeup, so a burst there never
+ * delays a command.
+ */
+struct rx_channel {
+	const char *name;
+	union rx_scratch rx_msg;
+	// receive statistics
+	uint32_t rx_count[ARRAY_SIZE(g_rx_types)];
+	uint32_t datagrams;
+	uint32_t decode_errors;
+	uint32_t unhandled;
+	uint32_t publish_errors;
+	uint32_t loan_exhausted;
+	// longest since the last status, wakeup to the last datagram handled
+	uint32_t max_us;
+};
 
 struct context {
 	struct zros_node node;
-	synapse_pb_Frame rx_frame;
 	struct udp_rx udp;
+	struct rx_channel command;
+	uint32_t control_errors;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK)
+	struct rx_channel bulk;
+	int bulk_sock;
+	uint8_t bulk_buf[sizeof(((struct udp_rx *)NULL)->rx_buf)];
+	atomic_t bulk_stop;
+	k_thread_stack_t *bulk_stack_area;
+	struct k_thread bulk_thread;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
@@ -36,65 +150,236 @@ struct context {
 
 static struct context g_ctx = {
 	.node = {},
-	.rx_frame = synapse_pb_Frame_init_default,
 	.udp = {},
+	.command = {.name = "command"},
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK)
+	.bulk = {.name = "bulk"},
+	.bulk_sock = -1,
+	.bulk_stack_area = g_bulk_stack_area,
+#endif
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
 	.thread_data = {},
 };
 
-static void handle_frame(struct context *ctx)
-{
-	synapse_pb_Frame *frame = &ctx->rx_frame;
-	void *msg = NULL;
-	struct zros_topic *topic = NULL;
-
-	// determine topic for data
-	if (frame->which_msg == synapse_pb_Frame_bezier_trajectory_tag) {
-		msg = &frame->msg.bezier_trajectory;
-		topic = &topic_bezier_trajectory_ethernet;
-	} else if (frame->which_msg == synapse_pb_Frame_clock_offset_tag) {
-		msg = &frame->msg.clock_offset;
-		topic = &topic_clock_offset_ethernet;
-	} else if (frame->which_msg == synapse_pb_Frame_input_tag) {
-		msg = &frame->msg.input;
-		topic = &topic_input_ethernet;
-	} else if (frame->which_msg == synapse_pb_Frame_twist_tag) {
-		msg = &frame->msg.twist;
-		topic = &topic_cmd_vel_ethernet;
-	} else if (frame->which_msg == synapse_pb_Frame_odometry_tag) {
-		msg = &frame->msg.odometry;
-		topic = &topic_odometry_ethernet;
-#ifdef CONFIG_CEREBRI_DREAM_HIL
-	} else if (frame->which_msg == synapse_pb_Frame_battery_state_tag) {
-		msg = &frame->msg.battery_state;
-		topic = &topic_battery_state;
-	} else if (frame->which_msg == synapse_pb_Frame_imutag) {
-		msg = &frame->msg.imu;
-		topic = &topic_imu;
-	} else if (frame->which_msg == synapse_pb_Frame_magnetic_fieldtag) {
-		msg = &frame->msg.magnetic_field;
-		topic = &topic_magnetic_field;
-	} else if (frame->which_msg == synapse_pb_Frame_nav_sat_fixtag) {
-		msg = &frame->msg.nav_sat_fix;
-		zros_topic_publish(&topic_nav_sat_fix, msg);
-	} else if (frame->which_msg == synapse_pb_Frame_wheel_odometrytag) {
-		msg = &frame->msg.wheel_odometry;
-		topic = &topic_wheel_odometry;
+// decode one message of the frame into its destination and publish it
+static bool handle_msg(struct rx_channel *ch, pb_istream_t *stream, int index)
+{
+	const struct rx_type *type = &g_rx_types[index];
+	void *msg = &ch->rx_msg;
+
+	if (type->loan != NULL) {
+		msg = synapse_loan_acquire(type->loan);
+		if (msg == NULL) {
+			ch->loan_exhausted++;
+			return pb_skip_field(stream, PB_WT_STRING);
+		}
+	}
+
+	pb_istream_t sub;
+	if (!pb_make_string_substream(stream, &sub)) {
+		if (type->loan != NULL) {
+			synapse_loan_discard(type->loan, msg);
+		}
+		return false;
+	}
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PB_ARENA)
+	// pointer fields of a loaned message live in the arena of its buffer
+	struct arena *arena = type->loan != NULL ? synapse_loan_arena(type->loan, msg) : NULL;
+	bool decoded = arena != NULL ? arena_pb_decode(arena, &sub, type->fields, msg)
+				     : pb_decode(&sub, type->fields, msg);
+#else
+	bool decoded = pb_decode(&sub, type->fields, msg);
 #endif
+	if (!pb_close_string_substream(stream, &sub) || !decoded) {
+		LOG_ERR("failed to decode %s: %s", type->name, PB_GET_ERROR(&sub));
+		if (type->loan != NULL) {
+			synapse_loan_discard(type->loan, msg);
+		}
+		return false;
 	}
 
-	if (msg == NULL) {
-		LOG_ERR("unhandled message: %d", frame->which_msg);
-	} else {
-		int ret = zros_topic_publish(topic, msg);
-		if (ret != 0) {
-			LOG_ERR("failed to publish msg: %d", frame->which_msg);
+	if (type->loan != NULL) {
+		synapse_loan_publish(type->loan, msg);
+	} else if (synapse_topic_republish(type->topic, msg) != 0) {
+		LOG_ERR("failed to publish msg: %s", type->name);
+		ch->publish_errors++;
+		return true;
+	}
+	if (type->tag == synapse_pb_Frame_clock_offset_tag) {
+		const synapse_pb_ClockOffset *clock_offset = msg;
+		clock_sync_set_offset_ns(clock_offset->offset.seconds * 1000000000LL +
+					 clock_offset->offset.nanos);
+	}
+	ch->rx_count[index]++;
+	return true;
+}
+
+// the frame oneof is read field by field, so no synapse_pb_Frame is needed
+static bool handle_frame(struct rx_channel *ch, pb_istream_t *stream)
+{
+	pb_wire_type_t wire_type;
+	uint32_t tag;
+	bool eof;
+
+	while (pb_decode_tag(stream, &wire_type, &tag, &eof)) {
+		int index = tag < ARRAY_SIZE(g_rx_index) ? g_rx_index[tag] - 1 : -1;
+
+		if (index < 0 || wire_type != PB_WT_STRING) {
+			LOG_ERR("unhandled message: %d", tag);
+			ch->unhandled++;
+			if (!pb_skip_field(stream, wire_type)) {
+				return false;
+			}
+		} else if (!handle_msg(ch, stream, index)) {
+			return false;
 		}
 	}
+	return eof;
 }
 
+// a datagram holds any number of delimited frames
+static void handle_datagram(struct rx_channel *ch, const void *buf, size_t size)
+{
+	pb_istream_t stream = pb_istream_from_buffer(buf, size);
+
+	while (stream.bytes_left > 0) {
+		pb_istream_t frame;
+		if (!pb_make_string_substream(&stream, &frame)) {
+			// the rest of the datagram cannot be framed any more
+			LOG_ERR("failed to decode frame: %s", PB_GET_ERROR(&stream));
+			ch->decode_errors++;
+			return;
+		}
+		if (!handle_frame(ch, &frame)) {
+			ch->decode_errors++;
+		}
+		if (!pb_close_string_substream(&stream, &frame)) {
+			ch->decode_errors++;
+			return;
+		}
+	}
+}
+
+static bool handle_param_set(struct param_set_datagram *msg)
+{
+	msg->path[sizeof(msg->path) - 1] = '\0';
+	int ret = param_set(msg->path, msg->value);
+	if (ret < 0) {
+		LOG_WRN("param %s not set: %d", msg->path, ret);
+		return false;
+	}
+	LOG_INF("param %s set", msg->path);
+	return true;
+}
+
+/*
+ * Telemetry rates from the ground, see synapse_telemetry.h, and parameter
+ * writes, see cerebri/core/param.h, told apart by their magic.
+ */
+static void handle_control(struct context *ctx)
+{
+	union {
+		uint32_t magic;
+		struct synapse_telemetry_rates rates;
+		struct param_set_datagram param;
+	} msg;
+	int received;
+
+	while ((received = udp_rx_receive_control(&ctx->udp, &msg, sizeof(msg))) > 0) {
+		if (received == sizeof(msg.param) && msg.magic == PARAM_SET_MAGIC) {
+			if (!handle_param_set(&msg.param)) {
+				ctx->control_errors++;
+			}
+			continue;
+		}
+		if ((received != sizeof(msg.rates) &&
+		     received != SYNAPSE_TELEMETRY_RATES_V1_SIZE) ||
+		    msg.magic != SYNAPSE_TELEMETRY_MAGIC) {
+			ctx->control_errors++;
+			continue;
+		}
+		if ((size_t)received < sizeof(msg.rates)) {
+			// an older ground station, frames only
+			msg.rates.compact_mask = 0;
+			msg.rates.compact_version = 0;
+		}
+		for (int i = 0; i < SYNAPSE_TELEMETRY_STREAM_COUNT; i++) {
+			msg.rates.rate_hz[i] =
+				MIN(msg.rates.rate_hz[i], SYNAPSE_TELEMETRY_RATE_MAX_HZ);
+		}
+		zros_topic_publish(&topic_telemetry_rates, &msg.rates);
+	}
+}
+
+static void channel_done(struct rx_channel *ch, uint32_t start_cyc)
+{
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start_cyc);
+	ch->max_us = MAX(ch->max_us, us);
+}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK)
+static void eth_rx_bulk_run(void *p0, void *p1, void *p2)
+{
+	struct context *ctx = p0;
+	struct rx_channel *ch = &ctx->bulk;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	while (!atomic_get(&ctx->bulk_stop)) {
+		struct zsock_pollfd fds[] = {{ctx->bulk_sock, ZSOCK_POLLIN, 0}};
+		if (zsock_poll(fds, ARRAY_SIZE(fds), 1000) <= 0) {
+			continue;
+		}
+
+		// the rest stays queued in the socket until the next wakeup
+		uint32_t start_cyc = k_cycle_get_32();
+		int received = 0;
+		for (int i = 0; i < BULK_BUDGET; i++) {
+			received = udp_rx_receive_from(ctx->bulk_sock, ctx->bulk_buf,
+						       sizeof(ctx->bulk_buf));
+			if (received <= 0) {
+				break;
+			}
+			ch->datagrams++;
+			handle_datagram(ch, ctx->bulk_buf, received);
+		}
+		if (received < 0) {
+			LOG_ERR("bulk connection error: %d", received);
+		}
+		channel_done(ch, start_cyc);
+		k_yield();
+	}
+}
+
+static int eth_rx_bulk_start(struct context *ctx)
+{
+	ctx->bulk_sock = udp_rx_bind(CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK_PORT);
+	if (ctx->bulk_sock < 0) {
+		return ctx->bulk_sock;
+	}
+	atomic_set(&ctx->bulk_stop, 0);
+	k_tid_t tid = k_thread_create(&ctx->bulk_thread, ctx->bulk_stack_area, BULK_STACK_SIZE,
+				      eth_rx_bulk_run, ctx, NULL, NULL, BULK_PRIORITY, 0,
+				      K_FOREVER);
+	k_thread_name_set(tid, "eth_rx_bulk");
+	k_thread_start(tid);
+	return 0;
+}
+
+static void eth_rx_bulk_stop(struct context *ctx)
+{
+	if (ctx->bulk_sock < 0) {
+		return;
+	}
+	atomic_set(&ctx->bulk_stop, 1);
+	k_thread_join(&ctx->bulk_thread, K_FOREVER);
+	zsock_close(ctx->bulk_sock);
+	ctx->bulk_sock = -1;
+}
+#endif
+
 static int eth_rx_init(struct context *ctx)
 {
 	int ret = 0;
@@ -108,7 +393,17 @@ static int eth_rx_init(struct context *ctx)
 		return ret;
 	}
 
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK)
+	ret = eth_rx_bulk_start(ctx);
+	if (ret < 0) {
+		LOG_ERR("bulk channel failed: %d", ret);
+		udp_rx_fini(&ctx->udp);
+		return ret;
+	}
+#endif
+
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("eth_rx init");
 	LOG_INF("started");
 	return ret;
 };
@@ -116,6 +411,9 @@ static int eth_rx_init(struct context *ctx)
 static int eth_rx_fini(struct context *ctx)
 {
 	int ret = 0;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK)
+	eth_rx_bulk_stop(ctx);
+#endif
 	// close udp socket
 	ret = udp_rx_fini(&ctx->udp);
 
@@ -142,25 +440,31 @@ static void eth_rx_run(void *p0, void *p1, void *p2)
 	}
 
 	LOG_INF("running");
-	pb_istream_t stream;
 
 	// while running
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
-		// poll sockets and receive data
-		int received = udp_rx_receive(&ctx->udp);
+		// wait for data, then drain every queued datagram before waiting again
+		int rc = udp_rx_poll(&ctx->udp, 1000);
+		if (rc < 0) {
+			LOG_ERR("poll error: %d", rc);
+			continue;
+		}
+
+		if (rc & UDP_RX_CONTROL) {
+			handle_control(ctx);
+		}
+
+		uint32_t start_cyc = k_cycle_get_32();
+		int received = 0;
+		while ((rc & UDP_RX_DATA) && (received = udp_rx_receive(&ctx->udp)) > 0) {
+			ctx->command.datagrams++;
+			handle_datagram(&ctx->command, ctx->udp.rx_buf, received);
+		}
 		if (received < 0) {
-			LOG_ERR("connection error: %d", errno);
-		} else if (received > 0) {
-			stream = pb_istream_from_buffer(ctx->udp.rx_buf, received);
-			while (stream.bytes_left > 0) {
-				if (!pb_decode_ex(&stream, synapse_pb_Frame_fields, &ctx->rx_frame,
-						  PB_DECODE_DELIMITED)) {
-					LOG_ERR("failed to decode msg: %s\n",
-						PB_GET_ERROR(&stream));
-				} else {
-					handle_frame(ctx);
-				}
-			}
+			LOG_ERR("connection error: %d", received);
+		}
+		if (rc & UDP_RX_DATA) {
+			channel_done(&ctx->command, start_cyc);
 		}
 	}
 
@@ -180,6 +484,20 @@ static int start(struct context *ctx)
 	return 0;
 }
 
+static void channel_status(const struct shell *sh, struct rx_channel *ch)
+{
+	shell_print(sh, "%s datagrams: %u decode errors: %u unhandled: %u publish errors: %u",
+		    ch->name, ch->datagrams, ch->decode_errors, ch->unhandled, ch->publish_errors);
+	shell_print(sh, "%s loan exhausted: %u max us: %u", ch->name, ch->loan_exhausted,
+		    ch->max_us);
+	ch->max_us = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(g_rx_types); i++) {
+		if (ch->rx_count[i] > 0) {
+			shell_print(sh, "  %-20s %u", g_rx_types[i].name, ch->rx_count[i]);
+		}
+	}
+}
+
 static int eth_rx_cmd_handler(const struct shell *sh, size_t argc, char **argv, void *data)
 {
 	ARG_UNUSED(argc);
@@ -198,7 +516,12 @@ static int eth_rx_cmd_handler(const struct shell *sh, size_t argc, char **argv,
 			shell_print(sh, "not running");
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
-		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		shell_print(sh, "running: %d control errors: %u",
+			    (int)k_sem_count_get(&g_ctx.running) == 0, ctx->control_errors);
+		channel_status(sh, &ctx->command);
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_RX_BULK)
+		channel_status(sh, &ctx->bulk);
+#endif
 	}
 	return 0;
 }
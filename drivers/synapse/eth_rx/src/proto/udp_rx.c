@@ -5,10 +5,31 @@
 
 LOG_MODULE_DECLARE(eth_rx);
 
-#define MY_PORT 4242
+#define MY_PORT      4242
+#define CONTROL_PORT CONFIG_CEREBRI_SYNAPSE_ETH_RX_CONTROL_PORT
+
+int udp_rx_bind(uint16_t port)
+{
+	struct sockaddr_in addr = {
+		.sin_addr.s_addr = INADDR_ANY, .sin_family = AF_INET, .sin_port = htons(port)};
+
+	int sock = zsock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		LOG_ERR("failed ot create UDP socket: %d", errno);
+		return -errno;
+	}
+	if (zsock_bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		LOG_ERR("failed to bind UDP socket: %d", errno);
+		int ret = -errno;
+		zsock_close(sock);
+		return ret;
+	}
+	return sock;
+}
 
 int udp_rx_init(struct udp_rx *ctx)
 {
+	ctx->control_sock = -1;
 	ctx->addr.sin_addr.s_addr = INADDR_ANY;
 	ctx->addr.sin_family = AF_INET;
 	ctx->addr.sin_port = htons(MY_PORT);
@@ -26,6 +47,11 @@ int udp_rx_init(struct udp_rx *ctx)
 		return -errno;
 	}
 
+	ctx->control_sock = udp_rx_bind(CONTROL_PORT);
+	if (ctx->control_sock < 0) {
+		return ctx->control_sock;
+	}
+
 	return 0;
 }
 
@@ -36,9 +62,32 @@ int udp_rx_fini(struct udp_rx *ctx)
 	if (ret < 0) {
 		LOG_ERR("failed to close socket: %d", ret);
 	}
+	if (ctx->control_sock >= 0) {
+		zsock_close(ctx->control_sock);
+	}
 	return ret;
 }
 
+int udp_rx_poll(struct udp_rx *ctx, int timeout_ms)
+{
+	struct zsock_pollfd fds[] = {
+		{ctx->sock, ZSOCK_POLLIN | ZSOCK_POLLHUP, 0},
+		{ctx->control_sock, ZSOCK_POLLIN | ZSOCK_POLLHUP, 0},
+	};
+
+	int ret = zsock_poll(fds, ARRAY_SIZE(fds), timeout_ms);
+	if (ret <= 0) {
+		if (ret < 0) {
+			LOG_ERR("poll failed: %d", errno);
+			return -errno;
+		}
+		return 0;
+	}
+
+	return ((fds[0].revents & ZSOCK_POLLIN) ? UDP_RX_DATA : 0) |
+	       ((fds[1].revents & ZSOCK_POLLIN) ? UDP_RX_CONTROL : 0);
+}
+
 int udp_rx_receive(struct udp_rx *ctx)
 {
 	uint32_t addr;
@@ -46,41 +95,32 @@ int udp_rx_receive(struct udp_rx *ctx)
 	struct sockaddr_in client_addr = {
 		.sin_addr.s_addr = addr, .sin_family = AF_INET, .sin_port = htons(MY_PORT)};
 	socklen_t client_addr_len = sizeof(client_addr);
-	int ret = 0;
 
-	struct zsock_pollfd fds[] = {
-		{ctx->sock, ZSOCK_POLLIN | ZSOCK_POLLHUP, 0},
-	};
-
-	ret = zsock_poll(fds, ARRAY_SIZE(fds), 1000);
+	int ret = zsock_recvfrom(ctx->sock, ctx->rx_buf, sizeof(ctx->rx_buf), ZSOCK_MSG_DONTWAIT,
+				 (struct sockaddr *)&client_addr, &client_addr_len);
 
 	if (ret == 0) {
-		return 0;
+		return -EIO;
 	} else if (ret < 0) {
-		LOG_ERR("poll failed: %d", ret);
-		return ret;
-	}
-
-	bool data_ready = false;
-	for (size_t i = 0; i < ARRAY_SIZE(fds); i++) {
-		if (fds[i].revents & ZSOCK_POLLIN) {
-			data_ready = true;
-		}
-		if (fds[i].revents & ZSOCK_POLLHUP) {
-			// socket closed
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			ret = 0;
+		} else {
+			ret = -errno;
 		}
 	}
+	return ret;
+}
 
-	if (!data_ready) {
-		return 0;
-	}
+int udp_rx_receive_control(struct udp_rx *ctx, void *buf, size_t size)
+{
+	return udp_rx_receive_from(ctx->control_sock, buf, size);
+}
 
-	ret = zsock_recvfrom(ctx->sock, ctx->rx_buf, sizeof(ctx->rx_buf), ZSOCK_MSG_DONTWAIT,
-			     (struct sockaddr *)&client_addr, &client_addr_len);
+int udp_rx_receive_from(int sock, void *buf, size_t size)
+{
+	int ret = zsock_recvfrom(sock, buf, size, ZSOCK_MSG_DONTWAIT, NULL, NULL);
 
-	if (ret == 0) {
-		return -EIO;
-	} else if (ret < 0) {
+	if (ret < 0) {
 		if (errno == EAGAIN || errno == EWOULDBLOCK) {
 			ret = 0;
 		} else {
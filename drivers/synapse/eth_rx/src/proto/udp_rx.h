@@ -2,16 +2,32 @@
 #define SYNAPSE_UDP_UDP_RX_H_
 
 #include <zephyr/net/socket.h>
+#include <zephyr/sys/util.h>
+
+// udp_rx_poll result bits
+#define UDP_RX_DATA    BIT(0)
+#define UDP_RX_CONTROL BIT(1)
 
 struct udp_rx {
 	int sock;
+	// small datagrams that configure the vehicle rather than carry frames
+	int control_sock;
 	struct sockaddr_in addr;
 	char rx_buf[4096];
 };
 
 int udp_rx_init(struct udp_rx *ctx);
 int udp_rx_fini(struct udp_rx *ctx);
+// wait for data, returns the UDP_RX_ bits of the sockets with a datagram queued, 0 on timeout
+int udp_rx_poll(struct udp_rx *ctx, int timeout_ms);
+// read the next queued datagram into rx_buf without blocking, 0 when none is left
 int udp_rx_receive(struct udp_rx *ctx);
+// read the next queued control datagram without blocking, 0 when none is left
+int udp_rx_receive_control(struct udp_rx *ctx, void *buf, size_t size);
+// a udp socket bound to port on every address, or a negative errno
+int udp_rx_bind(uint16_t port);
+// read the next queued datagram of sock without blocking, 0 when none is left
+int udp_rx_receive_from(int sock, void *buf, size_t size);
 
 #endif // SYNAPSE_UDP_UDP_RX_H_
 // vi: ts=4 sw=4 et
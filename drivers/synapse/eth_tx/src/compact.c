@@ -0,0 +1,162 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <math.h>
+#include <string.h>
+
+#include <zephyr/sys/time_units.h>
+#include <zephyr/sys/util.h>
+
+#include "compact.h"
+
+#define KEYFRAME_INTERVAL CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT_KEYFRAME
+
+#ifndef M_SQRT2
+#define M_SQRT2 1.41421356237309504880
+#endif
+
+void compact_odometry_reset(struct compact_odometry *state)
+{
+	state->keyed = false;
+	state->deltas_left = 0;
+}
+
+uint16_t compact_half(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint16_t sign = (bits >> 16) & 0x8000;
+	uint32_t mantissa = bits & 0x7fffff;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xff);
+
+	if (exponent == 0xff) {
+		// infinity stays one, nan stays a nan
+		return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+	}
+	exponent += 15 - 127;
+	if (exponent >= 31) {
+		return sign | 0x7c00;
+	}
+	if (exponent <= 0) {
+		// subnormal, or zero below half the smallest one
+		if (exponent < -10) {
+			return sign;
+		}
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint16_t half = mantissa >> shift;
+		half += (mantissa >> (shift - 1)) & 1;
+		return sign | half;
+	}
+	// a carry out of the mantissa correctly bumps the exponent
+	uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+	half += (mantissa >> 12) & 1;
+	return half;
+}
+
+uint32_t compact_quaternion(double w, double x, double y, double z)
+{
+	const double q[4] = {w, x, y, z};
+	int largest = 0;
+
+	for (int i = 1; i < 4; i++) {
+		if (fabs(q[i]) > fabs(q[largest])) {
+			largest = i;
+		}
+	}
+
+	// q and -q are the same rotation, flip it so the one left out is positive
+	double sign = q[largest] < 0 ? -1 : 1;
+	uint32_t packed = (uint32_t)largest << 30;
+	int shift = 20;
+	for (int i = 0; i < 4; i++) {
+		if (i == largest) {
+			continue;
+		}
+		// the others are within 1/sqrt(2) of zero
+		long value = lround(sign * q[i] * M_SQRT2 * 511);
+		value = CLAMP(value, -511, 511);
+		packed |= ((uint32_t)value & 0x3ff) << shift;
+		shift -= 10;
+	}
+	return packed;
+}
+
+static int32_t position_mm(double position)
+{
+	return (int32_t)CLAMP(llround(position * 1e3), INT32_MIN, INT32_MAX);
+}
+
+size_t compact_odometry_encode(struct compact_odometry *state, const synapse_pb_Odometry *msg,
+			       uint8_t *buf, size_t size)
+{
+	int64_t stamp_us =
+		((int64_t)msg->stamp.seconds * NSEC_PER_SEC + msg->stamp.nanos) / NSEC_PER_USEC;
+	int32_t pos[3] = {position_mm(msg->pose.position.x), position_mm(msg->pose.position.y),
+			  position_mm(msg->pose.position.z)};
+	uint16_t velocity[3] = {compact_half(msg->twist.linear.x),
+				compact_half(msg->twist.linear.y),
+				compact_half(msg->twist.linear.z)};
+	uint16_t angular_velocity[3] = {compact_half(msg->twist.angular.x),
+					compact_half(msg->twist.angular.y),
+					compact_half(msg->twist.angular.z)};
+	uint32_t orientation =
+		compact_quaternion(msg->pose.orientation.w, msg->pose.orientation.x,
+				   msg->pose.orientation.y, msg->pose.orientation.z);
+
+	// a delta that does not fit its fields takes a keyframe
+	bool key = !state->keyed || state->deltas_left == 0 || stamp_us < state->stamp_us ||
+		   stamp_us - state->stamp_us > UINT32_MAX;
+	for (int i = 0; i < 3 && !key; i++) {
+		int64_t delta = (int64_t)pos[i] - state->position_mm[i];
+		key = delta < INT16_MIN || delta > INT16_MAX;
+	}
+
+	if (key) {
+		struct synapse_compact_odometry_key record = {
+			.type = SYNAPSE_COMPACT_ODOMETRY_KEY,
+			.key = state->key + 1,
+			.stamp_us = stamp_us,
+			.orientation = orientation,
+		};
+		if (size < sizeof(record)) {
+			return 0;
+		}
+		memcpy(record.position_mm, pos, sizeof(record.position_mm));
+		memcpy(record.velocity, velocity, sizeof(record.velocity));
+		memcpy(record.angular_velocity, angular_velocity, sizeof(record.angular_velocity));
+		memcpy(buf, &record, sizeof(record));
+
+		state->keyed = true;
+		state->key = record.key;
+		state->deltas_left = KEYFRAME_INTERVAL - 1;
+		state->stamp_us = stamp_us;
+		memcpy(state->position_mm, pos, sizeof(state->position_mm));
+		state->keyframes++;
+		return sizeof(record);
+	}
+
+	struct synapse_compact_odometry_delta record = {
+		.type = SYNAPSE_COMPACT_ODOMETRY_DELTA,
+		.key = state->key,
+		.stamp_us = stamp_us - state->stamp_us,
+		.orientation = orientation,
+	};
+	if (size < sizeof(record)) {
+		return 0;
+	}
+	for (int i = 0; i < 3; i++) {
+		record.position_mm[i] = pos[i] - state->position_mm[i];
+	}
+	memcpy(record.velocity, velocity, sizeof(record.velocity));
+	memcpy(record.angular_velocity, angular_velocity, sizeof(record.angular_velocity));
+	memcpy(buf, &record, sizeof(record));
+
+	state->deltas_left--;
+	state->deltas++;
+	return sizeof(record);
+}
+
+// vi: ts=4 sw=4 et
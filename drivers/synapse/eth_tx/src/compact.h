@@ -0,0 +1,44 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_ETH_TX_COMPACT_H_
+#define SYNAPSE_ETH_TX_COMPACT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <synapse_pb/odometry.pb.h>
+#include <synapse_telemetry.h>
+
+// the keyframe deltas of the odometry stream are relative to
+struct compact_odometry {
+	bool keyed;
+	uint8_t key;
+	// deltas left before the next keyframe
+	uint16_t deltas_left;
+	int64_t stamp_us;
+	int32_t position_mm[3];
+	uint32_t keyframes;
+	uint32_t deltas;
+};
+
+// start over with a keyframe
+void compact_odometry_reset(struct compact_odometry *state);
+
+/*
+ * encode msg as a keyframe or a delta record into buf, returns its size
+ * or 0 if it does not fit in size, the state is only advanced on success
+ */
+size_t compact_odometry_encode(struct compact_odometry *state, const synapse_pb_Odometry *msg,
+			       uint8_t *buf, size_t size);
+
+// ieee 754 half float, rounded, out of range saturates to infinity
+uint16_t compact_half(float value);
+
+// smallest three of a unit quaternion w, x, y, z
+uint32_t compact_quaternion(double w, double x, double y, double z);
+
+#endif // SYNAPSE_ETH_TX_COMPACT_H_
+// vi: ts=4 sw=4 et
@@ -4,6 +4,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
@@ -16,31 +18,112 @@
 #include <pb_encode.h>
 
 #include "proto/udp_tx.h"
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+#include "proto/pkt_tx.h"
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+#include "compact.h"
+#endif
 
+#include <synapse_cache.h>
 #include <synapse_topic_list.h>
+#include <cerebri/core/boot.h>
 #include <cerebri/core/log_utils.h>
+#include <cerebri/core/profile.h>
+#include <cerebri/core/trace.h>
 
 #define MY_STACK_SIZE 8192
 #define MY_PRIORITY   1
 #define TX_BUF_SIZE   8192
+#define PACKET_SIZE   CONFIG_CEREBRI_SYNAPSE_ETH_TX_PACKET_SIZE
+#define DEST_MAX      CONFIG_CEREBRI_SYNAPSE_ETH_TX_DESTINATIONS_MAX
+#define ALL_STREAMS   BIT_MASK(SYNAPSE_TELEMETRY_STREAM_COUNT)
+#define FLUSH_TICKS   k_us_to_ticks_ceil64(CONFIG_CEREBRI_SYNAPSE_ETH_TX_FLUSH_US)
+#define RATE_HZ       CONFIG_CEREBRI_SYNAPSE_ETH_TX_RATE_HZ
+// congestion back off, each step halves the adaptive streams
+#define BACKOFF_MAX        3
+#define BACKOFF_STEP_TICKS k_ms_to_ticks_ceil64(100)
+#define RECOVER_TICKS      k_ms_to_ticks_ceil64(1000)
+#define SLOW_SEND_US       CONFIG_CEREBRI_SYNAPSE_ETH_TX_SLOW_SEND_US
+#define STREAM(name)       SYNAPSE_TELEMETRY_##name
+// keep trace datagrams below the ethernet mtu
+#define TRACE_EVENTS_PER_PACKET    100
+#define PROFILE_ENTRIES_PER_PACKET 160
+#define DUMP_PACKET_SIZE           1400
+#define DUMP_PORT                  CONFIG_CEREBRI_SYNAPSE_ETH_TX_STATE_DUMP_PORT
+#define COMPACT_PORT               CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT_PORT
 
 CEREBRI_NODE_LOG_INIT(eth_tx, LOG_LEVEL_WRN);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
+#define STREAM_NAME(name) #name,
+static const char *const g_stream_names[] = {SYNAPSE_TELEMETRY_STREAMS(STREAM_NAME)};
+
+// a ground consumer, unicast or a multicast group, and its pending datagram
+struct destination {
+	struct in_addr addr;
+	// bit per telemetry stream sent to it, clock offsets go to all
+	uint32_t streams;
+	// delimited frames waiting to go out in one datagram
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+	struct pkt_tx pkt;
+#else
+	uint8_t packet[PACKET_SIZE];
+#endif
+	size_t packet_len;
+	int64_t packet_deadline;
+};
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+// compact records waiting to go out in one datagram, the same for every destination
+struct compact_tx {
+	uint8_t packet[PACKET_SIZE];
+	size_t len;
+	int64_t deadline;
+	uint16_t datagram;
+	struct compact_odometry odometry;
+	uint32_t packets_sent;
+};
+#endif
+
 struct context {
 	// zros node handle
 	struct zros_node node;
 	// subscriptions
-	struct zros_sub sub_actuators, sub_odometry_estimator, sub_nav_sat_fix, sub_status;
-	// topic data
-	synapse_pb_Frame tx_frame;
+	struct zros_sub sub_actuators, sub_nav_sat_fix;
+	struct synapse_loan_sub sub_odometry_estimator;
+	struct synapse_seqlock_sub sub_status;
+	struct zros_sub sub_telemetry_rates;
+	// requested stream rates and the ones subscribed with, 0 when off
+	struct synapse_telemetry_rates rates, rates_msg;
+	uint16_t active_hz[SYNAPSE_TELEMETRY_STREAM_COUNT];
+	// adaptive streams run at their rate shifted right by backoff
+	int backoff;
+	bool congested;
+	int64_t congested_ticks;
+	int64_t backoff_ticks;
+	uint32_t send_stalls;
+	// topic data, encoded from here without building a synapse_pb_Frame
 	synapse_pb_Actuators actuators;
 	synapse_pb_NavSatFix nav_sat_fix;
-	synapse_pb_Odometry odometry_estimator;
 	synapse_pb_Status status;
 	// connections
 	struct udp_tx udp;
+	struct destination dest[DEST_MAX];
+	int dest_count;
+	// streams at least one destination takes
+	uint32_t streams;
+	uint32_t packets_sent;
+	uint32_t frames_sent;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+	// streams sent compact, as negotiated with the ground
+	uint32_t compact_streams;
+	struct compact_tx compact;
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_TRACE)
+	struct trace_reader trace_reader;
+#endif
 	// status
 	struct k_sem running;
 	size_t stack_size;
@@ -55,43 +138,666 @@ static struct context g_ctx = {
 	.sub_nav_sat_fix = {},
 	.sub_status = {},
 	.actuators = {},
-	.odometry_estimator = {},
 	.status = {},
+	.dest_count = 0,
+	.rates =
+		{
+			.magic = SYNAPSE_TELEMETRY_MAGIC,
+			.rate_hz = {RATE_HZ, RATE_HZ, RATE_HZ, RATE_HZ},
+			.adaptive_mask = BIT(STREAM(nav_sat_fix)) | BIT(STREAM(status)),
+		},
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
 	.thread_data = {},
 };
 
+// a send that would block or takes long means the link or the stack is saturated
+static void send_done(struct context *ctx, int ret, uint32_t start)
+{
+	uint32_t send_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+	if (ret == -EAGAIN || ret == -ENOMEM || send_us > SLOW_SEND_US) {
+		ctx->congested = true;
+		ctx->send_stalls++;
+	}
+	ctx->packets_sent++;
+}
+
+static void send_packet(struct context *ctx, const struct destination *dest, const uint8_t *buf,
+			size_t len)
+{
+	uint32_t start = k_cycle_get_32();
+	send_done(ctx, udp_tx_send_to(&ctx->udp, &dest->addr, UDP_TX_PORT, buf, len), start);
+}
+
+static void flush_packet(struct context *ctx, struct destination *dest)
+{
+	if (dest->packet_len == 0) {
+		return;
+	}
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+	uint32_t start = k_cycle_get_32();
+	send_done(ctx, pkt_tx_send(&dest->pkt), start);
+#else
+	send_packet(ctx, dest, dest->packet, dest->packet_len);
+#endif
+	dest->packet_len = 0;
+}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+// send the compact datagram to every destination taking one of its streams
+static void compact_flush(struct context *ctx)
+{
+	struct compact_tx *compact = &ctx->compact;
+
+	if (compact->len <= sizeof(struct synapse_compact_header)) {
+		compact->len = 0;
+		return;
+	}
+	for (int i = 0; i < ctx->dest_count; i++) {
+		if (ctx->dest[i].streams & ctx->compact_streams) {
+			uint32_t start = k_cycle_get_32();
+			send_done(ctx,
+				  udp_tx_send_to(&ctx->udp, &ctx->dest[i].addr, COMPACT_PORT,
+						 compact->packet, compact->len),
+				  start);
+		}
+	}
+	compact->packets_sent++;
+	compact->datagram++;
+	compact->len = 0;
+}
+
+// room for a record of up to size bytes at the end of the compact datagram
+static uint8_t *compact_reserve(struct context *ctx, size_t size)
+{
+	struct compact_tx *compact = &ctx->compact;
+
+	if (compact->len + size > sizeof(compact->packet)) {
+		compact_flush(ctx);
+	}
+	if (compact->len == 0) {
+		struct synapse_compact_header header = {
+			.magic = SYNAPSE_COMPACT_MAGIC,
+			.version = SYNAPSE_TELEMETRY_COMPACT_VERSION,
+			.datagram = compact->datagram,
+		};
+		memcpy(compact->packet, &header, sizeof(header));
+		compact->len = sizeof(header);
+		compact->deadline = k_uptime_ticks() + FLUSH_TICKS;
+	}
+	return &compact->packet[compact->len];
+}
+
+static void compact_commit(struct context *ctx, size_t len)
+{
+	struct compact_tx *compact = &ctx->compact;
+
+	compact->len += len;
+	compact->packet[offsetof(struct synapse_compact_header, count)]++;
+	if (compact->len + sizeof(struct synapse_compact_odometry_key) > sizeof(compact->packet)) {
+		compact_flush(ctx);
+	}
+}
+
+static void send_compact_odometry(struct context *ctx, const synapse_pb_Odometry *msg)
+{
+	uint8_t *buf = compact_reserve(ctx, sizeof(struct synapse_compact_odometry_key));
+	size_t size = sizeof(ctx->compact.packet) - ctx->compact.len;
+
+	ctx->frames_sent++;
+	compact_commit(ctx, compact_odometry_encode(&ctx->compact.odometry, msg, buf, size));
+}
+
+/*
+ * Take the compact streams the ground asked for if it decodes the version
+ * eth_tx speaks, otherwise keep sending frames.
+ */
+static void eth_tx_negotiate(struct context *ctx)
+{
+	uint32_t streams = 0;
+
+	if (ctx->rates.compact_version == SYNAPSE_TELEMETRY_COMPACT_VERSION) {
+		streams = ctx->rates.compact_mask & SYNAPSE_TELEMETRY_COMPACT_STREAMS;
+	} else if (ctx->rates.compact_mask != 0) {
+		LOG_WRN("ground wants compact version %u, sending frames",
+			ctx->rates.compact_version);
+	}
+	if (streams != ctx->compact_streams) {
+		LOG_INF("compact streams 0x%x", streams);
+		compact_flush(ctx);
+		compact_odometry_reset(&ctx->compact.odometry);
+		ctx->compact_streams = streams;
+	}
+}
+#endif
+
+// send the datagrams whose first frame is older than the flush time
+static void flush_due(struct context *ctx, int64_t now)
+{
+	for (int i = 0; i < ctx->dest_count; i++) {
+		if (ctx->dest[i].packet_len > 0 && now >= ctx->dest[i].packet_deadline) {
+			flush_packet(ctx, &ctx->dest[i]);
+		}
+	}
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+	if (ctx->compact.len > 0 && now >= ctx->compact.deadline) {
+		compact_flush(ctx);
+	}
+#endif
+}
+
+static int64_t next_deadline(const struct context *ctx)
+{
+	int64_t deadline = INT64_MAX;
+
+	for (int i = 0; i < ctx->dest_count; i++) {
+		if (ctx->dest[i].packet_len > 0) {
+			deadline = MIN(deadline, ctx->dest[i].packet_deadline);
+		}
+	}
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+	if (ctx->compact.len > 0) {
+		deadline = MIN(deadline, ctx->compact.deadline);
+	}
+#endif
+	return deadline;
+}
+
+/*
+ * A synapse_pb_Frame holding one message of its oneof, encoded as the
+ * frame would be: the field key and length of the submessage, then the
+ * submessage encoded straight from the subscriber buffer with its own
+ * descriptor, so it is never copied into a frame union.
+ */
+struct frame_msg {
+	pb_size_t tag;
+	const pb_msgdesc_t *fields;
+	const void *msg;
+	// encoded submessage and frame sizes, filled by frame_size
+	size_t msg_size;
+	size_t frame_size;
+};
+
+static size_t varint_size(size_t value)
+{
+	size_t size = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		size++;
+	}
+	return size;
+}
+
+// size the frame, returns its delimited length
+static bool frame_size(struct frame_msg *frame, size_t *len)
+{
+	if (!pb_get_encoded_size(&frame->msg_size, frame->fields, frame->msg)) {
+		return false;
+	}
+	frame->frame_size = varint_size(((uint32_t)frame->tag << 3) | PB_WT_STRING) +
+			    varint_size(frame->msg_size) + frame->msg_size;
+	*len = varint_size(frame->frame_size) + frame->frame_size;
+	return true;
+}
+
+// write a sized frame, length delimited
+static bool frame_write(pb_ostream_t *stream, const struct frame_msg *frame)
+{
+	return pb_encode_varint(stream, frame->frame_size) &&
+	       pb_encode_tag(stream, PB_WT_STRING, frame->tag) &&
+	       pb_encode_varint(stream, frame->msg_size) &&
+	       pb_encode(stream, frame->fields, frame->msg);
+}
+
+static bool encode_frame(uint8_t *buf, size_t size, size_t *len, const struct frame_msg *frame)
+{
+	pb_ostream_t stream = pb_ostream_from_buffer(buf, size);
+	if (!frame_write(&stream, frame)) {
+		return false;
+	}
+	*len = stream.bytes_written;
+	return true;
+}
+
+// make room for len bytes in the pending datagram, a frame that does not fit starts the next one
+static bool reserve_frame(struct context *ctx, struct destination *dest, size_t len)
+{
+	if (dest->packet_len + len > PACKET_SIZE) {
+		flush_packet(ctx, dest);
+	}
+	if (dest->packet_len == 0) {
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+		int ret = pkt_tx_begin(&dest->pkt, PACKET_SIZE);
+		if (ret < 0) {
+			// out of network buffers, drop the frame and treat it as congestion
+			ctx->congested = ctx->congested || ret == -ENOMEM;
+			return false;
+		}
+#endif
+		dest->packet_deadline = k_uptime_ticks() + FLUSH_TICKS;
+	}
+	return true;
+}
+
+static void commit_frame(struct context *ctx, struct destination *dest, size_t len)
+{
+	dest->packet_len += len;
+	if (dest->packet_len == PACKET_SIZE) {
+		flush_packet(ctx, dest);
+	}
+}
+
+// append a frame encoded once for several destinations
+static void append_frame(struct context *ctx, struct destination *dest, const uint8_t *buf,
+			 size_t len)
+{
+	if (len > PACKET_SIZE) {
+		// larger than a packet on its own, send it alone
+		send_packet(ctx, dest, buf, len);
+		return;
+	}
+	if (!reserve_frame(ctx, dest, len)) {
+		return;
+	}
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+	if (pkt_tx_append(&dest->pkt, buf, len) < 0) {
+		pkt_tx_fini(&dest->pkt);
+		dest->packet_len = 0;
+		return;
+	}
+#else
+	memcpy(&dest->packet[dest->packet_len], buf, len);
+#endif
+	commit_frame(ctx, dest, len);
+}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+/*
+ * Encode the frame straight into the network buffers of the pending
+ * datagram, for a frame only one destination takes. The frame is sized
+ * first, which PB_ENCODE_DELIMITED would do anyway, so a frame that does
+ * not fit never leaves a partial write.
+ */
+static void encode_to(struct context *ctx, struct destination *dest, const struct frame_msg *frame,
+		      size_t len, uint8_t *tx_buf)
+{
+	if (len > PACKET_SIZE) {
+		// larger than a packet on its own, send it alone through the socket
+		if (!encode_frame(tx_buf, TX_BUF_SIZE, &len, frame)) {
+			LOG_ERR("encoding failed");
+		} else {
+			send_packet(ctx, dest, tx_buf, len);
+		}
+		return;
+	}
+	if (!reserve_frame(ctx, dest, len)) {
+		return;
+	}
+
+	pb_ostream_t stream = pkt_tx_stream(&dest->pkt, PACKET_SIZE - dest->packet_len);
+	if (!frame_write(&stream, frame)) {
+		// the datagram holds a partial frame, give it up
+		LOG_ERR("encoding failed");
+		pkt_tx_fini(&dest->pkt);
+		dest->packet_len = 0;
+		return;
+	}
+	commit_frame(ctx, dest, len);
+}
+#endif
+
+// send a frame to every destination taking one of streams
+static void send_frame_to(struct context *ctx, struct frame_msg *frame, uint32_t streams)
+{
+	static uint8_t tx_buf[TX_BUF_SIZE];
+	ctx->frames_sent++;
+
+	int first = -1;
+	int count = 0;
+	for (int i = 0; i < ctx->dest_count; i++) {
+		if (ctx->dest[i].streams & streams) {
+			first = first < 0 ? i : first;
+			count++;
+		}
+	}
+	if (count == 0) {
+		return;
+	}
+
+	// sized once, which PB_ENCODE_DELIMITED would do anyway
+	size_t len;
+	if (!frame_size(frame, &len)) {
+		LOG_ERR("encoding failed");
+		return;
+	}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+	if (count == 1) {
+		encode_to(ctx, &ctx->dest[first], frame, len, tx_buf);
+		return;
+	}
+#endif
+
+	// encode once and copy the bytes to each destination taking the stream
+	if (!encode_frame(tx_buf, sizeof(tx_buf), &len, frame)) {
+		LOG_ERR("encoding failed");
+		return;
+	}
+	for (int i = first; i < ctx->dest_count; i++) {
+		if (ctx->dest[i].streams & streams) {
+			append_frame(ctx, &ctx->dest[i], tx_buf, len);
+		}
+	}
+}
+
+// frame member and descriptor of a topic from the registry
+static struct frame_msg frame_msg_of(enum synapse_topic_id id, const void *msg)
+{
+	const struct synapse_topic_info *info = synapse_topic_info(id);
+	return (struct frame_msg){.tag = info->frame_tag, .fields = info->fields, .msg = msg};
+}
+
+#define FRAME_MSG(_topic, _msg) frame_msg_of(SYNAPSE_TOPIC_ID_##_topic, (_msg))
+
 static void send_frame(struct context *ctx, pb_size_t which_msg)
 {
-	synapse_pb_Frame *frame = &ctx->tx_frame;
-	frame->which_msg = which_msg;
+	struct frame_msg frame;
+
 	if (which_msg == synapse_pb_Frame_actuators_tag) {
-		frame->msg.actuators = ctx->actuators;
+		frame = FRAME_MSG(actuators, &ctx->actuators);
+		send_frame_to(ctx, &frame, BIT(STREAM(actuators)));
 	} else if (which_msg == synapse_pb_Frame_nav_sat_fix_tag) {
-		frame->msg.nav_sat_fix = ctx->nav_sat_fix;
+		frame = FRAME_MSG(nav_sat_fix, &ctx->nav_sat_fix);
+		send_frame_to(ctx, &frame, BIT(STREAM(nav_sat_fix)));
 	} else if (which_msg == synapse_pb_Frame_odometry_tag) {
-		frame->msg.odometry = ctx->odometry_estimator;
+		// encoded from the borrowed loan slot, never copied out of the topic
+		const synapse_pb_Odometry *odometry =
+			synapse_loan_borrow(&ctx->sub_odometry_estimator);
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+		if (ctx->compact_streams & BIT(STREAM(odometry))) {
+			send_compact_odometry(ctx, odometry);
+			synapse_loan_release(&ctx->sub_odometry_estimator);
+			return;
+		}
+#endif
+		frame = FRAME_MSG(odometry_estimator, odometry);
+		send_frame_to(ctx, &frame, BIT(STREAM(odometry)));
+		synapse_loan_release(&ctx->sub_odometry_estimator);
 	} else if (which_msg == synapse_pb_Frame_status_tag) {
-		frame->msg.status = ctx->status;
+		frame = FRAME_MSG(status, &ctx->status);
+		send_frame_to(ctx, &frame, BIT(STREAM(status)));
 	} else if (which_msg == synapse_pb_Frame_clock_offset_tag) {
-		int64_t ticks = k_uptime_ticks();
-		int64_t sec = ticks / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-		int32_t nanosec = (ticks - sec * CONFIG_SYS_CLOCK_TICKS_PER_SEC) * 1e9 /
-				  CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-		frame->msg.clock_offset.has_stamp = false;
-		frame->msg.clock_offset.has_offset = true;
-		frame->msg.clock_offset.offset.seconds = sec;
-		frame->msg.clock_offset.offset.nanos = nanosec;
+		int64_t uptime_ns = synapse_uptime_ns();
+		synapse_pb_ClockOffset clock_offset = {
+			.has_stamp = false,
+			.has_offset = true,
+			.offset = {.seconds = uptime_ns / NSEC_PER_SEC,
+				   .nanos = uptime_ns % NSEC_PER_SEC},
+		};
+		frame = FRAME_MSG(clock_offset_ethernet, &clock_offset);
+		send_frame_to(ctx, &frame, ALL_STREAMS);
 	}
-	static uint8_t tx_buf[TX_BUF_SIZE];
-	pb_ostream_t stream = pb_ostream_from_buffer(tx_buf, sizeof(tx_buf));
-	if (!pb_encode_ex(&stream, synapse_pb_Frame_fields, frame, PB_ENCODE_DELIMITED)) {
-		LOG_ERR("encoding failed: %s", PB_GET_ERROR(&stream));
-	} else {
-		udp_tx_send(&ctx->udp, tx_buf, stream.bytes_written);
+}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_TRACE)
+static void send_trace(struct context *ctx, bool names)
+{
+	static struct {
+		struct trace_header header;
+		struct trace_event event[TRACE_EVENTS_PER_PACKET];
+	} packet;
+	trace_header_init(&packet.header);
+	while (true) {
+		size_t n = names ? trace_name_events(packet.event, ARRAY_SIZE(packet.event))
+				 : trace_read(&ctx->trace_reader, packet.event,
+					      ARRAY_SIZE(packet.event));
+		if (n == 0) {
+			return;
+		}
+		udp_tx_send_port(&ctx->udp, CONFIG_CEREBRI_SYNAPSE_ETH_TX_TRACE_PORT,
+				 (const uint8_t *)&packet,
+				 sizeof(packet.header) + n * sizeof(packet.event[0]));
+		if (names || n < ARRAY_SIZE(packet.event)) {
+			return;
+		}
+	}
+}
+#endif
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_PROFILE)
+static void send_profile(struct context *ctx)
+{
+	static struct {
+		struct profile_header header;
+		struct profile_entry entry[PROFILE_ENTRIES_PER_PACKET];
+	} packet;
+	size_t pos = 0;
+
+	if (!profile_running()) {
+		return;
+	}
+	profile_header_init(&packet.header);
+	while (true) {
+		size_t n = profile_read(&pos, packet.entry, ARRAY_SIZE(packet.entry));
+		if (n == 0) {
+			return;
+		}
+		udp_tx_send_port(&ctx->udp, CONFIG_CEREBRI_SYNAPSE_ETH_TX_PROFILE_PORT,
+				 (const uint8_t *)&packet,
+				 sizeof(packet.header) + n * sizeof(packet.entry[0]));
+		packet.header.datagram++;
+	}
+}
+#endif
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_STATE_DUMP)
+static void send_state_dump(struct context *ctx)
+{
+	static uint32_t dump;
+	static uint8_t packet[DUMP_PACKET_SIZE] __aligned(4);
+	struct synapse_cache_dump_header *header = (struct synapse_cache_dump_header *)packet;
+	struct synapse_cache_dump_record record;
+
+	const struct synapse_cache_snapshot *snap = synapse_cache_snapshot_take(K_NO_WAIT);
+	if (snap == NULL) {
+		return;
+	}
+
+	*header = (struct synapse_cache_dump_header){
+		.magic = SYNAPSE_CACHE_DUMP_MAGIC, .dump = dump++, .atomic = snap->atomic};
+	size_t len = sizeof(*header);
+
+	for (int i = 0; i < SYNAPSE_CACHE_TOPIC_COUNT; i++) {
+		size_t size = 0;
+		const uint8_t *msg = synapse_cache_snapshot_msg(snap, i, &size);
+		size_t offset = 0;
+		while (msg != NULL && offset < size) {
+			if (len + sizeof(record) >= sizeof(packet)) {
+				udp_tx_send_port(&ctx->udp, DUMP_PORT, packet, len);
+				header->datagram++;
+				len = sizeof(*header);
+			}
+			size_t chunk = MIN(size - offset, sizeof(packet) - len - sizeof(record));
+			record = (struct synapse_cache_dump_record){
+				.topic = i,
+				.size = size,
+				.offset = offset,
+				.len = chunk,
+				.publishes = snap->meta[i].publishes,
+				.age_ms = k_ticks_to_ms_floor32(snap->ticks - snap->meta[i].ticks),
+			};
+			memcpy(&packet[len], &record, sizeof(record));
+			memcpy(&packet[len + sizeof(record)], msg + offset, chunk);
+			len += sizeof(record) + chunk;
+			offset += chunk;
+		}
+	}
+	synapse_cache_snapshot_release();
+
+	header->last = 1;
+	udp_tx_send_port(&ctx->udp, DUMP_PORT, packet, len);
+}
+#endif
+
+static int eth_tx_stream_hz(const struct context *ctx, int stream)
+{
+	if (!(ctx->streams & BIT(stream))) {
+		return 0;
+	}
+
+	int rate_hz = ctx->rates.rate_hz[stream];
+
+	if (rate_hz > 0 && (ctx->rates.adaptive_mask & BIT(stream))) {
+		rate_hz = MAX(rate_hz >> ctx->backoff, 1);
+	}
+	return rate_hz;
+}
+
+static int eth_tx_subscribe(struct context *ctx)
+{
+	int ret = 0;
+
+	for (int i = 0; i < SYNAPSE_TELEMETRY_STREAM_COUNT; i++) {
+		ctx->active_hz[i] = eth_tx_stream_hz(ctx, i);
+	}
+
+	if (ctx->active_hz[STREAM(actuators)] > 0) {
+		ret = zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators,
+				    &ctx->actuators, ctx->active_hz[STREAM(actuators)]);
+		if (ret < 0) {
+			LOG_ERR("init actuators failed: %d", ret);
+			ctx->active_hz[STREAM(actuators)] = 0;
+			return ret;
+		}
+	}
+	if (ctx->active_hz[STREAM(odometry)] > 0) {
+		synapse_loan_sub_init(&ctx->sub_odometry_estimator, &loan_odometry_estimator,
+				      ctx->active_hz[STREAM(odometry)]);
+	}
+	if (ctx->active_hz[STREAM(nav_sat_fix)] > 0) {
+		ret = zros_sub_init(&ctx->sub_nav_sat_fix, &ctx->node, &topic_nav_sat_fix,
+				    &ctx->nav_sat_fix, ctx->active_hz[STREAM(nav_sat_fix)]);
+		if (ret < 0) {
+			LOG_ERR("sub init nav_sat_fix failed: %d", ret);
+			ctx->active_hz[STREAM(nav_sat_fix)] = 0;
+			return ret;
+		}
+	}
+	if (ctx->active_hz[STREAM(status)] > 0) {
+		synapse_seqlock_sub_init(&ctx->sub_status, &seqlock_status,
+					 ctx->active_hz[STREAM(status)]);
+	}
+	return ret;
+}
+
+static void eth_tx_unsubscribe(struct context *ctx)
+{
+	if (ctx->active_hz[STREAM(actuators)] > 0) {
+		zros_sub_fini(&ctx->sub_actuators);
+	}
+	if (ctx->active_hz[STREAM(odometry)] > 0) {
+		synapse_loan_sub_fini(&ctx->sub_odometry_estimator);
+	}
+	if (ctx->active_hz[STREAM(nav_sat_fix)] > 0) {
+		zros_sub_fini(&ctx->sub_nav_sat_fix);
+	}
+	if (ctx->active_hz[STREAM(status)] > 0) {
+		synapse_seqlock_sub_fini(&ctx->sub_status);
+	}
+	memset(ctx->active_hz, 0, sizeof(ctx->active_hz));
+}
+
+/*
+ * Step the back off up while sends stall, at most every BACKOFF_STEP_TICKS,
+ * and back down after RECOVER_TICKS without a stall.
+ */
+static void eth_tx_adapt(struct context *ctx, int64_t now)
+{
+	int backoff = ctx->backoff;
+
+	if (ctx->congested) {
+		ctx->congested = false;
+		ctx->congested_ticks = now;
+		if (backoff < BACKOFF_MAX && now - ctx->backoff_ticks > BACKOFF_STEP_TICKS) {
+			backoff++;
+		}
+	} else if (backoff > 0 && now - ctx->congested_ticks > RECOVER_TICKS) {
+		ctx->congested_ticks = now;
+		backoff--;
+	}
+
+	if (backoff != ctx->backoff) {
+		LOG_INF("telemetry back off %d", backoff);
+		ctx->backoff = backoff;
+		ctx->backoff_ticks = now;
+		eth_tx_unsubscribe(ctx);
+		eth_tx_subscribe(ctx);
+	}
+}
+
+static int find_stream(const char *name)
+{
+	for (int i = 0; i < SYNAPSE_TELEMETRY_STREAM_COUNT; i++) {
+		if (strcmp(name, g_stream_names[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Parse CONFIG_CEREBRI_SYNAPSE_ETH_TX_DESTINATIONS, a comma separated list
+ * of addr[:stream+stream...], e.g. "239.0.0.42,192.0.2.10:odometry". An
+ * entry without streams takes all of them, an empty list sends everything
+ * to CONFIG_NET_CONFIG_PEER_IPV4_ADDR.
+ */
+static int eth_tx_parse_destinations(struct context *ctx)
+{
+	char list[MAX(sizeof(CONFIG_CEREBRI_SYNAPSE_ETH_TX_DESTINATIONS),
+		      sizeof(CONFIG_NET_CONFIG_PEER_IPV4_ADDR))];
+	char *save = NULL;
+
+	strcpy(list, CONFIG_CEREBRI_SYNAPSE_ETH_TX_DESTINATIONS);
+	if (list[0] == '\0') {
+		strcpy(list, CONFIG_NET_CONFIG_PEER_IPV4_ADDR);
+	}
+
+	ctx->dest_count = 0;
+	ctx->streams = 0;
+	for (char *entry = strtok_r(list, ",", &save); entry != NULL;
+	     entry = strtok_r(NULL, ",", &save)) {
+		if (ctx->dest_count == DEST_MAX) {
+			LOG_ERR("more than %d destinations", DEST_MAX);
+			return -E2BIG;
+		}
+		struct destination *dest = &ctx->dest[ctx->dest_count];
+		char *names = strchr(entry, ':');
+		if (names != NULL) {
+			*names++ = '\0';
+		}
+		if (net_addr_pton(AF_INET, entry, &dest->addr) < 0) {
+			LOG_ERR("bad destination address: %s", entry);
+			return -EINVAL;
+		}
+
+		dest->streams = names == NULL ? ALL_STREAMS : 0;
+		char *save_name = NULL;
+		for (char *name = names ? strtok_r(names, "+", &save_name) : NULL; name != NULL;
+		     name = strtok_r(NULL, "+", &save_name)) {
+			int stream = find_stream(name);
+			if (stream < 0) {
+				LOG_ERR("unknown stream: %s", name);
+				return -EINVAL;
+			}
+			dest->streams |= BIT(stream);
+		}
+		dest->packet_len = 0;
+		ctx->streams |= dest->streams;
+		ctx->dest_count++;
 	}
+	return 0;
 }
 
 static int eth_tx_init(struct context *ctx)
@@ -100,27 +806,27 @@ static int eth_tx_init(struct context *ctx)
 	// initialize node
 	zros_node_init(&ctx->node, "eth_tx");
 
-	// initialize node subscriptions
-	ret = zros_sub_init(&ctx->sub_actuators, &ctx->node, &topic_actuators, &ctx->actuators, 15);
+	ret = eth_tx_parse_destinations(ctx);
 	if (ret < 0) {
-		LOG_ERR("init actuators failed: %d", ret);
 		return ret;
 	}
-	ret = zros_sub_init(&ctx->sub_odometry_estimator, &ctx->node, &topic_odometry_estimator,
-			    &ctx->odometry_estimator, 15);
-	if (ret < 0) {
-		LOG_ERR("sub init estimator odometry failed: %d", ret);
-		return ret;
-	}
-	ret = zros_sub_init(&ctx->sub_nav_sat_fix, &ctx->node, &topic_nav_sat_fix,
-			    &ctx->nav_sat_fix, 15);
+
+	// initialize node subscriptions
+	ctx->backoff = 0;
+	ctx->congested = false;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+	// frames until the ground asks for compact
+	ctx->compact_streams = 0;
+	ctx->compact.len = 0;
+#endif
+	ret = eth_tx_subscribe(ctx);
 	if (ret < 0) {
-		LOG_ERR("sub init nav_sat_fix failed: %d", ret);
 		return ret;
 	}
-	ret = zros_sub_init(&ctx->sub_status, &ctx->node, &topic_status, &ctx->status, 15);
+	ret = zros_sub_init(&ctx->sub_telemetry_rates, &ctx->node, &topic_telemetry_rates,
+			    &ctx->rates_msg, 10);
 	if (ret < 0) {
-		LOG_ERR("sub init status failed: %d", ret);
+		LOG_ERR("sub init telemetry_rates failed: %d", ret);
 		return ret;
 	}
 
@@ -130,8 +836,22 @@ static int eth_tx_init(struct context *ctx)
 		LOG_ERR("udp init failed: %d", ret);
 		return ret;
 	}
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+	for (int i = 0; i < ctx->dest_count; i++) {
+		ret = pkt_tx_init(&ctx->dest[i].pkt, &ctx->dest[i].addr, UDP_TX_PORT);
+		if (ret < 0) {
+			LOG_ERR("pkt init failed: %d", ret);
+			return ret;
+		}
+	}
+#endif
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_TRACE)
+	trace_reader_init(&ctx->trace_reader);
+#endif
 
 	k_sem_take(&ctx->running, K_FOREVER);
+	boot_mark("eth_tx init");
 	LOG_INF("init");
 	return ret;
 };
@@ -139,13 +859,17 @@ static int eth_tx_init(struct context *ctx)
 static int eth_tx_fini(struct context *ctx)
 {
 	int ret = 0;
+	flush_due(ctx, INT64_MAX);
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+	for (int i = 0; i < ctx->dest_count; i++) {
+		pkt_tx_fini(&ctx->dest[i].pkt);
+	}
+#endif
 	ret = udp_tx_fini(&ctx->udp);
 
 	// close subscriptions
-	zros_sub_fini(&ctx->sub_actuators);
-	zros_sub_fini(&ctx->sub_odometry_estimator);
-	zros_sub_fini(&ctx->sub_nav_sat_fix);
-	zros_sub_fini(&ctx->sub_status);
+	eth_tx_unsubscribe(ctx);
+	zros_sub_fini(&ctx->sub_telemetry_rates);
 	zros_node_fini(&ctx->node);
 
 	k_sem_give(&ctx->running);
@@ -176,43 +900,95 @@ static void eth_tx_run(void *p0, void *p1, void *p2)
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 		int64_t now = k_uptime_ticks();
 
-		struct k_poll_event events[] = {
-			*zros_sub_get_event(&ctx->sub_actuators),
-			*zros_sub_get_event(&ctx->sub_status),
-			*zros_sub_get_event(&ctx->sub_odometry_estimator),
-			*zros_sub_get_event(&ctx->sub_nav_sat_fix),
-		};
+		// only streams that are on have a subscription to wait on
+		struct k_poll_event events[SYNAPSE_TELEMETRY_STREAM_COUNT + 1];
+		int event_count = 0;
+		events[event_count++] = *zros_sub_get_event(&ctx->sub_telemetry_rates);
+		if (ctx->active_hz[STREAM(actuators)] > 0) {
+			events[event_count++] = *zros_sub_get_event(&ctx->sub_actuators);
+		}
+		if (ctx->active_hz[STREAM(status)] > 0) {
+			events[event_count++] = *synapse_seqlock_sub_get_event(&ctx->sub_status);
+		}
+		if (ctx->active_hz[STREAM(odometry)] > 0) {
+			events[event_count++] =
+				*synapse_loan_sub_get_event(&ctx->sub_odometry_estimator);
+		}
+		if (ctx->active_hz[STREAM(nav_sat_fix)] > 0) {
+			events[event_count++] = *zros_sub_get_event(&ctx->sub_nav_sat_fix);
+		}
+
+		// wake up in time to send a pending packet
+		k_timeout_t timeout = K_MSEC(1000);
+		int64_t deadline = next_deadline(ctx);
+		if (deadline != INT64_MAX) {
+			timeout = K_TICKS(MAX(deadline - now, 0));
+		}
 
 		int rc = 0;
-		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(1000));
+		rc = k_poll(events, event_count, timeout);
 		if (rc != 0) {
 			LOG_DBG("poll timeout");
 		}
 
-		if (zros_sub_update_available(&ctx->sub_actuators)) {
+		if (zros_sub_update_available(&ctx->sub_telemetry_rates)) {
+			zros_sub_update(&ctx->sub_telemetry_rates);
+			if (ctx->rates_msg.magic == SYNAPSE_TELEMETRY_MAGIC) {
+				ctx->rates = ctx->rates_msg;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+				eth_tx_negotiate(ctx);
+#endif
+				eth_tx_unsubscribe(ctx);
+				eth_tx_subscribe(ctx);
+			}
+		}
+
+		if (ctx->active_hz[STREAM(actuators)] > 0 &&
+		    zros_sub_update_available(&ctx->sub_actuators)) {
 			zros_sub_update(&ctx->sub_actuators);
 			send_frame(ctx, synapse_pb_Frame_actuators_tag);
 		}
 
-		if (zros_sub_update_available(&ctx->sub_nav_sat_fix)) {
+		if (ctx->active_hz[STREAM(nav_sat_fix)] > 0 &&
+		    zros_sub_update_available(&ctx->sub_nav_sat_fix)) {
 			zros_sub_update(&ctx->sub_nav_sat_fix);
 			send_frame(ctx, synapse_pb_Frame_nav_sat_fix_tag);
 		}
 
-		if (zros_sub_update_available(&ctx->sub_status)) {
-			zros_sub_update(&ctx->sub_status);
+		if (ctx->active_hz[STREAM(status)] > 0 &&
+		    synapse_seqlock_sub_update_available(&ctx->sub_status) &&
+		    synapse_seqlock_sub_update(&ctx->sub_status, &ctx->status) == 0) {
 			send_frame(ctx, synapse_pb_Frame_status_tag);
 		}
 
-		if (zros_sub_update_available(&ctx->sub_odometry_estimator)) {
-			zros_sub_update(&ctx->sub_odometry_estimator);
+		if (ctx->active_hz[STREAM(odometry)] > 0 &&
+		    synapse_loan_sub_update_available(&ctx->sub_odometry_estimator)) {
 			send_frame(ctx, synapse_pb_Frame_odometry_tag);
 		}
 
 		if (now - ticks_last_uptime > CONFIG_SYS_CLOCK_TICKS_PER_SEC) {
 			send_frame(ctx, synapse_pb_Frame_clock_offset_tag);
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_TRACE)
+			send_trace(ctx, true);
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_PROFILE)
+			send_profile(ctx);
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_STATE_DUMP)
+			send_state_dump(ctx);
+#endif
 			ticks_last_uptime = now;
 		}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_TRACE)
+		send_trace(ctx, false);
+#endif
+
+		flush_due(ctx, k_uptime_ticks());
+
+		if (IS_ENABLED(CONFIG_CEREBRI_SYNAPSE_ETH_TX_ADAPTIVE)) {
+			eth_tx_adapt(ctx, k_uptime_ticks());
+		}
 	}
 
 	// deconstructor
@@ -250,12 +1026,100 @@ static int eth_tx_cmd_handler(const struct shell *sh, size_t argc, char **argv,
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		shell_print(sh, "frames: %u packets: %u stalls: %u back off: %d", ctx->frames_sent,
+			    ctx->packets_sent, ctx->send_stalls, ctx->backoff);
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+		shell_print(sh, "compact v%d packets: %u keyframes: %u deltas: %u",
+			    SYNAPSE_TELEMETRY_COMPACT_VERSION, ctx->compact.packets_sent,
+			    ctx->compact.odometry.keyframes, ctx->compact.odometry.deltas);
+#endif
+		for (int i = 0; i < ctx->dest_count; i++) {
+			char addr[NET_IPV4_ADDR_LEN];
+			net_addr_ntop(AF_INET, &ctx->dest[i].addr, addr, sizeof(addr));
+			shell_fprintf(sh, SHELL_NORMAL, "dest %-15s", addr);
+			for (int j = 0; j < SYNAPSE_TELEMETRY_STREAM_COUNT; j++) {
+				if (ctx->dest[i].streams & BIT(j)) {
+					shell_fprintf(sh, SHELL_NORMAL, " %s", g_stream_names[j]);
+				}
+			}
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_NET_PKT)
+			shell_fprintf(sh, SHELL_NORMAL, ", alloc failures: %u",
+				      ctx->dest[i].pkt.alloc_failures);
+#endif
+			shell_print(sh, "");
+		}
+		for (int i = 0; i < SYNAPSE_TELEMETRY_STREAM_COUNT; i++) {
+			bool compact = false;
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+			compact = ctx->compact_streams & BIT(i);
+#endif
+			shell_print(sh, "%-12s %4u Hz, sending %4u Hz%s%s", g_stream_names[i],
+				    ctx->rates.rate_hz[i], ctx->active_hz[i],
+				    (ctx->rates.adaptive_mask & BIT(i)) ? " adaptive" : "",
+				    compact ? " compact" : "");
+		}
 	}
 	return 0;
 }
 
-SHELL_SUBCMD_DICT_SET_CREATE(sub_eth_tx, eth_tx_cmd_handler, (start, &g_ctx, "start"),
-			     (stop, &g_ctx, "stop"), (status, &g_ctx, "status"));
+static int cmd_eth_tx(const struct shell *sh, size_t argc, char **argv)
+{
+	return eth_tx_cmd_handler(sh, argc, argv, &g_ctx);
+}
+
+// set a stream rate the same way the ground does, through topic_telemetry_rates
+static int cmd_eth_tx_rate(const struct shell *sh, size_t argc, char **argv)
+{
+	struct context *ctx = &g_ctx;
+	int stream = find_stream(argv[1]);
+	if (stream < 0) {
+		shell_print(sh, "unknown stream: %s", argv[1]);
+		return -EINVAL;
+	}
+
+	int hz = atoi(argv[2]);
+	if (hz < 0 || hz > SYNAPSE_TELEMETRY_RATE_MAX_HZ) {
+		shell_print(sh, "rate must be 0 to %d Hz", SYNAPSE_TELEMETRY_RATE_MAX_HZ);
+		return -EINVAL;
+	}
+
+	struct synapse_telemetry_rates rates = ctx->rates;
+	rates.rate_hz[stream] = hz;
+	if (argc > 3) {
+		WRITE_BIT(rates.adaptive_mask, stream, strcmp(argv[3], "adaptive") == 0);
+	}
+	zros_topic_publish(&topic_telemetry_rates, &rates);
+	return 0;
+}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT)
+// pick the encoding of a stream the same way the ground does
+static int cmd_eth_tx_compact(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	struct context *ctx = &g_ctx;
+	int stream = find_stream(argv[1]);
+	if (stream < 0 || !(SYNAPSE_TELEMETRY_COMPACT_STREAMS & BIT(stream))) {
+		shell_print(sh, "no compact encoding for: %s", argv[1]);
+		return -EINVAL;
+	}
+
+	struct synapse_telemetry_rates rates = ctx->rates;
+	rates.compact_version = SYNAPSE_TELEMETRY_COMPACT_VERSION;
+	WRITE_BIT(rates.compact_mask, stream, strcmp(argv[2], "on") == 0);
+	zros_topic_publish(&topic_telemetry_rates, &rates);
+	return 0;
+}
+#endif
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+	sub_eth_tx, SHELL_CMD(start, NULL, "start", cmd_eth_tx),
+	SHELL_CMD(stop, NULL, "stop", cmd_eth_tx), SHELL_CMD(status, NULL, "status", cmd_eth_tx),
+	SHELL_CMD_ARG(rate, NULL, "Set <stream> <hz> [adaptive|fixed], 0 turns it off.",
+		      cmd_eth_tx_rate, 3, 1),
+	SHELL_COND_CMD_ARG(CONFIG_CEREBRI_SYNAPSE_ETH_TX_COMPACT, compact, NULL,
+			   "Send <stream> compact, on|off.", cmd_eth_tx_compact, 3, 0),
+	SHELL_SUBCMD_SET_END);
 
 SHELL_CMD_REGISTER(eth_tx, &sub_eth_tx, "eth_tx commands", NULL);
 
@@ -0,0 +1,151 @@
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+#include <zephyr/net/net_core.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/net/net_pkt.h>
+
+#include "pkt_tx.h"
+
+LOG_MODULE_DECLARE(eth_tx);
+
+#define HEADER_SIZE (sizeof(struct net_ipv4_hdr) + sizeof(struct net_udp_hdr))
+
+int pkt_tx_init(struct pkt_tx *tx, const struct in_addr *dst, uint16_t port)
+{
+	tx->iface = net_if_get_default();
+	if (tx->iface == NULL) {
+		LOG_ERR("no network interface");
+		return -ENODEV;
+	}
+	tx->dst = *dst;
+	tx->port = port;
+	tx->ip_id = 0;
+	tx->pkt = NULL;
+	tx->len = 0;
+	tx->alloc_failures = 0;
+	return 0;
+}
+
+void pkt_tx_fini(struct pkt_tx *tx)
+{
+	if (tx->pkt != NULL) {
+		net_pkt_unref(tx->pkt);
+		tx->pkt = NULL;
+	}
+}
+
+int pkt_tx_begin(struct pkt_tx *tx, size_t size)
+{
+	// the interface address can change after init, pick it per datagram
+	const struct in_addr *src = net_if_ipv4_select_src_addr(tx->iface, &tx->dst);
+	if (src == NULL || net_ipv4_is_addr_unspecified(src)) {
+		return -ENETUNREACH;
+	}
+	tx->src = *src;
+
+	tx->pkt = net_pkt_alloc_with_buffer(tx->iface, size, AF_INET, IPPROTO_UDP, K_NO_WAIT);
+	if (tx->pkt == NULL) {
+		tx->alloc_failures++;
+		return -ENOMEM;
+	}
+
+	// headers are filled in by pkt_tx_send once the length is known
+	uint8_t header[HEADER_SIZE] = {};
+	if (net_pkt_write(tx->pkt, header, sizeof(header)) < 0) {
+		pkt_tx_fini(tx);
+		return -ENOMEM;
+	}
+	tx->len = 0;
+	return 0;
+}
+
+int pkt_tx_append(struct pkt_tx *tx, const uint8_t *buf, size_t len)
+{
+	int ret = net_pkt_write(tx->pkt, buf, len);
+	if (ret < 0) {
+		return ret;
+	}
+	tx->len += len;
+	return 0;
+}
+
+static bool pkt_tx_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+	return pkt_tx_append(stream->state, buf, count) == 0;
+}
+
+pb_ostream_t pkt_tx_stream(struct pkt_tx *tx, size_t max_size)
+{
+	pb_ostream_t stream = {
+		.callback = pkt_tx_write,
+		.state = tx,
+		.max_size = max_size,
+		.bytes_written = 0,
+	};
+	return stream;
+}
+
+static uint16_t ipv4_header_checksum(const struct net_ipv4_hdr *hdr)
+{
+	const uint8_t *p = (const uint8_t *)hdr;
+	uint32_t sum = 0;
+
+	for (size_t i = 0; i < sizeof(*hdr); i += 2) {
+		sum += (p[i] << 8) | p[i + 1];
+	}
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return htons(~sum & 0xffff);
+}
+
+int pkt_tx_send(struct pkt_tx *tx)
+{
+	struct net_pkt *pkt = tx->pkt;
+	uint16_t ip_id = htons(tx->ip_id++);
+
+	struct net_ipv4_hdr ip = {
+		.vhl = 0x45,
+		.tos = 0,
+		.len = htons(HEADER_SIZE + tx->len),
+		// don't fragment
+		.offset = {0x40, 0x00},
+		.ttl = net_ipv4_is_addr_mcast(&tx->dst) ? CONFIG_NET_INITIAL_MCAST_TTL
+							  : CONFIG_NET_INITIAL_TTL,
+		.proto = IPPROTO_UDP,
+		.chksum = 0,
+	};
+	memcpy(ip.id, &ip_id, sizeof(ip.id));
+	memcpy(ip.src, &tx->src, sizeof(ip.src));
+	memcpy(ip.dst, &tx->dst, sizeof(ip.dst));
+	ip.chksum = ipv4_header_checksum(&ip);
+
+	struct net_udp_hdr udp = {
+		.src_port = htons(tx->port),
+		.dst_port = htons(tx->port),
+		.len = htons(sizeof(udp) + tx->len),
+		.chksum = 0,
+	};
+
+	net_pkt_cursor_init(pkt);
+	net_pkt_set_overwrite(pkt, true);
+	if (net_pkt_write(pkt, &ip, sizeof(ip)) < 0 || net_pkt_write(pkt, &udp, sizeof(udp)) < 0) {
+		pkt_tx_fini(tx);
+		return -EIO;
+	}
+	net_pkt_set_overwrite(pkt, false);
+	net_pkt_cursor_init(pkt);
+	net_pkt_set_ip_hdr_len(pkt, sizeof(ip));
+
+	tx->pkt = NULL;
+	int ret = net_send_data(pkt);
+	if (ret < 0) {
+		net_pkt_unref(pkt);
+	}
+	return ret;
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,46 @@
+#ifndef SYNAPSE_UDP_PKT_TX_H_
+#define SYNAPSE_UDP_PKT_TX_H_
+
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/net/net_pkt.h>
+
+#include <pb_encode.h>
+
+/*
+ * Udp datagrams built directly in a net_pkt and handed to the interface
+ * with net_send_data, bypassing the socket layer. nanopb encodes into the
+ * packet buffers through pkt_tx_stream, so the payload is written once.
+ * The ip and udp headers are written here, the udp checksum is left 0 as
+ * ipv4 allows, and datagrams are never fragmented.
+ */
+
+struct pkt_tx {
+	struct net_if *iface;
+	struct in_addr src;
+	struct in_addr dst;
+	uint16_t port;
+	uint16_t ip_id;
+	// datagram being built, NULL between pkt_tx_send calls
+	struct net_pkt *pkt;
+	size_t len;
+	uint32_t alloc_failures;
+};
+
+int pkt_tx_init(struct pkt_tx *tx, const struct in_addr *dst, uint16_t port);
+void pkt_tx_fini(struct pkt_tx *tx);
+
+// start a datagram with room for size payload bytes, without blocking
+int pkt_tx_begin(struct pkt_tx *tx, size_t size);
+
+// stream appending to the started datagram, bounded by the room left in it
+pb_ostream_t pkt_tx_stream(struct pkt_tx *tx, size_t max_size);
+
+// append bytes encoded elsewhere to the started datagram
+int pkt_tx_append(struct pkt_tx *tx, const uint8_t *buf, size_t len);
+
+// write the headers and send, the packet belongs to the stack afterwards
+int pkt_tx_send(struct pkt_tx *tx);
+
+#endif // SYNAPSE_UDP_PKT_TX_H_
+// vi: ts=4 sw=4 et
@@ -7,14 +7,12 @@
 
 LOG_MODULE_DECLARE(eth_tx);
 
-#define MY_PORT 4242
-
 int udp_tx_init(struct udp_tx *ctx)
 {
 	ctx->sock = -1;
 	ctx->addr.sin_addr.s_addr = INADDR_ANY;
 	ctx->addr.sin_family = AF_INET;
-	ctx->addr.sin_port = htons(MY_PORT);
+	ctx->addr.sin_port = htons(UDP_TX_PORT);
 
 	ctx->sock =
 		zsock_socket(((struct sockaddr *)&ctx->addr)->sa_family, SOCK_DGRAM, IPPROTO_UDP);
@@ -37,11 +35,22 @@ int udp_tx_fini(struct udp_tx *ctx)
 
 int udp_tx_send(struct udp_tx *ctx, const uint8_t *buf, size_t len)
 {
-	int ret = 0;
-	uint32_t addr;
+	return udp_tx_send_port(ctx, UDP_TX_PORT, buf, len);
+}
+
+int udp_tx_send_port(struct udp_tx *ctx, uint16_t port, const uint8_t *buf, size_t len)
+{
+	struct in_addr addr;
 	zsock_inet_pton(AF_INET, CONFIG_NET_CONFIG_PEER_IPV4_ADDR, &addr);
+	return udp_tx_send_to(ctx, &addr, port, buf, len);
+}
+
+int udp_tx_send_to(struct udp_tx *ctx, const struct in_addr *dst, uint16_t port, const uint8_t *buf,
+		   size_t len)
+{
+	int ret = 0;
 	struct sockaddr_in dest_addr = {
-		.sin_addr.s_addr = addr, .sin_family = AF_INET, .sin_port = htons(MY_PORT)};
+		.sin_addr = *dst, .sin_family = AF_INET, .sin_port = htons(port)};
 
 	ret = zsock_sendto(ctx->sock, buf, len, ZSOCK_MSG_DONTWAIT, (struct sockaddr *)&dest_addr,
 			   sizeof(dest_addr));
@@ -49,12 +58,9 @@ int udp_tx_send(struct udp_tx *ctx, const uint8_t *buf, size_t len)
 	if (ret == 0) {
 		return -EIO;
 	} else if (ret < 0) {
-		if (errno == EAGAIN) {
-			LOG_INF("timeout");
-			ret = 0;
-		} else if (errno == EWOULDBLOCK) {
-			LOG_INF("would block");
-			ret = 0;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			LOG_DBG("would block");
+			ret = -EAGAIN;
 		} else {
 			LOG_DBG("send error: %d", -errno);
 			ret = -errno;
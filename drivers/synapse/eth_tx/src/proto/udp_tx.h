@@ -3,6 +3,8 @@
 
 #include <zephyr/net/socket.h>
 
+#define UDP_TX_PORT 4242
+
 struct udp_tx {
 	int sock;
 	struct sockaddr_in addr;
@@ -11,6 +13,9 @@ struct udp_tx {
 int udp_tx_init(struct udp_tx *ctx);
 int udp_tx_fini(struct udp_tx *ctx);
 int udp_tx_send(struct udp_tx *ctx, const uint8_t *buf, size_t len);
+int udp_tx_send_port(struct udp_tx *ctx, uint16_t port, const uint8_t *buf, size_t len);
+int udp_tx_send_to(struct udp_tx *ctx, const struct in_addr *dst, uint16_t port, const uint8_t *buf,
+		   size_t len);
 
 #endif // SYNAPSE_UDP_UDP_TX_H_
 // vi: ts=4 sw=4 et
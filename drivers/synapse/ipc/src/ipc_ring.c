@@ -0,0 +1,116 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/sys/barrier.h>
+#include <zephyr/sys/util.h>
+
+#include "ipc_ring.h"
+
+struct ipc_record {
+	uint16_t topic;
+	uint16_t len;
+};
+
+// the other core changes these behind our back
+static uint32_t load(const uint32_t *p)
+{
+	return *(const volatile uint32_t *)p;
+}
+
+static void store(uint32_t *p, uint32_t v)
+{
+	*(volatile uint32_t *)p = v;
+}
+
+static void copy_in(struct ipc_ring *ring, uint32_t pos, const void *src, size_t len)
+{
+	uint32_t offset = pos & (ring->size - 1);
+	size_t first = MIN(len, ring->size - offset);
+	memcpy(&ring->data[offset], src, first);
+	memcpy(&ring->data[0], (const uint8_t *)src + first, len - first);
+}
+
+static void copy_out(const struct ipc_ring *ring, uint32_t pos, void *dst, size_t len)
+{
+	uint32_t offset = pos & (ring->size - 1);
+	size_t first = MIN(len, ring->size - offset);
+	memcpy(dst, &ring->data[offset], first);
+	memcpy((uint8_t *)dst + first, &ring->data[0], len - first);
+}
+
+void ipc_ring_init(struct ipc_ring *ring, size_t region_size)
+{
+	// largest power of two that fits, so positions can run free and wrap
+	size_t size = region_size - sizeof(*ring);
+	while (size & (size - 1)) {
+		size &= size - 1;
+	}
+
+	store(&ring->magic, 0);
+	barrier_dmem_fence_full();
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dropped = 0;
+	barrier_dmem_fence_full();
+	store(&ring->magic, IPC_RING_MAGIC);
+}
+
+bool ipc_ring_ready(const struct ipc_ring *ring)
+{
+	return load(&ring->magic) == IPC_RING_MAGIC;
+}
+
+int ipc_ring_write(struct ipc_ring *ring, uint16_t topic, const void *msg, uint16_t len)
+{
+	uint32_t need = ROUND_UP(sizeof(struct ipc_record) + len, 4);
+	uint32_t head = ring->head;
+	uint32_t tail = load(&ring->tail);
+
+	if (need > ring->size - (head - tail)) {
+		ring->dropped++;
+		return -ENOSPC;
+	}
+
+	struct ipc_record record = {.topic = topic, .len = len};
+	copy_in(ring, head, &record, sizeof(record));
+	copy_in(ring, head + sizeof(record), msg, len);
+
+	// data must be visible before the consumer sees the new head
+	barrier_dmem_fence_full();
+	store(&ring->head, head + need);
+	return 0;
+}
+
+int ipc_ring_read(struct ipc_ring *ring, uint16_t *topic, void *msg, size_t max_len)
+{
+	uint32_t tail = ring->tail;
+	uint32_t head = load(&ring->head);
+
+	if (head == tail) {
+		return -EAGAIN;
+	}
+	barrier_dmem_fence_full();
+
+	struct ipc_record record;
+	copy_out(ring, tail, &record, sizeof(record));
+	*topic = record.topic;
+
+	int ret = record.len;
+	if (record.len > max_len) {
+		ret = -EMSGSIZE;
+	} else {
+		copy_out(ring, tail + sizeof(record), msg, record.len);
+	}
+
+	// done reading before the producer may reuse the space
+	barrier_dmem_fence_full();
+	store(&ring->tail, tail + ROUND_UP(sizeof(record) + record.len, 4));
+	return ret;
+}
+
+// vi: ts=4 sw=4 et
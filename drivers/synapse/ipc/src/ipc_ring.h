@@ -0,0 +1,44 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SYNAPSE_IPC_RING_H
+#define CEREBRI_SYNAPSE_IPC_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Single producer single consumer ring in memory shared by two cores.
+ * head is only written by the producer and tail only by the consumer, so
+ * no lock is needed across cores. Records are a topic id and length
+ * followed by the raw message, padded to 4 bytes.
+ */
+
+#define IPC_RING_MAGIC 0x43495043 // CIPC
+
+struct ipc_ring {
+	uint32_t magic;
+	uint32_t size;
+	uint32_t head;
+	uint32_t tail;
+	uint32_t dropped;
+	uint32_t reserved[3];
+	uint8_t data[];
+};
+
+// called by the primary core on both rings before the secondary uses them
+void ipc_ring_init(struct ipc_ring *ring, size_t region_size);
+
+bool ipc_ring_ready(const struct ipc_ring *ring);
+
+// returns -ENOSPC and counts a drop when the consumer is behind
+int ipc_ring_write(struct ipc_ring *ring, uint16_t topic, const void *msg, uint16_t len);
+
+// returns the message length, -EAGAIN when empty, -EMSGSIZE when skipped as too large
+int ipc_ring_read(struct ipc_ring *ring, uint16_t *topic, void *msg, size_t max_len);
+
+#endif // CEREBRI_SYNAPSE_IPC_RING_H
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,51 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SYNAPSE_IPC_TOPICS_H
+#define CEREBRI_SYNAPSE_IPC_TOPICS_H
+
+#include <synapse_topic_list.h>
+
+#define IPC_PRIMARY   0
+#define IPC_SECONDARY 1
+
+/*
+ * Mirrored topics as X(topic, message type, sending core). Both images
+ * are built from this list, the position in it is the topic id on the
+ * wire, so append only. The primary sends what log_sdcard and eth_tx
+ * consume, the secondary sends what eth_rx publishes.
+ */
+#define SYNAPSE_IPC_TOPICS(X)                                                                      \
+	X(accel_sp, synapse_pb_Vector3, IPC_PRIMARY)                                               \
+	X(actuators, synapse_pb_Actuators, IPC_PRIMARY)                                            \
+	X(altimeter, synapse_pb_Altimeter, IPC_PRIMARY)                                            \
+	X(angular_velocity_sp, synapse_pb_Vector3, IPC_PRIMARY)                                    \
+	X(attitude_sp, synapse_pb_Quaternion, IPC_PRIMARY)                                         \
+	X(battery_state, synapse_pb_BatteryState, IPC_PRIMARY)                                     \
+	X(bezier_trajectory, synapse_pb_BezierTrajectory, IPC_PRIMARY)                             \
+	X(cmd_vel, synapse_pb_Twist, IPC_PRIMARY)                                                  \
+	X(imu, synapse_pb_Imu, IPC_PRIMARY)                                                        \
+	X(input, synapse_pb_Input, IPC_PRIMARY)                                                    \
+	X(input_sbus, synapse_pb_Input, IPC_PRIMARY)                                               \
+	X(led_array, synapse_pb_LEDArray, IPC_PRIMARY)                                             \
+	X(magnetic_field, synapse_pb_MagneticField, IPC_PRIMARY)                                   \
+	X(moment_ff, synapse_pb_Vector3, IPC_PRIMARY)                                              \
+	X(nav_sat_fix, synapse_pb_NavSatFix, IPC_PRIMARY)                                          \
+	X(odometry_estimator, synapse_pb_Odometry, IPC_PRIMARY)                                    \
+	X(orientation_sp, synapse_pb_Quaternion, IPC_PRIMARY)                                      \
+	X(position_sp, synapse_pb_Vector3, IPC_PRIMARY)                                            \
+	X(pwm, synapse_pb_Pwm, IPC_PRIMARY)                                                        \
+	X(safety, synapse_pb_Safety, IPC_PRIMARY)                                                  \
+	X(status, synapse_pb_Status, IPC_PRIMARY)                                                  \
+	X(velocity_sp, synapse_pb_Vector3, IPC_PRIMARY)                                            \
+	X(wheel_odometry, synapse_pb_WheelOdometry, IPC_PRIMARY)                                   \
+	X(bezier_trajectory_ethernet, synapse_pb_BezierTrajectory, IPC_SECONDARY)                  \
+	X(clock_offset_ethernet, synapse_pb_ClockOffset, IPC_SECONDARY)                            \
+	X(cmd_vel_ethernet, synapse_pb_Twist, IPC_SECONDARY)                                       \
+	X(input_ethernet, synapse_pb_Input, IPC_SECONDARY)                                         \
+	X(odometry_ethernet, synapse_pb_Odometry, IPC_SECONDARY)
+
+#endif // CEREBRI_SYNAPSE_IPC_TOPICS_H
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,310 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/mbox.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_sub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_sub.h>
+#include <zros/zros_topic.h>
+
+#include "ipc_ring.h"
+#include "ipc_topics.h"
+
+LOG_MODULE_REGISTER(synapse_ipc, CONFIG_CEREBRI_SYNAPSE_IPC_LOG_LEVEL);
+
+#define MY_STACK_SIZE 4096
+#define MY_PRIORITY   6
+
+#define TOPIC_RATE_HZ 100
+
+#define IPC_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(cerebri_ipc)
+#define SHM_NODE DT_PHANDLE(IPC_NODE, memory_region)
+#define SHM_ADDR DT_REG_ADDR(SHM_NODE)
+#define SHM_SIZE DT_REG_SIZE(SHM_NODE)
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_IPC_PRIMARY)
+#define IPC_SELF IPC_PRIMARY
+#else
+#define IPC_SELF IPC_SECONDARY
+#endif
+
+// the primary writes the first half of the shared region, the secondary the second
+#define RING_PRIMARY   ((struct ipc_ring *)SHM_ADDR)
+#define RING_SECONDARY ((struct ipc_ring *)(SHM_ADDR + SHM_SIZE / 2))
+
+enum ipc_topic_id {
+#define IPC_TOPIC_ID(name, type, from) IPC_TOPIC_##name,
+	SYNAPSE_IPC_TOPICS(IPC_TOPIC_ID)
+#undef IPC_TOPIC_ID
+	IPC_TOPIC_COUNT,
+};
+
+// ring records carry a 16 bit length
+#define IPC_TOPIC_SIZE_CHECK(name, type, from)                                                     \
+	BUILD_ASSERT(sizeof(type) <= UINT16_MAX, #name " too large for ipc");
+SYNAPSE_IPC_TOPICS(IPC_TOPIC_SIZE_CHECK)
+#undef IPC_TOPIC_SIZE_CHECK
+
+struct ipc_topic {
+	struct zros_topic *topic;
+	size_t size;
+	uint8_t sender;
+};
+
+static const struct ipc_topic g_topics[IPC_TOPIC_COUNT] = {
+#define IPC_TOPIC_ENTRY(name, type, from)                                                          \
+	[IPC_TOPIC_##name] = {.topic = &topic_##name, .size = sizeof(type), .sender = from},
+	SYNAPSE_IPC_TOPICS(IPC_TOPIC_ENTRY)
+#undef IPC_TOPIC_ENTRY
+};
+
+union ipc_msg {
+#define IPC_TOPIC_UNION(name, type, from) type name;
+	SYNAPSE_IPC_TOPICS(IPC_TOPIC_UNION)
+#undef IPC_TOPIC_UNION
+};
+
+static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+
+struct context {
+	struct zros_node node;
+	// subscriptions of the topics this core sends
+#define IPC_TOPIC_FIELDS(name, type, from)                                                         \
+	struct zros_sub sub_##name;                                                                \
+	type msg_##name;
+	SYNAPSE_IPC_TOPICS(IPC_TOPIC_FIELDS)
+#undef IPC_TOPIC_FIELDS
+	// received message before it is published
+	union ipc_msg rx_msg;
+	struct ipc_ring *tx;
+	struct ipc_ring *rx;
+	struct mbox_dt_spec tx_mbox;
+	struct mbox_dt_spec rx_mbox;
+	struct k_sem doorbell;
+	uint32_t sent;
+	uint32_t received;
+	uint32_t rx_errors;
+	struct k_sem running;
+	size_t stack_size;
+	k_thread_stack_t *stack_area;
+	struct k_thread thread_data;
+};
+
+static struct context g_ctx = {
+	.node = {},
+	.tx = NULL,
+	.rx = NULL,
+	.tx_mbox = MBOX_DT_SPEC_GET(IPC_NODE, tx),
+	.rx_mbox = MBOX_DT_SPEC_GET(IPC_NODE, rx),
+	.doorbell = Z_SEM_INITIALIZER(g_ctx.doorbell, 0, 1),
+	.sent = 0,
+	.received = 0,
+	.rx_errors = 0,
+	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
+	.stack_size = MY_STACK_SIZE,
+	.stack_area = g_my_stack_area,
+	.thread_data = {},
+};
+
+static void doorbell_callback(const struct device *dev, mbox_channel_id_t channel_id,
+			      void *user_data, struct mbox_msg *data)
+{
+	struct context *ctx = user_data;
+	ARG_UNUSED(dev);
+	ARG_UNUSED(channel_id);
+	ARG_UNUSED(data);
+	k_sem_give(&ctx->doorbell);
+}
+
+static int synapse_ipc_init(struct context *ctx)
+{
+	int ret = 0;
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_IPC_PRIMARY)
+	// once per boot, a restart of this node must not pull the rings from under the secondary
+	if (ctx->tx == NULL) {
+		ipc_ring_init(RING_PRIMARY, SHM_SIZE / 2);
+		ipc_ring_init(RING_SECONDARY, SHM_SIZE / 2);
+	}
+	ctx->tx = RING_PRIMARY;
+	ctx->rx = RING_SECONDARY;
+#else
+	// rings are set up by the primary core
+	while (!ipc_ring_ready(RING_PRIMARY) || !ipc_ring_ready(RING_SECONDARY)) {
+		k_msleep(10);
+	}
+	ctx->tx = RING_SECONDARY;
+	ctx->rx = RING_PRIMARY;
+#endif
+
+	ret = mbox_register_callback_dt(&ctx->rx_mbox, doorbell_callback, ctx);
+	if (ret < 0) {
+		LOG_ERR("mbox callback failed: %d", ret);
+		return ret;
+	}
+	ret = mbox_set_enabled_dt(&ctx->rx_mbox, true);
+	if (ret < 0) {
+		LOG_ERR("mbox enable failed: %d", ret);
+		return ret;
+	}
+
+	zros_node_init(&ctx->node, "synapse_ipc");
+
+#define IPC_TOPIC_SUB_INIT(name, type, from)                                                       \
+	if (from == IPC_SELF) {                                                                    \
+		ret = zros_sub_init(&ctx->sub_##name, &ctx->node, &topic_##name,                   \
+				    &ctx->msg_##name, TOPIC_RATE_HZ);                              \
+		if (ret < 0) {                                                                     \
+			LOG_ERR("init " #name " failed: %d", ret);                                 \
+			return ret;                                                                \
+		}                                                                                  \
+	}
+	SYNAPSE_IPC_TOPICS(IPC_TOPIC_SUB_INIT)
+#undef IPC_TOPIC_SUB_INIT
+
+	k_sem_take(&ctx->running, K_FOREVER);
+	LOG_INF("init, %u byte rings", ctx->tx->size);
+	return ret;
+}
+
+static void synapse_ipc_fini(struct context *ctx)
+{
+	mbox_set_enabled_dt(&ctx->rx_mbox, false);
+
+#define IPC_TOPIC_SUB_FINI(name, type, from)                                                       \
+	if (from == IPC_SELF) {                                                                    \
+		zros_sub_fini(&ctx->sub_##name);                                                   \
+	}
+	SYNAPSE_IPC_TOPICS(IPC_TOPIC_SUB_FINI)
+#undef IPC_TOPIC_SUB_FINI
+
+	zros_node_fini(&ctx->node);
+	k_sem_give(&ctx->running);
+	LOG_INF("fini");
+}
+
+static int synapse_ipc_send(struct context *ctx)
+{
+	int count = 0;
+
+#define IPC_TOPIC_SEND(name, type, from)                                                           \
+	if (from == IPC_SELF && zros_sub_update_available(&ctx->sub_##name)) {                     \
+		zros_sub_update(&ctx->sub_##name);                                                 \
+		if (ipc_ring_write(ctx->tx, IPC_TOPIC_##name, &ctx->msg_##name,                    \
+				   sizeof(type)) == 0) {                                           \
+			count++;                                                                   \
+		}                                                                                  \
+	}
+	SYNAPSE_IPC_TOPICS(IPC_TOPIC_SEND)
+#undef IPC_TOPIC_SEND
+
+	ctx->sent += count;
+	return count;
+}
+
+static void synapse_ipc_receive(struct context *ctx)
+{
+	while (true) {
+		uint16_t id = 0;
+		int ret = ipc_ring_read(ctx->rx, &id, &ctx->rx_msg, sizeof(ctx->rx_msg));
+		if (ret == -EAGAIN) {
+			return;
+		}
+
+		// a size mismatch means the two images were built from different lists
+		if (ret < 0 || id >= IPC_TOPIC_COUNT || g_topics[id].sender == IPC_SELF ||
+		    (size_t)ret != g_topics[id].size) {
+			ctx->rx_errors++;
+			continue;
+		}
+
+		synapse_topic_republish(g_topics[id].topic, &ctx->rx_msg);
+		ctx->received++;
+	}
+}
+
+static void synapse_ipc_run(void *p0, void *p1, void *p2)
+{
+	struct context *ctx = p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	int ret = synapse_ipc_init(ctx);
+	if (ret < 0) {
+		LOG_ERR("init failed: %d", ret);
+		return;
+	}
+
+	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
+		// woken early by the other core, otherwise send at the configured period
+		k_sem_take(&ctx->doorbell, K_MSEC(CONFIG_CEREBRI_SYNAPSE_IPC_PERIOD_MS));
+
+		synapse_ipc_receive(ctx);
+
+		if (synapse_ipc_send(ctx) > 0) {
+			mbox_send_dt(&ctx->tx_mbox, NULL);
+		}
+	}
+
+	synapse_ipc_fini(ctx);
+}
+
+static int start(struct context *ctx)
+{
+	k_tid_t tid = k_thread_create(&ctx->thread_data, ctx->stack_area, ctx->stack_size,
+				      synapse_ipc_run, ctx, NULL, NULL, MY_PRIORITY, 0, K_FOREVER);
+	k_thread_name_set(tid, "synapse_ipc");
+	k_thread_start(tid);
+	return 0;
+}
+
+static int synapse_ipc_cmd_handler(const struct shell *sh, size_t argc, char **argv, void *data)
+{
+	ARG_UNUSED(argc);
+	struct context *ctx = data;
+
+	if (strcmp(argv[0], "start") == 0) {
+		if (k_sem_count_get(&g_ctx.running) == 0) {
+			shell_print(sh, "already running");
+		} else {
+			start(ctx);
+		}
+	} else if (strcmp(argv[0], "stop") == 0) {
+		if (k_sem_count_get(&g_ctx.running) == 0) {
+			k_sem_give(&g_ctx.running);
+		} else {
+			shell_print(sh, "not running");
+		}
+	} else if (strcmp(argv[0], "status") == 0) {
+		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		if (ctx->tx != NULL) {
+			shell_print(sh, "sent: %u dropped: %u received: %u rx errors: %u",
+				    ctx->sent, ctx->tx->dropped, ctx->received, ctx->rx_errors);
+		}
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_DICT_SET_CREATE(sub_synapse_ipc, synapse_ipc_cmd_handler, (start, &g_ctx, "start"),
+			     (stop, &g_ctx, "stop"), (status, &g_ctx, "status"));
+
+SHELL_CMD_REGISTER(synapse_ipc, &sub_synapse_ipc, "synapse inter-core topic mirror", NULL);
+
+static int synapse_ipc_sys_init(void)
+{
+	return start(&g_ctx);
+};
+
+SYS_INIT(synapse_ipc_sys_init, APPLICATION, 2);
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,143 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/disk_access.h>
+#include <zephyr/sys/util.h>
+
+#include "block_log.h"
+
+#define DISK_PDRV    "SD"
+#define REGION_START CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW_START_SECTOR
+#define REGION_SIZE  CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW_SECTORS
+#define SECTOR_SIZE  BLOCK_LOG_SECTOR_SIZE
+// a new session gets at least this much room before the region starts over
+#define MIN_SESSION  2048
+
+LOG_MODULE_DECLARE(log_sdcard, LOG_LEVEL_DBG);
+
+int block_log_load(struct block_log *log)
+{
+	// sector 0 is the partition table, so it never is a log region
+	if (REGION_START == 0 || REGION_SIZE < 2) {
+		LOG_ERR("raw log region not configured");
+		return -EINVAL;
+	}
+
+	if (disk_access_init(DISK_PDRV) != 0) {
+		LOG_ERR("Storage init ERROR!");
+		return -EIO;
+	}
+
+	uint32_t block_count;
+	if (disk_access_ioctl(DISK_PDRV, DISK_IOCTL_GET_SECTOR_COUNT, &block_count) != 0 ||
+	    REGION_START + REGION_SIZE > block_count) {
+		LOG_ERR("raw log region past the end of the card");
+		return -EINVAL;
+	}
+
+	if (disk_access_read(DISK_PDRV, log->sector, REGION_START, 1) != 0) {
+		return -EIO;
+	}
+
+	struct block_log_super *super = &log->super;
+	if (super->magic != BLOCK_LOG_MAGIC || super->version != BLOCK_LOG_VERSION ||
+	    super->session_count > BLOCK_LOG_MAX_SESSIONS) {
+		memset(log->sector, 0, sizeof(log->sector));
+		super->magic = BLOCK_LOG_MAGIC;
+		super->version = BLOCK_LOG_VERSION;
+	}
+	log->session = NULL;
+	return 0;
+}
+
+int block_log_open(struct block_log *log)
+{
+	int ret = block_log_load(log);
+	if (ret < 0) {
+		return ret;
+	}
+
+	struct block_log_super *super = &log->super;
+	uint32_t start = 1;
+	if (super->session_count > 0) {
+		struct block_log_session *last = &super->session[super->session_count - 1];
+		start = last->start_sector + DIV_ROUND_UP(last->size, SECTOR_SIZE);
+	}
+	if (super->session_count == BLOCK_LOG_MAX_SESSIONS || start + MIN_SESSION > REGION_SIZE) {
+		LOG_WRN("raw log region full, overwriting old sessions");
+		super->session_count = 0;
+		start = 1;
+	}
+
+	log->session = &super->session[super->session_count++];
+	log->session->start_sector = start;
+	log->session->size = 0;
+	log->next_sector = start;
+	LOG_INF("raw log session %d at sector %u", super->session_count - 1, start);
+	return block_log_sync(log);
+}
+
+ssize_t block_log_write(struct block_log *log, uint8_t *buf, size_t size)
+{
+	if (log->session == NULL || log->session->size % SECTOR_SIZE != 0) {
+		return -EINVAL;
+	}
+
+	uint32_t count = DIV_ROUND_UP(size, SECTOR_SIZE);
+	if (log->next_sector + count > REGION_SIZE) {
+		return -ENOSPC;
+	}
+	memset(buf + size, 0, count * SECTOR_SIZE - size);
+
+	if (disk_access_write(DISK_PDRV, buf, REGION_START + log->next_sector, count) != 0) {
+		return -EIO;
+	}
+	log->next_sector += count;
+	log->session->size += size;
+	return size;
+}
+
+int block_log_sync(struct block_log *log)
+{
+	if (disk_access_write(DISK_PDRV, log->sector, REGION_START, 1) != 0) {
+		return -EIO;
+	}
+	return 0;
+}
+
+int block_log_close(struct block_log *log)
+{
+	int ret = block_log_sync(log);
+
+	disk_access_ioctl(DISK_PDRV, DISK_IOCTL_CTRL_SYNC, NULL);
+	log->session = NULL;
+	return ret;
+}
+
+ssize_t block_log_read(struct block_log *log, int session, uint32_t offset, uint8_t *buf,
+		       size_t size)
+{
+	struct block_log_super *super = &log->super;
+	if (session < 0 || session >= super->session_count || offset % SECTOR_SIZE != 0 ||
+	    size < SECTOR_SIZE) {
+		return -EINVAL;
+	}
+
+	struct block_log_session *s = &super->session[session];
+	if (offset >= s->size) {
+		return 0;
+	}
+	uint32_t n = MIN(s->size - offset, ROUND_DOWN(size, SECTOR_SIZE));
+	uint32_t sector = REGION_START + s->start_sector + offset / SECTOR_SIZE;
+	if (disk_access_read(DISK_PDRV, buf, sector, DIV_ROUND_UP(n, SECTOR_SIZE)) != 0) {
+		return -EIO;
+	}
+	return n;
+}
+
+// vi: ts=4 sw=4 et
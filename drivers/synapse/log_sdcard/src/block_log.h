@@ -0,0 +1,75 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SYNAPSE_LOG_SDCARD_BLOCK_LOG_H
+#define CEREBRI_SYNAPSE_LOG_SDCARD_BLOCK_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <zephyr/toolchain.h>
+
+/*
+ * Log backend writing straight to a region of the card outside the FAT
+ * volume with disk_access_write, so no cluster chain or directory entry is
+ * touched while logging. The first sector of the region is a superblock
+ * listing the sessions, each a contiguous run of sectors after the one
+ * before it. Only the superblock is ever rewritten, a full region starts
+ * over from its beginning.
+ */
+
+#define BLOCK_LOG_MAGIC        0x4b4c4253 // "SBLK"
+#define BLOCK_LOG_VERSION      1
+#define BLOCK_LOG_SECTOR_SIZE  512
+#define BLOCK_LOG_MAX_SESSIONS 62
+
+struct block_log_session {
+	// sectors from the start of the region
+	uint32_t start_sector;
+	uint32_t size;
+} __packed;
+
+struct block_log_super {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t session_count;
+	struct block_log_session session[BLOCK_LOG_MAX_SESSIONS];
+} __packed;
+
+BUILD_ASSERT(sizeof(struct block_log_super) <= BLOCK_LOG_SECTOR_SIZE, "superblock too large");
+
+struct block_log {
+	union {
+		struct block_log_super super;
+		uint8_t sector[BLOCK_LOG_SECTOR_SIZE];
+	} __aligned(4);
+	struct block_log_session *session;
+	uint32_t next_sector;
+};
+
+// read the superblock, the sessions stay as they are
+int block_log_load(struct block_log *log);
+
+// start a new session after the last one
+int block_log_open(struct block_log *log);
+
+/*
+ * Append to the open session in one multi-block transfer. Only the last
+ * write of a session may be a partial sector, buf is zero padded in place
+ * to the next sector so it must have room for it.
+ */
+ssize_t block_log_write(struct block_log *log, uint8_t *buf, size_t size);
+
+// store the session size in the superblock
+int block_log_sync(struct block_log *log);
+
+int block_log_close(struct block_log *log);
+
+// read whole sectors of a session from offset, returns the bytes of it in buf
+ssize_t block_log_read(struct block_log *log, int session, uint32_t offset, uint8_t *buf,
+		       size_t size);
+
+#endif // CEREBRI_SYNAPSE_LOG_SDCARD_BLOCK_LOG_H
+// vi: ts=4 sw=4 et
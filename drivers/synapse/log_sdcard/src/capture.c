@@ -0,0 +1,244 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/fs/fs.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include <pb_encode.h>
+
+#include <cerebri/core/workq.h>
+
+#include <synapse_capture.h>
+
+#include "capture.h"
+
+#define CAPTURE_SIZE    (CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE_KB * 1024)
+#define CAPTURE_PRE_US  (CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE_PRE_MS * 1000ULL)
+#define CAPTURE_POST_MS CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE_POST_MS
+#define MAX_PAYLOAD     8192
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE_SDRAM)
+#define CAPTURE_SECTION __attribute__((section(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE_SECTION)))
+#else
+#define CAPTURE_SECTION
+#endif
+
+LOG_MODULE_DECLARE(log_sdcard, LOG_LEVEL_DBG);
+
+extern struct k_work_q g_low_priority_work_q;
+
+enum capture_state {
+	CAPTURE_RECORDING,
+	CAPTURE_POST,
+	CAPTURE_WRITING,
+};
+
+// ring entry, the absolute time lets records older than the pre trigger time drop out
+struct capture_record {
+	uint64_t uptime_us;
+	uint16_t size;
+	uint8_t id;
+} __packed;
+
+static uint8_t g_capture_buf[CAPTURE_SIZE] CAPTURE_SECTION __aligned(4);
+static uint8_t g_write_buf[SYNAPSE_RECORD_HEADER_MAX + MAX_PAYLOAD] CAPTURE_SECTION;
+
+static void capture_write_handler(struct k_work *work);
+
+struct capture {
+	struct ring_buf rb;
+	const struct synapse_record_topic *topics;
+	size_t topic_count;
+	atomic_t state;
+	// the trigger reason, NULL while none is pending
+	atomic_ptr_t reason;
+	const char *last_reason;
+	int64_t post_end_ticks;
+	uint32_t files;
+	atomic_t ignored;
+	struct workq_item work_item;
+};
+
+static struct capture g_capture = {
+	.state = ATOMIC_INIT(CAPTURE_RECORDING),
+	.reason = ATOMIC_PTR_INIT(NULL),
+	.ignored = ATOMIC_INIT(0),
+	.work_item = WORKQ_ITEM_INITIALIZER(capture_write_handler, "log_capture", 1000000),
+};
+
+void synapse_capture_trigger(const char *reason)
+{
+	if (!atomic_ptr_cas(&g_capture.reason, NULL, (atomic_ptr_val_t)reason)) {
+		atomic_inc(&g_capture.ignored);
+	}
+}
+
+void log_capture_init(const struct synapse_record_topic *topics, size_t topic_count)
+{
+	struct capture *cap = &g_capture;
+
+	cap->topics = topics;
+	cap->topic_count = topic_count;
+	ring_buf_init(&cap->rb, sizeof(g_capture_buf), g_capture_buf);
+}
+
+void log_capture_record(uint8_t id, const synapse_pb_Frame *frame)
+{
+	static uint8_t buf[sizeof(struct capture_record) + MAX_PAYLOAD];
+	struct capture *cap = &g_capture;
+
+	// the writer owns the ring until it is done
+	if (atomic_get(&cap->state) == CAPTURE_WRITING) {
+		return;
+	}
+
+	struct capture_record record = {
+		.uptime_us = k_ticks_to_us_floor64(k_uptime_ticks()),
+		.id = id,
+	};
+	pb_ostream_t stream = pb_ostream_from_buffer(buf + sizeof(record), MAX_PAYLOAD);
+	if (!pb_encode(&stream, synapse_pb_Frame_fields, frame)) {
+		return;
+	}
+	record.size = stream.bytes_written;
+	memcpy(buf, &record, sizeof(record));
+	uint32_t size = sizeof(record) + record.size;
+
+	// before a trigger only the pre trigger time is kept, after it only space matters
+	bool recording = atomic_get(&cap->state) == CAPTURE_RECORDING;
+	struct capture_record oldest;
+	while (ring_buf_peek(&cap->rb, (uint8_t *)&oldest, sizeof(oldest)) == sizeof(oldest) &&
+	       (ring_buf_space_get(&cap->rb) < size ||
+		(recording && record.uptime_us - oldest.uptime_us > CAPTURE_PRE_US))) {
+		ring_buf_get(&cap->rb, NULL, sizeof(oldest) + oldest.size);
+	}
+	ring_buf_put(&cap->rb, buf, size);
+}
+
+void log_capture_poll(void)
+{
+	struct capture *cap = &g_capture;
+	int64_t now_ticks = k_uptime_ticks();
+
+	switch (atomic_get(&cap->state)) {
+	case CAPTURE_RECORDING: {
+		const char *reason = atomic_ptr_get(&cap->reason);
+		if (reason != NULL) {
+			LOG_WRN("capture triggered: %s", reason);
+			cap->last_reason = reason;
+			cap->post_end_ticks = now_ticks + k_ms_to_ticks_ceil64(CAPTURE_POST_MS);
+			atomic_set(&cap->state, CAPTURE_POST);
+		}
+		break;
+	}
+	case CAPTURE_POST:
+		if (now_ticks >= cap->post_end_ticks) {
+			atomic_set(&cap->state, CAPTURE_WRITING);
+			workq_submit(&g_low_priority_work_q, &cap->work_item);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// the ring in the compact record format, with one index block in front of the first record
+static int capture_write(struct capture *cap, struct fs_file_t *file)
+{
+	struct synapse_record_file header = {
+		.magic = SYNAPSE_RECORD_MAGIC,
+		.version = SYNAPSE_RECORD_VERSION,
+		.topic_count = cap->topic_count,
+		.index_period_ms = 0,
+	};
+	size_t topics_size = cap->topic_count * sizeof(cap->topics[0]);
+	if (fs_write(file, &header, sizeof(header)) != sizeof(header) ||
+	    fs_write(file, cap->topics, topics_size) != (ssize_t)topics_size) {
+		return -EIO;
+	}
+
+	struct capture_record record;
+	uint64_t last_us = 0;
+	bool first = true;
+	while (ring_buf_get(&cap->rb, (uint8_t *)&record, sizeof(record)) == sizeof(record)) {
+		uint8_t *payload = g_write_buf + SYNAPSE_RECORD_HEADER_MAX;
+		if (ring_buf_get(&cap->rb, payload, record.size) != record.size) {
+			return -EIO;
+		}
+
+		if (first) {
+			uint8_t id = SYNAPSE_RECORD_INDEX;
+			struct synapse_record_index index = {
+				.magic = SYNAPSE_RECORD_INDEX_MAGIC,
+				.uptime_us = record.uptime_us,
+				.prev_offset = 0,
+			};
+			if (fs_write(file, &id, 1) != 1 ||
+			    fs_write(file, &index, sizeof(index)) != sizeof(index)) {
+				return -EIO;
+			}
+			last_us = record.uptime_us;
+			first = false;
+		}
+
+		uint8_t record_header[SYNAPSE_RECORD_HEADER_MAX];
+		size_t n = synapse_record_header(record_header, record.id,
+						 record.uptime_us - last_us, record.size);
+		memcpy(payload - n, record_header, n);
+		if (fs_write(file, payload - n, n + record.size) != (ssize_t)(n + record.size)) {
+			return -EIO;
+		}
+		last_us = record.uptime_us;
+	}
+	return 0;
+}
+
+static void capture_write_handler(struct k_work *work)
+{
+	struct capture *cap = &g_capture;
+	struct fs_file_t file;
+	char path[32];
+	ARG_UNUSED(work);
+
+	snprintf(path, sizeof(path), "/SD:/capture%u.rec", cap->files++);
+	fs_file_t_init(&file);
+	fs_unlink(path);
+	int ret = fs_open(&file, path, FS_O_WRITE | FS_O_CREATE);
+	if (ret == 0) {
+		ret = capture_write(cap, &file);
+		fs_close(&file);
+	}
+	if (ret < 0) {
+		LOG_ERR("capture %s failed: %d", path, ret);
+	} else {
+		LOG_INF("capture written to %s", path);
+	}
+
+	ring_buf_reset(&cap->rb);
+	atomic_ptr_set(&cap->reason, NULL);
+	atomic_set(&cap->state, CAPTURE_RECORDING);
+}
+
+void log_capture_status(const struct shell *sh)
+{
+	static const char *const states[] = {"recording", "post trigger", "writing"};
+	struct capture *cap = &g_capture;
+
+	shell_print(sh, "capture: %s buffered: %u bytes files: %u ignored triggers: %u",
+		    states[atomic_get(&cap->state)], ring_buf_size_get(&cap->rb), cap->files,
+		    (unsigned int)atomic_get(&cap->ignored));
+	if (cap->last_reason != NULL) {
+		shell_print(sh, "last trigger: %s", cap->last_reason);
+	}
+}
+
+// vi: ts=4 sw=4 et
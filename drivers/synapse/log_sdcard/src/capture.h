@@ -0,0 +1,55 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE_H
+#define CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <synapse_record.h>
+#include <synapse_topic_list.h>
+
+struct shell;
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE)
+
+// the topic table written at the start of every capture file
+void log_capture_init(const struct synapse_record_topic *topics, size_t topic_count);
+
+// keep a message in the capture ring, dropping the oldest, logger thread only
+void log_capture_record(uint8_t id, const synapse_pb_Frame *frame);
+
+// logger thread, starts writing the capture once the post trigger time is over
+void log_capture_poll(void);
+
+void log_capture_status(const struct shell *sh);
+
+#else
+
+static inline void log_capture_init(const struct synapse_record_topic *topics, size_t topic_count)
+{
+	(void)topics;
+	(void)topic_count;
+}
+
+static inline void log_capture_record(uint8_t id, const synapse_pb_Frame *frame)
+{
+	(void)id;
+	(void)frame;
+}
+
+static inline void log_capture_poll(void)
+{
+}
+
+static inline void log_capture_status(const struct shell *sh)
+{
+	(void)sh;
+}
+
+#endif
+
+#endif // CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE_H
+// vi: ts=4 sw=4 et
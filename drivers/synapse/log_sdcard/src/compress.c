@@ -0,0 +1,192 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/ring_buffer.h>
+
+#include <lz4.h>
+
+#include "compress.h"
+
+#define MY_STACK_SIZE 2048
+#define MY_PRIORITY   CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_LZ4_PRIORITY
+#define CHUNK         CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_LZ4_CHUNK
+#define ACCELERATION  CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_LZ4_ACCELERATION
+#define WRITE_CHUNK   CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_WRITE_CHUNK
+#define FLUSH_MS      CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_FLUSH_MS
+#define BOUND         LZ4_COMPRESSBOUND(CHUNK)
+#define BLOCK_MAX     (sizeof(struct log_lz4_header) + BOUND)
+
+extern struct ring_buf rb_sdcard;
+extern struct k_sem sem_sdcard;
+
+// a full write chunk for the writer while the next block is compressed
+RING_BUF_DECLARE(rb_sdcard_lz4, 2 * WRITE_CHUNK + 2 * BLOCK_MAX);
+// given once a write chunk of compressed blocks is buffered
+K_SEM_DEFINE(sem_sdcard_lz4, 0, 1);
+// the first block of a new session in rb_sdcard_lz4
+struct log_split split_sdcard_lz4 = LOG_SPLIT_INITIALIZER;
+
+LOG_MODULE_DECLARE(log_sdcard, LOG_LEVEL_DBG);
+
+static uint8_t g_raw[CHUNK];
+static uint8_t g_block[BLOCK_MAX] __aligned(4);
+static LZ4_stream_t g_lz4;
+
+// the thread and a flush from the writer take chunks in turn
+static K_MUTEX_DEFINE(g_lock);
+
+struct compress_stats {
+	uint64_t raw_bytes;
+	uint64_t bytes;
+	uint64_t cycles;
+	uint32_t blocks;
+	uint32_t stored;
+	uint32_t max_us;
+	// blocks that waited for the writer to make room
+	uint32_t waits;
+};
+
+static struct compress_stats g_stats;
+
+// raw_bytes when the current session started
+static uint64_t g_session_raw;
+
+// pass a split on to the writer once everything before it is compressed, before clearing it so
+// the logger never sees a session start that no stage has pending
+static void compress_split(void)
+{
+	uint32_t pos = (uint32_t)g_stats.raw_bytes;
+
+	if (log_split_at(&split_sdcard, pos)) {
+		log_split_set(&split_sdcard_lz4, (uint32_t)g_stats.bytes);
+		g_session_raw = g_stats.raw_bytes;
+		(void)log_split_reached(&split_sdcard, pos);
+	}
+}
+
+// compress up to a chunk of the log into one block, false if the writer first needs room
+static bool compress_chunk(size_t size, bool wait)
+{
+	struct log_lz4_header *header = (struct log_lz4_header *)g_block;
+	uint8_t *payload = g_block + sizeof(*header);
+
+	// the writer may be the one flushing, so never wait for it with the lock held
+	if (wait && ring_buf_space_get(&rb_sdcard_lz4) < BLOCK_MAX) {
+		g_stats.waits++;
+		while (ring_buf_space_get(&rb_sdcard_lz4) < BLOCK_MAX) {
+			k_sem_give(&sem_sdcard_lz4);
+			k_msleep(1);
+		}
+	}
+
+	k_mutex_lock(&g_lock, K_FOREVER);
+
+	if (ring_buf_space_get(&rb_sdcard_lz4) < BLOCK_MAX) {
+		k_mutex_unlock(&g_lock);
+		return false;
+	}
+
+	// a block never spans two sessions
+	size = MIN(MIN(size, CHUNK), ring_buf_size_get(&rb_sdcard));
+	size = log_split_limit(&split_sdcard, (uint32_t)g_stats.raw_bytes, size);
+	uint32_t n = ring_buf_get(&rb_sdcard, g_raw, size);
+	if (n == 0) {
+		compress_split();
+		k_mutex_unlock(&g_lock);
+		return true;
+	}
+
+	uint32_t start = k_cycle_get_32();
+	int compressed = LZ4_compress_fast_extState(&g_lz4, (const char *)g_raw, (char *)payload,
+						    n, BOUND, ACCELERATION);
+	header->flags = 0;
+	if (compressed <= 0 || (uint32_t)compressed >= n) {
+		memcpy(payload, g_raw, n);
+		compressed = n;
+		header->flags = LOG_LZ4_STORED;
+		g_stats.stored++;
+	}
+	header->magic = LOG_LZ4_MAGIC;
+	header->seq = g_stats.blocks;
+	header->raw_offset = g_stats.raw_bytes - g_session_raw;
+	header->raw_size = n;
+	header->size = compressed;
+	header->crc = 0;
+	size_t block_size = sizeof(*header) + compressed;
+	header->crc = crc32_ieee(g_block, block_size);
+	uint32_t cycles = k_cycle_get_32() - start;
+
+	ring_buf_put(&rb_sdcard_lz4, g_block, block_size);
+
+	g_stats.raw_bytes += n;
+	g_stats.bytes += block_size;
+	g_stats.cycles += cycles;
+	g_stats.blocks++;
+	g_stats.max_us = MAX(g_stats.max_us, k_cyc_to_us_ceil32(cycles));
+
+	compress_split();
+
+	k_mutex_unlock(&g_lock);
+
+	if (ring_buf_size_get(&rb_sdcard_lz4) >= WRITE_CHUNK) {
+		k_sem_give(&sem_sdcard_lz4);
+	}
+	return true;
+}
+
+void log_compress_flush(void)
+{
+	while (!ring_buf_is_empty(&rb_sdcard) && compress_chunk(CHUNK, false)) {
+	}
+}
+
+static void log_compress_run(void *p0, void *p1, void *p2)
+{
+	ARG_UNUSED(p0);
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	while (true) {
+		// woken by the logger once a chunk is buffered, a trickle is compressed anyway
+		int timeout = k_sem_take(&sem_sdcard, K_MSEC(FLUSH_MS));
+		while (ring_buf_size_get(&rb_sdcard) >= CHUNK) {
+			compress_chunk(CHUNK, true);
+		}
+		if (timeout != 0 && !ring_buf_is_empty(&rb_sdcard)) {
+			compress_chunk(CHUNK, true);
+		}
+	}
+}
+
+K_THREAD_DEFINE(log_sdcard_lz4, MY_STACK_SIZE, log_compress_run, NULL, NULL, NULL, MY_PRIORITY, 0,
+		0);
+
+void log_compress_status(const struct shell *sh)
+{
+	struct compress_stats stats;
+
+	k_mutex_lock(&g_lock, K_FOREVER);
+	stats = g_stats;
+	k_mutex_unlock(&g_lock);
+
+	double ratio = stats.bytes > 0 ? (double)stats.raw_bytes / stats.bytes : 0;
+	double us_per_kb = 0;
+	if (stats.raw_bytes > 0) {
+		us_per_kb = k_cyc_to_us_floor64(stats.cycles) * 1024.0 / stats.raw_bytes;
+	}
+	shell_print(sh, "lz4 blocks: %u stored: %u waits: %u ratio: %.2f", stats.blocks,
+		    stats.stored, stats.waits, ratio);
+	shell_print(sh, "lz4 cpu: %.1f us/KB, %llu ms total, block max: %u us", us_per_kb,
+		    k_cyc_to_ms_floor64(stats.cycles), stats.max_us);
+	shell_print(sh, "lz4 buffered: %u bytes", ring_buf_size_get(&rb_sdcard_lz4));
+}
+
+// vi: ts=4 sw=4 et
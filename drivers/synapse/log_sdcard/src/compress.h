@@ -0,0 +1,86 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SYNAPSE_LOG_SDCARD_COMPRESS_H
+#define CEREBRI_SYNAPSE_LOG_SDCARD_COMPRESS_H
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/toolchain.h>
+
+#include "session.h"
+
+struct shell;
+
+/*
+ * Optional stage between the logger and the writer. A low priority
+ * thread takes chunks of the log from rb_sdcard, LZ4 block compresses
+ * each on its own and puts it in rb_sdcard_lz4 behind a header, the
+ * writer then writes that ring instead. A chunk that does not shrink is
+ * stored as it is.
+ *
+ * The header carries a magic and a crc32 over itself and the payload,
+ * so a decoder that finds a corrupted block scans forward for the next
+ * magic whose crc matches and carries on from there. raw_offset is the
+ * position of the block in the uncompressed log, the offsets of record
+ * index blocks point into that. It restarts from 0 with every session
+ * file, so they stay offsets in the file once it is decompressed.
+ */
+
+#define LOG_LZ4_MAGIC 0x345a4c53 // "SLZ4"
+
+// payload is the chunk as it is
+#define LOG_LZ4_STORED BIT(0)
+
+struct log_lz4_header {
+	uint32_t magic;
+	uint32_t seq;
+	uint64_t raw_offset;
+	uint32_t raw_size;
+	uint32_t size;
+	uint32_t flags;
+	// crc32 ieee of the header with crc 0, then the payload
+	uint32_t crc;
+} __packed;
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_LZ4)
+
+// the writer drains this ring instead of rb_sdcard
+#define LOG_WRITER_RB    rb_sdcard_lz4
+#define LOG_WRITER_SEM   sem_sdcard_lz4
+#define LOG_WRITER_SPLIT split_sdcard_lz4
+// the logger wakes the compressor once a chunk to compress is buffered
+#define LOG_STAGE_CHUNK CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_LZ4_CHUNK
+
+extern struct ring_buf rb_sdcard_lz4;
+extern struct k_sem sem_sdcard_lz4;
+extern struct log_split split_sdcard_lz4;
+
+// compress whatever the logger buffered, from the writer before it drains its ring
+void log_compress_flush(void);
+
+void log_compress_status(const struct shell *sh);
+
+#else
+
+#define LOG_WRITER_RB    rb_sdcard
+#define LOG_WRITER_SEM   sem_sdcard
+#define LOG_WRITER_SPLIT split_sdcard
+#define LOG_STAGE_CHUNK  CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_WRITE_CHUNK
+
+static inline void log_compress_flush(void)
+{
+}
+
+static inline void log_compress_status(const struct shell *sh)
+{
+	(void)sh;
+}
+
+#endif
+
+#endif // CEREBRI_SYNAPSE_LOG_SDCARD_COMPRESS_H
+// vi: ts=4 sw=4 et
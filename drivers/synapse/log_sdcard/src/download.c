@@ -0,0 +1,410 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <zephyr/fs/fs.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/shell/shell.h>
+
+#include <synapse_seqlock.h>
+#include <synapse_topic_list.h>
+
+#include "session.h"
+
+/*
+ * Log download over tcp, the ground connects to DOWNLOAD_PORT and sends
+ * one line per request:
+ *
+ *   list                   "<name> <size>\n" per file, then ".\n"
+ *   get <name> [offset]    "ok <size>\n" and size - offset bytes of the file
+ *
+ * errors are answered with "err <errno>\n". The session file being
+ * written is not listed or served. Requests are refused while armed and
+ * a transfer is cut when the vehicle arms, the thread runs below every
+ * flight node, so a download only takes idle time.
+ */
+
+#define MY_STACK_SIZE 4096
+#define MY_PRIORITY   CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_DOWNLOAD_PRIORITY
+#define DOWNLOAD_PORT CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_DOWNLOAD_PORT
+#define READ_CHUNK    CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_DOWNLOAD_CHUNK
+#define SECTOR_SIZE   512
+#define LINE_MAX      64
+#define ACCEPT_MS     500
+#define RECV_MS       2000
+// mount point and an 8.3 name
+#define PATH_MAX_LEN  24
+
+BUILD_ASSERT(READ_CHUNK % SECTOR_SIZE == 0, "read chunk must be whole sectors");
+
+LOG_MODULE_DECLARE(log_sdcard, LOG_LEVEL_DBG);
+
+static const char *disk_mount_pt = "/SD:";
+
+// whole aligned sectors, FatFS reads them straight from the card in one multi block transfer
+static uint8_t g_read_buf[READ_CHUNK] __aligned(4);
+
+static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+
+struct context {
+	struct synapse_seqlock_sub sub_status;
+	synapse_pb_Status status;
+	bool armed;
+	int sock;
+	struct k_sem running;
+	size_t stack_size;
+	k_thread_stack_t *stack_area;
+	struct k_thread thread_data;
+	// statistics
+	uint32_t requests;
+	uint32_t refused;
+	uint32_t files;
+	uint32_t aborted;
+	uint64_t bytes_sent;
+	// rate of the last completed transfer
+	uint32_t last_kbps;
+};
+
+static struct context g_ctx = {
+	.sub_status = {},
+	.status = {},
+	.sock = -1,
+	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
+	.stack_size = MY_STACK_SIZE,
+	.stack_area = g_my_stack_area,
+	.thread_data = {},
+};
+
+static bool log_download_armed(struct context *ctx)
+{
+	if (synapse_seqlock_sub_update_available(&ctx->sub_status) &&
+	    synapse_seqlock_sub_update(&ctx->sub_status, &ctx->status) == 0) {
+		ctx->armed = ctx->status.arming == synapse_pb_Status_Arming_ARMING_ARMED;
+	}
+	return ctx->armed;
+}
+
+static int log_download_send(int sock, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	while (len > 0) {
+		ssize_t n = zsock_send(sock, p, len, 0);
+		if (n < 0) {
+			return -errno;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int log_download_reply(int sock, const char *fmt, ...)
+{
+	char line[LINE_MAX];
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+	if (len < 0 || len >= sizeof(line)) {
+		return -EINVAL;
+	}
+	return log_download_send(sock, line, len);
+}
+
+// session number of a log file name, 0 for anything else
+static uint32_t log_download_session(const char *name)
+{
+	size_t digits = strcspn(name, "0123456789");
+	char *end;
+	unsigned long n = strtoul(name + digits, &end, 10);
+	if (digits == 0 || end == name + digits || *end != '.') {
+		return 0;
+	}
+	return n;
+}
+
+// the file being written is preallocated and still growing, it is not served until closed
+static bool log_download_busy(const char *name)
+{
+	uint32_t session = log_sdcard_writer_session();
+	return session != 0 && log_download_session(name) == session;
+}
+
+static int log_download_list(struct context *ctx)
+{
+	static struct fs_dirent entry;
+	struct fs_dir_t dir;
+
+	fs_dir_t_init(&dir);
+	int ret = fs_opendir(&dir, disk_mount_pt);
+	if (ret < 0) {
+		return ret;
+	}
+	while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != '\0') {
+		if (entry.type != FS_DIR_ENTRY_FILE || log_download_busy(entry.name)) {
+			continue;
+		}
+		ret = log_download_reply(ctx->sock, "%s %u\n", entry.name, (uint32_t)entry.size);
+		if (ret < 0) {
+			break;
+		}
+	}
+	fs_closedir(&dir);
+	return ret < 0 ? ret : log_download_reply(ctx->sock, ".\n");
+}
+
+static int log_download_get(struct context *ctx, const char *name, uint32_t offset)
+{
+	char path[PATH_MAX_LEN];
+	struct fs_dirent entry;
+
+	if (strchr(name, '/') != NULL || log_download_busy(name) ||
+	    snprintf(path, sizeof(path), "%s/%s", disk_mount_pt, name) >= sizeof(path)) {
+		return -EACCES;
+	}
+	int ret = fs_stat(path, &entry);
+	if (ret < 0) {
+		return ret;
+	}
+	if (entry.type != FS_DIR_ENTRY_FILE || offset > entry.size) {
+		return -EINVAL;
+	}
+
+	struct fs_file_t file;
+	fs_file_t_init(&file);
+	ret = fs_open(&file, path, FS_O_READ);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = fs_seek(&file, offset, FS_SEEK_SET);
+	if (ret < 0) {
+		fs_close(&file);
+		return ret;
+	}
+
+	ret = log_download_reply(ctx->sock, "ok %u\n", (uint32_t)entry.size);
+	int64_t start_ticks = k_uptime_ticks();
+	size_t left = entry.size - offset;
+	// an unaligned offset reads up to the next sector first, every later read is whole sectors
+	size_t chunk = MIN(left, READ_CHUNK - offset % SECTOR_SIZE);
+	while (ret == 0 && left > 0) {
+		if (log_download_armed(ctx) || log_sdcard_writer_session() == 0) {
+			ctx->aborted++;
+			ret = -ECANCELED;
+			break;
+		}
+		ssize_t n = fs_read(&file, g_read_buf, chunk);
+		if (n <= 0) {
+			ret = n < 0 ? n : -EIO;
+			break;
+		}
+		ret = log_download_send(ctx->sock, g_read_buf, n);
+		ctx->bytes_sent += n;
+		left -= n;
+		chunk = MIN(left, READ_CHUNK);
+	}
+	fs_close(&file);
+
+	if (ret == 0) {
+		ctx->files++;
+		uint64_t ms = MAX(k_ticks_to_ms_floor64(k_uptime_ticks() - start_ticks), 1);
+		ctx->last_kbps = (entry.size - offset) / ms;
+	}
+	// the size was sent, the ground sees the cut as a short file
+	return ret < 0 ? -ECONNABORTED : 0;
+}
+
+// one request line, without the newline
+static int log_download_recv_line(int sock, char *line, size_t size)
+{
+	size_t len = 0;
+	while (len + 1 < size) {
+		ssize_t n = zsock_recv(sock, &line[len], 1, 0);
+		if (n <= 0) {
+			return n < 0 ? -errno : -ENOTCONN;
+		}
+		if (line[len] == '\n') {
+			break;
+		}
+		len++;
+	}
+	if (len > 0 && line[len - 1] == '\r') {
+		len--;
+	}
+	line[len] = '\0';
+	return len;
+}
+
+static void log_download_serve(struct context *ctx)
+{
+	char line[LINE_MAX];
+
+	while (k_sem_count_get(&ctx->running) == 0) {
+		int ret = log_download_recv_line(ctx->sock, line, sizeof(line));
+		if (ret == -EAGAIN) {
+			continue;
+		} else if (ret < 0) {
+			return;
+		}
+		ctx->requests++;
+
+		char *save;
+		const char *cmd = strtok_r(line, " ", &save);
+		if (cmd == NULL) {
+			continue;
+		}
+		if (log_download_armed(ctx)) {
+			ctx->refused++;
+			ret = -EBUSY;
+		} else if (log_sdcard_writer_session() == 0) {
+			ret = -ENODEV;
+		} else if (strcmp(cmd, "list") == 0) {
+			ret = log_download_list(ctx);
+		} else if (strcmp(cmd, "get") == 0) {
+			const char *name = strtok_r(NULL, " ", &save);
+			const char *arg = strtok_r(NULL, " ", &save);
+			uint32_t offset = arg != NULL ? strtoul(arg, NULL, 10) : 0;
+			ret = name == NULL ? -EINVAL : log_download_get(ctx, name, offset);
+			if (ret == -ECONNABORTED) {
+				return;
+			}
+		} else {
+			ret = -ENOTSUP;
+		}
+		if (ret < 0 && log_download_reply(ctx->sock, "err %d\n", ret) < 0) {
+			return;
+		}
+	}
+}
+
+static int log_download_init(struct context *ctx)
+{
+	struct sockaddr_in addr = {
+		.sin_addr.s_addr = INADDR_ANY,
+		.sin_family = AF_INET,
+		.sin_port = htons(DOWNLOAD_PORT),
+	};
+
+	synapse_seqlock_sub_init(&ctx->sub_status, &seqlock_status, 0);
+	ctx->armed = false;
+
+	ctx->sock = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (ctx->sock < 0) {
+		LOG_ERR("failed to create download socket: %d", errno);
+		return -errno;
+	}
+	int one = 1;
+	(void)zsock_setsockopt(ctx->sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (zsock_bind(ctx->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    zsock_listen(ctx->sock, 1) < 0) {
+		int ret = -errno;
+		LOG_ERR("failed to listen on download port: %d", ret);
+		zsock_close(ctx->sock);
+		ctx->sock = -1;
+		return ret;
+	}
+
+	k_sem_take(&ctx->running, K_FOREVER);
+	LOG_INF("download on port %d", DOWNLOAD_PORT);
+	return 0;
+}
+
+static void log_download_fini(struct context *ctx)
+{
+	zsock_close(ctx->sock);
+	ctx->sock = -1;
+	synapse_seqlock_sub_fini(&ctx->sub_status);
+	k_sem_give(&ctx->running);
+}
+
+static void log_download_run(void *p0, void *p1, void *p2)
+{
+	struct context *ctx = p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	if (log_download_init(ctx) < 0) {
+		return;
+	}
+
+	struct timeval recv_timeout = {.tv_sec = RECV_MS / 1000, .tv_usec = 0};
+	while (k_sem_count_get(&ctx->running) == 0) {
+		struct zsock_pollfd fds[] = {{ctx->sock, ZSOCK_POLLIN, 0}};
+		if (zsock_poll(fds, ARRAY_SIZE(fds), ACCEPT_MS) <= 0) {
+			continue;
+		}
+		int listen_sock = ctx->sock;
+		int client = zsock_accept(listen_sock, NULL, NULL);
+		if (client < 0) {
+			continue;
+		}
+		(void)zsock_setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout,
+				       sizeof(recv_timeout));
+		// one ground client at a time, the listening socket waits in the backlog
+		ctx->sock = client;
+		log_download_serve(ctx);
+		zsock_close(client);
+		ctx->sock = listen_sock;
+	}
+
+	log_download_fini(ctx);
+}
+
+static int start(struct context *ctx)
+{
+	k_tid_t tid = k_thread_create(&ctx->thread_data, ctx->stack_area, ctx->stack_size,
+				      log_download_run, ctx, NULL, NULL, MY_PRIORITY, 0, K_FOREVER);
+	k_thread_name_set(tid, "log_download");
+	k_thread_start(tid);
+	return 0;
+}
+
+static int log_download_cmd_handler(const struct shell *sh, size_t argc, char **argv, void *data)
+{
+	ARG_UNUSED(argc);
+	struct context *ctx = data;
+
+	if (strcmp(argv[0], "start") == 0) {
+		if (k_sem_count_get(&g_ctx.running) == 0) {
+			shell_print(sh, "already running");
+		} else {
+			start(ctx);
+		}
+	} else if (strcmp(argv[0], "stop") == 0) {
+		if (k_sem_count_get(&g_ctx.running) == 0) {
+			k_sem_give(&g_ctx.running);
+		} else {
+			shell_print(sh, "not running");
+		}
+	} else if (strcmp(argv[0], "status") == 0) {
+		shell_print(sh, "running: %d port: %d armed: %d",
+			    (int)k_sem_count_get(&g_ctx.running) == 0, DOWNLOAD_PORT, ctx->armed);
+		shell_print(sh, "requests: %u refused: %u files: %u aborted: %u", ctx->requests,
+			    ctx->refused, ctx->files, ctx->aborted);
+		shell_print(sh, "sent: %10.3f MB last rate: %u kB/s",
+			    (double)ctx->bytes_sent / 1048576L, ctx->last_kbps);
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_DICT_SET_CREATE(sub_log_download, log_download_cmd_handler, (start, &g_ctx, "start"),
+			     (stop, &g_ctx, "stop"), (status, &g_ctx, "status"));
+
+SHELL_CMD_REGISTER(log_download, &sub_log_download, "log_download commands", NULL);
+
+static int log_download_sys_init(void)
+{
+	return start(&g_ctx);
+};
+
+SYS_INIT(log_download_sys_init, APPLICATION, 0);
+
+// vi: ts=4 sw=4 et
@@ -4,8 +4,11 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
 #include <zephyr/shell/shell.h>
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_sub_struct.h>
@@ -13,78 +16,314 @@
 #include <zros/zros_node.h>
 #include <zros/zros_sub.h>
 
+#include <cerebri/core/boot.h>
 #include <cerebri/core/perf_counter.h>
 
 #include <pb_encode.h>
 
+#include "capture.h"
+#include "compress.h"
+#include "session.h"
+
+#include <synapse_queue.h>
+#include <synapse_record.h>
 #include <synapse_topic_list.h>
 
-#define MY_STACK_SIZE 16384
-#define MY_PRIORITY   1
-#define BUF_SIZE      131072
-#define TOPIC_RATE_HZ 100
+#define MY_STACK_SIZE   16384
+#define MY_PRIORITY     1
+#define BUF_SIZE        131072
+#define TOPIC_RATE_HZ   100
+#define QUEUE_DEPTH     CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_QUEUE_DEPTH
+#define INDEX_PERIOD_MS CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_INDEX_PERIOD_MS
+// mounting a card takes a few hundred ms, a slow one a few seconds
+#define WRITER_READY_MS 5000
+#define SEEK_PERIOD_MS  CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK_PERIOD_MS
+#define SEEK_ENTRIES    16
+// a shed class resumes once this much more is free, so it loses one stretch, not every other record
+#define SHED_HYSTERESIS (BUF_SIZE / 16)
+
+// every logged topic, how it is subscribed and its priority class, the position is the topic id
+// in the record header, the frame type comes from the topic registry
+#define LOG_TOPICS(X)                                                                              \
+	X(accel_sp, ZROS, CONTROL)                                                                 \
+	X(actuators, ZROS, CONTROL)                                                                \
+	X(altimeter, ZROS, BULK)                                                                   \
+	X(angular_velocity_sp, ZROS, CONTROL)                                                      \
+	X(attitude_sp, ZROS, CONTROL)                                                              \
+	X(battery_state, ZROS, STATUS)                                                             \
+	X(bezier_trajectory, ZROS, CONTROL)                                                        \
+	X(clock_offset_ethernet, ZROS, BULK)                                                       \
+	X(cmd_vel, ZROS, CONTROL)                                                                  \
+	X(cmd_vel_ethernet, ZROS, CONTROL)                                                         \
+	X(imu, QUEUE, BULK)                                                                        \
+	X(imu_q31_array, QUEUE, BULK)                                                              \
+	X(input, ZROS, CONTROL)                                                                    \
+	X(input_ethernet, ZROS, CONTROL)                                                           \
+	X(input_sbus, ZROS, CONTROL)                                                               \
+	X(led_array, ZROS, BULK)                                                                   \
+	X(magnetic_field, ZROS, BULK)                                                              \
+	X(moment_ff, ZROS, CONTROL)                                                                \
+	X(nav_sat_fix, ZROS, BULK)                                                                 \
+	X(odometry_estimator, ZROS, CONTROL)                                                       \
+	X(odometry_ethernet, ZROS, BULK)                                                           \
+	X(orientation_sp, ZROS, CONTROL)                                                           \
+	X(position_sp, ZROS, CONTROL)                                                              \
+	X(pwm, ZROS, CONTROL)                                                                      \
+	X(safety, ZROS, CRITICAL)                                                                  \
+	X(status, SEQLOCK, STATUS)                                                                 \
+	X(velocity_sp, ZROS, CONTROL)                                                              \
+	X(wheel_odometry, ZROS, BULK)
+
+#define LOG_TOPIC_ID(topic_name, kind, prio) LOG_TOPIC_##topic_name,
+
+enum log_topic {
+	LOG_TOPICS(LOG_TOPIC_ID) LOG_TOPIC_COUNT,
+};
+
+BUILD_ASSERT(LOG_TOPIC_COUNT <= SYNAPSE_RECORD_MAX_TOPICS, "too many topics for the record header");
+
+// when the stream fills the lowest class goes first, headers and index blocks are critical
+enum log_class {
+	LOG_CLASS_CRITICAL,
+	LOG_CLASS_STATUS,
+	LOG_CLASS_CONTROL,
+	LOG_CLASS_BULK,
+	LOG_CLASS_COUNT,
+};
+
+BUILD_ASSERT(LOG_CLASS_COUNT == SYNAPSE_RECORD_CLASSES, "drop record classes out of date");
+
+#define LOG_TOPIC_CLASS(topic_name, kind, prio) LOG_CLASS_##prio,
 
-#define SUBSCRIBE_TOPIC(topic_name)                                                                \
-                                                                                                   \
+static const uint8_t g_topic_class[] = {LOG_TOPICS(LOG_TOPIC_CLASS)};
+
+static const char *const g_class_names[] = {"critical", "status", "control", "bulk"};
+
+// free space in rb_sdcard a class leaves to the ones above it
+#define LOG_RESERVE(name) (BUF_SIZE / 100 * CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SHED_##name##_PERCENT)
+
+static const uint32_t g_class_reserve[LOG_CLASS_COUNT] = {
+	[LOG_CLASS_CRITICAL] = 0,
+	[LOG_CLASS_STATUS] = LOG_RESERVE(STATUS),
+	[LOG_CLASS_CONTROL] = LOG_RESERVE(CONTROL),
+	[LOG_CLASS_BULK] = LOG_RESERVE(BULK),
+};
+
+BUILD_ASSERT(LOG_RESERVE(STATUS) <= LOG_RESERVE(CONTROL) &&
+		     LOG_RESERVE(CONTROL) <= LOG_RESERVE(BULK),
+	     "a lower class must be shed first");
+
+struct log_class_stats {
+	uint32_t dropped;
+	uint32_t dropped_bytes;
+	// times the class started to be shed
+	uint32_t shed;
+	bool shedding;
+};
+
+// log rates, anything else is in Hz
+#define LOG_RATE_OFF    0
+#define LOG_RATE_ALL    UINT16_MAX
+// zros subscriptions are rate limited, this is above every publisher
+#define LOG_RATE_MAX_HZ 1000
+
+#define LOG_MEMBER_ZROS(topic_name)    struct zros_sub sub_##topic_name;
+#define LOG_MEMBER_SEQLOCK(topic_name) struct synapse_seqlock_sub sub_##topic_name;
+#define LOG_MEMBER_QUEUE(topic_name)   struct synapse_queue queue_##topic_name;
+#define LOG_MEMBER(topic_name, kind, prio) LOG_MEMBER_##kind(topic_name)
+
+#define SUBSCRIBE_ZROS(topic_name, rate_hz)                                                        \
 	ret = zros_sub_init(&ctx->sub_##topic_name, &ctx->node, &topic_##topic_name,               \
-			    &ctx->frame.msg, TOPIC_RATE_HZ);                                       \
+			    &ctx->frame.msg, MIN(rate_hz, LOG_RATE_MAX_HZ));                       \
 	if (ret < 0) {                                                                             \
 		LOG_ERR("init " #topic_name " failed: %d", ret);                                   \
 		return ret;                                                                        \
 	}
 
-#define UNSUBSCRIBE_TOPIC(topic_name) zros_sub_fini(&ctx->sub_##topic_name)
+#define UNSUBSCRIBE_ZROS(topic_name) zros_sub_fini(&ctx->sub_##topic_name)
+
+// read without the topic lock, so the publisher never waits for the sd card writer
+#define SUBSCRIBE_SEQLOCK(topic_name, rate_hz)                                                     \
+	synapse_seqlock_sub_init(&ctx->sub_##topic_name, &seqlock_##topic_name,                    \
+				 (rate_hz) == LOG_RATE_ALL ? 0 : (rate_hz))
 
-#define GET_UPDATE(topic_name, topic_type)                                                         \
+#define UNSUBSCRIBE_SEQLOCK(topic_name) synapse_seqlock_sub_fini(&ctx->sub_##topic_name)
+
+// every message of high rate sensor topics, decimated here below LOG_RATE_ALL
+#define SUBSCRIBE_QUEUE(topic_name, rate_hz)                                                       \
+	ret = synapse_queue_init(&ctx->queue_##topic_name, &topic_##topic_name,                    \
+				 g_queue_##topic_name, sizeof(g_queue_##topic_name[0]),            \
+				 ARRAY_SIZE(g_queue_##topic_name));                                \
+	if (ret < 0) {                                                                             \
+		LOG_ERR("init " #topic_name " queue failed: %d", ret);                             \
+		return ret;                                                                        \
+	}                                                                                          \
+	ctx->period_ticks[LOG_TOPIC_##topic_name] =                                                \
+		(rate_hz) == LOG_RATE_ALL   ? 0                                                    \
+		: (rate_hz) == LOG_RATE_OFF ? -1                                                   \
+					    : CONFIG_SYS_CLOCK_TICKS_PER_SEC / (rate_hz);
+
+#define UNSUBSCRIBE_QUEUE(topic_name) synapse_queue_fini(&ctx->queue_##topic_name)
+
+// switched off topics are not subscribed at all, unless queued for the capture buffer
+#define LOG_ACTIVE_ZROS(topic)    (ctx->active_hz[topic] != LOG_RATE_OFF)
+#define LOG_ACTIVE_SEQLOCK(topic) (ctx->active_hz[topic] != LOG_RATE_OFF)
+#define LOG_ACTIVE_QUEUE(topic)                                                                    \
+	(ctx->active_hz[topic] != LOG_RATE_OFF ||                                                  \
+	 IS_ENABLED(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE))
+
+#define LOG_SUBSCRIBE(topic_name, kind, prio)                                                      \
+	if (LOG_ACTIVE_##kind(LOG_TOPIC_##topic_name)) {                                           \
+		SUBSCRIBE_##kind(topic_name, ctx->active_hz[LOG_TOPIC_##topic_name]);              \
+	}
+
+#define LOG_UNSUBSCRIBE(topic_name, kind, prio)                                                    \
+	if (LOG_ACTIVE_##kind(LOG_TOPIC_##topic_name)) {                                           \
+		UNSUBSCRIBE_##kind(topic_name);                                                    \
+	}
+
+#define GET_UPDATE_ZROS(topic_name)                                                                \
 	if (zros_sub_update_available(&ctx->sub_##topic_name)) {                                   \
 		zros_sub_update(&ctx->sub_##topic_name);                                           \
-		ctx->frame.which_msg = synapse_pb_Frame_##topic_type##_tag;                        \
-		snprintf(ctx->frame.topic, sizeof(ctx->frame.topic), #topic_name);                 \
-		log_sdcard_write_frame(ctx);                                                       \
+		ctx->frame.which_msg = SYNAPSE_TOPIC_FRAME_##topic_name;                           \
+		log_sdcard_write_frame(ctx, LOG_TOPIC_##topic_name);                               \
+	}
+
+#define GET_UPDATE_SEQLOCK(topic_name)                                                             \
+	if (synapse_seqlock_sub_update_available(&ctx->sub_##topic_name) &&                        \
+	    synapse_seqlock_sub_update(&ctx->sub_##topic_name, &ctx->frame.msg) == 0) {            \
+		ctx->frame.which_msg = SYNAPSE_TOPIC_FRAME_##topic_name;                           \
+		log_sdcard_write_frame(ctx, LOG_TOPIC_##topic_name);                               \
 	}
 
+// drain all messages queued since the last wakeup, the capture buffer takes every one
+#define GET_UPDATE_QUEUE(topic_name)                                                               \
+	while (synapse_queue_pop(&ctx->queue_##topic_name, &ctx->frame.msg) == 0) {                \
+		ctx->frame.which_msg = SYNAPSE_TOPIC_FRAME_##topic_name;                           \
+		log_capture_record(LOG_TOPIC_##topic_name, &ctx->frame);                           \
+		if (log_sdcard_decimate(ctx, LOG_TOPIC_##topic_name)) {                            \
+			continue;                                                                  \
+		}                                                                                  \
+		log_sdcard_write_frame(ctx, LOG_TOPIC_##topic_name);                               \
+	}
+
+#define LOG_GET_UPDATE(topic_name, kind, prio)                                                     \
+	if (LOG_ACTIVE_##kind(LOG_TOPIC_##topic_name)) {                                           \
+		GET_UPDATE_##kind(topic_name);                                                     \
+	}
+
+#define LOG_TOPIC_NAME(topic_name, kind, prio) #topic_name,
+
 RING_BUF_DECLARE(rb_sdcard, BUF_SIZE);
+// given once a write chunk, or a compression chunk, is buffered
+K_SEM_DEFINE(sem_sdcard, 0, 1);
+// the first byte of a new session in rb_sdcard
+struct log_split split_sdcard = LOG_SPLIT_INITIALIZER;
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+struct log_seek {
+	struct synapse_record_seek seek;
+	uint32_t topic_offset[LOG_TOPIC_COUNT];
+} __packed;
+
+// seek entries for the writer, drained into the sidecar of the session file
+RING_BUF_DECLARE(rb_sdcard_seek, SEEK_ENTRIES * sizeof(struct log_seek));
+struct log_split split_sdcard_seek = LOG_SPLIT_INITIALIZER;
+#endif
 
 LOG_MODULE_REGISTER(log_sdcard, LOG_LEVEL_DBG);
 
 static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
+static synapse_pb_Imu g_queue_imu[QUEUE_DEPTH];
+static synapse_pb_ImuQ31Array g_queue_imu_q31_array[QUEUE_DEPTH];
+
+struct log_rate {
+	enum log_topic topic;
+	uint16_t rate_hz;
+};
+
+struct log_profile {
+	const char *name;
+	// for every topic not in rates
+	uint16_t rate_hz;
+	const struct log_rate *rates;
+	size_t rate_count;
+};
+
+static const struct log_rate g_rates_default[] = {
+	{LOG_TOPIC_imu, LOG_RATE_ALL},
+	{LOG_TOPIC_imu_q31_array, LOG_RATE_ALL},
+};
+
+// raw gyro data and the setpoints of every loop for controller tuning
+static const struct log_rate g_rates_tuning[] = {
+	{LOG_TOPIC_imu, LOG_RATE_ALL},
+	{LOG_TOPIC_imu_q31_array, LOG_RATE_ALL},
+	{LOG_TOPIC_accel_sp, 1000},
+	{LOG_TOPIC_actuators, 1000},
+	{LOG_TOPIC_angular_velocity_sp, 1000},
+	{LOG_TOPIC_attitude_sp, 1000},
+	{LOG_TOPIC_moment_ff, 1000},
+	{LOG_TOPIC_orientation_sp, 1000},
+	{LOG_TOPIC_position_sp, 1000},
+	{LOG_TOPIC_velocity_sp, 1000},
+};
+
+static const struct log_profile g_profiles[] = {
+	{"default", TOPIC_RATE_HZ, g_rates_default, ARRAY_SIZE(g_rates_default)},
+	{"tuning", TOPIC_RATE_HZ, g_rates_tuning, ARRAY_SIZE(g_rates_tuning)},
+	{"cruise", 10, NULL, 0},
+};
+
+static const char *const g_topic_names[] = {LOG_TOPICS(LOG_TOPIC_NAME)};
+
 struct context {
 	// zros node handle
 	struct zros_node node;
 	// subscriptions
-	struct zros_sub sub_accel_sp;
-	struct zros_sub sub_actuators;
-	struct zros_sub sub_altimeter;
-	// struct zros_sub sub_angular_velocity_ff;
-	struct zros_sub sub_angular_velocity_sp;
-	struct zros_sub sub_attitude_sp;
-	struct zros_sub sub_battery_state;
-	struct zros_sub sub_bezier_trajectory;
-	// struct zros_sub sub_bezier_trajectory_ethernet;
-	struct zros_sub sub_clock_offset_ethernet;
-	struct zros_sub sub_cmd_vel;
-	struct zros_sub sub_cmd_vel_ethernet;
-	struct zros_sub sub_imu;
-	// struct zros_sub sub_imu_q31_array;
-	struct zros_sub sub_input;
-	struct zros_sub sub_input_ethernet;
-	struct zros_sub sub_input_sbus;
-	struct zros_sub sub_led_array;
-	struct zros_sub sub_magnetic_field;
-	struct zros_sub sub_moment_ff;
-	struct zros_sub sub_nav_sat_fix;
-	struct zros_sub sub_odometry_estimator;
-	struct zros_sub sub_odometry_ethernet;
-	struct zros_sub sub_orientation_sp;
-	struct zros_sub sub_position_sp;
-	struct zros_sub sub_pwm;
-	struct zros_sub sub_safety;
-	struct zros_sub sub_status;
-	struct zros_sub sub_velocity_sp;
-	struct zros_sub sub_wheel_odometry;
+	LOG_TOPICS(LOG_MEMBER)
+	// rates set from the shell, and the ones subscribed with
+	uint8_t profile;
+	uint16_t rate_hz[LOG_TOPIC_COUNT];
+	uint16_t active_hz[LOG_TOPIC_COUNT];
+	atomic_t rates_changed;
+	bool rates_loaded;
+	// decimation of queued topics
+	int64_t period_ticks[LOG_TOPIC_COUNT];
+	int64_t next_ticks[LOG_TOPIC_COUNT];
 	// file
 	synapse_pb_Frame frame;
+	uint32_t offset;
+	struct log_class_stats class_stats[LOG_CLASS_COUNT];
+	// records dropped since the last drop record
+	bool drops_changed;
+	// bytes put in rb_sdcard since boot, where a split goes
+	uint32_t stream_pos;
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RECORD)
+	uint32_t index_offset;
+	uint64_t index_us;
+	uint64_t last_us;
+	bool has_index;
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+	uint32_t seek_pos;
+	uint64_t seek_us;
+	bool has_seek;
+	uint32_t seek_dropped;
+	// offset of the last record of every topic in the session file
+	uint32_t topic_offset[LOG_TOPIC_COUNT];
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SESSION_ON_ARM)
+	struct synapse_seqlock_sub sub_arming;
+	synapse_pb_Status arming;
+	bool armed;
+	// the current file already saw an arming
+	bool session_armed;
+	uint32_t sessions;
+	// armings while the previous split was still pending
+	uint32_t sessions_missed;
+#endif
 	// status
 	struct k_sem running;
 	size_t stack_size;
@@ -95,37 +334,8 @@ struct context {
 
 static struct context g_ctx = {
 	.node = {},
-	// Subscriptions
-	.sub_accel_sp = {},
-	.sub_actuators = {},
-	.sub_altimeter = {},
-	//.sub_angular_velocity_ff = {},
-	.sub_angular_velocity_sp = {},
-	.sub_attitude_sp = {},
-	.sub_battery_state = {},
-	.sub_bezier_trajectory = {},
-	//.sub_bezier_trajectory_ethernet = {},
-	.sub_clock_offset_ethernet = {},
-	.sub_cmd_vel = {},
-	.sub_cmd_vel_ethernet = {},
-	.sub_imu = {},
-	//.sub_imu_q31_array = {},
-	.sub_input = {},
-	.sub_input_ethernet = {},
-	.sub_input_sbus = {},
-	.sub_led_array = {},
-	.sub_magnetic_field = {},
-	.sub_moment_ff = {},
-	.sub_nav_sat_fix = {},
-	.sub_odometry_estimator = {},
-	.sub_odometry_ethernet = {},
-	.sub_orientation_sp = {},
-	.sub_position_sp = {},
-	.sub_pwm = {},
-	.sub_safety = {},
-	.sub_status = {},
-	.sub_velocity_sp = {},
-	.sub_wheel_odometry = {},
+	.profile = 0,
+	.rates_changed = ATOMIC_INIT(0),
 	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
 	.stack_size = MY_STACK_SIZE,
 	.stack_area = g_my_stack_area,
@@ -133,6 +343,302 @@ static struct context g_ctx = {
 	.perf = {},
 };
 
+static void log_sdcard_apply_profile(struct context *ctx, int profile)
+{
+	const struct log_profile *p = &g_profiles[profile];
+
+	for (int i = 0; i < LOG_TOPIC_COUNT; i++) {
+		ctx->rate_hz[i] = p->rate_hz;
+	}
+	for (size_t i = 0; i < p->rate_count; i++) {
+		ctx->rate_hz[p->rates[i].topic] = p->rates[i].rate_hz;
+	}
+	ctx->profile = profile;
+	atomic_set(&ctx->rates_changed, 1);
+}
+
+static int log_sdcard_subscribe(struct context *ctx)
+{
+	int ret = 0;
+
+	memcpy(ctx->active_hz, ctx->rate_hz, sizeof(ctx->active_hz));
+	LOG_TOPICS(LOG_SUBSCRIBE)
+	return ret;
+}
+
+static void log_sdcard_unsubscribe(struct context *ctx)
+{
+	LOG_TOPICS(LOG_UNSUBSCRIBE)
+	memset(ctx->active_hz, 0, sizeof(ctx->active_hz));
+}
+
+// hand bytes to the writer, the offset counts them so it is the file offset of the next record
+static int log_sdcard_put(struct context *ctx, enum log_class prio, const uint8_t *data,
+			  size_t size)
+{
+	struct log_class_stats *stats = &ctx->class_stats[prio];
+	uint32_t space = ring_buf_space_get(&rb_sdcard);
+	uint32_t reserve = g_class_reserve[prio];
+
+	if (stats->shedding && space >= reserve + SHED_HYSTERESIS) {
+		stats->shedding = false;
+	}
+	if (!stats->shedding && reserve > 0 && space < reserve + size) {
+		stats->shedding = true;
+		stats->shed++;
+		LOG_WRN("shedding %s, %u bytes free", g_class_names[prio], space);
+	}
+	if (stats->shedding || space < size) {
+		stats->dropped++;
+		stats->dropped_bytes += size;
+		ctx->drops_changed = true;
+		return -ENOSPC;
+	}
+	size_t size_written = ring_buf_put(&rb_sdcard, data, size);
+	ctx->offset += size_written;
+	ctx->stream_pos += size_written;
+	if (size_written != size) {
+		LOG_INF("partial write: %d/%d", size_written, size);
+		return -EIO;
+	}
+	if (ring_buf_size_get(&rb_sdcard) >= LOG_STAGE_CHUNK) {
+		k_sem_give(&sem_sdcard);
+	}
+	return 0;
+}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RECORD)
+
+#define LOG_RECORD_TOPIC(topic_name, kind, prio)                                                   \
+	{.frame_tag = SYNAPSE_TOPIC_FRAME_##topic_name,                                            \
+	 .id = LOG_TOPIC_##topic_name,                                                             \
+	 .name = #topic_name},
+
+static const struct synapse_record_topic g_record_topics[] = {LOG_TOPICS(LOG_RECORD_TOPIC)};
+
+static int log_sdcard_write_header(struct context *ctx)
+{
+	struct synapse_record_file file = {
+		.magic = SYNAPSE_RECORD_MAGIC,
+		.version = SYNAPSE_RECORD_VERSION,
+		.topic_count = LOG_TOPIC_COUNT,
+		.index_period_ms = INDEX_PERIOD_MS,
+	};
+	int ret = log_sdcard_put(ctx, LOG_CLASS_CRITICAL, (const uint8_t *)&file, sizeof(file));
+	if (ret < 0) {
+		return ret;
+	}
+	return log_sdcard_put(ctx, LOG_CLASS_CRITICAL, (const uint8_t *)g_record_topics,
+			      sizeof(g_record_topics));
+}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+static void log_sdcard_seek_put(struct context *ctx, const void *data, size_t size)
+{
+	if (ring_buf_space_get(&rb_sdcard_seek) < size) {
+		ctx->seek_dropped++;
+		return;
+	}
+	ctx->seek_pos += ring_buf_put(&rb_sdcard_seek, data, size);
+}
+
+// the sidecar starts with its own header, topics come from the recording
+static void log_sdcard_write_seek_header(struct context *ctx)
+{
+	struct synapse_record_seek_file file = {
+		.magic = SYNAPSE_RECORD_SEEK_MAGIC,
+		.version = SYNAPSE_RECORD_VERSION,
+		.topic_count = LOG_TOPIC_COUNT,
+		.period_ms = SEEK_PERIOD_MS,
+	};
+
+	log_sdcard_seek_put(ctx, &file, sizeof(file));
+	for (int i = 0; i < LOG_TOPIC_COUNT; i++) {
+		ctx->topic_offset[i] = SYNAPSE_RECORD_SEEK_NONE;
+	}
+	ctx->has_seek = false;
+}
+
+// taken at an index block once a seek period passed since the last entry
+static void log_sdcard_write_seek(struct context *ctx, uint64_t uptime_us, uint32_t offset)
+{
+	if (ctx->has_seek && uptime_us - ctx->seek_us < SEEK_PERIOD_MS * 1000ULL) {
+		return;
+	}
+	struct log_seek entry = {
+		.seek = {.uptime_us = uptime_us, .offset = offset},
+	};
+
+	memcpy(entry.topic_offset, ctx->topic_offset, sizeof(entry.topic_offset));
+	log_sdcard_seek_put(ctx, &entry, sizeof(entry));
+	ctx->seek_us = uptime_us;
+	ctx->has_seek = true;
+}
+#endif
+
+// the drop counts so far, right after an index block so no time passed since it
+static void log_sdcard_write_drops(struct context *ctx)
+{
+	uint8_t buf[SYNAPSE_RECORD_HEADER_MAX + sizeof(struct synapse_record_drops)];
+	struct synapse_record_drops drops;
+
+	for (int i = 0; i < LOG_CLASS_COUNT; i++) {
+		drops.dropped[i] = ctx->class_stats[i].dropped;
+		drops.shed[i] = ctx->class_stats[i].shed;
+	}
+	size_t n = synapse_record_header(buf, SYNAPSE_RECORD_DROPS, 0, sizeof(drops));
+	memcpy(buf + n, &drops, sizeof(drops));
+	if (log_sdcard_put(ctx, LOG_CLASS_CRITICAL, buf, n + sizeof(drops)) == 0) {
+		ctx->drops_changed = false;
+	}
+}
+
+static void log_sdcard_write_index(struct context *ctx, uint64_t uptime_us)
+{
+	uint8_t buf[1 + sizeof(struct synapse_record_index)];
+	struct synapse_record_index index = {
+		.magic = SYNAPSE_RECORD_INDEX_MAGIC,
+		.uptime_us = uptime_us,
+		.prev_offset = ctx->index_offset,
+	};
+	uint32_t offset = ctx->offset;
+
+	buf[0] = SYNAPSE_RECORD_INDEX;
+	memcpy(buf + 1, &index, sizeof(index));
+	if (log_sdcard_put(ctx, LOG_CLASS_CRITICAL, buf, sizeof(buf)) == 0) {
+		ctx->index_offset = offset;
+		ctx->index_us = uptime_us;
+		ctx->last_us = uptime_us;
+		ctx->has_index = true;
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+		log_sdcard_write_seek(ctx, uptime_us, offset);
+#endif
+		if (ctx->drops_changed) {
+			log_sdcard_write_drops(ctx);
+		}
+	}
+}
+
+static void log_sdcard_write_frame(struct context *ctx, enum log_topic id)
+{
+	static uint8_t buf[8192];
+
+	uint64_t now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+	if (!ctx->has_index || now_us - ctx->index_us >= INDEX_PERIOD_MS * 1000ULL) {
+		log_sdcard_write_index(ctx, now_us);
+	}
+	// deltas need a time base
+	if (!ctx->has_index) {
+		return;
+	}
+
+	// the topic is declared in the file header, so only the message is encoded and the
+	// record header goes in front of it once the size is known
+	uint8_t *payload = buf + SYNAPSE_RECORD_HEADER_MAX;
+	pb_ostream_t stream =
+		pb_ostream_from_buffer(payload, ARRAY_SIZE(buf) - SYNAPSE_RECORD_HEADER_MAX);
+	if (!pb_encode(&stream, synapse_pb_Frame_fields, &ctx->frame)) {
+		LOG_ERR("encoding failed: %s", PB_GET_ERROR(&stream));
+		return;
+	}
+
+	uint8_t header[SYNAPSE_RECORD_HEADER_MAX];
+	size_t header_size =
+		synapse_record_header(header, id, now_us - ctx->last_us, stream.bytes_written);
+
+	uint8_t *record = payload - header_size;
+	size_t size = header_size + stream.bytes_written;
+	uint32_t offset = ctx->offset;
+	memcpy(record, header, header_size);
+	if (log_sdcard_put(ctx, g_topic_class[id], record, size) == 0) {
+		ctx->last_us = now_us;
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+		ctx->topic_offset[id] = offset;
+#else
+		ARG_UNUSED(offset);
+#endif
+	}
+}
+
+#else
+
+static void log_sdcard_write_frame(struct context *ctx, enum log_topic id)
+{
+	static uint8_t buf[8192];
+
+	snprintf(ctx->frame.topic, sizeof(ctx->frame.topic), "%s", g_topic_names[id]);
+	pb_ostream_t stream = pb_ostream_from_buffer(buf, ARRAY_SIZE(buf));
+	if (!pb_encode_ex(&stream, synapse_pb_Frame_fields, &ctx->frame, PB_ENCODE_DELIMITED)) {
+		LOG_ERR("encoding failed: %s", PB_GET_ERROR(&stream));
+		return;
+	}
+	log_sdcard_put(ctx, g_topic_class[id], buf, stream.bytes_written);
+}
+
+#endif
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SESSION_ON_ARM)
+// end the session file here, the writer opens the next one for what follows
+static void log_sdcard_session_start(struct context *ctx)
+{
+	// the last split is still on its way to the card, this flight shares its file
+	if (log_split_pending(&split_sdcard) || log_split_pending(&LOG_WRITER_SPLIT)) {
+		ctx->sessions_missed++;
+		return;
+	}
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+	// the writer finishes the old sidecar when the data reaches its split
+	log_split_set(&split_sdcard_seek, ctx->seek_pos);
+#endif
+	log_split_set(&split_sdcard, ctx->stream_pos);
+	ctx->offset = 0;
+	ctx->sessions++;
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RECORD)
+	ctx->has_index = false;
+	ctx->index_offset = 0;
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+	log_sdcard_write_seek_header(ctx);
+#endif
+	if (log_sdcard_write_header(ctx) < 0) {
+		LOG_ERR("session header write failed");
+	}
+#endif
+	LOG_INF("session %u", ctx->sessions);
+}
+
+static void log_sdcard_session_check(struct context *ctx)
+{
+	if (!synapse_seqlock_sub_update_available(&ctx->sub_arming) ||
+	    synapse_seqlock_sub_update(&ctx->sub_arming, &ctx->arming) != 0) {
+		return;
+	}
+	bool armed = ctx->arming.arming == synapse_pb_Status_Arming_ARMING_ARMED;
+	if (armed && !ctx->armed) {
+		if (ctx->session_armed) {
+			log_sdcard_session_start(ctx);
+		}
+		ctx->session_armed = true;
+	}
+	ctx->armed = armed;
+}
+#endif
+
+// true if a queued message comes too soon after the last one logged
+static bool log_sdcard_decimate(struct context *ctx, enum log_topic id)
+{
+	if (ctx->period_ticks[id] == 0) {
+		return false;
+	} else if (ctx->period_ticks[id] < 0) {
+		return true;
+	}
+	int64_t now_ticks = k_uptime_ticks();
+	if (now_ticks < ctx->next_ticks[id]) {
+		return true;
+	}
+	ctx->next_ticks[id] = now_ticks + ctx->period_ticks[id];
+	return false;
+}
+
 static int log_sdcard_init(struct context *ctx)
 {
 	int ret = 0;
@@ -141,40 +647,38 @@ static int log_sdcard_init(struct context *ctx)
 	perf_counter_init(&ctx->perf, "log imu", 1.0 / 100);
 
 	// initialize node subscriptions
-	SUBSCRIBE_TOPIC(accel_sp);
-	SUBSCRIBE_TOPIC(actuators);
-	SUBSCRIBE_TOPIC(altimeter);
-	SUBSCRIBE_TOPIC(angular_velocity_sp);
-	SUBSCRIBE_TOPIC(attitude_sp);
-	SUBSCRIBE_TOPIC(battery_state);
-	SUBSCRIBE_TOPIC(bezier_trajectory);
-	// SUBSCRIBE_TOPIC(bezier_trajectory_ethernet);
-	SUBSCRIBE_TOPIC(clock_offset_ethernet);
-	SUBSCRIBE_TOPIC(cmd_vel);
-	SUBSCRIBE_TOPIC(cmd_vel_ethernet);
-	SUBSCRIBE_TOPIC(imu);
-	// SUBSCRIBE_TOPIC(imu_q31_array);
-	SUBSCRIBE_TOPIC(input);
-	SUBSCRIBE_TOPIC(input_ethernet);
-	SUBSCRIBE_TOPIC(input_sbus);
-	SUBSCRIBE_TOPIC(led_array);
-	SUBSCRIBE_TOPIC(magnetic_field);
-	SUBSCRIBE_TOPIC(moment_ff);
-	SUBSCRIBE_TOPIC(nav_sat_fix);
-	SUBSCRIBE_TOPIC(odometry_estimator);
-	SUBSCRIBE_TOPIC(odometry_ethernet);
-	SUBSCRIBE_TOPIC(orientation_sp);
-	SUBSCRIBE_TOPIC(position_sp);
-	SUBSCRIBE_TOPIC(pwm);
-	SUBSCRIBE_TOPIC(safety);
-	SUBSCRIBE_TOPIC(status);
-	SUBSCRIBE_TOPIC(velocity_sp);
-	SUBSCRIBE_TOPIC(wheel_odometry);
+	atomic_set(&ctx->rates_changed, 0);
+	ret = log_sdcard_subscribe(ctx);
+	if (ret < 0) {
+		return ret;
+	}
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SESSION_ON_ARM)
+	synapse_seqlock_sub_init(&ctx->sub_arming, &seqlock_status, 0);
+#endif
 
 	k_sem_take(&ctx->running, K_FOREVER);
 
-	// make sure writer is ready
-	k_msleep(1000);
+	// the writer mounts the card in its own thread, nothing else waits on it
+	if (boot_ready_wait(BOOT_READY(LOG_WRITER), K_MSEC(WRITER_READY_MS)) != 0) {
+		LOG_WRN("writer not ready after %d ms", WRITER_READY_MS);
+	}
+	boot_mark("log_sdcard init");
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RECORD)
+	// the writer keeps the file across a restart of the logger, only start a new time base
+	ctx->has_index = false;
+	if (ctx->offset == 0) {
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+		log_sdcard_write_seek_header(ctx);
+#endif
+		ret = log_sdcard_write_header(ctx);
+		if (ret < 0) {
+			LOG_ERR("header write failed: %d", ret);
+			return ret;
+		}
+	}
+	log_capture_init(g_record_topics, ARRAY_SIZE(g_record_topics));
+#endif
 	LOG_INF("init");
 	return ret;
 };
@@ -184,35 +688,10 @@ static int log_sdcard_fini(struct context *ctx)
 	int ret = 0;
 
 	// close subscriptions
-	UNSUBSCRIBE_TOPIC(accel_sp);
-	UNSUBSCRIBE_TOPIC(actuators);
-	UNSUBSCRIBE_TOPIC(altimeter);
-	UNSUBSCRIBE_TOPIC(angular_velocity_sp);
-	UNSUBSCRIBE_TOPIC(attitude_sp);
-	UNSUBSCRIBE_TOPIC(battery_state);
-	UNSUBSCRIBE_TOPIC(bezier_trajectory);
-	// UNSUBSCRIBE_TOPIC(bezier_trajectory_ethernet);
-	UNSUBSCRIBE_TOPIC(clock_offset_ethernet);
-	UNSUBSCRIBE_TOPIC(cmd_vel);
-	UNSUBSCRIBE_TOPIC(cmd_vel_ethernet);
-	UNSUBSCRIBE_TOPIC(imu);
-	// UNSUBSCRIBE_TOPIC(imu_q31_array);
-	UNSUBSCRIBE_TOPIC(input);
-	UNSUBSCRIBE_TOPIC(input_ethernet);
-	UNSUBSCRIBE_TOPIC(input_sbus);
-	UNSUBSCRIBE_TOPIC(led_array);
-	UNSUBSCRIBE_TOPIC(magnetic_field);
-	UNSUBSCRIBE_TOPIC(moment_ff);
-	UNSUBSCRIBE_TOPIC(nav_sat_fix);
-	UNSUBSCRIBE_TOPIC(odometry_estimator);
-	UNSUBSCRIBE_TOPIC(odometry_ethernet);
-	UNSUBSCRIBE_TOPIC(orientation_sp);
-	UNSUBSCRIBE_TOPIC(position_sp);
-	UNSUBSCRIBE_TOPIC(pwm);
-	UNSUBSCRIBE_TOPIC(safety);
-	UNSUBSCRIBE_TOPIC(status);
-	UNSUBSCRIBE_TOPIC(velocity_sp);
-	UNSUBSCRIBE_TOPIC(wheel_odometry);
+	log_sdcard_unsubscribe(ctx);
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SESSION_ON_ARM)
+	synapse_seqlock_sub_fini(&ctx->sub_arming);
+#endif
 
 	zros_node_fini(&ctx->node);
 
@@ -221,28 +700,6 @@ static int log_sdcard_fini(struct context *ctx)
 	return ret;
 };
 
-static void log_sdcard_write_frame(struct context *ctx)
-{
-	static uint8_t buf[8192];
-	size_t size_written, size_available;
-	pb_ostream_t stream = pb_ostream_from_buffer(buf, ARRAY_SIZE(buf));
-	if (!pb_encode_ex(&stream, synapse_pb_Frame_fields, &ctx->frame, PB_ENCODE_DELIMITED)) {
-		LOG_ERR("encoding failed: %s", PB_GET_ERROR(&stream));
-	} else {
-		size_available = ring_buf_space_get(&rb_sdcard);
-		if (size_available < stream.bytes_written) {
-			LOG_WRN("dropping packet, stream full");
-		} else {
-			size_written = ring_buf_put(&rb_sdcard, buf, stream.bytes_written);
-			if (size_written != stream.bytes_written) {
-				LOG_INF("partial write: %d/%d", size_written, stream.bytes_written);
-				return;
-			}
-			// LOG_INF("writing %d", stream.bytes_written);
-		}
-	}
-}
-
 static void log_sdcard_run(void *p0, void *p1, void *p2)
 {
 	struct context *ctx = p0;
@@ -262,48 +719,37 @@ static void log_sdcard_run(void *p0, void *p1, void *p2)
 
 	// while running
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
-		struct k_poll_event events[] = {
-			*zros_sub_get_event(&ctx->sub_imu),
-		};
-
-		int rc = 0;
-		rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(2000));
-		if (rc != 0) {
-			LOG_DBG("poll timeout");
+		if (atomic_cas(&ctx->rates_changed, 1, 0)) {
+			log_sdcard_unsubscribe(ctx);
+			ret = log_sdcard_subscribe(ctx);
+			if (ret < 0) {
+				LOG_ERR("resubscribe failed: %d", ret);
+				break;
+			}
+		}
+
+		// the imu paces the logger, without it poll at the default rate
+		if (LOG_ACTIVE_QUEUE(LOG_TOPIC_imu)) {
+			struct k_poll_event events[] = {
+				*synapse_queue_get_event(&ctx->queue_imu),
+			};
+
+			int rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(2000));
+			if (rc != 0) {
+				LOG_DBG("poll timeout");
+			}
+		} else {
+			k_msleep(1000 / TOPIC_RATE_HZ);
 		}
 
 		perf_counter_update(&ctx->perf);
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SESSION_ON_ARM)
+		log_sdcard_session_check(ctx);
+#endif
 
 		// check for updates
-		GET_UPDATE(accel_sp, vector3);
-		GET_UPDATE(actuators, actuators);
-		GET_UPDATE(altimeter, altimeter);
-		GET_UPDATE(angular_velocity_sp, vector3);
-		GET_UPDATE(attitude_sp, quaternion);
-		GET_UPDATE(battery_state, battery_state);
-		GET_UPDATE(bezier_trajectory, bezier_trajectory);
-		// GET_UPDATE(bezier_trajectory_ethernet, bezier_trajectory);
-		GET_UPDATE(clock_offset_ethernet, clock_offset);
-		GET_UPDATE(cmd_vel, twist);
-		GET_UPDATE(cmd_vel_ethernet, twist);
-		GET_UPDATE(imu, imu);
-		// GET_UPDATE(imu_q31_array, imu_q31_array);
-		GET_UPDATE(input, input);
-		GET_UPDATE(input_ethernet, input);
-		GET_UPDATE(input_sbus, input);
-		GET_UPDATE(led_array, led_array);
-		GET_UPDATE(magnetic_field, magnetic_field);
-		GET_UPDATE(moment_ff, vector3);
-		GET_UPDATE(nav_sat_fix, nav_sat_fix);
-		GET_UPDATE(odometry_estimator, odometry);
-		GET_UPDATE(odometry_ethernet, odometry);
-		GET_UPDATE(orientation_sp, vector3);
-		GET_UPDATE(position_sp, vector3);
-		GET_UPDATE(pwm, pwm);
-		GET_UPDATE(safety, safety);
-		GET_UPDATE(status, status);
-		GET_UPDATE(velocity_sp, vector3);
-		GET_UPDATE(wheel_odometry, wheel_odometry);
+		LOG_TOPICS(LOG_GET_UPDATE)
+		log_capture_poll();
 	}
 
 	// deconstructor
@@ -338,18 +784,177 @@ static int log_sdcard_cmd_handler(const struct shell *sh, size_t argc, char **ar
 		}
 	} else if (strcmp(argv[0], "status") == 0) {
 		shell_print(sh, "running: %d", (int)k_sem_count_get(&g_ctx.running) == 0);
+		shell_print(sh, "profile: %s", g_profiles[ctx->profile].name);
+		shell_print(sh, "overruns imu: %u imu_q31_array: %u", ctx->queue_imu.overruns,
+			    ctx->queue_imu_q31_array.overruns);
+		log_capture_status(sh);
+		for (int i = 0; i < LOG_CLASS_COUNT; i++) {
+			const struct log_class_stats *stats = &ctx->class_stats[i];
+			shell_print(sh, "%-8s dropped: %u (%u bytes) shed: %u%s", g_class_names[i],
+				    stats->dropped, stats->dropped_bytes, stats->shed,
+				    stats->shedding ? " shedding" : "");
+		}
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SESSION_ON_ARM)
+		shell_print(sh, "sessions started: %u missed: %u", ctx->sessions,
+			    ctx->sessions_missed);
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+		shell_print(sh, "seek entries dropped: %u", ctx->seek_dropped);
+#endif
 	}
 	return 0;
 }
 
-SHELL_SUBCMD_DICT_SET_CREATE(sub_log_sdcard, log_sdcard_cmd_handler, (start, &g_ctx, "start"),
-			     (stop, &g_ctx, "stop"), (status, &g_ctx, "status"));
+#if defined(CONFIG_SETTINGS)
+static int log_sdcard_settings_set(const char *key, size_t len, settings_read_cb read_cb,
+				   void *cb_arg)
+{
+	struct context *ctx = &g_ctx;
+
+	if (settings_name_steq(key, "profile", NULL)) {
+		if (len != sizeof(ctx->profile) ||
+		    read_cb(cb_arg, &ctx->profile, len) != (ssize_t)len ||
+		    ctx->profile >= ARRAY_SIZE(g_profiles)) {
+			ctx->profile = 0;
+			return -EINVAL;
+		}
+		return 0;
+	} else if (settings_name_steq(key, "rates", NULL)) {
+		// saved by a build with other topics
+		if (len != sizeof(ctx->rate_hz)) {
+			return -EINVAL;
+		}
+		if (read_cb(cb_arg, ctx->rate_hz, len) != (ssize_t)len) {
+			return -EIO;
+		}
+		ctx->rates_loaded = true;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(log_sdcard, "log_sdcard", NULL, log_sdcard_settings_set, NULL,
+			       NULL);
+#endif
+
+static void log_sdcard_save(const struct shell *sh, struct context *ctx)
+{
+#if defined(CONFIG_SETTINGS)
+	if (settings_save_one("log_sdcard/profile", &ctx->profile, sizeof(ctx->profile)) < 0 ||
+	    settings_save_one("log_sdcard/rates", ctx->rate_hz, sizeof(ctx->rate_hz)) < 0) {
+		shell_print(sh, "saving failed");
+	}
+#else
+	ARG_UNUSED(ctx);
+	shell_print(sh, "not saved, CONFIG_SETTINGS is off");
+#endif
+}
+
+static void log_sdcard_print_rate(const struct shell *sh, int topic, uint16_t rate_hz)
+{
+	if (rate_hz == LOG_RATE_OFF) {
+		shell_print(sh, "%-24s off", g_topic_names[topic]);
+	} else if (rate_hz == LOG_RATE_ALL) {
+		shell_print(sh, "%-24s all", g_topic_names[topic]);
+	} else {
+		shell_print(sh, "%-24s %u Hz", g_topic_names[topic], rate_hz);
+	}
+}
+
+static int cmd_log_sdcard(const struct shell *sh, size_t argc, char **argv)
+{
+	return log_sdcard_cmd_handler(sh, argc, argv, &g_ctx);
+}
+
+static int cmd_log_sdcard_profile(const struct shell *sh, size_t argc, char **argv)
+{
+	struct context *ctx = &g_ctx;
+
+	if (argc < 2) {
+		for (size_t i = 0; i < ARRAY_SIZE(g_profiles); i++) {
+			shell_print(sh, "%c %s", i == ctx->profile ? '*' : ' ', g_profiles[i].name);
+		}
+		return 0;
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(g_profiles); i++) {
+		if (strcmp(argv[1], g_profiles[i].name) == 0) {
+			log_sdcard_apply_profile(ctx, i);
+			log_sdcard_save(sh, ctx);
+			return 0;
+		}
+	}
+	shell_print(sh, "unknown profile: %s", argv[1]);
+	return -EINVAL;
+}
+
+// set one topic on top of the profile, off, all or a rate in Hz
+static int cmd_log_sdcard_rate(const struct shell *sh, size_t argc, char **argv)
+{
+	struct context *ctx = &g_ctx;
+
+	if (argc < 3) {
+		for (int i = 0; i < LOG_TOPIC_COUNT; i++) {
+			log_sdcard_print_rate(sh, i, ctx->rate_hz[i]);
+		}
+		return 0;
+	}
+
+	int topic = -1;
+	for (int i = 0; i < LOG_TOPIC_COUNT; i++) {
+		if (strcmp(argv[1], g_topic_names[i]) == 0) {
+			topic = i;
+		}
+	}
+	if (topic < 0) {
+		shell_print(sh, "unknown topic: %s", argv[1]);
+		return -EINVAL;
+	}
+
+	uint16_t rate_hz;
+	if (strcmp(argv[2], "off") == 0) {
+		rate_hz = LOG_RATE_OFF;
+	} else if (strcmp(argv[2], "all") == 0) {
+		rate_hz = LOG_RATE_ALL;
+	} else {
+		int hz = atoi(argv[2]);
+		if (hz <= 0 || hz >= LOG_RATE_ALL) {
+			shell_print(sh, "rate must be off, all or 1 to %u Hz", LOG_RATE_ALL - 1);
+			return -EINVAL;
+		}
+		rate_hz = hz;
+	}
+
+	ctx->rate_hz[topic] = rate_hz;
+	atomic_set(&ctx->rates_changed, 1);
+	log_sdcard_save(sh, ctx);
+	log_sdcard_print_rate(sh, topic, rate_hz);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+	sub_log_sdcard, SHELL_CMD(start, NULL, "start", cmd_log_sdcard),
+	SHELL_CMD(stop, NULL, "stop", cmd_log_sdcard),
+	SHELL_CMD(status, NULL, "status", cmd_log_sdcard),
+	SHELL_CMD_ARG(profile, NULL, "List profiles or select one.", cmd_log_sdcard_profile, 1, 1),
+	SHELL_CMD_ARG(rate, NULL, "List rates or set <topic> <off|all|hz>.", cmd_log_sdcard_rate,
+		      1, 2),
+	SHELL_SUBCMD_SET_END);
 
 SHELL_CMD_REGISTER(log_sdcard, &sub_log_sdcard, "log_sdcard commands", NULL);
 
 static int log_sdcard_sys_init(void)
 {
-	return start(&g_ctx);
+	struct context *ctx = &g_ctx;
+
+#if defined(CONFIG_SETTINGS)
+	settings_subsys_init();
+	settings_load_subtree("log_sdcard");
+#endif
+	// saved rates already hold the profile and the overrides on top of it
+	if (!ctx->rates_loaded) {
+		log_sdcard_apply_profile(ctx, ctx->profile);
+	}
+	return start(ctx);
 };
 
 SYS_INIT(log_sdcard_sys_init, APPLICATION, 0);
@@ -0,0 +1,77 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SYNAPSE_LOG_SDCARD_SESSION_H
+#define CEREBRI_SYNAPSE_LOG_SDCARD_SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+/*
+ * Every boot, and every arming after the current file already saw one,
+ * starts a session in a new numbered file, see the writer. The logger
+ * only knows where in its stream the new session starts, so each ring
+ * between it and the card has a split, a position in that stream in
+ * bytes since boot modulo 2^32. The stage reading the ring stops short
+ * of the split, lets the old session have what came before it and then
+ * passes the split on in the stream it writes itself.
+ */
+
+struct log_split {
+	atomic_t pending;
+	atomic_t at;
+};
+
+#define LOG_SPLIT_INITIALIZER {.pending = ATOMIC_INIT(0), .at = ATOMIC_INIT(0)}
+
+// rb_sdcard, from the logger
+extern struct log_split split_sdcard;
+// rb_sdcard_seek, the seek entries of the recording
+extern struct log_split split_sdcard_seek;
+
+// number of the session file the writer has open, 0 while the card is not mounted
+uint32_t log_sdcard_writer_session(void);
+
+// set by the producer before it puts the first byte of the new session
+static inline void log_split_set(struct log_split *split, uint32_t at)
+{
+	atomic_set(&split->at, at);
+	atomic_set(&split->pending, 1);
+}
+
+static inline bool log_split_pending(struct log_split *split)
+{
+	return atomic_get(&split->pending) != 0;
+}
+
+/*
+ * bytes a reader at pos may take before the split, size is what it found
+ * buffered before calling, so no byte of a later session is counted in it
+ */
+static inline size_t log_split_limit(struct log_split *split, uint32_t pos, size_t size)
+{
+	if (!log_split_pending(split)) {
+		return size;
+	}
+	return MIN(size, (uint32_t)atomic_get(&split->at) - pos);
+}
+
+// a reader at pos has everything before the split
+static inline bool log_split_at(struct log_split *split, uint32_t pos)
+{
+	return log_split_pending(split) && (uint32_t)atomic_get(&split->at) == pos;
+}
+
+// true once, for the reader that got to the split
+static inline bool log_split_reached(struct log_split *split, uint32_t pos)
+{
+	return log_split_at(split, pos) && atomic_cas(&split->pending, 1, 0);
+}
+
+#endif // CEREBRI_SYNAPSE_LOG_SDCARD_SESSION_H
+// vi: ts=4 sw=4 et
@@ -4,22 +4,63 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
 
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
 
+#include <cerebri/core/boot.h>
 #include <cerebri/core/perf_counter.h>
+#include <cerebri/core/perf_histogram.h>
+#include <cerebri/core/trace.h>
 
 #include <ff.h>
 #include <zephyr/fs/fs.h>
 #include <zephyr/storage/disk_access.h>
 
+#include "block_log.h"
+#include "compress.h"
+#include "session.h"
+
 #define FS_RET_OK     FR_OK
 #define MY_STACK_SIZE 8192
 #define MY_PRIORITY   1
-#define BUF_SIZE      (131072 * 2)
+#define TRACE_CHUNK   256
+#define SECTOR_SIZE   512
+#define WRITE_CHUNK   CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_WRITE_CHUNK
+#define FLUSH_MS      CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_FLUSH_MS
+#define PREALLOC_SIZE ((uint64_t)CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_PREALLOC_MB << 20)
+// a write this slow would have overflowed a ring sized for 10 ms at a time
+#define STALL_US      100000
+#define SEEK_CHUNK    256
+// mount point and an 8.3 name
+#define LOG_PATH_MAX  24
+
+BUILD_ASSERT(WRITE_CHUNK % SECTOR_SIZE == 0, "write chunk must be whole sectors");
+
+// session files are numbered, rec0001.rec, rec0002.rec and so on
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RECORD)
+#define LOG_PREFIX "rec"
+#else
+#define LOG_PREFIX "pb"
+#endif
+
+// compressed logs are framed blocks, see compress.h
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_LZ4)
+#define LOG_EXT "lz4"
+#else
+#define LOG_EXT LOG_PREFIX
+#endif
 
 extern struct ring_buf rb_sdcard;
+extern struct k_sem sem_sdcard;
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+extern struct ring_buf rb_sdcard_seek;
+#endif
+
+// staging for whole sector writes, FatFS hands aligned full sectors straight to the card
+static uint8_t g_write_buf[WRITE_CHUNK] __aligned(4);
 
 static FATFS fat_fs;
 static struct fs_mount_t mp = {
@@ -33,11 +74,32 @@ static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
 
 struct context {
 	struct fs_file_t file;
+	// number and path of the session file
+	uint32_t session;
+	char path[LOG_PATH_MAX];
+	// bytes taken from the writer ring since boot
+	uint32_t data_pos;
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+	struct fs_file_t seek_file;
+	uint32_t seek_pos;
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+	struct block_log block_log;
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_TRACE)
+	struct fs_file_t trace_file;
+	struct trace_reader trace_reader;
+#endif
 	struct k_sem running;
 	size_t stack_size;
 	k_thread_stack_t *stack_area;
 	struct k_thread thread_data;
 	size_t total_size_written;
+	uint64_t data_size_written;
+	// write latency in us
+	struct perf_histogram write_us;
+	uint32_t write_max_us;
+	uint32_t stalls;
 };
 
 static struct context g_ctx = {
@@ -96,44 +158,269 @@ static int mount_sd_card(void)
 	return 0;
 }
 
+#if !defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+// grow the file to its final size up front, so the FAT is not touched while logging
+static void log_sdcard_writer_prealloc(struct context *ctx)
+{
+#if FF_USE_EXPAND
+	FIL *fp = ctx->file.filep;
+
+	// f_expand only takes an empty file
+	fs_truncate(&ctx->file, 0);
+	if (PREALLOC_SIZE > 0) {
+		FRESULT res = f_expand(fp, PREALLOC_SIZE, 1);
+		if (res != FR_OK) {
+			LOG_WRN("preallocating %u MB failed: %d",
+				CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_PREALLOC_MB, res);
+		}
+	}
+#else
+	ARG_UNUSED(ctx);
+#endif
+}
+#endif
+
+static void log_sdcard_writer_path(char *path, uint32_t number, const char *ext)
+{
+	snprintf(path, LOG_PATH_MAX, "%s/" LOG_PREFIX "%04u.%s", disk_mount_pt, number, ext);
+}
+
+// one above the highest numbered log on the card, so no earlier flight is overwritten
+static uint32_t log_sdcard_writer_next_number(void)
+{
+	static struct fs_dirent entry;
+	struct fs_dir_t dir;
+	size_t prefix = strlen(LOG_PREFIX);
+	uint32_t number = 0;
+
+	fs_dir_t_init(&dir);
+	if (fs_opendir(&dir, disk_mount_pt) < 0) {
+		return 1;
+	}
+	while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != '\0') {
+		// without long names FatFS lists them upper case
+		if (entry.type != FS_DIR_ENTRY_FILE ||
+		    strncasecmp(entry.name, LOG_PREFIX, prefix) != 0) {
+			continue;
+		}
+		char *end;
+		unsigned long n = strtoul(entry.name + prefix, &end, 10);
+		if (end != entry.name + prefix && *end == '.') {
+			number = MAX(number, (uint32_t)n);
+		}
+	}
+	fs_closedir(&dir);
+	return number + 1;
+}
+
+static int log_sdcard_writer_open(struct context *ctx)
+{
+	int ret = 0;
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+	ret = block_log_open(&ctx->block_log);
+	if (ret < 0) {
+		return ret;
+	}
+#else
+	log_sdcard_writer_path(ctx->path, ctx->session, LOG_EXT);
+	fs_file_t_init(&ctx->file);
+	ret = fs_open(&ctx->file, ctx->path, FS_O_RDWR | FS_O_CREATE);
+	if (ret < 0) {
+		return ret;
+	}
+	log_sdcard_writer_prealloc(ctx);
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+	char path[LOG_PATH_MAX];
+	log_sdcard_writer_path(path, ctx->session, "idx");
+	fs_file_t_init(&ctx->seek_file);
+	ret = fs_open(&ctx->seek_file, path, FS_O_WRITE | FS_O_CREATE);
+	if (ret < 0) {
+		fs_close(&ctx->file);
+		return ret;
+	}
+#endif
+	LOG_INF("session %s", ctx->path);
+#endif
+	ctx->data_size_written = 0;
+	return ret;
+}
+
+static int log_sdcard_writer_close(struct context *ctx)
+{
+	int ret = 0;
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+	ret = block_log_close(&ctx->block_log);
+	if (ret != 0) {
+		LOG_ERR("failed to close raw log");
+	}
+#else
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+	if (fs_close(&ctx->seek_file) != 0) {
+		LOG_ERR("failed to close seek file");
+	}
+#endif
+	// drop what is left of the preallocation
+	fs_truncate(&ctx->file, ctx->data_size_written);
+
+	ret = fs_close(&ctx->file);
+	if (ret != 0) {
+		LOG_ERR("failed to close file");
+	}
+#endif
+	return ret;
+}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+// the seek entries queued so far, short of a split until the data gets there
+static void log_sdcard_writer_seek(struct context *ctx)
+{
+	uint8_t buf[SEEK_CHUNK];
+	size_t size = log_split_limit(&split_sdcard_seek, ctx->seek_pos,
+				      ring_buf_size_get(&rb_sdcard_seek));
+
+	while (size > 0) {
+		uint32_t n = ring_buf_get(&rb_sdcard_seek, buf, MIN(size, sizeof(buf)));
+		ctx->seek_pos += n;
+		size -= n;
+		if (fs_write(&ctx->seek_file, buf, n) != n) {
+			LOG_ERR("seek write failed");
+		}
+		ctx->total_size_written += n;
+	}
+}
+#endif
+
+// every byte of the session is written, the rest of the stream goes to the next file
+static void log_sdcard_writer_rotate(struct context *ctx)
+{
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+	// the logger splits the seek stream first, so it is all queued by now
+	log_sdcard_writer_seek(ctx);
+	(void)log_split_reached(&split_sdcard_seek, ctx->seek_pos);
+#endif
+	log_sdcard_writer_close(ctx);
+	ctx->session++;
+	int ret = log_sdcard_writer_open(ctx);
+	if (ret < 0) {
+		LOG_ERR("opening session %u failed: %d", ctx->session, ret);
+	}
+	// cleared last, the logger starts no session while one is pending
+	(void)log_split_reached(&LOG_WRITER_SPLIT, ctx->data_pos);
+}
+
 static int log_sdcard_writer_init(struct context *ctx)
 {
 	int ret = 0;
 
+#if !defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
 	ret = mount_sd_card();
 	if (ret < 0) {
 		return ret;
 	}
+	boot_mark("sd mounted");
 
-	fs_file_t_init(&ctx->file);
+	uint32_t cluster_size = fat_fs.csize * SECTOR_SIZE;
+	if (WRITE_CHUNK % cluster_size != 0) {
+		LOG_WRN("write chunk %u not a multiple of the cluster size %u", WRITE_CHUNK,
+			cluster_size);
+	}
 
-	// delete old file if it exists
-	fs_unlink("/SD:/data.pb");
+	ctx->session = log_sdcard_writer_next_number();
+#endif
+	ret = log_sdcard_writer_open(ctx);
+	if (ret < 0) {
+		return ret;
+	}
 
-	// open file
-	ret = fs_open(&ctx->file, "/SD:/data.pb", FS_O_WRITE | FS_O_CREATE | FS_O_APPEND);
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_TRACE)
+	fs_file_t_init(&ctx->trace_file);
+	fs_unlink("/SD:/trace.bin");
+	ret = fs_open(&ctx->trace_file, "/SD:/trace.bin", FS_O_WRITE | FS_O_CREATE | FS_O_APPEND);
 	if (ret < 0) {
 		return ret;
 	}
+	struct trace_header header;
+	trace_header_init(&header);
+	fs_write(&ctx->trace_file, &header, sizeof(header));
+	trace_reader_init(&ctx->trace_reader);
+#endif
 
 	k_sem_take(&ctx->running, K_FOREVER);
 	LOG_INF("init");
 	return ret;
 };
 
+// size is at most what is buffered, a write stops at a split and opens the next session file
+static void log_sdcard_writer_write(struct context *ctx, size_t size)
+{
+	size = log_split_limit(&LOG_WRITER_SPLIT, ctx->data_pos, size);
+	uint32_t n = ring_buf_get(&LOG_WRITER_RB, g_write_buf, size);
+	ctx->data_pos += n;
+	if (n == 0) {
+		if (log_split_at(&LOG_WRITER_SPLIT, ctx->data_pos)) {
+			log_sdcard_writer_rotate(ctx);
+		}
+		return;
+	}
+
+	uint32_t start = k_cycle_get_32();
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+	ssize_t size_written = block_log_write(&ctx->block_log, g_write_buf, n);
+#else
+	ssize_t size_written = fs_write(&ctx->file, g_write_buf, n);
+#endif
+	uint32_t us = k_cyc_to_us_ceil32(k_cycle_get_32() - start);
+
+	perf_histogram_record(&ctx->write_us, us);
+	ctx->write_max_us = MAX(ctx->write_max_us, us);
+	if (us > STALL_US) {
+		ctx->stalls++;
+	}
+	if (size_written != n) {
+		LOG_ERR("file write failed %d/%d", size_written, n);
+	}
+	if (size_written > 0) {
+		ctx->total_size_written += size_written;
+		ctx->data_size_written += size_written;
+	}
+	if (log_split_at(&LOG_WRITER_SPLIT, ctx->data_pos)) {
+		log_sdcard_writer_rotate(ctx);
+	}
+}
+
 static int log_sdcard_writer_fini(struct context *ctx)
 {
 	int ret = 0;
 
-	ret = fs_close(&ctx->file);
+	// the tail that did not fill a sector, possibly across a split into the next session
+	do {
+		log_compress_flush();
+		while (!ring_buf_is_empty(&LOG_WRITER_RB)) {
+			size_t size = MIN(ring_buf_size_get(&LOG_WRITER_RB), WRITE_CHUNK);
+			log_sdcard_writer_write(ctx, size);
+		}
+	} while (!ring_buf_is_empty(&rb_sdcard));
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+	log_sdcard_writer_seek(ctx);
+#endif
+
+	ret = log_sdcard_writer_close(ctx);
+
+#if !defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_TRACE)
+	ret = fs_close(&ctx->trace_file);
 	if (ret != 0) {
-		LOG_ERR("failed to close file");
+		LOG_ERR("failed to close trace file");
 	}
+#endif
 
 	ret = fs_unmount(&mp);
 	if (ret < 0) {
 		LOG_ERR("failed to unmount disk");
 	}
+#endif
 
 	k_sem_give(&ctx->running);
 	LOG_INF("fini");
@@ -154,30 +441,54 @@ static void log_sdcard_writer_run(void *p0, void *p1, void *p2)
 		LOG_ERR("init failed: %d", ret);
 		return;
 	}
+	boot_ready_set(BOOT_READY_LOG_WRITER);
 
 	// while running
-	size_t size;
-	size_t size_written;
 	int64_t last_ticks = 0;
-	uint8_t *data;
 	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
 
-		k_msleep(1);
-		size = ring_buf_get_claim(&rb_sdcard, &data, BUF_SIZE);
-		if (size > 0) {
-			// LOG_INF("writing: %d bytes to sdcard", size);
-			size_written = fs_write(&ctx->file, data, size);
-			ctx->total_size_written += size_written;
-			ring_buf_get_finish(&rb_sdcard, size);
-			if (size != size_written) {
-				LOG_ERR("file write failed %d/%d", size_written, size);
+		// the logger wakes us once a chunk is buffered, the timeout bounds how long a
+		// slow trickle of data sits in ram
+		int timeout = k_sem_take(&LOG_WRITER_SEM, K_MSEC(FLUSH_MS));
+		while (ring_buf_size_get(&LOG_WRITER_RB) >= WRITE_CHUNK) {
+			log_sdcard_writer_write(ctx, WRITE_CHUNK);
+		}
+		if (timeout != 0) {
+			// keep the file offset sector aligned, the rest waits for the next chunk
+			size_t tail = ROUND_DOWN(ring_buf_size_get(&LOG_WRITER_RB), SECTOR_SIZE);
+			if (tail > 0) {
+				log_sdcard_writer_write(ctx, tail);
+			}
+		}
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+		log_sdcard_writer_seek(ctx);
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_TRACE)
+		static struct trace_event trace_buf[TRACE_CHUNK];
+		size_t n_events = trace_read(&ctx->trace_reader, trace_buf, ARRAY_SIZE(trace_buf));
+		if (n_events > 0) {
+			ssize_t size_written = fs_write(&ctx->trace_file, trace_buf,
+							n_events * sizeof(trace_buf[0]));
+			if (size_written > 0) {
+				ctx->total_size_written += size_written;
 			}
 		}
+#endif
 		int64_t now_ticks = k_uptime_ticks();
 		if (now_ticks - last_ticks > 4 * CONFIG_SYS_CLOCK_TICKS_PER_SEC) {
 			// LOG_INF("fsync");
 			last_ticks = now_ticks;
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+			block_log_sync(&ctx->block_log);
+#else
 			fs_sync(&ctx->file);
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_SEEK)
+			fs_sync(&ctx->seek_file);
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_TRACE)
+			fs_sync(&ctx->trace_file);
+#endif
 		}
 	}
 
@@ -195,6 +506,57 @@ static int start(struct context *ctx)
 	return 0;
 }
 
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+// copy the latest raw session to the next numbered file on the FAT volume
+static int log_sdcard_writer_export(const struct shell *sh, struct context *ctx)
+{
+	int ret = block_log_load(&ctx->block_log);
+	if (ret < 0) {
+		return ret;
+	}
+	int session = ctx->block_log.super.session_count - 1;
+	if (session < 0) {
+		shell_print(sh, "no raw log sessions");
+		return -ENOENT;
+	}
+
+	ret = mount_sd_card();
+	if (ret < 0) {
+		return ret;
+	}
+
+	char path[LOG_PATH_MAX];
+	log_sdcard_writer_path(path, log_sdcard_writer_next_number(), LOG_EXT);
+
+	struct fs_file_t file;
+	fs_file_t_init(&file);
+	ret = fs_open(&file, path, FS_O_WRITE | FS_O_CREATE);
+	if (ret == 0) {
+		uint32_t offset = 0;
+		ssize_t n;
+		while ((n = block_log_read(&ctx->block_log, session, offset, g_write_buf,
+					   sizeof(g_write_buf))) > 0) {
+			if (fs_write(&file, g_write_buf, n) != n) {
+				n = -EIO;
+				break;
+			}
+			offset += n;
+		}
+		ret = n < 0 ? n : 0;
+		fs_close(&file);
+		shell_print(sh, "exported session %d, %u bytes to %s: %d", session, offset, path,
+			    ret);
+	}
+	fs_unmount(&mp);
+	return ret;
+}
+#endif
+
+uint32_t log_sdcard_writer_session(void)
+{
+	return k_sem_count_get(&g_ctx.running) == 0 ? g_ctx.session : 0;
+}
+
 static int log_sdcard_writer_cmd_handler(const struct shell *sh, size_t argc, char **argv,
 					 void *data)
 {
@@ -217,13 +579,39 @@ static int log_sdcard_writer_cmd_handler(const struct shell *sh, size_t argc, ch
 		shell_print(sh, "running: %d size written: %10.3f MB",
 			    (int)k_sem_count_get(&g_ctx.running) == 0,
 			    ((double)ctx->total_size_written) / 1048576L);
+		shell_print(sh, "write us p50: %u p99: %u max: %u stalls > %u ms: %u",
+			    perf_histogram_percentile(&ctx->write_us, 5000),
+			    perf_histogram_percentile(&ctx->write_us, 9900), ctx->write_max_us,
+			    STALL_US / 1000, ctx->stalls);
+		shell_print(sh, "buffered: %u bytes", ring_buf_size_get(&rb_sdcard));
+#if !defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+		shell_print(sh, "session: %s", ctx->path);
+#endif
+		log_compress_status(sh);
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_TRACE)
+		shell_print(sh, "trace events dropped: %u", ctx->trace_reader.dropped);
+#endif
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+	} else if (strcmp(argv[0], "export") == 0) {
+		if (k_sem_count_get(&g_ctx.running) == 0) {
+			shell_print(sh, "stop the writer first");
+		} else {
+			return log_sdcard_writer_export(sh, ctx);
+		}
+#endif
 	}
 	return 0;
 }
 
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_RAW)
+SHELL_SUBCMD_DICT_SET_CREATE(sub_log_sdcard_writer, log_sdcard_writer_cmd_handler,
+			     (start, &g_ctx, "start"), (stop, &g_ctx, "stop"),
+			     (status, &g_ctx, "status"), (export, &g_ctx, "export"));
+#else
 SHELL_SUBCMD_DICT_SET_CREATE(sub_log_sdcard_writer, log_sdcard_writer_cmd_handler,
 			     (start, &g_ctx, "start"), (stop, &g_ctx, "stop"),
 			     (status, &g_ctx, "status"));
+#endif
 
 SHELL_CMD_REGISTER(log_sdcard_writer, &sub_log_sdcard_writer, "log_sdcard_writer commands", NULL);
 
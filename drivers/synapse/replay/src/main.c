@@ -0,0 +1,316 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/fs/fs.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <pb_decode.h>
+
+#include <synapse_record.h>
+#include <synapse_topic_list.h>
+
+#define MY_STACK_SIZE  8192
+#define MY_PRIORITY    2
+#define MAX_FRAME_SIZE 8192
+#define MAX_TOPICS     8
+
+LOG_MODULE_REGISTER(synapse_replay, CONFIG_CEREBRI_SYNAPSE_REPLAY_LOG_LEVEL);
+
+static K_THREAD_STACK_DEFINE(g_my_stack_area, MY_STACK_SIZE);
+
+struct context {
+	struct fs_file_t file;
+	synapse_pb_Frame frame;
+	uint8_t buf[MAX_FRAME_SIZE];
+	// topic and frame tag of each record id, from the file header
+	struct zros_topic *id_topic[SYNAPSE_RECORD_MAX_TOPICS];
+	uint16_t id_tag[SYNAPSE_RECORD_MAX_TOPICS];
+	size_t id_count;
+	uint64_t uptime_us;
+	// replay only these topics, all when empty
+	struct zros_topic *topics[MAX_TOPICS];
+	size_t topic_count;
+	int speed;
+	uint32_t replayed;
+	uint32_t skipped;
+	uint32_t errors;
+	struct k_sem running;
+	size_t stack_size;
+	k_thread_stack_t *stack_area;
+	struct k_thread thread_data;
+};
+
+static struct context g_ctx = {
+	.file = {},
+	.frame = synapse_pb_Frame_init_default,
+	.topic_count = 0,
+	.speed = CONFIG_CEREBRI_SYNAPSE_REPLAY_SPEED,
+	.running = Z_SEM_INITIALIZER(g_ctx.running, 1, 1),
+	.stack_size = MY_STACK_SIZE,
+	.stack_area = g_my_stack_area,
+	.thread_data = {},
+};
+
+static int synapse_replay_init(struct context *ctx)
+{
+	struct synapse_record_file header;
+	struct synapse_record_topic record_topic;
+
+	fs_file_t_init(&ctx->file);
+	int ret = fs_open(&ctx->file, CONFIG_CEREBRI_SYNAPSE_REPLAY_FILE, FS_O_READ);
+	if (ret < 0) {
+		LOG_ERR("open %s failed: %d", CONFIG_CEREBRI_SYNAPSE_REPLAY_FILE, ret);
+		return ret;
+	}
+
+	if (fs_read(&ctx->file, &header, sizeof(header)) != sizeof(header) ||
+	    header.magic != SYNAPSE_RECORD_MAGIC || header.version != SYNAPSE_RECORD_VERSION ||
+	    header.topic_count > SYNAPSE_RECORD_MAX_TOPICS) {
+		LOG_ERR("%s is not a recording", CONFIG_CEREBRI_SYNAPSE_REPLAY_FILE);
+		fs_close(&ctx->file);
+		return -EINVAL;
+	}
+
+	// topics this build does not have are skipped
+	for (size_t i = 0; i < header.topic_count; i++) {
+		ssize_t n = fs_read(&ctx->file, &record_topic, sizeof(record_topic));
+		if (n != sizeof(record_topic) || record_topic.id != i) {
+			LOG_ERR("bad topic table");
+			fs_close(&ctx->file);
+			return -EINVAL;
+		}
+		record_topic.name[SYNAPSE_RECORD_NAME_LEN - 1] = '\0';
+		ctx->id_topic[i] = synapse_topic_find(record_topic.name);
+		ctx->id_tag[i] = record_topic.frame_tag;
+	}
+	ctx->id_count = header.topic_count;
+	ctx->uptime_us = 0;
+
+	ctx->replayed = 0;
+	ctx->skipped = 0;
+	ctx->errors = 0;
+	k_sem_take(&ctx->running, K_FOREVER);
+	LOG_INF("init");
+	return 0;
+}
+
+static void synapse_replay_fini(struct context *ctx)
+{
+	fs_close(&ctx->file);
+	k_sem_give(&ctx->running);
+	LOG_INF("fini, replayed %u skipped %u errors %u", ctx->replayed, ctx->skipped,
+		ctx->errors);
+}
+
+static bool topic_selected(struct context *ctx, struct zros_topic *topic)
+{
+	if (ctx->topic_count == 0) {
+		return true;
+	}
+	for (size_t i = 0; i < ctx->topic_count; i++) {
+		if (ctx->topics[i] == topic) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool file_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+	return fs_read(stream->state, buf, count) == (ssize_t)count;
+}
+
+// 1 with the next message in buf, 0 at the end of the recording, index blocks set the time
+static int read_record(struct context *ctx, uint8_t *id, uint32_t *size)
+{
+	while (true) {
+		ssize_t n = fs_read(&ctx->file, id, 1);
+		if (n == 0) {
+			return 0;
+		} else if (n != 1) {
+			return -EIO;
+		} else if (*id != SYNAPSE_RECORD_INDEX) {
+			break;
+		}
+		struct synapse_record_index index;
+		if (fs_read(&ctx->file, &index, sizeof(index)) != sizeof(index) ||
+		    index.magic != SYNAPSE_RECORD_INDEX_MAGIC) {
+			return -EIO;
+		}
+		ctx->uptime_us = index.uptime_us;
+	}
+
+	pb_istream_t stream = {.callback = file_read, .state = &ctx->file, .bytes_left = SIZE_MAX};
+	uint32_t delta_us;
+	if (!pb_decode_varint32(&stream, &delta_us) || !pb_decode_varint32(&stream, size)) {
+		return -EIO;
+	}
+	if ((*id >= ctx->id_count && *id != SYNAPSE_RECORD_DROPS) || *size > sizeof(ctx->buf)) {
+		return -EIO;
+	}
+	if (fs_read(&ctx->file, ctx->buf, *size) != (ssize_t)*size) {
+		return -EIO;
+	}
+	ctx->uptime_us += delta_us;
+	return 1;
+}
+
+static void synapse_replay_run(void *p0, void *p1, void *p2)
+{
+	struct context *ctx = p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	if (synapse_replay_init(ctx) < 0) {
+		return;
+	}
+
+	uint8_t id;
+	uint32_t size;
+	int64_t start_ticks = k_uptime_ticks();
+	uint64_t start_us = 0;
+	bool first = true;
+
+	while (k_sem_take(&ctx->running, K_NO_WAIT) < 0) {
+		int ret = read_record(ctx, &id, &size);
+		if (ret == 0) {
+			LOG_INF("end of recording");
+			break;
+		} else if (ret < 0) {
+			LOG_ERR("truncated record");
+			ctx->errors++;
+			break;
+		}
+
+		// drop counts of the logger, not a topic
+		if (id == SYNAPSE_RECORD_DROPS) {
+			ctx->skipped++;
+			continue;
+		}
+
+		struct zros_topic *topic = ctx->id_topic[id];
+		if (topic == NULL || !topic_selected(ctx, topic)) {
+			ctx->skipped++;
+			continue;
+		}
+
+		pb_istream_t stream = pb_istream_from_buffer(ctx->buf, size);
+		if (!pb_decode(&stream, synapse_pb_Frame_fields, &ctx->frame) ||
+		    ctx->frame.which_msg != ctx->id_tag[id]) {
+			LOG_WRN("decoding failed: %s", PB_GET_ERROR(&stream));
+			ctx->errors++;
+			continue;
+		}
+
+		// keep the recorded spacing, scaled by the replay speed
+		if (first) {
+			start_us = ctx->uptime_us;
+			first = false;
+		}
+		if (ctx->speed > 0) {
+			uint64_t offset_us = (ctx->uptime_us - start_us) / ctx->speed;
+			int64_t due = start_ticks + k_us_to_ticks_floor64(offset_us);
+			int64_t wait = due - k_uptime_ticks();
+			if (wait > 0) {
+				k_sleep(K_TICKS(wait));
+			}
+		}
+
+		synapse_topic_republish(topic, &ctx->frame.msg);
+		ctx->replayed++;
+	}
+
+	synapse_replay_fini(ctx);
+}
+
+static int start(struct context *ctx)
+{
+	k_tid_t tid =
+		k_thread_create(&ctx->thread_data, ctx->stack_area, ctx->stack_size,
+				synapse_replay_run, ctx, NULL, NULL, MY_PRIORITY, 0, K_FOREVER);
+	k_thread_name_set(tid, "synapse_replay");
+	k_thread_start(tid);
+	return 0;
+}
+
+static int synapse_replay_cmd_handler(const struct shell *sh, size_t argc, char **argv,
+				      void *data)
+{
+	ARG_UNUSED(argc);
+	struct context *ctx = data;
+
+	if (strcmp(argv[0], "start") == 0) {
+		if (k_sem_count_get(&g_ctx.running) == 0) {
+			shell_print(sh, "already running");
+		} else {
+			start(ctx);
+		}
+	} else if (strcmp(argv[0], "stop") == 0) {
+		if (k_sem_count_get(&g_ctx.running) == 0) {
+			k_sem_give(&g_ctx.running);
+		} else {
+			shell_print(sh, "not running");
+		}
+	} else if (strcmp(argv[0], "status") == 0) {
+		shell_print(sh, "running: %d speed: %d replayed: %u skipped: %u errors: %u",
+			    (int)k_sem_count_get(&g_ctx.running) == 0, ctx->speed, ctx->replayed,
+			    ctx->skipped, ctx->errors);
+	}
+	return 0;
+}
+
+static int cmd_synapse_replay_speed(const struct shell *sh, size_t argc, char **argv)
+{
+	int speed = atoi(argv[1]);
+	if (speed < 0) {
+		shell_print(sh, "speed must be >= 0");
+		return -EINVAL;
+	}
+	g_ctx.speed = speed;
+	return 0;
+}
+
+static int cmd_synapse_replay_topics(const struct shell *sh, size_t argc, char **argv)
+{
+	struct context *ctx = &g_ctx;
+
+	if (k_sem_count_get(&ctx->running) == 0) {
+		shell_print(sh, "stop the replay first");
+		return -EBUSY;
+	}
+
+	ctx->topic_count = 0;
+	for (size_t i = 1; i < argc && ctx->topic_count < MAX_TOPICS; i++) {
+		struct zros_topic *topic = synapse_topic_find(argv[i]);
+		if (topic == NULL) {
+			shell_print(sh, "unknown topic: %s", argv[i]);
+			return -EINVAL;
+		}
+		ctx->topics[ctx->topic_count++] = topic;
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_DICT_SET_CREATE(sub_synapse_replay_run, synapse_replay_cmd_handler,
+			     (start, &g_ctx, "start"), (stop, &g_ctx, "stop"),
+			     (status, &g_ctx, "status"));
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+	sub_synapse_replay, SHELL_CMD(run, &sub_synapse_replay_run, "Start, stop or status.", NULL),
+	SHELL_CMD_ARG(speed, NULL, "Replay speed, 0 as fast as possible.",
+		      cmd_synapse_replay_speed, 2, 0),
+	SHELL_CMD_ARG(topics, NULL, "Topics to replay, none for all.", cmd_synapse_replay_topics,
+		      1, MAX_TOPICS),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(synapse_replay, &sub_synapse_replay, "synapse replay commands", NULL);
+
+// vi: ts=4 sw=4 et
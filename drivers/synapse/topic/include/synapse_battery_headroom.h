@@ -0,0 +1,33 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_BATTERY_HEADROOM_H
+#define SYNAPSE_BATTERY_HEADROOM_H
+
+#include <stdint.h>
+
+/*
+ * Battery model state, published by sense_power next to battery_state.
+ * The measured voltage sags with the load, these are the open circuit
+ * values behind it and what the pack can still deliver.
+ */
+struct synapse_battery_headroom {
+	uint64_t stamp_ns;
+	// V, measured voltage with the sag of the present current removed
+	float voltage_oc;
+	// ohm, pack resistance estimated from the sag of current steps
+	float resistance;
+	// 0 to 1, state of charge from coulomb counting
+	float remaining;
+	// Ah, charge left
+	float charge;
+	// share of full battery thrust the motors can still reach, the voltage
+	// left at the rated current over that of a full pack, squared, 1 when full
+	float thrust_scale;
+	// s, time to empty at the mean current, 0 while not discharging
+	float time_remaining_s;
+};
+
+#endif // SYNAPSE_BATTERY_HEADROOM_H
+// vi: ts=4 sw=4 et
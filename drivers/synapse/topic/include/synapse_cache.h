@@ -0,0 +1,142 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_CACHE_H
+#define SYNAPSE_CACHE_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/toolchain.h>
+
+#include <zros/zros_sub.h>
+
+#include "synapse_topic_list.h"
+
+/*
+ * Last value cache, the latest message of every topic, recorded by
+ * synapse_topic_notify so it sees zros, loan and seqlock publishes alike.
+ * Each topic is a seqlock, a writer claims it by making its sequence odd
+ * and no interrupt is masked during the copy. A publish that finds another
+ * writer of the same topic mid copy is not recorded. Writes are counted
+ * for the whole cache as well. A single topic is read lock free, a
+ * snapshot copies every topic in one pass and is atomic when no write
+ * started during it, that is retried a few times before settling for per
+ * topic consistency.
+ */
+
+#define SYNAPSE_CACHE_INDEX(name, type, frame, snprint) SYNAPSE_CACHE_##name,
+enum synapse_cache_index {
+	SYNAPSE_TOPIC_LIST(SYNAPSE_CACHE_INDEX) SYNAPSE_CACHE_TOPIC_COUNT
+};
+
+#define SYNAPSE_CACHE_MEMBER(name, type, frame, snprint) type name;
+struct synapse_cache_msgs {
+	SYNAPSE_TOPIC_LIST(SYNAPSE_CACHE_MEMBER)
+};
+
+struct synapse_cache_meta {
+	// zero if the topic was never published
+	uint32_t publishes;
+	int64_t ticks;
+};
+
+struct synapse_cache_snapshot {
+	int64_t ticks;
+	// no topic was written while it was taken
+	bool atomic;
+	uint8_t attempts;
+	struct synapse_cache_meta meta[SYNAPSE_CACHE_TOPIC_COUNT];
+	struct synapse_cache_msgs msg;
+};
+
+/*
+ * State dump datagram, sent by eth_tx on its own port: a header, then
+ * records of cached topics, each a record header and len bytes of the
+ * message from offset. A message larger than a datagram continues in the
+ * next one. Topics are indexed in SYNAPSE_TOPIC_LIST order, little endian
+ * in-memory structs like the trace datagrams.
+ */
+#define SYNAPSE_CACHE_DUMP_MAGIC 0x504d4453 // "SDMP"
+
+struct synapse_cache_dump_header {
+	uint32_t magic;
+	// snapshot number, the same in every datagram of one dump
+	uint32_t dump;
+	uint16_t datagram;
+	uint8_t last;
+	uint8_t atomic;
+} __packed;
+
+struct synapse_cache_dump_record {
+	uint8_t topic;
+	uint8_t reserved;
+	uint16_t size;
+	uint16_t offset;
+	uint16_t len;
+	uint32_t publishes;
+	uint32_t age_ms;
+} __packed;
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_CACHE)
+
+/* record a publish, called by synapse_topic_notify */
+void synapse_cache_record(struct zros_topic *topic, const void *msg);
+
+/*
+ * copy the cached message of topic to msg, returns 0, -ENOENT for a topic
+ * not in the list, -EAGAIN if it was never published or -EBUSY if writes
+ * kept landing during every retry
+ */
+int synapse_cache_read(const struct zros_topic *topic, void *msg);
+
+/*
+ * take the shared snapshot, NULL if another user holds it past timeout,
+ * hand it back with synapse_cache_snapshot_release
+ */
+const struct synapse_cache_snapshot *synapse_cache_snapshot_take(k_timeout_t timeout);
+
+void synapse_cache_snapshot_release(void);
+
+/* message of a topic index in a snapshot, NULL if never published */
+const void *synapse_cache_snapshot_msg(const struct synapse_cache_snapshot *snap, int index,
+				       size_t *size);
+
+struct zros_topic *synapse_cache_topic(int index);
+
+#else
+
+static inline void synapse_cache_record(struct zros_topic *topic, const void *msg)
+{
+	(void)topic;
+	(void)msg;
+}
+
+static inline int synapse_cache_read(const struct zros_topic *topic, void *msg)
+{
+	(void)topic;
+	(void)msg;
+	return -ENOTSUP;
+}
+
+#endif
+
+/*
+ * zros_sub_init that starts msg from the last published message, so a node
+ * started late does not wait a full period of a slow topic for its input
+ */
+static inline int synapse_sub_init_cached(struct zros_sub *sub, struct zros_node *node,
+					  struct zros_topic *topic, void *msg, float rate_hz)
+{
+	int ret = zros_sub_init(sub, node, topic, msg, rate_hz);
+	if (ret == 0) {
+		(void)synapse_cache_read(topic, msg);
+	}
+	return ret;
+}
+
+#endif // SYNAPSE_CACHE_H
+// vi: ts=4 sw=4 et
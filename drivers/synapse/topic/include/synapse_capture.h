@@ -0,0 +1,31 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_CAPTURE_H
+#define SYNAPSE_CAPTURE_H
+
+/*
+ * Anomaly trigger for the log_sdcard capture buffer, which keeps the last
+ * seconds of the high rate topics in ram. A trigger writes them and the
+ * following CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE_POST_MS to a
+ * capture file on the sd card. Callable from any thread or isr, triggers
+ * while a capture is being written are counted and otherwise ignored.
+ * reason must be a string literal.
+ */
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD_CAPTURE)
+
+void synapse_capture_trigger(const char *reason);
+
+#else
+
+static inline void synapse_capture_trigger(const char *reason)
+{
+	(void)reason;
+}
+
+#endif
+
+#endif // SYNAPSE_CAPTURE_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,29 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_IMU_DELTA_H
+#define SYNAPSE_IMU_DELTA_H
+
+#include <stdint.h>
+
+/*
+ * Integral of every imu fifo frame of a batch, published by sense_accel.
+ * The delta angle carries the coning correction and the delta velocity the
+ * rotation and sculling corrections, both in the body frame at the start of
+ * the interval, so a consumer can propagate once per batch without losing
+ * motion above its own rate.
+ */
+struct synapse_imu_delta {
+	// sensor time at the end of the interval
+	uint64_t stamp_ns;
+	uint32_t dt_ns;
+	uint16_t frame_count;
+	// rad
+	float delta_angle[3];
+	// m/s, gravity included
+	float delta_velocity[3];
+};
+
+#endif // SYNAPSE_IMU_DELTA_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,74 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_LATENCY_H
+#define SYNAPSE_LATENCY_H
+
+#include <zephyr/kernel.h>
+
+/*
+ * End-to-end latency tracing of the control pipeline.
+ *
+ * The synapse_pb messages have no room for a trace id, so each stage keeps
+ * the trace that belongs to its last publication in a side table. A stage
+ * copies the trace of the topic it consumed right after zros_sub_update,
+ * and marks its own stage right before zros_pub_update. The trace carries
+ * the cycle count of the originating imu sample and of every stage it
+ * passed, so the final stage can publish the full per-hop breakdown.
+ */
+
+enum synapse_latency_stage {
+	SYNAPSE_LATENCY_IMU = 0,
+	SYNAPSE_LATENCY_ESTIMATE,
+	SYNAPSE_LATENCY_ATTITUDE,
+	SYNAPSE_LATENCY_ANGULAR_VELOCITY,
+	SYNAPSE_LATENCY_ALLOCATION,
+	SYNAPSE_LATENCY_ACTUATE,
+	SYNAPSE_LATENCY_STAGE_COUNT,
+};
+
+struct synapse_latency_trace {
+	uint32_t origin_cyc;
+	uint32_t stage_mask;
+	uint32_t stage_cyc[SYNAPSE_LATENCY_STAGE_COUNT];
+};
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LATENCY)
+
+/* start a new trace at the time the sensor sample was taken */
+void synapse_latency_begin(struct synapse_latency_trace *trace);
+
+/* copy the trace attached to the last publication of a stage */
+void synapse_latency_get(enum synapse_latency_stage stage, struct synapse_latency_trace *trace);
+
+/* stamp a stage, record its hop latency and attach the trace to its output */
+void synapse_latency_mark(enum synapse_latency_stage stage, struct synapse_latency_trace *trace);
+
+#else
+
+static inline void synapse_latency_begin(struct synapse_latency_trace *trace)
+{
+	ARG_UNUSED(trace);
+}
+
+static inline void synapse_latency_get(enum synapse_latency_stage stage,
+				       struct synapse_latency_trace *trace)
+{
+	ARG_UNUSED(stage);
+	ARG_UNUSED(trace);
+}
+
+static inline void synapse_latency_mark(enum synapse_latency_stage stage,
+					struct synapse_latency_trace *trace)
+{
+	ARG_UNUSED(stage);
+	ARG_UNUSED(trace);
+}
+
+#endif
+
+const char *synapse_latency_stage_str(enum synapse_latency_stage stage);
+
+#endif // SYNAPSE_LATENCY_H
+// vi: ts=4 sw=4 et
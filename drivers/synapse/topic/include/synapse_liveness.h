@@ -0,0 +1,96 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_LIVENESS_H
+#define SYNAPSE_LIVENESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#define SYNAPSE_LIVENESS_MAX 32
+
+/*
+ * Health of every liveness watch, published on topic_health by the
+ * watchdog each time a bit changes. Bit i is watch i in the order the
+ * watches were first started, the liveness shell command lists them.
+ */
+struct synapse_health {
+	uint64_t stamp_ns;
+	// set while the topic of the watch is past its deadline
+	uint32_t stale;
+	// set while the watch is started
+	uint32_t watched;
+};
+
+struct zros_topic;
+
+/*
+ * A consumer's deadline on a topic. Every publish of the topic feeds the
+ * watches on it through synapse_topic_notify, so consumers keep no
+ * timestamps of their own. A single timer checks all watches and raises
+ * the signal of one whose topic went quiet for longer than its deadline,
+ * or came back, consumers add the signal to their k_poll events with
+ * SYNAPSE_LIVENESS_POLL_EVENT and call synapse_liveness_ack once woken.
+ */
+struct synapse_liveness {
+	struct zros_topic *topic;
+	const char *consumer;
+	uint32_t deadline_ms;
+	struct k_poll_signal signal;
+	// uptime ticks of the last publish, truncated to 32 bits
+	atomic_t last_ticks;
+	atomic_t stale;
+	bool watching;
+	// bit in the health mask, -1 until first started
+	int8_t bit;
+	uint32_t misses;
+};
+
+#define SYNAPSE_LIVENESS_INITIALIZER(obj, topic_ptr, name, ms)                                     \
+	{                                                                                          \
+		.topic = (topic_ptr), .consumer = (name), .deadline_ms = (ms),                     \
+		.signal = K_POLL_SIGNAL_INITIALIZER((obj).signal), .last_ticks = ATOMIC_INIT(0),   \
+		.stale = ATOMIC_INIT(0), .watching = false, .bit = -1, .misses = 0,                \
+	}
+
+#define SYNAPSE_LIVENESS_POLL_EVENT(obj)                                                           \
+	K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &(obj)->signal)
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS)
+
+// watch from now on, the deadline counts from the start
+void synapse_liveness_start(struct synapse_liveness *watch);
+
+void synapse_liveness_stop(struct synapse_liveness *watch);
+
+// re-arm the signal and its poll event after a k_poll it woke
+void synapse_liveness_ack(struct synapse_liveness *watch, struct k_poll_event *event);
+
+static inline bool synapse_liveness_stale(const struct synapse_liveness *watch)
+{
+	return atomic_get(&watch->stale) != 0;
+}
+
+// stale bits of all watches, as last published on topic_health
+uint32_t synapse_liveness_health(void);
+
+// raised each time the health mask changes, for nodes that act on any watch
+struct k_poll_signal *synapse_liveness_health_signal(void);
+
+/* feed the watches of a topic, called by synapse_topic_notify */
+void synapse_liveness_record(struct zros_topic *topic);
+
+#else
+
+static inline void synapse_liveness_record(struct zros_topic *topic)
+{
+	(void)topic;
+}
+
+#endif
+
+#endif // SYNAPSE_LIVENESS_H
+// vi: ts=4 sw=4 et
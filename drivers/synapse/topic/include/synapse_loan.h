@@ -0,0 +1,137 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_LOAN_H
+#define SYNAPSE_LOAN_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/slist.h>
+#include <zephyr/sys/util.h>
+
+#include <zros/zros_topic.h>
+
+#include <cerebri/core/arena.h>
+
+/*
+ * Zero-copy publishing for large messages.
+ *
+ * A loan owns a small pool of message buffers next to a zros topic. A
+ * publisher acquires a free buffer, fills it in place and publishes it,
+ * which makes it the latest message. A loan subscriber borrows a read-only
+ * reference to the latest message and holds it until it borrows again or
+ * releases it, so neither side copies. Buffers are reference counted and
+ * return to the pool once the last borrower lets go.
+ *
+ * Nodes that still use zros_sub on the topic keep working: as long as the
+ * topic has zros subscribers every loan publish is also passed to
+ * zros_topic_publish. All publishers of a topic with a loan must publish
+ * through the loan, otherwise loan subscribers miss their messages.
+ *
+ * A loan defined with SYNAPSE_LOAN_DEFINE_ARENA also has an arena per
+ * buffer for the pointer fields of its message, see cerebri/core/arena.h.
+ * It is reset when the buffer is acquired, so the pointers live as long
+ * as the buffer is borrowed. zros subscribers copy only the pointers,
+ * such a topic is read through loan subscribers.
+ */
+
+struct synapse_loan {
+	struct zros_topic *topic;
+	uint8_t *pool;
+	size_t size;
+	atomic_t ref[CONFIG_CEREBRI_SYNAPSE_TOPIC_LOAN_SLOTS];
+	int latest;
+	uint32_t seq;
+	sys_slist_t subs;
+	struct k_spinlock lock;
+	uint32_t exhausted;
+	// one per buffer, or NULL
+	struct arena *arenas;
+};
+
+struct synapse_loan_sub {
+	sys_snode_t node;
+	struct synapse_loan *loan;
+	struct k_poll_signal signal;
+	struct k_poll_event event;
+	uint32_t seq;
+	int borrowed;
+	int64_t period_ticks;
+	int64_t next_ticks;
+};
+
+#define SYNAPSE_LOAN_DECLARE(topic_name) extern struct synapse_loan loan_##topic_name
+
+#define SYNAPSE_LOAN_DEFINE(topic_name, type)                                                      \
+	static type g_loan_pool_##topic_name[CONFIG_CEREBRI_SYNAPSE_TOPIC_LOAN_SLOTS];             \
+	struct synapse_loan loan_##topic_name = {                                                  \
+		.topic = &topic_##topic_name,                                                      \
+		.pool = (uint8_t *)g_loan_pool_##topic_name,                                       \
+		.size = sizeof(type),                                                              \
+		.latest = -1,                                                                      \
+		.seq = 0,                                                                          \
+		.exhausted = 0,                                                                    \
+		.arenas = NULL,                                                                    \
+	}
+
+#define SYNAPSE_LOAN_ARENA_INIT(i, topic_name)                                                     \
+	ARENA_INITIALIZER(g_loan_arena_buf_##topic_name[i],                                        \
+			  sizeof(g_loan_arena_buf_##topic_name[i]))
+
+// a loan with arena_size bytes for the pointer fields of each buffer
+#define SYNAPSE_LOAN_DEFINE_ARENA(topic_name, type, arena_size)                                    \
+	static type g_loan_pool_##topic_name[CONFIG_CEREBRI_SYNAPSE_TOPIC_LOAN_SLOTS];             \
+	static uint8_t __aligned(ARENA_ALIGN)                                                      \
+		g_loan_arena_buf_##topic_name[CONFIG_CEREBRI_SYNAPSE_TOPIC_LOAN_SLOTS]             \
+					     [ROUND_UP(arena_size, ARENA_ALIGN)];                  \
+	static struct arena g_loan_arena_##topic_name[] = {                                        \
+		LISTIFY(CONFIG_CEREBRI_SYNAPSE_TOPIC_LOAN_SLOTS, SYNAPSE_LOAN_ARENA_INIT, (,),     \
+			topic_name)};                                                              \
+	struct synapse_loan loan_##topic_name = {                                                  \
+		.topic = &topic_##topic_name,                                                      \
+		.pool = (uint8_t *)g_loan_pool_##topic_name,                                       \
+		.size = sizeof(type),                                                              \
+		.latest = -1,                                                                      \
+		.seq = 0,                                                                          \
+		.exhausted = 0,                                                                    \
+		.arenas = g_loan_arena_##topic_name,                                               \
+	}
+
+/* returns a writable buffer, or NULL when every buffer is borrowed */
+void *synapse_loan_acquire(struct synapse_loan *loan);
+
+/* arena of an acquired buffer, NULL for a loan without arenas */
+struct arena *synapse_loan_arena(struct synapse_loan *loan, const void *msg);
+
+/* hand an acquired buffer back without publishing it */
+void synapse_loan_discard(struct synapse_loan *loan, void *msg);
+
+/* make an acquired buffer the latest message, msg must not be touched afterwards */
+void synapse_loan_publish(struct synapse_loan *loan, void *msg);
+
+/* for publishers that keep their message between updates, costs one copy */
+int synapse_loan_publish_copy(struct synapse_loan *loan, const void *msg);
+
+/*
+ * rate_hz 0 means every message, otherwise the event is only raised by a
+ * message published once 1 / rate_hz has passed since the last borrow
+ */
+void synapse_loan_sub_init(struct synapse_loan_sub *sub, struct synapse_loan *loan, int rate_hz);
+
+void synapse_loan_sub_fini(struct synapse_loan_sub *sub);
+
+bool synapse_loan_sub_update_available(struct synapse_loan_sub *sub);
+
+static inline struct k_poll_event *synapse_loan_sub_get_event(struct synapse_loan_sub *sub)
+{
+	return &sub->event;
+}
+
+/* the latest message, valid until the next borrow or release, NULL before the first publish */
+const void *synapse_loan_borrow(struct synapse_loan_sub *sub);
+
+void synapse_loan_release(struct synapse_loan_sub *sub);
+
+#endif // SYNAPSE_LOAN_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,34 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_MOTOR_STATE_H
+#define SYNAPSE_MOTOR_STATE_H
+
+#include <stdint.h>
+
+#define SYNAPSE_MOTOR_STATE_MAX 8
+
+/*
+ * Motor feedback, published by actuate_dshot once per frame from the
+ * bidirectional dshot replies, and by actuate_vesc_can from the VESC status
+ * frames. Dshot replies to a frame are collected just before the next one
+ * is sent, so the data is one frame old. Fields a source does not report
+ * are 0.
+ */
+struct synapse_motor_state {
+	// uptime of the frame the replies answered
+	uint64_t stamp_ns;
+	// electrical revolutions per minute, divide by the motor pole pairs for rpm
+	int32_t erpm[SYNAPSE_MOTOR_STATE_MAX];
+	// bit per motor, set when its erpm is from a valid reply to that frame
+	uint32_t valid;
+	// A, motor phase current
+	float current[SYNAPSE_MOTOR_STATE_MAX];
+	// degC, motor temperature
+	float temperature[SYNAPSE_MOTOR_STATE_MAX];
+	uint8_t count;
+};
+
+#endif // SYNAPSE_MOTOR_STATE_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,65 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_QUEUE_H
+#define SYNAPSE_QUEUE_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/slist.h>
+
+#include <zros/zros_topic.h>
+
+/*
+ * Queued subscription for consumers that need every message of a topic.
+ *
+ * zros_sub only keeps the latest message, a queue keeps the last depth
+ * messages published since the consumer drained it, so a logger that wakes
+ * up late still sees every sample. When the queue is full new messages are
+ * dropped and counted as overruns, the queued ones stay in order. Control
+ * loops should keep using zros_sub, they only care about the latest value.
+ */
+
+struct synapse_queue {
+	sys_snode_t node;
+	struct zros_topic *topic;
+	uint8_t *buf;
+	size_t size;
+	size_t depth;
+	// written by publishers under the queue list lock
+	atomic_t head;
+	// only written by the consumer
+	atomic_t tail;
+	uint32_t overruns;
+	struct k_poll_signal signal;
+	struct k_poll_event event;
+};
+
+/*
+ * buf holds depth messages of size bytes, as the message buffer of zros_sub_init,
+ * depth must be a power of two, -EINVAL otherwise
+ */
+int synapse_queue_init(struct synapse_queue *queue, struct zros_topic *topic, void *buf,
+		       size_t size, size_t depth);
+
+void synapse_queue_fini(struct synapse_queue *queue);
+
+/* copy the oldest queued message, -EAGAIN when the queue is empty */
+int synapse_queue_pop(struct synapse_queue *queue, void *msg);
+
+static inline size_t synapse_queue_count(struct synapse_queue *queue)
+{
+	return (uint32_t)(atomic_get(&queue->head) - atomic_get(&queue->tail));
+}
+
+static inline struct k_poll_event *synapse_queue_get_event(struct synapse_queue *queue)
+{
+	return &queue->event;
+}
+
+/* copy a published message into every queue of the topic, see synapse_topic_hook.h */
+void synapse_queue_push(struct zros_topic *topic, const void *msg);
+
+#endif // SYNAPSE_QUEUE_H
+// vi: ts=4 sw=4 et
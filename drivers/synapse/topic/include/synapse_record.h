@@ -0,0 +1,123 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_RECORD_H
+#define SYNAPSE_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/toolchain.h>
+
+/*
+ * Compact topic recording written by log_sdcard and read by synapse_replay.
+ *
+ * The file starts with a synapse_record_file and topic_count
+ * synapse_record_topic entries, which declare every logged topic once
+ * with its id and the synapse_pb_Frame tag of its type. Records follow:
+ *
+ *   uint8_t id       topic id, or SYNAPSE_RECORD_INDEX
+ *   varint delta_us  uptime since the previous record or index block
+ *   varint size      payload bytes
+ *   payload          synapse_pb_Frame with only the message set
+ *
+ * An index block, the id SYNAPSE_RECORD_INDEX followed by a
+ * synapse_record_index, is written before the first record and then every
+ * index_period_ms. It holds the absolute uptime the deltas restart from
+ * and the file offset of the previous index block, so a reader can find
+ * the last one in the tail of the file and walk back to build a time to
+ * offset table for seeking. Capture files have an index_period_ms of 0
+ * and only the first index block. All fields are little endian.
+ *
+ * A record with the id SYNAPSE_RECORD_DROPS and a synapse_record_drops
+ * payload follows an index block when the logger lost records since the
+ * one before, the counts of every priority class since boot.
+ *
+ * A seek sidecar, recNNNN.idx next to recNNNN.rec, saves the walk. It is
+ * a synapse_record_seek_file, then about every period_ms a
+ * synapse_record_seek followed by topic_count uint32_t, the offset of the
+ * last record of each topic before it or SYNAPSE_RECORD_SEEK_NONE. The
+ * entry offset is that of an index block, a reader decodes from there
+ * with a fresh time base and takes slow topics from their last record.
+ */
+
+#define SYNAPSE_RECORD_MAGIC       0x43455253 // "SREC"
+#define SYNAPSE_RECORD_INDEX_MAGIC 0x58444953 // "SIDX"
+#define SYNAPSE_RECORD_SEEK_MAGIC  0x4b454553 // "SEEK"
+#define SYNAPSE_RECORD_SEEK_NONE   UINT32_MAX
+#define SYNAPSE_RECORD_VERSION     3
+#define SYNAPSE_RECORD_INDEX       0xff
+#define SYNAPSE_RECORD_DROPS       0xfe
+#define SYNAPSE_RECORD_CLASSES     4
+#define SYNAPSE_RECORD_MAX_TOPICS  64
+#define SYNAPSE_RECORD_NAME_LEN    29
+
+// largest record header, id and two varint32
+#define SYNAPSE_RECORD_HEADER_MAX 11
+
+struct synapse_record_file {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t topic_count;
+	uint32_t index_period_ms;
+} __packed;
+
+struct synapse_record_topic {
+	uint16_t frame_tag;
+	uint8_t id;
+	char name[SYNAPSE_RECORD_NAME_LEN];
+} __packed;
+
+struct synapse_record_index {
+	uint32_t magic;
+	uint64_t uptime_us;
+	// 0 for the first index block
+	uint32_t prev_offset;
+} __packed;
+
+// classes in order critical, status, control and bulk
+struct synapse_record_drops {
+	uint32_t dropped[SYNAPSE_RECORD_CLASSES];
+	// times the class was shed to leave room for the ones above it
+	uint32_t shed[SYNAPSE_RECORD_CLASSES];
+} __packed;
+
+struct synapse_record_seek_file {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t topic_count;
+	uint32_t period_ms;
+} __packed;
+
+struct synapse_record_seek {
+	uint64_t uptime_us;
+	uint32_t offset;
+} __packed;
+
+static inline size_t synapse_record_varint(uint8_t *buf, uint32_t value)
+{
+	size_t n = 0;
+
+	while (value >= 0x80) {
+		buf[n++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buf[n++] = (uint8_t)value;
+	return n;
+}
+
+/* write the header of a record into buf, returns its length */
+static inline size_t synapse_record_header(uint8_t buf[SYNAPSE_RECORD_HEADER_MAX], uint8_t id,
+					   uint32_t delta_us, uint32_t size)
+{
+	size_t n = 0;
+
+	buf[n++] = id;
+	n += synapse_record_varint(&buf[n], delta_us);
+	n += synapse_record_varint(&buf[n], size);
+	return n;
+}
+
+#endif // SYNAPSE_RECORD_H
+// vi: ts=4 sw=4 et
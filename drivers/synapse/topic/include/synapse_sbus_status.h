@@ -0,0 +1,35 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_SBUS_STATUS_H
+#define SYNAPSE_SBUS_STATUS_H
+
+#include <stdint.h>
+
+#define SYNAPSE_SBUS_FLAG_CH17       (1 << 0)
+#define SYNAPSE_SBUS_FLAG_CH18       (1 << 1)
+#define SYNAPSE_SBUS_FLAG_FRAME_LOST (1 << 2)
+#define SYNAPSE_SBUS_FLAG_FAILSAFE   (1 << 3)
+
+/*
+ * Link state of the sbus receiver, published by sense_sbus with every
+ * frame. Counters run from boot, flags are the ones of the last frame.
+ */
+struct synapse_sbus_status {
+	// reception of the last frame, at the uart going idle
+	uint64_t stamp_ns;
+	// from reception to input_sbus being published
+	uint32_t latency_us;
+	uint32_t frames;
+	// frames the receiver flagged as lost between it and the transmitter
+	uint32_t frames_lost;
+	// frames with failsafe set, these are not published on input_sbus
+	uint32_t failsafes;
+	// bursts dropped for a bad header or footer, or a uart error
+	uint32_t errors;
+	uint8_t flags;
+};
+
+#endif // SYNAPSE_SBUS_STATUS_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,86 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_SEQLOCK_H
+#define SYNAPSE_SEQLOCK_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/slist.h>
+
+#include <zros/zros_topic.h>
+
+/*
+ * Lock-free read path for topics with a single publisher.
+ *
+ * The message is double buffered: the publisher writes the buffer readers
+ * are not pointed at and then advances the write count, readers copy the
+ * latest complete buffer and only retry if the publisher lapped them
+ * during the copy. Neither side ever waits for the other, so a slow low
+ * priority reader can not hold up a high priority publisher.
+ *
+ * As with synapse_loan, zros subscribers of the topic keep getting their
+ * copy through zros_topic_publish. Only one thread may publish a topic
+ * with a seqlock.
+ */
+
+struct synapse_seqlock {
+	struct zros_topic *topic;
+	uint8_t *buf;
+	size_t size;
+	// write count started and completed, buffer n & 1 holds write n
+	atomic_t begin;
+	atomic_t end;
+	sys_slist_t subs;
+	struct k_spinlock lock;
+	uint32_t retries;
+};
+
+struct synapse_seqlock_sub {
+	sys_snode_t node;
+	struct synapse_seqlock *seqlock;
+	struct k_poll_signal signal;
+	struct k_poll_event event;
+	uint32_t seq;
+	int64_t period_ticks;
+	int64_t next_ticks;
+};
+
+#define SYNAPSE_SEQLOCK_DECLARE(topic_name) extern struct synapse_seqlock seqlock_##topic_name
+
+#define SYNAPSE_SEQLOCK_DEFINE(topic_name, type)                                                   \
+	static type g_seqlock_buf_##topic_name[2];                                                 \
+	struct synapse_seqlock seqlock_##topic_name = {                                            \
+		.topic = &topic_##topic_name,                                                      \
+		.buf = (uint8_t *)g_seqlock_buf_##topic_name,                                      \
+		.size = sizeof(type),                                                              \
+		.begin = ATOMIC_INIT(0),                                                           \
+		.end = ATOMIC_INIT(0),                                                             \
+		.retries = 0,                                                                      \
+	}
+
+/* publisher side, never blocks on readers */
+void synapse_seqlock_publish(struct synapse_seqlock *seqlock, const void *msg);
+
+/*
+ * rate_hz 0 means every message, otherwise the event is only raised by a
+ * message published once 1 / rate_hz has passed since the last update
+ */
+void synapse_seqlock_sub_init(struct synapse_seqlock_sub *sub, struct synapse_seqlock *seqlock,
+			      int rate_hz);
+
+void synapse_seqlock_sub_fini(struct synapse_seqlock_sub *sub);
+
+bool synapse_seqlock_sub_update_available(struct synapse_seqlock_sub *sub);
+
+static inline struct k_poll_event *synapse_seqlock_sub_get_event(struct synapse_seqlock_sub *sub)
+{
+	return &sub->event;
+}
+
+/* copy the latest message, -EAGAIN if nothing was published or the publisher kept lapping */
+int synapse_seqlock_sub_update(struct synapse_seqlock_sub *sub, void *msg);
+
+#endif // SYNAPSE_SEQLOCK_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,85 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_SYNC_H
+#define SYNAPSE_SYNC_H
+
+#include <zephyr/kernel.h>
+
+#include <zros/zros_sub.h>
+
+#include <synapse_pb/timestamp.pb.h>
+
+/*
+ * Wait on several subscriptions and wake once with a time aligned set.
+ *
+ * Input 0 is the pivot, normally the fastest sensor. A set is complete
+ * when the pivot has a new message and every other input holds a message
+ * stamped within the slop of it, with the approximate policy, or stamped
+ * the same, with the exact policy. The pivot is held back for at most the
+ * slop while another input catches up, after that the set is released and
+ * synapse_sync_is_aligned tells which inputs missed it. An input stamped
+ * more than the slop after the pivot means the pivot is stale, it is then
+ * dropped and the next one is waited for.
+ */
+
+#define SYNAPSE_SYNC_MAX_INPUTS 4
+
+enum synapse_sync_policy {
+	SYNAPSE_SYNC_EXACT = 0,
+	SYNAPSE_SYNC_APPROXIMATE,
+};
+
+struct synapse_sync_input {
+	struct zros_sub *sub;
+	// stamp inside the message buffer of the subscription
+	const synapse_pb_Timestamp *stamp;
+	int64_t stamp_ns;
+	bool received;
+	bool fresh;
+	bool aligned;
+	bool is_new;
+};
+
+struct synapse_sync {
+	struct synapse_sync_input input[SYNAPSE_SYNC_MAX_INPUTS];
+	struct k_poll_event events[SYNAPSE_SYNC_MAX_INPUTS];
+	size_t count;
+	enum synapse_sync_policy policy;
+	int64_t slop_ns;
+	int64_t hold_ticks;
+	// uptime the current pivot was taken
+	int64_t pivot_ticks;
+	uint32_t sets;
+	uint32_t dropped;
+	uint32_t unaligned;
+};
+
+void synapse_sync_init(struct synapse_sync *sync, enum synapse_sync_policy policy,
+		       uint32_t slop_us);
+
+/* add an input, the first one added is the pivot, -ENOMEM when full */
+int synapse_sync_add(struct synapse_sync *sync, struct zros_sub *sub,
+		     const synapse_pb_Timestamp *stamp);
+
+/*
+ * wait for the next set, 0 once the message buffers of all inputs hold it,
+ * -EAGAIN if the timeout passed first, use K_NO_WAIT to check without blocking
+ */
+int synapse_sync_wait(struct synapse_sync *sync, k_timeout_t timeout);
+
+/* the input was updated for this set */
+static inline bool synapse_sync_is_new(const struct synapse_sync *sync, size_t i)
+{
+	return sync->input[i].is_new;
+}
+
+/* the message of the input is within the slop of the pivot for this set */
+static inline bool synapse_sync_is_aligned(const struct synapse_sync *sync, size_t i)
+{
+	return sync->input[i].aligned;
+}
+
+#endif // SYNAPSE_SYNC_H
+// vi: ts=4 sw=4 et
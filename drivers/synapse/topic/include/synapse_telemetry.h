@@ -0,0 +1,111 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_TELEMETRY_H
+#define SYNAPSE_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+/*
+ * Rates of the telemetry streams eth_tx sends to the ground. The ground
+ * station sends a synapse_telemetry_rates datagram, little endian, to the
+ * eth_rx control port and eth_rx publishes it on topic_telemetry_rates.
+ * The same datagram asks for the compact encoding of a stream, which
+ * eth_tx only sends if it speaks the version the ground named.
+ */
+
+#define SYNAPSE_TELEMETRY_STREAMS(X)                                                               \
+	X(actuators)                                                                               \
+	X(odometry)                                                                                \
+	X(nav_sat_fix)                                                                             \
+	X(status)
+
+#define SYNAPSE_TELEMETRY_ENUM(name) SYNAPSE_TELEMETRY_##name,
+
+enum synapse_telemetry_stream {
+	SYNAPSE_TELEMETRY_STREAMS(SYNAPSE_TELEMETRY_ENUM) SYNAPSE_TELEMETRY_STREAM_COUNT
+};
+
+#define SYNAPSE_TELEMETRY_MAGIC       0x4c455453 // "STEL"
+#define SYNAPSE_TELEMETRY_RATE_MAX_HZ 1000
+
+// compact encoding eth_tx speaks, see below
+#define SYNAPSE_TELEMETRY_COMPACT_VERSION 1
+// streams that have a compact encoding
+#define SYNAPSE_TELEMETRY_COMPACT_STREAMS BIT(SYNAPSE_TELEMETRY_odometry)
+
+struct synapse_telemetry_rates {
+	uint32_t magic;
+	// 0 stops a stream
+	uint16_t rate_hz[SYNAPSE_TELEMETRY_STREAM_COUNT];
+	// bit per stream, eth_tx lowers the rate of these while the link is congested
+	uint16_t adaptive_mask;
+	// bit per stream the ground takes compact instead of as frames
+	uint16_t compact_mask;
+	// compact version the ground decodes, compact_mask is ignored unless eth_tx speaks it
+	uint16_t compact_version;
+} __packed;
+
+// rates from a ground station predating the compact encoding end here
+#define SYNAPSE_TELEMETRY_RATES_V1_SIZE offsetof(struct synapse_telemetry_rates, compact_mask)
+
+/*
+ * Compact telemetry datagram, sent by eth_tx on its own port to each
+ * destination taking a stream the ground asked for compact, in place of
+ * its synapse_pb_Frame: a header, then records, little endian packed
+ * structs starting with their type.
+ *
+ * Odometry is a keyframe with the absolute position and stamp, then
+ * deltas from that keyframe until the next one. A delta names its
+ * keyframe, so a lost keyframe only costs the deltas up to the next.
+ *  - position in mm
+ *  - linear and angular velocity as in synapse_pb_Odometry, ieee 754
+ *    half floats
+ *  - orientation as the smallest three: bits 31..30 hold the index into
+ *    w, x, y, z of the largest component, which is left out and made
+ *    positive, bits 29..0 the other three in order, 10 bit two's
+ *    complement of the component times 511 sqrt(2)
+ */
+#define SYNAPSE_COMPACT_MAGIC 0x504d4353 // "SCMP"
+
+enum synapse_compact_type {
+	SYNAPSE_COMPACT_ODOMETRY_KEY = 1,
+	SYNAPSE_COMPACT_ODOMETRY_DELTA = 2,
+};
+
+struct synapse_compact_header {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t count;
+	// datagram number, a gap is a lost datagram
+	uint16_t datagram;
+} __packed;
+
+struct synapse_compact_odometry_key {
+	uint8_t type;
+	// keyframe number, wraps
+	uint8_t key;
+	int64_t stamp_us;
+	int32_t position_mm[3];
+	uint16_t velocity[3];
+	uint16_t angular_velocity[3];
+	uint32_t orientation;
+} __packed;
+
+struct synapse_compact_odometry_delta {
+	uint8_t type;
+	uint8_t key;
+	uint32_t stamp_us;
+	int16_t position_mm[3];
+	uint16_t velocity[3];
+	uint16_t angular_velocity[3];
+	uint32_t orientation;
+} __packed;
+
+#endif // SYNAPSE_TELEMETRY_H
+// vi: ts=4 sw=4 et
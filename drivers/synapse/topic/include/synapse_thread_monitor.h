@@ -0,0 +1,30 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_THREAD_MONITOR_H
+#define SYNAPSE_THREAD_MONITOR_H
+
+#include <stdint.h>
+
+#define SYNAPSE_THREAD_MONITOR_MAX_THREADS 32
+#define SYNAPSE_THREAD_MONITOR_NAME_LEN    16
+
+struct synapse_thread_stats {
+	char name[SYNAPSE_THREAD_MONITOR_NAME_LEN];
+	// share of cpu time over the last sample window, 1/1000
+	uint16_t cpu_permille;
+	int8_t priority;
+	uint32_t stack_size;
+	uint32_t stack_unused;
+};
+
+struct synapse_thread_monitor {
+	uint32_t uptime_ms;
+	uint16_t cpu_load_permille;
+	uint8_t thread_count;
+	struct synapse_thread_stats thread[SYNAPSE_THREAD_MONITOR_MAX_THREADS];
+};
+
+#endif // SYNAPSE_THREAD_MONITOR_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,20 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_TOPIC_HOOK_H
+#define SYNAPSE_TOPIC_HOOK_H
+
+struct zros_topic;
+
+/*
+ * Everything that has to see each publication of a topic: statistics,
+ * queued subscriptions, liveness watches and the last value cache. zros_topic_publish is
+ * wrapped at link time to call this, publish paths that bypass zros, like
+ * synapse_loan and synapse_seqlock without zros subscribers, call it
+ * themselves.
+ */
+void synapse_topic_notify(struct zros_topic *topic, const void *msg);
+
+#endif // SYNAPSE_TOPIC_HOOK_H
+// vi: ts=4 sw=4 et
@@ -7,6 +7,8 @@
 
 #include <zros/zros_topic.h>
 
+#include <pb.h>
+
 #include <synapse_pb/actuators.pb.h>
 #include <synapse_pb/altimeter.pb.h>
 #include <synapse_pb/battery_state.pb.h>
@@ -26,9 +28,45 @@
 #include <synapse_pb/vector3.pb.h>
 #include <synapse_pb/wheel_odometry.pb.h>
 
+#include "synapse_battery_headroom.h"
+#include "synapse_imu_delta.h"
+#include "synapse_latency.h"
+#include "synapse_liveness.h"
+#include "synapse_loan.h"
+#include "synapse_motor_state.h"
+#include "synapse_sbus_status.h"
+#include "synapse_seqlock.h"
+#include "synapse_telemetry.h"
+#include "synapse_thread_monitor.h"
+#include "synapse_topic_stats.h"
+#include "synapse_wheel_velocity.h"
+
 /********************************************************************
  * helper
  ********************************************************************/
+/*
+ * Stamps are integer ns. stamp_msg_now reads the 64 bit cycle counter, so
+ * its resolution is the timer clock rather than the system tick, stamp_msg
+ * converts a tick count captured earlier, e.g. in an interrupt. Both are in
+ * the clock_sync time base with CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_STAMP.
+ */
+enum synapse_time_quality {
+	// system tick resolution, no 64 bit cycle counter on this timer
+	SYNAPSE_TIME_TICK = 0,
+	// cycle counter resolution, free running uptime
+	SYNAPSE_TIME_CYCLE = 1,
+	// cycle counter resolution, offset locked to the PTP grandmaster
+	SYNAPSE_TIME_SYNCED = 2,
+};
+
+// monotonic uptime in ns, for intervals such as estimator dt
+int64_t synapse_uptime_ns(void);
+// stamp time base, uptime or the clock_sync time
+int64_t synapse_now_ns(void);
+enum synapse_time_quality synapse_time_quality(void);
+const char *synapse_time_quality_str(enum synapse_time_quality quality);
+void stamp_msg_ns(synapse_pb_Timestamp *hdr, int64_t ns);
+void stamp_msg_now(synapse_pb_Timestamp *hdr);
 void stamp_msg(synapse_pb_Timestamp *hdr, int64_t ticks);
 const char *mode_str(synapse_pb_Status_Mode mode);
 const char *input_source_str(synapse_pb_Status_InputSource src);
@@ -39,41 +77,152 @@ const char *fuel_str(synapse_pb_Status_Fuel fuel);
 const char *status_safety_str(synapse_pb_Status_Safety safety);
 const char *link_status_str(synapse_pb_Status_LinkStatus status);
 
+// print a message of a topic, see synapse_shell_print.h
+typedef int snprint_t(char *buf, size_t n, void *msg);
+
 /********************************************************************
  * topics
  ********************************************************************/
-ZROS_TOPIC_DECLARE(topic_accel_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DECLARE(topic_actuators, synapse_pb_Actuators);
-ZROS_TOPIC_DECLARE(topic_altimeter, synapse_pb_Altimeter);
-ZROS_TOPIC_DECLARE(topic_angular_velocity_ff, synapse_pb_Vector3);
-ZROS_TOPIC_DECLARE(topic_angular_velocity_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DECLARE(topic_attitude_sp, synapse_pb_Quaternion);
-ZROS_TOPIC_DECLARE(topic_battery_state, synapse_pb_BatteryState);
-ZROS_TOPIC_DECLARE(topic_bezier_trajectory, synapse_pb_BezierTrajectory);
-ZROS_TOPIC_DECLARE(topic_bezier_trajectory_ethernet, synapse_pb_BezierTrajectory);
-ZROS_TOPIC_DECLARE(topic_clock_offset_ethernet, synapse_pb_Time);
-ZROS_TOPIC_DECLARE(topic_cmd_vel, synapse_pb_Twist);
-ZROS_TOPIC_DECLARE(topic_cmd_vel_ethernet, synapse_pb_Twist);
-ZROS_TOPIC_DECLARE(topic_force_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DECLARE(topic_imu, synapse_pb_Imu);
-ZROS_TOPIC_DECLARE(topic_imu_q31_array, synapse_pb_ImuQ31Array);
-ZROS_TOPIC_DECLARE(topic_input, synapse_pb_Input);
-ZROS_TOPIC_DECLARE(topic_input_sbus, synapse_pb_Input);
-ZROS_TOPIC_DECLARE(topic_input_ethernet, synapse_pb_Input);
-ZROS_TOPIC_DECLARE(topic_led_array, synapse_pb_LEDArray);
-ZROS_TOPIC_DECLARE(topic_magnetic_field, synapse_pb_MagneticField);
-ZROS_TOPIC_DECLARE(topic_moment_ff, synapse_pb_Vector3);
-ZROS_TOPIC_DECLARE(topic_moment_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DECLARE(topic_nav_sat_fix, synapse_pb_NavSatFix);
-ZROS_TOPIC_DECLARE(topic_odometry_estimator, synapse_pb_Odometry);
-ZROS_TOPIC_DECLARE(topic_odometry_ethernet, synapse_pb_Odometry);
-ZROS_TOPIC_DECLARE(topic_orientation_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DECLARE(topic_position_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DECLARE(topic_pwm, synapse_pb_Pwm);
-ZROS_TOPIC_DECLARE(topic_safety, synapse_pb_Safety);
-ZROS_TOPIC_DECLARE(topic_status, synapse_pb_Status);
-ZROS_TOPIC_DECLARE(topic_velocity_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DECLARE(topic_wheel_odometry, synapse_pb_WheelOdometry);
+/*
+ * Every topic as X(name, message type, synapse_pb_Frame field, print
+ * function), expanded into the topic declarations here, the definitions
+ * and the registry in synapse_topic_list.c and every per topic table of
+ * the bridges, logger and shell. The frame field is none for messages
+ * that have no synapse_pb_Frame member.
+ */
+#define SYNAPSE_TOPIC_LIST(X)                                                                      \
+	X(accel_sp, synapse_pb_Vector3, vector3, snprint_vector3)                                  \
+	X(actuators, synapse_pb_Actuators, actuators, snprint_actuators)                           \
+	X(altimeter, synapse_pb_Altimeter, altimeter, snprint_altimeter)                           \
+	X(angular_velocity_ff, synapse_pb_Vector3, vector3, snprint_vector3)                       \
+	X(angular_velocity_sp, synapse_pb_Vector3, vector3, snprint_vector3)                       \
+	X(attitude_sp, synapse_pb_Quaternion, quaternion, snprint_quaternion)                      \
+	X(battery_headroom, struct synapse_battery_headroom, none, snprint_battery_headroom)       \
+	X(battery_state, synapse_pb_BatteryState, battery_state, snprint_battery_state)            \
+	X(bezier_trajectory, synapse_pb_BezierTrajectory, bezier_trajectory,                       \
+	  snprint_bezier_trajectory)                                                               \
+	X(bezier_trajectory_ethernet, synapse_pb_BezierTrajectory, bezier_trajectory,              \
+	  snprint_bezier_trajectory)                                                               \
+	X(clock_offset_ethernet, synapse_pb_ClockOffset, clock_offset, snprint_clock_offset)       \
+	X(cmd_vel, synapse_pb_Twist, twist, snprint_twist)                                         \
+	X(cmd_vel_ethernet, synapse_pb_Twist, twist, snprint_twist)                                \
+	X(force_sp, synapse_pb_Vector3, vector3, snprint_vector3)                                  \
+	X(health, struct synapse_health, none, snprint_health)                                     \
+	X(imu, synapse_pb_Imu, imu, snprint_imu)                                                   \
+	X(imu_delta, struct synapse_imu_delta, none, snprint_imu_delta)                            \
+	X(imu_q31_array, synapse_pb_ImuQ31Array, imu_q31_array, snprint_imu_q31_array)             \
+	X(imu_q31_array_1, synapse_pb_ImuQ31Array, imu_q31_array, snprint_imu_q31_array)           \
+	X(imu_q31_array_2, synapse_pb_ImuQ31Array, imu_q31_array, snprint_imu_q31_array)           \
+	X(imu_q31_array_3, synapse_pb_ImuQ31Array, imu_q31_array, snprint_imu_q31_array)           \
+	X(input, synapse_pb_Input, input, snprint_input)                                           \
+	X(input_ethernet, synapse_pb_Input, input, snprint_input)                                  \
+	X(input_sbus, synapse_pb_Input, input, snprint_input)                                      \
+	X(latency, struct synapse_latency_trace, none, snprint_latency)                            \
+	X(led_array, synapse_pb_LEDArray, led_array, snprint_ledarray)                             \
+	X(magnetic_field, synapse_pb_MagneticField, magnetic_field, snprint_magnetic_field)        \
+	X(moment_ff, synapse_pb_Vector3, vector3, snprint_vector3)                                 \
+	X(moment_sp, synapse_pb_Vector3, vector3, snprint_vector3)                                 \
+	X(motor_state, struct synapse_motor_state, none, snprint_motor_state)                      \
+	X(nav_sat_fix, synapse_pb_NavSatFix, nav_sat_fix, snprint_navsatfix)                       \
+	X(odometry_estimator, synapse_pb_Odometry, odometry, snprint_odometry)                     \
+	X(odometry_ethernet, synapse_pb_Odometry, odometry, snprint_odometry)                      \
+	X(orientation_sp, synapse_pb_Quaternion, quaternion, snprint_quaternion)                   \
+	X(position_sp, synapse_pb_Vector3, vector3, snprint_vector3)                               \
+	X(pwm, synapse_pb_Pwm, pwm, snprint_pwm)                                                   \
+	X(safety, synapse_pb_Safety, safety, snprint_safety)                                       \
+	X(sbus_status, struct synapse_sbus_status, none, snprint_sbus_status)                      \
+	X(status, synapse_pb_Status, status, snprint_status)                                       \
+	X(telemetry_rates, struct synapse_telemetry_rates, none, snprint_telemetry_rates)          \
+	X(thread_monitor, struct synapse_thread_monitor, none, snprint_thread_monitor)             \
+	X(topic_stats, struct synapse_topic_stats, none, snprint_topic_stats)                      \
+	X(velocity_sp, synapse_pb_Vector3, vector3, snprint_vector3)                               \
+	X(wheel_odometry, synapse_pb_WheelOdometry, wheel_odometry, snprint_wheel_odometry)        \
+	X(wheel_velocity, struct synapse_wheel_velocity, none, snprint_wheel_velocity)
+
+#define SYNAPSE_TOPIC_DECLARE(name, type, frame, snprint) ZROS_TOPIC_DECLARE(topic_##name, type);
+SYNAPSE_TOPIC_LIST(SYNAPSE_TOPIC_DECLARE)
+
+/********************************************************************
+ * loans, zero-copy publishing of large topics
+ ********************************************************************/
+#define SYNAPSE_LOAN_LIST(X)                                                                       \
+	X(bezier_trajectory_ethernet, synapse_pb_BezierTrajectory)                                 \
+	X(odometry_estimator, synapse_pb_Odometry)                                                 \
+	X(odometry_ethernet, synapse_pb_Odometry)
+
+#define SYNAPSE_LOAN_DECLARE_ENTRY(name, type) SYNAPSE_LOAN_DECLARE(name);
+SYNAPSE_LOAN_LIST(SYNAPSE_LOAN_DECLARE_ENTRY)
+
+/*
+ * loans of messages with nanopb pointer fields, X(name, type, arena bytes
+ * per buffer), decoded into with CONFIG_CEREBRI_CORE_COMMON_PB_ARENA
+ */
+#define SYNAPSE_LOAN_ARENA_LIST(X)
+
+#define SYNAPSE_LOAN_ARENA_DECLARE_ENTRY(name, type, size) SYNAPSE_LOAN_DECLARE(name);
+SYNAPSE_LOAN_ARENA_LIST(SYNAPSE_LOAN_ARENA_DECLARE_ENTRY)
+
+/********************************************************************
+ * seqlocks, lock-free reads of single publisher topics
+ ********************************************************************/
+// odometry_estimator stays a loan, readers borrow it instead of copying and retrying it
+#define SYNAPSE_SEQLOCK_LIST(X) X(imu, synapse_pb_Imu) X(status, synapse_pb_Status)
+
+#define SYNAPSE_SEQLOCK_DECLARE_ENTRY(name, type) SYNAPSE_SEQLOCK_DECLARE(name);
+SYNAPSE_SEQLOCK_LIST(SYNAPSE_SEQLOCK_DECLARE_ENTRY)
+
+/********************************************************************
+ * registry, lookup and republishing, for bridges, logger and shell
+ ********************************************************************/
+// frame field of the topics without a synapse_pb_Frame member
+#define synapse_pb_Frame_none_tag 0
+
+#define SYNAPSE_TOPIC_ID_ENTRY(name, type, frame, snprint) SYNAPSE_TOPIC_ID_##name,
+enum synapse_topic_id {
+	SYNAPSE_TOPIC_LIST(SYNAPSE_TOPIC_ID_ENTRY) SYNAPSE_TOPIC_COUNT
+};
+
+// synapse_pb_Frame tag of each topic as a constant, SYNAPSE_TOPIC_FRAME_imu
+#define SYNAPSE_TOPIC_FRAME_ENTRY(name, type, frame, snprint)                                      \
+	SYNAPSE_TOPIC_FRAME_##name = synapse_pb_Frame_##frame##_tag,
+enum synapse_topic_frame {
+	SYNAPSE_TOPIC_LIST(SYNAPSE_TOPIC_FRAME_ENTRY)
+};
+
+struct synapse_topic_info {
+	struct zros_topic *topic;
+	const char *name;
+	size_t size;
+	// synapse_pb_Frame tag, 0 for a message that is no frame member
+	pb_size_t frame_tag;
+	// nanopb descriptor of the frame member, NULL without one
+	const pb_msgdesc_t *fields;
+	snprint_t *snprint;
+};
+
+/*
+ * registry entry by id, in SYNAPSE_TOPIC_LIST order, NULL out of range,
+ * fields are filled in before the kernel starts
+ */
+const struct synapse_topic_info *synapse_topic_info(int id);
+
+/* registry id of a topic, -ENOENT if it is not in the list, a hash lookup */
+int synapse_topic_id(const struct zros_topic *topic);
+
+/* registry entry of a topic, NULL if it is not in the list */
+const struct synapse_topic_info *synapse_topic_lookup(const struct zros_topic *topic);
+
+/* topic with the given name, NULL if there is none */
+struct zros_topic *synapse_topic_find(const char *name);
+
+/* name of a topic, NULL if it is not in the list */
+const char *synapse_topic_name(const struct zros_topic *topic);
+
+/*
+ * publish a message that came from outside the node graph, through the loan
+ * or seqlock of the topic if it has one so all its subscribers see it
+ */
+int synapse_topic_republish(struct zros_topic *topic, const void *msg);
 
 #endif // SYNAPSE_TOPIC_LIST_H_
 // vi: ts=4 sw=4 et
@@ -0,0 +1,52 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_TOPIC_STATS_H
+#define SYNAPSE_TOPIC_STATS_H
+
+#include <stdint.h>
+
+#define SYNAPSE_TOPIC_STATS_MAX_TOPICS 64
+#define SYNAPSE_TOPIC_STATS_NAME_LEN   28
+
+struct synapse_topic_stat {
+	char name[SYNAPSE_TOPIC_STATS_NAME_LEN];
+	uint32_t publishes;
+	uint64_t bytes;
+	uint32_t last_publish_cyc;
+	// inter-arrival time, min and max over the last sample window
+	uint32_t interval_min_us;
+	uint32_t interval_max_us;
+	uint32_t interval_avg_us;
+	// messages subscribers did not take in the last window, mostly rate limiting
+	uint32_t skipped;
+};
+
+struct synapse_topic_stats {
+	uint32_t uptime_ms;
+	uint8_t topic_count;
+	struct synapse_topic_stat topic[SYNAPSE_TOPIC_STATS_MAX_TOPICS];
+};
+
+struct shell;
+struct zros_topic;
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_STATS)
+
+/* count a publish, called by synapse_topic_notify */
+void synapse_topic_stats_record(struct zros_topic *topic);
+
+int synapse_topic_stats_print(const struct shell *sh);
+
+#else
+
+static inline void synapse_topic_stats_record(struct zros_topic *topic)
+{
+	(void)topic;
+}
+
+#endif
+
+#endif // SYNAPSE_TOPIC_STATS_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,28 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SYNAPSE_WHEEL_VELOCITY_H
+#define SYNAPSE_WHEEL_VELOCITY_H
+
+#include <stdint.h>
+
+/*
+ * Wheel rotation and rate from encoder edge times, published by
+ * sense_wheel_odometry in capture mode. The rate is the count between
+ * two edges over the time between them rather than a count over a fixed
+ * window, so its quantization does not grow with the publish rate.
+ */
+struct synapse_wheel_velocity {
+	// uptime of the last edge counted
+	uint64_t stamp_ns;
+	// rad, same sign as wheel_odometry
+	double rotation;
+	// rad/s, an upper bound falling towards 0 while no edge arrives
+	float velocity;
+	// edges counted since the last message
+	uint16_t edges;
+};
+
+#endif // SYNAPSE_WHEEL_VELOCITY_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,175 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#include <zros/zros_topic.h>
+
+#include "synapse_cache.h"
+
+#define READ_RETRIES     CONFIG_CEREBRI_SYNAPSE_TOPIC_CACHE_RETRIES
+#define SNAPSHOT_RETRIES CONFIG_CEREBRI_SYNAPSE_TOPIC_CACHE_RETRIES
+
+struct cache_entry {
+	struct zros_topic *topic;
+	uint16_t offset;
+	uint16_t size;
+	// odd while the message is written, a writer claims the entry by making it odd
+	atomic_t seq;
+	uint32_t publishes;
+	int64_t ticks;
+};
+
+#define CACHE_ENTRY(name, type, frame, snprint)                                                    \
+	{.topic = &topic_##name,                                                                   \
+	 .offset = offsetof(struct synapse_cache_msgs, name),                                      \
+	 .size = sizeof(type)},
+
+static struct cache_entry g_entries[] = {SYNAPSE_TOPIC_LIST(CACHE_ENTRY)};
+
+BUILD_ASSERT(sizeof(struct synapse_cache_msgs) <= UINT16_MAX, "cache offsets are 16 bit");
+
+static struct synapse_cache_msgs g_msgs;
+
+// writes started and completed, equal while no message is written
+static atomic_t g_begin;
+static atomic_t g_end;
+
+static struct synapse_cache_snapshot g_snapshot;
+
+static K_MUTEX_DEFINE(g_snapshot_lock);
+
+BUILD_ASSERT(ARRAY_SIZE(g_entries) == SYNAPSE_TOPIC_COUNT, "cache is indexed by registry id");
+
+static struct cache_entry *entry_get(const struct zros_topic *topic)
+{
+	int id = synapse_topic_id(topic);
+	return id < 0 ? NULL : &g_entries[id];
+}
+
+void synapse_cache_record(struct zros_topic *topic, const void *msg)
+{
+	struct cache_entry *entry = entry_get(topic);
+	if (entry == NULL || msg == NULL) {
+		return;
+	}
+
+	// a second publisher of the topic preempted the first mid write, the
+	// first completes after it, so the newer message is the one dropped
+	atomic_val_t seq = atomic_get(&entry->seq);
+	if ((seq & 1) || !atomic_cas(&entry->seq, seq, seq + 1)) {
+		return;
+	}
+	atomic_inc(&g_begin);
+	memcpy((uint8_t *)&g_msgs + entry->offset, msg, entry->size);
+	entry->publishes++;
+	entry->ticks = k_uptime_ticks();
+	atomic_inc(&entry->seq);
+	atomic_inc(&g_end);
+}
+
+// lock free copy of one entry, false if writes kept landing during it
+static bool entry_copy(struct cache_entry *entry, void *msg, struct synapse_cache_meta *meta)
+{
+	const uint8_t *src = (const uint8_t *)&g_msgs + entry->offset;
+
+	for (int i = 0; i < READ_RETRIES; i++) {
+		atomic_val_t seq = atomic_get(&entry->seq);
+		if (seq & 1) {
+			continue;
+		}
+		memcpy(msg, src, entry->size);
+		meta->publishes = entry->publishes;
+		meta->ticks = entry->ticks;
+		if (atomic_get(&entry->seq) == seq) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int synapse_cache_read(const struct zros_topic *topic, void *msg)
+{
+	struct cache_entry *entry = entry_get(topic);
+	if (entry == NULL) {
+		return -ENOENT;
+	}
+	if (entry->publishes == 0) {
+		return -EAGAIN;
+	}
+	struct synapse_cache_meta meta;
+	return entry_copy(entry, msg, &meta) ? 0 : -EBUSY;
+}
+
+static void snapshot_fill(struct synapse_cache_snapshot *snap)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(g_entries); i++) {
+		struct cache_entry *entry = &g_entries[i];
+		if (!entry_copy(entry, (uint8_t *)&snap->msg + entry->offset, &snap->meta[i])) {
+			// torn by a writer every retry, left out of this snapshot
+			snap->meta[i].publishes = 0;
+		}
+	}
+}
+
+const struct synapse_cache_snapshot *synapse_cache_snapshot_take(k_timeout_t timeout)
+{
+	if (k_mutex_lock(&g_snapshot_lock, timeout) != 0) {
+		return NULL;
+	}
+
+	struct synapse_cache_snapshot *snap = &g_snapshot;
+	snap->atomic = false;
+	snap->attempts = 0;
+	while (snap->attempts < SNAPSHOT_RETRIES) {
+		snap->attempts++;
+		atomic_val_t begin = atomic_get(&g_begin);
+		if (atomic_get(&g_end) != begin) {
+			k_yield();
+			continue;
+		}
+		snapshot_fill(snap);
+		if (atomic_get(&g_begin) == begin) {
+			snap->atomic = true;
+			break;
+		}
+	}
+	if (!snap->atomic) {
+		// every topic is still consistent on its own
+		snapshot_fill(snap);
+	}
+	snap->ticks = k_uptime_ticks();
+	return snap;
+}
+
+void synapse_cache_snapshot_release(void)
+{
+	k_mutex_unlock(&g_snapshot_lock);
+}
+
+const void *synapse_cache_snapshot_msg(const struct synapse_cache_snapshot *snap, int index,
+				       size_t *size)
+{
+	if (index < 0 || index >= SYNAPSE_CACHE_TOPIC_COUNT || snap->meta[index].publishes == 0) {
+		return NULL;
+	}
+	if (size != NULL) {
+		*size = g_entries[index].size;
+	}
+	return (const uint8_t *)&snap->msg + g_entries[index].offset;
+}
+
+struct zros_topic *synapse_cache_topic(int index)
+{
+	if (index < 0 || index >= SYNAPSE_CACHE_TOPIC_COUNT) {
+		return NULL;
+	}
+	return g_entries[index].topic;
+}
+
+// vi: ts=4 sw=4 et
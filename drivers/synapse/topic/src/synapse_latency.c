@@ -0,0 +1,167 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/spinlock.h>
+
+#include <zros/zros_topic.h>
+
+#include <cerebri/core/perf_histogram.h>
+
+#include "synapse_latency.h"
+#include "synapse_topic_list.h"
+
+static const char *stage_name[SYNAPSE_LATENCY_STAGE_COUNT] = {
+	"imu", "estimate", "attitude", "angular_velocity", "allocation", "actuate",
+};
+
+const char *synapse_latency_stage_str(enum synapse_latency_stage stage)
+{
+	if (stage >= SYNAPSE_LATENCY_STAGE_COUNT) {
+		return "unknown";
+	}
+	return stage_name[stage];
+}
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_LATENCY)
+
+struct stage_stats {
+	struct synapse_latency_trace last;
+	uint32_t last_origin_cyc;
+	uint32_t max_hop_cyc;
+	struct perf_histogram hop;
+};
+
+static struct {
+	struct k_spinlock lock;
+	struct stage_stats stage[SYNAPSE_LATENCY_STAGE_COUNT];
+	uint32_t max_total_cyc;
+	struct perf_histogram total;
+} g_latency;
+
+void synapse_latency_begin(struct synapse_latency_trace *trace)
+{
+	memset(trace, 0, sizeof(*trace));
+	trace->origin_cyc = k_cycle_get_32();
+}
+
+void synapse_latency_get(enum synapse_latency_stage stage, struct synapse_latency_trace *trace)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_latency.lock);
+	*trace = g_latency.stage[stage].last;
+	k_spin_unlock(&g_latency.lock, key);
+}
+
+void synapse_latency_mark(enum synapse_latency_stage stage, struct synapse_latency_trace *trace)
+{
+	// no origin yet, upstream stage has not published a traced message
+	if (trace->origin_cyc == 0) {
+		return;
+	}
+
+	uint32_t now = k_cycle_get_32();
+
+	// hop is measured from the closest upstream stage this trace passed
+	uint32_t prev = trace->origin_cyc;
+	for (int i = (int)stage - 1; i >= 0; i--) {
+		if (trace->stage_mask & BIT(i)) {
+			prev = trace->stage_cyc[i];
+			break;
+		}
+	}
+	uint32_t hop = now - prev;
+	uint32_t total = now - trace->origin_cyc;
+
+	trace->stage_cyc[stage] = now;
+	trace->stage_mask |= BIT(stage);
+
+	k_spinlock_key_t key = k_spin_lock(&g_latency.lock);
+	struct stage_stats *s = &g_latency.stage[stage];
+	// a node woken by timeout consumes the same trace again, count it once
+	bool repeat = s->last_origin_cyc == trace->origin_cyc;
+	if (!repeat) {
+		s->last = *trace;
+		s->last_origin_cyc = trace->origin_cyc;
+		if (hop > s->max_hop_cyc) {
+			s->max_hop_cyc = hop;
+		}
+		if (stage == SYNAPSE_LATENCY_ACTUATE && total > g_latency.max_total_cyc) {
+			g_latency.max_total_cyc = total;
+		}
+	}
+	k_spin_unlock(&g_latency.lock, key);
+
+	if (repeat) {
+		return;
+	}
+
+	perf_histogram_record(&s->hop, hop);
+	if (stage == SYNAPSE_LATENCY_ACTUATE) {
+		perf_histogram_record(&g_latency.total, total);
+		zros_topic_publish(&topic_latency, trace);
+	}
+}
+
+static int64_t cyc_to_ns(uint32_t cyc)
+{
+	return 1000000000LL * cyc / sys_clock_hw_cycles_per_sec();
+}
+
+static void print_row(const struct shell *sh, const char *name, const struct perf_histogram *hist,
+		      uint32_t max_cyc)
+{
+	shell_print(sh, "%-18s %10lld %10lld %10lld %10lld %10u", name,
+		    cyc_to_ns(perf_histogram_percentile(hist, 5000)),
+		    cyc_to_ns(perf_histogram_percentile(hist, 9900)),
+		    cyc_to_ns(perf_histogram_percentile(hist, 9990)), cyc_to_ns(max_cyc),
+		    perf_histogram_count(hist));
+}
+
+static int cmd_latency(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	shell_print(sh, "%-18s %10s %10s %10s %10s %10s", "hop (ns)", "p50", "p99", "p99.9", "max",
+		    "samples");
+	for (int i = 0; i < SYNAPSE_LATENCY_STAGE_COUNT; i++) {
+		print_row(sh, stage_name[i], &g_latency.stage[i].hop,
+			  g_latency.stage[i].max_hop_cyc);
+	}
+	print_row(sh, "end to end", &g_latency.total, g_latency.max_total_cyc);
+	return 0;
+}
+
+static int cmd_latency_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	k_spinlock_key_t key = k_spin_lock(&g_latency.lock);
+	for (int i = 0; i < SYNAPSE_LATENCY_STAGE_COUNT; i++) {
+		g_latency.stage[i].max_hop_cyc = 0;
+	}
+	g_latency.max_total_cyc = 0;
+	k_spin_unlock(&g_latency.lock, key);
+	for (int i = 0; i < SYNAPSE_LATENCY_STAGE_COUNT; i++) {
+		perf_histogram_reset(&g_latency.stage[i].hop);
+	}
+	perf_histogram_reset(&g_latency.total);
+	shell_print(sh, "latency reset");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_latency,
+			       SHELL_CMD(reset, NULL, "Reset latency statistics.",
+					 cmd_latency_reset),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(latency, &sub_latency, "Control pipeline latency per stage", cmd_latency);
+
+#endif
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,203 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+
+#include "synapse_liveness.h"
+#include "synapse_topic_list.h"
+
+LOG_MODULE_REGISTER(synapse_liveness, CONFIG_CEREBRI_SYNAPSE_TOPIC_LOG_LEVEL);
+
+#define PERIOD_US CONFIG_CEREBRI_SYNAPSE_TOPIC_LIVENESS_PERIOD_US
+
+extern struct k_work_q g_low_priority_work_q;
+
+static void liveness_timer_handler(struct k_timer *timer);
+static void liveness_work_handler(struct k_work *work);
+
+struct context {
+	// watches are appended once and never removed, so the publish path
+	// reads them without a lock
+	struct synapse_liveness *watches[SYNAPSE_LIVENESS_MAX];
+	atomic_t count;
+	struct k_spinlock lock;
+	struct k_timer timer;
+	struct k_poll_signal health_signal;
+	struct k_work work_item;
+	atomic_t stale;
+	atomic_t watched;
+	struct zros_node node;
+	struct zros_pub pub;
+	struct synapse_health msg;
+	bool initialized;
+	bool timer_running;
+};
+
+static struct context g_ctx = {
+	.watches = {},
+	.count = ATOMIC_INIT(0),
+	.timer = Z_TIMER_INITIALIZER(g_ctx.timer, liveness_timer_handler, NULL),
+	.health_signal = K_POLL_SIGNAL_INITIALIZER(g_ctx.health_signal),
+	.work_item = Z_WORK_INITIALIZER(liveness_work_handler),
+	.stale = ATOMIC_INIT(0),
+	.watched = ATOMIC_INIT(0),
+	.node = {},
+	.pub = {},
+	.msg = {},
+	.initialized = false,
+	.timer_running = false,
+};
+
+void synapse_liveness_record(struct zros_topic *topic)
+{
+	atomic_val_t count = atomic_get(&g_ctx.count);
+	if (count == 0) {
+		return;
+	}
+	atomic_val_t now = (atomic_val_t)k_uptime_ticks();
+	for (atomic_val_t i = 0; i < count; i++) {
+		struct synapse_liveness *watch = g_ctx.watches[i];
+		if (watch->topic == topic) {
+			atomic_set(&watch->last_ticks, now);
+		}
+	}
+}
+
+void synapse_liveness_start(struct synapse_liveness *watch)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_ctx.lock);
+	if (watch->bit < 0) {
+		atomic_val_t count = atomic_get(&g_ctx.count);
+		if (count >= SYNAPSE_LIVENESS_MAX) {
+			k_spin_unlock(&g_ctx.lock, key);
+			LOG_ERR("no liveness slot for %s", watch->consumer);
+			return;
+		}
+		watch->bit = count;
+		g_ctx.watches[count] = watch;
+		atomic_set(&g_ctx.count, count + 1);
+	}
+	atomic_set(&watch->last_ticks, (atomic_val_t)k_uptime_ticks());
+	atomic_set(&watch->stale, 0);
+	k_poll_signal_reset(&watch->signal);
+	watch->watching = true;
+	atomic_or(&g_ctx.watched, BIT(watch->bit));
+	// the first watch starts the timer, it runs from then on
+	bool start_timer = !g_ctx.timer_running;
+	g_ctx.timer_running = true;
+	k_spin_unlock(&g_ctx.lock, key);
+
+	if (start_timer) {
+		k_timer_start(&g_ctx.timer, K_USEC(PERIOD_US), K_USEC(PERIOD_US));
+	}
+}
+
+void synapse_liveness_stop(struct synapse_liveness *watch)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_ctx.lock);
+	watch->watching = false;
+	if (watch->bit >= 0) {
+		atomic_and(&g_ctx.watched, ~BIT(watch->bit));
+	}
+	k_spin_unlock(&g_ctx.lock, key);
+}
+
+void synapse_liveness_ack(struct synapse_liveness *watch, struct k_poll_event *event)
+{
+	k_poll_signal_reset(&watch->signal);
+	event->state = K_POLL_STATE_NOT_READY;
+}
+
+uint32_t synapse_liveness_health(void)
+{
+	return (uint32_t)atomic_get(&g_ctx.stale);
+}
+
+struct k_poll_signal *synapse_liveness_health_signal(void)
+{
+	return &g_ctx.health_signal;
+}
+
+static void liveness_timer_handler(struct k_timer *timer)
+{
+	ARG_UNUSED(timer);
+	uint32_t now = (uint32_t)k_uptime_ticks();
+	uint32_t stale = 0;
+
+	k_spinlock_key_t key = k_spin_lock(&g_ctx.lock);
+	atomic_val_t count = atomic_get(&g_ctx.count);
+	for (atomic_val_t i = 0; i < count; i++) {
+		struct synapse_liveness *watch = g_ctx.watches[i];
+		if (!watch->watching) {
+			continue;
+		}
+		uint32_t age = now - (uint32_t)atomic_get(&watch->last_ticks);
+		bool late = age > k_ms_to_ticks_ceil32(watch->deadline_ms);
+		if (late) {
+			stale |= BIT(i);
+			if (atomic_set(&watch->stale, 1) == 0) {
+				watch->misses++;
+				k_poll_signal_raise(&watch->signal, 0);
+			}
+		} else if (atomic_set(&watch->stale, 0) != 0) {
+			k_poll_signal_raise(&watch->signal, 0);
+		}
+	}
+	k_spin_unlock(&g_ctx.lock, key);
+
+	if ((uint32_t)atomic_set(&g_ctx.stale, stale) != stale) {
+		k_poll_signal_raise(&g_ctx.health_signal, 0);
+		k_work_submit_to_queue(&g_low_priority_work_q, &g_ctx.work_item);
+	}
+}
+
+static void liveness_work_handler(struct k_work *work)
+{
+	struct context *ctx = CONTAINER_OF(work, struct context, work_item);
+
+	// topics are registered with the broker late in boot, so init on first change
+	if (!ctx->initialized) {
+		zros_node_init(&ctx->node, "synapse_liveness");
+		zros_pub_init(&ctx->pub, &ctx->node, &topic_health, &ctx->msg);
+		ctx->initialized = true;
+	}
+
+	ctx->msg.stamp_ns = k_ticks_to_ns_floor64(k_uptime_ticks());
+	ctx->msg.stale = (uint32_t)atomic_get(&ctx->stale);
+	ctx->msg.watched = (uint32_t)atomic_get(&ctx->watched);
+	zros_pub_update(&ctx->pub);
+}
+
+static int cmd_liveness(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	uint32_t now = (uint32_t)k_uptime_ticks();
+
+	shell_print(sh, "%-3s %-24s %-24s %8s %8s %6s %8s", "bit", "topic", "consumer",
+		    "deadline", "age ms", "stale", "misses");
+	atomic_val_t count = atomic_get(&g_ctx.count);
+	for (atomic_val_t i = 0; i < count; i++) {
+		struct synapse_liveness *watch = g_ctx.watches[i];
+		const char *name = synapse_topic_name(watch->topic);
+		uint32_t age = now - (uint32_t)atomic_get(&watch->last_ticks);
+		shell_print(sh, "%-3d %-24s %-24s %8u %8u %6s %8u", (int)i,
+			    name != NULL ? name : "-", watch->consumer, watch->deadline_ms,
+			    k_ticks_to_ms_floor32(age),
+			    !watch->watching ? "-" : (synapse_liveness_stale(watch) ? "yes" : "no"),
+			    watch->misses);
+	}
+	return 0;
+}
+
+SHELL_CMD_REGISTER(liveness, NULL, "Topic deadlines of each consumer", cmd_liveness);
+
+// vi: ts=4 sw=4 et
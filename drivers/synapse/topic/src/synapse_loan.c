@@ -0,0 +1,182 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include <zros/zros_topic.h>
+
+#include "synapse_loan.h"
+#include "synapse_topic_hook.h"
+
+#define LOAN_SLOTS CONFIG_CEREBRI_SYNAPSE_TOPIC_LOAN_SLOTS
+
+static void *slot_msg(struct synapse_loan *loan, int slot)
+{
+	return loan->pool + slot * loan->size;
+}
+
+static int msg_slot(struct synapse_loan *loan, const void *msg)
+{
+	return ((const uint8_t *)msg - loan->pool) / loan->size;
+}
+
+static void slot_release(struct synapse_loan *loan, int slot)
+{
+	if (slot >= 0) {
+		atomic_dec(&loan->ref[slot]);
+	}
+}
+
+// a rate limited subscriber is only woken once its period is over, under loan->lock
+static bool sub_due(const struct synapse_loan_sub *sub, int64_t now)
+{
+	return sub->period_ticks == 0 || now >= sub->next_ticks;
+}
+
+static void count_sub(const struct zros_sub *sub, void *data)
+{
+	ARG_UNUSED(sub);
+	(*(int *)data)++;
+}
+
+void *synapse_loan_acquire(struct synapse_loan *loan)
+{
+	// the latest message and borrowed ones hold a reference, so 0 means free
+	for (int i = 0; i < LOAN_SLOTS; i++) {
+		if (atomic_cas(&loan->ref[i], 0, 1)) {
+			if (loan->arenas != NULL) {
+				arena_reset(&loan->arenas[i]);
+			}
+			return slot_msg(loan, i);
+		}
+	}
+	loan->exhausted++;
+	return NULL;
+}
+
+struct arena *synapse_loan_arena(struct synapse_loan *loan, const void *msg)
+{
+	return loan->arenas != NULL ? &loan->arenas[msg_slot(loan, msg)] : NULL;
+}
+
+void synapse_loan_discard(struct synapse_loan *loan, void *msg)
+{
+	slot_release(loan, msg_slot(loan, msg));
+}
+
+void synapse_loan_publish(struct synapse_loan *loan, void *msg)
+{
+	int slot = msg_slot(loan, msg);
+	int64_t now = k_uptime_ticks();
+
+	k_spinlock_key_t key = k_spin_lock(&loan->lock);
+	int old = loan->latest;
+	atomic_inc(&loan->ref[slot]);
+	loan->latest = slot;
+	loan->seq++;
+	struct synapse_loan_sub *sub;
+	SYS_SLIST_FOR_EACH_CONTAINER(&loan->subs, sub, node) {
+		if (sub_due(sub, now)) {
+			k_poll_signal_raise(&sub->signal, 0);
+		}
+	}
+	k_spin_unlock(&loan->lock, key);
+	slot_release(loan, old);
+
+	// nodes still on zros_sub get their copy the old way, the publisher reference
+	// keeps the buffer alive while zros copies it
+	int zros_subs = 0;
+	zros_topic_iterate_sub(loan->topic, count_sub, &zros_subs);
+	if (zros_subs > 0) {
+		zros_topic_publish(loan->topic, msg);
+	} else {
+		synapse_topic_notify(loan->topic, msg);
+	}
+	slot_release(loan, slot);
+}
+
+int synapse_loan_publish_copy(struct synapse_loan *loan, const void *msg)
+{
+	void *buf = synapse_loan_acquire(loan);
+	if (buf == NULL) {
+		return -ENOMEM;
+	}
+	memcpy(buf, msg, loan->size);
+	synapse_loan_publish(loan, buf);
+	return 0;
+}
+
+void synapse_loan_sub_init(struct synapse_loan_sub *sub, struct synapse_loan *loan, int rate_hz)
+{
+	sub->loan = loan;
+	sub->borrowed = -1;
+	sub->period_ticks = rate_hz > 0 ? CONFIG_SYS_CLOCK_TICKS_PER_SEC / rate_hz : 0;
+	sub->next_ticks = 0;
+	k_poll_signal_init(&sub->signal);
+	k_poll_event_init(&sub->event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &sub->signal);
+
+	k_spinlock_key_t key = k_spin_lock(&loan->lock);
+	sub->seq = loan->seq;
+	sys_slist_append(&loan->subs, &sub->node);
+	k_spin_unlock(&loan->lock, key);
+}
+
+void synapse_loan_sub_fini(struct synapse_loan_sub *sub)
+{
+	struct synapse_loan *loan = sub->loan;
+
+	k_spinlock_key_t key = k_spin_lock(&loan->lock);
+	sys_slist_find_and_remove(&loan->subs, &sub->node);
+	k_spin_unlock(&loan->lock, key);
+	synapse_loan_release(sub);
+}
+
+bool synapse_loan_sub_update_available(struct synapse_loan_sub *sub)
+{
+	struct synapse_loan *loan = sub->loan;
+
+	k_spinlock_key_t key = k_spin_lock(&loan->lock);
+	bool due = sub_due(sub, k_uptime_ticks());
+	if (!due) {
+		// a signal left from before the period started must not wake the poll again
+		k_poll_signal_reset(&sub->signal);
+		sub->event.state = K_POLL_STATE_NOT_READY;
+	}
+	bool available = due && sub->seq != loan->seq;
+	k_spin_unlock(&loan->lock, key);
+	return available;
+}
+
+const void *synapse_loan_borrow(struct synapse_loan_sub *sub)
+{
+	struct synapse_loan *loan = sub->loan;
+
+	k_spinlock_key_t key = k_spin_lock(&loan->lock);
+	int slot = loan->latest;
+	if (slot >= 0) {
+		atomic_inc(&loan->ref[slot]);
+	}
+	sub->seq = loan->seq;
+	k_poll_signal_reset(&sub->signal);
+	sub->event.state = K_POLL_STATE_NOT_READY;
+	if (sub->period_ticks > 0) {
+		sub->next_ticks = k_uptime_ticks() + sub->period_ticks;
+	}
+	k_spin_unlock(&loan->lock, key);
+
+	slot_release(loan, sub->borrowed);
+	sub->borrowed = slot;
+	return slot >= 0 ? slot_msg(loan, slot) : NULL;
+}
+
+void synapse_loan_release(struct synapse_loan_sub *sub)
+{
+	slot_release(sub->loan, sub->borrowed);
+	sub->borrowed = -1;
+}
+
+// vi: ts=4 sw=4 et
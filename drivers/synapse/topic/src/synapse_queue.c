@@ -0,0 +1,97 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/barrier.h>
+
+#include "synapse_queue.h"
+
+static sys_slist_t g_queues = SYS_SLIST_STATIC_INIT(&g_queues);
+
+// guards the queue list and serializes publishers, the consumer never takes it
+static struct k_spinlock g_lock;
+
+static void *slot_msg(struct synapse_queue *queue, atomic_val_t n)
+{
+	return queue->buf + ((uint32_t)n & (queue->depth - 1)) * queue->size;
+}
+
+int synapse_queue_init(struct synapse_queue *queue, struct zros_topic *topic, void *buf,
+		       size_t size, size_t depth)
+{
+	// a power of two keeps the slot index right when the counters wrap
+	if (depth == 0 || (depth & (depth - 1)) != 0) {
+		return -EINVAL;
+	}
+	queue->topic = topic;
+	queue->buf = buf;
+	queue->size = size;
+	queue->depth = depth;
+	atomic_set(&queue->head, 0);
+	atomic_set(&queue->tail, 0);
+	queue->overruns = 0;
+	k_poll_signal_init(&queue->signal);
+	k_poll_event_init(&queue->event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY,
+			  &queue->signal);
+
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	sys_slist_append(&g_queues, &queue->node);
+	k_spin_unlock(&g_lock, key);
+	return 0;
+}
+
+void synapse_queue_fini(struct synapse_queue *queue)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	sys_slist_find_and_remove(&g_queues, &queue->node);
+	k_spin_unlock(&g_lock, key);
+}
+
+void synapse_queue_push(struct zros_topic *topic, const void *msg)
+{
+	struct synapse_queue *queue;
+
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_queues, queue, node) {
+		if (queue->topic != topic) {
+			continue;
+		}
+		atomic_val_t head = atomic_get(&queue->head);
+		if ((uint32_t)(head - atomic_get(&queue->tail)) >= queue->depth) {
+			queue->overruns++;
+			continue;
+		}
+		memcpy(slot_msg(queue, head), msg, queue->size);
+		barrier_dmem_fence_full();
+		atomic_set(&queue->head, head + 1);
+		k_poll_signal_raise(&queue->signal, 0);
+	}
+	k_spin_unlock(&g_lock, key);
+}
+
+int synapse_queue_pop(struct synapse_queue *queue, void *msg)
+{
+	atomic_val_t tail = atomic_get(&queue->tail);
+
+	if (atomic_get(&queue->head) == tail) {
+		k_poll_signal_reset(&queue->signal);
+		queue->event.state = K_POLL_STATE_NOT_READY;
+		// a push between the check and the reset would otherwise not wake the consumer
+		if (atomic_get(&queue->head) == tail) {
+			return -EAGAIN;
+		}
+	}
+
+	// publishers never write a slot that has not been popped, so no lock is needed
+	barrier_dmem_fence_full();
+	memcpy(msg, slot_msg(queue, tail), queue->size);
+	barrier_dmem_fence_full();
+	atomic_set(&queue->tail, tail + 1);
+	return 0;
+}
+
+// vi: ts=4 sw=4 et
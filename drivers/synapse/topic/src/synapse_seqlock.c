@@ -0,0 +1,131 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/barrier.h>
+
+#include <zros/zros_topic.h>
+
+#include "synapse_seqlock.h"
+#include "synapse_topic_hook.h"
+
+// a reader that is lapped this often in a row gives up until the next message
+#define READ_TRIES 4
+
+// a rate limited subscriber is only woken once its period is over, under seqlock->lock
+static bool sub_due(const struct synapse_seqlock_sub *sub, int64_t now)
+{
+	return sub->period_ticks == 0 || now >= sub->next_ticks;
+}
+
+static void count_sub(const struct zros_sub *sub, void *data)
+{
+	ARG_UNUSED(sub);
+	(*(int *)data)++;
+}
+
+void synapse_seqlock_publish(struct synapse_seqlock *seqlock, const void *msg)
+{
+	atomic_val_t n = atomic_get(&seqlock->end) + 1;
+
+	atomic_set(&seqlock->begin, n);
+	barrier_dmem_fence_full();
+	memcpy(seqlock->buf + (n & 1) * seqlock->size, msg, seqlock->size);
+	barrier_dmem_fence_full();
+	atomic_set(&seqlock->end, n);
+
+	// only guards the subscriber list and their periods, never held across a copy
+	int64_t now = k_uptime_ticks();
+	k_spinlock_key_t key = k_spin_lock(&seqlock->lock);
+	struct synapse_seqlock_sub *sub;
+	SYS_SLIST_FOR_EACH_CONTAINER(&seqlock->subs, sub, node) {
+		if (sub_due(sub, now)) {
+			k_poll_signal_raise(&sub->signal, 0);
+		}
+	}
+	k_spin_unlock(&seqlock->lock, key);
+
+	int zros_subs = 0;
+	zros_topic_iterate_sub(seqlock->topic, count_sub, &zros_subs);
+	if (zros_subs > 0) {
+		zros_topic_publish(seqlock->topic, (void *)msg);
+	} else {
+		synapse_topic_notify(seqlock->topic, msg);
+	}
+}
+
+void synapse_seqlock_sub_init(struct synapse_seqlock_sub *sub, struct synapse_seqlock *seqlock,
+			      int rate_hz)
+{
+	sub->seqlock = seqlock;
+	sub->seq = atomic_get(&seqlock->end);
+	sub->period_ticks = rate_hz > 0 ? CONFIG_SYS_CLOCK_TICKS_PER_SEC / rate_hz : 0;
+	sub->next_ticks = 0;
+	k_poll_signal_init(&sub->signal);
+	k_poll_event_init(&sub->event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &sub->signal);
+
+	k_spinlock_key_t key = k_spin_lock(&seqlock->lock);
+	sys_slist_append(&seqlock->subs, &sub->node);
+	k_spin_unlock(&seqlock->lock, key);
+}
+
+void synapse_seqlock_sub_fini(struct synapse_seqlock_sub *sub)
+{
+	struct synapse_seqlock *seqlock = sub->seqlock;
+
+	k_spinlock_key_t key = k_spin_lock(&seqlock->lock);
+	sys_slist_find_and_remove(&seqlock->subs, &sub->node);
+	k_spin_unlock(&seqlock->lock, key);
+}
+
+bool synapse_seqlock_sub_update_available(struct synapse_seqlock_sub *sub)
+{
+	struct synapse_seqlock *seqlock = sub->seqlock;
+
+	k_spinlock_key_t key = k_spin_lock(&seqlock->lock);
+	bool due = sub_due(sub, k_uptime_ticks());
+	if (!due) {
+		// a signal left from before the period started must not wake the poll again
+		k_poll_signal_reset(&sub->signal);
+		sub->event.state = K_POLL_STATE_NOT_READY;
+	}
+	k_spin_unlock(&seqlock->lock, key);
+	return due && sub->seq != (uint32_t)atomic_get(&seqlock->end);
+}
+
+int synapse_seqlock_sub_update(struct synapse_seqlock_sub *sub, void *msg)
+{
+	struct synapse_seqlock *seqlock = sub->seqlock;
+
+	k_poll_signal_reset(&sub->signal);
+	sub->event.state = K_POLL_STATE_NOT_READY;
+
+	for (int i = 0; i < READ_TRIES; i++) {
+		atomic_val_t n = atomic_get(&seqlock->end);
+		if (n == 0) {
+			return -EAGAIN;
+		}
+		barrier_dmem_fence_full();
+		memcpy(msg, seqlock->buf + (n & 1) * seqlock->size, seqlock->size);
+		barrier_dmem_fence_full();
+
+		// the publisher only touched the other buffer unless it started write n + 2
+		if (atomic_get(&seqlock->begin) - n <= 1) {
+			sub->seq = n;
+			if (sub->period_ticks > 0) {
+				k_spinlock_key_t key = k_spin_lock(&seqlock->lock);
+				sub->next_ticks = k_uptime_ticks() + sub->period_ticks;
+				k_spin_unlock(&seqlock->lock, key);
+			}
+			return 0;
+		}
+		seqlock->retries++;
+	}
+	return -EAGAIN;
+}
+
+// vi: ts=4 sw=4 et
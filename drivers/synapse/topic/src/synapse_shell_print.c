@@ -82,6 +82,23 @@ int snprint_altimeter(char *buf, size_t n, synapse_pb_Altimeter *m)
 	return offset;
 }
 
+int snprint_battery_headroom(char *buf, size_t n, struct synapse_battery_headroom *m)
+{
+	size_t offset = 0;
+	offset += snprintf_cat(buf + offset, n - offset, "stamp: %llu ns\n",
+			       (unsigned long long)m->stamp_ns);
+	offset += snprintf_cat(buf + offset, n - offset,
+			       "voltage oc: %8.3f V resistance: %8.4f ohm\n", (double)m->voltage_oc,
+			       (double)m->resistance);
+	offset += snprintf_cat(buf + offset, n - offset,
+			       "remaining: %6.3f charge: %8.3f Ah time: %8.1f s\n",
+			       (double)m->remaining, (double)m->charge,
+			       (double)m->time_remaining_s);
+	offset += snprintf_cat(buf + offset, n - offset, "thrust scale: %6.3f\n",
+			       (double)m->thrust_scale);
+	return offset;
+}
+
 int snprint_battery_state(char *buf, size_t n, synapse_pb_BatteryState *m)
 {
 	size_t offset = 0;
@@ -213,6 +230,69 @@ int snprint_input(char *buf, size_t n, synapse_pb_Input *m)
 	return offset;
 }
 
+int snprint_latency(char *buf, size_t n, struct synapse_latency_trace *m)
+{
+	size_t offset = 0;
+	uint32_t prev = m->origin_cyc;
+	for (int i = 0; i < SYNAPSE_LATENCY_STAGE_COUNT; i++) {
+		if (!(m->stage_mask & BIT(i))) {
+			continue;
+		}
+		offset += snprintf_cat(buf + offset, n - offset, "%-18s %10lld ns\n",
+				       synapse_latency_stage_str(i),
+				       1000000000LL * (m->stage_cyc[i] - prev) /
+					       sys_clock_hw_cycles_per_sec());
+		prev = m->stage_cyc[i];
+	}
+	offset += snprintf_cat(buf + offset, n - offset, "%-18s %10lld ns\n", "end to end",
+			       1000000000LL * (prev - m->origin_cyc) /
+				       sys_clock_hw_cycles_per_sec());
+	return offset;
+}
+
+int snprint_telemetry_rates(char *buf, size_t n, struct synapse_telemetry_rates *m)
+{
+#define TELEMETRY_NAME(name) #name,
+	static const char *const names[] = {SYNAPSE_TELEMETRY_STREAMS(TELEMETRY_NAME)};
+#undef TELEMETRY_NAME
+	size_t offset = 0;
+	for (int i = 0; i < SYNAPSE_TELEMETRY_STREAM_COUNT; i++) {
+		offset += snprintf_cat(buf + offset, n - offset, "%-12s %4u Hz%s\n", names[i],
+				       m->rate_hz[i],
+				       (m->adaptive_mask & BIT(i)) ? " adaptive" : "");
+	}
+	return offset;
+}
+
+int snprint_thread_monitor(char *buf, size_t n, struct synapse_thread_monitor *m)
+{
+	size_t offset = 0;
+	offset += snprintf_cat(buf + offset, n - offset, "uptime: %u ms cpu load: %5.1f %%\n",
+			       m->uptime_ms, m->cpu_load_permille / 10.0);
+	for (int i = 0; i < m->thread_count; i++) {
+		struct synapse_thread_stats *t = &m->thread[i];
+		offset += snprintf_cat(buf + offset, n - offset, "%-16s %4d %5.1f%% %6u/%6u\n",
+				       t->name, t->priority, t->cpu_permille / 10.0,
+				       t->stack_size - t->stack_unused, t->stack_size);
+	}
+	return offset;
+}
+
+int snprint_topic_stats(char *buf, size_t n, struct synapse_topic_stats *m)
+{
+	size_t offset = 0;
+	offset += snprintf_cat(buf + offset, n - offset, "uptime: %u ms\n", m->uptime_ms);
+	for (int i = 0; i < m->topic_count; i++) {
+		struct synapse_topic_stat *t = &m->topic[i];
+		if (t->publishes == 0) {
+			continue;
+		}
+		offset += snprintf_cat(buf + offset, n - offset, "%-28s %10u %8u us %8u\n",
+				       t->name, t->publishes, t->interval_avg_us, t->skipped);
+	}
+	return offset;
+}
+
 int snprint_ledarray(char *buf, size_t n, synapse_pb_LEDArray *m)
 {
 	size_t offset = 0;
@@ -292,10 +372,10 @@ int snprint_pose(char *buf, size_t n, synapse_pb_Pose *m)
 
 int snprint_quaternion(char *buf, size_t n, synapse_pb_Quaternion *m)
 {
-	double q[4] = {m->w, m->x, m->y, m->z};
-	double yaw, pitch, roll;
+	casadi_real q[4] = {m->w, m->x, m->y, m->z};
+	casadi_real yaw, pitch, roll;
 	double rad2deg = 180 / 3.14159;
-	CASADI_FUNC_ARGS(quat_to_eulerB321)
+	CASADI_FUNC_ARGS_STACK(quat_to_eulerB321)
 	args[0] = q;
 	res[0] = &yaw;
 	res[1] = &pitch;
@@ -323,6 +403,17 @@ int snprint_safety(char *buf, size_t n, synapse_pb_Safety *m)
 	return offset;
 }
 
+int snprint_sbus_status(char *buf, size_t n, struct synapse_sbus_status *m)
+{
+	size_t offset = 0;
+	offset += snprintf_cat(buf + offset, n - offset, "stamp: %llu ns latency: %u us\n",
+			       (unsigned long long)m->stamp_ns, m->latency_us);
+	offset += snprintf_cat(buf + offset, n - offset,
+			       "frames: %u lost: %u failsafes: %u errors: %u flags: 0x%02x\n",
+			       m->frames, m->frames_lost, m->failsafes, m->errors, m->flags);
+	return offset;
+}
+
 int snprint_timestamp(char *buf, size_t n, synapse_pb_Timestamp *m)
 {
 	return snprintf_cat(buf, n, "stamp: %lld.%09d\n", m->seconds, m->nanos);
@@ -361,6 +452,32 @@ int snprint_vector3(char *buf, size_t n, synapse_pb_Vector3 *m)
 	return offset;
 }
 
+int snprint_health(char *buf, size_t n, struct synapse_health *m)
+{
+	size_t offset = 0;
+	offset += snprintf_cat(buf + offset, n - offset, "stamp: %llu ns\n",
+			       (unsigned long long)m->stamp_ns);
+	offset += snprintf_cat(buf + offset, n - offset, "stale: 0x%08x watched: 0x%08x\n",
+			       m->stale, m->watched);
+	return offset;
+}
+
+int snprint_imu_delta(char *buf, size_t n, struct synapse_imu_delta *m)
+{
+	size_t offset = 0;
+	offset += snprintf_cat(buf + offset, n - offset, "stamp: %llu ns dt: %u ns frames: %u\n",
+			       (unsigned long long)m->stamp_ns, m->dt_ns, m->frame_count);
+	offset += snprintf_cat(buf + offset, n - offset,
+			       "delta angle [rad] x: %10.7f y: %10.7f z: %10.7f\n",
+			       (double)m->delta_angle[0], (double)m->delta_angle[1],
+			       (double)m->delta_angle[2]);
+	offset += snprintf_cat(buf + offset, n - offset,
+			       "delta velocity [m/s] x: %10.7f y: %10.7f z: %10.7f\n",
+			       (double)m->delta_velocity[0], (double)m->delta_velocity[1],
+			       (double)m->delta_velocity[2]);
+	return offset;
+}
+
 int snprint_imu_q31_array(char *buf, size_t n, synapse_pb_ImuQ31Array *m)
 {
 	size_t offset = 0;
@@ -388,4 +505,29 @@ int snprint_wheel_odometry(char *buf, size_t n, synapse_pb_WheelOdometry *m)
 	return offset;
 }
 
+int snprint_motor_state(char *buf, size_t n, struct synapse_motor_state *m)
+{
+	size_t offset = 0;
+	offset += snprintf_cat(buf + offset, n - offset, "stamp: %llu ns\n",
+			       (unsigned long long)m->stamp_ns);
+	for (int i = 0; i < m->count && i < SYNAPSE_MOTOR_STATE_MAX; i++) {
+		offset += snprintf_cat(buf + offset, n - offset,
+				       "motor %d: %8d erpm %8.2f A %6.1f C%s\n", i, m->erpm[i],
+				       (double)m->current[i], (double)m->temperature[i],
+				       (m->valid & (1U << i)) ? "" : " (no reply)");
+	}
+	return offset;
+}
+
+int snprint_wheel_velocity(char *buf, size_t n, struct synapse_wheel_velocity *m)
+{
+	size_t offset = 0;
+	offset += snprintf_cat(buf + offset, n - offset, "stamp: %llu ns edges: %u\n",
+			       (unsigned long long)m->stamp_ns, m->edges);
+	offset += snprintf_cat(buf + offset, n - offset,
+			       "rotation: %10.4f rad velocity: %10.4f rad/s\n", m->rotation,
+			       (double)m->velocity);
+	return offset;
+}
+
 // vi: ts=4 sw=4 et
@@ -0,0 +1,141 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/time_units.h>
+
+#include <zros/zros_sub.h>
+
+#include "synapse_sync.h"
+
+#define PIVOT 0
+
+enum sync_state {
+	SYNC_READY,
+	SYNC_WAIT_PIVOT,
+	SYNC_WAIT_INPUT,
+};
+
+static int64_t stamp_to_ns(const synapse_pb_Timestamp *stamp)
+{
+	return (int64_t)stamp->seconds * 1000000000LL + stamp->nanos;
+}
+
+void synapse_sync_init(struct synapse_sync *sync, enum synapse_sync_policy policy,
+		       uint32_t slop_us)
+{
+	memset(sync, 0, sizeof(*sync));
+	sync->policy = policy;
+	sync->slop_ns = policy == SYNAPSE_SYNC_EXACT ? 0 : (int64_t)slop_us * 1000;
+	// the exact policy still needs a bound on how long a pivot is held back
+	sync->hold_ticks = k_us_to_ticks_ceil64(slop_us);
+}
+
+int synapse_sync_add(struct synapse_sync *sync, struct zros_sub *sub,
+		     const synapse_pb_Timestamp *stamp)
+{
+	if (sync->count >= SYNAPSE_SYNC_MAX_INPUTS) {
+		return -ENOMEM;
+	}
+	struct synapse_sync_input *in = &sync->input[sync->count++];
+	in->sub = sub;
+	in->stamp = stamp;
+	return 0;
+}
+
+static void take_updates(struct synapse_sync *sync)
+{
+	for (size_t i = 0; i < sync->count; i++) {
+		struct synapse_sync_input *in = &sync->input[i];
+		if (!zros_sub_update_available(in->sub)) {
+			continue;
+		}
+		zros_sub_update(in->sub);
+		in->stamp_ns = stamp_to_ns(in->stamp);
+		in->received = true;
+		in->fresh = true;
+		if (i == PIVOT) {
+			sync->pivot_ticks = k_uptime_ticks();
+		}
+	}
+}
+
+static enum sync_state check(struct synapse_sync *sync)
+{
+	struct synapse_sync_input *pivot = &sync->input[PIVOT];
+	enum sync_state state = SYNC_READY;
+
+	if (!pivot->fresh) {
+		return SYNC_WAIT_PIVOT;
+	}
+
+	for (size_t i = 1; i < sync->count; i++) {
+		struct synapse_sync_input *in = &sync->input[i];
+		int64_t d = in->stamp_ns - pivot->stamp_ns;
+		in->aligned = in->received && d >= -sync->slop_ns && d <= sync->slop_ns;
+		if (in->received && d > sync->slop_ns) {
+			// the other input moved past this pivot, it can not be matched anymore
+			pivot->fresh = false;
+			sync->dropped++;
+			return SYNC_WAIT_PIVOT;
+		}
+		if (!in->aligned) {
+			state = SYNC_WAIT_INPUT;
+		}
+	}
+
+	if (state == SYNC_WAIT_INPUT && k_uptime_ticks() - sync->pivot_ticks >= sync->hold_ticks) {
+		sync->unaligned++;
+		state = SYNC_READY;
+	}
+	return state;
+}
+
+int synapse_sync_wait(struct synapse_sync *sync, k_timeout_t timeout)
+{
+	k_timepoint_t end = sys_timepoint_calc(timeout);
+
+	for (;;) {
+		take_updates(sync);
+		enum sync_state state = check(sync);
+
+		if (state == SYNC_READY) {
+			sync->input[PIVOT].aligned = true;
+			for (size_t i = 0; i < sync->count; i++) {
+				sync->input[i].is_new = sync->input[i].fresh;
+				sync->input[i].fresh = false;
+			}
+			sync->sets++;
+			return 0;
+		}
+
+		if (sys_timepoint_expired(end)) {
+			return -EAGAIN;
+		}
+
+		// only wake for what the set is missing, a lagging input is waited for
+		// until the pivot has been held back for the slop
+		size_t n = 0;
+		k_timeout_t wait = sys_timepoint_timeout(end);
+		if (state == SYNC_WAIT_PIVOT) {
+			sync->events[n++] = *zros_sub_get_event(sync->input[PIVOT].sub);
+		} else {
+			for (size_t i = 1; i < sync->count; i++) {
+				if (!sync->input[i].aligned) {
+					sync->events[n++] = *zros_sub_get_event(sync->input[i].sub);
+				}
+			}
+			int64_t hold = sync->pivot_ticks + sync->hold_ticks - k_uptime_ticks();
+			if (K_TIMEOUT_EQ(wait, K_FOREVER) || hold < wait.ticks) {
+				wait = K_TICKS(MAX(hold, 0));
+			}
+		}
+		(void)k_poll(sync->events, n, wait);
+	}
+}
+
+// vi: ts=4 sw=4 et
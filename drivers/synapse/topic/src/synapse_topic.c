@@ -4,10 +4,14 @@
  */
 
 #include <zephyr/logging/log.h>
+#include <zephyr/logging/log_backend.h>
 #include <zephyr/shell/shell.h>
 
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <pb_encode.h>
 #include <synapse_pb/vector3.pb.h>
 #include <zros/private/zros_node_struct.h>
 #include <zros/private/zros_pub_struct.h>
@@ -22,6 +26,8 @@
 
 LOG_MODULE_REGISTER(zros_topic);
 
+#include "synapse_cache.h"
+#include "synapse_queue.h"
 #include "synapse_shell_print.h"
 
 #define TOPIC_QUEUE_STACK_SIZE 8192
@@ -50,36 +56,9 @@ static context_t g_ctx = {.work_item = Z_WORK_INITIALIZER(topic_work_handler),
 			  .handler = NULL,
 			  .lock = Z_MUTEX_INITIALIZER(g_ctx.lock)};
 
-#define TOPIC_DICTIONARY()                                                                         \
-	(accel_sp, &topic_accel_sp, "accel_sp"), (actuators, &topic_actuators, "actuators"),       \
-		(altimeter, &topic_altimeter, "altimeter"),                                        \
-		(angular_velocity_ff, &topic_angular_velocity_ff, "angular_velocity_ff"),          \
-		(angular_velocity_sp, &topic_angular_velocity_sp, "angular_velocity_sp"),          \
-		(attitude_sp, &topic_attitude_sp, "attitude_sp"),                                  \
-		(battery_state, &topic_battery_state, "battery_state"),                            \
-		(bezier_trajectory, &topic_bezier_trajectory, "bezier_trajectory"),                \
-		(bezier_trajectory_ethernet, &topic_bezier_trajectory_ethernet,                    \
-		 "bezier_trajectory_ethernet"),                                                    \
-		(clock_offset_ethernet, &topic_clock_offset_ethernet, "clock_offset_ethernet"),    \
-		(cmd_vel, &topic_cmd_vel, "cmd_vel"),                                              \
-		(cmd_vel_ethernet, &topic_cmd_vel_ethernet, "cmd_vel_ethernet"),                   \
-		(force_sp, &topic_force_sp, "force_sp"), (imu, &topic_imu, "imu"),                 \
-		(imu_q31_array, &topic_imu_q31_array, "imu_q31_array"),                            \
-		(input, &topic_input, "input"),                                                    \
-		(input_ethernet, &topic_input_ethernet, "input_ethernet"),                         \
-		(input_sbus, &topic_input_sbus, "input_sbus"),                                     \
-		(led_array, &topic_led_array, "led_array"),                                        \
-		(magnetic_field, &topic_magnetic_field, "magnetic_field"),                         \
-		(moment_ff, &topic_moment_ff, "moment_ff"),                                        \
-		(moment_sp, &topic_moment_sp, "moment_sp"),                                        \
-		(nav_sat_fix, &topic_nav_sat_fix, "nav_sat_fix"),                                  \
-		(odometry_estimator, &topic_odometry_estimator, "odometry_estimator"),             \
-		(odometry_ethernet, &topic_odometry_ethernet, "odometry_ethernet"),                \
-		(orientation_sp, &topic_orientation_sp, "orientation_sp"),                         \
-		(position_sp, &topic_position_sp, "position_sp"), (pwm, &topic_pwm, "pwm"),        \
-		(safety, &topic_safety, "safety"), (status, &topic_status, "status"),              \
-		(velocity_sp, &topic_velocity_sp, "velocity_sp"),                                  \
-		(wheel_odometry, &topic_wheel_odometry, "wheel_odometry")
+// every topic of the list, the leading comma of the first entry is dropped
+#define TOPIC_DICT_ENTRY(name, type, frame, snprint) , (name, &topic_##name, #name)
+#define TOPIC_DICTIONARY() GET_ARGS_LESS_N(1, SYNAPSE_TOPIC_LIST(TOPIC_DICT_ENTRY))
 
 static void shell_callback(const struct shell *sh, uint8_t *data, size_t len)
 {
@@ -223,6 +202,128 @@ static int topic_echo(const struct shell *sh, struct zros_topic *topic, void *ms
 	return ZROS_OK;
 }
 
+static snprint_t *topic_snprint(const struct zros_topic *topic)
+{
+	const struct synapse_topic_info *info = synapse_topic_lookup(topic);
+	return info == NULL ? NULL : info->snprint;
+}
+
+// message buffer of the topic handlers, large enough for any topic
+#define TOPIC_MSG_MEMBER(name, type, frame, snprint) type name;
+static union {
+	SYNAPSE_TOPIC_LIST(TOPIC_MSG_MEMBER)
+} g_msg;
+
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_STREAM)
+/*
+ * Topics with a synapse_pb_Frame member, zros topic stream writes each
+ * message as STREAM_SYNC followed by a length delimited Frame.
+ */
+
+// lets a host find the next frame after console text
+#define STREAM_SYNC_0  0xa5
+#define STREAM_SYNC_1  0x5a
+#define STREAM_TX_SIZE 8192
+
+// write all of buf to the shell transport, the console is drained by its isr
+static void stream_write(const struct shell *sh, const uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		size_t cnt = 0;
+		if (sh->iface->api->write(sh->iface, buf, len, &cnt) != 0) {
+			return;
+		}
+		if (cnt == 0) {
+			k_sleep(K_TICKS(1));
+		}
+		buf += cnt;
+		len -= cnt;
+	}
+}
+
+static int topic_stream(const struct shell *sh, struct zros_topic *topic, void *msg,
+			snprint_t *echo)
+{
+	ARG_UNUSED(msg);
+	ARG_UNUSED(echo);
+	static synapse_pb_Frame frame;
+	static uint8_t queue_buf[CONFIG_CEREBRI_SYNAPSE_TOPIC_STREAM_BUF_SIZE] __aligned(8);
+	static uint8_t tx_buf[STREAM_TX_SIZE];
+	static struct synapse_queue queue;
+
+	const struct synapse_topic_info *stream = synapse_topic_lookup(topic);
+	if (stream == NULL || stream->frame_tag == 0) {
+		shell_print(sh, "%s has no frame type", synapse_topic_name(topic));
+		return -ENOTSUP;
+	}
+
+	// every message since the last wakeup is sent, not only the latest
+	size_t depth = 1;
+	while (depth * 2 * stream->size <= sizeof(queue_buf)) {
+		depth *= 2;
+	}
+	if (depth < 2 || synapse_queue_init(&queue, topic, queue_buf, stream->size, depth) != 0) {
+		shell_print(sh, "stream buffer too small");
+		return -ENOMEM;
+	}
+
+	k_poll_signal_init(&signal_quit);
+	struct k_poll_event events[2] = {*synapse_queue_get_event(&queue),
+					 K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL,
+								  K_POLL_MODE_NOTIFY_ONLY,
+								  &signal_quit)};
+
+	shell_print(sh, "streaming, press any key to exit");
+	shell_set_bypass(sh, shell_callback);
+#if defined(CONFIG_SHELL_LOG_BACKEND)
+	// a log line written between the chunks of a frame would corrupt it
+	const struct log_backend *log_backend = sh->log_backend->backend;
+	bool log_active = log_backend_is_active(log_backend);
+	if (log_active) {
+		log_backend_deactivate(log_backend);
+	}
+#endif
+
+	uint32_t frames = 0;
+	uint32_t failed = 0;
+	tx_buf[0] = STREAM_SYNC_0;
+	tx_buf[1] = STREAM_SYNC_1;
+	while (true) {
+		k_poll(events, ARRAY_SIZE(events), K_FOREVER);
+		events[0].state = K_POLL_STATE_NOT_READY;
+		int quit_signaled, result;
+		k_poll_signal_check(&signal_quit, &quit_signaled, &result);
+		if (quit_signaled) {
+			break;
+		}
+		while (synapse_queue_pop(&queue, &frame.msg) == 0) {
+			frame.which_msg = stream->frame_tag;
+			pb_ostream_t ostream =
+				pb_ostream_from_buffer(&tx_buf[2], sizeof(tx_buf) - 2);
+			if (!pb_encode_ex(&ostream, synapse_pb_Frame_fields, &frame,
+					  PB_ENCODE_DELIMITED)) {
+				failed++;
+				continue;
+			}
+			stream_write(sh, tx_buf, 2 + ostream.bytes_written);
+			frames++;
+		}
+	}
+
+	uint32_t overruns = queue.overruns;
+	synapse_queue_fini(&queue);
+#if defined(CONFIG_SHELL_LOG_BACKEND)
+	if (log_active) {
+		log_backend_activate(log_backend, log_backend->cb->ctx);
+	}
+#endif
+	shell_set_bypass(sh, NULL);
+	shell_print(sh, "");
+	shell_print(sh, "frames: %u dropped: %u encode failed: %u", frames, overruns, failed);
+	return ZROS_OK;
+}
+#endif
+
 void topic_work_handler(struct k_work *work)
 {
 	context_t *ctx = CONTAINER_OF(work, context_t, work_item);
@@ -233,69 +334,11 @@ void topic_work_handler(struct k_work *work)
 	const struct shell *sh = ctx->sh;
 	struct zros_topic *topic = ctx->topic;
 	msg_handler_t *handler = ctx->handler;
+	snprint_t *snprint = topic_snprint(topic);
 
-	if (topic == &topic_actuators) {
-		synapse_pb_Actuators msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_actuators);
-	} else if (topic == &topic_imu_q31_array) {
-		synapse_pb_ImuQ31Array msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_imu_q31_array);
-	} else if (topic == &topic_altimeter) {
-		synapse_pb_Altimeter msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_altimeter);
-	} else if (topic == &topic_angular_velocity_sp || topic == &topic_accel_sp ||
-		   topic == &topic_moment_sp || topic == &topic_force_sp ||
-		   topic == &topic_velocity_sp || topic == &topic_position_sp ||
-		   topic == &topic_moment_ff || topic == &topic_angular_velocity_ff) {
-		synapse_pb_Vector3 msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_vector3);
-	} else if (topic == &topic_attitude_sp || topic == &topic_orientation_sp) {
-		synapse_pb_Quaternion msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_quaternion);
-	} else if (topic == &topic_battery_state) {
-		synapse_pb_BatteryState msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_battery_state);
-	} else if (topic == &topic_bezier_trajectory_ethernet ||
-		   topic == &topic_bezier_trajectory) {
-		synapse_pb_BezierTrajectory msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_bezier_trajectory);
-	} else if (topic == &topic_clock_offset_ethernet) {
-		synapse_pb_ClockOffset msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_clock_offset);
-	} else if (topic == &topic_cmd_vel || topic == &topic_cmd_vel_ethernet) {
-		synapse_pb_Twist msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_twist);
-	} else if (topic == &topic_status) {
-		synapse_pb_Status msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_status);
-	} else if (topic == &topic_imu) {
-		synapse_pb_Imu msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_imu);
-	} else if (topic == &topic_input_ethernet || topic == &topic_input_sbus ||
-		   topic == &topic_input) {
-		synapse_pb_Input msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_input);
-	} else if (topic == &topic_led_array) {
-		synapse_pb_LEDArray msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_ledarray);
-	} else if (topic == &topic_pwm) {
-		synapse_pb_Pwm msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_pwm);
-	} else if (topic == &topic_magnetic_field) {
-		synapse_pb_MagneticField msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_magnetic_field);
-	} else if (topic == &topic_nav_sat_fix) {
-		synapse_pb_NavSatFix msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_navsatfix);
-	} else if (topic == &topic_odometry_estimator || topic == &topic_odometry_ethernet) {
-		synapse_pb_Odometry msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_odometry);
-	} else if (topic == &topic_safety) {
-		synapse_pb_Safety msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_safety);
-	} else if (topic == &topic_wheel_odometry) {
-		synapse_pb_WheelOdometry msg = {};
-		handler(sh, topic, &msg, (snprint_t *)&snprint_wheel_odometry);
+	if (snprint != NULL) {
+		memset(&g_msg, 0, sizeof(g_msg));
+		handler(sh, topic, &g_msg, snprint);
 	} else {
 		char name[20];
 		zros_topic_get_name(topic, name, sizeof(name));
@@ -325,6 +368,17 @@ static int cmd_zros_topic_echo(const struct shell *sh, size_t argc, char **argv,
 	return k_work_submit_to_queue(&g_topic_work_q, &g_ctx.work_item);
 }
 
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_STREAM)
+static int cmd_zros_topic_stream(const struct shell *sh, size_t argc, char **argv, void *data)
+{
+	struct zros_topic *topic = (struct zros_topic *)data;
+	g_ctx.sh = sh;
+	g_ctx.handler = &topic_stream;
+	g_ctx.topic = topic;
+	return k_work_submit_to_queue(&g_topic_work_q, &g_ctx.work_item);
+}
+#endif
+
 void topic_print_iterator(const struct zros_topic *topic, void *data)
 {
 	const struct shell *sh = (const struct shell *)data;
@@ -365,6 +419,13 @@ static int cmd_zros_topic_info(const struct shell *sh, size_t argc, char **argv,
 	return ZROS_OK;
 }
 
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_STATS)
+static int cmd_zros_topic_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	return synapse_topic_stats_print(sh);
+}
+#endif
+
 void node_print_iterator(const struct zros_node *node, void *data)
 {
 	const struct shell *sh = (const struct shell *)data;
@@ -379,16 +440,70 @@ static int cmd_zros_node_list(const struct shell *sh, size_t argc, char **argv)
 	return ZROS_OK;
 }
 
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_CACHE)
+static int cmd_zros_snapshot(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	static char buf[2048];
+	const struct synapse_cache_snapshot *snap = synapse_cache_snapshot_take(K_MSEC(100));
+	if (snap == NULL) {
+		shell_print(sh, "snapshot busy");
+		return -EBUSY;
+	}
+
+	shell_print(sh, "snapshot %s after %d attempts", snap->atomic ? "atomic" : "per topic",
+		    snap->attempts);
+	for (int i = 0; i < SYNAPSE_CACHE_TOPIC_COUNT; i++) {
+		const void *msg = synapse_cache_snapshot_msg(snap, i, NULL);
+		if (msg == NULL) {
+			continue;
+		}
+		struct zros_topic *topic = synapse_cache_topic(i);
+		const struct synapse_cache_meta *meta = &snap->meta[i];
+		int64_t age_ms = k_ticks_to_ms_floor64(snap->ticks - meta->ticks);
+		shell_print(sh, "%s: age %lld ms publishes %u", synapse_topic_name(topic),
+			    (long long)age_ms, meta->publishes);
+		snprint_t *snprint = topic_snprint(topic);
+		if (snprint != NULL) {
+			// snprint only reads the message
+			snprint(buf, sizeof(buf), (void *)msg);
+			shell_print(sh, "%s", buf);
+		}
+	}
+	synapse_cache_snapshot_release();
+	return ZROS_OK;
+}
+#endif
+
+static int cmd_zros_time(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	int64_t ns = synapse_now_ns();
+	const char *quality = synapse_time_quality_str(synapse_time_quality());
+	shell_print(sh, "now: %lld.%09lld s quality: %s", (long long)(ns / NSEC_PER_SEC),
+		    (long long)(ns % NSEC_PER_SEC), quality);
+	return ZROS_OK;
+}
+
 // level 2 (topic echo/hz/list)
 SHELL_SUBCMD_DICT_SET_CREATE(sub_zros_topic_echo, cmd_zros_topic_echo, TOPIC_DICTIONARY());
 SHELL_SUBCMD_DICT_SET_CREATE(sub_zros_topic_hz, cmd_zros_topic_hz, TOPIC_DICTIONARY());
 SHELL_SUBCMD_DICT_SET_CREATE(sub_zros_topic_info, cmd_zros_topic_info, TOPIC_DICTIONARY());
+#if defined(CONFIG_CEREBRI_SYNAPSE_TOPIC_STREAM)
+SHELL_SUBCMD_DICT_SET_CREATE(sub_zros_topic_stream, cmd_zros_topic_stream, TOPIC_DICTIONARY());
+#endif
 
 SHELL_STATIC_SUBCMD_SET_CREATE(sub_zros_topic,
 			       SHELL_CMD(echo, &sub_zros_topic_echo, "Echo topic.", NULL),
 			       SHELL_CMD(hz, &sub_zros_topic_hz, "Check topic pub rate.", NULL),
 			       SHELL_CMD(info, &sub_zros_topic_info, "Topic pubs and subs.", NULL),
 			       SHELL_CMD(list, NULL, "List topics.", cmd_zros_topic_list),
+			       SHELL_COND_CMD(CONFIG_CEREBRI_SYNAPSE_TOPIC_STREAM, stream,
+					      &sub_zros_topic_stream, "Stream topic frames.", NULL),
+			       SHELL_COND_CMD(CONFIG_CEREBRI_SYNAPSE_TOPIC_STATS, stats, NULL,
+					      "Per topic statistics.", cmd_zros_topic_stats),
 			       SHELL_SUBCMD_SET_END);
 
 // level 2 (node list)
@@ -399,6 +514,9 @@ SHELL_STATIC_SUBCMD_SET_CREATE(sub_zros_node,
 // level 1 (topic/node)
 SHELL_STATIC_SUBCMD_SET_CREATE(sub_zros, SHELL_CMD(topic, &sub_zros_topic, "Topic commands.", NULL),
 			       SHELL_CMD(node, &sub_zros_node, "Node commands.", NULL),
+			       SHELL_CMD(time, NULL, "Stamp time and its quality.", cmd_zros_time),
+			       SHELL_COND_CMD(CONFIG_CEREBRI_SYNAPSE_TOPIC_CACHE, snapshot, NULL,
+					      "Last message of every topic.", cmd_zros_snapshot),
 			       SHELL_SUBCMD_SET_END);
 
 // level 0 (zros)
@@ -0,0 +1,36 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zros/zros_topic.h>
+
+#include "synapse_cache.h"
+#include "synapse_liveness.h"
+#include "synapse_queue.h"
+#include "synapse_topic_hook.h"
+#include "synapse_topic_stats.h"
+
+/*
+ * zros lives in an external module, so the broker is hooked by wrapping
+ * zros_topic_publish at link time, see CMakeLists.txt. zros_pub_update
+ * publishes through zros_topic_publish, so it is covered too.
+ */
+
+int __real_zros_topic_publish(struct zros_topic *topic, void *msg);
+int __wrap_zros_topic_publish(struct zros_topic *topic, void *msg);
+
+void synapse_topic_notify(struct zros_topic *topic, const void *msg)
+{
+	synapse_topic_stats_record(topic);
+	synapse_queue_push(topic, msg);
+	synapse_liveness_record(topic);
+	synapse_cache_record(topic, msg);
+}
+
+int __wrap_zros_topic_publish(struct zros_topic *topic, void *msg)
+{
+	synapse_topic_notify(topic, msg);
+	return __real_zros_topic_publish(topic, msg);
+}
+
+// vi: ts=4 sw=4 et
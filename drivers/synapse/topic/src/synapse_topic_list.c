@@ -3,13 +3,23 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
 #include <zephyr/init.h>
 #include <zephyr/sys/slist.h>
 
 #include <zros/private/zros_broker_struct.h>
 #include <zros/private/zros_topic_struct.h>
 #include <zros/zros_broker.h>
+#include <zros/zros_topic.h>
+
+#include <pb_common.h>
+
+#include <cerebri/core/clock_sync.h>
 
+#include "synapse_shell_print.h"
 #include "synapse_topic_list.h"
 
 //*******************************************************************
@@ -17,13 +27,68 @@
 //*******************************************************************
 static const char *unhandled = "UNHANDLED";
 
+int64_t synapse_uptime_ns(void)
+{
+#if defined(CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER)
+	return k_cyc_to_ns_floor64(k_cycle_get_64());
+#else
+	return k_ticks_to_ns_floor64(k_uptime_ticks());
+#endif
+}
+
+int64_t synapse_now_ns(void)
+{
+#if defined(CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_STAMP)
+	return clock_sync_uptime_ns_to_ns(synapse_uptime_ns());
+#else
+	return synapse_uptime_ns();
+#endif
+}
+
+enum synapse_time_quality synapse_time_quality(void)
+{
+#if defined(CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_STAMP)
+	if (clock_sync_locked()) {
+		return SYNAPSE_TIME_SYNCED;
+	}
+#endif
+#if defined(CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER)
+	return SYNAPSE_TIME_CYCLE;
+#else
+	return SYNAPSE_TIME_TICK;
+#endif
+}
+
+const char *synapse_time_quality_str(enum synapse_time_quality quality)
+{
+	if (quality == SYNAPSE_TIME_TICK) {
+		return "tick";
+	} else if (quality == SYNAPSE_TIME_CYCLE) {
+		return "cycle";
+	} else if (quality == SYNAPSE_TIME_SYNCED) {
+		return "synced";
+	}
+	return unhandled;
+}
+
+void stamp_msg_ns(synapse_pb_Timestamp *msg, int64_t ns)
+{
+	msg->seconds = ns / NSEC_PER_SEC;
+	msg->nanos = ns % NSEC_PER_SEC;
+}
+
+void stamp_msg_now(synapse_pb_Timestamp *msg)
+{
+	stamp_msg_ns(msg, synapse_now_ns());
+}
+
 void stamp_msg(synapse_pb_Timestamp *msg, int64_t ticks)
 {
-	int64_t sec = ticks / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-	int32_t nanosec = (ticks - sec * CONFIG_SYS_CLOCK_TICKS_PER_SEC) * 1e9 /
-			  CONFIG_SYS_CLOCK_TICKS_PER_SEC;
-	msg->seconds = sec;
-	msg->nanos = nanosec;
+#if defined(CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_STAMP)
+	stamp_msg_ns(msg, clock_sync_ticks_to_ns(ticks));
+#else
+	stamp_msg_ns(msg, k_ticks_to_ns_floor64(ticks));
+#endif
 }
 
 const char *input_source_str(synapse_pb_Status_InputSource src)
@@ -177,76 +242,137 @@ const char *fuel_str(synapse_pb_Status_Fuel fuel)
 /********************************************************************
  * topics
  ********************************************************************/
-ZROS_TOPIC_DEFINE(accel_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DEFINE(actuators, synapse_pb_Actuators);
-ZROS_TOPIC_DEFINE(altimeter, synapse_pb_Altimeter);
-ZROS_TOPIC_DEFINE(angular_velocity_ff, synapse_pb_Vector3);
-ZROS_TOPIC_DEFINE(angular_velocity_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DEFINE(attitude_sp, synapse_pb_Quaternion);
-ZROS_TOPIC_DEFINE(battery_state, synapse_pb_BatteryState);
-ZROS_TOPIC_DEFINE(bezier_trajectory, synapse_pb_BezierTrajectory);
-ZROS_TOPIC_DEFINE(bezier_trajectory_ethernet, synapse_pb_BezierTrajectory);
-ZROS_TOPIC_DEFINE(clock_offset_ethernet, synapse_pb_ClockOffset);
-ZROS_TOPIC_DEFINE(cmd_vel, synapse_pb_Twist);
-ZROS_TOPIC_DEFINE(cmd_vel_ethernet, synapse_pb_Twist);
-ZROS_TOPIC_DEFINE(force_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DEFINE(imu, synapse_pb_Imu);
-ZROS_TOPIC_DEFINE(imu_q31_array, synapse_pb_ImuQ31Array);
-ZROS_TOPIC_DEFINE(input, synapse_pb_Input);
-ZROS_TOPIC_DEFINE(input_ethernet, synapse_pb_Input);
-ZROS_TOPIC_DEFINE(input_sbus, synapse_pb_Input);
-ZROS_TOPIC_DEFINE(led_array, synapse_pb_LEDArray);
-ZROS_TOPIC_DEFINE(magnetic_field, synapse_pb_MagneticField);
-ZROS_TOPIC_DEFINE(moment_ff, synapse_pb_Vector3);
-ZROS_TOPIC_DEFINE(moment_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DEFINE(nav_sat_fix, synapse_pb_NavSatFix);
-ZROS_TOPIC_DEFINE(odometry_estimator, synapse_pb_Odometry);
-ZROS_TOPIC_DEFINE(odometry_ethernet, synapse_pb_Odometry);
-ZROS_TOPIC_DEFINE(orientation_sp, synapse_pb_Quaternion);
-ZROS_TOPIC_DEFINE(position_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DEFINE(pwm, synapse_pb_Pwm);
-ZROS_TOPIC_DEFINE(safety, synapse_pb_Safety);
-ZROS_TOPIC_DEFINE(status, synapse_pb_Status);
-ZROS_TOPIC_DEFINE(velocity_sp, synapse_pb_Vector3);
-ZROS_TOPIC_DEFINE(wheel_odometry, synapse_pb_WheelOdometry);
-
-static struct zros_topic *topic_list[] = {
-	&topic_accel_sp,
-	&topic_actuators,
-	&topic_altimeter,
-	&topic_angular_velocity_ff,
-	&topic_angular_velocity_sp,
-	&topic_attitude_sp,
-	&topic_battery_state,
-	&topic_bezier_trajectory,
-	&topic_bezier_trajectory_ethernet,
-	&topic_clock_offset_ethernet,
-	&topic_cmd_vel,
-	&topic_cmd_vel_ethernet,
-	&topic_imu,
-	&topic_imu_q31_array,
-	&topic_input,
-	&topic_input_ethernet,
-	&topic_input_sbus,
-	&topic_led_array,
-	&topic_magnetic_field,
-	&topic_moment_ff,
-	&topic_nav_sat_fix,
-	&topic_odometry_estimator,
-	&topic_odometry_ethernet,
-	&topic_orientation_sp,
-	&topic_position_sp,
-	&topic_pwm,
-	&topic_safety,
-	&topic_status,
-	&topic_velocity_sp,
-	&topic_wheel_odometry,
-};
+#define SYNAPSE_TOPIC_DEFINE(name, type, frame, snprint) ZROS_TOPIC_DEFINE(name, type);
+SYNAPSE_TOPIC_LIST(SYNAPSE_TOPIC_DEFINE)
+
+#define SYNAPSE_LOAN_DEFINE_ENTRY(name, type) SYNAPSE_LOAN_DEFINE(name, type);
+SYNAPSE_LOAN_LIST(SYNAPSE_LOAN_DEFINE_ENTRY)
+
+#define SYNAPSE_LOAN_ARENA_DEFINE_ENTRY(name, type, size)                                          \
+	SYNAPSE_LOAN_DEFINE_ARENA(name, type, size);
+SYNAPSE_LOAN_ARENA_LIST(SYNAPSE_LOAN_ARENA_DEFINE_ENTRY)
+
+// the imu driver and the fsm are the only publishers, see synapse_seqlock.h
+#define SYNAPSE_SEQLOCK_DEFINE_ENTRY(name, type) SYNAPSE_SEQLOCK_DEFINE(name, type);
+SYNAPSE_SEQLOCK_LIST(SYNAPSE_SEQLOCK_DEFINE_ENTRY)
+
+#define TOPIC_INFO_ENTRY(name, type, frame, snprint)                                               \
+	{.topic = &topic_##name,                                                                   \
+	 .name = #name,                                                                            \
+	 .size = sizeof(type),                                                                     \
+	 .frame_tag = synapse_pb_Frame_##frame##_tag,                                              \
+	 .snprint = (snprint_t *)&snprint},
+static struct synapse_topic_info g_registry[] = {SYNAPSE_TOPIC_LIST(TOPIC_INFO_ENTRY)};
+
+BUILD_ASSERT(ARRAY_SIZE(g_registry) == SYNAPSE_TOPIC_COUNT, "registry out of date");
+
+/*
+ * topic address to registry id, open addressing on a multiplicative hash
+ * of the address, slots hold the id plus one so zero is empty
+ */
+#define TOPIC_HASH_BITS 7
+#define TOPIC_HASH_SIZE BIT(TOPIC_HASH_BITS)
+
+BUILD_ASSERT(SYNAPSE_TOPIC_COUNT <= TOPIC_HASH_SIZE / 2, "topic hash too full");
+BUILD_ASSERT(SYNAPSE_TOPIC_COUNT < UINT8_MAX, "topic ids are 8 bit in the hash");
+
+static uint8_t g_topic_hash[TOPIC_HASH_SIZE];
+
+static inline uint32_t topic_hash(const struct zros_topic *topic)
+{
+	return ((uint32_t)((uintptr_t)topic >> 3) * 2654435761u) >> (32 - TOPIC_HASH_BITS);
+}
+
+const struct synapse_topic_info *synapse_topic_info(int id)
+{
+	if (id < 0 || id >= SYNAPSE_TOPIC_COUNT) {
+		return NULL;
+	}
+	return &g_registry[id];
+}
+
+int synapse_topic_id(const struct zros_topic *topic)
+{
+	for (uint32_t i = topic_hash(topic);; i = (i + 1) & (TOPIC_HASH_SIZE - 1)) {
+		uint8_t slot = g_topic_hash[i];
+		if (slot == 0) {
+			return -ENOENT;
+		}
+		if (g_registry[slot - 1].topic == topic) {
+			return slot - 1;
+		}
+	}
+}
+
+const struct synapse_topic_info *synapse_topic_lookup(const struct zros_topic *topic)
+{
+	return synapse_topic_info(synapse_topic_id(topic));
+}
+
+struct zros_topic *synapse_topic_find(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(g_registry); i++) {
+		if (strcmp(g_registry[i].name, name) == 0) {
+			return g_registry[i].topic;
+		}
+	}
+	return NULL;
+}
+
+const char *synapse_topic_name(const struct zros_topic *topic)
+{
+	const struct synapse_topic_info *info = synapse_topic_lookup(topic);
+	return info == NULL ? NULL : info->name;
+}
+
+// before any publish, the hash is read without a lock
+static int synapse_topic_registry_init(void)
+{
+	for (size_t id = 0; id < ARRAY_SIZE(g_registry); id++) {
+		struct synapse_topic_info *info = &g_registry[id];
+		pb_field_iter_t iter;
+		if (info->frame_tag != 0 &&
+		    pb_field_iter_begin(&iter, synapse_pb_Frame_fields, NULL) &&
+		    pb_field_iter_find(&iter, info->frame_tag)) {
+			info->fields = iter.submsg_desc;
+		}
+
+		uint32_t i = topic_hash(info->topic);
+		while (g_topic_hash[i] != 0) {
+			i = (i + 1) & (TOPIC_HASH_SIZE - 1);
+		}
+		g_topic_hash[i] = id + 1;
+	}
+	return 0;
+}
+
+SYS_INIT(synapse_topic_registry_init, PRE_KERNEL_1, 0);
+
+int synapse_topic_republish(struct zros_topic *topic, const void *msg)
+{
+#define LOAN_REPUBLISH(name, type)                                                                 \
+	if (topic == &topic_##name) {                                                              \
+		return synapse_loan_publish_copy(&loan_##name, msg);                               \
+	}
+	SYNAPSE_LOAN_LIST(LOAN_REPUBLISH)
+#undef LOAN_REPUBLISH
+
+#define SEQLOCK_REPUBLISH(name, type)                                                              \
+	if (topic == &topic_##name) {                                                              \
+		synapse_seqlock_publish(&seqlock_##name, msg);                                     \
+		return 0;                                                                          \
+	}
+	SYNAPSE_SEQLOCK_LIST(SEQLOCK_REPUBLISH)
+#undef SEQLOCK_REPUBLISH
+
+	return zros_topic_publish(topic, (void *)msg);
+}
 
+// every topic in the list, the broker used to miss the ones added by hand
 static int set_topic_list()
 {
-	for (size_t i = 0; i < ARRAY_SIZE(topic_list); i++) {
-		zros_broker_add_topic(topic_list[i]);
+	for (size_t i = 0; i < ARRAY_SIZE(g_registry); i++) {
+		zros_broker_add_topic(g_registry[i].topic);
 	}
 	return 0;
 }
@@ -0,0 +1,282 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/private/zros_sub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+#include <zros/zros_sub.h>
+#include <zros/zros_topic.h>
+
+#include "synapse_topic_list.h"
+
+LOG_MODULE_REGISTER(synapse_topic_stats, CONFIG_CEREBRI_SYNAPSE_TOPIC_LOG_LEVEL);
+
+/*
+ * zros lives in an external module, so the broker is counted by wrapping
+ * zros_sub_update at link time, see CMakeLists.txt. Publications are
+ * recorded through synapse_topic_notify, see synapse_topic_hook.c.
+ */
+
+#define SUB_SLOTS CONFIG_CEREBRI_SYNAPSE_TOPIC_STATS_SUBS
+
+BUILD_ASSERT((SUB_SLOTS & (SUB_SLOTS - 1)) == 0, "sub slots must be a power of two");
+
+extern struct k_work_q g_low_priority_work_q;
+
+int __real_zros_sub_update(struct zros_sub *sub);
+int __wrap_zros_sub_update(struct zros_sub *sub);
+
+void topic_stats_work_handler(struct k_work *work);
+void topic_stats_timer_handler(struct k_timer *timer);
+
+struct topic_entry {
+	struct zros_topic *topic;
+	const char *name;
+	size_t size;
+	uint32_t publishes;
+	uint32_t last_cyc;
+	uint32_t min_cyc;
+	uint32_t max_cyc;
+	uint32_t avg_cyc;
+};
+
+// subscribers are found by address, slots are never freed
+struct sub_entry {
+	const struct zros_sub *sub;
+	uint32_t updates;
+	uint32_t last_updates;
+	uint32_t last_publishes;
+	uint32_t skipped;
+	bool baseline;
+};
+
+#define TOPIC_ENTRY(topic_name, type, frame, snprint)                                              \
+	{.topic = &topic_##topic_name, .name = #topic_name, .size = sizeof(type)},
+
+static struct topic_entry g_topics[] = {SYNAPSE_TOPIC_LIST(TOPIC_ENTRY)};
+
+BUILD_ASSERT(ARRAY_SIZE(g_topics) <= SYNAPSE_TOPIC_STATS_MAX_TOPICS, "too many topics for stats");
+
+static struct sub_entry g_subs[SUB_SLOTS];
+
+static struct k_spinlock g_lock;
+
+struct context {
+	struct k_work work_item;
+	struct k_timer timer;
+	struct zros_node node;
+	struct zros_pub pub;
+	struct synapse_topic_stats msg;
+	bool initialized;
+	struct k_mutex lock;
+};
+
+static struct context g_ctx = {
+	.work_item = Z_WORK_INITIALIZER(topic_stats_work_handler),
+	.timer = Z_TIMER_INITIALIZER(g_ctx.timer, topic_stats_timer_handler, NULL),
+	.node = {},
+	.pub = {},
+	.msg = {},
+	.initialized = false,
+	.lock = Z_MUTEX_INITIALIZER(g_ctx.lock),
+};
+
+BUILD_ASSERT(ARRAY_SIZE(g_topics) == SYNAPSE_TOPIC_COUNT, "stats are indexed by registry id");
+
+static struct topic_entry *topic_entry_get(const struct zros_topic *topic)
+{
+	int id = synapse_topic_id(topic);
+	return id < 0 ? NULL : &g_topics[id];
+}
+
+// call with g_lock held, returns NULL once the table is full
+static struct sub_entry *sub_entry_get(const struct zros_sub *sub)
+{
+	size_t i = ((uintptr_t)sub >> 2) & (SUB_SLOTS - 1);
+	for (size_t n = 0; n < SUB_SLOTS; n++) {
+		struct sub_entry *e = &g_subs[(i + n) & (SUB_SLOTS - 1)];
+		if (e->sub == sub) {
+			return e;
+		}
+		if (e->sub == NULL) {
+			e->sub = sub;
+			return e;
+		}
+	}
+	return NULL;
+}
+
+void synapse_topic_stats_record(struct zros_topic *topic)
+{
+	struct topic_entry *e = topic_entry_get(topic);
+	if (e == NULL) {
+		return;
+	}
+
+	uint32_t now = k_cycle_get_32();
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	if (e->publishes > 0) {
+		uint32_t dt = now - e->last_cyc;
+		e->min_cyc = MIN(e->min_cyc, dt);
+		e->max_cyc = MAX(e->max_cyc, dt);
+		// ewma with a weight of 1/16, seeded by the first interval
+		int64_t avg = e->publishes == 1 ? dt : e->avg_cyc + ((int64_t)dt - e->avg_cyc) / 16;
+		e->avg_cyc = (uint32_t)avg;
+	}
+	e->last_cyc = now;
+	e->publishes++;
+	k_spin_unlock(&g_lock, key);
+}
+
+int __wrap_zros_sub_update(struct zros_sub *sub)
+{
+	int ret = __real_zros_sub_update(sub);
+	if (ret == 0) {
+		k_spinlock_key_t key = k_spin_lock(&g_lock);
+		struct sub_entry *e = sub_entry_get(sub);
+		if (e != NULL) {
+			e->updates++;
+		}
+		k_spin_unlock(&g_lock, key);
+	}
+	return ret;
+}
+
+struct skip_sum {
+	uint32_t publishes;
+	uint32_t skipped;
+};
+
+static void sample_sub(const struct zros_sub *sub, void *data)
+{
+	struct skip_sum *sum = data;
+
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	struct sub_entry *e = sub_entry_get(sub);
+	if (e != NULL) {
+		uint32_t published = sum->publishes - e->last_publishes;
+		uint32_t updated = e->updates - e->last_updates;
+		e->skipped = e->baseline && published > updated ? published - updated : 0;
+		e->last_publishes = sum->publishes;
+		e->last_updates = e->updates;
+		e->baseline = true;
+		sum->skipped += e->skipped;
+	}
+	k_spin_unlock(&g_lock, key);
+}
+
+static void sample_topic(struct topic_entry *e, struct synapse_topic_stat *stat)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	uint32_t publishes = e->publishes;
+	uint32_t last_cyc = e->last_cyc;
+	uint32_t min_cyc = e->min_cyc;
+	uint32_t max_cyc = e->max_cyc;
+	uint32_t avg_cyc = e->avg_cyc;
+	e->min_cyc = UINT32_MAX;
+	e->max_cyc = 0;
+	k_spin_unlock(&g_lock, key);
+
+	struct skip_sum sum = {.publishes = publishes, .skipped = 0};
+	zros_topic_iterate_sub(e->topic, sample_sub, &sum);
+
+	strncpy(stat->name, e->name, sizeof(stat->name) - 1);
+	stat->publishes = publishes;
+	stat->bytes = (uint64_t)publishes * e->size;
+	stat->last_publish_cyc = last_cyc;
+	stat->interval_min_us = min_cyc == UINT32_MAX ? 0 : k_cyc_to_us_floor32(min_cyc);
+	stat->interval_max_us = k_cyc_to_us_floor32(max_cyc);
+	stat->interval_avg_us = k_cyc_to_us_floor32(avg_cyc);
+	stat->skipped = sum.skipped;
+}
+
+void topic_stats_work_handler(struct k_work *work)
+{
+	struct context *ctx = CONTAINER_OF(work, struct context, work_item);
+
+	// topics are registered with the broker late in boot, so init on first sample
+	if (!ctx->initialized) {
+		zros_node_init(&ctx->node, "synapse_topic_stats");
+		zros_pub_init(&ctx->pub, &ctx->node, &topic_topic_stats, &ctx->msg);
+		ctx->initialized = true;
+		LOG_INF("init");
+	}
+
+	k_mutex_lock(&ctx->lock, K_FOREVER);
+	ctx->msg.uptime_ms = k_uptime_get_32();
+	ctx->msg.topic_count = ARRAY_SIZE(g_topics);
+	for (size_t i = 0; i < ARRAY_SIZE(g_topics); i++) {
+		sample_topic(&g_topics[i], &ctx->msg.topic[i]);
+	}
+	k_mutex_unlock(&ctx->lock);
+
+	zros_pub_update(&ctx->pub);
+}
+
+void topic_stats_timer_handler(struct k_timer *timer)
+{
+	struct context *ctx = CONTAINER_OF(timer, struct context, timer);
+	k_work_submit_to_queue(&g_low_priority_work_q, &ctx->work_item);
+}
+
+static void print_sub(const struct zros_sub *sub, void *data)
+{
+	const struct shell *sh = data;
+	char name[32];
+	zros_node_get_name(sub->_node, name, sizeof(name));
+
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	struct sub_entry *e = sub_entry_get(sub);
+	uint32_t updates = e != NULL ? e->updates : 0;
+	uint32_t skipped = e != NULL ? e->skipped : 0;
+	k_spin_unlock(&g_lock, key);
+
+	shell_print(sh, "  %-26s %10u %42s %8u", name, updates, "", skipped);
+}
+
+int synapse_topic_stats_print(const struct shell *sh)
+{
+	struct context *ctx = &g_ctx;
+
+	k_mutex_lock(&ctx->lock, K_FOREVER);
+	shell_print(sh, "window: %d ms uptime: %u ms", CONFIG_CEREBRI_SYNAPSE_TOPIC_STATS_PERIOD_MS,
+		    ctx->msg.uptime_ms);
+	shell_print(sh, "%-28s %10s %10s %8s %8s %8s %6s %8s", "topic", "count", "kbytes",
+		    "avg (us)", "min (us)", "max (us)", "hz", "skipped");
+	for (int i = 0; i < ctx->msg.topic_count; i++) {
+		struct synapse_topic_stat *t = &ctx->msg.topic[i];
+		if (t->publishes == 0) {
+			continue;
+		}
+		shell_print(sh, "%-28s %10u %10llu %8u %8u %8u %6.1f %8u", t->name, t->publishes,
+			    t->bytes / 1024, t->interval_avg_us, t->interval_min_us,
+			    t->interval_max_us,
+			    t->interval_avg_us > 0 ? 1e6 / t->interval_avg_us : 0.0, t->skipped);
+		zros_topic_iterate_sub(g_topics[i].topic, print_sub, (void *)sh);
+	}
+	k_mutex_unlock(&ctx->lock);
+	return 0;
+}
+
+static int topic_stats_sys_init(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(g_topics); i++) {
+		g_topics[i].min_cyc = UINT32_MAX;
+	}
+	k_timer_start(&g_ctx.timer, K_MSEC(CONFIG_CEREBRI_SYNAPSE_TOPIC_STATS_PERIOD_MS),
+		      K_MSEC(CONFIG_CEREBRI_SYNAPSE_TOPIC_STATS_PERIOD_MS));
+	return 0;
+};
+
+SYS_INIT(topic_stats_sys_init, APPLICATION, 1);
+
+// vi: ts=4 sw=4 et
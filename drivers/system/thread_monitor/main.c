@@ -0,0 +1,205 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+
+#include <cerebri/core/trace.h>
+
+#include <synapse_topic_list.h>
+
+LOG_MODULE_REGISTER(system_thread_monitor, CONFIG_CEREBRI_SYSTEM_THREAD_MONITOR_LOG_LEVEL);
+
+#define MAX_THREADS SYNAPSE_THREAD_MONITOR_MAX_THREADS
+
+extern struct k_work_q g_low_priority_work_q;
+
+void thread_monitor_work_handler(struct k_work *work);
+void thread_monitor_timer_handler(struct k_timer *timer);
+
+// per thread state kept between samples, slots are never reused
+struct thread_slot {
+	const struct k_thread *thread;
+	char name[SYNAPSE_THREAD_MONITOR_NAME_LEN];
+	uint64_t last_cycles;
+	uint16_t trace_id;
+};
+
+struct context {
+	struct k_work work_item;
+	struct k_timer timer;
+	struct zros_node node;
+	struct zros_pub pub;
+	struct synapse_thread_monitor msg;
+	struct thread_slot slot[MAX_THREADS];
+	size_t slot_count;
+	uint64_t last_total_cycles;
+	uint64_t last_busy_cycles;
+	uint64_t window_cycles;
+	bool initialized;
+	struct k_mutex lock;
+};
+
+static struct context g_ctx = {
+	.work_item = Z_WORK_INITIALIZER(thread_monitor_work_handler),
+	.timer = Z_TIMER_INITIALIZER(g_ctx.timer, thread_monitor_timer_handler, NULL),
+	.node = {},
+	.pub = {},
+	.msg = {},
+	.slot = {},
+	.slot_count = 0,
+	.last_total_cycles = 0,
+	.last_busy_cycles = 0,
+	.window_cycles = 0,
+	.initialized = false,
+	.lock = Z_MUTEX_INITIALIZER(g_ctx.lock),
+};
+
+static struct thread_slot *get_slot(struct context *ctx, const struct k_thread *thread)
+{
+	for (size_t i = 0; i < ctx->slot_count; i++) {
+		if (ctx->slot[i].thread == thread) {
+			return &ctx->slot[i];
+		}
+	}
+	if (ctx->slot_count >= MAX_THREADS) {
+		return NULL;
+	}
+	struct thread_slot *slot = &ctx->slot[ctx->slot_count++];
+	slot->thread = thread;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+	if (name != NULL && name[0] != '\0') {
+		snprintf(slot->name, sizeof(slot->name), "%s", name);
+	} else {
+		snprintf(slot->name, sizeof(slot->name), "%p", thread);
+	}
+	slot->last_cycles = 0;
+	slot->trace_id = 0;
+	return slot;
+}
+
+static void sample_thread(const struct k_thread *cthread, void *user_data)
+{
+	struct context *ctx = user_data;
+	struct k_thread *thread = (struct k_thread *)cthread;
+
+	struct thread_slot *slot = get_slot(ctx, thread);
+	if (slot == NULL || ctx->msg.thread_count >= MAX_THREADS) {
+		return;
+	}
+
+	k_thread_runtime_stats_t stats;
+	if (k_thread_runtime_stats_get(thread, &stats) != 0) {
+		return;
+	}
+	uint64_t delta = stats.execution_cycles - slot->last_cycles;
+	slot->last_cycles = stats.execution_cycles;
+
+	size_t unused = 0;
+	if (k_thread_stack_space_get(thread, &unused) != 0) {
+		unused = 0;
+	}
+
+	struct synapse_thread_stats *t = &ctx->msg.thread[ctx->msg.thread_count++];
+	memcpy(t->name, slot->name, sizeof(t->name));
+	t->cpu_permille =
+		ctx->window_cycles > 0 ? (uint16_t)(1000 * delta / ctx->window_cycles) : 0;
+	t->priority = k_thread_priority_get(thread);
+	t->stack_size = thread->stack_info.size;
+	t->stack_unused = unused;
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_TRACE)
+	// log_sdcard and eth_tx drain the tracer, so samples end up in the flight log
+	if (slot->trace_id == 0) {
+		slot->trace_id = trace_register(slot->name);
+	}
+	trace_record(TRACE_EVENT_THREAD_CPU, slot->trace_id, t->cpu_permille);
+	trace_record(TRACE_EVENT_THREAD_STACK, slot->trace_id, t->stack_unused);
+#endif
+}
+
+void thread_monitor_work_handler(struct k_work *work)
+{
+	struct context *ctx = CONTAINER_OF(work, struct context, work_item);
+
+	// topics are registered with the broker late in boot, so init on first sample
+	if (!ctx->initialized) {
+		zros_node_init(&ctx->node, "system_thread_monitor");
+		zros_pub_init(&ctx->pub, &ctx->node, &topic_thread_monitor, &ctx->msg);
+		ctx->initialized = true;
+		LOG_INF("init");
+	}
+
+	k_thread_runtime_stats_t all;
+	if (k_thread_runtime_stats_all_get(&all) != 0) {
+		LOG_ERR("runtime stats unavailable");
+		return;
+	}
+
+	k_mutex_lock(&ctx->lock, K_FOREVER);
+	ctx->window_cycles = all.execution_cycles - ctx->last_total_cycles;
+	uint64_t busy = all.total_cycles - ctx->last_busy_cycles;
+	ctx->last_total_cycles = all.execution_cycles;
+	ctx->last_busy_cycles = all.total_cycles;
+
+	ctx->msg.uptime_ms = k_uptime_get_32();
+	ctx->msg.cpu_load_permille =
+		ctx->window_cycles > 0 ? (uint16_t)(1000 * busy / ctx->window_cycles) : 0;
+	ctx->msg.thread_count = 0;
+	k_thread_foreach_unlocked(sample_thread, ctx);
+	k_mutex_unlock(&ctx->lock);
+
+	zros_pub_update(&ctx->pub);
+}
+
+void thread_monitor_timer_handler(struct k_timer *timer)
+{
+	struct context *ctx = CONTAINER_OF(timer, struct context, timer);
+	k_work_submit_to_queue(&g_low_priority_work_q, &ctx->work_item);
+}
+
+static int cmd_top(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	struct context *ctx = &g_ctx;
+
+	k_mutex_lock(&ctx->lock, K_FOREVER);
+	shell_print(sh, "uptime: %u ms cpu load: %5.1f %%", ctx->msg.uptime_ms,
+		    ctx->msg.cpu_load_permille / 10.0);
+	shell_print(sh, "%-16s %4s %6s %8s %8s %5s", "thread", "prio", "cpu", "stack", "used",
+		    "use");
+	for (int i = 0; i < ctx->msg.thread_count; i++) {
+		struct synapse_thread_stats *t = &ctx->msg.thread[i];
+		uint32_t used = t->stack_size - t->stack_unused;
+		shell_print(sh, "%-16s %4d %5.1f%% %8u %8u %4u%%", t->name, t->priority,
+			    t->cpu_permille / 10.0, t->stack_size, used,
+			    t->stack_size > 0 ? 100 * used / t->stack_size : 0);
+	}
+	k_mutex_unlock(&ctx->lock);
+	return 0;
+}
+
+SHELL_CMD_REGISTER(top, NULL, "Thread cpu share and stack high water mark", cmd_top);
+
+static int thread_monitor_sys_init(void)
+{
+	struct context *ctx = &g_ctx;
+	k_timer_start(&ctx->timer, K_MSEC(CONFIG_CEREBRI_SYSTEM_THREAD_MONITOR_PERIOD_MS),
+		      K_MSEC(CONFIG_CEREBRI_SYSTEM_THREAD_MONITOR_PERIOD_MS));
+	return 0;
+};
+
+SYS_INIT(thread_monitor_sys_init, APPLICATION, 1);
+
+// vi: ts=4 sw=4 et
@@ -290,25 +290,19 @@ uint8_t nxp_flexio_dshot_channel_count(const struct device *dev)
 	return config->channel->dshot_channel_count;
 }
 
+/* Three timer bits per packet bit, T0H 0b001 and T1H 0b011, the first bit lowest */
+static const uint16_t dshot_expand_nibble[16] = {
+	0x249, 0x649, 0x2C9, 0x6C9, 0x259, 0x659, 0x2D9, 0x6D9,
+	0x24B, 0x64B, 0x2CB, 0x6CB, 0x25B, 0x65B, 0x2DB, 0x6DB,
+};
+
 /* Expand packet from 16 bits 48 to get T0H and T1H timing */
 uint64_t nxp_flexio_dshot_expand_data(uint16_t packet)
 {
-	unsigned int mask;
-	unsigned int index = 0;
-	uint64_t expanded = 0x0;
-
-	for (mask = 0x8000; mask != 0; mask >>= 1) {
-		if (packet & mask) {
-			expanded = expanded | ((uint64_t)0x3 << index);
-
-		} else {
-			expanded = expanded | ((uint64_t)0x1 << index);
-		}
-
-		index = index + 3;
-	}
-
-	return expanded;
+	return (uint64_t)dshot_expand_nibble[packet >> 12] |
+	       ((uint64_t)dshot_expand_nibble[(packet >> 8) & 0xF] << 12) |
+	       ((uint64_t)dshot_expand_nibble[(packet >> 4) & 0xF] << 24) |
+	       ((uint64_t)dshot_expand_nibble[packet & 0xF] << 36);
 }
 
 /**
@@ -316,54 +310,92 @@ uint64_t nxp_flexio_dshot_expand_data(uint16_t packet)
  *steps of throttle resolution) bit 	12		- dshot telemetry
  *enable/disable bits 	13-16	- XOR checksum
  **/
+static uint16_t nxp_flexio_dshot_packet(uint16_t throttle, bool telemetry, bool bdshot)
+{
+	uint16_t packet = (throttle << DSHOT_THROTTLE_POSITION) |
+			  (((uint16_t)telemetry & 0x01) << DSHOT_TELEMETRY_POSITION);
+	/* XOR checksum of the three data nibbles, inverted for bdshot */
+	uint16_t csum_data = (bdshot ? (uint16_t)~packet : packet) >> NIBBLES_SIZE;
+	uint16_t checksum = csum_data ^ (csum_data >> 4) ^ (csum_data >> 8);
+
+	return packet | (checksum & 0x0F);
+}
+
+static void nxp_flexio_dshot_channel_set(struct nxp_flexio_dshot_channel_config *dshot_info,
+					 uint16_t packet)
+{
+	uint64_t dshot_expanded = nxp_flexio_dshot_expand_data(packet);
+
+	dshot_info->data_seg1 = (uint32_t)(dshot_expanded & 0xFFFFFF);
+	dshot_info->irq_data = (uint32_t)(dshot_expanded >> 24);
+	dshot_info->state = DSHOT_START;
+}
+
 void nxp_flexio_dshot_data_set(const struct device *dev, unsigned channel, uint16_t throttle,
 			       bool telemetry)
 {
 	const struct nxp_flexio_dshot_config *config = dev->config;
 	struct nxp_flexio_dshot_data *data = dev->data;
-	struct nxp_flexio_dshot_channel_config *dshot_info = &config->channel->dshot_info[channel];
 	FLEXIO_Type *flexio_base = (FLEXIO_Type *)(config->flexio_base);
 
-	if (channel < config->channel->dshot_channel_count && dshot_info->init) {
-		uint16_t csum_data;
-		uint16_t packet = 0;
-		uint16_t checksum = 0;
+	if (channel >= config->channel->dshot_channel_count) {
+		return;
+	}
+
+	struct nxp_flexio_dshot_channel_config *dshot_info = &config->channel->dshot_info[channel];
+
+	if (dshot_info->init) {
+		uint16_t packet = nxp_flexio_dshot_packet(throttle, telemetry, dshot_info->bdshot);
 
-		packet |= throttle << DSHOT_THROTTLE_POSITION;
-		packet |= ((uint16_t)telemetry & 0x01) << DSHOT_TELEMETRY_POSITION;
+		nxp_flexio_dshot_channel_set(dshot_info, packet);
 
 		if (dshot_info->bdshot) {
-			csum_data = ~packet;
+			flexio_base->TIMCTL[config->child->res.timer_index[channel]] = 0;
+			FLEXIO_DisableShifterStatusInterrupts(flexio_base, data->dshot_mask);
+
+			nxp_flexio_dshot_output(dev, channel);
 
-		} else {
-			csum_data = packet;
+			FLEXIO_ClearTimerStatusFlags(flexio_base, data->dshot_timer_mask);
 		}
+	}
+}
 
-		/* XOR checksum calculation */
-		csum_data >>= NIBBLES_SIZE;
+void nxp_flexio_dshot_frames_set(const struct device *dev, const uint16_t *throttle,
+				 unsigned count)
+{
+	const struct nxp_flexio_dshot_config *config = dev->config;
+	struct nxp_flexio_dshot_data *data = dev->data;
+	FLEXIO_Type *flexio_base = (FLEXIO_Type *)(config->flexio_base);
+	bool bdshot = false;
 
-		for (unsigned i = 0; i < DSHOT_NUMBER_OF_NIBBLES; i++) {
-			checksum ^= (csum_data & 0x0F); // XOR data by nibbles
-			csum_data >>= NIBBLES_SIZE;
-		}
+	count = MIN(count, config->channel->dshot_channel_count);
+
+	/* interrupts of every channel are off while bdshot channels return to output */
+	FLEXIO_DisableShifterStatusInterrupts(flexio_base, data->dshot_mask);
 
-		packet |= (checksum & 0x0F);
+	for (unsigned channel = 0; channel < count; channel++) {
+		struct nxp_flexio_dshot_channel_config *dshot_info =
+			&config->channel->dshot_info[channel];
 
-		uint64_t dshot_expanded = nxp_flexio_dshot_expand_data(packet);
+		if (!dshot_info->init) {
+			continue;
+		}
 
-		dshot_info->data_seg1 = (uint32_t)(dshot_expanded & 0xFFFFFF);
-		dshot_info->irq_data = (uint32_t)(dshot_expanded >> 24);
-		dshot_info->state = DSHOT_START;
+		uint16_t packet =
+			nxp_flexio_dshot_packet(throttle[channel], false, dshot_info->bdshot);
+
+		nxp_flexio_dshot_channel_set(dshot_info, packet);
 
 		if (dshot_info->bdshot) {
 			flexio_base->TIMCTL[config->child->res.timer_index[channel]] = 0;
-			FLEXIO_DisableShifterStatusInterrupts(flexio_base, data->dshot_mask);
-
 			nxp_flexio_dshot_output(dev, channel);
-
-			FLEXIO_ClearTimerStatusFlags(flexio_base, data->dshot_timer_mask);
+			bdshot = true;
 		}
 	}
+
+	if (bdshot) {
+		FLEXIO_ClearTimerStatusFlags(flexio_base, data->dshot_timer_mask);
+	}
 }
 
 int up_bdshot_decode_erpm(const struct device *dev)
@@ -0,0 +1,17 @@
+#ifndef CEREBRI_ACTUATE_DSHOT_H
+#define CEREBRI_ACTUATE_DSHOT_H
+
+#include <synapse_latency.h>
+#include <synapse_topic_list.h>
+
+/*
+ * Send the velocities of actuators to the dshot motors from the calling
+ * thread, with CONFIG_CEREBRI_ACTUATE_DSHOT_DIRECT. The motors stay
+ * disarmed unless topic_status is armed. Stamps the actuate stage of
+ * latency. -ENODEV when the dshot node is not running.
+ */
+int actuate_dshot_write(const synapse_pb_Actuators *actuators,
+			struct synapse_latency_trace *latency);
+
+#endif // CEREBRI_ACTUATE_DSHOT_H
+// vi: ts=4 sw=4 et
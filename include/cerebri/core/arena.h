@@ -0,0 +1,87 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_ARENA_H
+#define CEREBRI_CORE_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/toolchain.h>
+
+/*
+ * Bounded bump allocator over a fixed buffer, for the variable length
+ * fields of one message. Blocks are carved from the front and all freed
+ * at once by arena_reset, only the last block can grow in place or be
+ * given back, which is how nanopb grows a repeated field while decoding.
+ * An allocation that does not fit returns NULL and is counted, there is
+ * no fallback to the heap.
+ *
+ * With CONFIG_CEREBRI_CORE_COMMON_PB_ARENA nanopb is built with
+ * PB_ENABLE_MALLOC and its pb_realloc / pb_free allocate from the arena
+ * of the thread inside arena_pb_decode. Pointer fields then take only
+ * what the decoded content needs instead of the max_count of a static
+ * array, and stay valid until the arena is reset.
+ */
+
+#define ARENA_ALIGN 8
+
+struct arena {
+	uint8_t *buf;
+	size_t size;
+	size_t used;
+	// offset of the last block, SIZE_MAX when there is none
+	size_t last;
+	size_t high_water;
+	uint32_t failures;
+};
+
+#define ARENA_INITIALIZER(_buf, _size)                                                             \
+	{.buf = (uint8_t *)(_buf), .size = (_size), .used = 0, .last = SIZE_MAX,                   \
+	 .high_water = 0, .failures = 0}
+
+#define ARENA_DEFINE(_name, _size)                                                                 \
+	static uint8_t __aligned(ARENA_ALIGN) _name##_buf[_size];                                  \
+	struct arena _name = ARENA_INITIALIZER(_name##_buf, _size)
+
+void arena_init(struct arena *arena, void *buf, size_t size);
+
+// frees every block, pointers into the arena are invalid afterwards
+void arena_reset(struct arena *arena);
+
+// ARENA_ALIGN aligned, NULL when it does not fit
+void *arena_alloc(struct arena *arena, size_t size);
+
+/*
+ * realloc semantics, the last block grows or shrinks in place, any
+ * other block is moved to a new one and its old space is lost until
+ * the next reset
+ */
+void *arena_realloc(struct arena *arena, void *ptr, size_t size);
+
+// only the last block is given back, others wait for the reset
+void arena_free(struct arena *arena, void *ptr);
+
+static inline size_t arena_used(const struct arena *arena)
+{
+	return arena->used;
+}
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PB_ARENA)
+
+#include <pb_decode.h>
+
+/*
+ * pb_decode with the pointer fields of msg allocated from arena, reset
+ * first, so msg must not hold an earlier decode that is still read.
+ * Calls from different threads are serialized.
+ */
+bool arena_pb_decode(struct arena *arena, pb_istream_t *stream, const pb_msgdesc_t *fields,
+		     void *msg);
+
+#endif
+
+#endif // CEREBRI_CORE_ARENA_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,60 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_BOOT_H
+#define CEREBRI_CORE_BOOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+/*
+ * Readiness signals between nodes brought up in parallel, in place of
+ * fixed sleeps: a producer sets its signal once, consumers wait for the
+ * signals they need. Each signal and boot_mark stage is stamped in the
+ * boot profile, listed by the boot shell command.
+ */
+
+#define BOOT_READY_LIST(X)                                                                         \
+	X(LOG_WRITER)                                                                              \
+	X(IMU)                                                                                     \
+	X(ESTIMATE)                                                                                \
+	X(ARM)
+
+#define BOOT_READY_ENUM(name) BOOT_READY_##name,
+enum boot_ready_signal {
+	BOOT_READY_LIST(BOOT_READY_ENUM) BOOT_READY_COUNT
+};
+
+#define BOOT_READY(name) BIT(BOOT_READY_##name)
+
+// signal once, later calls are ignored
+void boot_ready_set(enum boot_ready_signal signal);
+
+// 0 once every signal in mask is set, -EAGAIN on timeout
+int boot_ready_wait(uint32_t mask, k_timeout_t timeout);
+
+static inline bool boot_ready_all(uint32_t mask)
+{
+	return boot_ready_wait(mask, K_NO_WAIT) == 0;
+}
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_BOOT_PROFILE)
+
+// stamp a named boot stage, name must outlive the profile
+void boot_mark(const char *name);
+
+#else
+
+static inline void boot_mark(const char *name)
+{
+	(void)name;
+}
+
+#endif
+
+#endif // CEREBRI_CORE_BOOT_H
+// vi: ts=4 sw=4 et
@@ -1,13 +1,70 @@
 #ifndef CEREBRI_CORE_CASADI_H
 #define CEREBRI_CORE_CASADI_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/sys/slist.h>
+
+#include <cerebri/core/perf_duration.h>
+#include <cerebri/core/trace.h>
+
+// a call site of a generated function, listed by the casadi shell command
+struct casadi_func {
+	sys_snode_t node;
+	const char *name;
+	const char *caller;
+	bool registered;
+	uint32_t start_cyc;
+	uint32_t last_cyc;
+	struct perf_duration perf;
+};
+
+#define CASADI_FUNC_INITIALIZER(fn)                                                                \
+	{                                                                                          \
+		.name = #fn, .caller = __func__, .registered = false,                              \
+	}
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_CASADI_DTCM)
+#define CASADI_WORK_SECTION __dtcm_bss_section
+#else
+#define CASADI_WORK_SECTION
+#endif
+
+void casadi_func_start(struct casadi_func *func);
+
+void casadi_func_stop(struct casadi_func *func);
+
+/*
+ * Work arrays sized for the function and kept static at the call site,
+ * so they take no stack and a node's stack does not depend on the
+ * functions it calls. A call site must not be entered from two threads
+ * at once, shared code that may be uses CASADI_FUNC_ARGS_STACK.
+ */
 #define CASADI_FUNC_ARGS(name)                                                                     \
+	static casadi_int iw[name##_SZ_IW] CASADI_WORK_SECTION;                                    \
+	static casadi_real w[name##_SZ_W] CASADI_WORK_SECTION;                                     \
+	static const casadi_real *args[name##_SZ_ARG];                                             \
+	static casadi_real *res[name##_SZ_RES];                                                    \
+	static struct casadi_func casadi_func_site = CASADI_FUNC_INITIALIZER(name);                \
+	struct casadi_func *casadi_func_ptr = &casadi_func_site;                                   \
+	int mem = 0;
+
+// reentrant, work arrays on the caller stack and the call not timed
+#define CASADI_FUNC_ARGS_STACK(name)                                                               \
 	casadi_int iw[name##_SZ_IW];                                                               \
 	casadi_real w[name##_SZ_W];                                                                \
 	const casadi_real *args[name##_SZ_ARG];                                                    \
 	casadi_real *res[name##_SZ_RES];                                                           \
+	struct casadi_func *casadi_func_ptr = NULL;                                                \
 	int mem = 0;
 
-#define CASADI_FUNC_CALL(name) name(args, res, iw, w, mem);
+#define CASADI_FUNC_CALL(name)                                                                     \
+	CEREBRI_TRACE_NAMED(TRACE_EVENT_CASADI_START, #name, 0);                                   \
+	casadi_func_start(casadi_func_ptr);                                                        \
+	name(args, res, iw, w, mem);                                                               \
+	casadi_func_stop(casadi_func_ptr);                                                         \
+	CEREBRI_TRACE_NAMED(TRACE_EVENT_CASADI_STOP, #name, 0);
 
 #endif // CEREBRI_CORE_CASADI_H
@@ -0,0 +1,37 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_CLOCK_SYNC_H
+#define CEREBRI_CORE_CLOCK_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Offboard time base shared with the ground station, in ns.
+ *
+ * With CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_PTP it reads the ethernet
+ * PTP hardware clock that gPTP keeps locked to the grandmaster, with
+ * sub microsecond resolution and the path delay measured by the
+ * protocol. Without it, or while no grandmaster is present, it is
+ * uptime plus the offset from the last clock_offset message received
+ * from the ground.
+ */
+
+int64_t clock_sync_now_ns(void);
+
+// offboard time of an uptime in ticks, for stamping messages
+int64_t clock_sync_ticks_to_ns(int64_t ticks);
+
+// offboard time of an uptime in ns, for cycle counter stamps
+int64_t clock_sync_uptime_ns_to_ns(int64_t uptime_ns);
+
+// offset of the ground clock from uptime, from a clock_offset message
+void clock_sync_set_offset_ns(int64_t offset_ns);
+
+// true while the PTP clock follows a grandmaster
+bool clock_sync_locked(void);
+
+#endif // CEREBRI_CORE_CLOCK_SYNC_H
+// vi: ts=4 sw=4 et
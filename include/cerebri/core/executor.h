@@ -0,0 +1,65 @@
+#ifndef CEREBRI_CORE_EXECUTOR_H
+#define CEREBRI_CORE_EXECUTOR_H
+
+#include <zephyr/kernel.h>
+
+#include <cerebri/core/perf_duration.h>
+
+/*
+ * Time-triggered rate-monotonic executor.
+ *
+ * A timer releases one frame every CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR_FRAME_US
+ * on g_high_priority_work_q. Each frame runs the registered tasks due in
+ * that frame in stage order, so a sample flows estimate -> attitude ->
+ * angular_velocity -> allocation -> actuate within one frame instead of
+ * waking one thread per hop. Task durations are perf_durations with the
+ * task deadline, so overruns show up as misses in `perf_duration`.
+ */
+
+#define EXECUTOR_FRAME_US CONFIG_CEREBRI_CORE_WORKQUEUES_EXECUTOR_FRAME_US
+
+enum executor_stage {
+	EXECUTOR_STAGE_ESTIMATE = 0,
+	EXECUTOR_STAGE_ATTITUDE,
+	EXECUTOR_STAGE_ANGULAR_VELOCITY,
+	EXECUTOR_STAGE_ALLOCATION,
+	EXECUTOR_STAGE_ACTUATE,
+	EXECUTOR_STAGE_COUNT,
+};
+
+struct executor_task;
+
+typedef void (*executor_fn_t)(struct executor_task *task);
+
+struct executor_task {
+	sys_snode_t node;
+	const char *name;
+	executor_fn_t fn;
+	enum executor_stage stage;
+	uint32_t period_frames;
+	uint32_t phase_frames;
+	int64_t wait_start_ms;
+	uint16_t trace_id;
+	struct perf_duration duration;
+};
+
+/*
+ * period_us must be a multiple of the frame, phase_us delays the first
+ * release within the period, deadline_us bounds the run time of one call
+ */
+int executor_register(struct executor_task *task, const char *name, executor_fn_t fn,
+		      enum executor_stage stage, uint32_t period_us, uint32_t phase_us,
+		      uint32_t deadline_us);
+
+void executor_unregister(struct executor_task *task);
+
+/*
+ * stands in for k_poll on the topic a task consumes, returns 0 when a new
+ * message is available, -EAGAIN once timeout_ms passed without one and
+ * -EBUSY when the task has nothing to do this frame
+ */
+int executor_wait(struct executor_task *task, bool available, uint32_t timeout_ms);
+
+// vi: ts=4 sw=4 et
+
+#endif // CEREBRI_CORE_EXECUTOR_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_FSM_H
+#define CEREBRI_CORE_FSM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/sys/util.h>
+
+/*
+ * Table driven state machine shared by the vehicle fsm nodes. The vehicle
+ * reduces its topics to a bit set of inputs, the state variables are the
+ * enums of the status message. A transition is taken when its request bit
+ * is set, its state variable is at pre, or pre is FSM_STATE_ANY, and none
+ * of its guards hold. fsm_update only walks the table when the inputs
+ * differ from the last walk, so it is cheap to call on every wakeup and
+ * a decision is made as soon as the input that triggers it is seen.
+ */
+#define FSM_STATE_ANY  -1
+#define FSM_GUARDS_MAX 8
+
+struct fsm_guard {
+	// NULL ends the guards of a transition
+	const char *label;
+	// holds while any of these inputs is set
+	uint32_t inputs;
+	// or while state variable state is at value, unused when state < 0
+	int8_t state;
+	uint8_t value;
+};
+
+#define FSM_GUARD_INPUT(bits, text)                                                                \
+	{                                                                                          \
+		.label = (text), .inputs = (bits), .state = -1, .value = 0                         \
+	}
+
+#define FSM_GUARD_STATE(var, val, text)                                                            \
+	{                                                                                          \
+		.label = (text), .inputs = 0, .state = (var), .value = (val)                       \
+	}
+
+struct fsm_transition {
+	const char *label;
+	uint32_t request;
+	uint8_t state;
+	int16_t pre;
+	uint8_t post;
+	struct fsm_guard guards[FSM_GUARDS_MAX];
+};
+
+struct fsm {
+	const struct fsm_transition *table;
+	size_t table_size;
+	// state variables indexed by fsm_transition.state
+	void *const *states;
+	size_t state_count;
+	// union of the request bits, no walk when none is set
+	uint32_t request_mask;
+	// inputs of the last walk
+	uint32_t inputs;
+	bool walked;
+	uint32_t walks;
+	uint32_t skips;
+	uint32_t max_walk_cyc;
+};
+
+#define FSM_DEFINE(name, transitions, ...)                                                         \
+	static void *const name##_states[] = {__VA_ARGS__};                                        \
+	static struct fsm name = {                                                                 \
+		.table = transitions,                                                              \
+		.table_size = ARRAY_SIZE(transitions),                                             \
+		.states = name##_states,                                                           \
+		.state_count = ARRAY_SIZE(name##_states),                                          \
+		.request_mask = 0,                                                                 \
+		.inputs = 0,                                                                       \
+		.walked = false,                                                                   \
+		.walks = 0,                                                                        \
+		.skips = 0,                                                                        \
+		.max_walk_cyc = 0,                                                                 \
+	}
+
+/*
+ * Walk the table if the inputs changed. Accepted and denied requests are
+ * written to msg and counted in request_seq as the per transition calls
+ * did. Returns true when the table was walked, the status should then be
+ * published.
+ */
+bool fsm_update(struct fsm *fsm, uint32_t inputs, char *msg, size_t msg_size, int *request_seq,
+		bool *request_rejected);
+
+// inputs changed outside of fsm_update, for example on start, walk on the next update
+void fsm_reset(struct fsm *fsm);
+
+// ticks to wait for a link deadline, if it is ahead and sooner than wait
+static inline int64_t fsm_wait_ticks(int64_t now_ticks, int64_t deadline_ticks, int64_t wait)
+{
+	int64_t left = deadline_ticks - now_ticks;
+	if (left > 0 && left < wait) {
+		return left;
+	}
+	return wait;
+}
+
+#endif // CEREBRI_CORE_FSM_H
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,45 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_LIGHTING_H
+#define CEREBRI_CORE_LIGHTING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Shared by the lighting nodes of the vehicles. The status leds pulse
+ * between a dim and a bright level, and only the leds whose color moved
+ * since the last led_array are published again, so a node sleeps until
+ * the pulse next changes its integer brightness instead of polling.
+ */
+
+// last color published for one led index
+struct lighting_led {
+	int32_t r;
+	int32_t g;
+	int32_t b;
+	bool valid;
+};
+
+// pulse brightness at t, and the time until its integer value next changes
+int lighting_pulse_brightness(double t, int64_t *wait_ms);
+
+/*
+ * true if the color differs from what was last published for index, and
+ * records it, an index past the n entries of last is always published
+ */
+bool lighting_led_changed(struct lighting_led *last, size_t n, uint32_t index, int32_t r,
+			  int32_t g, int32_t b);
+
+// forget what was published, every led goes out again
+static inline void lighting_led_reset(struct lighting_led *last, size_t n)
+{
+	memset(last, 0, n * sizeof(*last));
+}
+
+#endif // CEREBRI_CORE_LIGHTING_H
+// vi: ts=4 sw=4 et
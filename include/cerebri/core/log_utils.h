@@ -1,7 +1,12 @@
 #ifndef CEREBRI_LOG_UTILS_H
 #define CEREBRI_LOG_UTILS_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/slist.h>
 
 /* Register a module’s desired runtime log level with the manager */
 void cerebri_register_log_level(int16_t module_id, uint32_t level);
@@ -20,4 +25,66 @@ void cerebri_register_log_level(int16_t module_id, uint32_t level);
 	}                                                                                          \
 	SYS_INIT(name##_log_init, APPLICATION, 98)
 
+/*
+ * A rate limited log call site, listed by the log_limit shell command.
+ * Owned by the thread of its call site, the shell only reads it.
+ */
+struct cerebri_log_limit {
+	sys_snode_t node;
+	const char *func;
+	int line;
+	bool registered;
+	int64_t next_tick;
+	uint32_t hits;
+	uint32_t dropped;
+	uint32_t pending;
+};
+
+/* Out of line part of cerebri_log_limit_pass, taken at most once a period */
+bool cerebri_log_limit_emit(struct cerebri_log_limit *site, uint32_t period_ms,
+			    uint32_t *suppressed);
+
+/*
+ * True if the call site may log now. A suppressed call costs a tick read
+ * and a compare, nothing is packaged for the log thread.
+ */
+static inline bool cerebri_log_limit_pass(struct cerebri_log_limit *site, uint32_t period_ms,
+					  uint32_t *suppressed)
+{
+	site->hits++;
+	if (site->registered && k_uptime_ticks() < site->next_tick) {
+		site->dropped++;
+		site->pending++;
+		return false;
+	}
+	return cerebri_log_limit_emit(site, period_ms, suppressed);
+}
+
+/*
+ * Log through the Zephyr macro _log at most once per period_ms from this
+ * call site, with the number of calls dropped since the last one appended.
+ */
+#define CEREBRI_LOG_LIMIT(_log, _period_ms, _fmt, ...)                                             \
+	do {                                                                                       \
+		static struct cerebri_log_limit _log_site = {                                      \
+			.func = __func__, .line = __LINE__, .registered = false};                  \
+		uint32_t _log_suppressed;                                                          \
+		if (cerebri_log_limit_pass(&_log_site, _period_ms, &_log_suppressed)) {            \
+			if (_log_suppressed > 0) {                                                 \
+				_log(_fmt " (%u suppressed)", ##__VA_ARGS__, _log_suppressed);     \
+			} else {                                                                   \
+				_log(_fmt, ##__VA_ARGS__);                                         \
+			}                                                                          \
+		}                                                                                  \
+	} while (0)
+
+#define CEREBRI_LOG_ERR_LIMIT(...)                                                                 \
+	CEREBRI_LOG_LIMIT(LOG_ERR, CONFIG_CEREBRI_CORE_COMMON_LOG_LIMIT_MS, __VA_ARGS__)
+#define CEREBRI_LOG_WRN_LIMIT(...)                                                                 \
+	CEREBRI_LOG_LIMIT(LOG_WRN, CONFIG_CEREBRI_CORE_COMMON_LOG_LIMIT_MS, __VA_ARGS__)
+#define CEREBRI_LOG_INF_LIMIT(...)                                                                 \
+	CEREBRI_LOG_LIMIT(LOG_INF, CONFIG_CEREBRI_CORE_COMMON_LOG_LIMIT_MS, __VA_ARGS__)
+#define CEREBRI_LOG_DBG_LIMIT(...)                                                                 \
+	CEREBRI_LOG_LIMIT(LOG_DBG, CONFIG_CEREBRI_CORE_COMMON_LOG_LIMIT_MS, __VA_ARGS__)
+
 #endif // CEREBRI_LOG_UTILS_H
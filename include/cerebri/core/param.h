@@ -0,0 +1,144 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_PARAM_H
+#define CEREBRI_CORE_PARAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/init.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/slist.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+/*
+ * Runtime parameters, grouped in a caller defined struct that is double
+ * buffered. A control loop takes the active copy with PARAM_GET, one
+ * atomic pointer load, and keeps the pointer for its iteration. A write
+ * fills the other copy from the active one, changes the value and swaps
+ * the pointer, then holds off the next write for a grace period so no
+ * reader is still on the copy it reuses. Writes come from the shell, the
+ * eth_rx control port and settings at boot, saved as param/<group>/<name>.
+ *
+ * Values are named <group>/<name>, and <group>/<name>/<i> for an element
+ * of an array parameter.
+ */
+
+enum param_type {
+	PARAM_TYPE_INT32,
+	PARAM_TYPE_FLOAT,
+	PARAM_TYPE_DOUBLE,
+};
+
+struct param_desc {
+	const char *name;
+	uint16_t offset;
+	uint8_t type;
+	uint8_t count;
+};
+
+struct param_group {
+	sys_snode_t node;
+	const char *name;
+	const struct param_desc *params;
+	size_t param_count;
+	size_t size;
+	void *copy[2];
+	atomic_ptr_t active;
+	// bumped on every write, a loop can compare it to redo derived values
+	atomic_t version;
+};
+
+#define PARAM_TYPE_OF(_v)                                                                          \
+	_Generic((_v),                                                                             \
+		int32_t: PARAM_TYPE_INT32,                                                         \
+		float: PARAM_TYPE_FLOAT,                                                           \
+		double: PARAM_TYPE_DOUBLE)
+
+#define PARAM_MEMBER(_type, _field) (((_type *)0)->_field)
+
+// a scalar member of the group struct
+#define PARAM(_type, _field)                                                                       \
+	{.name = #_field,                                                                          \
+	 .offset = offsetof(_type, _field),                                                        \
+	 .type = PARAM_TYPE_OF(PARAM_MEMBER(_type, _field)),                                       \
+	 .count = 1}
+
+#define PARAM_ARRAY_MAX 16
+
+// an array member, the element type decides the parameter type
+#define PARAM_ARRAY(_type, _field)                                                                 \
+	{.name = #_field,                                                                          \
+	 .offset = offsetof(_type, _field),                                                        \
+	 .type = PARAM_TYPE_OF(PARAM_MEMBER(_type, _field)[0]),                                    \
+	 .count = ARRAY_SIZE(PARAM_MEMBER(_type, _field))}
+
+void param_group_register(struct param_group *group);
+
+/*
+ * Defines struct param_group _name over _type, both copies initialized
+ * with _defaults, a macro expanding to a brace initializer of _type.
+ * Following arguments are PARAM and PARAM_ARRAY entries.
+ */
+#define PARAM_GROUP_DEFINE(_name, _type, _defaults, ...)                                           \
+	static const struct param_desc _name##_params[] = {__VA_ARGS__};                           \
+	static _type _name##_copy[2] = {_defaults, _defaults};                                     \
+	struct param_group _name = {                                                               \
+		.name = #_name,                                                                    \
+		.params = _name##_params,                                                          \
+		.param_count = ARRAY_SIZE(_name##_params),                                         \
+		.size = sizeof(_type),                                                             \
+		.copy = {&_name##_copy[0], &_name##_copy[1]},                                      \
+		.active = ATOMIC_PTR_INIT(&_name##_copy[0]),                                       \
+		.version = ATOMIC_INIT(0),                                                         \
+	};                                                                                         \
+	static int _name##_register(void)                                                          \
+	{                                                                                          \
+		param_group_register(&_name);                                                      \
+		return 0;                                                                          \
+	}                                                                                          \
+	SYS_INIT(_name##_register, APPLICATION, 0)
+
+#define PARAM_GROUP_DECLARE(_name) extern struct param_group _name
+
+// active copy, valid for one loop iteration
+#define PARAM_GET(_name, _type) ((const _type *)atomic_ptr_get(&(_name).active))
+
+static inline uint32_t param_group_version(struct param_group *group)
+{
+	return (uint32_t)atomic_get(&group->version);
+}
+
+/*
+ * Set a value by path from its text, as the shell and settings do.
+ * Returns 0, -ENOENT for an unknown path, -EINVAL for a bad value.
+ */
+int param_set_str(const char *path, const char *value);
+
+// set a value by path, converted to the parameter type, -EINVAL if not finite
+int param_set(const char *path, double value);
+
+int param_get(const char *path, double *value);
+
+// persist every parameter now, writes are otherwise saved after a delay
+int param_save(void);
+
+/*
+ * Datagram setting one parameter, little endian, sent by the ground to
+ * the eth_rx control port next to synapse_telemetry_rates.
+ */
+#define PARAM_SET_MAGIC    0x52415053 // "SPAR"
+#define PARAM_SET_PATH_MAX 48
+
+struct param_set_datagram {
+	uint32_t magic;
+	char path[PARAM_SET_PATH_MAX];
+	double value;
+} __packed;
+
+#endif // CEREBRI_CORE_PARAM_H
+// vi: ts=4 sw=4 et
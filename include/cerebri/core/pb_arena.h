@@ -0,0 +1,24 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_PB_ARENA_H
+#define CEREBRI_CORE_PB_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * nanopb allocation hooks, included ahead of the nanopb sources with
+ * CONFIG_CEREBRI_CORE_COMMON_PB_ARENA so pb_decode.c and pb_common.c
+ * see them, see cerebri/core/arena.h. Outside arena_pb_decode they fail,
+ * a pointer field can only be decoded into an arena.
+ */
+
+void *arena_pb_realloc(void *ptr, size_t size);
+void arena_pb_free(void *ptr);
+
+#define pb_realloc(ptr, size) arena_pb_realloc(ptr, size)
+#define pb_free(ptr)          arena_pb_free(ptr)
+
+#endif // CEREBRI_CORE_PB_ARENA_H
+// vi: ts=4 sw=4 et
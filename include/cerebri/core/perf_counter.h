@@ -3,6 +3,8 @@
 
 #include <zephyr/kernel.h>
 
+#include <cerebri/core/perf_histogram.h>
+
 struct perf_counter {
 	sys_snode_t node;
 	const char *name;
@@ -13,6 +15,7 @@ struct perf_counter {
 	int64_t last_cyc;
 	uint64_t delta_cyc_sum;
 	uint64_t count;
+	struct perf_histogram hist;
 };
 
 void perf_counter_init(struct perf_counter *counter, const char *name, double max_period_sec);
@@ -25,6 +28,10 @@ int perf_counter_report(struct perf_counter *counter, char *buf, size_t n);
 
 void perf_counter_list_report(char *buf, size_t n);
 
+void perf_counter_reset(struct perf_counter *counter);
+
+void perf_counter_list_hist_report(char *buf, size_t n);
+
 // vi: ts=4 sw=4 et
 
 #endif // CEREBRI_CORE_PERF_COUNTER_H
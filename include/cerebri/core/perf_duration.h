@@ -3,6 +3,8 @@
 
 #include <zephyr/kernel.h>
 
+#include <cerebri/core/perf_histogram.h>
+
 struct perf_duration {
 	sys_snode_t node;
 	bool started;
@@ -14,6 +16,7 @@ struct perf_duration {
 	int64_t start_cyc;
 	uint64_t delta_cyc_sum;
 	uint64_t count;
+	struct perf_histogram hist;
 };
 
 void perf_duration_init(struct perf_duration *duration, const char *name, double max_period_sec);
@@ -28,6 +31,10 @@ int perf_duration_report(struct perf_duration *duration, char *buf, size_t n);
 
 void perf_duration_list_report(char *buf, size_t n);
 
+void perf_duration_reset(struct perf_duration *duration);
+
+void perf_duration_list_hist_report(char *buf, size_t n);
+
 // vi: ts=4 sw=4 et
 
 #endif // CEREBRI_CORE_PERF_duration_H
@@ -0,0 +1,84 @@
+#ifndef CEREBRI_CORE_PERF_HISTOGRAM_H
+#define CEREBRI_CORE_PERF_HISTOGRAM_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+/*
+ * Fixed memory log-linear histogram of cycle counts.
+ *
+ * Values below 2^SUB_BITS get an exact bucket, above that every power of two
+ * is split into 2^SUB_BITS linear sub-buckets, so the relative error of a
+ * reported percentile is bounded by 2^-SUB_BITS. Buckets are atomic counters,
+ * so recording is lock-free and safe from any thread or ISR.
+ */
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PERF_HISTOGRAM)
+#define PERF_HISTOGRAM_SUB_BITS CONFIG_CEREBRI_CORE_COMMON_PERF_HISTOGRAM_SUB_BITS
+#else
+#define PERF_HISTOGRAM_SUB_BITS 1
+#endif
+
+#define PERF_HISTOGRAM_SUB_COUNT (1U << PERF_HISTOGRAM_SUB_BITS)
+#define PERF_HISTOGRAM_BUCKETS   ((32U - PERF_HISTOGRAM_SUB_BITS + 1U) * PERF_HISTOGRAM_SUB_COUNT)
+
+struct perf_histogram {
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PERF_HISTOGRAM)
+	atomic_t bucket[PERF_HISTOGRAM_BUCKETS];
+	atomic_t total;
+#endif
+};
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PERF_HISTOGRAM)
+
+static inline uint32_t perf_histogram_index(uint32_t cyc)
+{
+	if (cyc < PERF_HISTOGRAM_SUB_COUNT) {
+		return cyc;
+	}
+	uint32_t shift = (31U - __builtin_clz(cyc)) - PERF_HISTOGRAM_SUB_BITS;
+	return (shift + 1U) * PERF_HISTOGRAM_SUB_COUNT +
+	       ((cyc >> shift) & (PERF_HISTOGRAM_SUB_COUNT - 1U));
+}
+
+static inline void perf_histogram_record(struct perf_histogram *hist, uint32_t cyc)
+{
+	atomic_inc(&hist->bucket[perf_histogram_index(cyc)]);
+	atomic_inc(&hist->total);
+}
+
+#else
+
+static inline void perf_histogram_record(struct perf_histogram *hist, uint32_t cyc)
+{
+	ARG_UNUSED(hist);
+	ARG_UNUSED(cyc);
+}
+
+#endif
+
+void perf_histogram_reset(struct perf_histogram *hist);
+
+uint32_t perf_histogram_count(const struct perf_histogram *hist);
+
+/* upper bound in cycles of the bucket holding the given percentile (per 10000) */
+uint32_t perf_histogram_percentile(const struct perf_histogram *hist, uint32_t per10k);
+
+int perf_histogram_report(const struct perf_histogram *hist, const char *name, char *buf,
+			  size_t n);
+
+/*
+ * offset of a report of n > 0 bytes after appending a snprintf that returned
+ * ret, a truncated or failed append leaves it on the terminator at n - 1
+ */
+static inline size_t perf_report_advance(size_t offset, int ret, size_t n)
+{
+	if (ret < 0 || offset + ret >= n) {
+		return n - 1;
+	}
+	return offset + ret;
+}
+
+// vi: ts=4 sw=4 et
+
+#endif // CEREBRI_CORE_PERF_HISTOGRAM_H
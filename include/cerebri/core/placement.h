@@ -0,0 +1,31 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_PLACEMENT_H
+#define CEREBRI_CORE_PLACEMENT_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/linker/section_tags.h>
+
+/*
+ * Memory placement of the control path. With
+ * CONFIG_CEREBRI_CORE_COMMON_PLACEMENT the context of a control node goes
+ * in DTCM with CEREBRI_HOT_CONTEXT and its stack with
+ * CEREBRI_HOT_STACK_DEFINE, so neither competes for the data cache with
+ * log and network buffers. Whole sources are moved to ITCM by
+ * zephyr_code_relocate in the app CMakeLists.txt, see
+ * scripts/placement_report.py for what ended up where. Without it both
+ * expand to the default placement.
+ */
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PLACEMENT)
+#define CEREBRI_HOT_CONTEXT __dtcm_data_section
+#define CEREBRI_HOT_STACK_DEFINE(sym, size)                                                        \
+	Z_THREAD_STACK_DEFINE_IN(sym, size, __dtcm_noinit_section)
+#else
+#define CEREBRI_HOT_CONTEXT
+#define CEREBRI_HOT_STACK_DEFINE(sym, size) K_THREAD_STACK_DEFINE(sym, size)
+#endif
+
+#endif // CEREBRI_CORE_PLACEMENT_H
+// vi: ts=4 sw=4 et
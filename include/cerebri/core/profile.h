@@ -0,0 +1,69 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_PROFILE_H
+#define CEREBRI_CORE_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Statistical pc sampling profiler.
+ *
+ * A DWT comparator on the cycle counter raises the debug monitor
+ * exception at a fixed rate, the handler takes the interrupted pc from
+ * the exception frame and counts it in a fixed size table, rounded down
+ * to a granule of 2^CONFIG_CEREBRI_CORE_COMMON_PROFILE_GRANULE_BITS bytes.
+ * Bit 0 of an entry pc is set when the sample hit an interrupt handler.
+ * The table holds cumulative counts since the last reset, readers copy
+ * it out whole and scripts/profile_report.py maps the addresses to
+ * functions of zephyr.elf. Nothing is sampled while a halting debugger
+ * is attached, the core then never takes the debug monitor exception.
+ */
+
+struct profile_entry {
+	uint32_t pc;
+	uint32_t count;
+};
+
+/* header of every profile datagram or dump */
+struct profile_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entry_size;
+	// bumped by every reset, counts of different windows do not add up
+	uint32_t window;
+	uint32_t rate_hz;
+	uint32_t samples;
+	// samples that found the table full
+	uint32_t dropped;
+	uint16_t granule_bits;
+	uint16_t datagram;
+};
+
+#define PROFILE_MAGIC   0x46525043 // "CPRF"
+#define PROFILE_VERSION 1
+
+#define PROFILE_PC_HANDLER 0x1U
+
+int profile_start(uint32_t rate_hz);
+
+void profile_stop(void);
+
+bool profile_running(void);
+
+/* clears the table and starts a new window, sampling continues */
+void profile_reset(void);
+
+/*
+ * copies up to n entries of the table from *pos on and moves *pos past
+ * them, returns the number copied, 0 once the whole table was read
+ */
+size_t profile_read(size_t *pos, struct profile_entry *buf, size_t n);
+
+void profile_header_init(struct profile_header *header);
+
+#endif // CEREBRI_CORE_PROFILE_H
+// vi: ts=4 sw=4 et
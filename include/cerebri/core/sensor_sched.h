@@ -0,0 +1,79 @@
+#ifndef CEREBRI_CORE_SENSOR_SCHED_H
+#define CEREBRI_CORE_SENSOR_SCHED_H
+
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/rtio/rtio.h>
+
+/*
+ * Bus-aware scheduler for the low rate sensors.
+ *
+ * A timer releases one slot every CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED_SLOT_US,
+ * offset by ..._PHASE_US so slots fall between imu ticks. Each slot submits
+ * async reads for the clients due in it. Clients sharing a bus controller are
+ * chained so their transactions run back to back rather than collide. A client's
+ * phase is the least loaded slot of its period, which staggers sensors with the
+ * same rate. The done callback of a client runs on the scheduler thread when its
+ * read completes, buf holds the encoded sample for the sensor decoder and is
+ * released once done returns.
+ */
+
+#define SENSOR_SCHED_SLOT_US CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED_SLOT_US
+
+struct sensor_sched_client;
+
+typedef void (*sensor_sched_done_t)(struct sensor_sched_client *client, int result,
+				    const uint8_t *buf, uint32_t len);
+
+struct sensor_sched_client {
+	sys_snode_t node;
+	const char *name;
+	struct rtio_iodev *iodev;
+	const struct device *sensor;
+	// devices with the same bus are chained, NULL for none
+	const struct device *bus;
+	uint32_t period_ms;
+	sensor_sched_done_t done;
+	void *user_data;
+	uint32_t period_slots;
+	uint32_t phase_slots;
+	atomic_t busy;
+	uint32_t reads;
+	uint32_t errors;
+	uint32_t overruns;
+};
+
+// bus controller of an i2c or spi sensor node, NULL for other sensors
+#define SENSOR_SCHED_BUS(_node_id)                                                                 \
+	COND_CODE_1(DT_ON_BUS(_node_id, i2c), (DEVICE_DT_GET(DT_BUS(_node_id))),                   \
+		    (COND_CODE_1(DT_ON_BUS(_node_id, spi), (DEVICE_DT_GET(DT_BUS(_node_id))),      \
+				 (NULL))))
+
+/*
+ * Define a client reading the channel specs in ... of a devicetree node, e.g.
+ * SENSOR_SCHED_CLIENT_DEFINE(mag0, DT_ALIAS(mag0), 20, mag_done, ctx, {SENSOR_CHAN_MAGN_XYZ, 0})
+ */
+#define SENSOR_SCHED_CLIENT_DEFINE(_name, _node_id, _period_ms, _done, _user_data, ...)            \
+	SENSOR_DT_READ_IODEV(_name##_iodev, _node_id, __VA_ARGS__);                                \
+	static struct sensor_sched_client _name = {                                                \
+		.name = DEVICE_DT_NAME(_node_id),                                                  \
+		.iodev = &_name##_iodev,                                                           \
+		.sensor = DEVICE_DT_GET(_node_id),                                                 \
+		.bus = SENSOR_SCHED_BUS(_node_id),                                                 \
+		.period_ms = _period_ms,                                                           \
+		.done = _done,                                                                     \
+		.user_data = _user_data,                                                           \
+	}
+
+int sensor_sched_add(struct sensor_sched_client *client);
+
+/*
+ * decode the first frame of chan from a completed read into count values in
+ * SI units, count 3 for the _XYZ channels and 1 otherwise, returns 0 or -errno
+ */
+int sensor_sched_decode(const struct sensor_sched_client *client, const uint8_t *buf,
+			enum sensor_channel chan, double *values, int count);
+
+// vi: ts=4 sw=4 et
+
+#endif // CEREBRI_CORE_SENSOR_SCHED_H
@@ -0,0 +1,57 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_CORE_STATE_HISTORY_H
+#define CEREBRI_CORE_STATE_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Fixed length ring of past estimator steps, each a caller defined entry
+ * stamped with the time it was taken. Entries are pushed in time order,
+ * the oldest is overwritten once the ring is full. A late measurement
+ * finds the step it belongs to with state_history_find, and the steps
+ * after it are replayed from age - 1 down to 0, the newest.
+ */
+struct state_history {
+	uint8_t *entries;
+	int64_t *stamp_ns;
+	size_t entry_size;
+	uint32_t length;
+	// slot the next push writes
+	uint32_t head;
+	uint32_t count;
+};
+
+#define STATE_HISTORY_DEFINE(name, entry_type, len)                                                \
+	static entry_type name##_entries[len];                                                     \
+	static int64_t name##_stamp_ns[len];                                                       \
+	static struct state_history name = {.entries = (uint8_t *)name##_entries,                 \
+					    .stamp_ns = name##_stamp_ns,                           \
+					    .entry_size = sizeof(entry_type),                      \
+					    .length = len,                                         \
+					    .head = 0,                                             \
+					    .count = 0}
+
+void state_history_reset(struct state_history *history);
+
+// slot of a new newest entry stamped stamp_ns, for the caller to fill
+void *state_history_push(struct state_history *history, int64_t stamp_ns);
+
+// entry by age, 0 is the newest, NULL past the oldest
+void *state_history_get(const struct state_history *history, uint32_t age);
+
+int64_t state_history_stamp(const struct state_history *history, uint32_t age);
+
+/*
+ * age of the newest entry stamped at or before stamp_ns, -ENOENT when the
+ * history is empty or every entry is newer, the measurement is too late
+ * for the length of the history
+ */
+int state_history_find(const struct state_history *history, int64_t stamp_ns);
+
+#endif // CEREBRI_CORE_STATE_HISTORY_H
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,105 @@
+#ifndef CEREBRI_CORE_TRACE_H
+#define CEREBRI_CORE_TRACE_H
+
+#include <zephyr/kernel.h>
+
+/*
+ * Binary hot path event tracer.
+ *
+ * Events are 12 bytes, stamped with k_cycle_get_32() and written into a
+ * per-cpu ring without locks: a writer reserves a slot with an atomic
+ * increment and commits it by publishing the slot sequence number. Any
+ * number of readers can drain the rings concurrently, each with its own
+ * cursor, so the sd card logger and ethernet stream see the same events.
+ * When a reader falls behind, the oldest events are overwritten and
+ * counted as dropped by that reader.
+ */
+
+enum trace_event_type {
+	TRACE_EVENT_NONE = 0,
+	// arg: 4 characters of the name registered for id, little endian
+	TRACE_EVENT_NAME = 1,
+	TRACE_EVENT_NODE_WAKE = 2,
+	// arg: k_poll return code
+	TRACE_EVENT_POLL_RETURN = 3,
+	TRACE_EVENT_PUBLISH = 4,
+	TRACE_EVENT_CASADI_START = 5,
+	TRACE_EVENT_CASADI_STOP = 6,
+	TRACE_EVENT_ACTUATOR_WRITE = 7,
+	// arg: cpu share of the thread registered as id, 1/1000
+	TRACE_EVENT_THREAD_CPU = 8,
+	// arg: unused stack bytes of the thread registered as id
+	TRACE_EVENT_THREAD_STACK = 9,
+	TRACE_EVENT_USER = 128,
+};
+
+struct trace_event {
+	uint32_t cyc;
+	uint32_t arg;
+	uint16_t id;
+	uint8_t type;
+	uint8_t cpu;
+};
+
+/* header written once at the start of a trace file or stream */
+struct trace_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t event_size;
+	uint32_t cyc_per_sec;
+	uint32_t num_cpus;
+};
+
+#define TRACE_MAGIC   0x43525443 // "CTRC"
+#define TRACE_VERSION 1
+
+struct trace_reader {
+	uint32_t tail[CONFIG_MP_MAX_NUM_CPUS];
+	uint32_t dropped;
+};
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_TRACE)
+
+void trace_record(uint8_t type, uint16_t id, uint32_t arg);
+
+/* returns a stable id for name (ids start at 1), name must be static */
+uint16_t trace_register(const char *name);
+
+const char *trace_name(uint16_t id);
+
+void trace_reader_init(struct trace_reader *reader);
+
+/* copies up to n committed events, returns the number copied */
+size_t trace_read(struct trace_reader *reader, struct trace_event *buf, size_t n);
+
+void trace_header_init(struct trace_header *header);
+
+/* fills name events for every registered id, for late joining stream readers */
+size_t trace_name_events(struct trace_event *buf, size_t n);
+
+#define CEREBRI_TRACE(type, id, arg) trace_record(type, id, arg)
+
+#define CEREBRI_TRACE_NAMED(type, name, arg)                                                       \
+	do {                                                                                       \
+		static uint16_t trace_id_;                                                         \
+		if (trace_id_ == 0) {                                                              \
+			trace_id_ = trace_register(name);                                          \
+		}                                                                                  \
+		trace_record(type, trace_id_, (uint32_t)(arg));                                    \
+	} while (0)
+
+#else
+
+#define CEREBRI_TRACE(type, id, arg)                                                               \
+	do {                                                                                       \
+	} while (0)
+
+#define CEREBRI_TRACE_NAMED(type, name, arg)                                                       \
+	do {                                                                                       \
+	} while (0)
+
+#endif
+
+// vi: ts=4 sw=4 et
+
+#endif // CEREBRI_CORE_TRACE_H
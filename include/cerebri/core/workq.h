@@ -0,0 +1,68 @@
+#ifndef CEREBRI_CORE_WORKQ_H
+#define CEREBRI_CORE_WORKQ_H
+
+#include <zephyr/kernel.h>
+
+#include <cerebri/core/perf_duration.h>
+
+/*
+ * Work item for the core work queues. With
+ * CONFIG_CEREBRI_CORE_WORKQUEUES_STATS the time from workq_submit until
+ * the handler starts and the handler run time are kept as the
+ * perf_durations "<name>_delay" and "<name>_run", both checked against
+ * the item deadline. Handlers get &item->work as before, so contexts find
+ * themselves with CONTAINER_OF(work, context_t, work_item.work).
+ */
+
+struct workq_item {
+	struct k_work work;
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_STATS)
+	k_work_handler_t handler;
+	sys_snode_t node;
+	const char *name;
+	const char *delay_name;
+	const char *run_name;
+	uint32_t deadline_us;
+	struct k_work_q *queue;
+	bool registered;
+	struct perf_duration delay;
+	struct perf_duration run;
+#endif
+};
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_STATS)
+
+void workq_item_handler(struct k_work *work);
+
+#define WORKQ_ITEM_INITIALIZER(work_handler, item_name, deadline)                                  \
+	{                                                                                          \
+		.work = Z_WORK_INITIALIZER(workq_item_handler),                                    \
+		.handler = work_handler,                                                           \
+		.name = item_name,                                                                 \
+		.delay_name = item_name "_delay",                                                  \
+		.run_name = item_name "_run",                                                      \
+		.deadline_us = deadline,                                                           \
+		.queue = NULL,                                                                     \
+		.registered = false,                                                               \
+	}
+
+// same return values as k_work_submit_to_queue, callable from isr
+int workq_submit(struct k_work_q *queue, struct workq_item *item);
+
+#else
+
+#define WORKQ_ITEM_INITIALIZER(work_handler, item_name, deadline)                                  \
+	{                                                                                          \
+		.work = Z_WORK_INITIALIZER(work_handler),                                          \
+	}
+
+static inline int workq_submit(struct k_work_q *queue, struct workq_item *item)
+{
+	return k_work_submit_to_queue(queue, &item->work);
+}
+
+#endif
+
+// vi: ts=4 sw=4 et
+
+#endif // CEREBRI_CORE_WORKQ_H
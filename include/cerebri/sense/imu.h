@@ -0,0 +1,15 @@
+#ifndef CEREBRI_SENSE_IMU_H
+#define CEREBRI_SENSE_IMU_H
+
+#include <stdbool.h>
+
+/*
+ * True if the calibration sense_imu publishes with was loaded from
+ * settings. The calibration run at boot levels the accel, so only a
+ * stored one gives the gravity direction needed for a full attitude
+ * initialization. Valid once topic_imu is published.
+ */
+bool sense_imu_calibration_stored(void);
+
+#endif // CEREBRI_SENSE_IMU_H
+// vi: ts=4 sw=4 et
@@ -0,0 +1,78 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CEREBRI_SENSE_WHEEL_LOOP_H
+#define CEREBRI_SENSE_WHEEL_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zros/private/zros_sub_struct.h>
+#include <zros/zros_node.h>
+
+#include <synapse_topic_list.h>
+
+/*
+ * Wheel rate loop of the ground vehicle velocity nodes. The node waits
+ * on the wheel odometry event, or on wheel_velocity with encoder
+ * capture, takes it with wheel_loop_update and adds the PI correction
+ * of wheel_loop_correction to its feedforward wheel rate. The loop is
+ * open while the measurement is older than
+ * CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_LOOP_TIMEOUT_MS.
+ */
+
+#define WHEEL_LOOP_TIMEOUT_MS CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_LOOP_TIMEOUT_MS
+
+// wheel rate PI, the integral is limited to i_max in rad/s
+struct wheel_loop_gains {
+	double kp;
+	double ki;
+	double i_max;
+};
+
+#define WHEEL_LOOP_GAINS_DEFAULT                                                                   \
+	{                                                                                          \
+		.kp = CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_LOOP_GAIN_P / 1000.0,                    \
+		.ki = CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_LOOP_GAIN_I / 1000.0,                    \
+		.i_max = CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_LOOP_INTEGRAL_MAX_MRAD_S / 1000.0,    \
+	}
+
+struct wheel_loop {
+#if defined(CONFIG_CEREBRI_SENSE_WHEEL_ODOMETRY_CAPTURE)
+	struct synapse_wheel_velocity wheel;
+#else
+	synapse_pb_WheelOdometry wheel;
+	int64_t stamp_ns;
+	double rotation;
+#endif
+	struct zros_sub sub;
+	// measured wheel rate, closed while it is fresh
+	bool closed;
+	double omega;
+	double dt;
+	int64_t last_ns;
+	double integral;
+};
+
+void wheel_loop_init(struct wheel_loop *loop, struct zros_node *node);
+
+void wheel_loop_fini(struct wheel_loop *loop);
+
+/*
+ * waits up to the timeout for a wheel message and takes it, false and
+ * the loop open if there is no rate or interval to close it on
+ */
+bool wheel_loop_update(struct wheel_loop *loop);
+
+// PI correction of the feedforward wheel rate, reset while the loop is open
+double wheel_loop_correction(struct wheel_loop *loop, const struct wheel_loop_gains *gains,
+			     double omega_sp, bool closed);
+
+static inline void wheel_loop_reset(struct wheel_loop *loop)
+{
+	loop->integral = 0;
+}
+
+#endif // CEREBRI_SENSE_WHEEL_LOOP_H
+// vi: ts=4 sw=4 et
@@ -38,10 +38,35 @@ extern "C" {
 void nxp_flexio_dshot_data_set(const struct device *dev, unsigned channel, uint16_t throttle,
 			       bool telemetry);
 
+/**
+ * @brief Set the throttle of the first count channels at once, without telemetry requests.
+ *
+ * Same frames as nxp_flexio_dshot_data_set on each channel, with the
+ * shifter interrupts and timer flags handled once for all of them.
+ */
+void nxp_flexio_dshot_frames_set(const struct device *dev, const uint16_t *throttle,
+				 unsigned count);
+
 void nxp_flexio_dshot_trigger(const struct device *dev);
 
 uint8_t nxp_flexio_dshot_channel_count(const struct device *dev);
 
+/**
+ * @brief Decode the bidirectional dshot replies received since the last trigger.
+ *
+ * Does not wait for replies still in flight, call it before the next trigger.
+ *
+ * @return 1 if any channel gave a valid reply, 0 otherwise.
+ */
+int up_bdshot_decode_erpm(const struct device *dev);
+
+/**
+ * @brief eRPM / 100 of a channel from the last decode.
+ *
+ * @return 0 on success, -1 if the channel gave no valid reply.
+ */
+int up_bdshot_get_erpm(const struct device *dev, uint8_t channel, int *erpm);
+
 /**
  * @}
  */
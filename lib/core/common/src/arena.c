@@ -0,0 +1,148 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#include <cerebri/core/arena.h>
+
+// each block is preceded by its size, so a moved block knows what to copy
+struct block {
+	size_t size;
+} __aligned(ARENA_ALIGN);
+
+static struct block *block_of(void *ptr)
+{
+	return (struct block *)ptr - 1;
+}
+
+static size_t block_offset(const struct arena *arena, const struct block *block)
+{
+	return (const uint8_t *)block - arena->buf;
+}
+
+void arena_init(struct arena *arena, void *buf, size_t size)
+{
+	arena->buf = buf;
+	arena->size = size;
+	arena->high_water = 0;
+	arena->failures = 0;
+	arena_reset(arena);
+}
+
+void arena_reset(struct arena *arena)
+{
+	arena->used = 0;
+	arena->last = SIZE_MAX;
+}
+
+// grow or shrink the block at offset to size, false if it does not fit
+static bool block_fit(struct arena *arena, size_t offset, size_t size)
+{
+	size_t end = offset + sizeof(struct block) + ROUND_UP(size, ARENA_ALIGN);
+	if (end > arena->size || end < offset) {
+		arena->failures++;
+		return false;
+	}
+	arena->used = end;
+	arena->high_water = MAX(arena->high_water, end);
+	return true;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	size_t offset = arena->used;
+	if (!block_fit(arena, offset, size)) {
+		return NULL;
+	}
+	struct block *block = (struct block *)(arena->buf + offset);
+	block->size = size;
+	arena->last = offset;
+	return block + 1;
+}
+
+void *arena_realloc(struct arena *arena, void *ptr, size_t size)
+{
+	if (ptr == NULL) {
+		return arena_alloc(arena, size);
+	}
+
+	struct block *block = block_of(ptr);
+	size_t offset = block_offset(arena, block);
+	if (offset == arena->last) {
+		if (!block_fit(arena, offset, size)) {
+			return NULL;
+		}
+		block->size = size;
+		return ptr;
+	}
+
+	void *moved = arena_alloc(arena, size);
+	if (moved != NULL) {
+		memcpy(moved, ptr, MIN(block->size, size));
+	}
+	return moved;
+}
+
+void arena_free(struct arena *arena, void *ptr)
+{
+	if (ptr == NULL) {
+		return;
+	}
+	size_t offset = block_offset(arena, block_of(ptr));
+	if (offset == arena->last) {
+		// the block before it is not known, so it can not grow in place any more
+		arena->used = offset;
+		arena->last = SIZE_MAX;
+	}
+}
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PB_ARENA)
+
+#include <cerebri/core/pb_arena.h>
+
+static K_MUTEX_DEFINE(g_pb_lock);
+
+// the arena of the thread inside arena_pb_decode
+static struct arena *g_pb_arena;
+static k_tid_t g_pb_thread;
+
+static struct arena *pb_arena_current(void)
+{
+	return g_pb_thread == k_current_get() ? g_pb_arena : NULL;
+}
+
+void *arena_pb_realloc(void *ptr, size_t size)
+{
+	struct arena *arena = pb_arena_current();
+	return arena != NULL ? arena_realloc(arena, ptr, size) : NULL;
+}
+
+void arena_pb_free(void *ptr)
+{
+	struct arena *arena = pb_arena_current();
+	if (arena != NULL) {
+		arena_free(arena, ptr);
+	}
+}
+
+bool arena_pb_decode(struct arena *arena, pb_istream_t *stream, const pb_msgdesc_t *fields,
+		     void *msg)
+{
+	k_mutex_lock(&g_pb_lock, K_FOREVER);
+	arena_reset(arena);
+	g_pb_arena = arena;
+	g_pb_thread = k_current_get();
+	bool decoded = pb_decode(stream, fields, msg);
+	g_pb_thread = NULL;
+	g_pb_arena = NULL;
+	k_mutex_unlock(&g_pb_lock);
+	return decoded;
+}
+
+#endif
+
+// vi: ts=4 sw=4 et
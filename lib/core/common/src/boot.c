@@ -0,0 +1,116 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+
+#include <cerebri/core/boot.h>
+
+static K_EVENT_DEFINE(g_ready);
+
+#define BOOT_READY_NAME(name) "ready " #name,
+static const char *const g_ready_names[] = {BOOT_READY_LIST(BOOT_READY_NAME)};
+
+void boot_ready_set(enum boot_ready_signal signal)
+{
+	if (signal >= BOOT_READY_COUNT) {
+		return;
+	}
+	uint32_t bit = BIT(signal);
+	if (k_event_test(&g_ready, bit) != 0) {
+		return;
+	}
+	k_event_post(&g_ready, bit);
+	boot_mark(g_ready_names[signal]);
+}
+
+int boot_ready_wait(uint32_t mask, k_timeout_t timeout)
+{
+	if (mask == 0) {
+		return 0;
+	}
+	return k_event_wait_all(&g_ready, mask, false, timeout) != 0 ? 0 : -EAGAIN;
+}
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_BOOT_PROFILE)
+
+#define STAGES CONFIG_CEREBRI_CORE_COMMON_BOOT_PROFILE_STAGES
+
+struct boot_stage {
+	const char *name;
+	uint32_t us;
+};
+
+static struct boot_stage g_stages[STAGES];
+static atomic_t g_stage_count;
+
+static uint32_t boot_uptime_us(void)
+{
+#if defined(CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER)
+	return k_cyc_to_us_floor64(k_cycle_get_64());
+#else
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+#endif
+}
+
+void boot_mark(const char *name)
+{
+	uint32_t us = boot_uptime_us();
+	atomic_val_t i = atomic_inc(&g_stage_count);
+	if (i >= STAGES) {
+		return;
+	}
+	g_stages[i].us = us;
+	g_stages[i].name = name;
+}
+
+#define BOOT_LEVEL_MARK(_level, _prio, _name)                                                      \
+	static int boot_mark_##_level##_##_prio(void)                                              \
+	{                                                                                          \
+		boot_mark(_name);                                                                  \
+		return 0;                                                                          \
+	}                                                                                          \
+	SYS_INIT(boot_mark_##_level##_##_prio, _level, _prio)
+
+BOOT_LEVEL_MARK(POST_KERNEL, 0, "post kernel");
+BOOT_LEVEL_MARK(APPLICATION, 0, "application");
+BOOT_LEVEL_MARK(APPLICATION, 99, "application done");
+
+static int cmd_boot(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	size_t count = MIN((size_t)atomic_get(&g_stage_count), STAGES);
+	uint32_t last_us = 0;
+
+	shell_print(sh, "%10s %10s  %s", "ms", "delta ms", "stage");
+	for (size_t i = 0; i < count; i++) {
+		const struct boot_stage *stage = &g_stages[i];
+		if (stage->name == NULL) {
+			continue;
+		}
+		shell_print(sh, "%10.3f %10.3f  %s", stage->us / 1e3, (stage->us - last_us) / 1e3,
+			    stage->name);
+		last_us = stage->us;
+	}
+	if (atomic_get(&g_stage_count) > STAGES) {
+		shell_print(sh, "%ld stages dropped", (long)(atomic_get(&g_stage_count) - STAGES));
+	}
+	for (int i = 0; i < BOOT_READY_COUNT; i++) {
+		if (!boot_ready_all(BIT(i))) {
+			shell_print(sh, "%10s %10s  %s", "-", "-", g_ready_names[i]);
+		}
+	}
+	return 0;
+}
+
+SHELL_CMD_REGISTER(boot, NULL, "Boot profile and readiness", cmd_boot);
+
+#endif
+
+// vi: ts=4 sw=4 et
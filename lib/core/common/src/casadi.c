@@ -0,0 +1,89 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include <cerebri/core/casadi.h>
+
+static sys_slist_t g_casadi_func_list = {.head = NULL, .tail = NULL};
+static struct k_spinlock g_casadi_func_lock;
+
+// a call site is listed from its first call, so it needs no init of its own
+static void casadi_func_register(struct casadi_func *func)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_casadi_func_lock);
+	if (!func->registered) {
+		func->registered = true;
+		func->last_cyc = 0;
+		// generated functions have no deadline of their own, misses are against 1 ms
+		perf_duration_init(&func->perf, func->name, 1e-3);
+		sys_slist_append(&g_casadi_func_list, &func->node);
+	}
+	k_spin_unlock(&g_casadi_func_lock, key);
+}
+
+void casadi_func_start(struct casadi_func *func)
+{
+	if (func == NULL) {
+		return;
+	}
+	if (!func->registered) {
+		casadi_func_register(func);
+	}
+	func->start_cyc = k_cycle_get_32();
+	perf_duration_start(&func->perf);
+}
+
+void casadi_func_stop(struct casadi_func *func)
+{
+	if (func == NULL) {
+		return;
+	}
+	perf_duration_stop(&func->perf);
+	func->last_cyc = k_cycle_get_32() - func->start_cyc;
+}
+
+static int shell_casadi_list(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	struct casadi_func *func;
+
+	shell_print(sh, "%-32s %-28s %10s %10s %10s %10s", "function", "caller", "last cyc",
+		    "max cyc", "mean cyc", "count");
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_casadi_func_list, func, node) {
+		uint64_t count = func->perf.count;
+		shell_print(sh, "%-32s %-28s %10u %10u %10u %10llu", func->name, func->caller,
+			    func->last_cyc, func->perf.max_duration_cyc,
+			    count > 0 ? (uint32_t)(func->perf.delta_cyc_sum / count) : 0,
+			    (unsigned long long)count);
+	}
+	return 0;
+}
+
+static int shell_casadi_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	struct casadi_func *func;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_casadi_func_list, func, node) {
+		perf_duration_reset(&func->perf);
+		func->last_cyc = 0;
+	}
+	shell_print(sh, "casadi function timing reset");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_casadi,
+			       SHELL_CMD(list, NULL, "Functions called, with their cycles.",
+					 shell_casadi_list),
+			       SHELL_CMD(reset, NULL, "Reset function timing.", shell_casadi_reset),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(casadi, &sub_casadi, "casadi generated functions", NULL);
+
+// vi: ts=4 sw=4 et
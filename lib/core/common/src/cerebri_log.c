@@ -9,6 +9,9 @@
 #include <zephyr/logging/log_ctrl.h>
 #include <zephyr/logging/log_backend.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <cerebri/core/log_utils.h>
 
 #ifndef CONFIG_LOG_DOMAIN_ID
 #define CONFIG_LOG_DOMAIN_ID 0
@@ -76,3 +79,60 @@ static int cerebri_log_sys_init(void)
 
 /* Run late in boot, after logging backends have started */
 SYS_INIT(cerebri_log_sys_init, APPLICATION, 99);
+
+static sys_slist_t g_log_limit_list = {.head = NULL, .tail = NULL};
+static struct k_spinlock g_log_limit_lock;
+
+/* A call site is listed from its first call, like a casadi call site */
+bool cerebri_log_limit_emit(struct cerebri_log_limit *site, uint32_t period_ms,
+			    uint32_t *suppressed)
+{
+	if (!site->registered) {
+		k_spinlock_key_t key = k_spin_lock(&g_log_limit_lock);
+		sys_slist_append(&g_log_limit_list, &site->node);
+		site->registered = true;
+		k_spin_unlock(&g_log_limit_lock, key);
+	}
+	site->next_tick = k_uptime_ticks() + k_ms_to_ticks_ceil64(period_ms);
+	*suppressed = site->pending;
+	site->pending = 0;
+	return true;
+}
+
+static int shell_log_limit_list(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	struct cerebri_log_limit *site;
+
+	shell_print(sh, "%-40s %6s %10s %10s %10s", "function", "line", "hits", "dropped",
+		    "pending");
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_log_limit_list, site, node) {
+		shell_print(sh, "%-40s %6d %10u %10u %10u", site->func, site->line, site->hits,
+			    site->dropped, site->pending);
+	}
+	return 0;
+}
+
+static int shell_log_limit_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	struct cerebri_log_limit *site;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_log_limit_list, site, node) {
+		site->hits = 0;
+		site->dropped = 0;
+	}
+	shell_print(sh, "log limit counts reset");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_log_limit,
+			       SHELL_CMD(list, NULL, "Rate limited log call sites and their drops.",
+					 shell_log_limit_list),
+			       SHELL_CMD(reset, NULL, "Reset hit and drop counts.",
+					 shell_log_limit_reset),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(log_limit, &sub_log_limit, "rate limited log call sites", NULL);
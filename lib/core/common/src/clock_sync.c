@@ -0,0 +1,137 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cerebri/core/clock_sync.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/time_units.h>
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_PTP)
+#include <zephyr/drivers/ptp_clock.h>
+#include <zephyr/net/ethernet.h>
+#include <zephyr/net/gptp.h>
+#include <zephyr/net/net_if.h>
+
+#define NSEC_PER_SEC   1000000000LL
+#define UTC_OFFSET_NS  (CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_PTP_UTC_OFFSET_S * NSEC_PER_SEC)
+#define REFRESH_PERIOD K_MSEC(100)
+#endif
+
+LOG_MODULE_DECLARE(core_common);
+
+static struct {
+	struct k_spinlock lock;
+	// ground clock minus uptime
+	int64_t ground_offset_ns;
+	// ptp clock minus uptime, refreshed while locked
+	int64_t ptp_offset_ns;
+	bool locked;
+#if defined(CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_PTP)
+	const struct device *ptp_clock;
+	struct k_work_delayable refresh_work;
+#endif
+} g_clock_sync;
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_PTP)
+static int ptp_now_ns(int64_t *ns)
+{
+	struct net_ptp_time tm;
+	int ret = ptp_clock_get(g_clock_sync.ptp_clock, &tm);
+	if (ret < 0) {
+		return ret;
+	}
+	*ns = (int64_t)tm.second * NSEC_PER_SEC + tm.nanosecond - UTC_OFFSET_NS;
+	return 0;
+}
+
+// the ptp clock drifts from uptime by the crystal error only, so a 100 ms refresh is enough
+static void clock_sync_refresh(struct k_work *work)
+{
+	struct net_ptp_time gm_time;
+	bool gm_present = false;
+	int64_t ptp_ns = 0;
+
+	gptp_event_capture(&gm_time, &gm_present);
+	int64_t ticks = k_uptime_ticks();
+	bool locked = gm_present && ptp_now_ns(&ptp_ns) == 0;
+
+	k_spinlock_key_t key = k_spin_lock(&g_clock_sync.lock);
+	if (locked != g_clock_sync.locked) {
+		LOG_INF("ptp %s", locked ? "locked" : "lost");
+	}
+	g_clock_sync.locked = locked;
+	if (locked) {
+		g_clock_sync.ptp_offset_ns = ptp_ns - k_ticks_to_ns_floor64(ticks);
+	}
+	k_spin_unlock(&g_clock_sync.lock, key);
+
+	k_work_reschedule(k_work_delayable_from_work(work), REFRESH_PERIOD);
+}
+#endif
+
+int64_t clock_sync_now_ns(void)
+{
+#if defined(CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_PTP)
+	int64_t ns;
+	if (clock_sync_locked() && ptp_now_ns(&ns) == 0) {
+		return ns;
+	}
+#endif
+	return clock_sync_ticks_to_ns(k_uptime_ticks());
+}
+
+int64_t clock_sync_ticks_to_ns(int64_t ticks)
+{
+	return clock_sync_uptime_ns_to_ns(k_ticks_to_ns_floor64(ticks));
+}
+
+int64_t clock_sync_uptime_ns_to_ns(int64_t uptime_ns)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_clock_sync.lock);
+	int64_t offset_ns =
+		g_clock_sync.locked ? g_clock_sync.ptp_offset_ns : g_clock_sync.ground_offset_ns;
+	k_spin_unlock(&g_clock_sync.lock, key);
+	return uptime_ns + offset_ns;
+}
+
+void clock_sync_set_offset_ns(int64_t offset_ns)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_clock_sync.lock);
+	g_clock_sync.ground_offset_ns = offset_ns;
+	k_spin_unlock(&g_clock_sync.lock, key);
+}
+
+bool clock_sync_locked(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_clock_sync.lock);
+	bool locked = g_clock_sync.locked;
+	k_spin_unlock(&g_clock_sync.lock, key);
+	return locked;
+}
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_CLOCK_SYNC_PTP)
+static int clock_sync_init(void)
+{
+	struct net_if *iface = net_if_get_default();
+	if (iface == NULL) {
+		LOG_ERR("no network interface for ptp");
+		return -ENODEV;
+	}
+	g_clock_sync.ptp_clock = net_eth_get_ptp_clock(iface);
+	if (g_clock_sync.ptp_clock == NULL) {
+		LOG_ERR("no ptp clock on %d", net_if_get_by_iface(iface));
+		return -ENODEV;
+	}
+	k_work_init_delayable(&g_clock_sync.refresh_work, clock_sync_refresh);
+	k_work_schedule(&g_clock_sync.refresh_work, REFRESH_PERIOD);
+	return 0;
+}
+
+SYS_INIT(clock_sync_init, APPLICATION, 0);
+#endif
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,99 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdio.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <cerebri/core/fsm.h>
+
+LOG_MODULE_REGISTER(core_fsm, CONFIG_CEREBRI_CORE_COMMON_LOG_LEVEL);
+
+static const char *fsm_guard_held(const struct fsm *fsm, const struct fsm_transition *t,
+				  uint32_t inputs)
+{
+	for (int i = 0; i < FSM_GUARDS_MAX && t->guards[i].label != NULL; i++) {
+		const struct fsm_guard *g = &t->guards[i];
+		if ((inputs & g->inputs) != 0) {
+			return g->label;
+		}
+		if (g->state >= 0 && *(const uint8_t *)fsm->states[g->state] == g->value) {
+			return g->label;
+		}
+	}
+	return NULL;
+}
+
+void fsm_reset(struct fsm *fsm)
+{
+	fsm->walked = false;
+}
+
+bool fsm_update(struct fsm *fsm, uint32_t inputs, char *msg, size_t msg_size, int *request_seq,
+		bool *request_rejected)
+{
+	if (fsm->walked && inputs == fsm->inputs) {
+		fsm->skips++;
+		return false;
+	}
+
+	if (fsm->request_mask == 0) {
+		for (size_t i = 0; i < fsm->table_size; i++) {
+			fsm->request_mask |= fsm->table[i].request;
+		}
+	}
+
+	fsm->inputs = inputs;
+	fsm->walked = true;
+	fsm->walks++;
+
+	uint32_t requests = inputs & fsm->request_mask;
+	if (requests == 0) {
+		return true;
+	}
+
+	uint32_t start = k_cycle_get_32();
+	for (size_t i = 0; i < fsm->table_size; i++) {
+		const struct fsm_transition *t = &fsm->table[i];
+
+		// not requested
+		if ((requests & t->request) == 0) {
+			continue;
+		}
+
+		// state enums fit in a byte, as the status message sets them
+		uint8_t *state = (uint8_t *)fsm->states[t->state];
+
+		// null transition
+		if (*state == t->post) {
+			continue;
+		}
+
+		// pre state required and not matched
+		if (t->pre >= 0 && *state != t->pre) {
+			continue;
+		}
+
+		// new valid request
+		(*request_seq)++;
+
+		const char *guard = fsm_guard_held(fsm, t, inputs);
+		if (guard != NULL) {
+			snprintf(msg, msg_size, "deny %s: %s", t->label, guard);
+			LOG_WRN("%s", msg);
+			*request_rejected = true;
+			continue;
+		}
+
+		snprintf(msg, msg_size, "accept %s", t->label);
+		LOG_INF("%s", msg);
+		*state = t->post;
+		*request_rejected = false;
+	}
+	fsm->max_walk_cyc = MAX(fsm->max_walk_cyc, k_cycle_get_32() - start);
+	return true;
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,58 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+
+#include <zephyr/sys/util.h>
+
+#include <cerebri/core/lighting.h>
+
+static const double pi = 3.14159;
+static const double led_pulse_freq = 0.25;
+static const double brightness_min = 4;
+static const double brightness_max = 30;
+
+int lighting_pulse_brightness(double t, int64_t *wait_ms)
+{
+	const double amplitude = (brightness_max - brightness_min) / 2;
+	const double mean = (brightness_max + brightness_min) / 2;
+	const double omega = 2 * pi * led_pulse_freq;
+	double phase = fmod(omega * t, 2 * pi);
+	int brightness = mean + amplitude * sin(phase);
+
+	// falls below brightness or rises to brightness + 1, whichever comes first
+	double wait = 2 * pi;
+	for (int level = brightness; level <= brightness + 1; level++) {
+		double r = (level - mean) / amplitude;
+		if (r < -1 || r > 1) {
+			continue;
+		}
+		double crossings[] = {asin(r), pi - asin(r)};
+		for (size_t i = 0; i < ARRAY_SIZE(crossings); i++) {
+			double d = fmod(crossings[i] - phase + 4 * pi, 2 * pi);
+			if (d > 1e-6 && d < wait) {
+				wait = d;
+			}
+		}
+	}
+	*wait_ms = (int64_t)(wait / omega * 1000) + 1;
+	return brightness;
+}
+
+bool lighting_led_changed(struct lighting_led *last, size_t n, uint32_t index, int32_t r,
+			  int32_t g, int32_t b)
+{
+	if (index >= n) {
+		return true;
+	}
+	struct lighting_led *led = &last[index];
+	if (led->valid && led->r == r && led->g == g && led->b == b) {
+		return false;
+	}
+	*led = (struct lighting_led){.r = r, .g = g, .b = b, .valid = true};
+	return true;
+}
+
+// vi: ts=4 sw=4 et
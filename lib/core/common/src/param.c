@@ -0,0 +1,380 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PARAM_STORE)
+#include <zephyr/settings/settings.h>
+#endif
+
+#include <cerebri/core/param.h>
+
+LOG_MODULE_REGISTER(cerebri_param, CONFIG_CEREBRI_CORE_COMMON_LOG_LEVEL);
+
+// a reader keeps a copy for one loop iteration, far shorter than this
+#define PARAM_GRACE_MS 10
+
+// writes are saved together once they stop coming
+#define PARAM_SAVE_DELAY_MS 2000
+
+static sys_slist_t g_param_groups = {.head = NULL, .tail = NULL};
+static K_MUTEX_DEFINE(g_param_lock);
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PARAM_STORE)
+static void param_save_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(g_param_save_work, param_save_work_handler);
+#endif
+
+void param_group_register(struct param_group *group)
+{
+	for (size_t i = 0; i < group->param_count; i++) {
+		if (group->params[i].count > PARAM_ARRAY_MAX) {
+			LOG_ERR("%s/%s: arrays are limited to %d elements", group->name,
+				group->params[i].name, PARAM_ARRAY_MAX);
+			return;
+		}
+	}
+	k_mutex_lock(&g_param_lock, K_FOREVER);
+	sys_slist_append(&g_param_groups, &group->node);
+	k_mutex_unlock(&g_param_lock);
+}
+
+// a parameter value, located by group, descriptor and element
+struct param_ref {
+	struct param_group *group;
+	const struct param_desc *desc;
+	int index;
+};
+
+static bool param_name_is(const char *name, const char *s, size_t len)
+{
+	return strlen(name) == len && strncmp(name, s, len) == 0;
+}
+
+static int param_find(const char *path, struct param_ref *ref)
+{
+	struct param_group *group;
+	const char *name = strchr(path, '/');
+
+	if (name == NULL) {
+		return -ENOENT;
+	}
+	size_t group_len = name - path;
+	name++;
+	const char *index_str = strchr(name, '/');
+	size_t name_len = index_str != NULL ? (size_t)(index_str - name) : strlen(name);
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_param_groups, group, node) {
+		if (!param_name_is(group->name, path, group_len)) {
+			continue;
+		}
+		for (size_t i = 0; i < group->param_count; i++) {
+			const struct param_desc *desc = &group->params[i];
+			if (!param_name_is(desc->name, name, name_len)) {
+				continue;
+			}
+			ref->group = group;
+			ref->desc = desc;
+			ref->index = 0;
+			if (index_str != NULL) {
+				char *end;
+				long index = strtol(index_str + 1, &end, 10);
+				if (*end != '\0' || index < 0 || index >= desc->count) {
+					return -ENOENT;
+				}
+				ref->index = index;
+			} else if (desc->count != 1) {
+				return -ENOENT;
+			}
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+static void *param_value_ptr(void *copy, const struct param_desc *desc, int index)
+{
+	static const size_t type_size[] = {
+		[PARAM_TYPE_INT32] = sizeof(int32_t),
+		[PARAM_TYPE_FLOAT] = sizeof(float),
+		[PARAM_TYPE_DOUBLE] = sizeof(double),
+	};
+	return (uint8_t *)copy + desc->offset + index * type_size[desc->type];
+}
+
+static double param_read(const void *ptr, uint8_t type)
+{
+	switch (type) {
+	case PARAM_TYPE_INT32:
+		return *(const int32_t *)ptr;
+	case PARAM_TYPE_FLOAT:
+		return *(const float *)ptr;
+	default:
+		return *(const double *)ptr;
+	}
+}
+
+static void param_write(void *ptr, uint8_t type, double value)
+{
+	switch (type) {
+	case PARAM_TYPE_INT32:
+		*(int32_t *)ptr = (int32_t)value;
+		break;
+	case PARAM_TYPE_FLOAT:
+		*(float *)ptr = (float)value;
+		break;
+	default:
+		*(double *)ptr = value;
+		break;
+	}
+}
+
+// boot is a load from settings, before any loop reads and with nothing to save
+static int param_set_ref(const struct param_ref *ref, double value, bool boot)
+{
+	struct param_group *group = ref->group;
+
+	// a nan or inf gain would reach every loop reading the group
+	if (!isfinite(value)) {
+		return -EINVAL;
+	}
+	if (ref->desc->type == PARAM_TYPE_INT32 && (value < INT32_MIN || value > INT32_MAX)) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&g_param_lock, K_FOREVER);
+	void *active = atomic_ptr_get(&group->active);
+	void *next = active == group->copy[0] ? group->copy[1] : group->copy[0];
+	memcpy(next, active, group->size);
+	param_write(param_value_ptr(next, ref->desc, ref->index), ref->desc->type, value);
+	atomic_ptr_set(&group->active, next);
+	atomic_inc(&group->version);
+	// the old copy is written by the next set, wait out readers still on it
+	if (!boot) {
+		k_msleep(PARAM_GRACE_MS);
+	}
+	k_mutex_unlock(&g_param_lock);
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PARAM_STORE)
+	if (!boot) {
+		k_work_reschedule(&g_param_save_work, K_MSEC(PARAM_SAVE_DELAY_MS));
+	}
+#endif
+	return 0;
+}
+
+int param_set(const char *path, double value)
+{
+	struct param_ref ref;
+	int ret = param_find(path, &ref);
+
+	if (ret < 0) {
+		return ret;
+	}
+	return param_set_ref(&ref, value, false);
+}
+
+int param_set_str(const char *path, const char *value)
+{
+	char *end;
+	double v = strtod(value, &end);
+
+	if (end == value || *end != '\0') {
+		return -EINVAL;
+	}
+	return param_set(path, v);
+}
+
+int param_get(const char *path, double *value)
+{
+	struct param_ref ref;
+	int ret = param_find(path, &ref);
+
+	if (ret < 0) {
+		return ret;
+	}
+	void *active = atomic_ptr_get(&ref.group->active);
+	*value = param_read(param_value_ptr(active, ref.desc, ref.index), ref.desc->type);
+	return 0;
+}
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PARAM_STORE)
+// saved per parameter, an array as one value of all its elements
+static int param_settings_set(const char *key, size_t len, settings_read_cb read_cb,
+			      void *cb_arg)
+{
+	char path[PARAM_SET_PATH_MAX];
+	struct param_ref ref;
+	const char *next;
+
+	settings_name_next(key, &next);
+	if (next == NULL || snprintf(path, sizeof(path), "%s", key) >= (int)sizeof(path)) {
+		return -ENOENT;
+	}
+	// settings keys are <group>/<name>, param_find wants the element for arrays
+	if (param_find(path, &ref) < 0) {
+		strncat(path, "/0", sizeof(path) - strlen(path) - 1);
+		if (param_find(path, &ref) < 0) {
+			LOG_WRN("stored %s is not a parameter", key);
+			return 0;
+		}
+	}
+
+	double values[PARAM_ARRAY_MAX];
+	uint8_t count = ref.desc->count;
+	if (len != count * sizeof(double) || read_cb(cb_arg, values, len) != (ssize_t)len) {
+		LOG_WRN("stored %s does not match its parameter", key);
+		return 0;
+	}
+	for (int i = 0; i < count; i++) {
+		ref.index = i;
+		param_set_ref(&ref, values[i], true);
+	}
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(param, "param", NULL, param_settings_set, NULL, NULL);
+
+int param_save(void)
+{
+	struct param_group *group;
+	int ret = 0;
+
+	k_mutex_lock(&g_param_lock, K_FOREVER);
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_param_groups, group, node) {
+		void *active = atomic_ptr_get(&group->active);
+		for (size_t i = 0; i < group->param_count; i++) {
+			const struct param_desc *desc = &group->params[i];
+			double values[PARAM_ARRAY_MAX];
+			char key[16 + PARAM_SET_PATH_MAX];
+			for (int j = 0; j < desc->count; j++) {
+				values[j] = param_read(param_value_ptr(active, desc, j),
+						       desc->type);
+			}
+			snprintf(key, sizeof(key), "param/%s/%s", group->name, desc->name);
+			int rc = settings_save_one(key, values, desc->count * sizeof(double));
+			if (rc < 0) {
+				LOG_ERR("saving %s failed: %d", key, rc);
+				ret = rc;
+			}
+		}
+	}
+	k_mutex_unlock(&g_param_lock);
+	return ret;
+}
+
+static void param_save_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+	if (param_save() == 0) {
+		LOG_INF("parameters saved");
+	}
+}
+
+// after every group has registered at priority 0
+static int param_load(void)
+{
+	settings_subsys_init();
+	settings_load_subtree("param");
+	return 0;
+}
+
+SYS_INIT(param_load, APPLICATION, 1);
+#else
+int param_save(void)
+{
+	return -ENOTSUP;
+}
+#endif
+
+static void param_print(const struct shell *sh, const struct param_group *group,
+			const struct param_desc *desc)
+{
+	void *active = atomic_ptr_get(&group->active);
+
+	for (int j = 0; j < desc->count; j++) {
+		double v = param_read(param_value_ptr(active, desc, j), desc->type);
+		if (desc->count == 1) {
+			shell_print(sh, "%s/%s = %g", group->name, desc->name, v);
+		} else {
+			shell_print(sh, "%s/%s/%d = %g", group->name, desc->name, j, v);
+		}
+	}
+}
+
+static int shell_param_list(const struct shell *sh, size_t argc, char **argv)
+{
+	struct param_group *group;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_param_groups, group, node) {
+		if (argc > 1 && strcmp(argv[1], group->name) != 0) {
+			continue;
+		}
+		for (size_t i = 0; i < group->param_count; i++) {
+			param_print(sh, group, &group->params[i]);
+		}
+	}
+	return 0;
+}
+
+static int shell_param_get(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	double value;
+
+	if (param_get(argv[1], &value) < 0) {
+		shell_error(sh, "unknown parameter: %s", argv[1]);
+		return -ENOENT;
+	}
+	shell_print(sh, "%s = %g", argv[1], value);
+	return 0;
+}
+
+static int shell_param_set(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	int ret = param_set_str(argv[1], argv[2]);
+
+	if (ret == -ENOENT) {
+		shell_error(sh, "unknown parameter: %s", argv[1]);
+	} else if (ret < 0) {
+		shell_error(sh, "bad value: %s", argv[2]);
+	}
+	return ret;
+}
+
+static int shell_param_save(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	int ret = param_save();
+
+	if (ret < 0) {
+		shell_error(sh, "save failed: %d", ret);
+	}
+	return ret;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_param,
+			       SHELL_CMD_ARG(list, NULL, "List parameters [group].",
+					     shell_param_list, 1, 1),
+			       SHELL_CMD_ARG(get, NULL, "Get <group/name>.", shell_param_get, 2,
+					     0),
+			       SHELL_CMD_ARG(set, NULL, "Set <group/name> <value>.",
+					     shell_param_set, 3, 0),
+			       SHELL_CMD(save, NULL, "Save parameters now.", shell_param_save),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(param, &sub_param, "runtime parameters", NULL);
+
+// vi: ts=4 sw=4 et
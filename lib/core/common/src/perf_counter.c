@@ -22,6 +22,7 @@ void perf_counter_init(struct perf_counter *counter, const char *name, double de
 	counter->last_cyc = 0;
 	counter->delta_cyc_sum = 0;
 	counter->count = 0;
+	perf_histogram_reset(&counter->hist);
 	sys_slist_append(&g_perf_counter_list, &counter->node);
 };
 
@@ -39,6 +40,7 @@ void perf_counter_update(struct perf_counter *counter)
 	} else {
 		int32_t delta_cyc = now_cyc - counter->last_cyc;
 		counter->delta_cyc_sum += delta_cyc;
+		perf_histogram_record(&counter->hist, delta_cyc);
 		if (delta_cyc > counter->deadline_cyc) {
 			// LOG_WRN("miss detected on: %s, %lld (ns)", counter->name,
 			//         1000000000LL*delta_cyc/sys_clock_hw_cycles_per_sec());
@@ -56,26 +58,62 @@ void perf_counter_update(struct perf_counter *counter)
 
 int perf_counter_report(struct perf_counter *counter, char *buf, size_t n)
 {
+	// a counter still without samples is reported, not divided by zero
+	uint64_t avg_cyc = counter->count > 0 ? counter->delta_cyc_sum / counter->count : 0;
 	return snprintf(buf, n,
 			"name: %s, max period (ns): %lld, min period (ns): %lld, avg period (ns): "
 			"%lld, misses: %lld, count: %lld\n",
 			counter->name,
 			1000000000LL * counter->max_period_cyc / sys_clock_hw_cycles_per_sec(),
 			1000000000LL * counter->min_period_cyc / sys_clock_hw_cycles_per_sec(),
-			1000000000LL * (counter->delta_cyc_sum / counter->count) /
-				sys_clock_hw_cycles_per_sec(),
+			1000000000LL * avg_cyc / sys_clock_hw_cycles_per_sec(),
 			counter->misses, counter->count);
 };
 
 void perf_counter_list_report(char *buf, size_t n)
 {
-	int offset = 0;
+	size_t offset = 0;
 	struct perf_counter *counter;
+	if (n == 0) {
+		return;
+	}
+	buf[0] = '\0';
 	SYS_SLIST_FOR_EACH_CONTAINER(&g_perf_counter_list, counter, node) {
 		printf("iterating");
-		if (n - offset > 0) {
-			offset += perf_counter_report(counter, &buf[offset], n - offset);
+		// full once only the terminator is left
+		if (offset + 1 >= n) {
+			break;
+		}
+		int ret = perf_counter_report(counter, &buf[offset], n - offset);
+		offset = perf_report_advance(offset, ret, n);
+	}
+};
+
+void perf_counter_reset(struct perf_counter *counter)
+{
+	counter->min_period_cyc = 0;
+	counter->max_period_cyc = 0;
+	counter->misses = 0;
+	counter->delta_cyc_sum = 0;
+	counter->count = 0;
+	perf_histogram_reset(&counter->hist);
+};
+
+void perf_counter_list_hist_report(char *buf, size_t n)
+{
+	size_t offset = 0;
+	struct perf_counter *counter;
+	if (n == 0) {
+		return;
+	}
+	buf[0] = '\0';
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_perf_counter_list, counter, node) {
+		if (offset + 1 >= n) {
+			break;
 		}
+		int ret = perf_histogram_report(&counter->hist, counter->name, &buf[offset],
+						n - offset);
+		offset = perf_report_advance(offset, ret, n);
 	}
 };
 
@@ -87,6 +125,35 @@ void shell_perf_counter(const struct shell *sh, size_t argc, char **argv, void *
 	shell_print(sh, "%s", report_buf);
 }
 
-SHELL_CMD_REGISTER(perf_counter, NULL, "Display perf counters", shell_perf_counter);
+static int shell_perf_counter_hist(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	perf_counter_list_hist_report(report_buf, ARRAY_SIZE(report_buf));
+	shell_print(sh, "%s", report_buf);
+	return 0;
+}
+
+static int shell_perf_counter_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	struct perf_counter *counter;
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_perf_counter_list, counter, node) {
+		perf_counter_reset(counter);
+	}
+	shell_print(sh, "perf counters reset");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_perf_counter,
+			       SHELL_CMD(hist, NULL, "Percentiles p50/p90/p99/p99.9.",
+					 shell_perf_counter_hist),
+			       SHELL_CMD(reset, NULL, "Reset statistics window.",
+					 shell_perf_counter_reset),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(perf_counter, &sub_perf_counter, "Display perf counters",
+		   shell_perf_counter);
 
 // vi: ts=4 sw=4 et
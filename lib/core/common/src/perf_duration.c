@@ -23,6 +23,7 @@ void perf_duration_init(struct perf_duration *duration, const char *name, double
 	duration->start_cyc = 0;
 	duration->delta_cyc_sum = 0;
 	duration->count = 0;
+	perf_histogram_reset(&duration->hist);
 	sys_slist_append(&g_perf_duration_list, &duration->node);
 };
 
@@ -49,6 +50,7 @@ void perf_duration_stop(struct perf_duration *duration)
 	duration->count++;
 	int32_t delta_cyc = now_cyc - duration->start_cyc;
 	duration->delta_cyc_sum += delta_cyc;
+	perf_histogram_record(&duration->hist, delta_cyc);
 	if (delta_cyc > duration->deadline_cyc) {
 		// LOG_WRN("miss detected on: %s, %lld (ns)", duration->name,
 		//         1000000000LL*delta_cyc/sys_clock_hw_cycles_per_sec());
@@ -64,26 +66,62 @@ void perf_duration_stop(struct perf_duration *duration)
 
 int perf_duration_report(struct perf_duration *duration, char *buf, size_t n)
 {
+	// a duration still without samples is reported, not divided by zero
+	uint64_t avg_cyc = duration->count > 0 ? duration->delta_cyc_sum / duration->count : 0;
 	return snprintf(buf, n,
 			"name: %s, max duration (ns): %lld, min duration (ns): %lld, avg duration "
 			"(ns): %lld, misses: %lld, count: %lld\n",
 			duration->name,
 			1000000000LL * duration->max_duration_cyc / sys_clock_hw_cycles_per_sec(),
 			1000000000LL * duration->min_duration_cyc / sys_clock_hw_cycles_per_sec(),
-			1000000000LL * (duration->delta_cyc_sum / duration->count) /
-				sys_clock_hw_cycles_per_sec(),
+			1000000000LL * avg_cyc / sys_clock_hw_cycles_per_sec(),
 			duration->misses, duration->count);
 };
 
 void perf_duration_list_report(char *buf, size_t n)
 {
-	int offset = 0;
+	size_t offset = 0;
 	struct perf_duration *duration;
+	if (n == 0) {
+		return;
+	}
+	buf[0] = '\0';
 	SYS_SLIST_FOR_EACH_CONTAINER(&g_perf_duration_list, duration, node) {
 		printf("iterating");
-		if (n - offset > 0) {
-			offset += perf_duration_report(duration, &buf[offset], n - offset);
+		// full once only the terminator is left
+		if (offset + 1 >= n) {
+			break;
+		}
+		int ret = perf_duration_report(duration, &buf[offset], n - offset);
+		offset = perf_report_advance(offset, ret, n);
+	}
+};
+
+void perf_duration_reset(struct perf_duration *duration)
+{
+	duration->min_duration_cyc = 0;
+	duration->max_duration_cyc = 0;
+	duration->misses = 0;
+	duration->delta_cyc_sum = 0;
+	duration->count = 0;
+	perf_histogram_reset(&duration->hist);
+};
+
+void perf_duration_list_hist_report(char *buf, size_t n)
+{
+	size_t offset = 0;
+	struct perf_duration *duration;
+	if (n == 0) {
+		return;
+	}
+	buf[0] = '\0';
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_perf_duration_list, duration, node) {
+		if (offset + 1 >= n) {
+			break;
 		}
+		int ret = perf_histogram_report(&duration->hist, duration->name, &buf[offset],
+						n - offset);
+		offset = perf_report_advance(offset, ret, n);
 	}
 };
 
@@ -95,7 +133,36 @@ void shell_perf_duration(const struct shell *sh, size_t argc, char **argv, void
 	shell_print(sh, "%s", report_buf);
 }
 
-SHELL_CMD_REGISTER(perf_duration, NULL, "Display perf durations", shell_perf_duration);
+static int shell_perf_duration_hist(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	perf_duration_list_hist_report(report_buf, ARRAY_SIZE(report_buf));
+	shell_print(sh, "%s", report_buf);
+	return 0;
+}
+
+static int shell_perf_duration_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	struct perf_duration *duration;
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_perf_duration_list, duration, node) {
+		perf_duration_reset(duration);
+	}
+	shell_print(sh, "perf durations reset");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_perf_duration,
+			       SHELL_CMD(hist, NULL, "Percentiles p50/p90/p99/p99.9.",
+					 shell_perf_duration_hist),
+			       SHELL_CMD(reset, NULL, "Reset statistics window.",
+					 shell_perf_duration_reset),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(perf_duration, &sub_perf_duration, "Display perf durations",
+		   shell_perf_duration);
 
 struct perf_duration control_latency;
 
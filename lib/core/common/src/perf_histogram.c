@@ -0,0 +1,110 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cerebri/core/perf_histogram.h>
+#include <stdio.h>
+#include <zephyr/kernel.h>
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PERF_HISTOGRAM)
+
+static uint32_t bucket_upper_cyc(uint32_t index)
+{
+	if (index < PERF_HISTOGRAM_SUB_COUNT) {
+		return index;
+	}
+	uint32_t shift = index / PERF_HISTOGRAM_SUB_COUNT - 1U;
+	uint64_t lower = (uint64_t)(PERF_HISTOGRAM_SUB_COUNT + index % PERF_HISTOGRAM_SUB_COUNT)
+			 << shift;
+	uint64_t upper = lower + (1ULL << shift) - 1U;
+	return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+void perf_histogram_reset(struct perf_histogram *hist)
+{
+	for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; i++) {
+		atomic_clear(&hist->bucket[i]);
+	}
+	atomic_clear(&hist->total);
+}
+
+uint32_t perf_histogram_count(const struct perf_histogram *hist)
+{
+	return (uint32_t)atomic_get(&hist->total);
+}
+
+uint32_t perf_histogram_percentile(const struct perf_histogram *hist, uint32_t per10k)
+{
+	// sum buckets rather than trusting total, writers may be mid update
+	uint64_t total = 0;
+	for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; i++) {
+		total += (uint32_t)atomic_get(&hist->bucket[i]);
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	uint64_t rank = (total * per10k + 9999U) / 10000U;
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	uint64_t cum = 0;
+	for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; i++) {
+		cum += (uint32_t)atomic_get(&hist->bucket[i]);
+		if (cum >= rank) {
+			return bucket_upper_cyc(i);
+		}
+	}
+	return UINT32_MAX;
+}
+
+static int64_t cyc_to_ns(uint32_t cyc)
+{
+	return 1000000000LL * cyc / sys_clock_hw_cycles_per_sec();
+}
+
+int perf_histogram_report(const struct perf_histogram *hist, const char *name, char *buf,
+			  size_t n)
+{
+	return snprintf(buf, n,
+			"name: %s, p50 (ns): %lld, p90 (ns): %lld, p99 (ns): %lld, p99.9 (ns): "
+			"%lld, samples: %u\n",
+			name, cyc_to_ns(perf_histogram_percentile(hist, 5000)),
+			cyc_to_ns(perf_histogram_percentile(hist, 9000)),
+			cyc_to_ns(perf_histogram_percentile(hist, 9900)),
+			cyc_to_ns(perf_histogram_percentile(hist, 9990)),
+			perf_histogram_count(hist));
+}
+
+#else
+
+void perf_histogram_reset(struct perf_histogram *hist)
+{
+	ARG_UNUSED(hist);
+}
+
+uint32_t perf_histogram_count(const struct perf_histogram *hist)
+{
+	ARG_UNUSED(hist);
+	return 0;
+}
+
+uint32_t perf_histogram_percentile(const struct perf_histogram *hist, uint32_t per10k)
+{
+	ARG_UNUSED(hist);
+	ARG_UNUSED(per10k);
+	return 0;
+}
+
+int perf_histogram_report(const struct perf_histogram *hist, const char *name, char *buf,
+			  size_t n)
+{
+	ARG_UNUSED(hist);
+	return snprintf(buf, n, "name: %s, histogram disabled\n", name);
+}
+
+#endif
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,288 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/sys/util.h>
+
+#include <cmsis_core.h>
+
+#include <cerebri/core/profile.h>
+
+#define TABLE_SIZE   CONFIG_CEREBRI_CORE_COMMON_PROFILE_ENTRIES
+#define TABLE_MASK   (TABLE_SIZE - 1)
+#define GRANULE_BITS CONFIG_CEREBRI_CORE_COMMON_PROFILE_GRANULE_BITS
+#define GRANULE_MASK (BIT(GRANULE_BITS) - 1)
+// slots tried before a sample is dropped, keeps the handler bounded
+#define MAX_PROBE 8
+#define EMPTY     UINT32_MAX
+// ARMv7-M DWT_FUNCTION watchpoint debug event, on the cycle counter with CYCMATCH
+#define FUNCTION_WATCH 0x4U
+
+BUILD_ASSERT(IS_POWER_OF_TWO(TABLE_SIZE), "profile table size must be a power of two");
+
+static struct profile_entry g_table[TABLE_SIZE];
+
+static struct {
+	uint32_t period_cyc;
+	uint32_t rate_hz;
+	uint32_t samples;
+	uint32_t dropped;
+	uint32_t window;
+	bool running;
+} g_prof;
+
+void profile_sample(const uint32_t *frame, uint32_t exc_return);
+
+static void profile_clear(void)
+{
+	memset(g_table, 0xff, sizeof(g_table));
+	g_prof.samples = 0;
+	g_prof.dropped = 0;
+	g_prof.window++;
+}
+
+void profile_sample(const uint32_t *frame, uint32_t exc_return)
+{
+	// reading FUNCTION0 clears MATCHED, the next match is a period from now
+	(void)DWT->FUNCTION0;
+	DWT->COMP0 = DWT->CYCCNT + g_prof.period_cyc;
+	SCB->DFSR = SCB_DFSR_DWTTRAP_Msk;
+
+	// basic and extended frames both start r0-r3, r12, lr, pc, xpsr
+	uint32_t pc = frame[6] & ~GRANULE_MASK;
+	if ((exc_return & BIT(3)) == 0) {
+		pc |= PROFILE_PC_HANDLER;
+	}
+	g_prof.samples++;
+
+	uint32_t hash = pc * 2654435761U;
+	hash ^= hash >> 16;
+	for (uint32_t probe = 0; probe < MAX_PROBE; probe++) {
+		struct profile_entry *entry = &g_table[(hash + probe) & TABLE_MASK];
+		if (entry->pc == pc) {
+			entry->count++;
+			return;
+		}
+		if (entry->pc == EMPTY) {
+			// count before pc, a reader never sees a claimed slot with a stale count
+			entry->count = 1;
+			barrier_dmem_fence_full();
+			entry->pc = pc;
+			return;
+		}
+	}
+	g_prof.dropped++;
+}
+
+/*
+ * the exception frame is on the stack EXC_RETURN in lr names, the handler
+ * calls no kernel service so it may run above irq_lock and see inside it
+ */
+__attribute__((naked)) void z_arm_debug_monitor(void)
+{
+	__asm__ volatile("tst lr, #4\n\t"
+			 "ite eq\n\t"
+			 "mrseq r0, msp\n\t"
+			 "mrsne r0, psp\n\t"
+			 "mov r1, lr\n\t"
+			 "b profile_sample\n\t");
+}
+
+int profile_start(uint32_t rate_hz)
+{
+	if (rate_hz == 0 || rate_hz > sys_clock_hw_cycles_per_sec() / 1000) {
+		return -EINVAL;
+	}
+	// a halting debugger takes the debug events, the monitor never runs
+	if (CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) {
+		return -EBUSY;
+	}
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#if defined(CONFIG_CPU_CORTEX_M7)
+	DWT->LAR = 0xC5ACCE55;
+#endif
+	if ((DWT->CTRL & DWT_CTRL_NUMCOMP_Msk) == 0) {
+		return -ENOTSUP;
+	}
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	if (!g_prof.running) {
+		profile_clear();
+	}
+	g_prof.rate_hz = rate_hz;
+	g_prof.period_cyc = sys_clock_hw_cycles_per_sec() / rate_hz;
+	NVIC_SetPriority(DebugMonitor_IRQn, 0);
+	DWT->MASK0 = 0;
+	DWT->COMP0 = DWT->CYCCNT + g_prof.period_cyc;
+	DWT->FUNCTION0 = DWT_FUNCTION_CYCMATCH_Msk | FUNCTION_WATCH;
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_MON_EN_Msk;
+	g_prof.running = true;
+	return 0;
+}
+
+void profile_stop(void)
+{
+	CoreDebug->DEMCR &= ~CoreDebug_DEMCR_MON_EN_Msk;
+	DWT->FUNCTION0 = 0;
+	g_prof.running = false;
+}
+
+bool profile_running(void)
+{
+	return g_prof.running;
+}
+
+void profile_reset(void)
+{
+	// a sample preempts the thread and completes, none is left half done
+	CoreDebug->DEMCR &= ~CoreDebug_DEMCR_MON_EN_Msk;
+	profile_clear();
+	if (g_prof.running) {
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_MON_EN_Msk;
+	}
+}
+
+size_t profile_read(size_t *pos, struct profile_entry *buf, size_t n)
+{
+	size_t count = 0;
+	while (*pos < TABLE_SIZE && count < n) {
+		const struct profile_entry *entry = &g_table[(*pos)++];
+		uint32_t pc = entry->pc;
+		if (pc == EMPTY) {
+			continue;
+		}
+		barrier_dmem_fence_full();
+		buf[count].pc = pc;
+		buf[count].count = entry->count;
+		count++;
+	}
+	return count;
+}
+
+void profile_header_init(struct profile_header *header)
+{
+	*header = (struct profile_header){
+		.magic = PROFILE_MAGIC,
+		.version = PROFILE_VERSION,
+		.entry_size = sizeof(struct profile_entry),
+		.window = g_prof.window,
+		.rate_hz = g_prof.rate_hz,
+		.samples = g_prof.samples,
+		.dropped = g_prof.dropped,
+		.granule_bits = GRANULE_BITS,
+		.datagram = 0,
+	};
+}
+
+static int cmd_profile_start(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t rate_hz = CONFIG_CEREBRI_CORE_COMMON_PROFILE_RATE_HZ;
+	if (argc > 1) {
+		rate_hz = strtoul(argv[1], NULL, 10);
+	}
+	int ret = profile_start(rate_hz);
+	if (ret < 0) {
+		shell_error(sh, "start failed: %d", ret);
+		return ret;
+	}
+	shell_print(sh, "sampling at %u Hz", rate_hz);
+	return 0;
+}
+
+static int cmd_profile_stop(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	profile_stop();
+	return 0;
+}
+
+static int cmd_profile_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	profile_reset();
+	shell_print(sh, "profile window %u", g_prof.window);
+	return 0;
+}
+
+static int cmd_profile_status(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	size_t used = 0;
+	for (size_t i = 0; i < TABLE_SIZE; i++) {
+		used += g_table[i].pc != EMPTY;
+	}
+	shell_print(sh, "running: %d rate: %u Hz window: %u", g_prof.running, g_prof.rate_hz,
+		    g_prof.window);
+	shell_print(sh, "samples: %u dropped: %u entries: %u/%d", g_prof.samples,
+		    g_prof.dropped, (uint32_t)used, TABLE_SIZE);
+	return 0;
+}
+
+// the busiest entries, symbolize with addr2line or scripts/profile_report.py
+static int cmd_profile_top(const struct shell *sh, size_t argc, char **argv)
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 10;
+	uint32_t samples = MAX(g_prof.samples, 1);
+	// entries printed so far come before (count, slot) in the order of the list
+	uint32_t below = UINT32_MAX;
+	size_t below_slot = 0;
+
+	for (size_t k = 0; k < n; k++) {
+		const struct profile_entry *top = NULL;
+		size_t top_slot = 0;
+		for (size_t i = 0; i < TABLE_SIZE; i++) {
+			const struct profile_entry *entry = &g_table[i];
+			bool after = entry->count < below ||
+				     (entry->count == below && i > below_slot);
+			bool busier = top == NULL || entry->count > top->count;
+			if (entry->pc != EMPTY && after && busier) {
+				top = entry;
+				top_slot = i;
+			}
+		}
+		if (top == NULL) {
+			break;
+		}
+		below = top->count;
+		below_slot = top_slot;
+		shell_print(sh, "0x%08x %s %8u %5.1f%%", top->pc & ~PROFILE_PC_HANDLER,
+			    top->pc & PROFILE_PC_HANDLER ? "isr   " : "thread", top->count,
+			    100.0 * top->count / samples);
+	}
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_profile,
+			       SHELL_CMD_ARG(start, NULL, "Start sampling [rate_hz].",
+					     cmd_profile_start, 1, 1),
+			       SHELL_CMD(stop, NULL, "Stop sampling.", cmd_profile_stop),
+			       SHELL_CMD(reset, NULL, "Clear the table.", cmd_profile_reset),
+			       SHELL_CMD(status, NULL, "Sample counts.", cmd_profile_status),
+			       SHELL_CMD_ARG(top, NULL, "Busiest addresses [n].", cmd_profile_top,
+					     1, 1),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(profile, &sub_profile, "PC sampling profiler", NULL);
+
+#if defined(CONFIG_CEREBRI_CORE_COMMON_PROFILE_BOOT)
+static int profile_sys_init(void)
+{
+	profile_start(CONFIG_CEREBRI_CORE_COMMON_PROFILE_RATE_HZ);
+	return 0;
+}
+
+SYS_INIT(profile_sys_init, APPLICATION, 0);
+#endif
+
+// vi: ts=4 sw=4 et
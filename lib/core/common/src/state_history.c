@@ -0,0 +1,56 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+
+#include <cerebri/core/state_history.h>
+
+static uint32_t slot(const struct state_history *history, uint32_t age)
+{
+	return (history->head + history->length - 1 - age) % history->length;
+}
+
+void state_history_reset(struct state_history *history)
+{
+	history->head = 0;
+	history->count = 0;
+}
+
+void *state_history_push(struct state_history *history, int64_t stamp_ns)
+{
+	uint32_t i = history->head;
+	history->stamp_ns[i] = stamp_ns;
+	history->head = (i + 1) % history->length;
+	if (history->count < history->length) {
+		history->count++;
+	}
+	return history->entries + i * history->entry_size;
+}
+
+void *state_history_get(const struct state_history *history, uint32_t age)
+{
+	if (age >= history->count) {
+		return NULL;
+	}
+	return history->entries + slot(history, age) * history->entry_size;
+}
+
+int64_t state_history_stamp(const struct state_history *history, uint32_t age)
+{
+	return history->stamp_ns[slot(history, age)];
+}
+
+int state_history_find(const struct state_history *history, int64_t stamp_ns)
+{
+	// from the newest, a measurement is usually a few steps late
+	for (uint32_t age = 0; age < history->count; age++) {
+		if (history->stamp_ns[slot(history, age)] <= stamp_ns) {
+			return age;
+		}
+	}
+	return -ENOENT;
+}
+
+// vi: ts=4 sw=4 et
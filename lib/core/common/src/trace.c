@@ -0,0 +1,217 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/sys/util.h>
+
+#include <cerebri/core/trace.h>
+
+#define RING_SIZE  CONFIG_CEREBRI_CORE_COMMON_TRACE_EVENTS
+#define RING_MASK  (RING_SIZE - 1)
+#define NAME_COUNT CONFIG_CEREBRI_CORE_COMMON_TRACE_NAMES
+
+BUILD_ASSERT(IS_POWER_OF_TWO(RING_SIZE), "trace ring size must be a power of two");
+BUILD_ASSERT(sizeof(struct trace_event) == 12, "trace event must stay 12 bytes");
+
+struct trace_slot {
+	// index + 1 of the event held, 0 while being written
+	atomic_t seq;
+	struct trace_event event;
+};
+
+struct trace_ring {
+	atomic_t head;
+	struct trace_slot slot[RING_SIZE];
+};
+
+static struct trace_ring g_ring[CONFIG_MP_MAX_NUM_CPUS];
+
+static struct {
+	struct k_spinlock lock;
+	const char *name[NAME_COUNT];
+	uint16_t count;
+} g_names;
+
+static uint32_t current_cpu(void)
+{
+#if CONFIG_MP_MAX_NUM_CPUS > 1
+	return arch_curr_cpu()->id;
+#else
+	return 0;
+#endif
+}
+
+void trace_record(uint8_t type, uint16_t id, uint32_t arg)
+{
+	uint32_t cpu = current_cpu();
+	struct trace_ring *ring = &g_ring[cpu];
+	uint32_t idx = (uint32_t)atomic_inc(&ring->head);
+	struct trace_slot *slot = &ring->slot[idx & RING_MASK];
+
+	// invalidate, write, then commit so readers never see a torn event
+	atomic_set(&slot->seq, 0);
+	barrier_dmem_fence_full();
+	slot->event.cyc = k_cycle_get_32();
+	slot->event.arg = arg;
+	slot->event.id = id;
+	slot->event.type = type;
+	slot->event.cpu = cpu;
+	barrier_dmem_fence_full();
+	atomic_set(&slot->seq, (atomic_val_t)(idx + 1U));
+}
+
+uint16_t trace_register(const char *name)
+{
+	uint16_t id = 0;
+	k_spinlock_key_t key = k_spin_lock(&g_names.lock);
+	for (uint16_t i = 0; i < g_names.count; i++) {
+		if (strcmp(g_names.name[i], name) == 0) {
+			id = i + 1;
+			break;
+		}
+	}
+	bool added = false;
+	if (id == 0 && g_names.count < NAME_COUNT) {
+		g_names.name[g_names.count++] = name;
+		id = g_names.count;
+		added = true;
+	}
+	k_spin_unlock(&g_names.lock, key);
+
+	// put the name in the stream so offline decoders can resolve the id
+	if (added) {
+		size_t len = strlen(name);
+		for (size_t i = 0; i < len; i += 4) {
+			uint32_t chars = 0;
+			memcpy(&chars, &name[i], MIN(len - i, 4));
+			trace_record(TRACE_EVENT_NAME, id, chars);
+		}
+	}
+	return id;
+}
+
+size_t trace_name_events(struct trace_event *buf, size_t n)
+{
+	size_t count = 0;
+	uint32_t now = k_cycle_get_32();
+	for (uint16_t i = 0; i < g_names.count; i++) {
+		const char *name = g_names.name[i];
+		size_t len = strlen(name);
+		for (size_t j = 0; j < len; j += 4) {
+			if (count >= n) {
+				return count;
+			}
+			struct trace_event *ev = &buf[count++];
+			ev->cyc = now;
+			ev->arg = 0;
+			memcpy(&ev->arg, &name[j], MIN(len - j, 4));
+			ev->id = i + 1;
+			ev->type = TRACE_EVENT_NAME;
+			ev->cpu = current_cpu();
+		}
+	}
+	return count;
+}
+
+const char *trace_name(uint16_t id)
+{
+	if (id == 0 || id > g_names.count) {
+		return "unknown";
+	}
+	return g_names.name[id - 1];
+}
+
+void trace_reader_init(struct trace_reader *reader)
+{
+	memset(reader, 0, sizeof(*reader));
+}
+
+size_t trace_read(struct trace_reader *reader, struct trace_event *buf, size_t n)
+{
+	size_t count = 0;
+	for (int cpu = 0; cpu < CONFIG_MP_MAX_NUM_CPUS && count < n; cpu++) {
+		struct trace_ring *ring = &g_ring[cpu];
+		uint32_t head = (uint32_t)atomic_get(&ring->head);
+		uint32_t tail = reader->tail[cpu];
+
+		// lapped by the writers, skip to the oldest event still in the ring
+		if (head - tail > RING_SIZE) {
+			reader->dropped += head - tail - RING_SIZE;
+			tail = head - RING_SIZE;
+		}
+
+		while (tail != head && count < n) {
+			struct trace_slot *slot = &ring->slot[tail & RING_MASK];
+			uint32_t seq = (uint32_t)atomic_get(&slot->seq);
+			if (seq != tail + 1U) {
+				if ((int32_t)(seq - (tail + 1U)) > 0) {
+					// overwritten before we got to it
+					reader->dropped++;
+					tail++;
+					continue;
+				}
+				// reserved but not yet committed
+				break;
+			}
+			barrier_dmem_fence_full();
+			buf[count] = slot->event;
+			barrier_dmem_fence_full();
+			if ((uint32_t)atomic_get(&slot->seq) != seq) {
+				reader->dropped++;
+				tail++;
+				continue;
+			}
+			count++;
+			tail++;
+		}
+		reader->tail[cpu] = tail;
+	}
+	return count;
+}
+
+void trace_header_init(struct trace_header *header)
+{
+	header->magic = TRACE_MAGIC;
+	header->version = TRACE_VERSION;
+	header->event_size = sizeof(struct trace_event);
+	header->cyc_per_sec = sys_clock_hw_cycles_per_sec();
+	header->num_cpus = CONFIG_MP_MAX_NUM_CPUS;
+}
+
+static int cmd_trace_status(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	for (int cpu = 0; cpu < CONFIG_MP_MAX_NUM_CPUS; cpu++) {
+		shell_print(sh, "cpu %d events: %u", cpu, (uint32_t)atomic_get(&g_ring[cpu].head));
+	}
+	shell_print(sh, "ring size: %d names: %d/%d", RING_SIZE, g_names.count, NAME_COUNT);
+	return 0;
+}
+
+static int cmd_trace_names(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+	for (uint16_t i = 0; i < g_names.count; i++) {
+		shell_print(sh, "%4d %s", i + 1, g_names.name[i]);
+	}
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_trace,
+			       SHELL_CMD(status, NULL, "Event counts per cpu.", cmd_trace_status),
+			       SHELL_CMD(names, NULL, "Registered trace ids.", cmd_trace_names),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(trace, &sub_trace, "Hot path event tracer", NULL);
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,174 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <cerebri/core/executor.h>
+#include <cerebri/core/trace.h>
+
+LOG_MODULE_DECLARE(core_workqueues);
+
+extern struct k_work_q g_high_priority_work_q;
+
+static void executor_work_handler(struct k_work *work);
+static void executor_timer_handler(struct k_timer *timer);
+
+static struct {
+	struct k_work work_item;
+	struct k_timer timer;
+	struct k_mutex lock;
+	sys_slist_t tasks;
+	uint32_t frame;
+	uint32_t overruns;
+	bool started;
+	struct perf_duration duration;
+} g_executor = {
+	.work_item = Z_WORK_INITIALIZER(executor_work_handler),
+	.timer = Z_TIMER_INITIALIZER(g_executor.timer, executor_timer_handler, NULL),
+	.lock = Z_MUTEX_INITIALIZER(g_executor.lock),
+	.tasks = {.head = NULL, .tail = NULL},
+	.frame = 0,
+	.overruns = 0,
+	.started = false,
+};
+
+int executor_register(struct executor_task *task, const char *name, executor_fn_t fn,
+		      enum executor_stage stage, uint32_t period_us, uint32_t phase_us,
+		      uint32_t deadline_us)
+{
+	if (fn == NULL || stage >= EXECUTOR_STAGE_COUNT || period_us < EXECUTOR_FRAME_US ||
+	    period_us % EXECUTOR_FRAME_US != 0 || phase_us >= period_us ||
+	    phase_us % EXECUTOR_FRAME_US != 0) {
+		LOG_ERR("%s: period %u us, phase %u us invalid for %u us frame", name, period_us,
+			phase_us, EXECUTOR_FRAME_US);
+		return -EINVAL;
+	}
+
+	task->name = name;
+	task->fn = fn;
+	task->stage = stage;
+	task->period_frames = period_us / EXECUTOR_FRAME_US;
+	task->phase_frames = phase_us / EXECUTOR_FRAME_US;
+	task->wait_start_ms = k_uptime_get();
+	task->trace_id = 0;
+#if defined(CONFIG_CEREBRI_CORE_COMMON_TRACE)
+	task->trace_id = trace_register(name);
+#endif
+	perf_duration_init(&task->duration, name, deadline_us * 1e-6);
+
+	k_mutex_lock(&g_executor.lock, K_FOREVER);
+
+	// keep the list sorted by stage, tasks of the same stage run in register order
+	struct executor_task *prev = NULL;
+	struct executor_task *iter;
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_executor.tasks, iter, node) {
+		if (iter->stage > stage) {
+			break;
+		}
+		prev = iter;
+	}
+	if (prev == NULL) {
+		sys_slist_prepend(&g_executor.tasks, &task->node);
+	} else {
+		sys_slist_insert(&g_executor.tasks, &prev->node, &task->node);
+	}
+
+	// the work queues are started by a thread, so start releasing frames on first use
+	if (!g_executor.started) {
+		perf_duration_init(&g_executor.duration, "executor_frame",
+				   EXECUTOR_FRAME_US * 1e-6);
+		k_timer_start(&g_executor.timer, K_USEC(EXECUTOR_FRAME_US),
+			      K_USEC(EXECUTOR_FRAME_US));
+		g_executor.started = true;
+	}
+
+	k_mutex_unlock(&g_executor.lock);
+	LOG_INF("%s: stage %d period %u phase %u frames", name, stage, task->period_frames,
+		task->phase_frames);
+	return 0;
+}
+
+void executor_unregister(struct executor_task *task)
+{
+	k_mutex_lock(&g_executor.lock, K_FOREVER);
+	sys_slist_find_and_remove(&g_executor.tasks, &task->node);
+	k_mutex_unlock(&g_executor.lock);
+	perf_duration_fini(&task->duration);
+}
+
+int executor_wait(struct executor_task *task, bool available, uint32_t timeout_ms)
+{
+	int64_t now = k_uptime_get();
+	if (available) {
+		task->wait_start_ms = now;
+		return 0;
+	}
+	if (now - task->wait_start_ms >= timeout_ms) {
+		task->wait_start_ms = now;
+		return -EAGAIN;
+	}
+	return -EBUSY;
+}
+
+static void executor_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	perf_duration_start(&g_executor.duration);
+	k_mutex_lock(&g_executor.lock, K_FOREVER);
+	uint32_t frame = g_executor.frame++;
+	struct executor_task *task;
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_executor.tasks, task, node) {
+		if (frame % task->period_frames != task->phase_frames) {
+			continue;
+		}
+		CEREBRI_TRACE(TRACE_EVENT_NODE_WAKE, task->trace_id, frame);
+		perf_duration_start(&task->duration);
+		task->fn(task);
+		perf_duration_stop(&task->duration);
+	}
+	k_mutex_unlock(&g_executor.lock);
+	perf_duration_stop(&g_executor.duration);
+}
+
+static void executor_timer_handler(struct k_timer *timer)
+{
+	ARG_UNUSED(timer);
+
+	// 1 means newly queued, anything else means the previous frame has not finished
+	if (k_work_submit_to_queue(&g_high_priority_work_q, &g_executor.work_item) != 1) {
+		g_executor.overruns++;
+	}
+}
+
+static int cmd_executor(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "frame: %u us count: %u overruns: %u", EXECUTOR_FRAME_US,
+		    g_executor.frame, g_executor.overruns);
+	shell_print(sh, "%-24s %5s %6s %5s %10s %10s %8s", "task", "stage", "period", "phase",
+		    "max (ns)", "avg (ns)", "misses");
+	k_mutex_lock(&g_executor.lock, K_FOREVER);
+	struct executor_task *task;
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_executor.tasks, task, node) {
+		struct perf_duration *d = &task->duration;
+		uint64_t avg = d->count > 0 ? d->delta_cyc_sum / d->count : 0;
+		shell_print(sh, "%-24s %5d %6u %5u %10lld %10lld %8lld", task->name, task->stage,
+			    task->period_frames, task->phase_frames,
+			    1000000000LL * d->max_duration_cyc / sys_clock_hw_cycles_per_sec(),
+			    1000000000LL * avg / sys_clock_hw_cycles_per_sec(), d->misses);
+	}
+	k_mutex_unlock(&g_executor.lock);
+	return 0;
+}
+
+SHELL_CMD_REGISTER(executor, NULL, "Time-triggered executor frame and task timing", cmd_executor);
+
+// vi: ts=4 sw=4 et
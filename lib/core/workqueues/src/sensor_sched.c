@@ -0,0 +1,286 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/rtio/rtio.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include <cerebri/core/sensor_sched.h>
+
+LOG_MODULE_DECLARE(core_workqueues);
+
+#define CLIENT_MAX CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED_CLIENTS
+#define PHASE_US   CONFIG_CEREBRI_CORE_WORKQUEUES_SENSOR_SCHED_PHASE_US
+#define STACK_SIZE 2048
+#define PRIORITY   6
+// rtio mempool blocks, a read encodes a few q31 channels
+#define BLOCKS     (2 * CLIENT_MAX)
+#define BLOCK_SIZE 64
+
+extern struct k_work_q g_high_priority_work_q;
+
+static void sensor_sched_work_handler(struct k_work *work);
+static void sensor_sched_timer_handler(struct k_timer *timer);
+
+RTIO_DEFINE_WITH_MEMPOOL(g_sensor_sched_rtio, CLIENT_MAX, CLIENT_MAX, BLOCKS, BLOCK_SIZE, 4);
+
+static struct {
+	struct k_work work_item;
+	struct k_timer timer;
+	struct k_mutex lock;
+	sys_slist_t clients;
+	int client_count;
+	uint32_t slot;
+	uint32_t overruns;
+	bool started;
+} g_sensor_sched = {
+	.work_item = Z_WORK_INITIALIZER(sensor_sched_work_handler),
+	.timer = Z_TIMER_INITIALIZER(g_sensor_sched.timer, sensor_sched_timer_handler, NULL),
+	.lock = Z_MUTEX_INITIALIZER(g_sensor_sched.lock),
+	.clients = {.head = NULL, .tail = NULL},
+	.client_count = 0,
+	.slot = 0,
+	.overruns = 0,
+	.started = false,
+};
+
+static uint32_t gcd_u32(uint32_t a, uint32_t b)
+{
+	while (b != 0) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// clients already due in the slots of a phase, the ones sharing its residue
+static int slot_load(uint32_t period, uint32_t phase)
+{
+	int load = 0;
+	struct sensor_sched_client *iter;
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_sensor_sched.clients, iter, node) {
+		uint32_t g = gcd_u32(period, iter->period_slots);
+		if (phase % g == iter->phase_slots % g) {
+			load++;
+		}
+	}
+	return load;
+}
+
+int sensor_sched_add(struct sensor_sched_client *client)
+{
+	if (!device_is_ready(client->sensor)) {
+		LOG_ERR("%s: not ready", client->name);
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&g_sensor_sched.lock, K_FOREVER);
+	if (g_sensor_sched.client_count == CLIENT_MAX) {
+		k_mutex_unlock(&g_sensor_sched.lock);
+		LOG_ERR("%s: more than %d clients", client->name, CLIENT_MAX);
+		return -ENOMEM;
+	}
+
+	client->period_slots = MAX(client->period_ms * 1000 / SENSOR_SCHED_SLOT_US, 1);
+	client->phase_slots = 0;
+	int best = INT_MAX;
+	for (uint32_t phase = 0; phase < client->period_slots; phase++) {
+		int load = slot_load(client->period_slots, phase);
+		if (load < best) {
+			best = load;
+			client->phase_slots = phase;
+		}
+	}
+	atomic_clear(&client->busy);
+	client->reads = 0;
+	client->errors = 0;
+	client->overruns = 0;
+	sys_slist_append(&g_sensor_sched.clients, &client->node);
+	g_sensor_sched.client_count++;
+
+	// the work queues are started by a thread, so start releasing slots on first use
+	if (!g_sensor_sched.started) {
+		k_timer_start(&g_sensor_sched.timer, K_USEC(SENSOR_SCHED_SLOT_US + PHASE_US),
+			      K_USEC(SENSOR_SCHED_SLOT_US));
+		g_sensor_sched.started = true;
+	}
+	k_mutex_unlock(&g_sensor_sched.lock);
+
+	LOG_INF("%s: period %u phase %u slots", client->name, client->period_slots,
+		client->phase_slots);
+	return 0;
+}
+
+int sensor_sched_decode(const struct sensor_sched_client *client, const uint8_t *buf,
+			enum sensor_channel chan, double *values, int count)
+{
+	const struct sensor_decoder_api *decoder;
+	struct sensor_chan_spec ch = {.chan_type = chan, .chan_idx = 0};
+	uint32_t fit = 0;
+
+	int ret = sensor_get_decoder(client->sensor, &decoder);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (count == 3) {
+		struct sensor_three_axis_data data;
+		if (decoder->decode(buf, ch, &fit, 1, &data) <= 0) {
+			return -ENODATA;
+		}
+		for (int i = 0; i < 3; i++) {
+			values[i] = ldexp(data.readings[0].values[i], data.shift - 31);
+		}
+	} else {
+		struct sensor_q31_data data;
+		if (decoder->decode(buf, ch, &fit, 1, &data) <= 0) {
+			return -ENODATA;
+		}
+		values[0] = ldexp(data.readings[0].value, data.shift - 31);
+	}
+	return 0;
+}
+
+/*
+ * Queue the reads of the clients due in this slot. Reads of clients on the
+ * same bus are chained in list order, so the bus sees them one after the
+ * other, and a failed read cancels the rest of its chain. A chained sqe
+ * runs before the next one in the queue, so the reads of one bus are
+ * acquired back to back before those of the next.
+ */
+static void sensor_sched_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+	struct sensor_sched_client *due[CLIENT_MAX];
+	int due_count = 0;
+	bool queued = false;
+
+	k_mutex_lock(&g_sensor_sched.lock, K_FOREVER);
+	uint32_t slot = g_sensor_sched.slot++;
+	struct sensor_sched_client *client;
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_sensor_sched.clients, client, node) {
+		if (slot % client->period_slots != client->phase_slots) {
+			continue;
+		}
+		if (!atomic_cas(&client->busy, 0, 1)) {
+			// the previous read has not completed
+			client->overruns++;
+			continue;
+		}
+		due[due_count++] = client;
+	}
+
+	for (int i = 0; i < due_count; i++) {
+		if (due[i] == NULL) {
+			// queued in the chain of an earlier client on its bus
+			continue;
+		}
+		const struct device *bus = due[i]->bus;
+		struct rtio_sqe *last = NULL;
+		for (int j = i; j < due_count; j++) {
+			client = due[j];
+			if (client == NULL || (j > i && (bus == NULL || client->bus != bus))) {
+				continue;
+			}
+			due[j] = NULL;
+			struct rtio_sqe *sqe = rtio_sqe_acquire(&g_sensor_sched_rtio);
+			if (sqe == NULL) {
+				atomic_clear(&client->busy);
+				client->overruns++;
+				continue;
+			}
+			rtio_sqe_prep_read_with_pool(sqe, client->iodev, RTIO_PRIO_NORM, client);
+			if (last != NULL) {
+				last->flags |= RTIO_SQE_CHAINED;
+			}
+			last = sqe;
+			queued = true;
+			if (bus == NULL) {
+				break;
+			}
+		}
+	}
+	k_mutex_unlock(&g_sensor_sched.lock);
+
+	if (queued) {
+		rtio_submit(&g_sensor_sched_rtio, 0);
+	}
+}
+
+static void sensor_sched_timer_handler(struct k_timer *timer)
+{
+	ARG_UNUSED(timer);
+
+	// 1 means newly queued, anything else means the previous slot has not been queued
+	if (k_work_submit_to_queue(&g_high_priority_work_q, &g_sensor_sched.work_item) != 1) {
+		g_sensor_sched.overruns++;
+	}
+}
+
+// completions, the done callbacks publish from here, never from the work queue
+static void sensor_sched_run(void *p0, void *p1, void *p2)
+{
+	ARG_UNUSED(p0);
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	while (true) {
+		struct rtio_cqe *cqe = rtio_cqe_consume_block(&g_sensor_sched_rtio);
+		struct sensor_sched_client *client = cqe->userdata;
+		int result = cqe->result;
+		uint8_t *buf = NULL;
+		uint32_t len = 0;
+
+		if (result >= 0 &&
+		    rtio_cqe_get_mempool_buffer(&g_sensor_sched_rtio, cqe, &buf, &len) < 0) {
+			result = -ENOMEM;
+		}
+		rtio_cqe_release(&g_sensor_sched_rtio, cqe);
+
+		client->reads++;
+		if (result < 0) {
+			client->errors++;
+		}
+		client->done(client, result, buf, len);
+		if (buf != NULL) {
+			rtio_release_buffer(&g_sensor_sched_rtio, buf, len);
+		}
+		atomic_clear(&client->busy);
+	}
+}
+
+K_THREAD_DEFINE(sensor_sched, STACK_SIZE, sensor_sched_run, NULL, NULL, NULL, PRIORITY, 0, 0);
+
+static int cmd_sensor_sched(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "slot: %u us count: %u overruns: %u", SENSOR_SCHED_SLOT_US,
+		    g_sensor_sched.slot, g_sensor_sched.overruns);
+	shell_print(sh, "%-24s %-16s %6s %5s %10s %8s %8s", "client", "bus", "period", "phase",
+		    "reads", "errors", "overruns");
+	k_mutex_lock(&g_sensor_sched.lock, K_FOREVER);
+	struct sensor_sched_client *client;
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_sensor_sched.clients, client, node) {
+		shell_print(sh, "%-24s %-16s %6u %5u %10u %8u %8u", client->name,
+			    client->bus != NULL ? client->bus->name : "-", client->period_slots,
+			    client->phase_slots, client->reads, client->errors, client->overruns);
+	}
+	k_mutex_unlock(&g_sensor_sched.lock);
+	return 0;
+}
+
+SHELL_CMD_REGISTER(sensor_sched, NULL, "Low rate sensor schedule and read counts",
+		   cmd_sensor_sched);
+
+// vi: ts=4 sw=4 et
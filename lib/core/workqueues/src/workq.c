@@ -4,6 +4,11 @@
  */
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/spinlock.h>
+
+#include <cerebri/core/placement.h>
+#include <cerebri/core/workq.h>
 
 LOG_MODULE_REGISTER(core_workqueues, CONFIG_CEREBRI_CORE_WORKQUEUES_LOG_LEVEL);
 
@@ -16,11 +21,20 @@ LOG_MODULE_REGISTER(core_workqueues, CONFIG_CEREBRI_CORE_WORKQUEUES_LOG_LEVEL);
 #define HIGH_PRIORITY_STACK_SIZE 16384
 #define HIGH_PRIORITY_PRIORITY   -1
 
-K_THREAD_STACK_DEFINE(high_priority_stack_area, HIGH_PRIORITY_STACK_SIZE);
+CEREBRI_HOT_STACK_DEFINE(high_priority_stack_area, HIGH_PRIORITY_STACK_SIZE);
 K_THREAD_STACK_DEFINE(low_priority_stack_area, LOW_PRIORITY_STACK_SIZE);
 
 struct k_work_q g_high_priority_work_q, g_low_priority_work_q;
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+#define SHARED_STACK_SIZE CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED_STACK_SIZE
+#define SHARED_PRIORITY   4
+
+K_THREAD_STACK_DEFINE(shared_stack_area, SHARED_STACK_SIZE);
+
+struct k_work_q g_shared_work_q;
+#endif
+
 int core_workqueues_entry_point(void)
 {
 	// high priority
@@ -40,6 +54,93 @@ int core_workqueues_entry_point(void)
 	return 0;
 }
 
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_SHARED)
+// started at init so the nodes on it can submit from their SYS_INIT
+static int core_workqueues_shared_sys_init(void)
+{
+	k_work_queue_init(&g_shared_work_q);
+	struct k_work_queue_config shared_cfg = {.name = "shared_q", .no_yield = false};
+	k_work_queue_start(&g_shared_work_q, shared_stack_area,
+			   K_THREAD_STACK_SIZEOF(shared_stack_area), SHARED_PRIORITY, &shared_cfg);
+	return 0;
+}
+
+SYS_INIT(core_workqueues_shared_sys_init, APPLICATION, 0);
+#endif
+
+#if defined(CONFIG_CEREBRI_CORE_WORKQUEUES_STATS)
+static struct {
+	struct k_spinlock lock;
+	sys_slist_t items;
+} g_workq_stats = {
+	.items = {.head = NULL, .tail = NULL},
+};
+
+int workq_submit(struct k_work_q *queue, struct workq_item *item)
+{
+	// items register on first use, timers may submit before any thread runs
+	k_spinlock_key_t key = k_spin_lock(&g_workq_stats.lock);
+	if (!item->registered) {
+		perf_duration_init(&item->delay, item->delay_name, item->deadline_us * 1e-6);
+		perf_duration_init(&item->run, item->run_name, item->deadline_us * 1e-6);
+		sys_slist_append(&g_workq_stats.items, &item->node);
+		item->registered = true;
+	}
+	item->queue = queue;
+	k_spin_unlock(&g_workq_stats.lock, key);
+
+	// start before submitting as the handler may preempt us, an item that is
+	// already queued keeps its first submit time
+	perf_duration_start(&item->delay);
+	int ret = k_work_submit_to_queue(queue, &item->work);
+	if (ret < 0) {
+		item->delay.started = false;
+	}
+	return ret;
+}
+
+void workq_item_handler(struct k_work *work)
+{
+	struct workq_item *item = CONTAINER_OF(work, struct workq_item, work);
+	perf_duration_stop(&item->delay);
+	perf_duration_start(&item->run);
+	item->handler(work);
+	perf_duration_stop(&item->run);
+}
+
+static int64_t cyc_to_ns(uint64_t cyc)
+{
+	return 1000000000LL * cyc / sys_clock_hw_cycles_per_sec();
+}
+
+static int cmd_workq(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "%-16s %-16s %10s %10s %10s %10s %8s %8s", "queue", "item", "delay avg",
+		    "delay max", "run avg", "run max", "misses", "count");
+	struct workq_item *item;
+	SYS_SLIST_FOR_EACH_CONTAINER(&g_workq_stats.items, item, node) {
+		struct perf_duration *d = &item->delay;
+		struct perf_duration *r = &item->run;
+		const char *queue = NULL;
+		if (item->queue != NULL) {
+			queue = k_thread_name_get(&item->queue->thread);
+		}
+		uint64_t delay_avg = d->count > 0 ? d->delta_cyc_sum / d->count : 0;
+		uint64_t run_avg = r->count > 0 ? r->delta_cyc_sum / r->count : 0;
+		shell_print(sh, "%-16s %-16s %10lld %10lld %10lld %10lld %8lld %8lld",
+			    queue != NULL ? queue : "-", item->name, cyc_to_ns(delay_avg),
+			    cyc_to_ns(d->max_duration_cyc), cyc_to_ns(run_avg),
+			    cyc_to_ns(r->max_duration_cyc), d->misses + r->misses, r->count);
+	}
+	return 0;
+}
+
+SHELL_CMD_REGISTER(workq, NULL, "Work item queueing delay and run time (ns)", cmd_workq);
+#endif
+
 K_THREAD_DEFINE(core_workqueues, THREAD_STACK_SIZE, core_workqueues_entry_point, NULL, NULL, NULL,
 		THREAD_PRIORITY, 0, 0);
 
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Copyright (c) 2025 CogniPilot Foundation
+# SPDX-License-Identifier: Apache-2.0
+
+'''casadi_float.py
+
+Wraps a casadi generated source in a float32 copy that links next to the
+double one. Every function declared in the generated header is renamed
+with a _f32 suffix, so the two copies can be called from the same image
+and compared.
+
+usage: casadi_float.py <generated .c> <dest dir>
+
+writes <stem>_f32.c, to be built with the generated sources, and
+<stem>_f32.h, which declares the copies for a caller built with
+casadi_real as double.
+'''
+
+import argparse
+import re
+from pathlib import Path
+
+# a declaration at the start of a line: return type, name, open paren
+DECL = re.compile(r'^(?:CASADI_SYMBOL_EXPORT\s+)?(?:const\s+)?\w+\s*\**\s*(\w+)\(',
+                  re.MULTILINE)
+
+
+def exported_names(header: Path):
+    names = []
+    for name in DECL.findall(header.read_text()):
+        if name not in names:
+            names.append(name)
+    return names
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('source')
+    parser.add_argument('dest_dir')
+    args = parser.parse_args()
+
+    source = Path(args.source).resolve()
+    header = source.with_suffix('.h')
+    dest_dir = Path(args.dest_dir)
+    dest_dir.mkdir(parents=True, exist_ok=True)
+    names = exported_names(header)
+    if not names:
+        raise SystemExit('no functions declared in {:s}'.format(str(header)))
+
+    renames = ''.join('#define {0:s} {0:s}_f32\n'.format(n) for n in names)
+    undefs = ''.join('#undef {:s}\n'.format(n) for n in names)
+    banner = '/* generated by casadi_float.py from {:s}, do not edit */\n'.format(source.name)
+
+    (dest_dir / (source.stem + '_f32.c')).write_text(
+        banner +
+        '#define casadi_real float\n'
+        # internal helpers are prefixed and not all are static
+        '#define CASADI_CODEGEN_PREFIX\n'
+        '#define CODEGEN_PREFIX {:s}_f32_\n'.format(source.stem) +
+        renames +
+        '#include "{:s}"\n'.format(str(source)))
+
+    (dest_dir / (source.stem + '_f32.h')).write_text(
+        banner +
+        '#pragma push_macro("casadi_real")\n'
+        '#undef casadi_real\n'
+        '#define casadi_real float\n' +
+        renames +
+        '#include "{:s}"\n'.format(str(header)) +
+        undefs +
+        '#pragma pop_macro("casadi_real")\n')
+
+
+if __name__ == '__main__':
+    main()
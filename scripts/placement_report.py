@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+# Copyright (c) 2025 CogniPilot Foundation
+# SPDX-License-Identifier: Apache-2.0
+
+'''placement_report.py
+
+Reports where the control path landed after CONFIG_CEREBRI_CORE_COMMON_PLACEMENT
+moved it: the size of every tightly coupled memory section with the
+symbols in it, and the largest objects left in the other RAM sections.
+Run after every build by app/rdd2/CMakeLists.txt, the report is also
+written next to the elf as placement_report.txt.
+
+usage: placement_report.py <zephyr.elf> [--top N]
+'''
+
+import argparse
+from pathlib import Path
+
+from elftools.elf.constants import SH_FLAGS
+from elftools.elf.elffile import ELFFile
+from elftools.elf.sections import SymbolTableSection
+
+TCM = ('itcm', 'dtcm')
+
+
+def region(name):
+    for tcm in TCM:
+        if tcm in name.lower():
+            return tcm.upper()
+    return None
+
+
+def report(elf_path, top):
+    lines = []
+    with open(elf_path, 'rb') as f:
+        elf = ELFFile(f)
+        symtab = elf.get_section_by_name('.symtab')
+        if not isinstance(symtab, SymbolTableSection):
+            raise SystemExit('no symbol table in ' + str(elf_path))
+
+        by_section = {}
+        for sym in symtab.iter_symbols():
+            shndx = sym['st_shndx']
+            if not isinstance(shndx, int) or sym['st_size'] == 0 or not sym.name:
+                continue
+            if sym['st_info']['type'] not in ('STT_FUNC', 'STT_OBJECT'):
+                continue
+            by_section.setdefault(shndx, []).append(sym)
+
+        totals = {}
+        other = []
+        for index, section in enumerate(elf.iter_sections()):
+            if not section['sh_flags'] & SH_FLAGS.SHF_ALLOC or section['sh_size'] == 0:
+                continue
+            syms = by_section.get(index, [])
+            tcm = region(section.name)
+            if tcm is None:
+                writable = section['sh_flags'] & SH_FLAGS.SHF_WRITE
+                if writable:
+                    other += [(sym['st_size'], sym.name, section.name) for sym in syms]
+                continue
+            totals[tcm] = totals.get(tcm, 0) + section['sh_size']
+            lines.append('{} {:<24} {:>8} bytes at 0x{:08x}'.format(
+                tcm, section.name, section['sh_size'], section['sh_addr']))
+            for sym in sorted(syms, key=lambda s: -s['st_size']):
+                lines.append('    {:>8} {}'.format(sym['st_size'], sym.name))
+
+        for tcm in sorted(totals):
+            lines.append('{} total {} bytes'.format(tcm, totals[tcm]))
+        lines.append('largest objects left in other RAM:')
+        for size, name, section in sorted(other, reverse=True)[:top]:
+            lines.append('    {:>8} {:<40} {}'.format(size, name, section))
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('elf', type=Path)
+    parser.add_argument('--top', type=int, default=20)
+    args = parser.parse_args()
+
+    lines = report(args.elf, args.top)
+    text = '\n'.join(lines) + '\n'
+    (args.elf.parent / 'placement_report.txt').write_text(text)
+    print(text, end='')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+# Copyright (c) 2025 CogniPilot Foundation
+# SPDX-License-Identifier: Apache-2.0
+
+'''profile_report.py
+
+Symbolizes the pc sampling profile of CONFIG_CEREBRI_CORE_COMMON_PROFILE
+against the elf of the running image. Listens for the datagrams eth_tx
+sends with CONFIG_CEREBRI_SYNAPSE_ETH_TX_PROFILE, or reads a capture of
+them saved with --save, and prints the functions with the most samples.
+Counts on target are cumulative, the last datagram seen of each window
+wins.
+
+usage: profile_report.py <zephyr.elf> [--port 4248] [--duration 10]
+                         [--top 30] [--save FILE | --load FILE]
+'''
+
+import argparse
+import bisect
+import socket
+import struct
+import time
+from pathlib import Path
+
+from elftools.elf.elffile import ELFFile
+from elftools.elf.sections import SymbolTableSection
+
+MAGIC = 0x46525043
+VERSION = 1
+HEADER = struct.Struct('<IHHIIIIHH')
+ENTRY = struct.Struct('<II')
+PC_HANDLER = 0x1
+
+
+class Symbols:
+    def __init__(self, elf_path):
+        funcs = []
+        with open(elf_path, 'rb') as f:
+            symtab = ELFFile(f).get_section_by_name('.symtab')
+            if not isinstance(symtab, SymbolTableSection):
+                raise SystemExit('no symbol table in ' + str(elf_path))
+            for sym in symtab.iter_symbols():
+                if sym['st_info']['type'] != 'STT_FUNC' or sym['st_size'] == 0:
+                    continue
+                # thumb functions have bit 0 set in their symbol value
+                start = sym['st_value'] & ~1
+                funcs.append((start, start + sym['st_size'], sym.name))
+        funcs.sort()
+        self.starts = [start for start, _, _ in funcs]
+        self.funcs = funcs
+
+    def name(self, pc):
+        i = bisect.bisect_right(self.starts, pc) - 1
+        if i >= 0 and pc < self.funcs[i][1]:
+            return self.funcs[i][2]
+        return '0x{:08x}'.format(pc)
+
+
+class Profile:
+    def __init__(self):
+        self.window = None
+        self.header = None
+        self.counts = {}
+
+    def add(self, data):
+        if len(data) < HEADER.size:
+            return
+        header = HEADER.unpack_from(data)
+        magic, version, entry_size, window = header[:4]
+        if magic != MAGIC or version != VERSION or entry_size != ENTRY.size:
+            return
+        if window != self.window:
+            self.window = window
+            self.counts = {}
+        self.header = header
+        for offset in range(HEADER.size, len(data) - ENTRY.size + 1, ENTRY.size):
+            pc, count = ENTRY.unpack_from(data, offset)
+            self.counts[pc] = max(count, self.counts.get(pc, 0))
+
+
+def report(profile, symbols, top):
+    if profile.header is None:
+        return ['no profile received']
+    _, _, _, window, rate_hz, samples, dropped, granule_bits, _ = profile.header
+    funcs = {}
+    for pc, count in profile.counts.items():
+        handler = bool(pc & PC_HANDLER)
+        key = (symbols.name(pc & ~PC_HANDLER), handler)
+        funcs[key] = funcs.get(key, 0) + count
+    total = max(samples, 1)
+    lines = ['window {} at {} Hz, {} samples, {} dropped, {} byte granules'.format(
+        window, rate_hz, samples, dropped, 1 << granule_bits)]
+    for (name, handler), count in sorted(funcs.items(), key=lambda f: -f[1])[:top]:
+        lines.append('{:>8} {:>6.2f}% {} {}'.format(
+            count, 100.0 * count / total, 'isr   ' if handler else 'thread', name))
+    return lines
+
+
+def receive(port, duration, save):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(('', port))
+    sock.settimeout(0.5)
+    datagrams = []
+    end = time.monotonic() + duration
+    while time.monotonic() < end:
+        try:
+            data, _ = sock.recvfrom(2048)
+        except socket.timeout:
+            continue
+        datagrams.append(data)
+    if save is not None:
+        with open(save, 'wb') as f:
+            for data in datagrams:
+                f.write(struct.pack('<H', len(data)) + data)
+    return datagrams
+
+
+def load(path):
+    datagrams = []
+    raw = Path(path).read_bytes()
+    offset = 0
+    while offset + 2 <= len(raw):
+        (size,) = struct.unpack_from('<H', raw, offset)
+        datagrams.append(raw[offset + 2:offset + 2 + size])
+        offset += 2 + size
+    return datagrams
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('elf', type=Path)
+    parser.add_argument('--port', type=int, default=4248)
+    parser.add_argument('--duration', type=float, default=10.0)
+    parser.add_argument('--top', type=int, default=30)
+    parser.add_argument('--save', type=Path)
+    parser.add_argument('--load', type=Path)
+    args = parser.parse_args()
+
+    symbols = Symbols(args.elf)
+    if args.load is not None:
+        datagrams = load(args.load)
+    else:
+        datagrams = receive(args.port, args.duration, args.save)
+
+    profile = Profile()
+    for data in datagrams:
+        profile.add(data)
+    print('\n'.join(report(profile, symbols, args.top)))
+
+
+if __name__ == '__main__':
+    main()
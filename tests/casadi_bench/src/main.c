@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2025 CogniPilot Foundation
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "lib/core/common/casadi/common.h"
+
+#if defined(CONFIG_CASADI_BENCH_RDD2)
+#include "app/rdd2/casadi/bezier.h"
+#include "app/rdd2/casadi/rdd2.h"
+#include "app/rdd2/casadi/rdd2_estimate.h"
+#include "app/rdd2/casadi/rdd2_loglinear.h"
+#elif defined(CONFIG_CASADI_BENCH_B3RB)
+#include "app/b3rb/casadi/b3rb.h"
+#elif defined(CONFIG_CASADI_BENCH_MELM)
+#include "app/melm/casadi/melm.h"
+#endif
+
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+#define FLOAT_TOL (CONFIG_CASADI_BENCH_FLOAT_TOL_PPM * 1e-6)
+#if defined(CONFIG_CASADI_BENCH_RDD2)
+#include "app/rdd2/casadi/bezier_f32.h"
+#include "app/rdd2/casadi/rdd2_f32.h"
+#include "app/rdd2/casadi/rdd2_estimate_f32.h"
+#include "app/rdd2/casadi/rdd2_loglinear_f32.h"
+#elif defined(CONFIG_CASADI_BENCH_B3RB)
+#include "app/b3rb/casadi/b3rb_f32.h"
+#elif defined(CONFIG_CASADI_BENCH_MELM)
+#include "app/melm/casadi/melm_f32.h"
+#endif
+#endif
+
+LOG_MODULE_REGISTER(casadi_bench, CONFIG_CASADI_BENCH_LOG_LEVEL);
+
+#define ITERATIONS CONFIG_CASADI_BENCH_ITERATIONS
+#define BUF_SIZE   CONFIG_CASADI_BENCH_BUF_SIZE
+#define STACK_SIZE CONFIG_CASADI_BENCH_STACK_SIZE
+
+typedef int (*casadi_eval_t)(const casadi_real **arg, casadi_real **res, casadi_int *iw,
+			     casadi_real *w, int mem);
+typedef int (*casadi_eval_f32_t)(const float **arg, float **res, casadi_int *iw, float *w,
+				 int mem);
+typedef const casadi_int *(*casadi_sparsity_t)(casadi_int i);
+
+struct bench {
+	const char *name;
+	casadi_eval_t eval;
+	// float32 copy, NULL where there is none
+	casadi_eval_f32_t eval_f32;
+	casadi_sparsity_t sparsity_in;
+	casadi_sparsity_t sparsity_out;
+	int sz_arg;
+	int sz_res;
+	int sz_iw;
+	int sz_w;
+};
+
+#define BENCH_FIELDS(fn)                                                                           \
+	.name = #fn, .eval = fn, .sparsity_in = fn##_sparsity_in,                                  \
+	.sparsity_out = fn##_sparsity_out, .sz_arg = fn##_SZ_ARG, .sz_res = fn##_SZ_RES,           \
+	.sz_iw = fn##_SZ_IW, .sz_w = fn##_SZ_W
+
+#define BENCH(fn)                                                                                  \
+	{                                                                                          \
+		BENCH_FIELDS(fn),                                                                  \
+	}
+
+// vehicle functions, which have a float32 copy when it is built
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+#define BENCH_F32(fn)                                                                              \
+	{                                                                                          \
+		BENCH_FIELDS(fn),                                                                  \
+		.eval_f32 = fn##_f32,                                                              \
+	}
+#else
+#define BENCH_F32(fn) BENCH(fn)
+#endif
+
+static const struct bench g_bench[] = {
+	// lib/core/common
+	BENCH(quat_to_eulerB321),
+	BENCH(eulerB321_to_quat),
+#if defined(CONFIG_CASADI_BENCH_RDD2)
+	// estimate
+	BENCH_F32(attitude_init),
+	BENCH_F32(yaw_init),
+	BENCH_F32(strapdown_ins_propagate),
+	BENCH_F32(position_correction),
+	BENCH_F32(attitude_estimator),
+	BENCH_F32(rotate_vector_w_to_b),
+	// fused over packed covariances
+	BENCH_F32(estimate_step),
+	BENCH_F32(estimate_propagate),
+	BENCH_F32(estimate_position_correction),
+	// command
+	BENCH_F32(input_acro),
+	BENCH_F32(input_auto_level),
+	BENCH_F32(input_velocity),
+	BENCH_F32(bezier_multirotor),
+	BENCH_F32(f_ref),
+	// position and attitude
+	BENCH_F32(rotate_vector_b_to_w),
+	BENCH_F32(position_control),
+	BENCH_F32(velocity_control),
+	BENCH_F32(attitude_control),
+	BENCH_F32(attitude_rate_control),
+	BENCH_F32(control_allocation),
+	// log linear control
+	BENCH_F32(se23_error),
+	BENCH_F32(se23_control),
+	BENCH_F32(se23_position_control),
+	BENCH_F32(se23_attitude_control),
+	BENCH_F32(so3_attitude_control),
+#elif defined(CONFIG_CASADI_BENCH_B3RB) || defined(CONFIG_CASADI_BENCH_MELM)
+	BENCH_F32(bezier6_solve),
+	BENCH_F32(bezier6_traj),
+	BENCH_F32(bezier6_rover),
+#if defined(CONFIG_CASADI_BENCH_B3RB)
+	BENCH_F32(ackermann_steering),
+#endif
+	BENCH_F32(differential_steering),
+	BENCH_F32(se2_error),
+	BENCH_F32(se2_U),
+	BENCH_F32(se2_U_inv),
+	BENCH_F32(predict),
+#endif
+};
+
+struct result {
+	uint32_t min;
+	uint32_t median;
+	uint32_t max;
+	size_t stack_used;
+	int rc;
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+	uint32_t median_f32;
+	double err_f32;
+#endif
+};
+
+static casadi_real g_in[BUF_SIZE];
+static casadi_real g_out[BUF_SIZE];
+static casadi_real g_w[BUF_SIZE];
+static casadi_int g_iw[BUF_SIZE];
+static const casadi_real *g_arg[BUF_SIZE];
+static casadi_real *g_res[BUF_SIZE];
+static uint32_t g_cycles[ITERATIONS];
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+static float g_in_f32[BUF_SIZE];
+static float g_out_f32[BUF_SIZE];
+static float g_w_f32[BUF_SIZE];
+static const float *g_arg_f32[BUF_SIZE];
+static float *g_res_f32[BUF_SIZE];
+#endif
+
+static struct k_thread g_thread;
+K_THREAD_STACK_DEFINE(g_stack, STACK_SIZE);
+
+/*
+ * Number of non zeros of a generated sparsity pattern: nrow, ncol,
+ * then either 1 for dense or the column offsets and row indices.
+ */
+static size_t sparsity_nnz(const casadi_int *sp)
+{
+	if (sp == NULL) {
+		return 0;
+	}
+	casadi_int nrow = sp[0];
+	casadi_int ncol = sp[1];
+	if (sp[2] == 1) {
+		return nrow * ncol;
+	}
+	return sp[2 + ncol];
+}
+
+/*
+ * Deterministic inputs in [-1, 1], 4 element inputs are normalized so that
+ * quaternion inputs take the same path through the code as in flight.
+ */
+static size_t fill_inputs(const struct bench *b)
+{
+	uint32_t seed = 12345;
+	size_t offset = 0;
+	for (int i = 0; i < b->sz_arg; i++) {
+		size_t nnz = sparsity_nnz(b->sparsity_in(i));
+		if (offset + nnz > BUF_SIZE) {
+			return 0;
+		}
+		double norm = 0;
+		for (size_t j = 0; j < nnz; j++) {
+			seed = seed * 1103515245 + 12345;
+			g_in[offset + j] = ((double)(seed >> 16) / 32768.0) - 1.0;
+			norm += g_in[offset + j] * g_in[offset + j];
+		}
+		if (nnz == 4 && norm > 0) {
+			for (size_t j = 0; j < nnz; j++) {
+				g_in[offset + j] /= sqrt(norm);
+			}
+		}
+		g_arg[i] = nnz > 0 ? &g_in[offset] : NULL;
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+		for (size_t j = 0; j < nnz; j++) {
+			g_in_f32[offset + j] = g_in[offset + j];
+		}
+		g_arg_f32[i] = nnz > 0 ? &g_in_f32[offset] : NULL;
+#endif
+		offset += nnz;
+	}
+	return offset;
+}
+
+static size_t assign_outputs(const struct bench *b)
+{
+	size_t offset = 0;
+	for (int i = 0; i < b->sz_res; i++) {
+		size_t nnz = sparsity_nnz(b->sparsity_out(i));
+		if (offset + nnz > BUF_SIZE) {
+			return 0;
+		}
+		g_res[i] = nnz > 0 ? &g_out[offset] : NULL;
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+		g_res_f32[i] = nnz > 0 ? &g_out_f32[offset] : NULL;
+#endif
+		offset += nnz;
+	}
+	return offset;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int call(const struct bench *b, bool f32)
+{
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+	if (f32) {
+		return b->eval_f32(g_arg_f32, g_res_f32, g_iw, g_w_f32, 0);
+	}
+#endif
+	return b->eval(g_arg, g_res, g_iw, g_w, 0);
+}
+
+static void bench_entry_point(void *p0, void *p1, void *p2)
+{
+	const struct bench *b = p0;
+	struct result *r = p1;
+	bool f32 = p2 != NULL;
+
+	// no function, measures the stack used by the runner itself
+	if (b == NULL) {
+		return;
+	}
+
+	// warm up caches and branch predictors
+	int rc = call(b, f32);
+
+	for (int i = 0; i < ITERATIONS; i++) {
+		uint32_t start = k_cycle_get_32();
+		call(b, f32);
+		g_cycles[i] = k_cycle_get_32() - start;
+	}
+
+	qsort(g_cycles, ITERATIONS, sizeof(g_cycles[0]), compare_u32);
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+	if (f32) {
+		r->median_f32 = g_cycles[ITERATIONS / 2];
+		return;
+	}
+#endif
+	r->rc = rc;
+	r->min = g_cycles[0];
+	r->median = g_cycles[ITERATIONS / 2];
+	r->max = g_cycles[ITERATIONS - 1];
+}
+
+static size_t run(const struct bench *b, struct result *r, bool f32)
+{
+	// a fresh thread repaints the stack, so the high water mark is per function
+	k_thread_create(&g_thread, g_stack, K_THREAD_STACK_SIZEOF(g_stack), bench_entry_point,
+			(void *)b, r, f32 ? (void *)b : NULL, K_PRIO_PREEMPT(0), 0, K_NO_WAIT);
+	k_thread_name_set(&g_thread, "casadi_bench");
+	k_thread_join(&g_thread, K_FOREVER);
+
+	size_t unused = 0;
+	if (k_thread_stack_space_get(&g_thread, &unused) != 0) {
+		return 0;
+	}
+	return K_THREAD_STACK_SIZEOF(g_stack) - unused;
+}
+
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+/*
+ * Largest difference between the float32 and double outputs, scaled by
+ * the larger of 1 and the double value. An output finite in one and not
+ * the other counts as infinite.
+ */
+static double float_error(size_t n_out)
+{
+	double err = 0;
+	for (size_t i = 0; i < n_out; i++) {
+		double d = g_out[i];
+		double f = g_out_f32[i];
+		if (!isfinite(d) != !isfinite(f)) {
+			return INFINITY;
+		} else if (!isfinite(d)) {
+			continue;
+		}
+		double e = fabs(f - d) / fmax(1.0, fabs(d));
+		err = e > err ? e : err;
+	}
+	return err;
+}
+#endif
+
+static uint32_t cyc_to_ns(uint32_t cyc)
+{
+	return (uint32_t)(1000000000ULL * cyc / sys_clock_hw_cycles_per_sec());
+}
+
+int main(void)
+{
+	struct result baseline = {};
+	size_t stack_baseline = run(NULL, &baseline, false);
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+	int over_tol = 0;
+#endif
+
+	printf("casadi bench: %d calls per function, %u cycles per second\n", ITERATIONS,
+	       sys_clock_hw_cycles_per_sec());
+	printf("%-24s %8s %8s %8s %8s %6s %6s %6s\n", "function", "min", "median", "max",
+	       "med ns", "stack", "w", "iw");
+
+	for (size_t i = 0; i < ARRAY_SIZE(g_bench); i++) {
+		const struct bench *b = &g_bench[i];
+		size_t n_out = 0;
+
+		if (b->sz_arg > BUF_SIZE || b->sz_res > BUF_SIZE || b->sz_w > BUF_SIZE ||
+		    b->sz_iw > BUF_SIZE || (b->sz_arg > 0 && fill_inputs(b) == 0) ||
+		    (b->sz_res > 0 && (n_out = assign_outputs(b)) == 0)) {
+			LOG_ERR("%s does not fit CONFIG_CASADI_BENCH_BUF_SIZE", b->name);
+			continue;
+		}
+
+		struct result r = {};
+		size_t stack = run(b, &r, false);
+		if (r.rc != 0) {
+			LOG_WRN("%s returned %d", b->name, r.rc);
+		}
+
+		// w and iw are static at each CASADI_FUNC_ARGS call site, listed in bytes
+		printf("%-24s %8u %8u %8u %8u %6u %6u %6u\n", b->name, r.min, r.median, r.max,
+		       cyc_to_ns(r.median), (unsigned)(stack - stack_baseline),
+		       (unsigned)(b->sz_w * sizeof(casadi_real)),
+		       (unsigned)(b->sz_iw * sizeof(casadi_int)));
+
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+		if (b->eval_f32 == NULL) {
+			continue;
+		}
+		// the double outputs are left from the last timed call
+		run(b, &r, true);
+		r.err_f32 = float_error(n_out);
+		printf("%-24s %8s %8u %8s %8u err %.3g ppm\n", "  f32", "", r.median_f32, "",
+		       cyc_to_ns(r.median_f32), r.err_f32 * 1e6);
+		if (!(r.err_f32 <= FLOAT_TOL)) {
+			LOG_WRN("%s float32 error %.3g ppm over %d ppm", b->name, r.err_f32 * 1e6,
+				CONFIG_CASADI_BENCH_FLOAT_TOL_PPM);
+			over_tol++;
+		}
+#endif
+	}
+
+#if defined(CONFIG_CASADI_BENCH_FLOAT)
+	printf("casadi bench: %d float32 functions over %d ppm\n", over_tol,
+	       CONFIG_CASADI_BENCH_FLOAT_TOL_PPM);
+#endif
+	printf("casadi bench: complete\n");
+	return 0;
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,270 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+// zephyr
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/printk.h>
+
+// zros
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_sub_struct.h>
+#include <zros/zros_node.h>
+#include <zros/zros_sub.h>
+
+#include <cerebri/core/perf_histogram.h>
+#include <cerebri/core/workq.h>
+
+#include <synapse_shell_print.h>
+#include <synapse_topic_list.h>
+
+/*
+ * Control loop benchmark. Synthetic imu samples are published on topic_imu
+ * from the high priority work queue as sense_imu does, and the rdd2 nodes
+ * built into the image take them through estimate, attitude, angular
+ * velocity and allocation to topic_actuators, where a stub actuator thread
+ * takes the place of dshot. Status, input and magnetic field stand in for
+ * fsm, sbus and sense_mag at 50 Hz.
+ *
+ * lat_us is the time from the imu publish to the actuators of that sample
+ * reaching the stub. A sample is missed if its actuators take longer than
+ * the deadline, or, unanswered, if none arrive before the next imu sample.
+ * The result is one json line starting with "bench: " so runs under
+ * different load, scheduler or broker changes can be diffed by a script.
+ */
+
+#define BENCH_STACK_SIZE 4096
+// the actuator stub runs at the priority of the dshot thread
+#define BENCH_PRIO_STUB  2
+#define BENCH_PRIO_ECHO  10
+#define BENCH_PRIO_MAIN  8
+#define IMU_PERIOD_US    CONFIG_CONTROL_LOOP_BENCH_IMU_PERIOD_US
+#define SLOW_PERIOD_MS   20
+
+LOG_MODULE_REGISTER(control_loop_bench, CONFIG_CONTROL_LOOP_BENCH_LOG_LEVEL);
+
+extern struct k_work_q g_high_priority_work_q;
+extern struct k_work_q g_low_priority_work_q;
+
+static void bench_imu_work_handler(struct k_work *work);
+static void bench_slow_work_handler(struct k_work *work);
+static void bench_imu_timer_handler(struct k_timer *timer);
+static void bench_slow_timer_handler(struct k_timer *timer);
+
+struct bench {
+	struct workq_item imu_item;
+	struct workq_item slow_item;
+	struct k_timer imu_timer;
+	struct k_timer slow_timer;
+	synapse_pb_Imu imu;
+	synapse_pb_MagneticField mag;
+	synapse_pb_Status status;
+	synapse_pb_Input input;
+	// cycle count of the last imu publish, and samples published and answered
+	atomic_t imu_cyc;
+	atomic_t imu_seq;
+	atomic_t answered_seq;
+	// counted only between start and the end of the run
+	atomic_t measuring;
+	uint32_t imus;
+	uint32_t actuators;
+	uint32_t misses;
+	uint32_t unanswered;
+	uint32_t max_cyc;
+	struct perf_histogram latency;
+};
+
+static struct bench g_bench = {
+	.imu_item = WORKQ_ITEM_INITIALIZER(bench_imu_work_handler, "bench_imu", IMU_PERIOD_US),
+	.slow_item = WORKQ_ITEM_INITIALIZER(bench_slow_work_handler, "bench_slow", 10000),
+	.imu_timer = Z_TIMER_INITIALIZER(g_bench.imu_timer, bench_imu_timer_handler, NULL),
+	.slow_timer = Z_TIMER_INITIALIZER(g_bench.slow_timer, bench_slow_timer_handler, NULL),
+	.imu =
+		{
+			.has_stamp = true,
+			.has_angular_velocity = true,
+			.has_linear_acceleration = true,
+		},
+	.mag = {.has_stamp = true, .has_magnetic_field = true},
+	.status =
+		{
+			.has_stamp = true,
+			.arming = synapse_pb_Status_Arming_ARMING_ARMED,
+			.mode = synapse_pb_Status_Mode_MODE_ATTITUDE,
+			.input_source = synapse_pb_Status_InputSource_INPUT_SOURCE_RADIO_CONTROL,
+			.input_status = synapse_pb_Status_LinkStatus_STATUS_NOMINAL,
+		},
+	.input = {.has_timestamp = true, .channel_count = 16},
+};
+
+static void bench_imu_timer_handler(struct k_timer *timer)
+{
+	struct bench *bench = CONTAINER_OF(timer, struct bench, imu_timer);
+	workq_submit(&g_high_priority_work_q, &bench->imu_item);
+}
+
+static void bench_slow_timer_handler(struct k_timer *timer)
+{
+	struct bench *bench = CONTAINER_OF(timer, struct bench, slow_timer);
+	workq_submit(&g_low_priority_work_q, &bench->slow_item);
+}
+
+// level and still, with a slow wobble so the controllers have something to do
+static void bench_imu_work_handler(struct k_work *work)
+{
+	struct bench *bench = CONTAINER_OF(work, struct bench, imu_item.work);
+	uint32_t seq = atomic_get(&bench->imu_seq);
+	float t = seq * (IMU_PERIOD_US * 1e-6f);
+
+	if (atomic_get(&bench->measuring)) {
+		bench->imus++;
+		if ((uint32_t)atomic_get(&bench->answered_seq) != seq) {
+			bench->unanswered++;
+		}
+	}
+
+	stamp_msg_now(&bench->imu.stamp);
+	bench->imu.angular_velocity.x = 0.1f * sinf(2 * 3.14159f * t);
+	bench->imu.angular_velocity.y = 0.1f * cosf(2 * 3.14159f * t);
+	bench->imu.angular_velocity.z = 0;
+	bench->imu.linear_acceleration.x = 0;
+	bench->imu.linear_acceleration.y = 0;
+	bench->imu.linear_acceleration.z = 9.8f;
+
+	atomic_set(&bench->imu_cyc, k_cycle_get_32());
+	atomic_set(&bench->imu_seq, seq + 1);
+	synapse_topic_republish(&topic_imu, &bench->imu);
+}
+
+static void bench_slow_work_handler(struct k_work *work)
+{
+	struct bench *bench = CONTAINER_OF(work, struct bench, slow_item.work);
+
+	stamp_msg_now(&bench->mag.stamp);
+	bench->mag.magnetic_field.x = 0.2f;
+	bench->mag.magnetic_field.y = 0;
+	bench->mag.magnetic_field.z = 0.4f;
+	synapse_topic_republish(&topic_magnetic_field, &bench->mag);
+
+	stamp_msg_now(&bench->status.stamp);
+	synapse_topic_republish(&topic_status, &bench->status);
+
+	stamp_msg_now(&bench->input.timestamp);
+	synapse_topic_republish(&topic_input_sbus, &bench->input);
+}
+
+// stands in for dshot, takes every actuator message
+static void bench_stub_entry_point(void *p0, void *p1, void *p2)
+{
+	struct bench *bench = p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	static synapse_pb_Actuators actuators;
+	struct zros_node node = {};
+	struct zros_sub sub = {};
+	const uint32_t deadline_cyc = k_us_to_cyc_ceil32(CONFIG_CONTROL_LOOP_BENCH_DEADLINE_US);
+
+	zros_node_init(&node, "bench_actuate");
+	zros_sub_init(&sub, &node, &topic_actuators, &actuators, 2 * 1000000 / IMU_PERIOD_US);
+
+	struct k_poll_event events[] = {
+		*zros_sub_get_event(&sub),
+	};
+
+	while (true) {
+		int rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(100));
+		if (rc != 0 || !zros_sub_update_available(&sub)) {
+			continue;
+		}
+		uint32_t cyc = k_cycle_get_32() - (uint32_t)atomic_get(&bench->imu_cyc);
+		zros_sub_update(&sub);
+		atomic_set(&bench->answered_seq, atomic_get(&bench->imu_seq));
+		if (!atomic_get(&bench->measuring)) {
+			continue;
+		}
+		perf_histogram_record(&bench->latency, cyc);
+		bench->max_cyc = MAX(bench->max_cyc, cyc);
+		bench->actuators++;
+		if (cyc > deadline_cyc) {
+			bench->misses++;
+		}
+	}
+}
+
+K_THREAD_DEFINE(bench_stub, BENCH_STACK_SIZE, bench_stub_entry_point, &g_bench, NULL, NULL,
+		BENCH_PRIO_STUB, 0, 0);
+
+#if CONFIG_CONTROL_LOOP_BENCH_ECHO_HZ > 0
+// the load of a shell echoing the imu topic on the console
+static void bench_echo_entry_point(void *p0, void *p1, void *p2)
+{
+	struct bench *bench = p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	static char buf[512];
+	static synapse_pb_Imu imu;
+
+	while (true) {
+		k_msleep(1000 / CONFIG_CONTROL_LOOP_BENCH_ECHO_HZ);
+		imu = bench->imu;
+		snprint_imu(buf, sizeof(buf), &imu);
+		printk("%s\n", buf);
+	}
+}
+
+K_THREAD_DEFINE(bench_echo, BENCH_STACK_SIZE, bench_echo_entry_point, &g_bench, NULL, NULL,
+		BENCH_PRIO_ECHO, 0, 0);
+#endif
+
+static uint32_t cyc_to_us(uint32_t cyc)
+{
+	return k_cyc_to_us_ceil32(cyc);
+}
+
+static void bench_report(const struct bench *bench)
+{
+	const struct perf_histogram *lat = &bench->latency;
+
+	printk("bench: {\"board\":\"%s\",\"imu_hz\":%u,\"deadline_us\":%u,\"log_sdcard\":%d,"
+	       "\"eth_tx\":%d,\"echo_hz\":%d,\"imus\":%u,\"actuators\":%u,"
+	       "\"lat_us_p50\":%u,\"lat_us_p90\":%u,\"lat_us_p99\":%u,\"lat_us_p999\":%u,"
+	       "\"lat_us_max\":%u,\"misses\":%u,\"unanswered\":%u}\n",
+	       CONFIG_BOARD, 1000000U / IMU_PERIOD_US, CONFIG_CONTROL_LOOP_BENCH_DEADLINE_US,
+	       IS_ENABLED(CONFIG_CEREBRI_SYNAPSE_LOG_SDCARD),
+	       IS_ENABLED(CONFIG_CEREBRI_SYNAPSE_ETH_TX), CONFIG_CONTROL_LOOP_BENCH_ECHO_HZ,
+	       bench->imus, bench->actuators, cyc_to_us(perf_histogram_percentile(lat, 5000)),
+	       cyc_to_us(perf_histogram_percentile(lat, 9000)),
+	       cyc_to_us(perf_histogram_percentile(lat, 9900)),
+	       cyc_to_us(perf_histogram_percentile(lat, 9990)), cyc_to_us(bench->max_cyc),
+	       bench->misses, bench->unanswered);
+}
+
+int main(void)
+{
+	struct bench *bench = &g_bench;
+
+	k_timer_start(&bench->slow_timer, K_NO_WAIT, K_MSEC(SLOW_PERIOD_MS));
+	k_timer_start(&bench->imu_timer, K_NO_WAIT, K_USEC(IMU_PERIOD_US));
+
+	// the estimator initializes from the first imu and mag samples
+	k_msleep(CONFIG_CONTROL_LOOP_BENCH_WARMUP_MS);
+	LOG_INF("measuring for %d ms", CONFIG_CONTROL_LOOP_BENCH_DURATION_MS);
+	atomic_set(&bench->answered_seq, atomic_get(&bench->imu_seq));
+	atomic_set(&bench->measuring, 1);
+	k_msleep(CONFIG_CONTROL_LOOP_BENCH_DURATION_MS);
+	atomic_set(&bench->measuring, 0);
+
+	k_timer_stop(&bench->imu_timer);
+	k_timer_stop(&bench->slow_timer);
+	bench_report(bench);
+	printk("bench: done\n");
+	return 0;
+}
+
+// vi: ts=4 sw=4 et
@@ -0,0 +1,274 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+// zephyr
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/printk.h>
+
+// zros
+#include <zros/private/zros_node_struct.h>
+#include <zros/private/zros_pub_struct.h>
+#include <zros/private/zros_sub_struct.h>
+#include <zros/private/zros_topic_struct.h>
+#include <zros/zros_broker.h>
+#include <zros/zros_node.h>
+#include <zros/zros_pub.h>
+#include <zros/zros_sub.h>
+#include <zros/zros_topic.h>
+
+#include <cerebri/core/perf_histogram.h>
+
+#include <synapse_topic_list.h>
+
+/*
+ * Broker benchmark, sweeps message size, publisher and subscriber count and
+ * subscriber rate limit. Every case prints one json line starting with
+ * "bench: " so runs on native_posix and the boards can be diffed by a script.
+ *
+ * pub_cyc is the cost of zros_pub_update, lat_cyc the time from the start
+ * of the last publish to the subscriber waking up, both in cycles.
+ */
+
+#define BENCH_STACK_SIZE 4096
+#define BENCH_MAX_PUBS   4
+#define BENCH_MAX_SUBS   8
+#define BENCH_PRIO_SUB   6
+#define BENCH_PRIO_PUB   7
+#define BENCH_PRIO_MAIN  8
+
+LOG_MODULE_DECLARE(pubsub);
+
+ZROS_TOPIC_DEFINE(bench_vector3, synapse_pb_Vector3);
+ZROS_TOPIC_DEFINE(bench_imu, synapse_pb_Imu);
+ZROS_TOPIC_DEFINE(bench_odometry, synapse_pb_Odometry);
+ZROS_TOPIC_DEFINE(bench_bezier_trajectory, synapse_pb_BezierTrajectory);
+
+union bench_msg {
+	synapse_pb_Vector3 vector3;
+	synapse_pb_Imu imu;
+	synapse_pb_Odometry odometry;
+	synapse_pb_BezierTrajectory bezier_trajectory;
+};
+
+struct bench_topic {
+	const char *name;
+	struct zros_topic *topic;
+	size_t size;
+};
+
+static const struct bench_topic g_topics[] = {
+	{"vector3", &topic_bench_vector3, sizeof(synapse_pb_Vector3)},
+	{"imu", &topic_bench_imu, sizeof(synapse_pb_Imu)},
+	{"odometry", &topic_bench_odometry, sizeof(synapse_pb_Odometry)},
+	{"bezier_trajectory", &topic_bench_bezier_trajectory, sizeof(synapse_pb_BezierTrajectory)},
+};
+
+static const int g_pub_counts[] = {1, 2, 4};
+static const int g_sub_counts[] = {1, 4, 8};
+// 0 is a rate limit above the publish rate, so every message is taken
+static const int g_sub_rates_hz[] = {0, 50};
+
+BUILD_ASSERT(BENCH_MAX_PUBS >= 4 && BENCH_MAX_SUBS >= 8, "sweep exceeds thread pool");
+
+struct bench_run {
+	const struct bench_topic *topic;
+	int sub_rate_hz;
+	int64_t end_ms;
+	atomic_t stop;
+	atomic_t publish_cyc;
+	uint32_t publishes[BENCH_MAX_PUBS];
+	uint32_t publish_max_cyc[BENCH_MAX_PUBS];
+	uint32_t updates[BENCH_MAX_SUBS];
+	struct perf_histogram publish;
+	struct perf_histogram latency;
+};
+
+static struct bench_run g_run;
+
+static union bench_msg g_pub_msg[BENCH_MAX_PUBS];
+static union bench_msg g_sub_msg[BENCH_MAX_SUBS];
+
+static K_THREAD_STACK_ARRAY_DEFINE(g_pub_stack, BENCH_MAX_PUBS, BENCH_STACK_SIZE);
+static K_THREAD_STACK_ARRAY_DEFINE(g_sub_stack, BENCH_MAX_SUBS, BENCH_STACK_SIZE);
+static struct k_thread g_pub_thread[BENCH_MAX_PUBS];
+static struct k_thread g_sub_thread[BENCH_MAX_SUBS];
+
+static void bench_pub(void *p0, void *p1, void *p2)
+{
+	int id = (int)(intptr_t)p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	struct bench_run *run = &g_run;
+	union bench_msg *msg = &g_pub_msg[id];
+	struct zros_node node = {};
+	struct zros_pub pub = {};
+	char name[20];
+
+	snprintf(name, sizeof(name), "bench pub %d", id);
+	zros_node_init(&node, name);
+	if (zros_pub_init(&pub, &node, run->topic->topic, msg) != 0) {
+		LOG_ERR("bench pub %d init failed", id);
+		zros_node_fini(&node);
+		return;
+	}
+
+	while (k_uptime_get() < run->end_ms) {
+		k_usleep(CONFIG_PUBSUB_BENCH_PUB_PERIOD_US);
+
+		// touch the whole message, as a sensor driver filling it would
+		memset(msg, (uint8_t)run->publishes[id], run->topic->size);
+
+		uint32_t start = k_cycle_get_32();
+		atomic_set(&run->publish_cyc, start);
+		zros_pub_update(&pub);
+		uint32_t cyc = k_cycle_get_32() - start;
+
+		perf_histogram_record(&run->publish, cyc);
+		run->publish_max_cyc[id] = MAX(run->publish_max_cyc[id], cyc);
+		run->publishes[id]++;
+	}
+
+	zros_pub_fini(&pub);
+	zros_node_fini(&node);
+}
+
+static void bench_sub(void *p0, void *p1, void *p2)
+{
+	int id = (int)(intptr_t)p0;
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	struct bench_run *run = &g_run;
+	struct zros_node node = {};
+	struct zros_sub sub = {};
+	char name[20];
+
+	// above the publish rate means every message passes the rate limit
+	int rate_hz = run->sub_rate_hz > 0 ? run->sub_rate_hz
+					   : 2 * 1000000 / CONFIG_PUBSUB_BENCH_PUB_PERIOD_US;
+
+	snprintf(name, sizeof(name), "bench sub %d", id);
+	zros_node_init(&node, name);
+	if (zros_sub_init(&sub, &node, run->topic->topic, &g_sub_msg[id], rate_hz) != 0) {
+		LOG_ERR("bench sub %d init failed", id);
+		zros_node_fini(&node);
+		return;
+	}
+
+	struct k_poll_event events[] = {
+		*zros_sub_get_event(&sub),
+	};
+
+	while (!atomic_get(&run->stop)) {
+		int rc = k_poll(events, ARRAY_SIZE(events), K_MSEC(100));
+		if (rc != 0 || !zros_sub_update_available(&sub)) {
+			continue;
+		}
+		perf_histogram_record(&run->latency,
+				      k_cycle_get_32() - (uint32_t)atomic_get(&run->publish_cyc));
+		zros_sub_update(&sub);
+		run->updates[id]++;
+	}
+
+	zros_sub_fini(&sub);
+	zros_node_fini(&node);
+}
+
+static void bench_report(const struct bench_run *run, int pubs, int subs)
+{
+	uint32_t publishes = 0;
+	uint32_t publish_max_cyc = 0;
+	uint32_t updates = 0;
+
+	for (int i = 0; i < pubs; i++) {
+		publishes += run->publishes[i];
+		publish_max_cyc = MAX(publish_max_cyc, run->publish_max_cyc[i]);
+	}
+	for (int i = 0; i < subs; i++) {
+		updates += run->updates[i];
+	}
+
+	uint32_t ms = CONFIG_PUBSUB_BENCH_DURATION_MS;
+	printk("bench: {\"board\":\"%s\",\"msg\":\"%s\",\"size\":%u,\"pubs\":%d,\"subs\":%d,"
+	       "\"sub_rate_hz\":%d,\"cyc_per_us\":%u,\"publishes\":%u,\"pub_hz\":%u,"
+	       "\"pub_cyc_p50\":%u,\"pub_cyc_p99\":%u,\"pub_cyc_max\":%u,"
+	       "\"lat_cyc_p50\":%u,\"lat_cyc_p90\":%u,\"lat_cyc_p99\":%u,\"lat_cyc_p999\":%u,"
+	       "\"sub_hz\":%u}\n",
+	       CONFIG_BOARD, run->topic->name, (unsigned int)run->topic->size, pubs, subs,
+	       run->sub_rate_hz, sys_clock_hw_cycles_per_sec() / 1000000U, publishes,
+	       (uint32_t)((uint64_t)publishes * 1000 / ms),
+	       perf_histogram_percentile(&run->publish, 5000),
+	       perf_histogram_percentile(&run->publish, 9900), publish_max_cyc,
+	       perf_histogram_percentile(&run->latency, 5000),
+	       perf_histogram_percentile(&run->latency, 9000),
+	       perf_histogram_percentile(&run->latency, 9900),
+	       perf_histogram_percentile(&run->latency, 9990),
+	       (uint32_t)((uint64_t)updates * 1000 / ms / subs));
+}
+
+static void bench_case(const struct bench_topic *topic, int pubs, int subs, int sub_rate_hz)
+{
+	struct bench_run *run = &g_run;
+
+	memset(run, 0, sizeof(*run));
+	run->topic = topic;
+	run->sub_rate_hz = sub_rate_hz;
+	// subscribers have to be ready before the first publish
+	run->end_ms = k_uptime_get() + 10 + CONFIG_PUBSUB_BENCH_DURATION_MS;
+
+	for (int i = 0; i < subs; i++) {
+		k_thread_create(&g_sub_thread[i], g_sub_stack[i], BENCH_STACK_SIZE, bench_sub,
+				(void *)(intptr_t)i, NULL, NULL, BENCH_PRIO_SUB, 0, K_NO_WAIT);
+	}
+	k_msleep(10);
+	for (int i = 0; i < pubs; i++) {
+		k_thread_create(&g_pub_thread[i], g_pub_stack[i], BENCH_STACK_SIZE, bench_pub,
+				(void *)(intptr_t)i, NULL, NULL, BENCH_PRIO_PUB, 0, K_NO_WAIT);
+	}
+
+	for (int i = 0; i < pubs; i++) {
+		k_thread_join(&g_pub_thread[i], K_FOREVER);
+	}
+	atomic_set(&run->stop, 1);
+	for (int i = 0; i < subs; i++) {
+		k_thread_join(&g_sub_thread[i], K_FOREVER);
+	}
+
+	bench_report(run, pubs, subs);
+}
+
+static void bench_entry_point(void *p0, void *p1, void *p2)
+{
+	ARG_UNUSED(p0);
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	for (size_t i = 0; i < ARRAY_SIZE(g_topics); i++) {
+		zros_broker_add_topic(g_topics[i].topic);
+	}
+
+	for (size_t t = 0; t < ARRAY_SIZE(g_topics); t++) {
+		for (size_t p = 0; p < ARRAY_SIZE(g_pub_counts); p++) {
+			for (size_t s = 0; s < ARRAY_SIZE(g_sub_counts); s++) {
+				for (size_t r = 0; r < ARRAY_SIZE(g_sub_rates_hz); r++) {
+					bench_case(&g_topics[t], g_pub_counts[p], g_sub_counts[s],
+						   g_sub_rates_hz[r]);
+				}
+			}
+		}
+	}
+	printk("bench: done\n");
+}
+
+K_THREAD_DEFINE(bench, BENCH_STACK_SIZE, bench_entry_point, NULL, NULL, NULL, BENCH_PRIO_MAIN, 0,
+		1000);
+
+// vi: ts=4 sw=4 et
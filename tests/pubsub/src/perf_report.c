@@ -0,0 +1,89 @@
+/*
+ * Copyright CogniPilot Foundation 2025
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+// zephyr
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+#include <cerebri/core/perf_counter.h>
+#include <cerebri/core/perf_duration.h>
+
+/*
+ * Fills the perf lists past the size of the report buffer and checks that
+ * the list reports truncate inside it. Every report is written into a
+ * buffer followed by a guard, which must be left as it was.
+ */
+
+#define PERF_REPORT_ENTRIES 16
+#define PERF_REPORT_GUARD   0xa5
+
+static struct perf_counter g_counters[PERF_REPORT_ENTRIES];
+static struct perf_duration g_durations[PERF_REPORT_ENTRIES];
+static char g_names[PERF_REPORT_ENTRIES][32];
+
+static struct {
+	char buf[256];
+	uint8_t guard[64];
+} g_report;
+
+static bool perf_report_check(const char *name, void (*report)(char *buf, size_t n), size_t n)
+{
+	memset(&g_report, PERF_REPORT_GUARD, sizeof(g_report));
+	report(g_report.buf, n);
+
+	for (size_t i = n; i < sizeof(g_report); i++) {
+		if (((const uint8_t *)&g_report)[i] != PERF_REPORT_GUARD) {
+			printk("perf_report: %s n %u wrote byte %u\n", name, (unsigned)n,
+			       (unsigned)i);
+			return false;
+		}
+	}
+	size_t len = strnlen(g_report.buf, n);
+	// the lists hold more than fits, so the report fills the buffer
+	if (len != n - 1) {
+		printk("perf_report: %s n %u length %u\n", name, (unsigned)n, (unsigned)len);
+		return false;
+	}
+	return true;
+}
+
+static void perf_report_entry_point(void *p0, void *p1, void *p2)
+{
+	ARG_UNUSED(p0);
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+
+	for (int i = 0; i < PERF_REPORT_ENTRIES; i++) {
+		snprintk(g_names[i], sizeof(g_names[i]), "perf_report_%02d", i);
+		perf_counter_init(&g_counters[i], g_names[i], 0.01);
+		perf_counter_update(&g_counters[i]);
+		perf_counter_update(&g_counters[i]);
+		perf_duration_init(&g_durations[i], g_names[i], 0.01);
+		perf_duration_start(&g_durations[i]);
+		perf_duration_stop(&g_durations[i]);
+	}
+
+	static const size_t sizes[] = {1, 2, 100, sizeof(g_report.buf)};
+	bool pass = true;
+	for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+		pass &= perf_report_check("counter", perf_counter_list_report, sizes[i]);
+		pass &= perf_report_check("counter hist", perf_counter_list_hist_report, sizes[i]);
+		pass &= perf_report_check("duration", perf_duration_list_report, sizes[i]);
+		pass &= perf_report_check("duration hist", perf_duration_list_hist_report,
+					  sizes[i]);
+	}
+
+	for (int i = 0; i < PERF_REPORT_ENTRIES; i++) {
+		perf_counter_fini(&g_counters[i]);
+		perf_duration_fini(&g_durations[i]);
+	}
+	printk("perf_report: %s\n", pass ? "pass" : "fail");
+}
+
+K_THREAD_DEFINE(perf_report, 2048, perf_report_entry_point, NULL, NULL, NULL, 8, 0, 1000);
+
+// vi: ts=4 sw=4 et